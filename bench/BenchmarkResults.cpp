@@ -0,0 +1,327 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "BenchmarkResults.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+/**
+ * Tree of the metrics used to write the flat "a/b/c" keys of the metrics as nested JSON objects
+ */
+struct JSONMetricsNode
+{
+    std::map<std::string, JSONMetricsNode> children;
+    double value = 0.0;
+};
+
+static std::string json_escape(const std::string& string)
+{
+    std::string escaped;
+    for (char character : string)
+    {
+        if (character == '"' || character == '\\')
+            escaped += '\\';
+        escaped += character;
+    }
+
+    return escaped;
+}
+
+static void write_json_node(std::ostream& stream, const JSONMetricsNode& node, int indentation)
+{
+    if (node.children.empty())
+    {
+        stream << node.value;
+
+        return;
+    }
+
+    std::string indent(indentation * 4, ' ');
+    stream << "{" << std::endl;
+    for (auto it = node.children.begin(); it != node.children.end(); it++)
+    {
+        stream << indent << "    \"" << json_escape(it->first) << "\": ";
+        write_json_node(stream, it->second, indentation + 1);
+        stream << (std::next(it) == node.children.end() ? "" : ",") << std::endl;
+    }
+    stream << indent << "}";
+}
+
+bool BenchmarkResults::write_json(const std::string& file_path) const
+{
+    JSONMetricsNode root;
+    for (const auto& [key, value] : get_metrics())
+    {
+        JSONMetricsNode* node = &root;
+
+        std::stringstream key_stream(key);
+        std::string key_part;
+        while (std::getline(key_stream, key_part, '/'))
+            node = &node->children[key_part];
+
+        node->value = value;
+    }
+
+    std::ofstream file(file_path);
+    if (!file.is_open())
+        return false;
+
+    file << std::setprecision(15);
+    write_json_node(file, root, 0);
+    file << std::endl;
+
+    return true;
+}
+
+std::map<std::string, double> BenchmarkResults::get_metrics() const
+{
+    std::map<std::string, double> metrics;
+
+    metrics["settings/width"] = settings.width;
+    metrics["settings/height"] = settings.height;
+    metrics["settings/samples"] = settings.samples;
+    metrics["settings/bounces"] = settings.bounces;
+    metrics["settings/tile_size"] = settings.tile_size;
+    metrics["settings/bvh_type"] = settings.bvh_type;
+    metrics["settings/gmon"] = settings.gmon;
+    metrics["settings/wavefront"] = settings.wavefront;
+
+    for (const BenchmarkSceneResult& scene : scenes)
+    {
+        std::string prefix = "scenes/" + scene.name + "/";
+
+        metrics[prefix + "scene_load_ms"] = scene.scene_load_ms;
+        metrics[prefix + "bvh_build_ms"] = scene.bvh_build_ms;
+        metrics[prefix + "render_ms"] = scene.render_ms;
+        metrics[prefix + "primary_rays"] = static_cast<double>(scene.primary_rays);
+        metrics[prefix + "secondary_rays"] = static_cast<double>(scene.secondary_rays);
+        metrics[prefix + "shadow_rays"] = static_cast<double>(scene.shadow_rays);
+        metrics[prefix + "primary_rays_per_second"] = scene.primary_rays_per_second;
+        metrics[prefix + "secondary_rays_per_second"] = scene.secondary_rays_per_second;
+        metrics[prefix + "shadow_rays_per_second"] = scene.shadow_rays_per_second;
+        metrics[prefix + "bvh_nodes_per_ray"] = scene.bvh_nodes_per_ray;
+        metrics[prefix + "triangles_per_ray"] = scene.triangles_per_ray;
+
+        if (settings.gmon)
+        {
+            metrics[prefix + "gmon_memory_bytes"] = scene.gmon_memory_bytes;
+            metrics[prefix + "gmon_updates"] = scene.gmon_updates;
+            metrics[prefix + "gmon_update_ms"] = scene.gmon_update_ms;
+        }
+
+        for (const auto& [pass_name, pass] : scene.passes)
+        {
+            std::string pass_prefix = prefix + "passes/" + pass_name + "/";
+
+            metrics[pass_prefix + "total_ms"] = pass.total_ms;
+            metrics[pass_prefix + "average_ms"] = pass.average_ms;
+            metrics[pass_prefix + "pixel_samples_per_second"] = pass.pixel_samples_per_second;
+        }
+    }
+
+    return metrics;
+}
+
+/**
+ * Minimal JSON reader that only keeps the numbers of the document,
+ * keyed by their path in the objects joined with '/'
+ */
+class JSONMetricsReader
+{
+public:
+    JSONMetricsReader(const std::string& text) : m_text(text) {}
+
+    bool read(std::map<std::string, double>& out_metrics)
+    {
+        if (!read_value("", out_metrics))
+            return false;
+
+        skip_whitespaces();
+        return m_position == m_text.size();
+    }
+
+private:
+    void skip_whitespaces()
+    {
+        while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position])))
+            m_position++;
+    }
+
+    bool read_string(std::string& out_string)
+    {
+        if (m_text[m_position] != '"')
+            return false;
+
+        m_position++;
+        while (m_position < m_text.size() && m_text[m_position] != '"')
+        {
+            if (m_text[m_position] == '\\')
+                m_position++;
+
+            if (m_position < m_text.size())
+                out_string += m_text[m_position++];
+        }
+
+        if (m_position >= m_text.size())
+            return false;
+
+        // Closing quote
+        m_position++;
+        return true;
+    }
+
+    bool read_value(const std::string& key, std::map<std::string, double>& out_metrics)
+    {
+        skip_whitespaces();
+        if (m_position >= m_text.size())
+            return false;
+
+        char character = m_text[m_position];
+        if (character == '{' || character == '[')
+        {
+            char closing_character = character == '{' ? '}' : ']';
+            m_position++;
+
+            int array_index = 0;
+            skip_whitespaces();
+            if (m_position < m_text.size() && m_text[m_position] == closing_character)
+            {
+                m_position++;
+
+                return true;
+            }
+
+            while (true)
+            {
+                std::string child_key;
+                if (character == '{')
+                {
+                    skip_whitespaces();
+                    if (!read_string(child_key))
+                        return false;
+
+                    skip_whitespaces();
+                    if (m_position >= m_text.size() || m_text[m_position] != ':')
+                        return false;
+                    m_position++;
+                }
+                else
+                    child_key = std::to_string(array_index++);
+
+                if (!read_value(key.empty() ? child_key : key + "/" + child_key, out_metrics))
+                    return false;
+
+                skip_whitespaces();
+                if (m_position >= m_text.size())
+                    return false;
+                else if (m_text[m_position] == ',')
+                    m_position++;
+                else if (m_text[m_position] == closing_character)
+                {
+                    m_position++;
+
+                    return true;
+                }
+                else
+                    return false;
+            }
+        }
+        else if (character == '"')
+        {
+            // Strings are not metrics
+            std::string ignored;
+
+            return read_string(ignored);
+        }
+        else if (m_text.compare(m_position, 4, "true") == 0 || m_text.compare(m_position, 4, "null") == 0)
+            m_position += 4;
+        else if (m_text.compare(m_position, 5, "false") == 0)
+            m_position += 5;
+        else
+        {
+            const char* start = m_text.c_str() + m_position;
+            char* end;
+            double value = std::strtod(start, &end);
+            if (end == start)
+                return false;
+
+            m_position += end - start;
+            out_metrics[key] = value;
+        }
+
+        return true;
+    }
+
+    const std::string& m_text;
+    size_t m_position = 0;
+};
+
+bool BenchmarkResults::read_json_metrics(const std::string& file_path, std::map<std::string, double>& out_metrics)
+{
+    std::ifstream file(file_path);
+    if (!file.is_open())
+        return false;
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    return JSONMetricsReader(text).read(out_metrics);
+}
+
+int BenchmarkResults::compare_to_baseline(const std::map<std::string, double>& baseline_metrics, double threshold, std::ostream& stream) const
+{
+    std::map<std::string, double> metrics = get_metrics();
+
+    for (const auto& [key, value] : metrics)
+    {
+        if (!key.starts_with("settings/"))
+            continue;
+
+        auto baseline_it = baseline_metrics.find(key);
+        if (baseline_it != baseline_metrics.end() && baseline_it->second != value)
+            stream << "Warning: " << key << " is " << value << " but was " << baseline_it->second << " in the baseline. The results are not comparable." << std::endl;
+    }
+
+    int regression_count = 0;
+    stream << std::fixed << std::setprecision(2);
+    for (const auto& [key, value] : metrics)
+    {
+        bool higher_is_better = key.ends_with("_per_second");
+        bool lower_is_better = key.ends_with("_ms");
+        if (!higher_is_better && !lower_is_better)
+            continue;
+
+        auto baseline_it = baseline_metrics.find(key);
+        if (baseline_it == baseline_metrics.end() || baseline_it->second <= 0.0)
+            // New metric or nothing to compare to
+            continue;
+
+        double baseline_value = baseline_it->second;
+        double relative_change = (value - baseline_value) / baseline_value;
+
+        bool regression;
+        if (higher_is_better)
+            regression = relative_change < -threshold;
+        else
+            regression = relative_change > threshold;
+
+        regression_count += regression;
+        stream << (regression ? "REGRESSION " : "           ") << key << ": " << baseline_value << " -> " << value << " (" << std::showpos << relative_change * 100.0 << std::noshowpos << "%)" << std::endl;
+    }
+
+    for (const auto& [key, value] : baseline_metrics)
+        if (key.starts_with("scenes/") && metrics.find(key) == metrics.end() && (key.ends_with("_per_second") || key.ends_with("_ms")))
+            stream << "Warning: " << key << " is in the baseline but wasn't measured" << std::endl;
+
+    stream << std::defaultfloat;
+
+    return regression_count;
+}
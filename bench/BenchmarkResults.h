@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef BENCH_BENCHMARK_RESULTS_H
+#define BENCH_BENCHMARK_RESULTS_H
+
+#include "Renderer/BVHConstants.h"
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct BenchmarkSettings
+{
+    int width = 640;
+    int height = 360;
+    int samples = 16;
+    int bounces = 4;
+    int tile_size = 32;
+    CPUBVHType bvh_type = CPUBVHType::BINARY_SAH;
+    bool gmon = false;
+    bool wavefront = false;
+};
+
+struct BenchmarkPassResult
+{
+    // Sum over all the samples of the render
+    double total_ms = 0.0;
+    double average_ms = 0.0;
+    // Number of pixel samples per second that this pass alone can process
+    double pixel_samples_per_second = 0.0;
+};
+
+struct BenchmarkSceneResult
+{
+    std::string name;
+
+    // Scene file parsing + renderer setup (the BVH build overlaps with the rest of the setup)
+    double scene_load_ms = 0.0;
+    double bvh_build_ms = 0.0;
+    // Wall time of the whole render
+    double render_ms = 0.0;
+
+    unsigned long long int primary_rays = 0;
+    unsigned long long int secondary_rays = 0;
+    unsigned long long int shadow_rays = 0;
+    double primary_rays_per_second = 0.0;
+    double secondary_rays_per_second = 0.0;
+    double shadow_rays_per_second = 0.0;
+
+    double bvh_nodes_per_ray = 0.0;
+    double triangles_per_ray = 0.0;
+
+    // Only if GMoN is enabled
+    double gmon_memory_bytes = 0.0;
+    // Number of median of means recomputations and their average time
+    int gmon_updates = 0;
+    double gmon_update_ms = 0.0;
+
+    std::map<std::string, BenchmarkPassResult> passes;
+};
+
+/**
+ * Results of a HIPRTPathTracerBench run.
+ *
+ * The results are written as JSON and can be read back as a flat map of metrics
+ * ("scenes/<scene>/<metric>", "scenes/<scene>/passes/<pass>/<metric>", "settings/<setting>")
+ * to be compared with a baseline run
+ */
+class BenchmarkResults
+{
+public:
+    bool write_json(const std::string& file_path) const;
+
+    /**
+     * Returns all the numeric values of the results with the same keys as read_json_metrics()
+     */
+    std::map<std::string, double> get_metrics() const;
+
+    /**
+     * Reads all the numeric values of a JSON file written by write_json() into 'out_metrics'.
+     * Returns false if the file couldn't be read or isn't valid JSON
+     */
+    static bool read_json_metrics(const std::string& file_path, std::map<std::string, double>& out_metrics);
+
+    /**
+     * Compares the results with the metrics of a baseline run.
+     *
+     * Metrics ending in "_per_second" regress if they are more than 'threshold' (relative)
+     * lower than the baseline. Metrics ending in "_ms" regress if they are more than 'threshold'
+     * higher. The other metrics (ray counts, ...) are not compared.
+     *
+     * Every metric compared is printed to 'stream'. Returns the number of regressions
+     */
+    int compare_to_baseline(const std::map<std::string, double>& baseline_metrics, double threshold, std::ostream& stream) const;
+
+    BenchmarkSettings settings;
+    std::vector<BenchmarkSceneResult> scenes;
+};
+
+#endif
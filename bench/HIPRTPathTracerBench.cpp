@@ -0,0 +1,506 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "BenchmarkResults.h"
+
+#include "Device/includes/Intersect.h"
+#include "Image/Image.h"
+#include "Renderer/BVH.h"
+#include "Renderer/CPUProfiler.h"
+#include "Renderer/CPURenderer.h"
+#include "Renderer/RenderPasses/GMoNRenderPass.h"
+#include "Scene/SceneParser.h"
+#include "Threads/ThreadFunctions.h"
+#include "Threads/TaskScheduler.h"
+#include "Utils/CommandlineArguments.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+/**
+ * Fixed-seed CPU renders of canned scenes to catch performance regressions.
+ *
+ * Usage: HIPRTPathTracerBench [scene.gltf ...] [options]
+ *      With no scene given, all the GLTFs of data/GLTFs are benchmarked
+ *
+ *      --w=N / --h=N           Resolution of the renders (640x360 by default)
+ *      --samples=N             Samples per pixel (16 by default)
+ *      --bounces=N             Maximum number of bounces (4 by default)
+ *      --tile-size=N           Tile size of the CPU renderer (32 by default)
+ *      --bvh=<type>            CPU BVH: 'binary' (default), 'two-level' or 'octree'
+ *      --gmon                  Renders with GMoN and reports its memory and time per median of means update.
+ *                              The packed and full precision GMoN sets (GMoNUsePackedSets) are compared by
+ *                              running a build of each with --baseline
+ *      --wavefront             Traces the paths with the wavefront path tracer instead of the megakernel
+ *      --sky=<path>            Envmap of the renders
+ *      --output=<path>         JSON results (bench_results.json by default)
+ *      --baseline=<path>       JSON results of a previous run to compare against
+ *      --threshold=T           Relative change that is considered a regression (0.1 by default)
+ *      --check-shadow-packets  Instead of benchmarking, checks that the packet shadow rays of the wavefront
+ *                              path tracer find the same occlusion as the single shadow rays. The scenes that use
+ *                              the two-level BVH (instanced scenes or --bvh=two-level) are skipped.
+ *                              The exit code is 1 if they don't
+ *      --check-bvh-updates     Instead of benchmarking, moves an instance and deforms a mesh of the scenes through
+ *                              the refit / TLAS rebuild of the two-level CPU BVH and checks that it finds the same
+ *                              hits as a two-level BVH built from scratch. The exit code is 1 if it doesn't
+ *
+ * The exit code is 0 if no regression was found, 1 if there are regressions and 2 on error
+ */
+
+static std::vector<std::string> find_default_scenes()
+{
+    std::vector<std::string> scenes;
+
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(DATA_DIRECTORY "/GLTFs"))
+        if (entry.is_regular_file() && entry.path().extension() == ".gltf")
+            scenes.push_back(entry.path().string());
+
+    // Stable order between runs
+    std::sort(scenes.begin(), scenes.end());
+
+    return scenes;
+}
+
+static BenchmarkSceneResult benchmark_scene(const std::string& scene_file_path, Image32Bit& envmap_image, const BenchmarkSettings& settings)
+{
+    BenchmarkSceneResult result;
+    result.name = std::filesystem::path(scene_file_path).stem().string();
+
+    std::cout << std::endl << "Benchmarking " << result.name << "..." << std::endl;
+
+    auto start_load = std::chrono::high_resolution_clock::now();
+
+    Scene parsed_scene;
+    SceneParserOptions options(scene_file_path);
+    options.override_aspect_ratio = static_cast<float>(settings.width) / settings.height;
+    // Always parsing the scene from its files so that the load times are comparable between runs
+    options.use_scene_cache = false;
+    options.use_texture_cache = false;
+
+    Assimp::Importer assimp_importer;
+    SceneParser::parse_scene_file(scene_file_path, assimp_importer, parsed_scene, options);
+
+    CPURenderer cpu_renderer(settings.width, settings.height);
+    cpu_renderer.get_render_settings().nb_bounces = settings.bounces;
+    cpu_renderer.get_render_settings().samples_per_frame = settings.samples;
+    // Same random numbers on every run
+    cpu_renderer.get_render_settings().freeze_random = true;
+    cpu_renderer.set_tiled_rendering(true, settings.tile_size);
+    cpu_renderer.set_bvh_type(settings.bvh_type);
+    cpu_renderer.set_gmon(settings.gmon);
+    cpu_renderer.set_wavefront_path_tracing(settings.wavefront);
+    cpu_renderer.set_envmap(envmap_image);
+    cpu_renderer.set_camera(parsed_scene.camera);
+    cpu_renderer.set_scene(parsed_scene);
+    g_task_scheduler.wait_for_all_tasks();
+
+    auto stop_load = std::chrono::high_resolution_clock::now();
+
+    // render() clears the profiler
+    auto start_render = std::chrono::high_resolution_clock::now();
+    cpu_renderer.render();
+    auto stop_render = std::chrono::high_resolution_clock::now();
+
+    result.scene_load_ms = std::chrono::duration<double, std::milli>(stop_load - start_load).count();
+    result.bvh_build_ms = cpu_renderer.get_bvh_build_time_ms();
+    result.render_ms = std::chrono::duration<double, std::milli>(stop_render - start_render).count();
+
+    CPUProfilerThreadData counters = g_cpu_profiler.get_counters();
+    double render_seconds = result.render_ms / 1000.0;
+    result.primary_rays = counters.rays_traced_per_type[CPU_PROFILER_PRIMARY_RAY];
+    result.secondary_rays = counters.rays_traced_per_type[CPU_PROFILER_SECONDARY_RAY];
+    result.shadow_rays = counters.rays_traced_per_type[CPU_PROFILER_SHADOW_RAY];
+    result.primary_rays_per_second = result.primary_rays / render_seconds;
+    result.secondary_rays_per_second = result.secondary_rays / render_seconds;
+    result.shadow_rays_per_second = result.shadow_rays / render_seconds;
+    if (counters.rays_traced > 0)
+    {
+        result.bvh_nodes_per_ray = counters.bvh_nodes_visited / static_cast<double>(counters.rays_traced);
+        result.triangles_per_ray = counters.triangles_tested / static_cast<double>(counters.rays_traced);
+    }
+
+    // The time budget of the renderer may have stopped the render early
+    int frame_count = g_cpu_profiler.get_frame_count();
+
+    if (cpu_renderer.get_gmon_data().use_gmon)
+    {
+        const std::map<std::string, double>& pass_times = g_cpu_profiler.get_total_pass_times();
+        auto gmon_pass = pass_times.find(GMoNRenderPass::COMPUTE_GMON_KERNEL);
+
+        result.gmon_memory_bytes = static_cast<double>(cpu_renderer.get_gmon_data().get_memory_usage_bytes());
+        // The median of means is recomputed once every sample was accumulated in all the sets
+        result.gmon_updates = frame_count / cpu_renderer.get_gmon_data().number_of_sets;
+        if (gmon_pass != pass_times.end() && result.gmon_updates > 0)
+            result.gmon_update_ms = gmon_pass->second / result.gmon_updates;
+    }
+    double pixel_count = static_cast<double>(settings.width) * settings.height;
+    for (const auto& [pass_name, total_ms] : g_cpu_profiler.get_total_pass_times())
+    {
+        BenchmarkPassResult& pass = result.passes[pass_name];
+
+        pass.total_ms = total_ms;
+        pass.average_ms = total_ms / std::max(frame_count, 1);
+        if (total_ms > 0.0)
+            pass.pixel_samples_per_second = frame_count * pixel_count / (total_ms / 1000.0);
+    }
+
+    return result;
+}
+
+/**
+ * Traces random shadow rays between the triangles of the scene with evaluate_shadow_rays_packet()
+ * and with evaluate_shadow_ray() and returns the number of rays whose occlusion differ.
+ *
+ * Most packets are coherent (from one triangle to another) so that they go through the packet
+ * traversal, the others are random and exercise its single rays fallback. Alpha testing is
+ * disabled so that the occlusion of both doesn't depend on the random numbers
+ */
+static int check_shadow_ray_packets(const std::string& scene_file_path, const BenchmarkSettings& settings)
+{
+    std::cout << std::endl << "Checking the shadow ray packets of " << std::filesystem::path(scene_file_path).stem().string() << "..." << std::endl;
+
+    Scene parsed_scene;
+    SceneParserOptions options(scene_file_path);
+    Assimp::Importer assimp_importer;
+    SceneParser::parse_scene_file(scene_file_path, assimp_importer, parsed_scene, options);
+
+    // Copied before the renderer takes the scene
+    std::vector<int> triangle_indices = parsed_scene.triangle_indices;
+    std::vector<float3> vertices_positions = parsed_scene.vertices_positions;
+    int triangle_count = static_cast<int>(triangle_indices.size() / 3);
+    if (triangle_count == 0)
+        return 0;
+
+    CPURenderer cpu_renderer(settings.width, settings.height);
+    cpu_renderer.get_render_settings().do_alpha_testing = false;
+    cpu_renderer.set_bvh_type(settings.bvh_type);
+    cpu_renderer.set_camera(parsed_scene.camera);
+    cpu_renderer.set_scene(parsed_scene);
+    g_task_scheduler.wait_for_all_tasks();
+
+    const HIPRTRenderData& render_data = cpu_renderer.get_render_data();
+    if (render_data.cpu_only.bvh->m_bvh_type == CPUBVHType::TWO_LEVEL)
+    {
+        // The two-level BVH traces the rays of a packet one by one so there is no packet traversal to check.
+        // The scenes with instanced meshes always use it, their vertices are in the object space of their mesh
+        std::cout << "The scene uses the two-level BVH which has no packet traversal, skipping" << std::endl;
+
+        return 0;
+    }
+
+    Xorshift32Generator random_number_generator(42);
+    auto random_point_on_triangle = [&](int triangle_index) {
+        float u = random_number_generator();
+        float v = random_number_generator();
+        if (u + v > 1.0f)
+        {
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+
+        float3 A = vertices_positions[triangle_indices[triangle_index * 3 + 0]];
+        float3 B = vertices_positions[triangle_indices[triangle_index * 3 + 1]];
+        float3 C = vertices_positions[triangle_indices[triangle_index * 3 + 2]];
+
+        return A + (B - A) * u + (C - A) * v;
+    };
+
+    constexpr int PACKET_COUNT = 4096;
+
+    int mismatch_count = 0;
+    int occluded_count = 0;
+    for (int packet_index = 0; packet_index < PACKET_COUNT; packet_index++)
+    {
+        bool coherent_packet = packet_index % 4 != 0;
+        int from_triangle = random_number_generator.random_index(triangle_count);
+        int to_triangle = random_number_generator.random_index(triangle_count);
+
+        hiprtRay rays[BVHConstants::PACKET_MAX_RAY_COUNT];
+        float t_max[BVHConstants::PACKET_MAX_RAY_COUNT];
+        int last_hit_primitive_indices[BVHConstants::PACKET_MAX_RAY_COUNT];
+        int last_hit_instance_ids[BVHConstants::PACKET_MAX_RAY_COUNT];
+        int bounces[BVHConstants::PACKET_MAX_RAY_COUNT];
+        Xorshift32Generator random_number_generators[BVHConstants::PACKET_MAX_RAY_COUNT];
+        Xorshift32Generator* random_number_generators_pointers[BVHConstants::PACKET_MAX_RAY_COUNT];
+
+        int ray_count = 0;
+        while (ray_count < BVHConstants::PACKET_MAX_RAY_COUNT)
+        {
+            if (!coherent_packet)
+            {
+                from_triangle = random_number_generator.random_index(triangle_count);
+                to_triangle = random_number_generator.random_index(triangle_count);
+            }
+
+            float3 from = random_point_on_triangle(from_triangle);
+            float3 to = random_point_on_triangle(to_triangle);
+            float distance = hippt::length(to - from);
+            if (distance <= 1.0e-3f)
+            {
+                // Degenerate triangles or same point, trying other triangles
+                from_triangle = random_number_generator.random_index(triangle_count);
+                to_triangle = random_number_generator.random_index(triangle_count);
+
+                continue;
+            }
+
+            rays[ray_count].origin = from;
+            rays[ray_count].direction = (to - from) / distance;
+            t_max[ray_count] = distance;
+            // Starting on 'from_triangle', that's the hit the ray must not intersect again.
+            // 0 is the instance of all the triangles with the single-level BVHs
+            last_hit_primitive_indices[ray_count] = from_triangle;
+            last_hit_instance_ids[ray_count] = 0;
+            bounces[ray_count] = 0;
+            random_number_generators[ray_count] = Xorshift32Generator(packet_index * BVHConstants::PACKET_MAX_RAY_COUNT + ray_count + 1);
+            random_number_generators_pointers[ray_count] = &random_number_generators[ray_count];
+            ray_count++;
+        }
+
+        bool packet_in_shadow[BVHConstants::PACKET_MAX_RAY_COUNT];
+        evaluate_shadow_rays_packet(render_data, rays, t_max, last_hit_primitive_indices, last_hit_instance_ids, bounces, random_number_generators_pointers, ray_count, packet_in_shadow);
+
+        for (int i = 0; i < ray_count; i++)
+        {
+            bool in_shadow = evaluate_shadow_ray(render_data, rays[i], t_max[i], last_hit_primitive_indices[i], last_hit_instance_ids[i], bounces[i], random_number_generators[i]);
+
+            occluded_count += in_shadow ? 1 : 0;
+            mismatch_count += in_shadow != packet_in_shadow[i] ? 1 : 0;
+        }
+    }
+
+    std::cout << PACKET_COUNT * BVHConstants::PACKET_MAX_RAY_COUNT << " shadow rays, " << occluded_count << " occluded, " << mismatch_count << " mismatch(es)" << std::endl;
+
+    return mismatch_count;
+}
+
+/**
+ * Moves an instance and deforms a mesh with CPURenderer::set_instance_transform() and
+ * CPURenderer::update_mesh_vertices(), which rebuild the TLAS and refit the BLAS of the
+ * two-level BVH, and returns the number of random rays whose closest hit differs from
+ * the one found by a two-level BVH built from scratch with the updated scene
+ */
+static int check_bvh_updates(const std::string& scene_file_path, const BenchmarkSettings& settings)
+{
+    std::cout << std::endl << "Checking the BVH updates of " << std::filesystem::path(scene_file_path).stem().string() << "..." << std::endl;
+
+    Scene parsed_scene;
+    SceneParserOptions options(scene_file_path);
+    Assimp::Importer assimp_importer;
+    SceneParser::parse_scene_file(scene_file_path, assimp_importer, parsed_scene, options);
+
+    CPURenderer cpu_renderer(settings.width, settings.height);
+    cpu_renderer.get_render_settings().do_alpha_testing = false;
+    cpu_renderer.set_bvh_type(CPUBVHType::TWO_LEVEL);
+    cpu_renderer.set_camera(parsed_scene.camera);
+    cpu_renderer.set_scene(parsed_scene);
+    g_task_scheduler.wait_for_all_tasks();
+
+    std::vector<SceneInstance> instances = parsed_scene.metadata.instances;
+    int instance_index = -1;
+    for (int i = 0; i < instances.size() && instance_index == -1; i++)
+        if (!cpu_renderer.is_mesh_emissive(instances[i].mesh_index))
+            instance_index = i;
+
+    if (instance_index == -1)
+    {
+        std::cout << "No instance of a non-emissive mesh, skipping" << std::endl;
+
+        return 0;
+    }
+
+    // Moving the instance by a tenth of the scene along X
+    const BoundingBox& scene_bounds = parsed_scene.metadata.scene_bounding_box;
+    instances[instance_index].object_to_world.m[0][3] += (scene_bounds.maxi.x - scene_bounds.mini.x) * 0.1f;
+    cpu_renderer.set_instance_transform(instance_index, instances[instance_index].object_to_world);
+
+    // Scaling the mesh of the instance around its center
+    int mesh_index = instances[instance_index].mesh_index;
+    std::vector<float3> mesh_vertices = cpu_renderer.get_mesh_vertices(mesh_index);
+    BoundingBox mesh_bounds;
+    for (const float3& vertex : mesh_vertices)
+        mesh_bounds.extend(vertex);
+    float3 mesh_center = (mesh_bounds.mini + mesh_bounds.maxi) * 0.5f;
+    for (float3& vertex : mesh_vertices)
+        vertex = mesh_center + (vertex - mesh_center) * 1.1f;
+    cpu_renderer.update_mesh_vertices(mesh_index, mesh_vertices);
+
+    // The renderer wrote the new vertices in the scene
+    std::vector<Triangle> reference_triangles = parsed_scene.get_triangles();
+    BVH reference_bvh(&reference_triangles, parsed_scene.metadata.mesh_triangle_offsets, instances);
+
+    const HIPRTRenderData& render_data = cpu_renderer.get_render_data();
+    // Slightly bigger than the scene so that the instance that moved is still inside
+    float3 rays_min = scene_bounds.mini - (scene_bounds.maxi - scene_bounds.mini) * 0.2f;
+    float3 rays_extent = (scene_bounds.maxi - scene_bounds.mini) * 1.4f;
+
+    constexpr int RAY_COUNT = 65536;
+
+    Xorshift32Generator random_number_generator(42);
+    int mismatch_count = 0;
+    int hit_count = 0;
+    for (int i = 0; i < RAY_COUNT; i++)
+    {
+        hiprtRay ray;
+        ray.origin = rays_min + rays_extent * make_float3(random_number_generator(), random_number_generator(), random_number_generator());
+
+        float cos_theta = 1.0f - 2.0f * random_number_generator();
+        float sin_theta = sqrtf(hippt::max(0.0f, 1.0f - cos_theta * cos_theta));
+        float phi = M_TWO_PI * random_number_generator();
+        ray.direction = make_float3(sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta);
+
+        FilterFunctionPayload payload;
+        payload.render_data = &render_data;
+        payload.random_number_generator = &random_number_generator;
+        payload.last_hit_primitive_index = -1;
+        payload.last_hit_instance_id = -1;
+
+        hiprtHit hit;
+        hiprtHit reference_hit;
+        bool hit_found = render_data.cpu_only.bvh->intersect(ray, hit, &payload);
+        bool reference_hit_found = reference_bvh.intersect(ray, reference_hit, &payload);
+
+        hit_count += hit_found ? 1 : 0;
+        if (hit_found != reference_hit_found)
+            mismatch_count++;
+        else if (hit_found && (hit.primID != reference_hit.primID || hit.instanceID != reference_hit.instanceID || hippt::abs(hit.t - reference_hit.t) > 1.0e-4f * hippt::max(1.0f, reference_hit.t)))
+            mismatch_count++;
+    }
+
+    std::cout << RAY_COUNT << " rays, " << hit_count << " hits, " << mismatch_count << " mismatch(es)" << std::endl;
+
+    return mismatch_count;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    std::vector<std::string> scene_file_paths;
+    std::string skysphere_file_path = CommandlineArguments::DEFAULT_SKYSPHERE;
+    std::string output_file_path = "bench_results.json";
+    std::string baseline_file_path;
+    double threshold = 0.1;
+    bool check_shadow_packets = false;
+    bool check_bvh = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string string_argv = std::string(argv[i]);
+        if (string_argv.starts_with("--w="))
+            settings.width = std::atoi(string_argv.substr(4).c_str());
+        else if (string_argv.starts_with("--h="))
+            settings.height = std::atoi(string_argv.substr(4).c_str());
+        else if (string_argv.starts_with("--samples="))
+            settings.samples = std::atoi(string_argv.substr(10).c_str());
+        else if (string_argv.starts_with("--bounces="))
+            settings.bounces = std::atoi(string_argv.substr(10).c_str());
+        else if (string_argv.starts_with("--tile-size="))
+            settings.tile_size = std::atoi(string_argv.substr(12).c_str());
+        else if (string_argv.starts_with("--bvh="))
+        {
+            std::string bvh_type = string_argv.substr(6);
+            if (bvh_type == "binary")
+                settings.bvh_type = CPUBVHType::BINARY_SAH;
+            else if (bvh_type == "two-level")
+                settings.bvh_type = CPUBVHType::TWO_LEVEL;
+            else if (bvh_type == "octree")
+                settings.bvh_type = CPUBVHType::OCTREE;
+            else
+            {
+                std::cerr << "Unknown BVH type " << bvh_type << std::endl;
+
+                return 2;
+            }
+        }
+        else if (string_argv == "--gmon")
+            settings.gmon = true;
+        else if (string_argv == "--wavefront")
+            settings.wavefront = true;
+        else if (string_argv.starts_with("--sky="))
+            skysphere_file_path = string_argv.substr(6);
+        else if (string_argv.starts_with("--output="))
+            output_file_path = string_argv.substr(9);
+        else if (string_argv.starts_with("--baseline="))
+            baseline_file_path = string_argv.substr(11);
+        else if (string_argv.starts_with("--threshold="))
+            threshold = std::atof(string_argv.substr(12).c_str());
+        else if (string_argv == "--check-shadow-packets")
+            check_shadow_packets = true;
+        else if (string_argv == "--check-bvh-updates")
+            check_bvh = true;
+        else if (string_argv.starts_with("--"))
+        {
+            std::cerr << "Unknown argument " << string_argv << std::endl;
+
+            return 2;
+        }
+        else
+            scene_file_paths.push_back(string_argv);
+    }
+
+    if (scene_file_paths.empty())
+        scene_file_paths = find_default_scenes();
+
+    if (scene_file_paths.empty())
+    {
+        std::cerr << "No scene to benchmark" << std::endl;
+
+        return 2;
+    }
+
+    if (check_shadow_packets)
+    {
+        int mismatch_count = 0;
+        for (const std::string& scene_file_path : scene_file_paths)
+            mismatch_count += check_shadow_ray_packets(scene_file_path, settings);
+
+        return mismatch_count > 0 ? 1 : 0;
+    }
+
+    if (check_bvh)
+    {
+        int mismatch_count = 0;
+        for (const std::string& scene_file_path : scene_file_paths)
+            mismatch_count += check_bvh_updates(scene_file_path, settings);
+
+        return mismatch_count > 0 ? 1 : 0;
+    }
+
+    // Reading the baseline first to fail early
+    std::map<std::string, double> baseline_metrics;
+    if (!baseline_file_path.empty() && !BenchmarkResults::read_json_metrics(baseline_file_path, baseline_metrics))
+    {
+        std::cerr << "Could not read the baseline " << baseline_file_path << std::endl;
+
+        return 2;
+    }
+
+    Image32Bit envmap_image;
+    ThreadFunctions::read_envmap(envmap_image, skysphere_file_path, 4, true);
+
+    BenchmarkResults results;
+    results.settings = settings;
+    for (const std::string& scene_file_path : scene_file_paths)
+        results.scenes.push_back(benchmark_scene(scene_file_path, envmap_image, settings));
+
+    if (!results.write_json(output_file_path))
+    {
+        std::cerr << "Could not write the results to " << output_file_path << std::endl;
+
+        return 2;
+    }
+    std::cout << std::endl << "Results written to " << output_file_path << std::endl;
+
+    if (baseline_file_path.empty())
+        return 0;
+
+    std::cout << std::endl << "Comparing with the baseline " << baseline_file_path << " (threshold " << threshold * 100.0 << "%):" << std::endl;
+    int regression_count = results.compare_to_baseline(baseline_metrics, threshold, std::cout);
+    std::cout << regression_count << " regression(s)" << std::endl;
+
+    return regression_count > 0 ? 1 : 0;
+}
@@ -8,7 +8,6 @@
 #include "Compiler/GPUKernelCompilerOptions.h"
 #include "HIPRT-Orochi/HIPRTOrochiUtils.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
 #include "UI/ImGui/ImGuiLogger.h"
 
 extern GPUKernelCompiler g_gpu_kernel_compiler;
@@ -9,6 +9,7 @@
 #include "UI/ImGui/ImGuiLogger.h"
 #include "Utils/Utils.h"
 
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <deque>
@@ -17,14 +18,8 @@
 GPUKernelCompiler g_gpu_kernel_compiler;
 extern ImGuiLogger g_imgui_logger;
 
-// This variable will be initialized before the main function by the main thread
-std::thread::id g_priority_thread_id = std::this_thread::get_id();
-// Whether or not the main thread is currently compiling. Used in the condition variable.
-// If the main thread is currently compiling (very likely that his was asked by the user through the UI), 
-// other threads may not compile to give the user the priority for the compilation
-bool g_main_thread_compiling = false;
-bool g_background_shader_compilation_enabled = true;
-std::condition_variable g_condition_for_compilation;
+// True on the compile worker threads of the GPUKernelCompiler
+static thread_local bool t_is_compile_worker = false;
 
 void enable_compilation_warnings(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, std::vector<std::string>& compiler_options)
 {
@@ -55,26 +50,104 @@ void enable_compilation_warnings(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ct
 	}
 }
 
+GPUKernelCompiler::GPUKernelCompiler()
+{
+	m_compilation_state = std::make_shared<CompilationQueueState>();
+}
+
+GPUKernelCompiler::~GPUKernelCompiler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
+
+		// Dropping the precompilations that haven't started yet so that the workers only have
+		// to finish their current compilation. Not going through cancel_precompilations()
+		// because the logger may already have been destroyed at this point
+		m_compilation_state->precompilation_jobs.clear();
+		m_compilation_state->precompilations_cancelled = true;
+		m_compilation_state->stop = true;
+	}
+	m_compilation_state->work_condition.notify_all();
+
+	// Joining and not detaching: a detached worker could still be inside HIPRT / Orochi
+	// (hiprtBuildTraceKernels) while the rest of the application is being destroyed
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+void GPUKernelCompiler::start_workers()
+{
+	std::call_once(m_workers_started, [this]() {
+		// The GPU compilers use a lot of memory and a few threads of their own
+		// so not using all the cores of the CPU. At least 2 workers so that one
+		// worker is always left for the interactive compilations, see below
+		int worker_count = std::max(2u, std::thread::hardware_concurrency() / 2);
+
+		m_compilation_state->max_running_precompilations = worker_count - 1;
+		for (int i = 0; i < worker_count; i++)
+			m_workers.push_back(std::thread(GPUKernelCompiler::worker_loop, m_compilation_state));
+	});
+}
+
+void GPUKernelCompiler::worker_loop(std::shared_ptr<CompilationQueueState> state)
+{
+	t_is_compile_worker = true;
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	while (true)
+	{
+		state->work_condition.wait(lock, [&state]() {
+			return state->stop
+				|| !state->interactive_jobs.empty()
+				|| (!state->precompilation_jobs.empty() && state->running_precompilations < state->max_running_precompilations);
+		});
+
+		if (state->stop)
+			break;
+
+		std::shared_ptr<CompilationJob> job;
+		if (!state->interactive_jobs.empty())
+		{
+			job = state->interactive_jobs.front();
+			state->interactive_jobs.pop_front();
+		}
+		else
+		{
+			job = state->precompilation_jobs.front();
+			state->precompilation_jobs.pop_front();
+			state->running_precompilations++;
+		}
+
+		lock.unlock();
+		oroFunction result = job->function();
+		lock.lock();
+
+		job->function = nullptr;
+		job->result = result;
+		job->finished = true;
+		if (job->priority == COMPILATION_PRIORITY_PRECOMPILATION)
+		{
+			state->queued_precompilations.erase(job->key);
+			state->running_precompilations--;
+
+			// A precompilation slot is available again
+			state->work_condition.notify_one();
+		}
+		else
+			state->in_flight_compilations.erase(job->key);
+
+		state->job_finished_condition.notify_all();
+	}
+}
+
 oroFunction_t GPUKernelCompiler::compile_kernel(GPUKernel& kernel, const GPUKernelCompilerOptions& kernel_compiler_options, std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, hiprtFuncNameSet* function_name_sets, int num_geom_types, int num_ray_types, bool use_cache, const std::string& additional_cache_key, bool silent)
 {
 	std::string kernel_file_path = kernel.get_kernel_file_path();
 	std::string kernel_function_name = kernel.get_kernel_function_name();
-	const std::vector<std::string>& additional_include_dirs = GPUKernel::COMMON_ADDITIONAL_KERNEL_INCLUDE_DIRS;
 	std::vector<std::string> compiler_options = kernel_compiler_options.get_relevant_macros_as_std_vector_string(&kernel);
 
 	// enable_compilation_warnings(hiprt_orochi_ctx, compiler_options);
 
-	// Locking because neither NVIDIA or AMD cannot compile kernels on multiple threads so we may as well
-	// lock here to have better control on when to compile a kernel as well as have proper compilation times
-	std::unique_lock<std::mutex> lock(m_compile_mutex);
-
-	if (std::this_thread::get_id() != g_priority_thread_id)
-		// Other threads wait if the main thread is compiling
-		g_condition_for_compilation.wait(lock, []() { return !g_main_thread_compiling && g_background_shader_compilation_enabled; });
-
-	auto start = std::chrono::high_resolution_clock::now();
-
-	hiprtApiFunction trace_function_out;
 	bool use_shader_cache;
 	if (m_shader_cache_force_usage == GPUKernelCompiler::ShaderCacheUsageOverride::FORCE_SHADER_CACHE_OFF)
 		use_shader_cache = false;
@@ -83,23 +156,96 @@ oroFunction_t GPUKernelCompiler::compile_kernel(GPUKernel& kernel, const GPUKern
 	else
 		use_shader_cache = use_cache;
 
-	if (HIPPTOrochiUtils::build_trace_kernel(hiprt_orochi_ctx->hiprt_ctx, kernel_file_path, kernel_function_name, trace_function_out, additional_include_dirs, compiler_options, num_geom_types, num_ray_types, use_shader_cache, function_name_sets, additional_cache_key) != hiprtError::hiprtSuccess)
+	// Everything that changes the output of the compiler. The options are sorted because
+	// their order depends on the iteration order of the hash maps of the options
+	std::vector<std::string> sorted_compiler_options = compiler_options;
+	std::sort(sorted_compiler_options.begin(), sorted_compiler_options.end());
+	std::string compilation_key = kernel_file_path + ":" + kernel_function_name + ":" + std::to_string(num_geom_types) + ":" + std::to_string(num_ray_types) + ":" + std::to_string(use_shader_cache) + ":" + additional_cache_key;
+	for (const std::string& option : sorted_compiler_options)
+		compilation_key += ":" + option;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::shared_ptr<CompilationJob> job;
+	bool new_job = false;
 	{
-		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Unable to compile kernel \"%s\". Cannot continue.", kernel_function_name.c_str());
+		std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
 
-		return nullptr;
+		auto in_flight_find = m_compilation_state->in_flight_compilations.find(compilation_key);
+		if (in_flight_find != m_compilation_state->in_flight_compilations.end())
+			job = in_flight_find->second;
+		else
+		{
+			new_job = true;
+
+			job = std::make_shared<CompilationJob>();
+			job->key = compilation_key;
+			job->function = [=]() -> oroFunction {
+				// The compile workers aren't the thread that created the context
+				OROCHI_CHECK_ERROR(oroCtxSetCurrent(hiprt_orochi_ctx->orochi_ctx));
+
+				hiprtApiFunction trace_function_out;
+				if (HIPPTOrochiUtils::build_trace_kernel(hiprt_orochi_ctx->hiprt_ctx, kernel_file_path, kernel_function_name, trace_function_out, GPUKernel::COMMON_ADDITIONAL_KERNEL_INCLUDE_DIRS, compiler_options, num_geom_types, num_ray_types, use_shader_cache, function_name_sets, additional_cache_key) != hiprtError::hiprtSuccess)
+				{
+					g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Unable to compile kernel \"%s\". Cannot continue.", kernel_function_name.c_str());
+
+					return nullptr;
+				}
+
+				return reinterpret_cast<oroFunction>(trace_function_out);
+			};
+
+			m_compilation_state->in_flight_compilations[compilation_key] = job;
+		}
+	}
+
+	oroFunction kernel_function = nullptr;
+	if (new_job && t_is_compile_worker)
+	{
+		// Compile workers only get here when precompiling a kernel. Compiling
+		// right away on this worker, queuing the job and waiting for it could deadlock
+		kernel_function = job->function();
+
+		std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
+		job->function = nullptr;
+		job->result = kernel_function;
+		job->finished = true;
+		m_compilation_state->in_flight_compilations.erase(compilation_key);
+		m_compilation_state->job_finished_condition.notify_all();
+	}
+	else if (!new_job && kernel.is_precompiled())
+	{
+		// The same kernel is already being compiled, it's going to end up in the
+		// shader cache, which is all a precompilation is about so nothing to do
 	}
+	else
+	{
+		if (new_job)
+		{
+			start_workers();
 
-	oroFunction kernel_function = reinterpret_cast<oroFunction>(trace_function_out);
+			std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
+			m_compilation_state->interactive_jobs.push_back(job);
+			m_compilation_state->work_condition.notify_one();
+		}
+
+		std::unique_lock<std::mutex> lock(m_compilation_state->mutex);
+		m_compilation_state->job_finished_condition.wait(lock, [&job]() { return job->finished; });
+
+		kernel_function = job->result;
+	}
 
 	if (kernel.is_precompiled())
 	{
 		// Updating the logs
 		m_precompiled_kernels_compilation_ended++;
 
-		g_imgui_logger.update_line(ImGuiLogger::BACKGROUND_KERNEL_COMPILATION_LINE_NAME, "Compiling kernel permutations in the background... [%d / %d]", m_precompiled_kernels_compilation_ended.load(), m_precompiled_kernels_parsing_started.load());
+		update_precompilation_log();
 	}
 
+	if (kernel_function == nullptr)
+		return nullptr;
+
 	auto stop = std::chrono::high_resolution_clock::now();
 
 	if (!silent)
@@ -114,12 +260,105 @@ oroFunction_t GPUKernelCompiler::compile_kernel(GPUKernel& kernel, const GPUKern
 		int nb_shared = GPUKernel::get_kernel_attribute(kernel_function, ORO_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES);
 		int nb_local = GPUKernel::get_kernel_attribute(kernel_function, ORO_FUNC_ATTRIBUTE_LOCAL_SIZE_BYTES);
 
-		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Kernel \"%s\" compiled in %ldms.\n\t[Reg, Shared, Local] = [%d, %d, %d]\n", kernel_function_name.c_str(), std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count(), nb_reg, nb_shared, nb_local);
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Kernel \"%s\" compiled in %lldms.\n\t[Reg, Shared, Local] = [%d, %d, %d]\n", kernel_function_name.c_str(), (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count(), nb_reg, nb_shared, nb_local);
 	}
 
 	return kernel_function;
 }
 
+void GPUKernelCompiler::precompile_kernel(const std::string& kernel_function_name, const std::string& kernel_file_path, const GPUKernelCompilerOptions& options, std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets)
+{
+	// Deep copy so that the options of the job don't change if the options
+	// of the kernel the caller copied them from are modified in the meantime
+	GPUKernelCompilerOptions job_options = options.deep_copy();
+
+	std::vector<std::string> sorted_options = job_options.get_all_macros_as_std_vector_string();
+	std::sort(sorted_options.begin(), sorted_options.end());
+	std::string precompilation_key = kernel_file_path + ":" + kernel_function_name;
+	for (const std::string& option : sorted_options)
+		precompilation_key += ":" + option;
+
+	std::shared_ptr<CompilationJob> job = std::make_shared<CompilationJob>();
+	job->priority = COMPILATION_PRIORITY_PRECOMPILATION;
+	job->key = precompilation_key;
+	job->function = [kernel_function_name, kernel_file_path, job_options, hiprt_orochi_ctx, func_name_sets]() -> oroFunction {
+		OROCHI_CHECK_ERROR(oroCtxSetCurrent(hiprt_orochi_ctx->orochi_ctx));
+
+		GPUKernel kernel(kernel_file_path, kernel_function_name);
+		kernel.set_precompiled(true);
+		kernel.get_kernel_options() = job_options;
+		kernel.compile_silent(hiprt_orochi_ctx, func_name_sets);
+
+		// The kernel is discarded, it only had to end up in the shader cache
+		return nullptr;
+	};
+
+	start_workers();
+
+	{
+		std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
+		if (m_compilation_state->precompilations_cancelled)
+			return;
+
+		if (!m_compilation_state->queued_precompilations.insert(precompilation_key).second)
+			// Identical precompilation already queued or running
+			return;
+
+		m_compilation_state->precompilation_jobs.push_back(job);
+		m_compilation_state->work_condition.notify_one();
+	}
+
+	m_precompiled_kernels_queued++;
+	update_precompilation_log();
+}
+
+void GPUKernelCompiler::begin_precompilations()
+{
+	std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
+
+	m_compilation_state->precompilations_cancelled = false;
+	if (m_compilation_state->queued_precompilations.empty())
+	{
+		// Nothing in progress, the progress logs restart from 0
+		m_precompiled_kernels_queued = 0;
+		m_precompiled_kernels_compilation_ended = 0;
+	}
+}
+
+void GPUKernelCompiler::cancel_precompilations()
+{
+	int cancelled_count;
+	{
+		std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
+
+		cancelled_count = m_compilation_state->precompilation_jobs.size();
+		for (const std::shared_ptr<CompilationJob>& job : m_compilation_state->precompilation_jobs)
+			m_compilation_state->queued_precompilations.erase(job->key);
+		m_compilation_state->precompilation_jobs.clear();
+		m_compilation_state->precompilations_cancelled = true;
+	}
+
+	m_precompiled_kernels_queued -= cancelled_count;
+	if (cancelled_count > 0)
+	{
+		update_precompilation_log();
+
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Background kernel precompilation cancelled, %d kernels not compiled.", cancelled_count);
+	}
+}
+
+int GPUKernelCompiler::get_pending_precompilation_count()
+{
+	std::lock_guard<std::mutex> lock(m_compilation_state->mutex);
+
+	return m_compilation_state->queued_precompilations.size();
+}
+
+void GPUKernelCompiler::update_precompilation_log()
+{
+	g_imgui_logger.update_line(ImGuiLogger::BACKGROUND_KERNEL_COMPILATION_LINE_NAME, "Compiling kernel permutations in the background... [%d / %d]", m_precompiled_kernels_compilation_ended.load(), m_precompiled_kernels_queued.load());
+}
+
 std::string GPUKernelCompiler::find_in_include_directories(const std::string& include_name, const std::vector<std::string>& include_directories)
 {
 	for (const std::string& include_directory : include_directories)
@@ -8,11 +8,17 @@
 
 #include "Compiler/GPUKernel.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <semaphore>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
-#include <condition_variable>
+#include <vector>
 
 
 class GPUKernelCompiler
@@ -25,8 +31,55 @@ public:
 		FORCE_SHADER_CACHE_ON,
 	};
 
+	enum CompilationPriority
+	{
+		// Compilations that someone is waiting on (the renderer, the UI, ...)
+		COMPILATION_PRIORITY_INTERACTIVE,
+		// Background precompilation of the kernel option permutations. Only executed
+		// when no interactive compilation is waiting
+		COMPILATION_PRIORITY_PRECOMPILATION,
+	};
+
+	GPUKernelCompiler();
+	~GPUKernelCompiler();
+
+	/**
+	 * Compiles the given kernel on the compile workers and blocks until it is compiled.
+	 * Interactive compilations are executed before any queued precompilation.
+	 *
+	 * If an identical compilation (same kernel file and function, same relevant options and cache key)
+	 * is already in flight, this function waits for that compilation instead of compiling the kernel again
+	 */
 	oroFunction_t compile_kernel(GPUKernel& kernel, const GPUKernelCompilerOptions& kernel_compiler_options, std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, hiprtFuncNameSet* function_name_sets, int num_geom_types, int num_ray_types, bool use_cache, const std::string& additional_cache_key, bool silent = false);
 
+	/**
+	 * Queues the compilation of the given kernel function with the given options in the
+	 * background and returns immediately. The compiled kernel is discarded: the point of
+	 * precompiling is to fill the shader cache so that switching options at runtime is fast.
+	 *
+	 * The precompilation is ignored if an identical one (same kernel and options) is already
+	 * queued or running, or if the precompilations were cancelled since the last call to begin_precompilations()
+	 */
+	void precompile_kernel(const std::string& kernel_function_name, const std::string& kernel_file_path, const GPUKernelCompilerOptions& options, std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets);
+
+	/**
+	 * Resets the progress counters of the precompilations and accepts
+	 * new precompilations again if they were cancelled
+	 */
+	void begin_precompilations();
+
+	/**
+	 * Drops all the precompilations that haven't started yet and ignores the new ones
+	 * until the next call to begin_precompilations(). The precompilations that
+	 * are already running cannot be interrupted and complete normally
+	 */
+	void cancel_precompilations();
+
+	/**
+	 * Number of precompilations queued or running
+	 */
+	int get_pending_precompilation_count();
+
 	/**
 	 * Takes an include name ("Device/includes/MyInclude.h" for example) and a list of include directories.
 	 * If the given include can be found in one the given include directories, the concatenation of the
@@ -122,7 +175,6 @@ private:
 	// Because this GPUKernelCompiler may be used by multiple threads at the same time,
 	// we may use that mutex sometimes to protect from race conditions
 	std::mutex m_option_macro_cache_mutex;
-	std::mutex m_compile_mutex;
 
 	// Semaphore used by 'get_option_macros_used_by_kernel' so that not too many threads
 	// read kernel files at the same time: this can cause a "Too many files open" error
@@ -139,6 +191,57 @@ private:
 	std::atomic<int> m_additional_cache_key_started = 0;
 	std::atomic<int> m_additional_cache_key_ended = 0;
 	std::atomic<int> m_precompiled_kernels_compilation_ended = 0;
+	std::atomic<int> m_precompiled_kernels_queued = 0;
+
+	struct CompilationJob
+	{
+		std::function<oroFunction()> function;
+		CompilationPriority priority = COMPILATION_PRIORITY_INTERACTIVE;
+
+		// Key of the job in CompilationQueueState::in_flight_compilations for interactive
+		// jobs and in CompilationQueueState::queued_precompilations for precompilations
+		std::string key;
+
+		bool finished = false;
+		oroFunction result = nullptr;
+	};
+
+	// State shared with the compile workers. The destructor of the compiler stops
+	// the workers and waits for them to finish their current job
+	struct CompilationQueueState
+	{
+		// Protects everything in this structure
+		std::mutex mutex;
+		// Notified when a job is queued or when a precompilation slot is available again
+		std::condition_variable work_condition;
+		// Notified whenever a job is finished
+		std::condition_variable job_finished_condition;
+
+		// One queue per priority, oldest jobs first
+		std::deque<std::shared_ptr<CompilationJob>> interactive_jobs;
+		std::deque<std::shared_ptr<CompilationJob>> precompilation_jobs;
+
+		// Interactive compilations (queued or running) by compilation key, for deduplication
+		std::unordered_map<std::string, std::shared_ptr<CompilationJob>> in_flight_compilations;
+		// Keys of the precompilations queued or running
+		std::unordered_set<std::string> queued_precompilations;
+		bool precompilations_cancelled = false;
+
+		// Precompilations never occupy all the workers such that
+		// there's always a worker available for an interactive compilation
+		int running_precompilations = 0;
+		int max_running_precompilations = 1;
+
+		bool stop = false;
+	};
+
+	void start_workers();
+	static void worker_loop(std::shared_ptr<CompilationQueueState> state);
+	void update_precompilation_log();
+
+	std::shared_ptr<CompilationQueueState> m_compilation_state;
+	std::vector<std::thread> m_workers;
+	std::once_flag m_workers_started;
 
 	ShaderCacheUsageOverride m_shader_cache_force_usage = ShaderCacheUsageOverride::FORCE_SHADER_CACHE_DEFAULT;
 };
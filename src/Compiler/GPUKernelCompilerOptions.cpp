@@ -21,6 +21,7 @@ const std::string GPUKernelCompilerOptions::SHARED_STACK_BVH_TRAVERSAL_SIZE = "S
 const std::string GPUKernelCompilerOptions::SHARED_STACK_BVH_TRAVERSAL_BLOCK_SIZE = "KernelWorkgroupThreadCount";
 const std::string GPUKernelCompilerOptions::REUSE_BSDF_MIS_RAY = "ReuseBSDFMISRay";
 const std::string GPUKernelCompilerOptions::DO_FIRST_BOUNCE_WARP_DIRECTION_REUSE = "DoFirstBounceWarpDirectionReuse";
+const std::string GPUKernelCompilerOptions::PATH_SAMPLER_TYPE = "PathSamplerType";
 
 const std::string GPUKernelCompilerOptions::BSDF_OVERRIDE = "BSDFOverride";
 const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_DIFFUSE_LOBE = "PrincipledBSDFDiffuseLobe";
@@ -32,10 +33,16 @@ const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_DO_METALLIC_ENERGY_C
 const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_DO_METALLIC_FRESNEL_ENERGY_COMPENSATION = "PrincipledBSDFDoMetallicFresnelEnergyCompensation";
 const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_DO_SPECULAR_ENERGY_COMPENSATION = "PrincipledBSDFDoSpecularEnergyCompensation";
 const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_DELTA_DISTRIBUTION_EVALUATION_OPTIMIZATION = "PrincipledBSDFDeltaDistributionEvaluationOptimization";
+const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_0 = "PrincipledBSDFSpecializedLobeMask0";
+const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_1 = "PrincipledBSDFSpecializedLobeMask1";
+const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_2 = "PrincipledBSDFSpecializedLobeMask2";
+const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_3 = "PrincipledBSDFSpecializedLobeMask3";
+const std::string GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE = "PrincipledBSDFSpecializationsCoverScene";
 const std::string GPUKernelCompilerOptions::GGX_SAMPLE_FUNCTION = "PrincipledBSDFAnisotropicGGXSampleFunction";
 const std::string GPUKernelCompilerOptions::NESTED_DIELETRCICS_STACK_SIZE_OPTION = "NestedDielectricsStackSize";
 
 const std::string GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_STRATEGY = "DirectLightSamplingStrategy";
+const std::string GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_BASE_STRATEGY = "DirectLightSamplingBaseStrategy";
 const std::string GPUKernelCompilerOptions::DIRECT_LIGHT_USE_NEE_PLUS_PLUS = "DirectLightUseNEEPlusPlus";
 const std::string GPUKernelCompilerOptions::DIRECT_LIGHT_USE_NEE_PLUS_PLUS_RUSSIAN_ROULETTE = "DirectLightUseNEEPlusPlusRR";
 const std::string GPUKernelCompilerOptions::DIRECT_LIGHT_NEE_PLUS_PLUS_DISPLAY_SHADOW_RAYS_DISCARDED = "DirectLightNEEPlusPlusDisplayShadowRaysDiscarded";
@@ -60,6 +67,7 @@ const std::unordered_set<std::string> GPUKernelCompilerOptions::ALL_MACROS_NAMES
 	GPUKernelCompilerOptions::SHARED_STACK_BVH_TRAVERSAL_BLOCK_SIZE,
 	GPUKernelCompilerOptions::REUSE_BSDF_MIS_RAY,
 	GPUKernelCompilerOptions::DO_FIRST_BOUNCE_WARP_DIRECTION_REUSE,
+	GPUKernelCompilerOptions::PATH_SAMPLER_TYPE,
 
 	GPUKernelCompilerOptions::BSDF_OVERRIDE,
 	GPUKernelCompilerOptions::PRINCIPLED_BSDF_DIFFUSE_LOBE,
@@ -71,10 +79,16 @@ const std::unordered_set<std::string> GPUKernelCompilerOptions::ALL_MACROS_NAMES
 	GPUKernelCompilerOptions::PRINCIPLED_BSDF_DO_METALLIC_FRESNEL_ENERGY_COMPENSATION,
 	GPUKernelCompilerOptions::PRINCIPLED_BSDF_DO_SPECULAR_ENERGY_COMPENSATION,
 	GPUKernelCompilerOptions::PRINCIPLED_BSDF_DELTA_DISTRIBUTION_EVALUATION_OPTIMIZATION,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_0,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_1,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_2,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_3,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE,
 	GPUKernelCompilerOptions::GGX_SAMPLE_FUNCTION,
 	GPUKernelCompilerOptions::NESTED_DIELETRCICS_STACK_SIZE_OPTION,
 
 	GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_STRATEGY,
+	GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_BASE_STRATEGY,
 	GPUKernelCompilerOptions::DIRECT_LIGHT_USE_NEE_PLUS_PLUS,
 	GPUKernelCompilerOptions::DIRECT_LIGHT_USE_NEE_PLUS_PLUS_RUSSIAN_ROULETTE,
 	GPUKernelCompilerOptions::DIRECT_LIGHT_NEE_PLUS_PLUS_DISPLAY_SHADOW_RAYS_DISCARDED,
@@ -103,6 +117,7 @@ GPUKernelCompilerOptions::GPUKernelCompilerOptions()
 	m_options_macro_map[GPUKernelCompilerOptions::SHARED_STACK_BVH_TRAVERSAL_BLOCK_SIZE] = std::make_shared<int>(KernelWorkgroupThreadCount);
 	m_options_macro_map[GPUKernelCompilerOptions::REUSE_BSDF_MIS_RAY] = std::make_shared<int>(ReuseBSDFMISRay);
 	m_options_macro_map[GPUKernelCompilerOptions::DO_FIRST_BOUNCE_WARP_DIRECTION_REUSE] = std::make_shared<int>(DoFirstBounceWarpDirectionReuse);
+	m_options_macro_map[GPUKernelCompilerOptions::PATH_SAMPLER_TYPE] = std::make_shared<int>(PathSamplerType);
 
 	m_options_macro_map[GPUKernelCompilerOptions::BSDF_OVERRIDE] = std::make_shared<int>(BSDFOverride);
 	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_DIFFUSE_LOBE] = std::make_shared<int>(PrincipledBSDFDiffuseLobe);
@@ -114,10 +129,16 @@ GPUKernelCompilerOptions::GPUKernelCompilerOptions()
 	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_DO_METALLIC_FRESNEL_ENERGY_COMPENSATION] = std::make_shared<int>(PrincipledBSDFDoMetallicFresnelEnergyCompensation);
 	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_DO_SPECULAR_ENERGY_COMPENSATION] = std::make_shared<int>(PrincipledBSDFDoSpecularEnergyCompensation);
 	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_DELTA_DISTRIBUTION_EVALUATION_OPTIMIZATION] = std::make_shared<int>(PrincipledBSDFDeltaDistributionEvaluationOptimization);
+	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_0] = std::make_shared<int>(PrincipledBSDFSpecializedLobeMask0);
+	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_1] = std::make_shared<int>(PrincipledBSDFSpecializedLobeMask1);
+	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_2] = std::make_shared<int>(PrincipledBSDFSpecializedLobeMask2);
+	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_3] = std::make_shared<int>(PrincipledBSDFSpecializedLobeMask3);
+	m_options_macro_map[GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE] = std::make_shared<int>(PrincipledBSDFSpecializationsCoverScene);
 	m_options_macro_map[GPUKernelCompilerOptions::GGX_SAMPLE_FUNCTION] = std::make_shared<int>(PrincipledBSDFAnisotropicGGXSampleFunction);
 	m_options_macro_map[GPUKernelCompilerOptions::NESTED_DIELETRCICS_STACK_SIZE_OPTION] = std::make_shared<int>(NestedDielectricsStackSize);
 
 	m_options_macro_map[GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_STRATEGY] = std::make_shared<int>(DirectLightSamplingStrategy);
+	m_options_macro_map[GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_BASE_STRATEGY] = std::make_shared<int>(DirectLightSamplingBaseStrategy);
 	m_options_macro_map[GPUKernelCompilerOptions::DIRECT_LIGHT_USE_NEE_PLUS_PLUS] = std::make_shared<int>(DirectLightUseNEEPlusPlus);
 	m_options_macro_map[GPUKernelCompilerOptions::DIRECT_LIGHT_USE_NEE_PLUS_PLUS_RUSSIAN_ROULETTE] = std::make_shared<int>(DirectLightUseNEEPlusPlusRR);
 	m_options_macro_map[GPUKernelCompilerOptions::DIRECT_LIGHT_NEE_PLUS_PLUS_DISPLAY_SHADOW_RAYS_DISCARDED] = std::make_shared<int>(DirectLightNEEPlusPlusDisplayShadowRaysDiscarded);
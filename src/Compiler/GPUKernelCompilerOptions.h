@@ -22,6 +22,7 @@ public:
 	static const std::string SHARED_STACK_BVH_TRAVERSAL_SIZE;
 	static const std::string REUSE_BSDF_MIS_RAY;
 	static const std::string DO_FIRST_BOUNCE_WARP_DIRECTION_REUSE;
+	static const std::string PATH_SAMPLER_TYPE;
 
 	static const std::string BSDF_OVERRIDE;
 	static const std::string PRINCIPLED_BSDF_DIFFUSE_LOBE;
@@ -33,10 +34,16 @@ public:
 	static const std::string PRINCIPLED_BSDF_DO_METALLIC_FRESNEL_ENERGY_COMPENSATION;
 	static const std::string PRINCIPLED_BSDF_DO_SPECULAR_ENERGY_COMPENSATION;
 	static const std::string PRINCIPLED_BSDF_DELTA_DISTRIBUTION_EVALUATION_OPTIMIZATION;
+	static const std::string PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_0;
+	static const std::string PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_1;
+	static const std::string PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_2;
+	static const std::string PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_3;
+	static const std::string PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE;
 	static const std::string GGX_SAMPLE_FUNCTION;
 	static const std::string NESTED_DIELETRCICS_STACK_SIZE_OPTION;
 
 	static const std::string DIRECT_LIGHT_SAMPLING_STRATEGY;
+	static const std::string DIRECT_LIGHT_SAMPLING_BASE_STRATEGY;
 	static const std::string DIRECT_LIGHT_USE_NEE_PLUS_PLUS;
 	static const std::string DIRECT_LIGHT_USE_NEE_PLUS_PLUS_RUSSIAN_ROULETTE;
 	static const std::string DIRECT_LIGHT_NEE_PLUS_PLUS_DISPLAY_SHADOW_RAYS_DISCARDED;
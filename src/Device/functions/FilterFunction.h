@@ -9,6 +9,7 @@
 #include "Device/functions/FilterFunctionPayload.h"
 #include "Device/includes/FixIntellisense.h"
 #include "Device/includes/Material.h"
+#include "Device/includes/SceneHit.h"
 
 #include "HostDeviceCommon/RenderData.h"
 #include "HostDeviceCommon/Xorshift.h"
@@ -22,13 +23,25 @@
 HIPRT_DEVICE HIPRT_INLINE bool filter_function(const hiprtRay&, const void*, void* payld, const hiprtHit& hit)
 {
 	FilterFunctionPayload* payload = reinterpret_cast<FilterFunctionPayload*>(payld);
-	if (hit.primID == payload->last_hit_primitive_index)
+
+	// The primitive index of the hits of the GPU is relative to the mesh that was hit
+	hiprtHit scene_hit = hit;
+	scene_hit.primID = get_scene_primitive_index(*payload->render_data, hit);
+#ifdef __KERNELCC__
+	int hit_instance_id = hit.instanceID;
+#else
+	int hit_instance_id = payload->traversed_instance_id;
+#endif
+	if (scene_hit.primID == payload->last_hit_primitive_index && hit_instance_id == payload->last_hit_instance_id)
 		// This is a self-intersection, filtering it out
 		//
 		// Triangles are planar so one given triangle can
 		// never be intersect twice in a row (unless we're absolutely
 		// perfectly parallel to the triangle but let's ignore that...)
 		//
+		// The same triangle on another instance of the mesh is a different
+		// triangle in world space, that's a valid hit.
+		//
 		// This self-intersection avoidance only works for planar primitives
 		return true;
 
@@ -39,14 +52,14 @@ HIPRT_DEVICE HIPRT_INLINE bool filter_function(const hiprtRay&, const void*, voi
 		// Alpha testing is disable at the current bounce
 		return false;
 
-	int material_index = payload->render_data->buffers.material_indices[hit.primID];
+	int material_index = payload->render_data->buffers.material_indices[scene_hit.primID];
 	if (payload->render_data->buffers.material_opaque[material_index])
 		// The material is fully opaque, no need to test further, accept the intersection
 		return false;
 
 	// Composition both the alpha of the base color texture and the material
 	unsigned short int base_color_texture_index = payload->render_data->buffers.materials_buffer.get_base_color_texture_index(material_index);
-	float base_color_alpha = get_hit_base_color_alpha(*payload->render_data, base_color_texture_index, hit);
+	float base_color_alpha = get_hit_base_color_alpha(*payload->render_data, base_color_texture_index, scene_hit);
 	float alpha_opacity = payload->render_data->buffers.materials_buffer.get_alpha_opacity(material_index);
 	float composited_alpha = alpha_opacity * base_color_alpha;
 
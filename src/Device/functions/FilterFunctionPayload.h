@@ -21,6 +21,13 @@ struct FilterFunctionPayload
 
 	// -- Self intersection avoidance payload --
 	int last_hit_primitive_index;
+	// The instances of a mesh share the primitive indices of the mesh so the
+	// instance of the last hit is needed to know that this is a self intersection
+	int last_hit_instance_id;
+	// CPU only. The BLASes of the two-level BVH are shared by the instances of a mesh
+	// so the hits of the BLASes do not know their instance: the two-level BVH sets
+	// the instance it is traversing here. The single-level BVHs leave it at 0
+	int traversed_instance_id = 0;
 	// -- Self intersection avoidance payload --
 };
 
@@ -21,6 +21,11 @@
 #include "HostDeviceCommon/Material/MaterialUnpacked.h"
 #include "HostDeviceCommon/Xorshift.h"
 
+#ifndef __KERNELCC__
+#include <array>
+#include <utility> // for std::index_sequence
+#endif
+
  /** References:
   *
   * [1] [CSE 272 University of California San Diego - Disney BSDF Homework] https://cseweb.ucsd.edu/~tzli/cse272/wi2024/homework1.pdf
@@ -1108,6 +1113,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F internal_eval_diffuse_layer(const HIP
  * The "glossy base" is the combination of a specular GGX layer
  * on top of a diffuse BRDF.
  */
+template <unsigned int LobeMask>
 HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F internal_eval_glossy_base(const HIPRTRenderData& render_data, const DeviceUnpackedEffectiveMaterial& material,
                                                                      const float3& local_view_direction, const float3 local_to_light_direction, const float3& local_half_vector, 
                                                                      const float3& local_view_direction_rotated, const float3 local_to_light_direction_rotated, const float3& local_half_vector_rotated,
@@ -1120,18 +1126,27 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F internal_eval_glossy_base(const HIPRT
     ColorRGB32F glossy_base_contribution = ColorRGB32F(0.0f);
 
     // Evaluating the two components of the glossy base
-    glossy_base_contribution += internal_eval_specular_layer(render_data, material,
-        local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, shading_normal, 
-        incident_medium_ior, specular_weight, refracting, specular_proba_norm, layers_throughput, out_cumulative_pdf, incident_light_info, current_bounce);
-    glossy_base_contribution += internal_eval_diffuse_layer(render_data, incident_medium_ior, material, local_view_direction, local_to_light_direction, diffuse_weight, diffuse_proba_norm, layers_throughput, out_cumulative_pdf);
-
-    float glossy_base_energy_compensation = get_principled_energy_compensation_glossy_base(render_data, material, incident_medium_ior, local_view_direction.z, current_bounce);
-    return glossy_base_contribution / glossy_base_energy_compensation;
+    if constexpr ((LobeMask & PRINCIPLED_LOBE_SPECULAR) != 0)
+        glossy_base_contribution += internal_eval_specular_layer(render_data, material,
+            local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, shading_normal, 
+            incident_medium_ior, specular_weight, refracting, specular_proba_norm, layers_throughput, out_cumulative_pdf, incident_light_info, current_bounce);
+    if constexpr ((LobeMask & PRINCIPLED_LOBE_DIFFUSE) != 0)
+        glossy_base_contribution += internal_eval_diffuse_layer(render_data, incident_medium_ior, material, local_view_direction, local_to_light_direction, diffuse_weight, diffuse_proba_norm, layers_throughput, out_cumulative_pdf);
+
+    // The glossy base isn't compensated without the specular
+    // layer, see get_principled_energy_compensation_glossy_base()
+    if constexpr ((LobeMask & PRINCIPLED_LOBE_SPECULAR) != 0)
+        glossy_base_contribution /= get_principled_energy_compensation_glossy_base(render_data, material, incident_medium_ior, local_view_direction.z, current_bounce);
+
+    return glossy_base_contribution;
 }
 
 /**
  * Computes the lobes weights for the principled BSDF
+ * 
+ * The lobes that are not in 'LobeMask' always have a weight of 0
  */
+template <unsigned int LobeMask>
 HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_weights(const DeviceUnpackedEffectiveMaterial& material,
                                                                       bool outside_object,
                                                                       float& out_coat_weight, float& out_sheen_weight,
@@ -1148,8 +1163,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_weights(const Devi
     // The layering follows the one of the principled BSDF of blender:
     // [10] https://docs.blender.org/manual/fr/dev/render/shader_nodes/shader/principled.html
 
-    out_coat_weight = material.coat * outside_object;
-    out_sheen_weight = material.sheen * outside_object;
+    out_coat_weight = (LobeMask & PRINCIPLED_LOBE_COAT) ? material.coat * outside_object : 0.0f;
+    out_sheen_weight = (LobeMask & PRINCIPLED_LOBE_SHEEN) ? material.sheen * outside_object : 0.0f;
     // Metal 1 and metal 2 are the two metallic lobes for the two roughnesses.
     // Having 2 roughnesses (linearly blended together) can enable interesting effects
     // that cannot be achieved with a single GGX metal lobe.
@@ -1157,8 +1172,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_weights(const Devi
     // See [Revisiting Physically Based Shading at Imageworks, Kulla & Conty, SIGGRAPH 2017],
     // "Double Specular" for more details
     float metallic = material.metallic;
-    out_metal_1_weight = metallic * outside_object;
-    out_metal_2_weight = metallic * outside_object;
+    out_metal_1_weight = (LobeMask & PRINCIPLED_LOBE_METAL) ? metallic * outside_object : 0.0f;
+    out_metal_2_weight = (LobeMask & PRINCIPLED_LOBE_METAL) ? metallic * outside_object : 0.0f;
 
     float second_roughness_weight = material.second_roughness_weight;
     out_metal_1_weight = hippt::lerp(out_metal_1_weight, 0.0f, second_roughness_weight);
@@ -1166,11 +1181,11 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_weights(const Devi
 
     float specular_transmission = material.specular_transmission;
     float diffuse_transmission = material.diffuse_transmission;
-    out_glass_weight = !outside_object ? (1.0f - diffuse_transmission) : (1.0f - metallic) * (1.0f - diffuse_transmission) * specular_transmission;
-    out_diffuse_transmission_weight = !outside_object ? diffuse_transmission : (1.0f - metallic) * diffuse_transmission;
+    out_glass_weight = !(LobeMask & PRINCIPLED_LOBE_GLASS) ? 0.0f : !outside_object ? (1.0f - diffuse_transmission) : (1.0f - metallic) * (1.0f - diffuse_transmission) * specular_transmission;
+    out_diffuse_transmission_weight = !(LobeMask & PRINCIPLED_LOBE_DIFFUSE_TRANSMISSION) ? 0.0f : !outside_object ? diffuse_transmission : (1.0f - metallic) * diffuse_transmission;
 
-    out_specular_weight = (1.0f - metallic) * (1.0f - specular_transmission * (1.0f - diffuse_transmission)) * material.specular * outside_object;
-    out_diffuse_weight = (1.0f - metallic) * (1.0f - specular_transmission) * (1.0f - diffuse_transmission) * outside_object;
+    out_specular_weight = (LobeMask & PRINCIPLED_LOBE_SPECULAR) ? (1.0f - metallic) * (1.0f - specular_transmission * (1.0f - diffuse_transmission)) * material.specular * outside_object : 0.0f;
+    out_diffuse_weight = (LobeMask & PRINCIPLED_LOBE_DIFFUSE) ? (1.0f - metallic) * (1.0f - specular_transmission) * (1.0f - diffuse_transmission) * outside_object : 0.0f;
 }
 
 /**
@@ -1179,6 +1194,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_weights(const Devi
  * is below the shading normal (probably due to normal mapping / smooth
  * vertex normals)
  */
+template <unsigned int LobeMask>
 HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_weights_fringe_fix(const DeviceUnpackedEffectiveMaterial& material, 
                                                                       const float3& view_direction, const float3& shading_normal, const float3& geometric_normal,
                                                                       float3& in_out_normal,
@@ -1217,7 +1233,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_weights_fringe_fix
         out_outside_object = true;
     }
 
-    principled_bsdf_get_lobes_weights(material, out_outside_object, 
+    principled_bsdf_get_lobes_weights<LobeMask>(material, out_outside_object, 
                                       out_coat_weight, out_sheen_weight, 
                                       out_metal_1_weight, out_metal_2_weight, 
                                       out_specular_weight, out_diffuse_weight, 
@@ -1254,12 +1270,53 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void principled_bsdf_get_lobes_sampling_proba(
     out_diffuse_transmission_sampling_proba = diffuse_transmission_weight * normalize_factor;
 }
 
+/**
+ * Returns the lobes of the principled BSDF (combination of PRINCIPLED_LOBE_XXX) that have a
+ * non-zero weight when evaluating or sampling 'material' from 'view_direction'.
+ * 
+ * principled_bsdf_eval<LobeMask>() and principled_bsdf_sample<LobeMask>() with a 'LobeMask'
+ * that contains all these lobes give the same result as the BSDF with all the lobes
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE unsigned int principled_bsdf_get_lobe_mask(const DeviceUnpackedEffectiveMaterial& material, const float3& view_direction, const float3& shading_normal)
+{
+    float metallic = material.metallic;
+    float specular_transmission = material.specular_transmission;
+    float diffuse_transmission = material.diffuse_transmission;
+    unsigned int lobe_mask = MaterialUtils::get_principled_lobe_mask(material.coat, material.sheen,
+                                                                     metallic, metallic, material.specular,
+                                                                     specular_transmission, specular_transmission,
+                                                                     diffuse_transmission, diffuse_transmission);
+
+    if (hippt::dot(view_direction, shading_normal) <= 0.0f)
+        // Inside the object (or below the shading normal because of normal mapping), the glass
+        // and diffuse transmission lobes are used whatever the other parameters of the material.
+        // See principled_bsdf_get_lobes_weights()
+        lobe_mask = MaterialUtils::add_principled_inside_lobes(lobe_mask, diffuse_transmission, diffuse_transmission);
+
+    return lobe_mask;
+}
+
+/**
+ * Version of the principled BSDF that only has the lobes of 'LobeMask' (combination of PRINCIPLED_LOBE_XXX).
+ * The other lobes are removed at compile time.
+ * 
+ * The lobes of the material that are not in 'LobeMask' are ignored so this must only
+ * be called with a 'LobeMask' that contains principled_bsdf_get_lobe_mask() for the result to be correct
+ */
+template <unsigned int LobeMask>
 HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_eval(const HIPRTRenderData& render_data, const DeviceUnpackedEffectiveMaterial& material, 
                                                                 RayVolumeState& ray_volume_state, bool update_ray_volume_state,
                                                                 const float3& view_direction, float3 shading_normal, const float3& to_light_direction, 
                                                                 float& pdf,
                                                                 int current_bounce, BSDFIncidentLightInfo incident_light_info)
 {
+    constexpr bool has_coat = (LobeMask & PRINCIPLED_LOBE_COAT) != 0;
+    constexpr bool has_sheen = (LobeMask & PRINCIPLED_LOBE_SHEEN) != 0;
+    constexpr bool has_metal = (LobeMask & PRINCIPLED_LOBE_METAL) != 0;
+    constexpr bool has_glossy_base = (LobeMask & (PRINCIPLED_LOBE_SPECULAR | PRINCIPLED_LOBE_DIFFUSE)) != 0;
+    constexpr bool has_glass = (LobeMask & PRINCIPLED_LOBE_GLASS) != 0;
+    constexpr bool has_diffuse_transmission = (LobeMask & PRINCIPLED_LOBE_DIFFUSE_TRANSMISSION) != 0;
+
     pdf = 0.0f;
 
     // Only the glass lobe is considered when evaluating
@@ -1290,7 +1347,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_eval(const HIPRTRende
 
     float coat_weight, sheen_weight, metal_1_weight, metal_2_weight;
     float specular_weight, diffuse_weight, glass_weight, diffuse_transmission_weight;
-    principled_bsdf_get_lobes_weights(material, outside_object,
+    principled_bsdf_get_lobes_weights<LobeMask>(material, outside_object,
                                       coat_weight, sheen_weight, metal_1_weight, metal_2_weight,
                                       specular_weight, diffuse_weight, glass_weight, diffuse_transmission_weight);
 
@@ -1313,18 +1370,26 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_eval(const HIPRTRende
     // 'weight * !refracting' so that lobes that do not allow refractions
     // (which is pretty much all of them except glass) do no get evaluated
     // (because their weight becomes 0)
-    final_color += internal_eval_coat_layer(render_data, material,
-                                            local_view_direction, local_to_light_direction, local_half_vector, shading_normal, 
-                                            incident_medium_ior, coat_weight, refracting, coat_proba, layers_throughput, pdf, incident_light_info, current_bounce);
-    final_color += internal_eval_sheen_layer(render_data, material, 
-                                             local_view_direction, local_to_light_direction, to_light_direction, shading_normal, 
-                                             incident_medium_ior, sheen_weight, sheen_proba, layers_throughput, pdf);
-    final_color += internal_eval_metal_layer(render_data, material, material.roughness, material.anisotropy, 
-                                             local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, incident_medium_ior, 
-                                             metal_1_weight * !refracting, metal_1_proba, layers_throughput, pdf, incident_light_info, true, current_bounce);
-    final_color += internal_eval_metal_layer(render_data, material, material.second_roughness, material.anisotropy, 
-                                             local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, incident_medium_ior, 
-                                             metal_2_weight * !refracting, metal_2_proba, layers_throughput, pdf, incident_light_info, false, current_bounce);
+    //
+    // The layers that are not in the lobe mask aren't evaluated at all: with a weight of 0, they
+    // would have no contribution and wouldn't attenuate the layers below them either
+    if constexpr (has_coat)
+        final_color += internal_eval_coat_layer(render_data, material,
+                                                local_view_direction, local_to_light_direction, local_half_vector, shading_normal, 
+                                                incident_medium_ior, coat_weight, refracting, coat_proba, layers_throughput, pdf, incident_light_info, current_bounce);
+    if constexpr (has_sheen)
+        final_color += internal_eval_sheen_layer(render_data, material, 
+                                                 local_view_direction, local_to_light_direction, to_light_direction, shading_normal, 
+                                                 incident_medium_ior, sheen_weight, sheen_proba, layers_throughput, pdf);
+    if constexpr (has_metal)
+    {
+        final_color += internal_eval_metal_layer(render_data, material, material.roughness, material.anisotropy, 
+                                                 local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, incident_medium_ior, 
+                                                 metal_1_weight * !refracting, metal_1_proba, layers_throughput, pdf, incident_light_info, true, current_bounce);
+        final_color += internal_eval_metal_layer(render_data, material, material.second_roughness, material.anisotropy, 
+                                                 local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, incident_medium_ior, 
+                                                 metal_2_weight * !refracting, metal_2_proba, layers_throughput, pdf, incident_light_info, false, current_bounce);
+    }
     // Careful here to evaluate the glass layer before the glossy
     // base otherwise, layers_throughput is going to be modified
     // by the specular layer evaluation (in the glossy base) to 
@@ -1333,36 +1398,52 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_eval(const HIPRTRende
     // The glass layer isn't below the specular layer , it's "next to"
     // the specular layer so we don't want the specular-layer-fresnel-attenuation
     // there
-    final_color += internal_eval_glass_layer(render_data, material,
-                                             ray_volume_state, update_ray_volume_state, local_view_direction_rotated, local_to_light_direction_rotated,
-                                             glass_weight, glass_proba, layers_throughput, pdf, incident_light_info, current_bounce);
-    final_color += internal_eval_glossy_base(render_data, material,
-                                             local_view_direction, local_to_light_direction, local_half_vector, 
-                                             local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, shading_normal, 
-                                             incident_medium_ior, diffuse_weight * !refracting, specular_weight, refracting, 
-                                             diffuse_proba, specular_proba, 
-                                             layers_throughput, pdf, 
-                                             incident_light_info, current_bounce);
-    final_color += internal_eval_diffuse_transmission_layer(render_data, material,
-                                                            ray_volume_state, update_ray_volume_state,
-                                                            local_view_direction, local_to_light_direction, diffuse_transmission_weight, diffuse_transmission_proba, layers_throughput, pdf);
+    if constexpr (has_glass)
+        final_color += internal_eval_glass_layer(render_data, material,
+                                                 ray_volume_state, update_ray_volume_state, local_view_direction_rotated, local_to_light_direction_rotated,
+                                                 glass_weight, glass_proba, layers_throughput, pdf, incident_light_info, current_bounce);
+    if constexpr (has_glossy_base)
+        final_color += internal_eval_glossy_base<LobeMask>(render_data, material,
+                                                           local_view_direction, local_to_light_direction, local_half_vector, 
+                                                           local_view_direction_rotated, local_to_light_direction_rotated, local_half_vector_rotated, shading_normal, 
+                                                           incident_medium_ior, diffuse_weight * !refracting, specular_weight, refracting, 
+                                                           diffuse_proba, specular_proba, 
+                                                           layers_throughput, pdf, 
+                                                           incident_light_info, current_bounce);
+    if constexpr (has_diffuse_transmission)
+        final_color += internal_eval_diffuse_transmission_layer(render_data, material,
+                                                                ray_volume_state, update_ray_volume_state,
+                                                                local_view_direction, local_to_light_direction, diffuse_transmission_weight, diffuse_transmission_proba, layers_throughput, pdf);
 
     // The clearcoat compensation is done here and not in the clearcoat function
     // because the clearcoat sits on top of everything else. This means that the clearcoat
     // closure contains the full BSDF below. So the full BSDF below + the clearcoat (= the whole BSDF actually)
     // should be compensated, not just the clearcoat lobe. So that's why we're doing
     // it here,  after the full BSDF evaluation so that everything gets compensated
-    final_color /= get_principled_energy_compensation_clearcoat_lobe(render_data, material, incident_medium_ior, local_view_direction.z, current_bounce);
+    if constexpr (has_coat)
+        final_color /= get_principled_energy_compensation_clearcoat_lobe(render_data, material, incident_medium_ior, local_view_direction.z, current_bounce);
 
     return final_color;
 }
 
+/**
+ * Sampling counterpart of principled_bsdf_eval<LobeMask>()
+ */
+template <unsigned int LobeMask>
 HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRenderData& render_data, const DeviceUnpackedEffectiveMaterial& material,
                                                                   RayVolumeState& ray_volume_state, bool update_ray_volume_state,
                                                                   const float3& view_direction, const float3& shading_normal, const float3& geometric_normal, float3& output_direction,
                                                                   float& pdf, Xorshift32Generator& random_number_generator, 
                                                                   int current_bounce, BSDFIncidentLightInfo* light_sample_info_out)
 {
+    constexpr bool has_coat = (LobeMask & PRINCIPLED_LOBE_COAT) != 0;
+    constexpr bool has_sheen = (LobeMask & PRINCIPLED_LOBE_SHEEN) != 0;
+    constexpr bool has_metal = (LobeMask & PRINCIPLED_LOBE_METAL) != 0;
+    constexpr bool has_specular = (LobeMask & PRINCIPLED_LOBE_SPECULAR) != 0;
+    constexpr bool has_diffuse = (LobeMask & PRINCIPLED_LOBE_DIFFUSE) != 0;
+    constexpr bool has_glass = (LobeMask & PRINCIPLED_LOBE_GLASS) != 0;
+    constexpr bool has_diffuse_transmission = (LobeMask & PRINCIPLED_LOBE_DIFFUSE_TRANSMISSION) != 0;
+
     pdf = 0.0f;
 
     float3 normal = shading_normal;
@@ -1377,7 +1458,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRen
     float diffuse_sampling_weight;
     float glass_sampling_weight;
     float diffuse_transmission_weight;
-    principled_bsdf_get_lobes_weights_fringe_fix(material, view_direction,
+    principled_bsdf_get_lobes_weights_fringe_fix<LobeMask>(material, view_direction,
         shading_normal, geometric_normal, normal,
         outside_object,
         coat_sampling_weight, sheen_sampling_weight,
@@ -1406,8 +1487,10 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRen
     // The last cdf[] is implicitely 1.0f so don't need to include it
 
     float rand_1 = random_number_generator();
-    bool sampling_diffuse_transmission_lobe = rand_1 > cdf5 && rand_1 < cdf6;
-    bool sampling_glass_lobe = rand_1 > cdf6;
+    // The lobes that are not in the lobe mask have a sampling probability of 0 but the
+    // constexpr flags in the conditions below also remove their sampling code completely
+    bool sampling_diffuse_transmission_lobe = has_diffuse_transmission && rand_1 > cdf5 && rand_1 < cdf6;
+    bool sampling_glass_lobe = has_glass && rand_1 > cdf6;
     if (sampling_glass_lobe || sampling_diffuse_transmission_lobe)
     {
         // We're going to sample the glass lobe
@@ -1450,7 +1533,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRen
     float3 local_view_direction_rotated = world_to_local_frame(TR, BR, normal, view_direction);
 
     BSDFIncidentLightInfo incident_light_info = BSDFIncidentLightInfo::NO_INFO;
-    if (rand_1 < cdf0)
+    if (has_coat && rand_1 < cdf0)
     {
         // Sampling the coat lobe
 
@@ -1461,7 +1544,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRen
         incident_light_info = BSDFIncidentLightInfo::LIGHT_DIRECTION_SAMPLED_FROM_COAT_LOBE;
         output_direction = local_to_world_frame(TR_coat, BR_coat, normal, principled_coat_sample(material, local_view_direction_rotated_coat, random_number_generator));
     }
-    else if (rand_1 < cdf1)
+    else if (has_sheen && rand_1 < cdf1)
     {
         // Sampling the sheen lobe
 
@@ -1471,38 +1554,42 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRen
 
         output_direction = local_to_world_frame(T, B, normal, principled_sheen_sample(render_data, material, local_view_direction, normal, random_number_generator));
     }
-    else if (rand_1 < cdf2)
+    else if (has_metal && rand_1 < cdf2)
     {
         // First metallic lobe sample
         incident_light_info = BSDFIncidentLightInfo::LIGHT_DIRECTION_SAMPLED_FROM_FIRST_METAL_LOBE;
         output_direction = local_to_world_frame(TR, BR, normal, principled_metallic_sample(material.roughness, material.anisotropy, local_view_direction_rotated, random_number_generator));
     }
-    else if (rand_1 < cdf3)
+    else if (has_metal && rand_1 < cdf3)
     {
         // Second metallic lobe sample
         incident_light_info = BSDFIncidentLightInfo::LIGHT_DIRECTION_SAMPLED_FROM_SECOND_METAL_LOBE;
         output_direction = local_to_world_frame(TR, BR, normal, principled_metallic_sample(material.second_roughness, material.anisotropy, local_view_direction_rotated, random_number_generator));
     }
-    else if (rand_1 < cdf4)
+    else if (has_specular && rand_1 < cdf4)
     {
         // Sampling the specular lobe
         incident_light_info = BSDFIncidentLightInfo::LIGHT_DIRECTION_SAMPLED_FROM_SPECULAR_LOBE;
         output_direction = local_to_world_frame(TR, BR, normal, principled_specular_sample(material.roughness, material.anisotropy, local_view_direction_rotated, random_number_generator));
     }
-    else if (rand_1 < cdf5)
+    else if (has_diffuse && rand_1 < cdf5)
         // No call to local_to_world_frame() since the sample diffuse functions
         // already returns in world space around the given normal
         output_direction = principled_diffuse_sample(normal, random_number_generator);
-    else if (rand_1 < cdf6)
+    else if (has_diffuse_transmission && rand_1 < cdf6)
         // Diffuse transmission lobe
         output_direction = principled_diffuse_transmission_sample(normal, random_number_generator);
-    else
+    else if (has_glass)
     {
         // When sampling the glass lobe, if we're reflecting off the glass, we're going to have to pop the stack.
         // This is handled inside glass_sample because we cannot know from here if we refracted or reflected
         output_direction = local_to_world_frame(TR, BR, normal, principled_glass_sample(render_data.buffers.materials_buffer, material,
             ray_volume_state, update_ray_volume_state, local_view_direction_rotated, random_number_generator, incident_light_info));
     }
+    else
+        // Only reached if the last cdf[] of the lobe mask is slightly below 1.0f
+        // because of floating point errors
+        return ColorRGB32F(0.0f);
 
     if (hippt::dot(output_direction, shading_normal) < 0 && !sampling_glass_lobe && !sampling_diffuse_transmission_lobe)
         // It can happen that the light direction sampled is below the surface. 
@@ -1519,7 +1606,152 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRen
     // If we were using 'normal', we would always be outside the surface because 'normal' is flipped
     // (a few lines above in the code) so that it is in the same hemisphere as the view direction and
     // eval() will then think that we're always outside the surface even though that's not the case
-    return principled_bsdf_eval(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, output_direction, pdf, current_bounce, incident_light_info);
+    return principled_bsdf_eval<LobeMask>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, output_direction, pdf, current_bounce, incident_light_info);
+}
+
+#ifdef __KERNELCC__
+/**
+ * Lobe mask of the version of the BSDF used by the dispatch below when no specialization
+ * has all the lobes needed by the material.
+ * 
+ * That's the generic version with all the lobes unless the specializations cover all the materials
+ * of the scene (PrincipledBSDFSpecializationsCoverScene), in which case the last specialization is
+ * used without checking its mask so that the generic version isn't compiled in the kernels
+ */
+#if PrincipledBSDFSpecializationsCoverScene == KERNEL_OPTION_FALSE || PrincipledBSDFSpecializedLobeMask0 == PRINCIPLED_LOBE_NONE
+#define PRINCIPLED_BSDF_FALLBACK_LOBE_MASK PRINCIPLED_LOBE_ALL
+#elif PrincipledBSDFSpecializedLobeMask1 == PRINCIPLED_LOBE_NONE
+#define PRINCIPLED_BSDF_FALLBACK_LOBE_MASK (PrincipledBSDFSpecializedLobeMask0)
+#elif PrincipledBSDFSpecializedLobeMask2 == PRINCIPLED_LOBE_NONE
+#define PRINCIPLED_BSDF_FALLBACK_LOBE_MASK (PrincipledBSDFSpecializedLobeMask1)
+#elif PrincipledBSDFSpecializedLobeMask3 == PRINCIPLED_LOBE_NONE
+#define PRINCIPLED_BSDF_FALLBACK_LOBE_MASK (PrincipledBSDFSpecializedLobeMask2)
+#else
+#define PRINCIPLED_BSDF_FALLBACK_LOBE_MASK (PrincipledBSDFSpecializedLobeMask3)
+#endif
+#else
+using PrincipledBSDFEvalFunction = ColorRGB32F(*)(const HIPRTRenderData&, const DeviceUnpackedEffectiveMaterial&,
+                                                  RayVolumeState&, bool,
+                                                  const float3&, float3, const float3&,
+                                                  float&,
+                                                  int, BSDFIncidentLightInfo);
+using PrincipledBSDFSampleFunction = ColorRGB32F(*)(const HIPRTRenderData&, const DeviceUnpackedEffectiveMaterial&,
+                                                    RayVolumeState&, bool,
+                                                    const float3&, const float3&, const float3&, float3&,
+                                                    float&, Xorshift32Generator&,
+                                                    int, BSDFIncidentLightInfo*);
+
+/**
+ * The CPU can't compile the BSDF for the lobes of the scene once it is loaded so all
+ * the versions of the BSDF (one per lobe mask) are compiled and the ones of the
+ * specializations of the scene are picked at runtime from these tables, indexed by lobe mask
+ */
+template <std::size_t... LobeMasks>
+std::array<PrincipledBSDFEvalFunction, PRINCIPLED_LOBE_ALL + 1> principled_bsdf_make_eval_table(std::index_sequence<LobeMasks...>)
+{
+    return { &principled_bsdf_eval<static_cast<unsigned int>(LobeMasks)>... };
+}
+
+template <std::size_t... LobeMasks>
+std::array<PrincipledBSDFSampleFunction, PRINCIPLED_LOBE_ALL + 1> principled_bsdf_make_sample_table(std::index_sequence<LobeMasks...>)
+{
+    return { &principled_bsdf_sample<static_cast<unsigned int>(LobeMasks)>... };
+}
+
+/**
+ * Returns the first specialization of 'render_data.bsdfs_data.principled_bsdf_specialized_lobe_masks'
+ * that has all the lobes of 'lobe_mask'. PRINCIPLED_LOBE_ALL if there is none
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE unsigned int principled_bsdf_get_specialized_lobe_mask(const HIPRTRenderData& render_data, unsigned int lobe_mask)
+{
+    for (int i = 0; i < render_data.bsdfs_data.principled_bsdf_specialized_lobe_mask_count; i++)
+    {
+        unsigned int specialized_lobe_mask = render_data.bsdfs_data.principled_bsdf_specialized_lobe_masks[i];
+        if ((lobe_mask & ~specialized_lobe_mask) == 0)
+            return specialized_lobe_mask;
+    }
+
+    return PRINCIPLED_LOBE_ALL;
+}
+#endif
+
+/**
+ * Evaluates the principled BSDF with the first specialized version that has all
+ * the lobes needed by the material. The version with all the lobes is used if no
+ * specialized version fits.
+ * 
+ * On the GPU, the specializations are the PrincipledBSDFSpecializedLobeMaskX kernel options.
+ * On the CPU, they are chosen at runtime, see BRDFsData::principled_bsdf_specialized_lobe_masks
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_eval(const HIPRTRenderData& render_data, const DeviceUnpackedEffectiveMaterial& material, 
+                                                                RayVolumeState& ray_volume_state, bool update_ray_volume_state,
+                                                                const float3& view_direction, float3 shading_normal, const float3& to_light_direction, 
+                                                                float& pdf,
+                                                                int current_bounce, BSDFIncidentLightInfo incident_light_info)
+{
+    unsigned int lobe_mask = principled_bsdf_get_lobe_mask(material, view_direction, shading_normal);
+
+#ifdef __KERNELCC__
+#if PrincipledBSDFSpecializedLobeMask0 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask0) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask0)) == 0)
+        return principled_bsdf_eval<PrincipledBSDFSpecializedLobeMask0>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, to_light_direction, pdf, current_bounce, incident_light_info);
+#endif
+#if PrincipledBSDFSpecializedLobeMask1 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask1) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask1)) == 0)
+        return principled_bsdf_eval<PrincipledBSDFSpecializedLobeMask1>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, to_light_direction, pdf, current_bounce, incident_light_info);
+#endif
+#if PrincipledBSDFSpecializedLobeMask2 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask2) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask2)) == 0)
+        return principled_bsdf_eval<PrincipledBSDFSpecializedLobeMask2>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, to_light_direction, pdf, current_bounce, incident_light_info);
+#endif
+#if PrincipledBSDFSpecializedLobeMask3 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask3) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask3)) == 0)
+        return principled_bsdf_eval<PrincipledBSDFSpecializedLobeMask3>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, to_light_direction, pdf, current_bounce, incident_light_info);
+#endif
+
+    return principled_bsdf_eval<PRINCIPLED_BSDF_FALLBACK_LOBE_MASK>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, to_light_direction, pdf, current_bounce, incident_light_info);
+#else
+    static const std::array<PrincipledBSDFEvalFunction, PRINCIPLED_LOBE_ALL + 1> eval_functions = principled_bsdf_make_eval_table(std::make_index_sequence<PRINCIPLED_LOBE_ALL + 1>());
+
+    return eval_functions[principled_bsdf_get_specialized_lobe_mask(render_data, lobe_mask)](render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, to_light_direction, pdf, current_bounce, incident_light_info);
+#endif
+}
+
+/**
+ * Same dispatch as principled_bsdf_eval() for sampling the principled BSDF
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F principled_bsdf_sample(const HIPRTRenderData& render_data, const DeviceUnpackedEffectiveMaterial& material,
+                                                                  RayVolumeState& ray_volume_state, bool update_ray_volume_state,
+                                                                  const float3& view_direction, const float3& shading_normal, const float3& geometric_normal, float3& output_direction,
+                                                                  float& pdf, Xorshift32Generator& random_number_generator, 
+                                                                  int current_bounce, BSDFIncidentLightInfo* light_sample_info_out)
+{
+    unsigned int lobe_mask = principled_bsdf_get_lobe_mask(material, view_direction, shading_normal);
+
+#ifdef __KERNELCC__
+#if PrincipledBSDFSpecializedLobeMask0 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask0) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask0)) == 0)
+        return principled_bsdf_sample<PrincipledBSDFSpecializedLobeMask0>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, geometric_normal, output_direction, pdf, random_number_generator, current_bounce, light_sample_info_out);
+#endif
+#if PrincipledBSDFSpecializedLobeMask1 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask1) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask1)) == 0)
+        return principled_bsdf_sample<PrincipledBSDFSpecializedLobeMask1>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, geometric_normal, output_direction, pdf, random_number_generator, current_bounce, light_sample_info_out);
+#endif
+#if PrincipledBSDFSpecializedLobeMask2 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask2) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask2)) == 0)
+        return principled_bsdf_sample<PrincipledBSDFSpecializedLobeMask2>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, geometric_normal, output_direction, pdf, random_number_generator, current_bounce, light_sample_info_out);
+#endif
+#if PrincipledBSDFSpecializedLobeMask3 != PRINCIPLED_LOBE_NONE && (PrincipledBSDFSpecializedLobeMask3) != PRINCIPLED_BSDF_FALLBACK_LOBE_MASK
+    if ((lobe_mask & ~(PrincipledBSDFSpecializedLobeMask3)) == 0)
+        return principled_bsdf_sample<PrincipledBSDFSpecializedLobeMask3>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, geometric_normal, output_direction, pdf, random_number_generator, current_bounce, light_sample_info_out);
+#endif
+
+    return principled_bsdf_sample<PRINCIPLED_BSDF_FALLBACK_LOBE_MASK>(render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, geometric_normal, output_direction, pdf, random_number_generator, current_bounce, light_sample_info_out);
+#else
+    static const std::array<PrincipledBSDFSampleFunction, PRINCIPLED_LOBE_ALL + 1> sample_functions = principled_bsdf_make_sample_table(std::make_index_sequence<PRINCIPLED_LOBE_ALL + 1>());
+
+    return sample_functions[principled_bsdf_get_specialized_lobe_mask(render_data, lobe_mask)](render_data, material, ray_volume_state, update_ray_volume_state, view_direction, shading_normal, geometric_normal, output_direction, pdf, random_number_generator, current_bounce, light_sample_info_out);
+#endif
 }
 
 #endif
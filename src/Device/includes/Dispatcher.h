@@ -9,6 +9,7 @@
 #include "Device/includes/BSDFs/Lambertian.h"
 #include "Device/includes/BSDFs/OrenNayar.h"
 #include "Device/includes/BSDFs/Principled.h"
+#include "Device/includes/Profiling.h"
 #include "Device/includes/RayPayload.h"
 
 /**
@@ -24,6 +25,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F bsdf_dispatcher_eval(const HIPRTRende
 	float& pdf, Xorshift32Generator& random_number_generator,
 	int current_bounce, BSDFIncidentLightInfo incident_light_info = BSDFIncidentLightInfo::NO_INFO)
 {
+	CPU_PROFILER_HOT_FUNCTION_SCOPE(CPU_PROFILER_BSDF_EVAL);
+
 #if BSDFOverride == BSDF_NONE || BSDFOverride == BSDF_PRINCIPLED
 	/*switch (brdf_type)
 	{
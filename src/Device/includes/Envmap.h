@@ -7,6 +7,7 @@
 #define DEVICE_ENVMAP_H
 
 #include "Device/includes/Dispatcher.h"
+#include "Device/includes/EnvmapGuidedCDF/EnvmapGuidedCDFDevice.h"
 #include "Device/includes/FixIntellisense.h"
 #include "Device/includes/Intersect.h"
 #include "Device/includes/MISBSDFRayReuse.h"
@@ -75,8 +76,45 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void envmap_cdf_search(const WorldSettings& world
     x = hippt::max(hippt::min(lower, world_settings.envmap_width), 0u);
 }
 
+/**
+ * Samples a direction on the envmap with the guided marginal / conditional CDFs
+ * (EnvmapSamplingStrategy == ESS_GUIDED_CDF)
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F envmap_sample_guided_cdf(const WorldSettings& world_settings, float3& sampled_direction, float& envmap_pdf, Xorshift32Generator& random_number_generator)
+{
+    // Drawn in named variables because the order of evaluation of function arguments is unspecified
+    float random_y = random_number_generator();
+    float random_x = random_number_generator();
+
+    int x, y;
+    float texel_probability = envmap_guided_cdf_sample(world_settings.envmap_guided_cdf, world_settings.envmap_width, world_settings.envmap_height, random_y, random_x, x, y);
+
+    // Uniformly sampling a point in the texel
+    float u = (x + random_number_generator()) / world_settings.envmap_width;
+    float v = (y + random_number_generator()) / world_settings.envmap_height;
+
+    float phi = u * M_TWO_PI;
+    float theta = hippt::max(1.0e-5f, v * M_PI);
+
+    float cos_theta = cos(theta);
+    float sin_theta = sin(theta);
+    sampled_direction = make_float3(-sin_theta * cos(phi), -cos_theta, -sin_theta * sin(phi));
+    sampled_direction = matrix_X_vec(world_settings.envmap_to_world_matrix, sampled_direction);
+
+    // The PDF is given by the sampling structure and not by the luminance of the
+    // texel read in the envmap such that it exactly matches the probabilities that were used
+    // for sampling (the conditional CDFs are quantized and weighted by sin(theta))
+    envmap_pdf = texel_probability * world_settings.envmap_width * world_settings.envmap_height;
+    envmap_pdf /= (M_TWO_PIPI * sin_theta);
+
+    return sample_environment_map_texture(world_settings, make_float2(u, v));
+}
+
 HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F envmap_sample(const WorldSettings& world_settings, float3& sampled_direction, float& envmap_pdf, Xorshift32Generator& random_number_generator)
 {
+#if EnvmapSamplingStrategy == ESS_GUIDED_CDF
+    return envmap_sample_guided_cdf(world_settings, sampled_direction, envmap_pdf, random_number_generator);
+#else
     int x, y;
     float env_map_total_sum = world_settings.envmap_total_sum;
 
@@ -122,6 +160,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F envmap_sample(const WorldSettings& wo
     envmap_pdf /= (M_TWO_PIPI * sin_theta);
 
     return env_map_radiance;
+#endif
 }
 
 /**
@@ -134,6 +173,25 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F envmap_eval(const HIPRTRenderData& re
 
     ColorRGB32F envmap_radiance = eval_envmap_no_pdf(world_settings, direction);
 
+#if EnvmapSamplingStrategy == ESS_GUIDED_CDF
+    float3 rotated_direction = matrix_X_vec(world_settings.world_to_envmap_matrix, direction);
+
+    float u = 0.5f + atan2(rotated_direction.z, rotated_direction.x) * M_INV_2_PI;
+    float v = 0.5f + asin(rotated_direction.y) * M_INV_PI;
+    int x = hippt::min(static_cast<int>(u * world_settings.envmap_width), static_cast<int>(world_settings.envmap_width) - 1);
+    int y = hippt::min(static_cast<int>(v * world_settings.envmap_height), static_cast<int>(world_settings.envmap_height) - 1);
+    x = hippt::max(x, 0);
+    y = hippt::max(y, 0);
+
+    // Same sin(theta) as in envmap_sample_guided_cdf()
+    float sin_theta = sin(hippt::max(1.0e-5f, v * M_PI));
+
+    pdf = envmap_guided_cdf_texel_probability(world_settings.envmap_guided_cdf, world_settings.envmap_width, x, y);
+    pdf *= world_settings.envmap_width * world_settings.envmap_height;
+    pdf /= (M_TWO_PIPI * sin_theta);
+
+    return envmap_radiance;
+#else
     float envmap_total_sum = world_settings.envmap_total_sum;
 
     float theta_bsdf_dir = acos(-direction.y);
@@ -147,6 +205,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F envmap_eval(const HIPRTRenderData& re
     pdf /= (M_TWO_PIPI * sin_theta);
 
     return envmap_radiance;
+#endif
 }
 
 HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_environment_map_with_mis(HIPRTRenderData& render_data, RayPayload& ray_payload, HitInfo& closest_hit_info,
@@ -172,7 +231,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_environment_map_with_mis(HIPRT
             nee_plus_plus_context.shaded_point = closest_hit_info.inter_point;
             nee_plus_plus_context.point_on_light = sampled_direction;
             nee_plus_plus_context.envmap = true;
-            bool in_shadow = evaluate_shadow_ray_nee_plus_plus(render_data, shadow_ray, 1.0e35f, closest_hit_info.primitive_index, nee_plus_plus_context, random_number_generator, ray_payload.bounce);
+            bool in_shadow = evaluate_shadow_ray_nee_plus_plus(render_data, shadow_ray, 1.0e35f, closest_hit_info.primitive_index, closest_hit_info.instance_id, nee_plus_plus_context, random_number_generator, ray_payload.bounce);
             if (!in_shadow)
             {
                 float bsdf_pdf;
@@ -188,6 +247,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_environment_map_with_mis(HIPRT
 
                 envmap_mis_contribution = bsdf_color * cosine_term * mis_weight * envmap_color / envmap_pdf / nee_plus_plus_context.unoccluded_probability;
             }
+
+            envmap_mis_contribution = defer_shadow_ray_contribution(render_data, envmap_mis_contribution, WAVEFRONT_SHADOW_RAY_ENVMAP);
         }
     }
 
@@ -245,9 +306,9 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_environment_map_with_mis(HIPRT
             in_shadow = false;
         else
             // No ray was reused, we have to check for visibility
-            in_shadow = evaluate_shadow_ray(render_data, shadow_ray, 1.0e35f, closest_hit_info.primitive_index, ray_payload.bounce, random_number_generator);
+            in_shadow = evaluate_or_defer_shadow_ray(render_data, shadow_ray, 1.0e35f, closest_hit_info.primitive_index, closest_hit_info.instance_id, ray_payload.bounce, random_number_generator);
 #else
-        bool in_shadow = evaluate_shadow_ray(render_data, shadow_ray, 1.0e35f, closest_hit_info.primitive_index, random_number_generator);
+        bool in_shadow = evaluate_or_defer_shadow_ray(render_data, shadow_ray, 1.0e35f, closest_hit_info.primitive_index, closest_hit_info.instance_id, ray_payload.bounce, random_number_generator);
 #endif
 
         if (!in_shadow)
@@ -260,6 +321,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_environment_map_with_mis(HIPRT
                 bsdf_mis_contribution = envmap_radiance * mis_weight * cosine_term * bsdf_color / bsdf_sample_pdf;
             }
         }
+
+        bsdf_mis_contribution = defer_shadow_ray_contribution(render_data, bsdf_mis_contribution, WAVEFRONT_SHADOW_RAY_ENVMAP);
     }
 
     return bsdf_mis_contribution + envmap_mis_contribution;
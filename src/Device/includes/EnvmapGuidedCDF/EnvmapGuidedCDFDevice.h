@@ -0,0 +1,95 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_ENVMAP_GUIDED_CDF_DEVICE_H
+#define DEVICE_ENVMAP_GUIDED_CDF_DEVICE_H
+
+#include "HostDeviceCommon/Math.h"
+
+/**
+ * Marginal / conditional CDFs of the envmap with guide tables for importance
+ * sampling the envmap with EnvmapSamplingStrategy == ESS_GUIDED_CDF.
+ *
+ * A row of the envmap is first picked with the marginal CDF and then a texel
+ * of that row with the conditional CDF of the row. Instead of a binary search, each CDF
+ * is inverted with a guide table [1]: the guide table gives, for a given interval
+ * of random numbers, the first index of the CDF that can be the answer and the CDF is then
+ * searched linearly from there. With as many guide entries as the CDF has elements
+ * (or a fixed fraction of that), this is O(1) on average.
+ *
+ * The conditional CDFs are quantized to 16 bits so that the whole structure is
+ * about 3 bytes per texel (2 bytes for the conditional CDFs and 1 byte for the
+ * conditional guide tables) vs. 8 bytes per texel for the alias table.
+ *
+ * Reference:
+ * [1] [Chen, Asau, On generating random variates from an empirical distribution, 1974]
+ */
+struct EnvmapGuidedCDFDevice
+{
+    // Maximum value of the quantized conditional CDFs (which is the value of the last
+    // element of each conditional CDF)
+    static constexpr unsigned int CONDITIONAL_CDF_MAX = 65535;
+    // Number of elements of a conditional CDF per entry of its guide table
+    static constexpr unsigned int CONDITIONAL_GUIDE_RATIO = 4;
+
+    // Marginal CDF over the rows of the envmap. 'envmap_height' elements, the last one is 1.0f
+    float* marginal_cdf = nullptr;
+    // 'envmap_height' elements
+    unsigned int* marginal_guide = nullptr;
+
+    // Conditional CDF of each row, 'envmap_width' elements per row
+    unsigned short* conditional_cdfs = nullptr;
+    // Guide table of each row, 'conditional_guide_size' elements per row
+    unsigned int* conditional_guides = nullptr;
+    unsigned int conditional_guide_size = 0;
+};
+
+/**
+ * Samples a texel of the envmap with the random numbers 'random_y' and 'random_x' in [0, 1[.
+ *
+ * Returns the probability of the sampled texel
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float envmap_guided_cdf_sample(const EnvmapGuidedCDFDevice& guided_cdf, unsigned int width, unsigned int height, float random_y, float random_x, int& out_x, int& out_y)
+{
+    // Picking the row
+    unsigned int guide_index = hippt::min(static_cast<unsigned int>(random_y * height), height - 1);
+    unsigned int y = guided_cdf.marginal_guide[guide_index];
+    while (y < height - 1 && guided_cdf.marginal_cdf[y] <= random_y)
+        y++;
+
+    float row_probability = guided_cdf.marginal_cdf[y] - (y == 0 ? 0.0f : guided_cdf.marginal_cdf[y - 1]);
+
+    // Picking the texel in the row
+    const unsigned short* conditional_cdf = guided_cdf.conditional_cdfs + y * width;
+    const unsigned int* conditional_guide = guided_cdf.conditional_guides + y * guided_cdf.conditional_guide_size;
+
+    float target = random_x * EnvmapGuidedCDFDevice::CONDITIONAL_CDF_MAX;
+    guide_index = hippt::min(static_cast<unsigned int>(random_x * guided_cdf.conditional_guide_size), guided_cdf.conditional_guide_size - 1);
+    unsigned int x = conditional_guide[guide_index];
+    while (x < width - 1 && conditional_cdf[x] <= target)
+        x++;
+
+    unsigned int texel_cdf_interval = conditional_cdf[x] - (x == 0 ? 0u : conditional_cdf[x - 1]);
+
+    out_x = x;
+    out_y = y;
+
+    return row_probability * texel_cdf_interval / static_cast<float>(EnvmapGuidedCDFDevice::CONDITIONAL_CDF_MAX);
+}
+
+/**
+ * Returns the probability that envmap_guided_cdf_sample() samples the texel (x, y)
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float envmap_guided_cdf_texel_probability(const EnvmapGuidedCDFDevice& guided_cdf, unsigned int width, int x, int y)
+{
+    float row_probability = guided_cdf.marginal_cdf[y] - (y == 0 ? 0.0f : guided_cdf.marginal_cdf[y - 1]);
+
+    const unsigned short* conditional_cdf = guided_cdf.conditional_cdfs + y * width;
+    unsigned int texel_cdf_interval = conditional_cdf[x] - (x == 0 ? 0u : conditional_cdf[x - 1]);
+
+    return row_probability * texel_cdf_interval / static_cast<float>(EnvmapGuidedCDFDevice::CONDITIONAL_CDF_MAX);
+}
+
+#endif
@@ -24,6 +24,8 @@ struct GBufferDevice
 	DevicePackedEffectiveMaterial* materials = nullptr;
 
 	int* first_hit_prim_index = nullptr;
+	// Instance of the first hit, needed with 'first_hit_prim_index' to discard self intersections
+	int* first_hit_instance_id = nullptr;
 	float3* primary_hit_position = nullptr;
 
 	// We need both normals to correct the black fringes from the microfacet
@@ -8,6 +8,7 @@
 
 #include "Device/includes/FixIntellisense.h"
 #include "Device/includes/GMoN/GMoNMeansRadixSort.h"
+#include "Device/includes/GMoN/GMoNMeansSortingNetwork.h"
 #include "Device/includes/GMoN/GMoNDevice.h"
 #include "HostDeviceCommon/Color.h"
 
@@ -16,7 +17,19 @@
 // TODO 4k, 31 sets, adaptive gMon --> 42ms
 
 // A bunch of macros here to streamline the code between the CPU and GPU
-#ifdef __KERNELCC__
+#if GMoNMSetsCount <= GMoNMaxSetsCountForSortingNetwork
+
+// The means are sorted with the sorting network, the same on the CPU and the GPU
+#define SORTED_MEANS_VARIABLE sorted_means
+#define SORTED_MEANS_VARIABLE_WITH_COMMA ,sorted_means
+#define SORTED_MEANS_DECLARATION GMoNSortedMeans SORTED_MEANS_VARIABLE
+#define SORTED_MEANS_DECLARATION_WITH_COMMA ,const GMoNSortedMeans& SORTED_MEANS_VARIABLE
+#define SORTED_MEANS_ASSIGNATION(x) SORTED_MEANS_VARIABLE = (x)
+// The set indices are in the 4 LSB of the keys
+#define SORTED_MEANS_FETCH(mean_index) (SORTED_MEANS_VARIABLE.keys[(mean_index)] & ~0xFu)
+#define SORTED_INDEX_FETCH(set_index) (SORTED_MEANS_VARIABLE.keys[(set_index)] & 0xF)
+
+#elif defined(__KERNELCC__)
 
 #define SORTED_MEANS_VARIABLE
 #define SORTED_MEANS_VARIABLE_WITH_COMMA
@@ -73,7 +86,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F get_median_of_means(GMoNDevice gmon_d
     // Getting the index of the set for the sorted median
     unsigned short int median_set_index = SORTED_INDEX_FETCH(GMoNMSetsCount / 2);
 
-    return gmon_device.sets[median_set_index * render_resolution.x * render_resolution.y + pixel_index];
+    return gmon_device.read_set(median_set_index, pixel_index, render_resolution);
 }
 
 /**
@@ -87,7 +100,11 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F get_median_of_means(GMoNDevice gmon_d
 HIPRT_HOST_DEVICE ColorRGB32F gmon_compute_median_of_means(GMoNDevice gmon_device, uint32_t pixel_index, unsigned int sample_number, int2 render_resolution)
 {
     SORTED_MEANS_DECLARATION;
-    SORTED_MEANS_ASSIGNATION(gmon_means_radix_sort(gmon_device.sets, pixel_index, sample_number, render_resolution));
+#if GMoNMSetsCount <= GMoNMaxSetsCountForSortingNetwork
+    SORTED_MEANS_ASSIGNATION(gmon_means_sorting_network(gmon_device, pixel_index, render_resolution));
+#else
+    SORTED_MEANS_ASSIGNATION(gmon_means_radix_sort(gmon_device, pixel_index, sample_number, render_resolution));
+#endif
 
     switch (gmon_device.gmon_mode)
     {
@@ -114,7 +131,7 @@ HIPRT_HOST_DEVICE ColorRGB32F gmon_compute_median_of_means(GMoNDevice gmon_devic
             
             ColorRGB32F sum;
             for (int i = 0; i < GMoNMSetsCount; i++)
-                sum += gmon_device.sets[render_resolution.x * render_resolution.y * i + pixel_index];
+                sum += gmon_device.read_set(i, pixel_index, render_resolution);
 
             return sum;
         }
@@ -143,7 +160,7 @@ HIPRT_HOST_DEVICE ColorRGB32F gmon_compute_median_of_means(GMoNDevice gmon_devic
         // Eq. 6
         ColorRGB32F sum;
         for (int i = c; i < GMoNMSetsCount - c; i++)
-            sum += gmon_device.sets[SORTED_INDEX_FETCH(i) * render_resolution.x * render_resolution.y + pixel_index];
+            sum += gmon_device.read_set(SORTED_INDEX_FETCH(i), pixel_index, render_resolution);
 
         // We want this function to return un-averaged colors such that it is
         // the shader that displays in the viewport that does the averaging.
@@ -7,6 +7,100 @@
 #define DEVICE_GMON_DEVICE_H
 
 #include "HostDeviceCommon/Color.h"
+#include "HostDeviceCommon/KernelOptions/GMoNOptions.h"
+#include "HostDeviceCommon/Packing.h"
+#include "HostDeviceCommon/Xorshift.h"
+
+/**
+ * GMoN set of a pixel stored as the mean of its samples in half precision and its number of samples.
+ * 
+ * The accessors read and write the sum of the samples such that this structure
+ * is interchangeable with the ColorRGB32F sums of the full precision sets.
+ *
+ * The incremental mean is rounded stochastically to halves. With round to nearest, the
+ * updates smaller than half an ULP of the mean are lost and, for the skewed distributions of
+ * the samples of a pixel (mostly dim samples, rare bright ones), only the bright samples
+ * end up moving the mean: the means were biased upwards
+ */
+struct GMoNPackedSet
+{
+    // Largest value representable by a half float. The means are clamped
+    // to that such that a firefly doesn't make a set infinite
+    static constexpr float MAX_HALF_VALUE = 65504.0f;
+    static constexpr unsigned int MAX_SAMPLE_COUNT = 0xFFFF;
+
+    HIPRT_HOST_DEVICE ColorRGB32F get_sum() const
+    {
+        return get_mean() * static_cast<float>(get_sample_count());
+    }
+
+    HIPRT_HOST_DEVICE void set_first_sample(const ColorRGB32F& sample)
+    {
+        pack(sample, 1);
+    }
+
+    /**
+     * 'random' is a uniform random number in [0, 1[ for the stochastic rounding of the mean
+     */
+    HIPRT_HOST_DEVICE void accumulate(const ColorRGB32F& sample, float random)
+    {
+        unsigned int sample_count = get_sample_count();
+        // The count saturates, the mean is then an exponential moving average
+        // of the samples, which is fine that late in the render
+        unsigned int new_sample_count = hippt::min(sample_count + 1, MAX_SAMPLE_COUNT);
+
+        // Incremental mean, this avoids storing a sum that would outgrow the precision of the halves
+        ColorRGB32F mean = get_mean();
+        pack_stochastic(mean + (sample - mean) / static_cast<float>(new_sample_count), new_sample_count, random);
+    }
+
+    /**
+     * Scales the sum of the samples of the set by 'factor'
+     */
+    HIPRT_HOST_DEVICE void scale(float factor)
+    {
+        pack(get_mean() * factor, get_sample_count());
+    }
+
+private:
+    HIPRT_HOST_DEVICE ColorRGB32F get_mean() const
+    {
+        float2 red_green_unpacked = red_green.unpack();
+
+        return ColorRGB32F(red_green_unpacked.x, red_green_unpacked.y, Half2xPacked::half_to_float(blue_and_count & 0xFFFF));
+    }
+
+    HIPRT_HOST_DEVICE unsigned int get_sample_count() const
+    {
+        return blue_and_count >> 16;
+    }
+
+    HIPRT_HOST_DEVICE void pack(ColorRGB32F mean, unsigned int sample_count)
+    {
+        mean.clamp(0.0f, MAX_HALF_VALUE);
+
+        red_green.pack(make_float2(mean.r, mean.g));
+        blue_and_count = Half2xPacked::float_to_half(mean.b) | (sample_count << 16);
+    }
+
+    HIPRT_HOST_DEVICE void pack_stochastic(ColorRGB32F mean, unsigned int sample_count, float random)
+    {
+        mean.clamp(0.0f, MAX_HALF_VALUE);
+
+        red_green.pack_stochastic(make_float2(mean.r, mean.g), random);
+        blue_and_count = Half2xPacked::float_to_half_stochastic(mean.b, random) | (sample_count << 16);
+    }
+
+    Half2xPacked red_green;
+    // Blue channel of the mean as a half in the 16 LSB, number of samples in the 16 MSB
+    unsigned int blue_and_count = 0;
+};
+
+#if GMoNUsePackedSets == KERNEL_OPTION_TRUE
+typedef GMoNPackedSet GMoNSet;
+#else
+typedef ColorRGB32F GMoNSet;
+#endif
 
 /**
  * Data structure for the implementation of GMoN
@@ -24,16 +118,113 @@ struct GMoNDevice
     };
     GMoNMode gmon_mode = GMoNMode::ADAPTIVE_GMON;
 
+    /**
+     * Returns the sum of the samples accumulated in the given set for the given pixel
+     */
+    HIPRT_HOST_DEVICE ColorRGB32F read_set(unsigned int set_index, uint32_t pixel_index, int2 render_resolution) const
+    {
+#if GMoNUsePackedSets == KERNEL_OPTION_TRUE
+        return sets[set_index * render_resolution.x * render_resolution.y + pixel_index].get_sum();
+#else
+        return sets[set_index * render_resolution.x * render_resolution.y + pixel_index];
+#endif
+    }
+
+    /**
+     * Adds a sample to the set 'next_set_to_accumulate' of the given pixel. If 'first_sample' is true,
+     * the previous content of the set is discarded
+     *
+     * The random number generator is only used by the packed sets
+     */
+    HIPRT_HOST_DEVICE void accumulate_sample(const ColorRGB32F& sample, uint32_t pixel_index, int2 render_resolution, bool first_sample, Xorshift32Generator& random_number_generator) const
+    {
+        unsigned int offset = render_resolution.x * render_resolution.y * next_set_to_accumulate + pixel_index;
+
+#if GMoNUsePackedSets == KERNEL_OPTION_TRUE
+        if (first_sample)
+            sets[offset].set_first_sample(sample);
+        else
+            sets[offset].accumulate(sample, random_number_generator());
+#else
+        if (first_sample)
+            sets[offset] = sample;
+        else
+            sets[offset] += sample;
+#endif
+    }
+
+    /**
+     * Multiplies the sum of the samples of the given set of the given pixel by 'factor'
+     */
+    HIPRT_HOST_DEVICE void scale_set(unsigned int set_index, uint32_t pixel_index, int2 render_resolution, float factor) const
+    {
+#if GMoNUsePackedSets == KERNEL_OPTION_TRUE
+        sets[set_index * render_resolution.x * render_resolution.y + pixel_index].scale(factor);
+#else
+        sets[set_index * render_resolution.x * render_resolution.y + pixel_index] *= factor;
+#endif
+    }
+
+    HIPRT_HOST_DEVICE static unsigned int get_tile_count(int2 render_resolution)
+    {
+        unsigned int tile_count_x = (render_resolution.x + GMoNComputeMeansKernelThreadBlockSize - 1) / GMoNComputeMeansKernelThreadBlockSize;
+        unsigned int tile_count_y = (render_resolution.y + GMoNComputeMeansKernelThreadBlockSize - 1) / GMoNComputeMeansKernelThreadBlockSize;
+
+        return tile_count_x * tile_count_y;
+    }
+
+    HIPRT_HOST_DEVICE static unsigned int get_tile_index(uint32_t pixel_index, int2 render_resolution)
+    {
+        unsigned int tile_count_x = (render_resolution.x + GMoNComputeMeansKernelThreadBlockSize - 1) / GMoNComputeMeansKernelThreadBlockSize;
+        unsigned int x = pixel_index % render_resolution.x;
+        unsigned int y = pixel_index / render_resolution.x;
+
+        return x / GMoNComputeMeansKernelThreadBlockSize + y / GMoNComputeMeansKernelThreadBlockSize * tile_count_x;
+    }
+
+    /**
+     * Records that the tile of the given pixel received the sample that brings the sample count of the render to 'sample_count'
+     */
+    HIPRT_HOST_DEVICE void mark_tile_accumulated(uint32_t pixel_index, int2 render_resolution, unsigned int sample_count) const
+    {
+        if (tile_sample_counts != nullptr)
+            // All the pixels of the tile write the same value, no need for atomics
+            tile_sample_counts[get_tile_index(pixel_index, render_resolution)] = sample_count;
+    }
+
+    /**
+     * Returns true if no pixel of the tile of the given pixel received samples since the last median of means recomputation.
+     * 
+     * The sets of such a tile were at most rescaled (see rescale_samples() for the pixels that stopped sampling),
+     * which doesn't change the order of the means, so the median of means of the tile only needs to be rescaled
+     */
+    HIPRT_HOST_DEVICE bool tile_unchanged_since_last_recomputation(uint32_t pixel_index, int2 render_resolution) const
+    {
+        if (tile_sample_counts == nullptr || last_recomputation_sample_count == 0)
+            return false;
+
+        return tile_sample_counts[get_tile_index(pixel_index, render_resolution)] <= last_recomputation_sample_count;
+    }
+
     // This is one very big buffer that contains all the sets we accumulate into for GMoN
     //
     // For example, for GMoNMSets == 5 and a render resolution of 1280x720,
     // this is going to be a buffer that is 1280*720*5 elements long
-    ColorRGB32F* sets = nullptr;
+    GMoNSet* sets = nullptr;
 
     // This is the buffer that contains the G-median of means result of each pixel and this is going
     // to be displayed in the viewport instead of the regular framebuffer if GMoN is being used
     ColorRGB32F* result_framebuffer = nullptr;
 
+    // For each tile of GMoNComputeMeansKernelThreadBlockSize^2 pixels, the sample count of the
+    // render after the last sample that was accumulated in a pixel of the tile
+    unsigned int* tile_sample_counts = nullptr;
+
+    // Sample count of the render at the previous median of means recomputation (0 if there was none)
+    // and at the current one. Set by the renderer before launching the recomputation
+    unsigned int last_recomputation_sample_count = 0;
+    unsigned int recomputation_sample_count = 0;
+
     // Which is the next set that is going to receive the sample
     unsigned int next_set_to_accumulate = 0;
 };
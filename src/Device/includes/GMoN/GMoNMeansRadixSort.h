@@ -7,6 +7,7 @@
 #define DEVICE_GMON_RADIX_SORT_H
 
 #include "Device/includes/FixIntellisense.h"
+#include "Device/includes/GMoN/GMoNDevice.h"
 #include "Device/includes/GMoN/GMoNMeansRadixSortHistogramDeclaration.h"
 
 #include "HostDeviceCommon/Color.h"
@@ -48,7 +49,7 @@ __shared__ unsigned short int sorted_keys[GMoNThreadsPerBlock * GMoNMSetsCount];
 #define STORE_KEY(key_index, value) scratch_memory[SCRATCH_MEMORY_INDEX(42, key_index)] = value
 #endif
 
-HIPRT_HOST_DEVICE HIPRT_INLINE RETURN_TYPE gmon_means_radix_sort(ColorRGB32F* gmon_sets, uint32_t pixel_index, unsigned int sample_number, int2 render_resolution)
+HIPRT_HOST_DEVICE HIPRT_INLINE RETURN_TYPE gmon_means_radix_sort(const GMoNDevice& gmon_device, uint32_t pixel_index, unsigned int sample_number, int2 render_resolution)
 {
 #ifndef __KERNELCC__
 	std::vector<unsigned int> keys_vector(GMoNMSetsCount);
@@ -71,7 +72,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE RETURN_TYPE gmon_means_radix_sort(ColorRGB32F* gm
 		// If we wanted the mean, we would have to divide everyone by the number of samples
 		// But dividing everyone by the same value isn't going to change the ordering so we don't have to do
 		// that division
-		float mean = gmon_sets[key_index * render_resolution.x * render_resolution.y + pixel_index].luminance();
+		float mean = gmon_device.read_set(key_index, pixel_index, render_resolution).luminance();
 
 		// Setting the means in the "input buffer"
 		INITIAL_STORE_KEY_IN_INPUT_BUFFER(key_index, *reinterpret_cast<unsigned int*>(&mean));
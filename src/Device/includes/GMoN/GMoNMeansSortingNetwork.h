@@ -0,0 +1,65 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_GMON_MEANS_SORTING_NETWORK_H
+#define DEVICE_GMON_MEANS_SORTING_NETWORK_H
+
+#include "Device/includes/GMoN/GMoNDevice.h"
+
+#include "HostDeviceCommon/KernelOptions/GMoNOptions.h"
+#include "HostDeviceCommon/Math.h"
+
+/**
+ * Means of the GMoN sets of a pixel, sorted in ascending order.
+ * 
+ * Each key is the luminance of the mean of a set (as the bits of a float, which sort
+ * the same as the floats themselves since the luminances are positive) whose 4 LSB are
+ * replaced by the index of the set
+ */
+struct GMoNSortedMeans
+{
+    unsigned int keys[GMoNMSetsCount];
+};
+
+/**
+ * Sorts the means of the GMoN sets of the given pixel with an odd-even transposition sorting network.
+ * 
+ * For the small number of sets of GMoN, this is cheaper than the radix sort: the keys stay in registers,
+ * there is no histogram to compute and there is no branching so all the threads of a warp execute the
+ * same compare-exchanges
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE GMoNSortedMeans gmon_means_sorting_network(const GMoNDevice& gmon_device, uint32_t pixel_index, int2 render_resolution)
+{
+    GMoNSortedMeans sorted_means;
+
+    for (int set_index = 0; set_index < GMoNMSetsCount; set_index++)
+    {
+        // Note that this isn't actually the mean, this is just the value of the accumulated samples
+        // If we wanted the mean, we would have to divide everyone by the number of samples
+        // But dividing everyone by the same value isn't going to change the ordering so we don't have to do
+        // that division
+        float mean = hippt::max(0.0f, gmon_device.read_set(set_index, pixel_index, render_resolution).luminance());
+
+        // Losing the 4 LSB of the mantissa doesn't change the ordering of the means in any meaningful way
+        sorted_means.keys[set_index] = (hippt::asuint(mean) & ~0xFu) | set_index;
+    }
+
+    // GMoNMSetsCount rounds of compare-exchanges between the neighbors at even and then odd positions
+    for (int round = 0; round < GMoNMSetsCount; round++)
+    {
+        for (int i = round & 1; i < GMoNMSetsCount - 1; i += 2)
+        {
+            unsigned int key_a = sorted_means.keys[i];
+            unsigned int key_b = sorted_means.keys[i + 1];
+
+            sorted_means.keys[i] = hippt::min(key_a, key_b);
+            sorted_means.keys[i + 1] = hippt::max(key_a, key_b);
+        }
+    }
+
+    return sorted_means;
+}
+
+#endif
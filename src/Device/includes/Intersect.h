@@ -11,6 +11,7 @@
 #include "Device/includes/Material.h"
 #include "Device/includes/ONB.h"
 #include "Device/includes/RayPayload.h"
+#include "Device/includes/SceneHit.h"
 #include "Device/includes/Texture.h"
 #include "Device/includes/TriangleStructures.h"
 #include "Device/functions/FilterFunction.h"
@@ -34,15 +35,16 @@ __shared__ static int shared_stack_cache[SharedStackBVHTraversalSize * KernelWor
 #define DECLARE_SHARED_STACK_BUFFER shared_stack_buffer{ 0, nullptr }
 #endif
 
+// Single level of instancing: the instance stack is never used
 #if UseSharedStackBVHTraversal == KERNEL_OPTION_TRUE
-#define CONSTRUCT_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal_variable_name) hiprtGeomTraversalClosestCustomStack<hiprtGlobalStack> traversal_variable_name(render_data.GPU_BVH, ray, global_stack, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0)
-#define CONSTRUCT_HIPRT_ANY_HIT_TRAVERSAL(traversal_variable_name) hiprtGeomTraversalAnyHitCustomStack<hiprtGlobalStack> traversal_variable_name(render_data.GPU_BVH, ray, global_stack, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0)
+#define CONSTRUCT_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal_variable_name) hiprtSceneTraversalClosestCustomStack<hiprtGlobalStack, hiprtEmptyInstanceStack> traversal_variable_name(render_data.GPU_BVH, ray, global_stack, instance_stack, hiprtFullRayMask, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0)
+#define CONSTRUCT_HIPRT_ANY_HIT_TRAVERSAL(traversal_variable_name) hiprtSceneTraversalAnyHitCustomStack<hiprtGlobalStack, hiprtEmptyInstanceStack> traversal_variable_name(render_data.GPU_BVH, ray, global_stack, instance_stack, hiprtFullRayMask, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0)
 #else
-#define CONSTRUCT_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal_variable_name) hiprtGeomTraversalClosest traversal_variable_name(render_data.GPU_BVH, ray, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
-#define CONSTRUCT_HIPRT_ANY_HIT_TRAVERSAL(traversal_variable_name) hiprtGeomTraversalAnyHit traversal_variable_name(render_data.GPU_BVH, ray, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
+#define CONSTRUCT_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal_variable_name) hiprtSceneTraversalClosest traversal_variable_name(render_data.GPU_BVH, ray, hiprtFullRayMask, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
+#define CONSTRUCT_HIPRT_ANY_HIT_TRAVERSAL(traversal_variable_name) hiprtSceneTraversalAnyHit traversal_variable_name(render_data.GPU_BVH, ray, hiprtFullRayMask, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
 #endif
 
-#define DECLARE_HIPRT_CLOSEST_ANY_HIT_COMMON(render_data, ray, last_hit_primitive_index, random_number_generator) \
+#define DECLARE_HIPRT_CLOSEST_ANY_HIT_COMMON(render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator) \
   /* Payload for the alpha testing filter function */                                                             \
   FilterFunctionPayload payload;                                                                                  \
   payload.render_data = &render_data;                                                                             \
@@ -50,20 +52,22 @@ __shared__ static int shared_stack_cache[SharedStackBVHTraversalSize * KernelWor
   /* Filling the payload with the last hit primitive index to avoid self intersections */                         \
   /* (avoid that the ray intersects the triangle it is currently sitting on) */                                   \
   payload.last_hit_primitive_index = last_hit_primitive_index;                                                    \
+  payload.last_hit_instance_id = last_hit_instance_id;                                                            \
   payload.bounce = bounce;                                                                            \
                                                                                                                   \
   hiprtSharedStackBuffer DECLARE_SHARED_STACK_BUFFER;                                                             \
-  hiprtGlobalStack global_stack(render_data.global_traversal_stack_buffer, shared_stack_buffer);
+  hiprtGlobalStack global_stack(render_data.global_traversal_stack_buffer, shared_stack_buffer);                  \
+  hiprtEmptyInstanceStack instance_stack;
 
 
 
 
-#define DECLARE_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal_variable_name, render_data, ray, last_hit_primitive_index, random_number_generator) \
-  DECLARE_HIPRT_CLOSEST_ANY_HIT_COMMON(render_data, ray, last_hit_primitive_index, random_number_generator);                              \
+#define DECLARE_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal_variable_name, render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator) \
+  DECLARE_HIPRT_CLOSEST_ANY_HIT_COMMON(render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);                              \
   CONSTRUCT_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal_variable_name);
 
-#define DECLARE_HIPRT_ANY_HIT_TRAVERSAL(traversal_variable_name, render_data, ray, last_hit_primitive_index, random_number_generator) \
-  DECLARE_HIPRT_CLOSEST_ANY_HIT_COMMON(render_data, ray, last_hit_primitive_index, random_number_generator);                          \
+#define DECLARE_HIPRT_ANY_HIT_TRAVERSAL(traversal_variable_name, render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator) \
+  DECLARE_HIPRT_CLOSEST_ANY_HIT_COMMON(render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);                          \
   CONSTRUCT_HIPRT_ANY_HIT_TRAVERSAL(traversal_variable_name);
 
 #endif
@@ -72,7 +76,7 @@ __shared__ static int shared_stack_cache[SharedStackBVHTraversalSize * KernelWor
  * 
  * [1] [Foundations of Game Engine Development: Rendering - Tangent/Bitangent calculation] http://foundationsofgameenginedev.com/#fged2
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE float3 normal_mapping(const HIPRTRenderData& render_data, int normal_map_texture_index, TriangleIndices triangle_vertex_indices, TriangleTexcoords& texcoords, const float2& interpolated_texcoords, const float3& surface_normal)
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 normal_mapping(const HIPRTRenderData& render_data, int normal_map_texture_index, int instance_id, TriangleIndices triangle_vertex_indices, TriangleTexcoords& texcoords, const float2& interpolated_texcoords, const float3& surface_normal, float texcoords_footprint = 0.0f)
 {
     // Calculating tangents and bitangents aligned with texture U and V coordinates
     float2 P0_texcoords = texcoords.x;
@@ -82,9 +86,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float3 normal_mapping(const HIPRTRenderData& rend
     float2 delta_P1P0_texcoords = P1_texcoords - P0_texcoords;
     float2 delta_P2P0_texcoords = P2_texcoords - P0_texcoords;
 
-    float3 P0 = render_data.buffers.vertices_positions[triangle_vertex_indices.x];
-    float3 P1 = render_data.buffers.vertices_positions[triangle_vertex_indices.y];
-    float3 P2 = render_data.buffers.vertices_positions[triangle_vertex_indices.z];
+    float3 P0, P1, P2;
+    load_triangle_world_positions(render_data, instance_id, triangle_vertex_indices, P0, P1, P2);
 
     float3 edge_P0P1 = P1 - P0;
     float3 edge_P0P2 = P2 - P0;
@@ -100,22 +103,41 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float3 normal_mapping(const HIPRTRenderData& rend
         // The tangent or the bitangent is degenerate
         return surface_normal;
 
-    ColorRGB32F normal = sample_texture_rgb_8bits(render_data.buffers.material_textures, normal_map_texture_index, /* is_srgb */ false, interpolated_texcoords);
-    // Bringing the normal in [-x, x]. x doesn't really matter since we normalize the result anyway
-    normal -= ColorRGB32F(0.5f);
+    ColorRGB32F normal = sample_texture_rgb_8bits(render_data.buffers.material_textures, normal_map_texture_index, /* is_srgb */ false, interpolated_texcoords, true, texcoords_footprint);
+    float3 normal_tangent_space;
+    if (render_data.buffers.material_textures_two_channels[normal_map_texture_index])
+    {
+        // Bringing the normal in [-1, 1]
+        normal = normal * 2.0f - ColorRGB32F(1.0f);
+        // The normal map is compressed in BC5 which only stores X and Y (see TextureCompression).
+        // Reconstructing Z
+        float normal_z = sqrtf(hippt::max(0.0f, 1.0f - normal.r * normal.r - normal.g * normal.g));
+
+        normal_tangent_space = hippt::normalize(make_float3(normal.r, normal.g, normal_z));
+    }
+    else
+    {
+        // Bringing the normal in [-x, x]. x doesn't really matter since we normalize the result anyway
+        normal -= ColorRGB32F(0.5f);
 
-    float3 normal_tangent_space = hippt::normalize(make_float3(normal.r, normal.g, normal.b));
+        normal_tangent_space = hippt::normalize(make_float3(normal.r, normal.g, normal.b));
+    }
 
     return local_to_world_frame(hippt::normalize(T), hippt::normalize(B), surface_normal, normal_tangent_space);
 }
 
-HIPRT_HOST_DEVICE HIPRT_INLINE float3 get_shading_normal(const HIPRTRenderData& render_data, const float3& geometric_normal, TriangleIndices triangle_vertex_indices, TriangleTexcoords triangle_texcoords, int primitive_index, const float2& uv, const float2& interpolated_texcoords)
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 get_shading_normal(const HIPRTRenderData& render_data, const float3& geometric_normal, TriangleIndices triangle_vertex_indices, TriangleTexcoords triangle_texcoords, int primitive_index, int instance_id, const float2& uv, const float2& interpolated_texcoords, float texcoords_footprint = 0.0f)
 {
     // Do smooth shading first if we have vertex normals
     float3 surface_normal;
-    if (render_data.buffers.has_vertex_normals[triangle_vertex_indices.x])
+#if GeometryCompression == KERNEL_OPTION_TRUE
+    bool has_vertex_normal = render_data.buffers.has_vertex_normals[triangle_vertex_indices.x / 32] & (1u << (triangle_vertex_indices.x % 32));
+#else
+    bool has_vertex_normal = render_data.buffers.has_vertex_normals[triangle_vertex_indices.x];
+#endif
+    if (has_vertex_normal)
         // Smooth normal available for the triangle
-        surface_normal = hippt::normalize(uv_interpolate(triangle_vertex_indices, render_data.buffers.vertex_normals, uv));
+        surface_normal = hippt::normalize(instance_to_world_normal(render_data, instance_id, uv_interpolate(triangle_vertex_indices, render_data.buffers.vertex_normals, uv)));
     else
         surface_normal = geometric_normal;
 
@@ -123,7 +145,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float3 get_shading_normal(const HIPRTRenderData&
     int material_index = render_data.buffers.material_indices[primitive_index];
     unsigned short int normal_map_texture_index = render_data.buffers.materials_buffer.get_normal_map_texture_index(material_index);
     if (normal_map_texture_index != MaterialUtils::NO_TEXTURE)
-        surface_normal = normal_mapping(render_data, normal_map_texture_index, triangle_vertex_indices, triangle_texcoords, interpolated_texcoords, surface_normal);
+        surface_normal = normal_mapping(render_data, normal_map_texture_index, instance_id, triangle_vertex_indices, triangle_texcoords, interpolated_texcoords, surface_normal, texcoords_footprint);
 
     return surface_normal;
 }
@@ -168,14 +190,18 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void fix_backfacing_normals(const RayPayload& ray
 
 #ifndef __KERNELCC__
 #include "Renderer/BVH.h"
-HIPRT_HOST_DEVICE HIPRT_INLINE hiprtHit intersect_scene_cpu(const HIPRTRenderData& render_data, const hiprtRay& ray, int last_hit_primitive_index, Xorshift32Generator& random_number_generator)
+#include "Renderer/CPUProfiler.h"
+HIPRT_HOST_DEVICE HIPRT_INLINE hiprtHit intersect_scene_cpu(const HIPRTRenderData& render_data, const hiprtRay& ray, int last_hit_primitive_index, int last_hit_instance_id, Xorshift32Generator& random_number_generator)
 {
+    CPU_PROFILER_HOT_FUNCTION_SCOPE(CPU_PROFILER_BVH_TRAVERSAL);
+
     FilterFunctionPayload filter_function_payload;
     filter_function_payload.render_data = &render_data;
     filter_function_payload.random_number_generator = &random_number_generator;
     // Filling the payload with the last hit primitive index to avoid self intersections
     // (avoid that the ray intersects the triangle it is currently sitting on)
     filter_function_payload.last_hit_primitive_index = last_hit_primitive_index;
+    filter_function_payload.last_hit_instance_id = last_hit_instance_id;
 
     hiprtHit hiprtHit;
     render_data.cpu_only.bvh->intersect(ray, hiprtHit, &filter_function_payload);
@@ -184,68 +210,90 @@ HIPRT_HOST_DEVICE HIPRT_INLINE hiprtHit intersect_scene_cpu(const HIPRTRenderDat
 }
 #endif
 
+#ifndef __KERNELCC__
 /**
- * Returns true if a hit was found, false otherwise
+ * CPU only. Intersects a packet of rays with a single shared traversal of the BVH.
+ * 
+ * Each ray has its own last hit primitive index and instance (for self intersection avoidance)
+ * and its own random number generator (for alpha testing).
+ * 
+ * If 'any_hit' is true, the hits returned aren't necessarily the closest ones, see FlattenedBVH::intersect_packet()
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE bool trace_ray(const HIPRTRenderData& render_data, hiprtRay ray, RayPayload& in_out_ray_payload, HitInfo& out_hit_info, int last_hit_primitive_index, int bounce, Xorshift32Generator& random_number_generator)
+HIPRT_HOST_DEVICE HIPRT_INLINE void intersect_scene_cpu_packet(const HIPRTRenderData& render_data, const hiprtRay* rays, const int* last_hit_primitive_indices, const int* last_hit_instance_ids, Xorshift32Generator** random_number_generators, int ray_count, hiprtHit* out_hits, bool any_hit = false)
 {
-#ifdef __KERNELCC__
-    if (render_data.GPU_BVH == nullptr)
-        // Empty scene --> no intersection
-        return false;
-#endif
+    CPU_PROFILER_HOT_FUNCTION_SCOPE(CPU_PROFILER_BVH_TRAVERSAL);
 
-    hiprtHit hit;
-    bool skipping_volume_boundary = false;
-    do
+    FilterFunctionPayload filter_function_payloads[BVHConstants::PACKET_MAX_RAY_COUNT];
+    void* filter_function_payloads_pointers[BVHConstants::PACKET_MAX_RAY_COUNT];
+    bool hit_found[BVHConstants::PACKET_MAX_RAY_COUNT];
+    for (int i = 0; i < ray_count; i++)
     {
-#ifdef __KERNELCC__
-        DECLARE_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal, render_data, ray, last_hit_primitive_index, random_number_generator);
-        
-        hit = traversal.getNextHit();
-#else
-        hit = intersect_scene_cpu(render_data, ray, last_hit_primitive_index, random_number_generator);
+        filter_function_payloads[i].render_data = &render_data;
+        filter_function_payloads[i].random_number_generator = random_number_generators[i];
+        filter_function_payloads[i].last_hit_primitive_index = last_hit_primitive_indices[i];
+        filter_function_payloads[i].last_hit_instance_id = last_hit_instance_ids[i];
+
+        filter_function_payloads_pointers[i] = &filter_function_payloads[i];
+        out_hits[i] = hiprtHit();
+    }
+
+    render_data.cpu_only.bvh->intersect_packet(rays, out_hits, hit_found, ray_count, filter_function_payloads_pointers, any_hit);
+}
 #endif
 
-        if (!hit.hasHit())
-            return false;
+/**
+ * Fills the hit info and the material of the ray payload from the given hit.
+ * 
+ * Returns true if the hit is a volume boundary that must be skipped. The origin
+ * of the ray is then moved to the hit point so that the ray can be traced again
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool trace_ray_process_hit(const HIPRTRenderData& render_data, hiprtRay& ray, const hiprtHit& hit, RayPayload& in_out_ray_payload, HitInfo& out_hit_info)
+{
+    TriangleIndices triangle_vertex_indices = load_triangle_vertex_indices(render_data.buffers.triangles_indices, hit.primID);
+    TriangleTexcoords triangle_texcoords = load_triangle_texcoords(render_data.buffers.texcoords, triangle_vertex_indices);
 
-        TriangleIndices triangle_vertex_indices = load_triangle_vertex_indices(render_data.buffers.triangles_indices, hit.primID);
-        TriangleTexcoords triangle_texcoords = load_triangle_texcoords(render_data.buffers.texcoords, triangle_vertex_indices);
+    out_hit_info.inter_point = ray.origin + hit.t * ray.direction;
+    out_hit_info.primitive_index = hit.primID;
+    out_hit_info.instance_id = hit.instanceID;
+    out_hit_info.texcoords = uv_interpolate(triangle_texcoords, hit.uv);
+    // The hit has already been brought to world space by get_scene_hit()
+    out_hit_info.geometric_normal = hippt::normalize(hit.normal);
 
-        out_hit_info.inter_point = ray.origin + hit.t * ray.direction;
-        out_hit_info.primitive_index = hit.primID;
-        out_hit_info.texcoords = uv_interpolate(triangle_texcoords, hit.uv);
-        // TODO hit.normal is in object space, this simple approach will not work if using
-        // multiple-levels BVH (TLAS/BLAS). We'll have to  transform by the BLAS transform
-        out_hit_info.geometric_normal = hippt::normalize(hit.normal);
-        out_hit_info.shading_normal = get_shading_normal(render_data, out_hit_info.geometric_normal, triangle_vertex_indices, triangle_texcoords, hit.primID, hit.uv, out_hit_info.texcoords);
+    in_out_ray_payload.ray_cone.propagate(hit.t);
+    float3 P0, P1, P2;
+    load_triangle_world_positions(render_data, hit.instanceID, triangle_vertex_indices, P0, P1, P2);
+    float texcoords_footprint = in_out_ray_payload.ray_cone.get_texcoords_footprint(P0, P1, P2, triangle_texcoords, out_hit_info.geometric_normal, ray.direction);
 
-        out_hit_info.t = hit.t;
+    out_hit_info.shading_normal = get_shading_normal(render_data, out_hit_info.geometric_normal, triangle_vertex_indices, triangle_texcoords, hit.primID, hit.instanceID, hit.uv, out_hit_info.texcoords, texcoords_footprint);
 
-        if (in_out_ray_payload.is_inside_volume())
-            in_out_ray_payload.volume_state.distance_in_volume += hit.t;
+    out_hit_info.t = hit.t;
 
-        int material_index = render_data.buffers.material_indices[hit.primID];
-        in_out_ray_payload.material = get_intersection_material(render_data, material_index, out_hit_info.texcoords);
+    if (in_out_ray_payload.is_inside_volume())
+        in_out_ray_payload.volume_state.distance_in_volume += hit.t;
 
-        fix_backfacing_normals(in_out_ray_payload, out_hit_info, -ray.direction);
+    int material_index = render_data.buffers.material_indices[hit.primID];
+    in_out_ray_payload.material = get_intersection_material(render_data, material_index, out_hit_info.texcoords, texcoords_footprint);
 
-        skipping_volume_boundary = in_out_ray_payload.volume_state.interior_stack.push(
-            in_out_ray_payload.volume_state.incident_mat_index, in_out_ray_payload.volume_state.outgoing_mat_index, in_out_ray_payload.volume_state.inside_material, material_index, in_out_ray_payload.material.get_dielectric_priority());
+    fix_backfacing_normals(in_out_ray_payload, out_hit_info, -ray.direction);
 
-        if (skipping_volume_boundary)
-        {
-            // If we're skipping, the boundary, the ray just keeps going on its way
-            ray.origin = out_hit_info.inter_point;
+    bool skipping_volume_boundary = in_out_ray_payload.volume_state.interior_stack.push(
+        in_out_ray_payload.volume_state.incident_mat_index, in_out_ray_payload.volume_state.outgoing_mat_index, in_out_ray_payload.volume_state.inside_material, material_index, in_out_ray_payload.material.get_dielectric_priority());
 
-            // Don't forget to increment the distance traveled
-            // TODO: Are we not double counting the distance here and a few lines above (where we set the .t, .uv, .geometric_normal, ...)
-            in_out_ray_payload.volume_state.distance_in_volume += hit.t;
-        }
+    if (skipping_volume_boundary)
+    {
+        // If we're skipping, the boundary, the ray just keeps going on its way
+        ray.origin = out_hit_info.inter_point;
 
-    } while ((skipping_volume_boundary && hit.hasHit()));
+        // Don't forget to increment the distance traveled
+        // TODO: Are we not double counting the distance here and a few lines above (where we set the .t, .uv, .geometric_normal, ...)
+        in_out_ray_payload.volume_state.distance_in_volume += hit.t;
+    }
+
+    return skipping_volume_boundary;
+}
 
+HIPRT_HOST_DEVICE HIPRT_INLINE void trace_ray_sample_wavelength(RayPayload& in_out_ray_payload, Xorshift32Generator& random_number_generator)
+{
     if (in_out_ray_payload.material.dispersion_scale > 0.0f && in_out_ray_payload.material.specular_transmission > 0.0f && in_out_ray_payload.volume_state.sampled_wavelength == 0.0f)
         // If we hit a dispersive material, we sample the wavelength that will be used
         // for computing the wavelength dependent IORs used for dispersion
@@ -255,15 +303,74 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool trace_ray(const HIPRTRenderData& render_data
         // Negating the wavelength to indicate that the throughput filter of the wavelength
         // hasn't been applied yet (applied in principled_glass_eval())
         in_out_ray_payload.volume_state.sampled_wavelength = -sample_wavelength_uniformly(random_number_generator);
+}
+
+/**
+ * Returns true if a hit was found, false otherwise
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool trace_ray(const HIPRTRenderData& render_data, hiprtRay ray, RayPayload& in_out_ray_payload, HitInfo& out_hit_info, int last_hit_primitive_index, int last_hit_instance_id, int bounce, Xorshift32Generator& random_number_generator)
+{
+#ifdef __KERNELCC__
+    if (render_data.GPU_BVH == nullptr)
+        // Empty scene --> no intersection
+        return false;
+#endif
+
+    hiprtHit hit;
+    bool skipping_volume_boundary = false;
+    do
+    {
+#ifdef __KERNELCC__
+        DECLARE_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal, render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);
+        
+        hit = get_scene_hit(render_data, traversal.getNextHit());
+#else
+        hit = intersect_scene_cpu(render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);
+        CPU_PROFILER_COUNT_RAYS(bounce == 0 ? CPU_PROFILER_PRIMARY_RAY : CPU_PROFILER_SECONDARY_RAY, 1);
+#endif
+
+        if (!hit.hasHit())
+            return false;
+
+        skipping_volume_boundary = trace_ray_process_hit(render_data, ray, hit, in_out_ray_payload, out_hit_info);
+    } while ((skipping_volume_boundary && hit.hasHit()));
+
+    trace_ray_sample_wavelength(in_out_ray_payload, random_number_generator);
 
     return hit.hasHit();
 }
 
+#ifndef __KERNELCC__
+/**
+ * CPU only. Same as trace_ray() but the first intersection of the ray
+ * has already been computed (by a packet traversal for example) and is given in 'first_hit'
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool trace_ray_from_first_hit(const HIPRTRenderData& render_data, hiprtRay ray, const hiprtHit& first_hit, RayPayload& in_out_ray_payload, HitInfo& out_hit_info, int last_hit_primitive_index, int last_hit_instance_id, int bounce, Xorshift32Generator& random_number_generator)
+{
+    hiprtHit hit = first_hit;
+    if (!hit.hasHit())
+        return false;
+
+    while (trace_ray_process_hit(render_data, ray, hit, in_out_ray_payload, out_hit_info))
+    {
+        // Volume boundary skipped, the ray continues
+        hit = intersect_scene_cpu(render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);
+        CPU_PROFILER_COUNT_RAYS(bounce == 0 ? CPU_PROFILER_PRIMARY_RAY : CPU_PROFILER_SECONDARY_RAY, 1);
+        if (!hit.hasHit())
+            return false;
+    }
+
+    trace_ray_sample_wavelength(in_out_ray_payload, random_number_generator);
+
+    return true;
+}
+#endif
+
 /**
  * Returns true if in shadow (a hit was found before 't_max' distance
  * Returns false if unoccluded
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray(const HIPRTRenderData& render_data, hiprtRay ray, float t_max, int last_hit_primitive_index, int bounce, Xorshift32Generator& random_number_generator)
+HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray(const HIPRTRenderData& render_data, hiprtRay ray, float t_max, int last_hit_primitive_index, int last_hit_instance_id, int bounce, Xorshift32Generator& random_number_generator)
 {
 #ifdef __KERNELCC__
     if (render_data.GPU_BVH == nullptr)
@@ -274,7 +381,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray(const HIPRTRenderData& r
 #ifdef __KERNELCC__
     ray.maxT = t_max - 1.0e-4f;
 
-    DECLARE_HIPRT_ANY_HIT_TRAVERSAL(traversal, render_data, ray, last_hit_primitive_index, random_number_generator);
+    DECLARE_HIPRT_ANY_HIT_TRAVERSAL(traversal, render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);
 
     hiprtHit shadow_ray_hit = traversal.getNextHit();
     if (!shadow_ray_hit.hasHit())
@@ -292,7 +399,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray(const HIPRTRenderData& r
     do
     {
         // We should use ray tracing filter functions here instead of re-tracing new rays
-        hit = intersect_scene_cpu(render_data, ray, last_hit_primitive_index, random_number_generator);
+        hit = intersect_scene_cpu(render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);
+        CPU_PROFILER_COUNT_RAYS(CPU_PROFILER_SHADOW_RAY, 1);
         if (!hit.hasHit())
             return false;
 
@@ -313,15 +421,184 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray(const HIPRTRenderData& r
 #endif // __KERNELCC__
 }
 
+#ifndef __KERNELCC__
+/**
+ * CPU only. Packet version of evaluate_shadow_ray(): the occlusion of all the shadow
+ * rays is computed with a single shared any hit traversal of the BVH.
+ * 
+ * Each ray has its own 't_max', last hit primitive index and instance, bounce and random number generator.
+ * Rays whose hit is alpha-tested transparent are traced again on their own with evaluate_shadow_ray()
+ * because the any hit traversal may have skipped closer opaque hits.
+ * 
+ * 'out_in_shadow[i]' is set to true if ray 'i' is occluded
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void evaluate_shadow_rays_packet(const HIPRTRenderData& render_data, const hiprtRay* rays, const float* t_max, const int* last_hit_primitive_indices, const int* last_hit_instance_ids, const int* bounces, Xorshift32Generator** random_number_generators, int ray_count, bool* out_in_shadow)
+{
+    // Hits further than 't_max' don't occlude anything so the rays can stop there
+    hiprtRay clamped_rays[BVHConstants::PACKET_MAX_RAY_COUNT];
+    for (int i = 0; i < ray_count; i++)
+    {
+        clamped_rays[i] = rays[i];
+        clamped_rays[i].maxT = hippt::min(rays[i].maxT, t_max[i] - 1.0e-4f);
+    }
+
+    hiprtHit hits[BVHConstants::PACKET_MAX_RAY_COUNT];
+    intersect_scene_cpu_packet(render_data, clamped_rays, last_hit_primitive_indices, last_hit_instance_ids, random_number_generators, ray_count, hits, /* any hit */ true);
+    CPU_PROFILER_COUNT_RAYS(CPU_PROFILER_SHADOW_RAY, ray_count);
+
+    for (int i = 0; i < ray_count; i++)
+    {
+        if (!hits[i].hasHit())
+        {
+            out_in_shadow[i] = false;
+
+            continue;
+        }
+
+        float alpha = 1.0f;
+        if (render_data.render_settings.do_alpha_testing)
+            alpha = get_hit_base_color_alpha(render_data, hits[i]);
+
+        if (alpha >= 1.0f)
+            out_in_shadow[i] = true;
+        else
+            out_in_shadow[i] = evaluate_shadow_ray(render_data, rays[i], t_max[i], last_hit_primitive_indices[i], last_hit_instance_ids[i], bounces[i], *random_number_generators[i]);
+    }
+}
+#endif
+
+/**
+ * Same as evaluate_shadow_ray() but during the direct lighting stage of the wavefront path tracer
+ * (when 'render_data.buffers.wavefront.deferred_shadow_rays' is set), the shadow ray isn't traced.
+ * It is stored for the shadow ray stage and false (unoccluded) is returned.
+ * 
+ * The caller must then pass the contribution of its light sample, computed as if the shadow ray
+ * was unoccluded, to defer_shadow_ray_contribution(). A deferred shadow ray whose contribution
+ * hasn't been given yet is replaced if another shadow ray is deferred.
+ * 
+ * If 'nee_plus_plus_voxel_matrix_index' isn't -1, the shadow ray stage accumulates the visibility
+ * of the deferred shadow ray in that entry of the NEE++ visibility map
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_or_defer_shadow_ray(const HIPRTRenderData& render_data, hiprtRay ray, float t_max, int last_hit_primitive_index, int last_hit_instance_id, int bounce, Xorshift32Generator& random_number_generator, int nee_plus_plus_voxel_matrix_index = -1)
+{
+#ifndef __KERNELCC__
+    WavefrontDeferredShadowRays* deferred_shadow_rays = render_data.buffers.wavefront.deferred_shadow_rays;
+    if (deferred_shadow_rays != nullptr)
+    {
+        if (deferred_shadow_rays->contribution_pending)
+            // The previous shadow ray never got its contribution, replacing it
+            deferred_shadow_rays->count--;
+
+        if (deferred_shadow_rays->count < WavefrontDeferredShadowRays::MAX_SHADOW_RAYS)
+        {
+            WavefrontShadowRay& shadow_ray = deferred_shadow_rays->shadow_rays[deferred_shadow_rays->count++];
+            shadow_ray.ray = ray;
+            shadow_ray.t_max = t_max;
+            shadow_ray.last_hit_primitive_index = last_hit_primitive_index;
+            shadow_ray.last_hit_instance_id = last_hit_instance_id;
+            shadow_ray.random_seed = random_number_generator.xorshift32();
+            shadow_ray.nee_plus_plus_voxel_matrix_index = nee_plus_plus_voxel_matrix_index;
+            shadow_ray.bounce = static_cast<unsigned char>(bounce);
+            shadow_ray.occluded = false;
+
+            deferred_shadow_rays->contribution_pending = true;
+
+            return false;
+        }
+
+        deferred_shadow_rays->contribution_pending = false;
+    }
+#endif
+
+    return evaluate_shadow_ray(render_data, ray, t_max, last_hit_primitive_index, last_hit_instance_id, bounce, random_number_generator);
+}
+
+/**
+ * Returns true if the last shadow ray given to evaluate_or_defer_shadow_ray()
+ * was deferred to the shadow ray stage of the wavefront path tracer
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool is_shadow_ray_deferred(const HIPRTRenderData& render_data)
+{
+#ifndef __KERNELCC__
+    return render_data.buffers.wavefront.deferred_shadow_rays != nullptr && render_data.buffers.wavefront.deferred_shadow_rays->contribution_pending;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Returns 'contribution' if the last shadow ray given to evaluate_or_defer_shadow_ray() was traced.
+ * 
+ * If that shadow ray was deferred to the shadow ray stage of the wavefront path tracer, 'contribution'
+ * is attached to the shadow ray and black is returned: the contribution is added to the 'target' direct
+ * lighting of the path by the shadow ray stage if the shadow ray is unoccluded
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F defer_shadow_ray_contribution(const HIPRTRenderData& render_data, const ColorRGB32F& contribution, WavefrontShadowRayTarget target)
+{
+#ifndef __KERNELCC__
+    WavefrontDeferredShadowRays* deferred_shadow_rays = render_data.buffers.wavefront.deferred_shadow_rays;
+    if (deferred_shadow_rays != nullptr && deferred_shadow_rays->contribution_pending)
+    {
+        deferred_shadow_rays->contribution_pending = false;
+
+        if (contribution.r == 0.0f && contribution.g == 0.0f && contribution.b == 0.0f)
+            // Nothing to gain from tracing that shadow ray. Not using is_black()
+            // because spectral rendering can give negative contributions
+            deferred_shadow_rays->count--;
+        else
+        {
+            WavefrontShadowRay& shadow_ray = deferred_shadow_rays->shadow_rays[deferred_shadow_rays->count - 1];
+            shadow_ray.contribution = contribution;
+            shadow_ray.target = target;
+        }
+
+        return ColorRGB32F(0.0f);
+    }
+#endif
+
+    return contribution;
+}
+
+/**
+ * Number of shadow rays deferred so far for the path whose lights are being sampled.
+ * Always 0 outside of the direct lighting stage of the wavefront path tracer
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE int get_deferred_shadow_ray_count(const HIPRTRenderData& render_data)
+{
+#ifndef __KERNELCC__
+    if (render_data.buffers.wavefront.deferred_shadow_rays != nullptr)
+        return render_data.buffers.wavefront.deferred_shadow_rays->count;
+#endif
+
+    return 0;
+}
+
+/**
+ * Multiplies the contribution of the shadow rays deferred since the deferred shadow ray
+ * 'first_shadow_ray_index' by 'scale'. Used by the estimators that average the light samples
+ * whose shadow rays may have been deferred
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void scale_deferred_shadow_ray_contributions(const HIPRTRenderData& render_data, int first_shadow_ray_index, float scale)
+{
+#ifndef __KERNELCC__
+    WavefrontDeferredShadowRays* deferred_shadow_rays = render_data.buffers.wavefront.deferred_shadow_rays;
+    if (deferred_shadow_rays == nullptr)
+        return;
+
+    for (int i = first_shadow_ray_index; i < deferred_shadow_rays->count; i++)
+        deferred_shadow_rays->shadow_rays[i].contribution *= scale;
+#endif
+}
+
 /**
  * Returns true if in shadow (a hit was found before 't_max' distance
- * Returns false if unoccluded
+ * Returns false if unoccluded (or if the shadow ray was deferred, see evaluate_or_defer_shadow_ray())
  * 
  * This function also uses NEE++ if enabled in the kernel options and this
  * function can update the visibility map of NEE++ if enabled in 'render_data.nee_plus_plus'
  */
 #include "Device/includes/Hash.h"
-HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray_nee_plus_plus(HIPRTRenderData& render_data, hiprtRay ray, float t_max, int last_hit_primitive_index, NEEPlusPlusContext& nee_plus_plus_context, Xorshift32Generator& random_number_generator, int bounce)
+HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray_nee_plus_plus(HIPRTRenderData& render_data, hiprtRay ray, float t_max, int last_hit_primitive_index, int last_hit_instance_id, NEEPlusPlusContext& nee_plus_plus_context, Xorshift32Generator& random_number_generator, int bounce)
 {
 #if DirectLightUseNEEPlusPlusRR == KERNEL_OPTION_TRUE && DirectLightUseNEEPlusPlus == KERNEL_OPTION_TRUE
     bool shadow_ray_discarded = false;
@@ -342,7 +619,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray_nee_plus_plus(HIPRTRende
             // Updating the statistics
             hippt::atomic_fetch_add(render_data.nee_plus_plus.shadow_rays_actually_traced, 1u);
 
-        shadow_ray_occluded = evaluate_shadow_ray(render_data, ray, t_max, last_hit_primitive_index, bounce, random_number_generator);
+        shadow_ray_occluded = evaluate_or_defer_shadow_ray(render_data, ray, t_max, last_hit_primitive_index, last_hit_instance_id, bounce, random_number_generator);
         shadow_ray_discarded = false;
     }
 
@@ -361,10 +638,12 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray_nee_plus_plus(HIPRTRende
             hippt::atomic_fetch_add(render_data.nee_plus_plus.shadow_rays_actually_traced, 1u);
 
         // The shadow ray is likely visible, testing with a shadow ray
-        shadow_ray_occluded = evaluate_shadow_ray(render_data, ray, t_max, last_hit_primitive_index, bounce, random_number_generator);
+        shadow_ray_occluded = evaluate_or_defer_shadow_ray(render_data, ray, t_max, last_hit_primitive_index, last_hit_instance_id, bounce, random_number_generator,
+            render_data.nee_plus_plus.update_visibility_map ? nee_plus_plus_voxel_matrix_index : -1);
         shadow_ray_discarded = false;
 
-        if (render_data.nee_plus_plus.update_visibility_map)
+        if (render_data.nee_plus_plus.update_visibility_map && !is_shadow_ray_deferred(render_data))
+            // The visibility of deferred shadow rays is accumulated by the shadow ray stage
             render_data.nee_plus_plus.accumulate_visibility(!shadow_ray_occluded, nee_plus_plus_voxel_matrix_index);
     }
     else
@@ -380,7 +659,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray_nee_plus_plus(HIPRTRende
     // divides by it
     nee_plus_plus_context.unoccluded_probability = 1.0f;
 
-    bool shadow_ray_occluded = evaluate_shadow_ray(render_data, ray, t_max, last_hit_primitive_index, bounce, random_number_generator);
+    bool shadow_ray_occluded = evaluate_or_defer_shadow_ray(render_data, ray, t_max, last_hit_primitive_index, last_hit_instance_id, bounce, random_number_generator);
 #endif
 
 #if DirectLightNEEPlusPlusDisplayShadowRaysDiscarded == KERNEL_OPTION_TRUE
@@ -411,7 +690,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_ray_nee_plus_plus(HIPRTRende
  * 
  * Also, if a hit was found, outputs the emission of the material at the hit point in 'out_hit_emission'
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_light_ray(const HIPRTRenderData& render_data, hiprtRay ray, float t_max, ShadowLightRayHitInfo& out_light_hit_info, int last_hit_primitive_index, int bounce, Xorshift32Generator& random_number_generator)
+HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_light_ray(const HIPRTRenderData& render_data, hiprtRay ray, float t_max, ShadowLightRayHitInfo& out_light_hit_info, int last_hit_primitive_index, int last_hit_instance_id, int bounce, Xorshift32Generator& random_number_generator)
 {
 #ifdef __KERNELCC__
     if (render_data.GPU_BVH == nullptr)
@@ -422,9 +701,9 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_light_ray(const HIPRTRenderD
 #ifdef __KERNELCC__
     ray.maxT = t_max - 1.0e-4f;
 
-    DECLARE_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal, render_data, ray, last_hit_primitive_index, random_number_generator);
+    DECLARE_HIPRT_CLOSEST_HIT_TRAVERSAL(traversal, render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);
 
-    hiprtHit shadow_ray_hit = traversal.getNextHit();
+    hiprtHit shadow_ray_hit = get_scene_hit(render_data, traversal.getNextHit());
     if (!shadow_ray_hit.hasHit())
         return false;
 
@@ -443,17 +722,18 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_light_ray(const HIPRTRenderD
     {
         out_light_hit_info.hit_emission = get_material_property<ColorRGB32F>(render_data, false, interpolated_texcoords, emission_texture_index);
         // Getting the shading normal
-        out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.uv, interpolated_texcoords);
+        out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.instanceID, shadow_ray_hit.uv, interpolated_texcoords);
     }
     else
     {
         out_light_hit_info.hit_emission = render_data.buffers.materials_buffer.get_emission(material_index);
-        out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.uv, interpolated_texcoords);
+        out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.instanceID, shadow_ray_hit.uv, interpolated_texcoords);
     }
     
     out_light_hit_info.hit_interpolated_texcoords = interpolated_texcoords;
     out_light_hit_info.hit_geometric_normal = shadow_ray_hit.normal;
     out_light_hit_info.hit_prim_index = shadow_ray_hit.primID;
+    out_light_hit_info.hit_instance_id = shadow_ray_hit.instanceID;
     out_light_hit_info.hit_material_index = material_index;
     out_light_hit_info.hit_distance = shadow_ray_hit.t;
 
@@ -469,7 +749,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_light_ray(const HIPRTRenderD
     do
     {
         // We should use ray tracing filter functions here instead of re-tracing new rays
-        shadow_ray_hit = intersect_scene_cpu(render_data, ray, last_hit_primitive_index, random_number_generator);
+        shadow_ray_hit = intersect_scene_cpu(render_data, ray, last_hit_primitive_index, last_hit_instance_id, random_number_generator);
+        CPU_PROFILER_COUNT_RAYS(CPU_PROFILER_SHADOW_RAY, 1);
         if (!shadow_ray_hit.hasHit())
             return false;
 
@@ -502,17 +783,18 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool evaluate_shadow_light_ray(const HIPRTRenderD
         {
             out_light_hit_info.hit_emission = get_material_property<ColorRGB32F>(render_data, false, interpolated_texcoords, emission_texture_index);
             // Getting the shading normal
-            out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.uv, interpolated_texcoords);
+            out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.instanceID, shadow_ray_hit.uv, interpolated_texcoords);
         }
         else
         {
             out_light_hit_info.hit_emission = render_data.buffers.materials_buffer.get_emission(material_index);
-            out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.uv, interpolated_texcoords);
+            out_light_hit_info.hit_shading_normal = get_shading_normal(render_data, hippt::normalize(shadow_ray_hit.normal), triangle_vertex_indices, triangle_texcoords, shadow_ray_hit.primID, shadow_ray_hit.instanceID, shadow_ray_hit.uv, interpolated_texcoords);
         }
 
         out_light_hit_info.hit_interpolated_texcoords = interpolated_texcoords;
         out_light_hit_info.hit_geometric_normal = shadow_ray_hit.normal;
         out_light_hit_info.hit_prim_index = shadow_ray_hit.primID;
+        out_light_hit_info.hit_instance_id = shadow_ray_hit.instanceID;
         out_light_hit_info.hit_material_index = material_index;
         out_light_hit_info.hit_distance = cumulative_t;
 
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_LIGHT_BVH_DEVICE_H
+#define DEVICE_LIGHT_BVH_DEVICE_H
+
+#include "HostDeviceCommon/Math.h"
+#include "HostDeviceCommon/Xorshift.h"
+
+/**
+ * Node of the light BVH built over the emissive triangles of the scene.
+ * 
+ * Nodes are stored in depth-first order: the first child of an interior
+ * node is the node right after it in the nodes array.
+ * 
+ * Each node bounds the position, the orientation and the power of the
+ * emissive triangles below it so that the importance of the whole node
+ * for a given shading point can be estimated.
+ * 
+ * Reference:
+ * [1] [Importance Sampling of Many Lights with Adaptive Tree Splitting, Conty Estevez, Kulla, 2018]
+ * [2] [Physically Based Rendering 4th Edition, Pharr, Jakob, Humphreys, 2023] Chapter 12.6.3
+ */
+struct LightBVHNode
+{
+    float3 bounds_min;
+    // Index of the second child for an interior node,
+    // index of the emissive triangle in the triangle buffer of the scene for a leaf
+    int second_child_or_triangle_index;
+
+    float3 bounds_max;
+    // Sum of the power of the emissive triangles of the node
+    float power;
+
+    // Cone bounding the normals of the emissive triangles of the node
+    float3 normals_cone_axis;
+    float cos_theta_o;
+
+    // -1 for the root
+    int parent_index;
+    int is_leaf;
+
+    int padding[2];
+};
+
+struct LightBVHDevice
+{
+    LightBVHNode* nodes = nullptr;
+
+    // For each triangle of the scene, the index of the leaf of the light BVH
+    // that contains that triangle. -1 if the triangle isn't emissive
+    int* triangle_leaf_indices = nullptr;
+};
+
+/**
+ * cos(max(0, theta_a - theta_b)) from the sine and cosine of both angles
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float light_bvh_cos_sub_clamped(float sin_theta_a, float cos_theta_a, float sin_theta_b, float cos_theta_b)
+{
+    if (cos_theta_a > cos_theta_b)
+        return 1.0f;
+
+    return cos_theta_a * cos_theta_b + sin_theta_a * sin_theta_b;
+}
+
+/**
+ * sin(max(0, theta_a - theta_b)) from the sine and cosine of both angles
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float light_bvh_sin_sub_clamped(float sin_theta_a, float cos_theta_a, float sin_theta_b, float cos_theta_b)
+{
+    if (cos_theta_a > cos_theta_b)
+        return 0.0f;
+
+    return sin_theta_a * cos_theta_b - cos_theta_a * sin_theta_b;
+}
+
+/**
+ * Conservative estimate of the contribution of the emissive triangles of 'node'
+ * to the point 'shading_point' with normal 'shading_normal'.
+ * 
+ * The emissive triangles are double sided so the orientation of the cone is only used up to its sign.
+ * The receiver side uses the absolute value of the cosine so that points on transmissive surfaces
+ * can still sample lights behind them.
+ * 
+ * This is the importance function of [2] with emission angle theta_e = pi / 2
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float light_bvh_node_importance(const LightBVHNode& node, const float3& shading_point, const float3& shading_normal)
+{
+    float3 center = (node.bounds_min + node.bounds_max) * 0.5f;
+    float3 to_point = shading_point - center;
+    float distance_squared = hippt::length2(to_point);
+    // Clamping the distance to avoid infinite importance for points inside the node
+    float half_diagonal = hippt::length(node.bounds_max - node.bounds_min) * 0.5f;
+    float clamped_distance_squared = hippt::max(distance_squared, half_diagonal);
+
+    float3 direction_from_node = distance_squared > 0.0f ? to_point / sqrtf(distance_squared) : make_float3(0.0f, 0.0f, 1.0f);
+
+    // Angle between the axis of the cone and the direction to the point
+    float cos_theta_w = hippt::abs(hippt::dot(node.normals_cone_axis, direction_from_node));
+    float sin_theta_w = sqrtf(hippt::max(0.0f, 1.0f - cos_theta_w * cos_theta_w));
+
+    // Angle subtended by the bounds of the node as seen from the point
+    float cos_theta_b;
+    float bounding_sphere_radius_squared = hippt::length2(node.bounds_max - center);
+    if (distance_squared < bounding_sphere_radius_squared)
+        // The point is inside the bounding sphere of the node, all directions are possible
+        cos_theta_b = -1.0f;
+    else
+        cos_theta_b = sqrtf(hippt::max(0.0f, 1.0f - bounding_sphere_radius_squared / distance_squared));
+    float sin_theta_b = sqrtf(hippt::max(0.0f, 1.0f - cos_theta_b * cos_theta_b));
+
+    float sin_theta_o = sqrtf(hippt::max(0.0f, 1.0f - node.cos_theta_o * node.cos_theta_o));
+
+    // Minimum angle between the direction to the point and the normals of the node
+    float cos_theta_x = light_bvh_cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, node.cos_theta_o);
+    float sin_theta_x = light_bvh_sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, node.cos_theta_o);
+    float cos_theta_p = light_bvh_cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+    if (cos_theta_p <= 0.0f)
+        // Beyond the emission angle of the triangles
+        return 0.0f;
+
+    float importance = node.power * cos_theta_p / clamped_distance_squared;
+
+    // Cosine at the receiver
+    float cos_theta_i = hippt::abs(hippt::dot(-direction_from_node, shading_normal));
+    float sin_theta_i = sqrtf(hippt::max(0.0f, 1.0f - cos_theta_i * cos_theta_i));
+    float cos_theta_i_p = light_bvh_cos_sub_clamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+    importance *= cos_theta_i_p;
+
+    return hippt::max(0.0f, importance);
+}
+
+/**
+ * Probability of picking the first child of 'parent_index' from the given shading point.
+ * -1.0f is returned if none of the children has any importance
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float light_bvh_first_child_probability(const LightBVHDevice& light_bvh, int parent_index, const float3& shading_point, const float3& shading_normal)
+{
+    const LightBVHNode& parent = light_bvh.nodes[parent_index];
+
+    float first_child_importance = light_bvh_node_importance(light_bvh.nodes[parent_index + 1], shading_point, shading_normal);
+    float second_child_importance = light_bvh_node_importance(light_bvh.nodes[parent.second_child_or_triangle_index], shading_point, shading_normal);
+
+    float importance_sum = first_child_importance + second_child_importance;
+    if (importance_sum <= 0.0f)
+        return -1.0f;
+
+    return first_child_importance / importance_sum;
+}
+
+/**
+ * Stochastically descends the light BVH from the root, picking the children proportionally
+ * to their importance for the shading point.
+ * 
+ * Returns the index of the emissive triangle picked in the triangle buffer and the probability
+ * of picking it in 'out_probability'. -1 is returned if no light could be picked
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE int light_bvh_sample_triangle(const LightBVHDevice& light_bvh, const float3& shading_point, const float3& shading_normal, Xorshift32Generator& random_number_generator, float& out_probability)
+{
+    int node_index = 0;
+    out_probability = 1.0f;
+
+    while (!light_bvh.nodes[node_index].is_leaf)
+    {
+        float first_child_probability = light_bvh_first_child_probability(light_bvh, node_index, shading_point, shading_normal);
+        if (first_child_probability < 0.0f)
+        {
+            out_probability = 0.0f;
+
+            return -1;
+        }
+
+        if (random_number_generator() < first_child_probability)
+        {
+            out_probability *= first_child_probability;
+            node_index = node_index + 1;
+        }
+        else
+        {
+            out_probability *= 1.0f - first_child_probability;
+            node_index = light_bvh.nodes[node_index].second_child_or_triangle_index;
+        }
+    }
+
+    return light_bvh.nodes[node_index].second_child_or_triangle_index;
+}
+
+/**
+ * Probability that 'light_bvh_sample_triangle()' picks the emissive triangle 'triangle_index'
+ * from the given shading point.
+ * 
+ * The probability is computed by walking up from the leaf of the triangle to the root
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float light_bvh_triangle_probability(const LightBVHDevice& light_bvh, int triangle_index, const float3& shading_point, const float3& shading_normal)
+{
+    int node_index = light_bvh.triangle_leaf_indices[triangle_index];
+    if (node_index == -1)
+        return 0.0f;
+
+    float probability = 1.0f;
+    int parent_index = light_bvh.nodes[node_index].parent_index;
+    while (parent_index != -1)
+    {
+        float first_child_probability = light_bvh_first_child_probability(light_bvh, parent_index, shading_point, shading_normal);
+        if (first_child_probability < 0.0f)
+            return 0.0f;
+
+        probability *= (node_index == parent_index + 1) ? first_child_probability : 1.0f - first_child_probability;
+
+        node_index = parent_index;
+        parent_index = light_bvh.nodes[node_index].parent_index;
+    }
+
+    return probability;
+}
+
+#endif
@@ -6,15 +6,20 @@
 #ifndef DEVICE_LIGHT_UTILS_H
 #define DEVICE_LIGHT_UTILS_H
 
+#include "Device/includes/LightBVH/LightBVHDevice.h"
+
 #include "HostDeviceCommon/Color.h"
 #include "HostDeviceCommon/HitInfo.h"
 #include "HostDeviceCommon/RenderData.h"
 
-HIPRT_HOST_DEVICE HIPRT_INLINE float3 uniform_sample_one_emissive_triangle(const HIPRTRenderData& render_data, Xorshift32Generator& random_number_generator, float& pdf, LightSourceInformation& light_info)
+/**
+ * Samples a point uniformly on the emissive triangle 'triangle_index'.
+ * 
+ * The returned 'pdf' is the area measure PDF of the point on the triangle only,
+ * it doesn't include the probability of having picked that triangle
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 sample_point_on_emissive_triangle(const HIPRTRenderData& render_data, int triangle_index, Xorshift32Generator& random_number_generator, float& pdf, LightSourceInformation& light_info)
 {
-    int random_index = random_number_generator.random_index(render_data.buffers.emissive_triangles_count);
-    int triangle_index = render_data.buffers.emissive_triangles_indices[random_index];
-
     float3 vertex_A = render_data.buffers.vertices_positions[render_data.buffers.triangles_indices[triangle_index * 3 + 0]];
     float3 vertex_B = render_data.buffers.vertices_positions[render_data.buffers.triangles_indices[triangle_index * 3 + 1]];
     float3 vertex_C = render_data.buffers.vertices_positions[render_data.buffers.triangles_indices[triangle_index * 3 + 2]];
@@ -47,11 +52,104 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float3 uniform_sample_one_emissive_triangle(const
     light_info.emission = render_data.buffers.materials_buffer.get_emission(render_data.buffers.material_indices[triangle_index]);
 
     pdf = 1.0f / light_info.light_area;
+
+    return random_point_on_triangle;
+}
+
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 uniform_sample_one_emissive_triangle(const HIPRTRenderData& render_data, Xorshift32Generator& random_number_generator, float& pdf, LightSourceInformation& light_info)
+{
+    int random_index = random_number_generator.random_index(render_data.buffers.emissive_triangles_count);
+    int triangle_index = render_data.buffers.emissive_triangles_indices[random_index];
+
+    float3 random_point_on_triangle = sample_point_on_emissive_triangle(render_data, triangle_index, random_number_generator, pdf, light_info);
     pdf /= render_data.buffers.emissive_triangles_count;
 
     return random_point_on_triangle;
 }
 
+/**
+ * Picks an emissive triangle proportionally to its power with the alias table
+ * of the emissive triangles.
+ * 
+ * Returns the index of the triangle in the triangle buffer of the scene
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE int power_pick_one_emissive_triangle(const HIPRTRenderData& render_data, Xorshift32Generator& random_number_generator)
+{
+    int random_index = random_number_generator.random_index(render_data.buffers.emissive_triangles_count);
+    if (random_number_generator() > render_data.buffers.emissive_power_alias_table_probas[random_index])
+        // Picking the alias
+        random_index = render_data.buffers.emissive_power_alias_table_alias[random_index];
+
+    return render_data.buffers.emissive_triangles_indices[random_index];
+}
+
+/**
+ * Probability that 'power_pick_one_emissive_triangle()' picks the given triangle
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float power_pick_probability_of_emissive_triangle(const HIPRTRenderData& render_data, int triangle_index)
+{
+    // The leaves of the light BVH contain the power of each triangle
+    // and the root contains the power of the whole scene.
+    // 
+    // The alias table is built from the same powers
+    int leaf_index = render_data.buffers.light_bvh.triangle_leaf_indices[triangle_index];
+    if (leaf_index == -1)
+        return 0.0f;
+
+    return render_data.buffers.light_bvh.nodes[leaf_index].power / render_data.buffers.light_bvh.nodes[0].power;
+}
+
+/**
+ * Samples one emissive triangle of the scene with the strategy given by
+ * 'DirectLightSamplingBaseStrategy' and then a point uniformly on that triangle.
+ * 
+ * 'shading_point' and 'shading_normal' are those of the point being shaded. They are only
+ * used by the light BVH. The same point and normal must be given to 'pdf_of_emissive_triangle_hit()'
+ * for MIS to be correct.
+ * 
+ * The returned 'pdf' is in area measure and includes the probability of having picked the triangle
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 sample_one_emissive_triangle(const HIPRTRenderData& render_data, const float3& shading_point, const float3& shading_normal, Xorshift32Generator& random_number_generator, float& pdf, LightSourceInformation& light_info)
+{
+#if DirectLightSamplingBaseStrategy == LSS_BASE_UNIFORM
+    return uniform_sample_one_emissive_triangle(render_data, random_number_generator, pdf, light_info);
+#else
+#if DirectLightSamplingBaseStrategy == LSS_BASE_POWER
+    int triangle_index = power_pick_one_emissive_triangle(render_data, random_number_generator);
+    float pick_probability = power_pick_probability_of_emissive_triangle(render_data, triangle_index);
+#elif DirectLightSamplingBaseStrategy == LSS_BASE_LIGHT_BVH
+    float pick_probability;
+    int triangle_index = light_bvh_sample_triangle(render_data.buffers.light_bvh, shading_point, shading_normal, random_number_generator, pick_probability);
+#endif
+
+    if (triangle_index == -1 || pick_probability <= 0.0f)
+    {
+        pdf = 0.0f;
+
+        return make_float3(0.0f, 0.0f, 0.0f);
+    }
+
+    float3 random_point_on_triangle = sample_point_on_emissive_triangle(render_data, triangle_index, random_number_generator, pdf, light_info);
+    pdf *= pick_probability;
+
+    return random_point_on_triangle;
+#endif
+}
+
+/**
+ * Probability that 'sample_one_emissive_triangle()' picks the emissive triangle 'triangle_index'
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float pick_probability_of_emissive_triangle(const HIPRTRenderData& render_data, int triangle_index, const float3& shading_point, const float3& shading_normal)
+{
+#if DirectLightSamplingBaseStrategy == LSS_BASE_UNIFORM
+    return 1.0f / render_data.buffers.emissive_triangles_count;
+#elif DirectLightSamplingBaseStrategy == LSS_BASE_POWER
+    return power_pick_probability_of_emissive_triangle(render_data, triangle_index);
+#elif DirectLightSamplingBaseStrategy == LSS_BASE_LIGHT_BVH
+    return light_bvh_triangle_probability(render_data.buffers.light_bvh, triangle_index, shading_point, shading_normal);
+#endif
+}
+
 HIPRT_HOST_DEVICE HIPRT_INLINE float3 get_triangle_normal_non_normalized(const HIPRTRenderData& render_data, int triangle_index)
 {
     float3 vertex_A = render_data.buffers.vertices_positions[render_data.buffers.triangles_indices[triangle_index * 3 + 0]];
@@ -91,19 +189,18 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F clamp_light_contribution(ColorRGB32F
 }
 
 /**
- * Returns the PDF (solid angle measure) of the light sampler for the given triangle_hit_info
+ * Returns the solid angle PDF of sampling the point hit on the emissive triangle given
+ * that the triangle is picked with probability 'pick_probability' and that the point
+ * is then sampled uniformly on the triangle
  * 
- * 'primitive_index' is the index of the emissive triangle hit
- * 'shading_normal' is the shading normal at the intersection point of the emissive triangle hit
- * 'hit_distance' is the distance to the intersection point on the hit triangle
  * 'ray_direction' is the direction of the ray that hit the triangle. The direction points towards the triangle.
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE float pdf_of_emissive_triangle_hit(const HIPRTRenderData& render_data, const ShadowLightRayHitInfo& light_hit_info, float3 ray_direction)
+HIPRT_HOST_DEVICE HIPRT_INLINE float pdf_of_emissive_triangle_hit(const HIPRTRenderData& render_data, const ShadowLightRayHitInfo& light_hit_info, float3 ray_direction, float pick_probability)
 {
     // Surface area PDF of hitting that point on that triangle in the scene
     float light_area = triangle_area(render_data, light_hit_info.hit_prim_index);
     float pdf = 1.0f / light_area;
-    pdf /= render_data.buffers.emissive_triangles_count;
+    pdf *= pick_probability;
     
     // abs() here to allow backfacing lights
     // Without abs() here:
@@ -119,6 +216,21 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float pdf_of_emissive_triangle_hit(const HIPRTRen
     return pdf;
 }
 
+/**
+ * Returns the PDF (solid angle measure) of the light sampler for the given triangle_hit_info
+ * 
+ * 'light_hit_info' is the information of the emissive triangle hit
+ * 'ray_direction' is the direction of the ray that hit the triangle. The direction points towards the triangle.
+ * 'shading_point' and 'shading_normal' must be the same as those given to 'sample_one_emissive_triangle()'
+ * at that point
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float pdf_of_emissive_triangle_hit(const HIPRTRenderData& render_data, const ShadowLightRayHitInfo& light_hit_info, float3 ray_direction, const float3& shading_point, const float3& shading_normal)
+{
+    float pick_probability = pick_probability_of_emissive_triangle(render_data, light_hit_info.hit_prim_index, shading_point, shading_normal);
+
+    return pdf_of_emissive_triangle_hit(render_data, light_hit_info, ray_direction, pick_probability);
+}
+
 /**
  * Returns true if the given contribution satisfies the minimum light contribution
  * required for a light to be 
@@ -11,6 +11,7 @@
 #include "Device/includes/Intersect.h"
 #include "Device/includes/LightUtils.h"
 #include "Device/includes/MISBSDFRayReuse.h"
+#include "Device/includes/Profiling.h"
 #include "Device/includes/ReSTIR/DI/Reservoir.h"
 #include "Device/includes/ReSTIR/DI/FinalShading.h"
 #include "Device/includes/RIS/RIS.h"
@@ -28,7 +29,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_no_MIS(HIPRTRenderDa
     float light_sample_pdf;
     LightSourceInformation light_source_info;
     ColorRGB32F light_source_radiance;
-    float3 random_light_point = uniform_sample_one_emissive_triangle(render_data, random_number_generator, light_sample_pdf, light_source_info);
+    float3 random_light_point = sample_one_emissive_triangle(render_data, closest_hit_info.inter_point, closest_hit_info.shading_normal, random_number_generator, light_sample_pdf, light_source_info);
     if (!(light_sample_pdf > 0.0f))
         // Can happen for very small triangles
         return ColorRGB32F(0.0f);
@@ -49,7 +50,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_no_MIS(HIPRTRenderDa
         NEEPlusPlusContext nee_plus_plus_context;
         nee_plus_plus_context.point_on_light = random_light_point;
         nee_plus_plus_context.shaded_point = shadow_ray_origin;
-        bool in_shadow = evaluate_shadow_ray_nee_plus_plus(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, nee_plus_plus_context, random_number_generator, ray_payload.bounce);
+        bool in_shadow = evaluate_shadow_ray_nee_plus_plus(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, closest_hit_info.instance_id, nee_plus_plus_context, random_number_generator, ray_payload.bounce);
 
         if (!in_shadow)
         {
@@ -67,20 +68,28 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_no_MIS(HIPRTRenderDa
                 light_source_radiance = light_source_info.emission * cosine_term * bsdf_color / light_sample_pdf / nee_plus_plus_context.unoccluded_probability;
             }
         }
+
+        light_source_radiance = defer_shadow_ray_contribution(render_data, light_source_radiance, WAVEFRONT_SHADOW_RAY_LIGHT);
     }
 
     return light_source_radiance;
 }
 
-HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_bsdf(const HIPRTRenderData& render_data, RayPayload& ray_payload, const HitInfo closest_hit_info, const float3& view_direction, Xorshift32Generator& random_number_generator, MISBSDFRayReuse& mis_ray_reuse)
+/**
+ * 'last_light_sample' is whether this is the last light sample of the path vertex, whose
+ * BSDF sample is the one reused for the next bounce. See begin_mis_bsdf_sample_dimensions()
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_bsdf(const HIPRTRenderData& render_data, RayPayload& ray_payload, const HitInfo closest_hit_info, const float3& view_direction, Xorshift32Generator& random_number_generator, MISBSDFRayReuse& mis_ray_reuse, bool last_light_sample)
 {
     ColorRGB32F bsdf_radiance = ColorRGB32F(0.0f);
 
     float bsdf_sample_pdf;
     float3 sampled_bsdf_direction;
+    begin_mis_bsdf_sample_dimensions(random_number_generator, ray_payload.bounce, last_light_sample);
     ColorRGB32F bsdf_color = bsdf_dispatcher_sample(render_data, ray_payload.material, ray_payload.volume_state, true, 
                                                     view_direction, closest_hit_info.shading_normal, closest_hit_info.geometric_normal, sampled_bsdf_direction, 
                                                     bsdf_sample_pdf, random_number_generator, ray_payload.bounce);
+    random_number_generator.end_dimensions();
 
     bool intersection_found = false;
     ShadowLightRayHitInfo shadow_light_ray_hit_info;
@@ -90,7 +99,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_bsdf(const HIPRTRend
         new_ray.origin = closest_hit_info.inter_point;
         new_ray.direction = sampled_bsdf_direction;
 
-        intersection_found = evaluate_shadow_light_ray(render_data, new_ray, 1.0e35f, shadow_light_ray_hit_info, closest_hit_info.primitive_index, ray_payload.bounce, random_number_generator);
+        intersection_found = evaluate_shadow_light_ray(render_data, new_ray, 1.0e35f, shadow_light_ray_hit_info, closest_hit_info.primitive_index, closest_hit_info.instance_id, ray_payload.bounce, random_number_generator);
 
         // Checking that we did hit something and if we hit something,
         // it needs to be emissive
@@ -111,7 +120,10 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_bsdf(const HIPRTRend
     return bsdf_radiance;
 }
 
-HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData& render_data, RayPayload& ray_payload, const HitInfo closest_hit_info, const float3& view_direction, Xorshift32Generator& random_number_generator, MISBSDFRayReuse& mis_ray_reuse)
+/**
+ * See sample_one_light_bsdf() for 'last_light_sample'
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData& render_data, RayPayload& ray_payload, const HitInfo closest_hit_info, const float3& view_direction, Xorshift32Generator& random_number_generator, MISBSDFRayReuse& mis_ray_reuse, bool last_light_sample)
 {
     float light_sample_pdf;
     ColorRGB32F light_source_radiance_mis;
@@ -119,7 +131,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData&
     if (MaterialUtils::can_do_light_sampling(ray_payload.material))
     {
         LightSourceInformation light_source_info;
-        float3 random_light_point = uniform_sample_one_emissive_triangle(render_data, random_number_generator, light_sample_pdf, light_source_info);
+        float3 random_light_point = sample_one_emissive_triangle(render_data, closest_hit_info.inter_point, closest_hit_info.shading_normal, random_number_generator, light_sample_pdf, light_source_info);
         if (light_sample_pdf <= 0.0f)
             // Can happen for very small triangles
             return ColorRGB32F(0.0f);
@@ -139,7 +151,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData&
             NEEPlusPlusContext nee_plus_plus_context;
             nee_plus_plus_context.point_on_light = random_light_point;
             nee_plus_plus_context.shaded_point = shadow_ray.origin;
-            bool in_shadow = evaluate_shadow_ray_nee_plus_plus(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, nee_plus_plus_context, random_number_generator, ray_payload.bounce);
+            bool in_shadow = evaluate_shadow_ray_nee_plus_plus(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, closest_hit_info.instance_id, nee_plus_plus_context, random_number_generator, ray_payload.bounce);
 
             if (!in_shadow)
             {
@@ -159,6 +171,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData&
                     light_source_radiance_mis = bsdf_color * cosine_term * light_source_info.emission * mis_weight / light_sample_pdf / nee_plus_plus_context.unoccluded_probability;
                 }
             }
+
+            light_source_radiance_mis = defer_shadow_ray_contribution(render_data, light_source_radiance_mis, WAVEFRONT_SHADOW_RAY_LIGHT);
         }
     }
 
@@ -167,9 +181,11 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData&
     float bsdf_sample_pdf;
     float3 sampled_bsdf_direction;
     float3 bsdf_shadow_ray_origin = closest_hit_info.inter_point;
+    begin_mis_bsdf_sample_dimensions(random_number_generator, ray_payload.bounce, last_light_sample);
     ColorRGB32F bsdf_color = bsdf_dispatcher_sample(render_data, ray_payload.material, ray_payload.volume_state, ReuseBSDFMISRay == KERNEL_OPTION_TRUE, 
                                                     view_direction, closest_hit_info.shading_normal, closest_hit_info.geometric_normal, sampled_bsdf_direction, 
                                                     bsdf_sample_pdf, random_number_generator, ray_payload.bounce);
+    random_number_generator.end_dimensions();
 
     bool intersection_found = false;
     ShadowLightRayHitInfo shadow_light_ray_hit_info;
@@ -179,13 +195,13 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData&
         new_ray.origin = bsdf_shadow_ray_origin;
         new_ray.direction = sampled_bsdf_direction;
 
-        intersection_found = evaluate_shadow_light_ray(render_data, new_ray, 1.0e35f, shadow_light_ray_hit_info, closest_hit_info.primitive_index, ray_payload.bounce, random_number_generator);
+        intersection_found = evaluate_shadow_light_ray(render_data, new_ray, 1.0e35f, shadow_light_ray_hit_info, closest_hit_info.primitive_index, closest_hit_info.instance_id, ray_payload.bounce, random_number_generator);
 
         // Checking that we did hit something and if we hit something,
         // it needs to be emissive
         if (intersection_found)
         {
-            float light_pdf = pdf_of_emissive_triangle_hit(render_data, shadow_light_ray_hit_info, sampled_bsdf_direction);
+            float light_pdf = pdf_of_emissive_triangle_hit(render_data, shadow_light_ray_hit_info, sampled_bsdf_direction, closest_hit_info.inter_point, closest_hit_info.shading_normal);
             float mis_weight = balance_heuristic(bsdf_sample_pdf, light_pdf);
 
             // Using abs here because we want the dot product to be positive.
@@ -219,6 +235,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_MIS(HIPRTRenderData&
 HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_many_lights(HIPRTRenderData& render_data, RayPayload& ray_payload, const HitInfo closest_hit_info, const float3& view_direction, Xorshift32Generator& random_number_generator, MISBSDFRayReuse& mis_ray_reuse)
 {
     ColorRGB32F direct_light_contribution;
+    int first_deferred_shadow_ray = get_deferred_shadow_ray_count(render_data);
 
     // Any of these light sampling strategy support sampling multiple lights
     // per each shading point, effectively "amortizing" camera and bounce rays
@@ -227,14 +244,17 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_many_lights(HIPRTRenderData& r
 #if DirectLightSamplingStrategy == LSS_UNIFORM_ONE_LIGHT
         direct_light_contribution += sample_one_light_no_MIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator);
 #elif DirectLightSamplingStrategy == LSS_BSDF
-        direct_light_contribution += sample_one_light_bsdf(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse);
+        direct_light_contribution += sample_one_light_bsdf(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse, i == render_data.render_settings.number_of_light_samples - 1);
 #elif DirectLightSamplingStrategy == LSS_MIS_LIGHT_BSDF
-        direct_light_contribution += sample_one_light_MIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse);
+        direct_light_contribution += sample_one_light_MIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse, i == render_data.render_settings.number_of_light_samples - 1);
 #elif DirectLightSamplingStrategy == LSS_RIS_BSDF_AND_LIGHT
-        direct_light_contribution += sample_lights_RIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse);
+        direct_light_contribution += sample_lights_RIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse, i == render_data.render_settings.number_of_light_samples - 1);
 #endif
     }
 
+    // The shadow rays deferred to the wavefront shadow ray stage are averaged too
+    scale_deferred_shadow_ray_contributions(render_data, first_deferred_shadow_ray, 1.0f / render_data.render_settings.number_of_light_samples);
+
     return direct_light_contribution / render_data.render_settings.number_of_light_samples;
 }
 
@@ -254,19 +274,21 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light_ReSTIR_DI(HIPRTRende
     {
         // ReSTIR DI isn't used for the secondary/tertiary/... bounces
         // so there we can take multiple light samples per path vertex
+        int first_deferred_shadow_ray = get_deferred_shadow_ray_count(render_data);
         for (int i = 0; i < render_data.render_settings.number_of_light_samples; i++)
         {
 #if ReSTIR_DI_LaterBouncesSamplingStrategy == RESTIR_DI_LATER_BOUNCES_UNIFORM_ONE_LIGHT
             direct_light_contribution += sample_one_light_no_MIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator);
 #elif ReSTIR_DI_LaterBouncesSamplingStrategy == RESTIR_DI_LATER_BOUNCES_BSDF
-            direct_light_contribution += sample_one_light_bsdf(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse);
+            direct_light_contribution += sample_one_light_bsdf(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse, i == render_data.render_settings.number_of_light_samples - 1);
 #elif ReSTIR_DI_LaterBouncesSamplingStrategy == RESTIR_DI_LATER_BOUNCES_MIS_LIGHT_BSDF
-            direct_light_contribution += sample_one_light_MIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse);
+            direct_light_contribution += sample_one_light_MIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse, i == render_data.render_settings.number_of_light_samples - 1);
 #elif ReSTIR_DI_LaterBouncesSamplingStrategy == RESTIR_DI_LATER_BOUNCES_RIS_BSDF_AND_LIGHT
-            direct_light_contribution += sample_lights_RIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse);
+            direct_light_contribution += sample_lights_RIS(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_ray_reuse, i == render_data.render_settings.number_of_light_samples - 1);
 #endif
         }
 
+        scale_deferred_shadow_ray_contributions(render_data, first_deferred_shadow_ray, 1.0f / render_data.render_settings.number_of_light_samples);
         direct_light_contribution /= render_data.render_settings.number_of_light_samples;
     }
 
@@ -294,6 +316,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light(HIPRTRenderData& ren
     const float3& view_direction, 
     Xorshift32Generator& random_number_generator, int2 pixel_coords, MISBSDFRayReuse& mis_ray_reuse)
 {
+    CPU_PROFILER_HOT_FUNCTION_SCOPE(CPU_PROFILER_LIGHT_SAMPLING);
+
     if (render_data.buffers.emissive_triangles_count == 0 
         && !(render_data.world_settings.ambient_light_type == AmbientLightType::ENVMAP && DirectLightSamplingStrategy == LSS_RESTIR_DI))
         // No emissive geometry in the scene to sample
@@ -331,14 +355,30 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_one_light(HIPRTRenderData& ren
     return direct_light_contribution + material_self_textured_emission;
 }
 
-HIPRT_HOST_DEVICE void estimate_direct_lighting(HIPRTRenderData& render_data, RayPayload& ray_payload, HitInfo& closest_hit_info, 
+/**
+ * Samples the emissive lights and the envmap at the hit point of the path.
+ * The unclamped results are returned in 'out_light_direct_contribution' and
+ * 'out_envmap_direct_contribution' and are meant to be given to accumulate_direct_lighting()
+ */
+HIPRT_HOST_DEVICE void sample_direct_lighting(HIPRTRenderData& render_data, RayPayload& ray_payload, HitInfo& closest_hit_info, 
     float3 view_direction,
     int x, int y,
-    MISBSDFRayReuse& mis_reuse, Xorshift32Generator& random_number_generator)
+    MISBSDFRayReuse& mis_reuse, Xorshift32Generator& random_number_generator,
+    ColorRGB32F& out_light_direct_contribution, ColorRGB32F& out_envmap_direct_contribution)
 {
-    ColorRGB32F light_direct_contribution = sample_one_light(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, make_int2(x, y), mis_reuse);
-    ColorRGB32F envmap_direct_contribution = sample_environment_map(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_reuse);
+    random_number_generator.begin_dimensions(SamplerDimension::bounce_dimension(ray_payload.bounce, SamplerDimension::LIGHT), SamplerDimension::LIGHT_COUNT);
+    out_light_direct_contribution = sample_one_light(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, make_int2(x, y), mis_reuse);
+    random_number_generator.begin_dimensions(SamplerDimension::bounce_dimension(ray_payload.bounce, SamplerDimension::ENVMAP), SamplerDimension::ENVMAP_COUNT);
+    out_envmap_direct_contribution = sample_environment_map(render_data, ray_payload, closest_hit_info, view_direction, random_number_generator, mis_reuse);
+}
 
+/**
+ * Clamps the direct lighting computed by sample_direct_lighting() and adds it,
+ * along with the emission of the hit, to the radiance of the path
+ */
+HIPRT_HOST_DEVICE void accumulate_direct_lighting(const HIPRTRenderData& render_data, RayPayload& ray_payload,
+    ColorRGB32F light_direct_contribution, ColorRGB32F envmap_direct_contribution)
+{
     // Clamping direct lighting
     light_direct_contribution = clamp_light_contribution(light_direct_contribution, render_data.render_settings.direct_contribution_clamp, ray_payload.bounce == 0);
     envmap_direct_contribution = clamp_light_contribution(envmap_direct_contribution, render_data.render_settings.envmap_contribution_clamp, ray_payload.bounce == 0);
@@ -363,4 +403,16 @@ HIPRT_HOST_DEVICE void estimate_direct_lighting(HIPRTRenderData& render_data, Ra
 #endif
 }
 
+HIPRT_HOST_DEVICE void estimate_direct_lighting(HIPRTRenderData& render_data, RayPayload& ray_payload, HitInfo& closest_hit_info, 
+    float3 view_direction,
+    int x, int y,
+    MISBSDFRayReuse& mis_reuse, Xorshift32Generator& random_number_generator)
+{
+    ColorRGB32F light_direct_contribution;
+    ColorRGB32F envmap_direct_contribution;
+
+    sample_direct_lighting(render_data, ray_payload, closest_hit_info, view_direction, x, y, mis_reuse, random_number_generator, light_direct_contribution, envmap_direct_contribution);
+    accumulate_direct_lighting(render_data, ray_payload, light_direct_contribution, envmap_direct_contribution);
+}
+
 #endif
@@ -6,9 +6,11 @@
 #ifndef DEVICE_MIS_RAY_REUSE_H
 #define DEVICE_MIS_RAY_REUSE_H
 
+#include "Device/includes/Intersect.h"
 #include "Device/includes/RayPayload.h"
 #include "HostDeviceCommon/HitInfo.h"
 #include "HostDeviceCommon/RenderData.h"
+#include "HostDeviceCommon/Xorshift.h"
 
 struct MISBSDFRayReuse
 {
@@ -18,6 +20,7 @@ struct MISBSDFRayReuse
 	{
 #if ReuseBSDFMISRay
 		this->prim_index = shadow_light_ray.hit_prim_index;
+		this->instance_id = shadow_light_ray.hit_instance_id;
 		this->material_index = shadow_light_ray.hit_material_index;
 			
 		this->interpolated_texcoords = shadow_light_ray.hit_interpolated_texcoords;
@@ -71,6 +74,7 @@ struct MISBSDFRayReuse
 
 #if ReuseBSDFMISRay
 	int prim_index = -1;
+	int instance_id = -1;
 	int material_index = -1;
 
 	float2 interpolated_texcoords;
@@ -88,6 +92,25 @@ struct MISBSDFRayReuse
 #endif
 };
 
+/**
+ * The BSDF sample of the light sampling that is reused as the direction of the next bounce
+ * must come from the BSDF dimensions of the low discrepancy sequence of the bounce, the same
+ * dimensions that sample_path_next_bounce() would have used if it had sampled the BSDF itself.
+ *
+ * 'reused' is whether the BSDF sample about to be drawn is the one that stays in the MISBSDFRayReuse
+ * structure (the last one filled). The other BSDF samples use white noise, the same BSDF dimensions
+ * would give them the same direction as the reused sample
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void begin_mis_bsdf_sample_dimensions(Xorshift32Generator& random_number_generator, int bounce, bool reused)
+{
+#if ReuseBSDFMISRay == KERNEL_OPTION_TRUE
+	if (reused)
+		random_number_generator.begin_dimensions(SamplerDimension::bounce_dimension(bounce, SamplerDimension::BSDF), SamplerDimension::BSDF_COUNT);
+	else
+#endif
+		random_number_generator.end_dimensions();
+}
+
 /**
  * Updates the 'hit_info' and 'ray_payload' structures from a 'mis_reuse' structure
  */
@@ -107,6 +130,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE bool reuse_mis_ray(const HIPRTRenderData& render_
 		closest_hit_info.shading_normal = mis_reuse.shading_normal;
 		closest_hit_info.inter_point = mis_reuse.inter_point;
 		closest_hit_info.primitive_index = mis_reuse.prim_index;
+		closest_hit_info.instance_id = mis_reuse.instance_id;
 
 		ray_payload.material = mis_reuse.read_material(render_data);
 		fix_backfacing_normals(ray_payload, closest_hit_info, view_direction);
@@ -17,9 +17,9 @@
 #endif
 
 template <typename T>
-HIPRT_HOST_DEVICE HIPRT_INLINE T get_material_property(const HIPRTRenderData& render_data, bool is_srgb, const float2& texcoords, int texture_index);
-HIPRT_HOST_DEVICE HIPRT_INLINE float2 get_metallic_roughness(const HIPRTRenderData& render_data, const float2& texcoords, int metallic_texture_index, int roughness_texture_index, int metallic_roughness_texture_index);
-HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F get_base_color(const HIPRTRenderData& render_data, float& out_alpha, const float2& texcoords, int base_color_texture_index);
+HIPRT_HOST_DEVICE HIPRT_INLINE T get_material_property(const HIPRTRenderData& render_data, bool is_srgb, const float2& texcoords, int texture_index, float texcoords_footprint = 0.0f);
+HIPRT_HOST_DEVICE HIPRT_INLINE float2 get_metallic_roughness(const HIPRTRenderData& render_data, const float2& texcoords, int metallic_texture_index, int roughness_texture_index, int metallic_roughness_texture_index, float texcoords_footprint = 0.0f);
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F get_base_color(const HIPRTRenderData& render_data, float& out_alpha, const float2& texcoords, int base_color_texture_index, float texcoords_footprint = 0.0f);
 
 HIPRT_HOST_DEVICE HIPRT_INLINE float get_hit_base_color_alpha(const HIPRTRenderData& render_data, unsigned short int base_color_texture_index, hiprtHit hit)
 {
@@ -49,7 +49,11 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float get_hit_base_color_alpha(const HIPRTRenderD
     return get_hit_base_color_alpha(render_data, base_color_texture_index, hit);
 }
 
-HIPRT_HOST_DEVICE HIPRT_INLINE DeviceUnpackedEffectiveMaterial get_intersection_material(const HIPRTRenderData& render_data, int material_index, float2 texcoords)
+/**
+ * 'texcoords_footprint' is the width of the ray cone in texture space at the
+ * intersection and selects the mip level of the textures. See RayCone
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE DeviceUnpackedEffectiveMaterial get_intersection_material(const HIPRTRenderData& render_data, int material_index, float2 texcoords, float texcoords_footprint = 0.0f)
 {
     DeviceUnpackedTexturedMaterial material = render_data.buffers.materials_buffer.read_partial_material(material_index).unpack();
 
@@ -59,11 +63,11 @@ HIPRT_HOST_DEVICE HIPRT_INLINE DeviceUnpackedEffectiveMaterial get_intersection_
     else
     {
         if (material.base_color_texture_index != MaterialUtils::NO_TEXTURE)
-            material.base_color = get_base_color(render_data, trash_alpha, texcoords, material.base_color_texture_index);
+            material.base_color = get_base_color(render_data, trash_alpha, texcoords, material.base_color_texture_index, texcoords_footprint);
     }
 
     // Reading some parameters from the textures
-    float2 roughness_metallic = get_metallic_roughness(render_data, texcoords, material.metallic_texture_index, material.roughness_texture_index, material.roughness_metallic_texture_index);
+    float2 roughness_metallic = get_metallic_roughness(render_data, texcoords, material.metallic_texture_index, material.roughness_texture_index, material.roughness_metallic_texture_index, texcoords_footprint);
     if (material.roughness_metallic_texture_index != MaterialUtils::NO_TEXTURE)
     {
         material.roughness = roughness_metallic.x;
@@ -82,29 +86,29 @@ HIPRT_HOST_DEVICE HIPRT_INLINE DeviceUnpackedEffectiveMaterial get_intersection_
         roughness_metallic.x = material.roughness;
     }
 
-    float anisotropy = get_material_property<float>(render_data, false, texcoords, material.anisotropic_texture_index);
+    float anisotropy = get_material_property<float>(render_data, false, texcoords, material.anisotropic_texture_index, texcoords_footprint);
     if (material.anisotropic_texture_index != MaterialUtils::NO_TEXTURE)
         material.anisotropy = anisotropy;
     
-    float specular = get_material_property<float>(render_data, false, texcoords, material.specular_texture_index);
+    float specular = get_material_property<float>(render_data, false, texcoords, material.specular_texture_index, texcoords_footprint);
     if (material.specular_texture_index != MaterialUtils::NO_TEXTURE)
         material.specular = specular;
 
-    float coat = get_material_property<float>(render_data, false, texcoords, material.coat_texture_index);
+    float coat = get_material_property<float>(render_data, false, texcoords, material.coat_texture_index, texcoords_footprint);
     if (material.coat_texture_index != MaterialUtils::NO_TEXTURE)
         material.coat = coat;
     else
         coat = material.coat;
 
-    float sheen = get_material_property<float>(render_data, false, texcoords, material.sheen_texture_index);
+    float sheen = get_material_property<float>(render_data, false, texcoords, material.sheen_texture_index, texcoords_footprint);
     if (material.sheen_texture_index != MaterialUtils::NO_TEXTURE)
         material.sheen = sheen;
 
-    float specular_transmission = get_material_property<float>(render_data, false, texcoords, material.specular_transmission_texture_index);
+    float specular_transmission = get_material_property<float>(render_data, false, texcoords, material.specular_transmission_texture_index, texcoords_footprint);
     if (material.specular_transmission_texture_index != MaterialUtils::NO_TEXTURE)
         material.specular_transmission = specular_transmission;
 
-    ColorRGB32F emission = get_material_property<ColorRGB32F>(render_data, false, texcoords, material.emission_texture_index);
+    ColorRGB32F emission = get_material_property<ColorRGB32F>(render_data, false, texcoords, material.emission_texture_index, texcoords_footprint);
     if (material.emission_texture_index == MaterialUtils::NO_TEXTURE || material.emission_texture_index == MaterialUtils::CONSTANT_EMISSIVE_TEXTURE)
         emission = material.emission;
 
@@ -143,13 +147,13 @@ HIPRT_HOST_DEVICE HIPRT_INLINE DeviceUnpackedEffectiveMaterial get_intersection_
 /**
  * The float2 returned is (roughness, metallic)
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE float2 get_metallic_roughness(const HIPRTRenderData& render_data, const float2& texcoords, int metallic_texture_index, int roughness_texture_index, int metallic_roughness_texture_index)
+HIPRT_HOST_DEVICE HIPRT_INLINE float2 get_metallic_roughness(const HIPRTRenderData& render_data, const float2& texcoords, int metallic_texture_index, int roughness_texture_index, int metallic_roughness_texture_index, float texcoords_footprint)
 {
     float2 out;
 
     if (metallic_roughness_texture_index != MaterialUtils::NO_TEXTURE)
     {
-        ColorRGB32F rgb = sample_texture_rgb_8bits(render_data.buffers.material_textures, metallic_roughness_texture_index, false, texcoords);
+        ColorRGB32F rgb = sample_texture_rgb_8bits(render_data.buffers.material_textures, metallic_roughness_texture_index, false, texcoords, true, texcoords_footprint);
 
         // Not converting to linear here because material properties (roughness and metallic) here are assumed to be linear already
         out.x = rgb.g;
@@ -157,17 +161,17 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float2 get_metallic_roughness(const HIPRTRenderDa
     }
     else
     {
-        out.x = get_material_property<float>(render_data, false, texcoords, roughness_texture_index);
-        out.y = get_material_property<float>(render_data, false, texcoords, metallic_texture_index);
+        out.x = get_material_property<float>(render_data, false, texcoords, roughness_texture_index, texcoords_footprint);
+        out.y = get_material_property<float>(render_data, false, texcoords, metallic_texture_index, texcoords_footprint);
     }
 
     return out;
 }
 
-HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F get_base_color(const HIPRTRenderData& render_data, float& out_alpha, const float2& texcoords, int base_color_texture_index)
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F get_base_color(const HIPRTRenderData& render_data, float& out_alpha, const float2& texcoords, int base_color_texture_index, float texcoords_footprint)
 {
     out_alpha = 1.0f;
-    ColorRGBA32F rgba = get_material_property<ColorRGBA32F>(render_data, true, texcoords, base_color_texture_index);
+    ColorRGBA32F rgba = get_material_property<ColorRGBA32F>(render_data, true, texcoords, base_color_texture_index, texcoords_footprint);
     if (base_color_texture_index != MaterialUtils::NO_TEXTURE)
     {
         ColorRGB32F base_color = ColorRGB32F(rgba.r, rgba.g, rgba.b);
@@ -201,12 +205,12 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float read_data<float>(const ColorRGBA32F& rgba)
 }
 
 template <typename T>
-HIPRT_HOST_DEVICE HIPRT_INLINE T get_material_property(const HIPRTRenderData& render_data, bool is_srgb, const float2& texcoords, int texture_index)
+HIPRT_HOST_DEVICE HIPRT_INLINE T get_material_property(const HIPRTRenderData& render_data, bool is_srgb, const float2& texcoords, int texture_index, float texcoords_footprint)
 {
     if (texture_index == MaterialUtils::NO_TEXTURE || texture_index == MaterialUtils::CONSTANT_EMISSIVE_TEXTURE)
         return T();
 
-    ColorRGBA32F rgba = sample_texture_rgba(render_data.buffers.material_textures, texture_index, is_srgb, texcoords);
+    ColorRGBA32F rgba = sample_texture_rgba(render_data.buffers.material_textures, texture_index, is_srgb, texcoords, true, texcoords_footprint);
     return read_data<T>(rgba);
 }
 
@@ -6,6 +6,7 @@
 #ifndef DEVICE_INCLUDES_NEE_PLUS_PLUS
 #define DEVICE_INCLUDES_NEE_PLUS_PLUS
 
+#include "Device/includes/Hash.h"
 #include "HostDeviceCommon/Math.h"
 
 /**
@@ -38,12 +39,26 @@ struct NEEPlusPlusContext
 /**
  * Structure that contains the data for the implementation of NEE++.
  * 
+ * The visibility between two voxels is stored in a hash table keyed on the pair of voxels
+ * instead of a dense voxel-to-voxel matrix: only the pairs of voxels that are actually queried
+ * during the rendering use memory and the size of the table doesn't depend on the resolution
+ * of the grid.
+ * 
+ * The table is split in buckets of HASH_TABLE_BUCKET_SIZE entries. A voxel pair can only
+ * be stored in the bucket given by the hash of its key. If that bucket is full, the least recently used
+ * entry of the bucket is evicted if it hasn't been used for 'eviction_age' epochs. An epoch ends every
+ * time the accumulation buffers are copied to the visibility map.
+ * 
  * Reference:
  * [1] [Next Event Estimation++: Visibility Mapping for Efficient Light Transport Simulation]
  */
 struct NEEPlusPlusDevice
 {
 	static constexpr int NEE_PLUS_PLUS_DEFAULT_GRID_SIZE = 16;
+	static constexpr unsigned int NEE_PLUS_PLUS_DEFAULT_HASH_TABLE_BUCKET_COUNT = 1 << 17;
+	static constexpr unsigned int HASH_TABLE_BUCKET_SIZE = 8;
+	// Value of the key of the entries of the hash table that are not used
+	static constexpr unsigned long long int HASH_TABLE_EMPTY_KEY = 0;
 
 	// If true, the next camera rays kernel call will reset the visibility map
 	bool reset_visibility_map = false;
@@ -69,7 +84,7 @@ struct NEEPlusPlusDevice
 		ACCUMULATION_BUFFER_COUNT = 3,
 	};
 
-	// Linear buffer that is a packing of 4 buffers:
+	// Linear buffer that is a packing of 4 buffers, one unsigned int per entry of the hash table:
 	// 
 	// - 1 buffer that stores the number of rays that were
 	//		computed as non-occluded from voxel to voxel in the scene.
@@ -78,17 +93,10 @@ struct NEEPlusPlusDevice
 	//		and 7 of these rays were found to be unoccluded, then the corresponding
 	//		entry in the map will contain the value 7
 	//
-	//		Because the visibility map is symmetrical, this is a linear buffer that contains
-	//		only half of the visibility matrix
-	//
-	//		For the indexing logic, (0, 0) is in the top left corner of the matrix
-	//
 	// - 1 buffer that is the same the same as the previous one but stores how many rays
 	//		in total were traced in total from one voxel to another, not just the unoccluded ones. 
 	//		In the example from above, this would contain the value 16.
 	//
-	//		For the indexing logic, (0, 0) is in the top left corner of the matrix
-	//
 	// - 2 buffers used for accumulation during the rendering process
 	//		These two buffers are used for accumulation of the visibility information during the rendering
 	//		For example, if we trace a shadow ray between voxel A and voxel B and that this shadow ray is
@@ -107,11 +115,36 @@ struct NEEPlusPlusDevice
 	//
 	// Each one these 4 buffers are of type unsigned chars, packed into 1 unsigned ints.
 	// 
-	// The data is stored such that the first unsigned int contains the 4 buffers at index 0 of the matrix
-	// The second unsigned int contains the 4 buffers at index 1
+	// The data is stored such that the first unsigned int contains the 4 buffers of the entry 0 of the hash table
+	// The second unsigned int contains the 4 buffers of the entry 1
 	// ...
 	AtomicType<unsigned int>* packed_buffers = nullptr;
 
+	// Voxel pair stored in each entry of the hash table, see 'get_voxel_pair_key()'.
+	// HASH_TABLE_EMPTY_KEY for the entries that are not used yet
+	AtomicType<unsigned long long int>* hash_keys = nullptr;
+	// Last epoch during which each entry of the hash table was used. Used for the eviction
+	AtomicType<unsigned int>* entry_epochs = nullptr;
+
+	// Indices of the entries of the hash table that were used during the current epoch.
+	// Only these entries have their accumulation buffers copied to the visibility map at the end of the epoch.
+	//
+	// There are two lists of 'get_hash_table_entry_count()' indices each: the list of the current epoch is
+	// the list 'current_epoch & 1'. The finalize accumulation pass reads the list of the epoch that is ending
+	// and clears the other one for the next epoch so that the CPU never has to read the number of touched entries back
+	AtomicType<unsigned int>* touched_entries = nullptr;
+	// Number of indices in each of the two lists of 'touched_entries'
+	AtomicType<unsigned int>* touched_entry_counts = nullptr;
+
+	// Number of buckets of the hash table. Must be a power of 2
+	unsigned int hash_table_bucket_count = NEE_PLUS_PLUS_DEFAULT_HASH_TABLE_BUCKET_COUNT;
+	// Incremented every time the accumulation buffers are copied to the visibility map.
+	// Starts at 1 because an epoch of 0 in 'entry_epochs' means that the entry was never used
+	unsigned int current_epoch = 1;
+	// How many epochs an entry of the hash table must not have been used for
+	// before it can be replaced by another voxel pair
+	unsigned int eviction_age = 4;
+
 	// TODO deallocate accumulation buffers if not updating the vis map anymore
 
 	// If a voxel-to-voxel unocclusion probability is higher than that, the voxel will be considered unoccluded
@@ -128,19 +161,20 @@ struct NEEPlusPlusDevice
 	AtomicType<unsigned int>* total_shadow_ray_queries = nullptr;
 	AtomicType<unsigned int>* shadow_rays_actually_traced = nullptr;
 
-	HIPRT_HOST_DEVICE void accumulate_visibility(bool visible, int matrix_index)
+	HIPRT_HOST_DEVICE void accumulate_visibility(bool visible, int entry_index)
 	{
-		if (matrix_index == -1)
-			// One of the two points was outside the scene, cannot cache this
+		if (entry_index == -1)
+			// One of the two points was outside the scene or there
+			// was no room in the hash table, cannot cache this
 			return;
 
-		if (read_buffer<BufferNames::ACCUMULATION_BUFFER_COUNT>(matrix_index) > 220)
+		if (read_buffer<BufferNames::ACCUMULATION_BUFFER_COUNT>(entry_index) > 220)
 			// We're at the limit of unsigned chars, cannot accumulate anymore
 			return;
 
 		if (visible)
-			increment_buffer<BufferNames::ACCUMULATION_BUFFER>(matrix_index, 1);
-		increment_buffer<BufferNames::ACCUMULATION_BUFFER_COUNT>(matrix_index, 1);
+			increment_buffer<BufferNames::ACCUMULATION_BUFFER>(entry_index, 1);
+		increment_buffer<BufferNames::ACCUMULATION_BUFFER_COUNT>(entry_index, 1);
 	}
 
 	/**
@@ -148,30 +182,34 @@ struct NEEPlusPlusDevice
 	 */
 	HIPRT_HOST_DEVICE void accumulate_visibility(const NEEPlusPlusContext& context, bool visible)
 	{
-		return accumulate_visibility(visible, get_visibility_map_index(context));
+		return accumulate_visibility(visible, find_hash_table_entry(get_voxel_pair_key(context), /* insert */ true));
 	}
 
 	/**
 	 * Returns the estimated probability that a ray between the two given world points 
 	 * is going to be unoccluded (i.e. the two points are mutually visible)
 	 * 
-	 * Returns the index in the visibility matrix of the voxel-to-voxel correspondance of the
+	 * Returns the index in the hash table of the voxel-to-voxel correspondance of the
 	 * two given points. This value can then be passed as argument to 'accumulate_visibility'
-	 * to save a little bit of computations (otherwise, 'accumulate_visibility' would have recomputed
-	 * that value on its own even though the world points given may be the same and thus, the matrix
-	 * index is the same)
+	 * to save a little bit of computations (otherwise, 'accumulate_visibility' would have looked
+	 * up the hash table again even though the world points given may be the same and thus, the
+	 * entry is the same)
+	 * 
+	 * If the visibility map is being updated, the voxel pair is inserted in the hash table if it
+	 * wasn't there already
 	 */
-	HIPRT_HOST_DEVICE float estimate_visibility_probability(const NEEPlusPlusContext& context, int& out_matrix_index) const
+	HIPRT_HOST_DEVICE float estimate_visibility_probability(const NEEPlusPlusContext& context, int& out_entry_index) const
 	{
-		out_matrix_index = get_visibility_map_index(context);
-		if (out_matrix_index == -1)
-			// One of the two points was outside the scene, cannot read the cache for this
+		out_entry_index = find_hash_table_entry(get_voxel_pair_key(context), /* insert */ update_visibility_map);
+		if (out_entry_index == -1)
+			// One of the two points was outside the scene or the voxel pair isn't
+			// in the hash table, cannot read the cache for this
 			// 
 	 		// Returning 1.0f indicating that the two points are not occluded such that the caller
 			// tests for a shadow ray
 			return 1.0f;
 
-		unsigned char map_count = read_buffer<BufferNames::VISIBILITY_MAP_COUNT>(out_matrix_index);
+		unsigned char map_count = read_buffer<BufferNames::VISIBILITY_MAP_COUNT>(out_entry_index);
 		if (map_count == 0)
 			// No information for these two points
 			// 
@@ -180,7 +218,7 @@ struct NEEPlusPlusDevice
 			return 1.0f;
 		else
 		{
-			float unoccluded_proba = read_buffer<BufferNames::VISIBILITY_MAP>(out_matrix_index) / static_cast<float>(map_count);
+			float unoccluded_proba = read_buffer<BufferNames::VISIBILITY_MAP>(out_entry_index) / static_cast<float>(map_count);
 			if (unoccluded_proba >= confidence_threshold)
 				return 1.0f;
 			else
@@ -194,28 +232,57 @@ struct NEEPlusPlusDevice
 	 */
 	HIPRT_HOST_DEVICE float estimate_visibility_probability(const NEEPlusPlusContext& context) const
 	{
-		int trash_matrix_index;
-		return estimate_visibility_probability(context, trash_matrix_index);
+		int trash_entry_index;
+		return estimate_visibility_probability(context, trash_entry_index);
 	}
 
-	HIPRT_HOST_DEVICE unsigned int get_visibility_matrix_element_count() const
+	HIPRT_HOST_DEVICE unsigned int get_hash_table_entry_count() const
 	{
-		unsigned int grid_elements_count = grid_dimensions.x * grid_dimensions.y * grid_dimensions.z;
-		unsigned half_matrix_size = grid_elements_count * (grid_elements_count + 1) / 2.0f;
+		return hash_table_bucket_count * HASH_TABLE_BUCKET_SIZE;
+	}
 
-		return half_matrix_size;
+	/**
+	 * Returns the list of 'touched_entries' that is filled during the current epoch
+	 */
+	HIPRT_HOST_DEVICE unsigned int get_current_touched_entries_list() const
+	{
+		return current_epoch & 1;
+	}
+
+	/**
+	 * Copies the accumulation buffers of the given touched entry of the current epoch
+	 * to the visibility map (all in the packed buffers)
+	 */
+	HIPRT_HOST_DEVICE void copy_accumulation_buffers_of_touched_entry(unsigned int touched_entry_index)
+	{
+		unsigned int touched_list = get_current_touched_entries_list();
+		if (touched_entry_index >= touched_entry_counts[touched_list])
+			return;
+
+		copy_accumulation_buffers(touched_entries[touched_list * get_hash_table_entry_count() + touched_entry_index]);
+	}
+
+	/**
+	 * Empties the list of touched entries of the next epoch.
+	 * 
+	 * This must be called when finalizing the accumulation of the current epoch,
+	 * before 'current_epoch' is incremented
+	 */
+	HIPRT_HOST_DEVICE void clear_next_epoch_touched_entries()
+	{
+		touched_entry_counts[1 - get_current_touched_entries_list()] = 0;
 	}
 
 	/**
 	 * Copies the accumulation buffers to the visibility map (all in the packed buffers)
 	 */
-	HIPRT_HOST_DEVICE void copy_accumulation_buffers(unsigned int matrix_index)
+	HIPRT_HOST_DEVICE void copy_accumulation_buffers(unsigned int entry_index)
 	{
-		unsigned char accumulation_buffer = read_buffer<BufferNames::ACCUMULATION_BUFFER>(matrix_index);
-		unsigned char accumulation_buffer_count = read_buffer<BufferNames::ACCUMULATION_BUFFER_COUNT>(matrix_index);
+		unsigned char accumulation_buffer = read_buffer<BufferNames::ACCUMULATION_BUFFER>(entry_index);
+		unsigned char accumulation_buffer_count = read_buffer<BufferNames::ACCUMULATION_BUFFER_COUNT>(entry_index);
 
-		set_buffer<BufferNames::VISIBILITY_MAP>(matrix_index, accumulation_buffer);
-		set_buffer<BufferNames::VISIBILITY_MAP_COUNT>(matrix_index, accumulation_buffer_count);
+		set_buffer<BufferNames::VISIBILITY_MAP>(entry_index, accumulation_buffer);
+		set_buffer<BufferNames::VISIBILITY_MAP_COUNT>(entry_index, accumulation_buffer_count);
 		return;
 	}
 
@@ -223,23 +290,23 @@ struct NEEPlusPlusDevice
 	// TODO see if capping at 255 / 65535 is enough
 private:
 	/**
-	 * Returns the value packed in the buffer at the given visibility matrix index and with the given
+	 * Returns the value packed in the buffer at the given hash table entry index and with the given
 	 * buffer name from the BufferNames enum
 	 */
 	template <unsigned int bufferName>
-	HIPRT_HOST_DEVICE unsigned char read_buffer(int matrix_index) const
+	HIPRT_HOST_DEVICE unsigned char read_buffer(int entry_index) const
 	{
-		return (packed_buffers[matrix_index] >> (bufferName * 8)) & 0xFF;
+		return (packed_buffers[entry_index] >> (bufferName * 8)) & 0xFF;
 	}
 
 	/**
-	 * Increments the packed value in the packed buffer 'bufferName' at the given matrix index
+	 * Increments the packed value in the packed buffer 'bufferName' at the given entry index
 	 * There is no protection against overflows in this function
 	 */
 	template <unsigned int bufferName>
-	HIPRT_HOST_DEVICE void increment_buffer(int matrix_index, unsigned char value)
+	HIPRT_HOST_DEVICE void increment_buffer(int entry_index, unsigned char value)
 	{
-		hippt::atomic_fetch_add(&packed_buffers[matrix_index], static_cast<unsigned int>(value) << (8 * bufferName));
+		hippt::atomic_fetch_add(&packed_buffers[entry_index], static_cast<unsigned int>(value) << (8 * bufferName));
 	}
 
 	/**
@@ -249,13 +316,113 @@ private:
 	 * This function is non-atomic
 	 */
 	template <unsigned int bufferName>
-	HIPRT_HOST_DEVICE void set_buffer(int matrix_index, unsigned char value)
+	HIPRT_HOST_DEVICE void set_buffer(int entry_index, unsigned char value)
 	{
 		// Clearing
-		packed_buffers[matrix_index] &= ~(0x000000FF << (bufferName * 8));
+		packed_buffers[entry_index] &= ~(0x000000FF << (bufferName * 8));
 
 		// Setting
-		packed_buffers[matrix_index] |= value << (bufferName * 8);
+		packed_buffers[entry_index] |= value << (bufferName * 8);
+	}
+
+	/**
+	 * Marks the given entry of the hash table as used during the current epoch and adds it
+	 * to the list of the entries whose accumulation buffers will be copied at the end of the epoch
+	 */
+	HIPRT_HOST_DEVICE void touch_entry(unsigned int entry_index) const
+	{
+		unsigned int entry_epoch = entry_epochs[entry_index];
+		if (entry_epoch == current_epoch)
+			// Already touched during this epoch
+			return;
+
+		if (hippt::atomic_compare_exchange(&entry_epochs[entry_index], entry_epoch, current_epoch) != entry_epoch)
+			// Another thread touched the entry at the same time, it's going to add it to the list
+			return;
+
+		// An entry can only be added once per epoch to the list so the list cannot overflow
+		unsigned int touched_list = get_current_touched_entries_list();
+		unsigned int touched_entry_index = hippt::atomic_fetch_add(&touched_entry_counts[touched_list], 1u);
+		touched_entries[touched_list * get_hash_table_entry_count() + touched_entry_index] = entry_index;
+	}
+
+	/**
+	 * Returns the index of the entry of the hash table that stores the given voxel pair key or -1 if
+	 * the key isn't in the hash table.
+	 * 
+	 * If 'insert' is true, the key is inserted in the hash table if it isn't there yet, evicting the
+	 * least recently used entry of its bucket if the bucket is full. -1 is still returned if all the
+	 * entries of the bucket are younger than 'eviction_age'. The entry returned is then touched
+	 * for the current epoch.
+	 */
+	HIPRT_HOST_DEVICE int find_hash_table_entry(unsigned long long int key, bool insert) const
+	{
+		if (key == HASH_TABLE_EMPTY_KEY)
+			return -1;
+
+		unsigned int key_low = static_cast<unsigned int>(key);
+		unsigned int key_high = static_cast<unsigned int>(key >> 32);
+		unsigned int bucket_index = wang_hash(key_low ^ wang_hash(key_high)) & (hash_table_bucket_count - 1);
+		unsigned int bucket_start = bucket_index * HASH_TABLE_BUCKET_SIZE;
+
+		for (unsigned int i = 0; i < HASH_TABLE_BUCKET_SIZE; i++)
+		{
+			unsigned int entry_index = bucket_start + i;
+
+			unsigned long long int entry_key = hash_keys[entry_index];
+			if (entry_key == HASH_TABLE_EMPTY_KEY)
+			{
+				// The entries of a bucket are filled in order and are never emptied
+				// so the key isn't in the bucket
+				if (!insert)
+					return -1;
+
+				entry_key = hippt::atomic_compare_exchange(&hash_keys[entry_index], HASH_TABLE_EMPTY_KEY, key);
+				if (entry_key == HASH_TABLE_EMPTY_KEY)
+					// We claimed the empty entry
+					entry_key = key;
+			}
+
+			if (entry_key == key)
+			{
+				if (insert)
+					touch_entry(entry_index);
+
+				return entry_index;
+			}
+		}
+
+		if (!insert)
+			return -1;
+
+		// The bucket is full, looking for the least recently used entry
+		unsigned int oldest_entry_index = bucket_start;
+		unsigned int oldest_entry_epoch = entry_epochs[bucket_start];
+		for (unsigned int i = 1; i < HASH_TABLE_BUCKET_SIZE; i++)
+		{
+			unsigned int entry_epoch = entry_epochs[bucket_start + i];
+			if (entry_epoch < oldest_entry_epoch)
+			{
+				oldest_entry_epoch = entry_epoch;
+				oldest_entry_index = bucket_start + i;
+			}
+		}
+
+		if (current_epoch - oldest_entry_epoch < eviction_age)
+			// Everything in the bucket is still in use, not caching that voxel pair
+			return -1;
+
+		unsigned long long int evicted_key = hash_keys[oldest_entry_index];
+		if (hippt::atomic_compare_exchange(&hash_keys[oldest_entry_index], evicted_key, key) != evicted_key)
+			// Another thread evicted that entry at the same time
+			return -1;
+
+		// The visibility of the evicted voxel pair doesn't apply to the new one.
+		// Other threads may still be accumulating into that entry so the reset must be atomic
+		hippt::atomic_exchange(&packed_buffers[oldest_entry_index], 0u);
+		touch_entry(oldest_entry_index);
+
+		return oldest_entry_index;
 	}
 
 	/**
@@ -326,7 +493,13 @@ private:
 		return get_voxel_3D_index(exit_point);
 	}
 
-	HIPRT_HOST_DEVICE int get_visibility_map_index(const NEEPlusPlusContext& context) const
+	/**
+	 * Returns the key of the hash table for the pair of voxels of the two points of the given context.
+	 * 
+	 * The visibility is symmetrical so the key is the same for (A, B) and (B, A).
+	 * HASH_TABLE_EMPTY_KEY is returned if one of the two points is outside the grid.
+	 */
+	HIPRT_HOST_DEVICE unsigned long long int get_voxel_pair_key(const NEEPlusPlusContext& context) const
 	{
 		int3 shaded_point_voxel_3D_index = get_voxel_3D_index(context.shaded_point);
 		int3 second_pos_voxel_3D_index;
@@ -338,43 +511,16 @@ private:
 
 		if (shaded_point_voxel_3D_index.x == -1 || second_pos_voxel_3D_index.x == -1)
 			// One of the two points is outside the scene, cannot cache this
-			return -1;
+			return HASH_TABLE_EMPTY_KEY;
 
-		int first_voxel_index = shaded_point_voxel_3D_index.x + shaded_point_voxel_3D_index.y * grid_dimensions.x + shaded_point_voxel_3D_index.z * grid_dimensions.y * grid_dimensions.x;
-		int second_voxel_index = second_pos_voxel_3D_index.x + second_pos_voxel_3D_index.y * grid_dimensions.x + second_pos_voxel_3D_index.z * grid_dimensions.y * grid_dimensions.x;
+		unsigned int first_voxel_index = shaded_point_voxel_3D_index.x + shaded_point_voxel_3D_index.y * grid_dimensions.x + shaded_point_voxel_3D_index.z * grid_dimensions.y * grid_dimensions.x;
+		unsigned int second_voxel_index = second_pos_voxel_3D_index.x + second_pos_voxel_3D_index.y * grid_dimensions.x + second_pos_voxel_3D_index.z * grid_dimensions.y * grid_dimensions.x;
 
-		// Just renaming
-		int column = first_voxel_index;
-		int row = second_voxel_index;
-
-		if (column > row)
-		{
-			// We're past the diagonal, flipping to bring it back in the lower left triangle of the matrix
-			int temp = column;
-			column = row;
-			row = temp;
-		}
-
-		// Because the visibility matrix is symmetrical, we're only using half of it to save half the VRAM
-		// Thus we need to find the index in the lower half of the visiblity matrix
-		//
-		// We know that our matrix is N*N
-		// Because we only consider the lower half (lower triangle) of the matrix:
-		// 
-		// - The first row contains  1 element   : (0, 0)
-		// - The second row contains 2 elements : (1, 0), (1, 1)
-		// - The third row contains  3 elements  : (2, 0), (2, 1), (2, 2)
-		//
-		// The starting index of a row R is then given by the sum of the number of elements
-		// of all rows coming before row N. So for row 3, that would be 1 + 2 + 3 = 6
-		//
-		// In general, this gives us starting_index = N * (N + 1) / 2
-	
-		int starting_index = row * (row + 1) / 2.0f;
-		// We then just need to index our item inside that row
-		int final_index = starting_index + column;
+		unsigned int min_voxel_index = hippt::min(first_voxel_index, second_voxel_index);
+		unsigned int max_voxel_index = hippt::max(first_voxel_index, second_voxel_index);
 
-		return final_index;
+		// + 1 so that the pair (0, 0) doesn't collide with the empty key
+		return ((static_cast<unsigned long long int>(max_voxel_index) << 32) | min_voxel_index) + 1;
 	}
 };
 
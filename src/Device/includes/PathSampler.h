@@ -0,0 +1,45 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_PATH_SAMPLER_H
+#define DEVICE_PATH_SAMPLER_H
+
+#include "Device/includes/Hash.h"
+
+#include "HostDeviceCommon/KernelOptions/KernelOptions.h"
+#include "HostDeviceCommon/LowDiscrepancy.h"
+#include "HostDeviceCommon/RenderData.h"
+#include "HostDeviceCommon/Xorshift.h"
+
+/**
+ * Sets up the low discrepancy sequence of the given random number generator for
+ * the current sample of the pixel (x, y) when PathSamplerType isn't PST_WHITE_NOISE.
+ *
+ * The camera ray pass and the path tracing pass both call this function with the
+ * same pixel so that they draw from the same sample of the sequence, each in their
+ * own dimensions (see SamplerDimension)
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void init_path_sampler(Xorshift32Generator& random_number_generator, const HIPRTRenderData& render_data, uint32_t x, uint32_t y)
+{
+#if PathSamplerType != PST_WHITE_NOISE
+    unsigned int sample_index = render_data.render_settings.freeze_random ? 0 : render_data.render_settings.sample_number;
+
+#if PathSamplerType == PST_BLUE_NOISE_DITHERED
+    // Same sequence for all the pixels, decorrelated by the blue noise shift
+    unsigned int scramble_seed = 0x9E3779B9u;
+#else
+    unsigned int scramble_seed = wang_hash(x + y * render_data.render_settings.render_resolution.x + 1);
+#endif
+
+    if (!render_data.render_settings.accumulate && !render_data.render_settings.freeze_random)
+        // When not accumulating, the sample index doesn't increase from one frame to the other
+        // so we're scrambling differently every frame instead
+        scramble_seed = hash_combine(scramble_seed, render_data.random_seed);
+
+    random_number_generator.init_low_discrepancy(x, y, sample_index, scramble_seed);
+#endif
+}
+
+#endif
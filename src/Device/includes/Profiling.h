@@ -0,0 +1,23 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_PROFILING_H
+#define DEVICE_PROFILING_H
+
+/**
+ * CPU_PROFILER_HOT_FUNCTION_SCOPE(hot_function) times the enclosing scope with the
+ * CPUProfiler when the device code is compiled for the CPU renderer (see CPU_PROFILER_HOT_FUNCTIONS).
+ * CPU_PROFILER_COUNT_RAYS(ray_type, count) counts rays traced by type (see CPU_PROFILER_COUNTERS).
+ *
+ * These are no-ops on the GPU
+ */
+#ifndef __KERNELCC__
+#include "Renderer/CPUProfiler.h"
+#else
+#define CPU_PROFILER_HOT_FUNCTION_SCOPE(hot_function)
+#define CPU_PROFILER_COUNT_RAYS(ray_type, count)
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_RAY_CONE_H
+#define DEVICE_RAY_CONE_H
+
+#include "Device/includes/TriangleStructures.h"
+
+#include "HostDeviceCommon/Material/MaterialUnpacked.h"
+#include "HostDeviceCommon/Math.h"
+
+/**
+ * Ray cone used to select the level of detail of the textures fetched at the hits of a path.
+ *
+ * The cone starts at the camera with the spread angle of a pixel and its width grows with
+ * the distance traveled. The footprint of the cone on a triangle, in texture space, is
+ * then used to pick the mip level of the textures.
+ *
+ * Reference:
+ * [1] [Texture Level of Detail Strategies for Real-Time Ray Tracing, Akenine-Möller et al., 2019]
+ */
+struct RayCone
+{
+    // Width of the cone at the origin of the current ray
+    float width = 0.0f;
+    // Angle of the cone in radians
+    float spread_angle = 0.0f;
+
+    /**
+     * Width of the cone after 'distance' along the ray
+     */
+    HIPRT_HOST_DEVICE void propagate(float distance)
+    {
+        width += spread_angle * distance;
+    }
+
+    /**
+     * Widens the cone after a bounce on the given material.
+     *
+     * Rough or diffuse bounces scatter the path over a large solid angle and the textures
+     * seen after them are blurred by the integration anyways so the cone is widened accordingly.
+     * This is a heuristic: [1] only handles the perfectly specular case
+     */
+    HIPRT_HOST_DEVICE void bounce(const DeviceUnpackedEffectiveMaterial& material)
+    {
+        float alpha = material.roughness * material.roughness;
+        float specular_weight = hippt::min(1.0f, material.metallic + material.specular_transmission);
+
+        // Quarter of a hemisphere for the diffuse part, approximately the width of the GGX lobe for the specular part
+        spread_angle += hippt::lerp(M_PI / 4.0f, alpha, specular_weight);
+    }
+
+    /**
+     * Returns the width of the cone in texture space (UV units) at a hit on the given
+     * triangle. P0, P1 and P2 are the world space positions of the vertices of the triangle.
+     *
+     * 0.0f is returned if the triangle has degenerate texture coordinates or if the cone has no width
+     * (in which case the finest mip level of the textures is used)
+     */
+    HIPRT_HOST_DEVICE float get_texcoords_footprint(const float3& P0, const float3& P1, const float3& P2, const TriangleTexcoords& triangle_texcoords, const float3& geometric_normal, const float3& ray_direction) const
+    {
+        if (width <= 0.0f)
+            return 0.0f;
+
+        float world_area = hippt::length(hippt::cross(P1 - P0, P2 - P0));
+
+        float2 T1T0 = triangle_texcoords.y - triangle_texcoords.x;
+        float2 T2T0 = triangle_texcoords.z - triangle_texcoords.x;
+        float texcoords_area = hippt::abs(T1T0.x * T2T0.y - T1T0.y * T2T0.x);
+
+        if (world_area <= 0.0f || texcoords_area <= 0.0f)
+            return 0.0f;
+
+        // The footprint stretches at grazing angles
+        float cos_theta = hippt::max(1.0e-4f, hippt::abs(hippt::dot(geometric_normal, ray_direction)));
+
+        return width * sqrtf(texcoords_area / world_area) / cos_theta;
+    }
+};
+
+#endif
@@ -6,6 +6,7 @@
 #ifndef DEVICE_RAY_PAYLOAD_H
 #define DEVICE_RAY_PAYLOAD_H
 
+#include "Device/includes/RayCone.h"
 #include "Device/includes/RayVolumeState.h"
 
 #include "HostDeviceCommon/Color.h"
@@ -37,6 +38,9 @@ struct RayPayload
 
 	RayVolumeState volume_state;
 
+	// For the level of detail of the texture fetches
+	RayCone ray_cone;
+
 	HIPRT_HOST_DEVICE bool is_inside_volume() const
 	{
 		// TODO this is not general and calling this function in
@@ -48,7 +48,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F evaluate_ReSTIR_DI_reservoir(const HI
         shadow_ray.origin = closest_hit_info.inter_point;
         shadow_ray.direction = shadow_ray_direction;
 
-        in_shadow = evaluate_shadow_ray(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, /* bounce. Always 0 for ReSTIR */0, random_number_generator);
+        in_shadow = evaluate_or_defer_shadow_ray(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, closest_hit_info.instance_id, /* bounce. Always 0 for ReSTIR */0, random_number_generator);
     }
 
     if (!in_shadow)
@@ -88,7 +88,8 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F evaluate_ReSTIR_DI_reservoir(const HI
         }
     }
 
-    return final_color;
+    // Envmap samples included, ReSTIR DI samples are part of the emissive lights direct lighting, see sample_one_light()
+    return defer_shadow_ray_contribution(render_data, final_color, WAVEFRONT_SHADOW_RAY_LIGHT);
 }
 
 HIPRT_HOST_DEVICE HIPRT_INLINE void validate_reservoir(const HIPRTRenderData& render_data, ReSTIRDIReservoir& reservoir)
@@ -14,6 +14,7 @@ struct ReSTIRDISurface
 	DeviceUnpackedEffectiveMaterial material;
 	RayVolumeState ray_volume_state;
 	int last_hit_primitive_index;
+	int last_hit_instance_id;
 
 	float3 view_direction = { 0.0f, 0.0f, 0.0f};
 	float3 shading_normal = { 0.0f, 0.0f, 0.0f};
@@ -27,6 +28,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ReSTIRDISurface get_pixel_surface(const HIPRTRend
 
 	surface.material = render_data.g_buffer.materials[pixel_index].unpack();
 	surface.last_hit_primitive_index = render_data.g_buffer.first_hit_prim_index[pixel_index];
+	surface.last_hit_instance_id = render_data.g_buffer.first_hit_instance_id[pixel_index];
 	surface.ray_volume_state.initialize();
 	surface.ray_volume_state.reconstruct_first_hit(
 		surface.material,
@@ -54,6 +56,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ReSTIRDISurface get_pixel_surface_previous_frame(
 
 	surface.material = render_data.g_buffer_prev_frame.materials[pixel_index].unpack();
 	surface.last_hit_primitive_index = render_data.g_buffer_prev_frame.first_hit_prim_index[pixel_index];
+	surface.last_hit_instance_id = render_data.g_buffer_prev_frame.first_hit_instance_id[pixel_index];
 	surface.ray_volume_state.initialize();
 	surface.ray_volume_state.reconstruct_first_hit(
 		surface.material,
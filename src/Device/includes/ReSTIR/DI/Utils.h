@@ -126,7 +126,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float ReSTIR_DI_evaluate_target_function<KERNEL_O
 	shadow_ray.origin = surface.shading_point;
 	shadow_ray.direction = sample_direction;
 
-	bool visible = !evaluate_shadow_ray(render_data, shadow_ray, distance_to_light, surface.last_hit_primitive_index, /* bounce. Always 0 for ReSTIR DI*/ 0, random_number_generator);
+	bool visible = !evaluate_shadow_ray(render_data, shadow_ray, distance_to_light, surface.last_hit_primitive_index, surface.last_hit_instance_id, /* bounce. Always 0 for ReSTIR DI*/ 0, random_number_generator);
 
 	target_function *= visible;
 
@@ -136,8 +136,9 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float ReSTIR_DI_evaluate_target_function<KERNEL_O
 /**
  * 'last_primitive_hit_index' is the index of the triangle we're currently sitting 
  * on and that we're shooting a ray from. This is used to avoid self intersections.
+ * 'last_primitive_hit_instance_id' is the instance of the mesh of that triangle.
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE void ReSTIR_DI_visibility_reuse(const HIPRTRenderData& render_data, ReSTIRDIReservoir& reservoir, float3 shading_point, int last_primitive_hit_index, Xorshift32Generator& random_number_generator)
+HIPRT_HOST_DEVICE HIPRT_INLINE void ReSTIR_DI_visibility_reuse(const HIPRTRenderData& render_data, ReSTIRDIReservoir& reservoir, float3 shading_point, int last_primitive_hit_index, int last_primitive_hit_instance_id, Xorshift32Generator& random_number_generator)
 {
 	if (reservoir.UCW <= 0.0f)
 		return;
@@ -162,7 +163,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void ReSTIR_DI_visibility_reuse(const HIPRTRender
 	shadow_ray.origin = shading_point;
 	shadow_ray.direction = sample_direction;
 
-	bool visible = !evaluate_shadow_ray(render_data, shadow_ray, distance_to_light, last_primitive_hit_index, /* bounce. Always 0 for ReSTIR DI*/ 0, random_number_generator);
+	bool visible = !evaluate_shadow_ray(render_data, shadow_ray, distance_to_light, last_primitive_hit_index, last_primitive_hit_instance_id, /* bounce. Always 0 for ReSTIR DI*/ 0, random_number_generator);
 	if (!visible)
 		// Setting to -1 here so that we know when debugging that this is because of visibility reuse
 		reservoir.UCW = -1.0f;
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_SCENE_HIT_H
+#define DEVICE_SCENE_HIT_H
+
+#include "Device/includes/TriangleStructures.h"
+#include "HostDeviceCommon/RenderData.h"
+
+/**
+ * The BVH of the GPU is a TLAS over one BLAS per mesh (see HIPRTSceneBVH). The hits of its
+ * traversals have the index of the triangle in the mesh of the instance that was hit
+ * and a normal in the object space of that instance.
+ *
+ * The CPU BVHs already return the index of the triangle in the buffers of the whole
+ * scene and a world space normal
+ */
+
+/**
+ * Returns the index of the triangle of the hit in the triangle buffers of the whole scene
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE int get_scene_primitive_index(const HIPRTRenderData& render_data, const hiprtHit& hit)
+{
+#ifdef __KERNELCC__
+    return hit.primID + render_data.buffers.instance_primitive_offsets[hit.instanceID];
+#else
+    return hit.primID;
+#endif
+}
+
+/**
+ * Returns the hit with the index of the triangle in the buffers of the
+ * whole scene and with a world space (non normalized) geometric normal
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE hiprtHit get_scene_hit(const HIPRTRenderData& render_data, const hiprtHit& hit)
+{
+#ifdef __KERNELCC__
+    if (!hit.hasHit())
+        return hit;
+
+    hiprtHit scene_hit = hit;
+    scene_hit.primID = get_scene_primitive_index(render_data, hit);
+
+    // Normals are transformed by the inverse transpose of the object to world transform
+    hiprtFrameMatrix world_to_object = hiprtGetWorldToObjectFrameMatrix(render_data.GPU_BVH, hit.instanceID);
+    scene_hit.normal.x = world_to_object.matrix[0][0] * hit.normal.x + world_to_object.matrix[1][0] * hit.normal.y + world_to_object.matrix[2][0] * hit.normal.z;
+    scene_hit.normal.y = world_to_object.matrix[0][1] * hit.normal.x + world_to_object.matrix[1][1] * hit.normal.y + world_to_object.matrix[2][1] * hit.normal.z;
+    scene_hit.normal.z = world_to_object.matrix[0][2] * hit.normal.x + world_to_object.matrix[1][2] * hit.normal.y + world_to_object.matrix[2][2] * hit.normal.z;
+
+    return scene_hit;
+#else
+    return hit;
+#endif
+}
+
+/**
+ * Brings a point of the mesh of the given instance (read from the vertex buffers of the scene) to world space.
+ * 'instance_id' is the 'instanceID' of the hit on that mesh
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 instance_to_world_point(const HIPRTRenderData& render_data, int instance_id, const float3& point)
+{
+    if (render_data.buffers.instance_object_to_world == nullptr)
+        // No instancing, the vertices are already in world space
+        return point;
+
+    return matrix_X_point(render_data.buffers.instance_object_to_world[instance_id], point);
+}
+
+/**
+ * Same as instance_to_world_point() for a normal. The returned normal isn't normalized
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 instance_to_world_normal(const HIPRTRenderData& render_data, int instance_id, const float3& normal)
+{
+    if (render_data.buffers.instance_normal_to_world == nullptr)
+        return normal;
+
+    return affine_matrix_X_vec(render_data.buffers.instance_normal_to_world[instance_id], normal);
+}
+
+/**
+ * Reads the world space positions of the vertices of a triangle of the given instance
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void load_triangle_world_positions(const HIPRTRenderData& render_data, int instance_id, const TriangleIndices& triangle_vertex_indices, float3& out_P0, float3& out_P1, float3& out_P2)
+{
+    out_P0 = instance_to_world_point(render_data, instance_id, render_data.buffers.vertices_positions[triangle_vertex_indices.x]);
+    out_P1 = instance_to_world_point(render_data, instance_id, render_data.buffers.vertices_positions[triangle_vertex_indices.y]);
+    out_P2 = instance_to_world_point(render_data, instance_id, render_data.buffers.vertices_positions[triangle_vertex_indices.z]);
+}
+
+#endif
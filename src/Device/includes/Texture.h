@@ -34,9 +34,13 @@ using Image32Bit = int;
  * and the texture must use a wrapping address mode for the V coordinate.
  * 
  * If 'flip_uv_y' is true, then the UV coordinates are just used as is
+ * 
+ * 'texcoords_footprint' is the width in UV space of the area to filter (see RayCone).
+ * It selects the mip level of the texture on the CPU. 0.0f samples the finest level.
+ * Textures aren't mipmapped on the GPU and the footprint is ignored there
  */ 
 template <typename ImageType = Image8Bit>
-HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGBA32F sample_texture_rgba(const void* texture_buffer, int texture_index, bool is_srgb, float2 uv, bool flip_uv_y = true)
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGBA32F sample_texture_rgba(const void* texture_buffer, int texture_index, bool is_srgb, float2 uv, bool flip_uv_y = true, float texcoords_footprint = 0.0f)
 {
     ColorRGBA32F rgba;
 
@@ -51,7 +55,10 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGBA32F sample_texture_rgba(const void* text
 #else
     const ImageType& texture = reinterpret_cast<const ImageType*>(texture_buffer)[texture_index];
 
-    rgba = texture.sample_rgba32f(uv);
+    if constexpr (std::is_same_v<ImageType, Image8Bit>)
+        rgba = texture.sample_rgba32f(uv, texcoords_footprint);
+    else
+        rgba = texture.sample_rgba32f(uv);
 #endif
 
     // sRGB to linear conversion
@@ -73,9 +80,9 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGBA32F sample_texture_rgba(const void* text
  * It should be set to false if your texture addressing mode isn't 'warping'
  * or when you know what you're doing and why you need to have it to false
  */
-HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_texture_rgb_8bits(const void* texture_buffer, int texture_index, bool is_srgb, float2 uv, bool flip_uv_y = true)
+HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_texture_rgb_8bits(const void* texture_buffer, int texture_index, bool is_srgb, float2 uv, bool flip_uv_y = true, float texcoords_footprint = 0.0f)
 {
-    ColorRGBA32F rgba = sample_texture_rgba<Image8Bit>(texture_buffer, texture_index, is_srgb, uv, flip_uv_y);
+    ColorRGBA32F rgba = sample_texture_rgba<Image8Bit>(texture_buffer, texture_index, is_srgb, uv, flip_uv_y, texcoords_footprint);
 
     return ColorRGB32F(rgba.r, rgba.g, rgba.b);
 }
@@ -209,6 +216,33 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ColorRGB32F sample_environment_map_texture(const
     return world_settings.envmap[index].unpack() * world_settings.envmap_intensity;
 }
 
+/**
+ * Overload for the octahedral-packed vertex normals of GeometryCompression.
+ * The normals are unpacked before being interpolated
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 uv_interpolate(int vertex_A_index, int vertex_B_index, int vertex_C_index, Octahedral24BitNormal* data, float2 uv)
+{
+    return data[vertex_B_index].unpack() * uv.x + data[vertex_C_index].unpack() * uv.y + data[vertex_A_index].unpack() * (1.0f - uv.x - uv.y);
+}
+
+/**
+ * Overload for the quantized texcoords of GeometryCompression
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float2 uv_interpolate(int vertex_A_index, int vertex_B_index, int vertex_C_index, const QuantizedTexcoordsBuffer& data, float2 uv)
+{
+    return data.unpack(vertex_B_index) * uv.x + data.unpack(vertex_C_index) * uv.y + data.unpack(vertex_A_index) * (1.0f - uv.x - uv.y);
+}
+
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 uv_interpolate(TriangleIndices triangle_vertex_indices, Octahedral24BitNormal* data, float2 uv)
+{
+    return uv_interpolate(triangle_vertex_indices.x, triangle_vertex_indices.y, triangle_vertex_indices.z, data, uv);
+}
+
+HIPRT_HOST_DEVICE HIPRT_INLINE float2 uv_interpolate(int* vertex_indices, int primitive_index, const QuantizedTexcoordsBuffer& data, float2 uv)
+{
+    return uv_interpolate(vertex_indices[primitive_index * 3 + 0], vertex_indices[primitive_index * 3 + 1], vertex_indices[primitive_index * 3 + 2], data, uv);
+}
+
 /**
  * Given the indices of the vertices of a triangle, interpolates the vertices data found
  * in the 'data' buffer passed as argument as the given UV coordinates
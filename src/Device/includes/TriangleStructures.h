@@ -7,6 +7,7 @@
 #define DEVICE_TRIANGLE_STRUCTURES_H
 
 #include "HostDeviceCommon/Math.h"
+#include "HostDeviceCommon/Packing.h"
 
 /**
  * Structure that contains the vertex index (in the vertex buffer) of the 3 vertices of a triangle
@@ -50,4 +51,14 @@ HIPRT_HOST_DEVICE HIPRT_INLINE TriangleTexcoords load_triangle_texcoords(float2*
     };
 }
 
+HIPRT_HOST_DEVICE HIPRT_INLINE TriangleTexcoords load_triangle_texcoords(const QuantizedTexcoordsBuffer& quantized_texcoords_buffer, TriangleIndices triangle_vertex_indices)
+{
+    return TriangleTexcoords
+    {
+        quantized_texcoords_buffer.unpack(triangle_vertex_indices.x),
+        quantized_texcoords_buffer.unpack(triangle_vertex_indices.y),
+        quantized_texcoords_buffer.unpack(triangle_vertex_indices.z)
+    };
+}
+
 #endif
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_WAVEFRONT_PATH_STATE_H
+#define DEVICE_WAVEFRONT_PATH_STATE_H
+
+#include "Device/includes/MISBSDFRayReuse.h"
+#include "Device/includes/RayPayload.h"
+
+#include "HostDeviceCommon/Color.h"
+#include "HostDeviceCommon/HitInfo.h"
+#include "HostDeviceCommon/Xorshift.h"
+
+#include <hiprt/hiprt_types.h> // for hiprtRay
+
+/**
+ * Everything a path needs to carry from one stage of the wavefront
+ * path tracer to the next. This is all the state that lives in registers
+ * in the megakernel path tracer
+ */
+struct WavefrontPathState
+{
+	hiprtRay ray;
+	RayPayload ray_payload;
+	HitInfo closest_hit_info;
+
+	// BSDF MIS ray that can be reused for the next bounce. See 'FullPathTracer'
+	MISBSDFRayReuse mis_reuse;
+
+	Xorshift32Generator random_number_generator;
+
+	// Direct lighting of the current hit of the path computed by the direct lighting stage,
+	// without the contribution of the shadow rays deferred to the shadow ray stage
+	ColorRGB32F light_direct_contribution;
+	ColorRGB32F envmap_direct_contribution;
+	// Range of the shadow rays of the path in the shadow ray queue
+	int shadow_rays_offset;
+	int shadow_ray_count;
+
+	uint32_t pixel_index;
+};
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_WAVEFRONT_QUEUES_H
+#define DEVICE_WAVEFRONT_QUEUES_H
+
+#include "Device/includes/Wavefront/WavefrontShadowRays.h"
+#include "HostDeviceCommon/Math.h"
+
+// Defined in "Device/includes/Wavefront/WavefrontPathState.h".
+// Only forward declared here because the path state needs the full
+// render data to be defined
+struct WavefrontPathState;
+
+/**
+ * Buffers used by the wavefront path tracer.
+ *
+ * Instead of tracing a whole path per thread like the megakernel 'FullPathTracer',
+ * the wavefront path tracer stores the state of the paths in memory and runs
+ * one stage (extend, direct lighting, shade, ...) at a time for all the paths.
+ *
+ * The queues contain the indices (in 'paths') of the paths that need to be
+ * processed by the next stage. Only the paths still alive are in the queues
+ * so the stages don't waste time on terminated paths
+ */
+struct WavefrontQueues
+{
+	// One path state per pixel, indexed by the pixel index
+	WavefrontPathState* paths = nullptr;
+
+	// Paths whose next ray needs to be traced by the extend stage
+	int* ray_queue = nullptr;
+	AtomicType<int>* ray_queue_size = nullptr;
+
+	// Paths that found an intersection and need to be shaded
+	int* hit_queue = nullptr;
+	AtomicType<int>* hit_queue_size = nullptr;
+
+	// Shadow rays of the direct lighting stage that need to be traced by the shadow ray stage.
+	// The shadow rays of a path are contiguous in the queue, see WavefrontPathState::shadow_rays_offset
+	WavefrontShadowRay* shadow_ray_queue = nullptr;
+	AtomicType<int>* shadow_ray_queue_size = nullptr;
+	// Size of the 'shadow_ray_queue' buffer. The shadow rays of a path that don't fit
+	// in the queue anymore are traced right away by the direct lighting stage
+	int shadow_ray_queue_capacity = 0;
+
+	// Only set in the per-thread copy of the render data of the direct lighting stage,
+	// while the lights of a path are being sampled. See WavefrontDeferredShadowRays
+	WavefrontDeferredShadowRays* deferred_shadow_rays = nullptr;
+};
+
+#endif
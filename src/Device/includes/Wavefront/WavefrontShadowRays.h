@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef DEVICE_WAVEFRONT_SHADOW_RAYS_H
+#define DEVICE_WAVEFRONT_SHADOW_RAYS_H
+
+#include "HostDeviceCommon/Color.h"
+#include "HostDeviceCommon/Math.h"
+
+#include <hiprt/hiprt_types.h> // for hiprtRay
+
+enum WavefrontShadowRayTarget : unsigned char
+{
+	// The contribution of the shadow ray goes into the emissive lights direct lighting
+	WAVEFRONT_SHADOW_RAY_LIGHT = 0,
+	// The contribution of the shadow ray goes into the envmap direct lighting
+	WAVEFRONT_SHADOW_RAY_ENVMAP = 1
+};
+
+/**
+ * A shadow ray of the next event estimation of a path whose visibility is
+ * computed by the shadow ray stage of the wavefront path tracer instead of
+ * being traced in the middle of the light sampling
+ */
+struct WavefrontShadowRay
+{
+	hiprtRay ray;
+	float t_max;
+
+	int last_hit_primitive_index;
+	int last_hit_instance_id;
+
+	// Contribution of the light sample if the shadow ray is unoccluded
+	ColorRGB32F contribution;
+
+	// Seed of the random number generator used for the alpha testing of the shadow ray.
+	// Each shadow ray has its own so that the shadow rays of a path can be traced by different threads
+	unsigned int random_seed;
+
+	// Index in the NEE++ visibility map of the voxel pair of the shadow ray
+	// whose visibility must be accumulated. -1 if no accumulation is needed
+	int nee_plus_plus_voxel_matrix_index;
+
+	// Index of the path (and pixel) that traced this shadow ray
+	int path_index;
+
+	unsigned char bounce;
+	WavefrontShadowRayTarget target;
+	// Output of the shadow ray stage
+	unsigned char occluded;
+};
+
+/**
+ * The shadow rays deferred by the direct lighting stage for a single path.
+ *
+ * The direct lighting stage of the wavefront path tracer points 'render_data.buffers.wavefront.deferred_shadow_rays'
+ * to one of these, on its stack, while it samples the lights of a path. The shadow rays that the light sampling
+ * functions would have traced are stored here instead (see evaluate_or_defer_shadow_ray()) and pushed in the
+ * shadow ray buffer of the wavefront path tracer at the end of the stage
+ */
+struct WavefrontDeferredShadowRays
+{
+	// Shadow rays past that count are traced right away by evaluate_or_defer_shadow_ray()
+	static constexpr int MAX_SHADOW_RAYS = 8;
+
+	WavefrontShadowRay shadow_rays[MAX_SHADOW_RAYS];
+	int count = 0;
+
+	// Whether the last shadow ray of 'shadow_rays' is still waiting
+	// for its contribution, see defer_shadow_ray_contribution()
+	bool contribution_pending = false;
+};
+
+#endif
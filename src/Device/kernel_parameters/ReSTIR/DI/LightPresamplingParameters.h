@@ -6,6 +6,7 @@
 #ifndef LIGHT_PRESAMPLING_KERNEL_PARAMETERS_H
 #define LIGHT_PRESAMPLING_KERNEL_PARAMETERS_H
 
+#include "Device/includes/LightBVH/LightBVHDevice.h"
 #include "Device/includes/ReSTIR/DI/PresampledLight.h"
 #include "Device/includes/ReSTIR/DI/Reservoir.h"
 
@@ -30,6 +31,11 @@ struct LightPresamplingParameters
 	 */
 	int emissive_triangles_count = 0;
 	int* emissive_triangles_indices = nullptr;
+	// For picking the emissive triangles proportionally to their power
+	// when DirectLightSamplingBaseStrategy isn't LSS_BASE_UNIFORM
+	float* emissive_power_alias_table_probas = nullptr;
+	int* emissive_power_alias_table_alias = nullptr;
+	LightBVHDevice light_bvh;
 	int* triangles_indices = nullptr;
 	float3* vertices_positions = nullptr;
 	int* material_indices = nullptr;
@@ -10,6 +10,7 @@
 #include "Device/includes/FixIntellisense.h"
 #include "Device/includes/Hash.h"
 #include "Device/includes/Intersect.h"
+#include "Device/includes/PathSampler.h"
 #include "Device/includes/RayPayload.h"
 
 #include "HostDeviceCommon/HIPRTCamera.h"
@@ -58,22 +59,22 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void rescale_samples(HIPRTRenderData& render_data
         // GMoN is enabled, we're also going to scale the GMoN samples for the same reason
         for (int set_index = 0; set_index < GMoNMSetsCount; set_index++)
             // TODO this is slow
-            render_data.buffers.gmon_estimator.sets[set_index * res.x * res.y + pixel_index] = render_data.buffers.gmon_estimator.sets[set_index * res.x * res.y + pixel_index] / float_sample_number * (render_data.render_settings.sample_number + 1);
+            render_data.buffers.gmon_estimator.scale_set(set_index, pixel_index, res, (render_data.render_settings.sample_number + 1) / float_sample_number);
     }
 }
 
-#ifdef __KERNELCC__
-GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) CameraRays(HIPRTRenderData render_data, int2 res)
-#else
-GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int2 res, int x, int y)
-#endif
+/**
+ * Everything that the camera ray pass does for a pixel before tracing the camera ray:
+ * low resolution rendering, G-buffer history, adaptive sampling and ray generation.
+ *
+ * Returns false if no camera ray needs to be traced for that pixel. Otherwise,
+ * the ray to trace is returned in 'out_ray' and 'out_pixel_index' / 'out_random_number_generator'
+ * are to be used for tracing the ray and storing its hit with camera_ray_store_hit()
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool camera_ray_generate(HIPRTRenderData& render_data, int2 res, uint32_t x, uint32_t y, uint32_t& out_pixel_index, hiprtRay& out_ray, Xorshift32Generator& out_random_number_generator)
 {
-#ifdef __KERNELCC__
-    const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
-    const uint32_t y = blockIdx.y * blockDim.y + threadIdx.y;
-#endif
     if (x >= res.x || y >= res.y)
-        return;
+        return false;
 
     uint32_t pixel_index = x + y * res.x;
 
@@ -89,7 +90,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int
         {
             render_data.aux_buffers.pixel_active[pixel_index] = false;
 
-            return;
+            return false;
         }
 
         pixel_index /= res_scaling;
@@ -102,6 +103,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int
         render_data.g_buffer_prev_frame.materials[pixel_index] = render_data.g_buffer.materials[pixel_index];
         render_data.g_buffer_prev_frame.primary_hit_position[pixel_index] = render_data.g_buffer.primary_hit_position[pixel_index];
         render_data.g_buffer_prev_frame.first_hit_prim_index[pixel_index] = render_data.g_buffer.first_hit_prim_index[pixel_index];
+        render_data.g_buffer_prev_frame.first_hit_instance_id[pixel_index] = render_data.g_buffer.first_hit_instance_id[pixel_index];
     }
 
     if (render_data.render_settings.sample_number == 0 || render_data.render_settings.need_to_reset)
@@ -129,7 +131,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int
 
             render_data.aux_buffers.pixel_active[pixel_index] = false;
 
-            return;
+            return false;
         }
         else
             render_data.aux_buffers.pixel_sample_count[pixel_index]++;
@@ -141,6 +143,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int
     else
         seed = wang_hash((pixel_index + 1) * (render_data.render_settings.sample_number + 1) * render_data.random_seed);
     Xorshift32Generator random_number_generator(seed);
+    init_path_sampler(random_number_generator, render_data, x, y);
 
     // Direction to the center of the pixel
     float x_ray_point_direction = (x + 0.5f);
@@ -148,17 +151,23 @@ GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int
     if (render_data.current_camera.do_jittering)
     {
         // Jitter randomly around the center
+        random_number_generator.begin_dimensions(SamplerDimension::PIXEL, 2);
         x_ray_point_direction += random_number_generator() - 0.5f;
         y_ray_point_direction += random_number_generator() - 0.5f;
     }
 
-    hiprtRay ray = render_data.current_camera.get_camera_ray(x_ray_point_direction, y_ray_point_direction, res);
-    RayPayload ray_payload;
-    ray_payload.volume_state.initialize();
+    out_ray = render_data.current_camera.get_camera_ray(x_ray_point_direction, y_ray_point_direction, res);
+    out_pixel_index = pixel_index;
+    out_random_number_generator = random_number_generator;
 
-    HitInfo closest_hit_info;
-    bool intersection_found = trace_ray(render_data, ray, ray_payload, closest_hit_info, /* camera ray = no previous primitive hit */ -1, /* bounce. Always 0 for camera rays*/ 0, random_number_generator);
+    return true;
+}
 
+/**
+ * Writes the result of the camera ray of the pixel in the G-buffer
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void camera_ray_store_hit(HIPRTRenderData& render_data, uint32_t pixel_index, const hiprtRay& ray, const RayPayload& ray_payload, HitInfo& closest_hit_info, bool intersection_found)
+{
     if (intersection_found)
     {
         if (ray_payload.material.is_emissive() && hippt::dot(-ray.direction, closest_hit_info.geometric_normal) < 0)
@@ -190,6 +199,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int
         render_data.g_buffer.primary_hit_position[pixel_index] = ray.origin + ray.direction;
         
     render_data.g_buffer.first_hit_prim_index[pixel_index] = intersection_found ? closest_hit_info.primitive_index : -1;
+    render_data.g_buffer.first_hit_instance_id[pixel_index] = intersection_found ? closest_hit_info.instance_id : -1;
 
     render_data.aux_buffers.pixel_active[pixel_index] = true;
 
@@ -202,4 +212,91 @@ GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int
     }
 }
 
+
+#ifdef __KERNELCC__
+GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) CameraRays(HIPRTRenderData render_data, int2 res)
+#else
+GLOBAL_KERNEL_SIGNATURE(void) inline CameraRays(HIPRTRenderData render_data, int2 res, int x, int y)
+#endif
+{
+#ifdef __KERNELCC__
+    const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
+    const uint32_t y = blockIdx.y * blockDim.y + threadIdx.y;
+#endif
+
+    uint32_t pixel_index;
+    hiprtRay ray;
+    Xorshift32Generator random_number_generator;
+    if (!camera_ray_generate(render_data, res, x, y, pixel_index, ray, random_number_generator))
+        return;
+
+    RayPayload ray_payload;
+    ray_payload.volume_state.initialize();
+    ray_payload.ray_cone.spread_angle = render_data.current_camera.get_pixel_spread_angle(res);
+
+    HitInfo closest_hit_info;
+    bool intersection_found = trace_ray(render_data, ray, ray_payload, closest_hit_info, /* camera ray = no previous primitive hit */ -1, -1, /* bounce. Always 0 for camera rays*/ 0, random_number_generator);
+
+    camera_ray_store_hit(render_data, pixel_index, ray, ray_payload, closest_hit_info, intersection_found);
+}
+
+#ifndef __KERNELCC__
+// Side in pixels of the square tiles of the CPU packet camera ray pass
+#define CAMERA_RAYS_PACKET_TILE_SIZE 8
+
+/**
+ * CPU only. Camera ray pass of a whole tile of CAMERA_RAYS_PACKET_TILE_SIZE x CAMERA_RAYS_PACKET_TILE_SIZE
+ * pixels starting at pixel (tile_x, tile_y).
+ *
+ * The camera rays of the tile are coherent so their first intersection
+ * is computed with a single packet traversal of the BVH
+ */
+inline void CameraRaysPacket(HIPRTRenderData render_data, int2 res, int tile_x, int tile_y)
+{
+    static_assert(CAMERA_RAYS_PACKET_TILE_SIZE * CAMERA_RAYS_PACKET_TILE_SIZE <= BVHConstants::PACKET_MAX_RAY_COUNT, "Camera ray tiles must fit in a single ray packet");
+
+    uint32_t pixel_indices[BVHConstants::PACKET_MAX_RAY_COUNT];
+    hiprtRay rays[BVHConstants::PACKET_MAX_RAY_COUNT];
+    Xorshift32Generator random_number_generators[BVHConstants::PACKET_MAX_RAY_COUNT];
+    Xorshift32Generator* random_number_generators_pointers[BVHConstants::PACKET_MAX_RAY_COUNT];
+    int last_hit_primitive_indices[BVHConstants::PACKET_MAX_RAY_COUNT];
+    int last_hit_instance_ids[BVHConstants::PACKET_MAX_RAY_COUNT];
+
+    // Only the pixels that need a camera ray (adaptive sampling, low resolution
+    // rendering, ...) are added to the packet: this is the active mask of the tile
+    int ray_count = 0;
+    for (int y = tile_y; y < tile_y + CAMERA_RAYS_PACKET_TILE_SIZE; y++)
+    {
+        for (int x = tile_x; x < tile_x + CAMERA_RAYS_PACKET_TILE_SIZE; x++)
+        {
+            if (!camera_ray_generate(render_data, res, x, y, pixel_indices[ray_count], rays[ray_count], random_number_generators[ray_count]))
+                continue;
+
+            random_number_generators_pointers[ray_count] = &random_number_generators[ray_count];
+            // Camera ray = no previous primitive hit
+            last_hit_primitive_indices[ray_count] = -1;
+            last_hit_instance_ids[ray_count] = -1;
+            ray_count++;
+        }
+    }
+
+    hiprtHit first_hits[BVHConstants::PACKET_MAX_RAY_COUNT];
+    intersect_scene_cpu_packet(render_data, rays, last_hit_primitive_indices, last_hit_instance_ids, random_number_generators_pointers, ray_count, first_hits);
+    CPU_PROFILER_COUNT_RAYS(CPU_PROFILER_PRIMARY_RAY, ray_count);
+
+    float pixel_spread_angle = render_data.current_camera.get_pixel_spread_angle(res);
+    for (int i = 0; i < ray_count; i++)
+    {
+        RayPayload ray_payload;
+        ray_payload.volume_state.initialize();
+        ray_payload.ray_cone.spread_angle = pixel_spread_angle;
+
+        HitInfo closest_hit_info;
+        bool intersection_found = trace_ray_from_first_hit(render_data, rays[i], first_hits[i], ray_payload, closest_hit_info, /* camera ray = no previous primitive hit */ -1, -1, /* bounce. Always 0 for camera rays*/ 0, random_number_generators[i]);
+
+        camera_ray_store_hit(render_data, pixel_indices[i], rays[i], ray_payload, closest_hit_info, intersection_found);
+    }
+}
+#endif
+
 #endif
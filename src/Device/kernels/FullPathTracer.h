@@ -12,6 +12,7 @@
 #include "Device/includes/Envmap.h"
 #include "Device/includes/Hash.h"
 #include "Device/includes/Material.h"
+#include "Device/includes/PathSampler.h"
 #include "Device/includes/RayPayload.h"
 #include "Device/includes/RussianRoulette.h"
 #include "Device/includes/Sampling.h"
@@ -117,7 +118,7 @@ HIPRT_HOST_DEVICE void store_denoiser_AOVs(HIPRTRenderData& render_data, uint32_
     }
 }
 
-HIPRT_HOST_DEVICE void accumulate_color(const HIPRTRenderData& render_data, const ColorRGB32F& ray_color, uint32_t pixel_index)
+HIPRT_HOST_DEVICE void accumulate_color(const HIPRTRenderData& render_data, const ColorRGB32F& ray_color, uint32_t pixel_index, Xorshift32Generator& random_number_generator)
 {
 #if ViewportColorOverriden == 0
     // Only outputting the ray color if no kernel option is going to output its own color
@@ -141,14 +142,203 @@ HIPRT_HOST_DEVICE void accumulate_color(const HIPRTRenderData& render_data, cons
     {
         // GMoN is in use, accumulating in the GMoN sets
 
-        unsigned int offset = render_data.render_settings.render_resolution.x * render_data.render_settings.render_resolution.y * render_data.buffers.gmon_estimator.next_set_to_accumulate + pixel_index;
+        render_data.buffers.gmon_estimator.accumulate_sample(ray_color, pixel_index, render_data.render_settings.render_resolution, render_data.render_settings.sample_number == 0, random_number_generator);
+        render_data.buffers.gmon_estimator.mark_tile_accumulated(pixel_index, render_data.render_settings.render_resolution, render_data.render_settings.sample_number + 1);
+    }
+#endif
+}
 
-        if (render_data.render_settings.sample_number == 0)
-            render_data.buffers.gmon_estimator.sets[offset] = ray_color;
-        else
-            render_data.buffers.gmon_estimator.sets[offset] += ray_color;
+/**
+ * Returns the number of bounces to use for the current frame
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE int get_path_tracing_bounce_count(const HIPRTRenderData& render_data)
+{
+    if (render_data.render_settings.do_render_low_resolution())
+        // Reducing the number of bounces to 3 if rendering at low resolution
+        // for better interactivity
+        return hippt::min(3, render_data.render_settings.nb_bounces);
+
+    return render_data.render_settings.nb_bounces;
+}
+
+HIPRT_HOST_DEVICE HIPRT_INLINE Xorshift32Generator get_path_tracing_random_generator(const HIPRTRenderData& render_data, uint32_t pixel_index)
+{
+    unsigned int seed;
+    if (render_data.render_settings.freeze_random)
+        seed = wang_hash(pixel_index + 1);
+    else
+        seed = wang_hash((pixel_index + 1) * (render_data.render_settings.sample_number + 1) * render_data.random_seed);
+
+    Xorshift32Generator random_number_generator(seed);
+    init_path_sampler(random_number_generator, render_data, pixel_index % render_data.render_settings.render_resolution.x, pixel_index / render_data.render_settings.render_resolution.x);
+
+    return random_number_generator;
+}
+
+/**
+ * Initializes the state of the path of the given pixel from
+ * the camera ray hit stored in the G-buffer by the camera ray pass.
+ * 
+ * Returns true if the camera ray hit the scene
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool initialize_path_from_g_buffer(const HIPRTRenderData& render_data, uint32_t pixel_index, 
+    hiprtRay& out_ray, RayPayload& out_ray_payload, HitInfo& out_closest_hit_info, Xorshift32Generator& random_number_generator)
+{
+    // Initializing the closest hit info the information from the camera ray pass
+    out_closest_hit_info.inter_point = render_data.g_buffer.primary_hit_position[pixel_index];
+    out_closest_hit_info.geometric_normal = hippt::normalize(render_data.g_buffer.geometric_normals[pixel_index].unpack());
+    out_closest_hit_info.shading_normal = hippt::normalize(render_data.g_buffer.shading_normals[pixel_index].unpack());
+    out_closest_hit_info.primitive_index = render_data.g_buffer.first_hit_prim_index[pixel_index];
+    out_closest_hit_info.instance_id = render_data.g_buffer.first_hit_instance_id[pixel_index];
+
+    // Initializing the ray with the information from the camera ray pass
+    out_ray.direction = hippt::normalize(-render_data.g_buffer.get_view_direction(render_data.current_camera.position, pixel_index));
+
+    out_ray_payload.volume_state.initialize();
+    out_ray_payload.next_ray_state = RayState::BOUNCE;
+    out_ray_payload.material = render_data.g_buffer.materials[pixel_index].unpack();
+
+    // Ray cone of the camera ray at its hit, the textures of the camera hit have
+    // already been fetched by the camera ray pass with that cone
+    out_ray_payload.ray_cone.spread_angle = render_data.current_camera.get_pixel_spread_angle(render_data.render_settings.render_resolution);
+    out_ray_payload.ray_cone.propagate(hippt::length(out_closest_hit_info.inter_point - render_data.current_camera.position));
+
+    // Because this is the camera hit (and assuming the camera isn't inside volumes for now),
+    // the ray volume state after the camera hit is just an empty interior stack but with
+    // the material index that we hit pushed onto the stack. That's it. Because it is that
+    // simple, we don't have the ray volume state in the GBuffer but rather we can
+    // reconstruct the ray volume state on the fly
+    out_ray_payload.volume_state.reconstruct_first_hit(
+        out_ray_payload.material,
+        render_data.buffers.material_indices,
+        out_closest_hit_info.primitive_index,
+        random_number_generator);
+
+    return out_closest_hit_info.primitive_index != -1;
+}
+
+/**
+ * Stores the denoiser AOVs of the first hit and makes the normals
+ * of the hit face the view direction for emissive geometry
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void prepare_path_hit(HIPRTRenderData& render_data, RayPayload& ray_payload, HitInfo& closest_hit_info, const hiprtRay& ray, uint32_t pixel_index)
+{
+    if (ray_payload.bounce == 0)
+        store_denoiser_AOVs(render_data, pixel_index, closest_hit_info.shading_normal, ray_payload.material.base_color);
+
+    // For the BRDF calculations, bounces, ... to be correct, we need the normal to be in the same hemisphere as
+    // the view direction. One thing that can go wrong is when we have an emissive triangle (typical area light)
+    // and a ray hits the back of the triangle. The normal will not be facing the view direction in this
+    // case and this will cause issues later in the BRDF.
+    // Because we want to allow backfacing emissive geometry (making the emissive geometry double sided
+    // and emitting light in both directions of the surface), we're negating the normal to make
+    // it face the view direction (but only for emissive geometry)
+    if (ray_payload.material.is_emissive() && hippt::dot(-ray.direction, closest_hit_info.geometric_normal) < 0)
+    {
+        closest_hit_info.geometric_normal = -closest_hit_info.geometric_normal;
+        closest_hit_info.shading_normal = -closest_hit_info.shading_normal;
+    }
+}
+
+/**
+ * Samples the BSDF at the current hit of the path to get the direction of the next bounce,
+ * updates the throughput of the path and sets 'ray' to the next ray to trace.
+ * 
+ * Returns false if the path is terminated (bad BSDF sample or russian roulette)
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE bool sample_path_next_bounce(const HIPRTRenderData& render_data, RayPayload& ray_payload, HitInfo& closest_hit_info, 
+    hiprtRay& ray, MISBSDFRayReuse& mis_reuse, Xorshift32Generator& random_number_generator)
+{
+    float bsdf_pdf;
+    float3 bounce_direction;
+    ColorRGB32F bsdf_color;
+
+    if (mis_reuse.has_ray())
+        bsdf_color = reuse_mis_bsdf_sample(bounce_direction, bsdf_pdf, ray_payload, mis_reuse);
+    else
+    {
+        random_number_generator.begin_dimensions(SamplerDimension::bounce_dimension(ray_payload.bounce, SamplerDimension::BSDF), SamplerDimension::BSDF_COUNT);
+        bsdf_color = bsdf_dispatcher_sample(render_data, ray_payload.material, ray_payload.volume_state, true, 
+                                            -ray.direction, closest_hit_info.shading_normal, closest_hit_info.geometric_normal, bounce_direction, 
+                                            bsdf_pdf, random_number_generator, ray_payload.bounce);
     }
+#if DoFirstBounceWarpDirectionReuse
+    warp_direction_reuse(render_data, closest_hit_info, ray_payload, -ray.direction, bounce_direction, bsdf_color, bsdf_pdf, ray_payload.bounce, random_number_generator);
+#endif
+
+    // Terminate ray if bad sampling
+    if (bsdf_pdf <= 0.0f)
+        return false;
+
+    ColorRGB32F throughput_attenuation = bsdf_color * hippt::abs(hippt::dot(bounce_direction, closest_hit_info.shading_normal)) / bsdf_pdf;
+    // Russian roulette
+    random_number_generator.begin_dimensions(SamplerDimension::bounce_dimension(ray_payload.bounce, SamplerDimension::RUSSIAN_ROULETTE), SamplerDimension::RUSSIAN_ROULETTE_COUNT);
+    if (!do_russian_roulette(render_data.render_settings, ray_payload.bounce, ray_payload.throughput, throughput_attenuation, random_number_generator))
+        return false;
+
+    // Dispersion ray throughput filter
+    ray_payload.throughput *= get_dispersion_ray_color(ray_payload.volume_state.sampled_wavelength, ray_payload.material.dispersion_scale);
+    ray_payload.throughput *= throughput_attenuation;
+    ray_payload.next_ray_state = RayState::BOUNCE;
+    ray_payload.ray_cone.bounce(ray_payload.material);
+
+    ray.origin = closest_hit_info.inter_point;
+    ray.direction = bounce_direction;
+
+    return true;
+}
+
+/**
+ * Adds the contribution of the skysphere / envmap to the path whose ray missed the scene
+ * and marks the path as terminated
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void accumulate_path_miss(HIPRTRenderData& render_data, RayPayload& ray_payload, const hiprtRay& ray, uint32_t pixel_index)
+{
+    int bounce = ray_payload.bounce;
+    ColorRGB32F skysphere_color;
+
+    if (render_data.world_settings.ambient_light_type == AmbientLightType::UNIFORM || render_data.bsdfs_data.white_furnace_mode)
+        skysphere_color = render_data.world_settings.uniform_light_color;
+    else if (render_data.world_settings.ambient_light_type == AmbientLightType::ENVMAP)
+    {
+#if EnvmapSamplingStrategy != ESS_NO_SAMPLING
+        // If we have sampling, only taking envmap into account on camera ray miss
+        if (bounce == 0)
+#endif
+        {
+            // We're only getting the skysphere radiance for the first rays because the
+            // syksphere is importance sampled.
+            skysphere_color = eval_envmap_no_pdf(render_data.world_settings, ray.direction);
+
+#if EnvmapSamplingStrategy == ESS_NO_SAMPLING
+            // If we don't have envmap sampling, we're only going to unscale on
+            // bounce 0 (which is when a ray misses directly --> background color).
+            // Otherwise, if not bounce 2, we do want to take the scaling into
+            // account so this if will fail and the envmap color will never be unscaled
+            if (!render_data.world_settings.envmap_scale_background_intensity && bounce == 0)
+#else
+            if (!render_data.world_settings.envmap_scale_background_intensity)
 #endif
+                // Un-scaling the envmap if the user doesn't want to scale the background
+                skysphere_color /= render_data.world_settings.envmap_intensity;
+        }
+    }
+
+    skysphere_color = clamp_light_contribution(skysphere_color, render_data.render_settings.envmap_contribution_clamp, /* clamp condition */ true);
+
+    ColorRGB32F indirect_lighting_contribution = skysphere_color * ray_payload.throughput;
+    // Only clamping with the indirect lighting clamp value if
+    // this is bounce > 0 (thanks to /* clamp condition */ bounce > 0)
+    ColorRGB32F clamped_indirect_lighting_contribution = clamp_light_contribution(
+        indirect_lighting_contribution, render_data.render_settings.indirect_contribution_clamp, 
+        /* clamp condition */ bounce > 0);
+
+    ray_payload.ray_color += clamped_indirect_lighting_contribution;
+    ray_payload.next_ray_state = RayState::MISSED;
+
+    if (bounce == 0)
+        // The camera ray missed so we don't have the normals but we have the base color
+        store_denoiser_AOVs(render_data, pixel_index, make_float3(0, 0, 0), skysphere_color);
 }
 
 __shared__ float3 shared_directions[1];
@@ -171,10 +361,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline FullPathTracer(HIPRTRenderData render_data,
     if (!render_data.aux_buffers.pixel_active[pixel_index])
         return;
 
-    if (render_data.render_settings.do_render_low_resolution())
-        // Reducing the number of bounces to 3 if rendering at low resolution
-        // for better interactivity
-        render_data.render_settings.nb_bounces = hippt::min(3, render_data.render_settings.nb_bounces);
+    render_data.render_settings.nb_bounces = get_path_tracing_bounce_count(render_data);
 
 #if ViewportColorOverriden == 1
     // If some kernel option is going to debug some color in the viewport,
@@ -182,40 +369,12 @@ GLOBAL_KERNEL_SIGNATURE(void) inline FullPathTracer(HIPRTRenderData render_data,
     render_data.buffers.accumulated_ray_colors[pixel_index] = ColorRGB32F();
 #endif
 
+    Xorshift32Generator random_number_generator = get_path_tracing_random_generator(render_data, pixel_index);
 
-    unsigned int seed;
-    if (render_data.render_settings.freeze_random)
-        seed = wang_hash(pixel_index + 1);
-    else
-        seed = wang_hash((pixel_index + 1) * (render_data.render_settings.sample_number + 1) * render_data.random_seed);
-    Xorshift32Generator random_number_generator(seed);
-
-    // Initializing the closest hit info the information from the camera ray pass
-    HitInfo closest_hit_info;
-    closest_hit_info.inter_point = render_data.g_buffer.primary_hit_position[pixel_index];
-    closest_hit_info.geometric_normal = hippt::normalize(render_data.g_buffer.geometric_normals[pixel_index].unpack());
-    closest_hit_info.shading_normal = hippt::normalize(render_data.g_buffer.shading_normals[pixel_index].unpack());
-    closest_hit_info.primitive_index = render_data.g_buffer.first_hit_prim_index[pixel_index];
-
-    // Initializing the ray with the information from the camera ray pass
     hiprtRay ray;
-    ray.direction = hippt::normalize(-render_data.g_buffer.get_view_direction(render_data.current_camera.position, pixel_index));
-
     RayPayload ray_payload;
-    ray_payload.volume_state.initialize();
-    ray_payload.next_ray_state = RayState::BOUNCE;
-    ray_payload.material = render_data.g_buffer.materials[pixel_index].unpack();
-
-    // Because this is the camera hit (and assuming the camera isn't inside volumes for now),
-    // the ray volume state after the camera hit is just an empty interior stack but with
-    // the material index that we hit pushed onto the stack. That's it. Because it is that
-    // simple, we don't have the ray volume state in the GBuffer but rather we can
-    // reconstruct the ray volume state on the fly
-    ray_payload.volume_state.reconstruct_first_hit(
-        ray_payload.material,
-        render_data.buffers.material_indices,
-        closest_hit_info.primitive_index,
-        random_number_generator);
+    HitInfo closest_hit_info;
+    bool intersection_found = initialize_path_from_g_buffer(render_data, pixel_index, ray, ray_payload, closest_hit_info, random_number_generator);
 
     // This structure is going to contain the information for reusing the
     // BSDF ray when doing NEE with MIS: as a matter of fact, when doing
@@ -227,7 +386,6 @@ GLOBAL_KERNEL_SIGNATURE(void) inline FullPathTracer(HIPRTRenderData render_data,
     MISBSDFRayReuse mis_reuse;
     // + 1 to nb_bounces here because we want "0" bounces to still act as one
     // hit and to return some color
-    bool intersection_found = closest_hit_info.primitive_index != -1;
     for (int& bounce = ray_payload.bounce; bounce < render_data.render_settings.nb_bounces + 1; bounce++)
     {
         if (ray_payload.next_ray_state != RayState::MISSED)
@@ -239,26 +397,12 @@ GLOBAL_KERNEL_SIGNATURE(void) inline FullPathTracer(HIPRTRenderData render_data,
                     intersection_found = reuse_mis_ray(render_data, closest_hit_info, ray_payload, -ray.direction, mis_reuse);
                 else
                     // Not tracing for the primary ray because this has already been done in the camera ray pass
-                    intersection_found = trace_ray(render_data, ray, ray_payload, closest_hit_info, closest_hit_info.primitive_index, bounce, random_number_generator);
+                    intersection_found = trace_ray(render_data, ray, ray_payload, closest_hit_info, closest_hit_info.primitive_index, closest_hit_info.instance_id, bounce, random_number_generator);
             }
 
             if (intersection_found)
             {
-                if (bounce == 0)
-                    store_denoiser_AOVs(render_data, pixel_index, closest_hit_info.shading_normal, ray_payload.material.base_color);
-
-                // For the BRDF calculations, bounces, ... to be correct, we need the normal to be in the same hemisphere as
-                // the view direction. One thing that can go wrong is when we have an emissive triangle (typical area light)
-                // and a ray hits the back of the triangle. The normal will not be facing the view direction in this
-                // case and this will cause issues later in the BRDF.
-                // Because we want to allow backfacing emissive geometry (making the emissive geometry double sided
-                // and emitting light in both directions of the surface), we're negating the normal to make
-                // it face the view direction (but only for emissive geometry)
-                if (ray_payload.material.is_emissive() && hippt::dot(-ray.direction, closest_hit_info.geometric_normal) < 0)
-                {
-                    closest_hit_info.geometric_normal = -closest_hit_info.geometric_normal;
-                    closest_hit_info.shading_normal = -closest_hit_info.shading_normal;
-                }
+                prepare_path_hit(render_data, ray_payload, closest_hit_info, ray, pixel_index);
 
                 // --------------------------------------------------- //
                 // ----------------- Direct lighting ----------------- //
@@ -271,84 +415,11 @@ GLOBAL_KERNEL_SIGNATURE(void) inline FullPathTracer(HIPRTRenderData render_data,
                 // ---------- Indirect lighting ---------- //
                 // --------------------------------------- //
 
-                float bsdf_pdf;
-                float3 bounce_direction;
-                ColorRGB32F bsdf_color;
-
-                if (mis_reuse.has_ray())
-                    bsdf_color = reuse_mis_bsdf_sample(bounce_direction, bsdf_pdf, ray_payload, mis_reuse);
-                else
-                    bsdf_color = bsdf_dispatcher_sample(render_data, ray_payload.material, ray_payload.volume_state, true, 
-                                                        -ray.direction, closest_hit_info.shading_normal, closest_hit_info.geometric_normal, bounce_direction, 
-                                                        bsdf_pdf, random_number_generator, bounce);
-#if DoFirstBounceWarpDirectionReuse
-                warp_direction_reuse(render_data, closest_hit_info, ray_payload, -ray.direction, bounce_direction, bsdf_color, bsdf_pdf, bounce, random_number_generator);
-#endif
-
-                // Terminate ray if bad sampling
-                if (bsdf_pdf <= 0.0f)
-                    break;
-
-                ColorRGB32F throughput_attenuation = bsdf_color * hippt::abs(hippt::dot(bounce_direction, closest_hit_info.shading_normal)) / bsdf_pdf;
-                // Russian roulette
-                if (!do_russian_roulette(render_data.render_settings, bounce, ray_payload.throughput, throughput_attenuation, random_number_generator))
+                if (!sample_path_next_bounce(render_data, ray_payload, closest_hit_info, ray, mis_reuse, random_number_generator))
                     break;
-
-                // Dispersion ray throughput filter
-                ray_payload.throughput *= get_dispersion_ray_color(ray_payload.volume_state.sampled_wavelength, ray_payload.material.dispersion_scale);
-                ray_payload.throughput *= throughput_attenuation;
-                ray_payload.next_ray_state = RayState::BOUNCE;
-
-                ray.origin = closest_hit_info.inter_point;
-                ray.direction = bounce_direction;
             }
             else
-            {
-                ColorRGB32F skysphere_color;
-
-                if (render_data.world_settings.ambient_light_type == AmbientLightType::UNIFORM || render_data.bsdfs_data.white_furnace_mode)
-                    skysphere_color = render_data.world_settings.uniform_light_color;
-                else if (render_data.world_settings.ambient_light_type == AmbientLightType::ENVMAP)
-                {
-#if EnvmapSamplingStrategy != ESS_NO_SAMPLING
-                    // If we have sampling, only taking envmap into account on camera ray miss
-                    if (bounce == 0)
-#endif
-                    {
-                        // We're only getting the skysphere radiance for the first rays because the
-                        // syksphere is importance sampled.
-                        skysphere_color = eval_envmap_no_pdf(render_data.world_settings, ray.direction);
-
-#if EnvmapSamplingStrategy == ESS_NO_SAMPLING
-                        // If we don't have envmap sampling, we're only going to unscale on
-                        // bounce 0 (which is when a ray misses directly --> background color).
-                        // Otherwise, if not bounce 2, we do want to take the scaling into
-                        // account so this if will fail and the envmap color will never be unscaled
-                        if (!render_data.world_settings.envmap_scale_background_intensity && bounce == 0)
-#else
-                        if (!render_data.world_settings.envmap_scale_background_intensity)
-#endif
-                            // Un-scaling the envmap if the user doesn't want to scale the background
-                            skysphere_color /= render_data.world_settings.envmap_intensity;
-                    }
-                }
-
-                skysphere_color = clamp_light_contribution(skysphere_color, render_data.render_settings.envmap_contribution_clamp, /* clamp condition */ true);
-
-                ColorRGB32F indirect_lighting_contribution = skysphere_color * ray_payload.throughput;
-                // Only clamping with the indirect lighting clamp value if
-                // this is bounce > 0 (thanks to /* clamp condition */ bounce > 0)
-                ColorRGB32F clamped_indirect_lighting_contribution = clamp_light_contribution(
-                    indirect_lighting_contribution, render_data.render_settings.indirect_contribution_clamp, 
-                    /* clamp condition */ bounce > 0);
-
-                ray_payload.ray_color += clamped_indirect_lighting_contribution;
-                ray_payload.next_ray_state = RayState::MISSED;
-
-                if (bounce == 0)
-                    // The camera ray missed so we don't have the normals but we have the base color
-                    store_denoiser_AOVs(render_data, pixel_index, make_float3(0, 0, 0), skysphere_color);
-            }
+                accumulate_path_miss(render_data, ray_payload, ray, pixel_index);
         }
         else if (ray_payload.next_ray_state == RayState::MISSED)
             break;
@@ -364,7 +435,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline FullPathTracer(HIPRTRenderData render_data,
     // the same value
     render_data.aux_buffers.still_one_ray_active[0] = 1;
 
-    accumulate_color(render_data, ray_payload.ray_color, pixel_index);
+    accumulate_color(render_data, ray_payload.ray_color, pixel_index, random_number_generator);
 }
 
 #endif
@@ -44,6 +44,17 @@ GLOBAL_KERNEL_SIGNATURE(void) inline GMoNComputeMedianOfMeans(HIPRTRenderData re
         return;
     }
 
+    if (render_data.buffers.gmon_estimator.tile_unchanged_since_last_recomputation(pixel_index, render_data.render_settings.render_resolution))
+    {
+        // Same median of means as the last recomputation, only rescaling it to the
+        // current sample count. All the threads of a block are in the same tile so
+        // that branch is coherent on the GPU
+        float scale = render_data.buffers.gmon_estimator.recomputation_sample_count / static_cast<float>(render_data.buffers.gmon_estimator.last_recomputation_sample_count);
+        render_data.buffers.gmon_estimator.result_framebuffer[pixel_index] *= scale;
+
+        return;
+    }
+
     ColorRGB32F GMoN_color = gmon_compute_median_of_means(render_data.buffers.gmon_estimator, pixel_index, render_data.render_settings.sample_number, render_data.render_settings.render_resolution);
 
     render_data.buffers.gmon_estimator.result_framebuffer[pixel_index] = GMoN_color;
@@ -12,7 +12,7 @@
 
 #include "HostDeviceCommon/RenderData.h"
 
-HIPRT_HOST_DEVICE hiprtHit simple_closest_hit(const HIPRTRenderData& render_data, hiprtRay ray, int last_primitive_index, Xorshift32Generator& random_number_generator)
+HIPRT_HOST_DEVICE hiprtHit simple_closest_hit(const HIPRTRenderData& render_data, hiprtRay ray, int last_primitive_index, int last_instance_id, Xorshift32Generator& random_number_generator)
 {
     hiprtHit hit;
 
@@ -22,6 +22,7 @@ HIPRT_HOST_DEVICE hiprtHit simple_closest_hit(const HIPRTRenderData& render_data
     payload.render_data = &render_data;
     payload.random_number_generator = &random_number_generator;
     payload.last_hit_primitive_index = last_primitive_index;
+    payload.last_hit_instance_id = last_instance_id;
 
 #if UseSharedStackBVHTraversal == KERNEL_OPTION_TRUE
 #if SharedStackBVHTraversalSize > 0
@@ -30,15 +31,17 @@ HIPRT_HOST_DEVICE hiprtHit simple_closest_hit(const HIPRTRenderData& render_data
     hiprtSharedStackBuffer shared_stack_buffer{ 0, nullptr };
 #endif
     hiprtGlobalStack global_stack(render_data.global_traversal_stack_buffer, shared_stack_buffer);
+    hiprtEmptyInstanceStack instance_stack;
 
-    hiprtGeomTraversalClosestCustomStack<hiprtGlobalStack> traversal(render_data.GPU_BVH, ray, global_stack, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
+    hiprtSceneTraversalClosestCustomStack<hiprtGlobalStack, hiprtEmptyInstanceStack> traversal(render_data.GPU_BVH, ray, global_stack, instance_stack, hiprtFullRayMask, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
 #else
-    hiprtGeomTraversalClosest traversal(render_data.GPU_BVH, ray, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
+    hiprtSceneTraversalClosest traversal(render_data.GPU_BVH, ray, hiprtFullRayMask, hiprtTraversalHintDefault, &payload, render_data.hiprt_function_table, 0);
 #endif
 
-    hit = traversal.getNextHit();
+    hit = get_scene_hit(render_data, traversal.getNextHit());
 #else
-hit = intersect_scene_cpu(render_data, ray, last_primitive_index, random_number_generator);
+hit = intersect_scene_cpu(render_data, ray, last_primitive_index, last_instance_id, random_number_generator);
+CPU_PROFILER_COUNT_RAYS(CPU_PROFILER_SHADOW_RAY, 1);
 #endif
 
     return hit;
@@ -74,7 +77,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline NEEPlusPlusCachingPrepass(HIPRTRenderData r
 
     // First finding where the camera ray intersects
     hiprtRay ray = render_data.current_camera.get_camera_ray(x_ray_point_direction, y_ray_point_direction, res);
-    hiprtHit hit = simple_closest_hit(render_data, ray, -1, random_number_generator);
+    hiprtHit hit = simple_closest_hit(render_data, ray, -1, -1, random_number_generator);
 
     if (!hit.hasHit())
         return;
@@ -82,6 +85,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline NEEPlusPlusCachingPrepass(HIPRTRenderData r
     // We have the intersection of the camera rays, we can already update the visibility map with those rays
     float3 intersection_position = ray.origin + ray.direction * hit.t;
     int camera_hit_primitive_index = hit.primID;
+    int camera_hit_instance_id = hit.instanceID;
 
     render_data.nee_plus_plus.accumulate_visibility(NEEPlusPlusContext{ render_data.current_camera.position, intersection_position }, true);
 
@@ -100,7 +104,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline NEEPlusPlusCachingPrepass(HIPRTRenderData r
         shadow_ray.origin = intersection_position;
         shadow_ray.direction = direction;
 
-        hiprtHit shadow_ray_hit = simple_closest_hit(render_data, shadow_ray, camera_hit_primitive_index, random_number_generator);
+        hiprtHit shadow_ray_hit = simple_closest_hit(render_data, shadow_ray, camera_hit_primitive_index, camera_hit_instance_id, random_number_generator);
         if (!shadow_ray_hit.hasHit())
             // Should never happen because we should at least hit the emissive triangle sampled
             continue;
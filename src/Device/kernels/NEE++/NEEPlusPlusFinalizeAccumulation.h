@@ -18,11 +18,11 @@ GLOBAL_KERNEL_SIGNATURE(void) inline NEEPlusPlusFinalizeAccumulation(NEEPlusPlus
 #ifdef __KERNELCC__
     const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
 #endif
-    uint32_t pixel_index = x;
-    if (x >= nee_plus_plus_data.get_visibility_matrix_element_count())
-        return;
+    if (x == 0)
+        nee_plus_plus_data.clear_next_epoch_touched_entries();
 
-    nee_plus_plus_data.copy_accumulation_buffers(pixel_index);
+    // Only the entries of the hash table that were used during the epoch are copied
+    nee_plus_plus_data.copy_accumulation_buffers_of_touched_entry(x);
 }
 
 #endif
@@ -103,7 +103,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ReSTIRDISample sample_fresh_light_candidate(const
         // Light sample
 
         LightSourceInformation light_source_info;
-        light_sample.point_on_light_source = uniform_sample_one_emissive_triangle(render_data, random_number_generator, out_sample_pdf, light_source_info);
+        light_sample.point_on_light_source = sample_one_emissive_triangle(render_data, closest_hit_info.inter_point, closest_hit_info.shading_normal, random_number_generator, out_sample_pdf, light_source_info);
         light_sample.emissive_triangle_index = light_source_info.emissive_triangle_index;
 
         if (out_sample_pdf > 0.0f)
@@ -257,7 +257,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void sample_light_candidates(const HIPRTRenderDat
             shadow_ray.origin = evaluated_point;
             shadow_ray.direction = to_light_direction;
 
-            bool visible = !evaluate_shadow_ray(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, /* bounce. Always 0 for ReSTIR DI*/ 0, random_number_generator);
+            bool visible = !evaluate_shadow_ray(render_data, shadow_ray, distance_to_light, closest_hit_info.primitive_index, closest_hit_info.instance_id, /* bounce. Always 0 for ReSTIR DI*/ 0, random_number_generator);
             if (!visible)
             {
                 // Sample occluded, it is not going to be resampled anyways because it is
@@ -279,6 +279,26 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void sample_light_candidates(const HIPRTRenderDat
     }
 }
 
+/**
+ * PDF of the light candidates sampler for the emissive triangle hit by a BSDF candidate
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float ReSTIR_DI_pdf_of_emissive_triangle_hit(const HIPRTRenderData& render_data, const ShadowLightRayHitInfo& light_hit_info, float3 ray_direction, const HitInfo& closest_hit_info)
+{
+#if ReSTIR_DI_DoLightsPresampling == KERNEL_OPTION_TRUE
+    // The light candidates come from the presampled lights which are picked
+    // uniformly or by power, never with the light BVH
+#if DirectLightSamplingBaseStrategy == LSS_BASE_UNIFORM
+    float pick_probability = 1.0f / render_data.buffers.emissive_triangles_count;
+#else
+    float pick_probability = power_pick_probability_of_emissive_triangle(render_data, light_hit_info.hit_prim_index);
+#endif
+
+    return pdf_of_emissive_triangle_hit(render_data, light_hit_info, ray_direction, pick_probability);
+#else
+    return pdf_of_emissive_triangle_hit(render_data, light_hit_info, ray_direction, closest_hit_info.inter_point, closest_hit_info.shading_normal);
+#endif
+}
+
 HIPRT_HOST_DEVICE HIPRT_INLINE void sample_bsdf_candidates(const HIPRTRenderData& render_data, const HitInfo& closest_hit_info, RayPayload& ray_payload, ReSTIRDIReservoir& reservoir, int nb_light_candidates, int nb_bsdf_candidates, float envmap_candidate_probability, const float3& view_direction, Xorshift32Generator& random_number_generator)
 {
     // Sampling the BSDF candidates
@@ -300,7 +320,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void sample_bsdf_candidates(const HIPRTRenderData
             bsdf_ray.direction = sampled_direction;
 
             ShadowLightRayHitInfo shadow_light_ray_hit_info;
-            bool hit_found = evaluate_shadow_light_ray(render_data, bsdf_ray, 1.0e35f, shadow_light_ray_hit_info, closest_hit_info.primitive_index, /* bounce. Always 0 for ReSTIR */ 0, random_number_generator);
+            bool hit_found = evaluate_shadow_light_ray(render_data, bsdf_ray, 1.0e35f, shadow_light_ray_hit_info, closest_hit_info.primitive_index, closest_hit_info.instance_id, /* bounce. Always 0 for ReSTIR */ 0, random_number_generator);
             if (hit_found && !shadow_light_ray_hit_info.hit_emission.is_black())
             {
                 // If we intersected an emissive material, compute the weight. 
@@ -336,7 +356,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE void sample_bsdf_candidates(const HIPRTRenderData
                     // (because the BSDF sample, that should have weight 1 [or to be precise: 1 / nb_bsdf_samples]
                     // will have weight 1 / (1 + nb_light_samples) [or to be precise: 1 / (nb_bsdf_samples + nb_light_samples)]
                     // and this is going to cause darkening as the number of light samples grows)
-                    light_pdf = pdf_of_emissive_triangle_hit(render_data, shadow_light_ray_hit_info, sampled_direction);
+                    light_pdf = ReSTIR_DI_pdf_of_emissive_triangle_hit(render_data, shadow_light_ray_hit_info, sampled_direction, closest_hit_info);
 
                 if (!check_minimum_light_contribution(render_data.render_settings.minimum_light_contribution, light_contribution / light_pdf / bsdf_sample_pdf))
                 {
@@ -492,6 +512,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline ReSTIR_DI_InitialCandidates(HIPRTRenderData
     hit_info.shading_normal = render_data.g_buffer.shading_normals[pixel_index].unpack();
     hit_info.inter_point = render_data.g_buffer.primary_hit_position[pixel_index];
     hit_info.primitive_index = render_data.g_buffer.first_hit_prim_index[pixel_index];
+    hit_info.instance_id = render_data.g_buffer.first_hit_instance_id[pixel_index];
 
     RayPayload ray_payload;
     ray_payload.material = material.unpack();
@@ -511,7 +532,7 @@ GLOBAL_KERNEL_SIGNATURE(void) inline ReSTIR_DI_InitialCandidates(HIPRTRenderData
     ReSTIRDIReservoir initial_candidates_reservoir = sample_initial_candidates(render_data, make_int2(x, y), ray_payload, hit_info, view_direction, random_number_generator);
 
 #if ReSTIR_DI_DoVisibilityReuse == KERNEL_OPTION_TRUE
-    ReSTIR_DI_visibility_reuse(render_data, initial_candidates_reservoir, hit_info.inter_point + hit_info.shading_normal * 1.0e-4f, hit_info.primitive_index, random_number_generator);
+    ReSTIR_DI_visibility_reuse(render_data, initial_candidates_reservoir, hit_info.inter_point + hit_info.shading_normal * 1.0e-4f, hit_info.primitive_index, hit_info.instance_id, random_number_generator);
 #endif
 
     render_data.render_settings.restir_di_settings.initial_candidates.output_reservoirs[pixel_index] = initial_candidates_reservoir;
@@ -39,7 +39,20 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ReSTIRDIPresampledLight presample_emissive_triang
     ReSTIRDIPresampledLight presampled_light;
 
     int random_index = random_number_generator.random_index(parameters.emissive_triangles_count);
+#if DirectLightSamplingBaseStrategy == LSS_BASE_UNIFORM
+    float pick_probability = 1.0f / parameters.emissive_triangles_count;
+#else
+    // The lights aren't presampled for a given shading point so the light BVH
+    // cannot be used here, picking the lights proportionally to their power instead
+    if (random_number_generator() > parameters.emissive_power_alias_table_probas[random_index])
+        // Picking the alias
+        random_index = parameters.emissive_power_alias_table_alias[random_index];
+#endif
     int triangle_index = parameters.emissive_triangles_indices[random_index];
+#if DirectLightSamplingBaseStrategy != LSS_BASE_UNIFORM
+    int leaf_index = parameters.light_bvh.triangle_leaf_indices[triangle_index];
+    float pick_probability = parameters.light_bvh.nodes[leaf_index].power / parameters.light_bvh.nodes[0].power;
+#endif
 
     float3 vertex_A = parameters.vertices_positions[parameters.triangles_indices[triangle_index * 3 + 0]];
     float3 vertex_B = parameters.vertices_positions[parameters.triangles_indices[triangle_index * 3 + 1]];
@@ -68,7 +81,7 @@ HIPRT_HOST_DEVICE HIPRT_INLINE ReSTIRDIPresampledLight presample_emissive_triang
         presampled_light.light_source_normal = normal / length_normal;
         presampled_light.emissive_triangle_index = triangle_index;
         presampled_light.pdf = 1.0f / triangle_area;
-        presampled_light.pdf /= parameters.emissive_triangles_count;
+        presampled_light.pdf *= pick_probability;
         presampled_light.pdf *= light_sampling_probability;
         presampled_light.radiance = parameters.materials.get_emission(parameters.material_indices[triangle_index]);
     }
@@ -55,10 +55,11 @@ GLOBAL_KERNEL_SIGNATURE(void) inline TraceTest(HIPRTRenderData render_data, int2
     hiprtSharedStackBuffer shared_stack_buffer{ 0, nullptr };
 #endif
     hiprtGlobalStack global_stack(render_data.global_traversal_stack_buffer, shared_stack_buffer);
+    hiprtEmptyInstanceStack instance_stack;
 
-    hiprtGeomTraversalClosestCustomStack<hiprtGlobalStack> traversal(render_data.GPU_BVH, ray, global_stack, hiprtTraversalHintDefault);
+    hiprtSceneTraversalClosestCustomStack<hiprtGlobalStack, hiprtEmptyInstanceStack> traversal(render_data.GPU_BVH, ray, global_stack, instance_stack);
 #else
-    hiprtGeomTraversalClosest traversal(render_data.GPU_BVH, ray, hiprtTraversalHintDefault);
+    hiprtSceneTraversalClosest traversal(render_data.GPU_BVH, ray);
 #endif
 
     hit = traversal.getNextHit();
@@ -0,0 +1,350 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef KERNELS_WAVEFRONT_PATH_TRACER_H
+#define KERNELS_WAVEFRONT_PATH_TRACER_H
+
+#include "Device/includes/FixIntellisense.h"
+#include "Device/includes/Wavefront/WavefrontPathState.h"
+#include "Device/kernels/FullPathTracer.h"
+
+/**
+ * Stages of the wavefront path tracer.
+ * 
+ * The wavefront path tracer computes the same estimator as 'FullPathTracer' but splits the path tracing
+ * loop into stages that each process all the paths of a queue before the next stage runs:
+ * 
+ *	- WavefrontGenerate: initializes the paths from the G-buffer of the camera ray pass
+ *	- WavefrontDirectLighting: next event estimation at the hit of the paths. The shadow rays of the
+ *		light samples are pushed in the shadow ray queue instead of being traced
+ *	- WavefrontTraceShadowRays: traces the shadow rays of the shadow ray queue
+ *	- WavefrontShade: adds the unoccluded light samples to the paths, BSDF sampling of the next bounce and russian roulette
+ *	- WavefrontExtend: traces the rays of the next bounce
+ *	- WavefrontAccumulate: accumulates the radiance of the paths in the framebuffer
+ * 
+ * The direct lighting, shadow rays, shade and extend stages are repeated for every bounce. The hit queue
+ * can be sorted by material between the extend and the shading stages so that paths shading
+ * the same material are processed together
+ */
+
+/**
+ * Updates the NEE++ visibility map with the visibility of a traced shadow ray, if the shadow ray needs it
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void accumulate_wavefront_shadow_ray_visibility(HIPRTRenderData& render_data, const WavefrontShadowRay& shadow_ray)
+{
+#if DirectLightUseNEEPlusPlus == KERNEL_OPTION_TRUE
+    if (shadow_ray.nee_plus_plus_voxel_matrix_index != -1)
+        render_data.nee_plus_plus.accumulate_visibility(!shadow_ray.occluded, shadow_ray.nee_plus_plus_voxel_matrix_index);
+#endif
+}
+
+/**
+ * Computes the visibility of a shadow ray of the shadow ray queue
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void trace_wavefront_shadow_ray(HIPRTRenderData& render_data, WavefrontShadowRay& shadow_ray)
+{
+    Xorshift32Generator random_number_generator(shadow_ray.random_seed);
+
+    shadow_ray.occluded = evaluate_shadow_ray(render_data, shadow_ray.ray, shadow_ray.t_max, shadow_ray.last_hit_primitive_index, shadow_ray.last_hit_instance_id, shadow_ray.bounce, random_number_generator);
+    accumulate_wavefront_shadow_ray_visibility(render_data, shadow_ray);
+}
+
+/**
+ * Adds the contribution of the shadow ray to the direct lighting of its path if it is unoccluded
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE void add_wavefront_shadow_ray_contribution(WavefrontPathState& path, const WavefrontShadowRay& shadow_ray)
+{
+    if (shadow_ray.occluded)
+        return;
+
+    if (shadow_ray.target == WAVEFRONT_SHADOW_RAY_LIGHT)
+        path.light_direct_contribution += shadow_ray.contribution;
+    else
+        path.envmap_direct_contribution += shadow_ray.contribution;
+}
+
+/**
+ * Initializes the path of the pixel from the G-buffer. The path is pushed in the hit
+ * queue if the camera ray hit the scene, the miss is handled right away otherwise
+ */
+#ifdef __KERNELCC__
+GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) WavefrontGenerate(HIPRTRenderData render_data)
+#else
+GLOBAL_KERNEL_SIGNATURE(void) inline WavefrontGenerate(HIPRTRenderData render_data, int x, int y)
+#endif
+{
+#ifdef __KERNELCC__
+    const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
+    const uint32_t y = blockIdx.y * blockDim.y + threadIdx.y;
+#endif
+    if (x >= render_data.render_settings.render_resolution.x || y >= render_data.render_settings.render_resolution.y)
+        return;
+
+    uint32_t pixel_index = x + y * render_data.render_settings.render_resolution.x;
+    if (!render_data.aux_buffers.pixel_active[pixel_index])
+        return;
+
+#if ViewportColorOverriden == 1
+    // If some kernel option is going to debug some color in the viewport,
+    // then we're clearing the viewport buffer here
+    render_data.buffers.accumulated_ray_colors[pixel_index] = ColorRGB32F();
+#endif
+
+    WavefrontPathState& path = render_data.buffers.wavefront.paths[pixel_index];
+    path = WavefrontPathState();
+    path.pixel_index = pixel_index;
+    path.random_number_generator = get_path_tracing_random_generator(render_data, pixel_index);
+
+    if (initialize_path_from_g_buffer(render_data, pixel_index, path.ray, path.ray_payload, path.closest_hit_info, path.random_number_generator))
+        render_data.buffers.wavefront.hit_queue[hippt::atomic_fetch_add(render_data.buffers.wavefront.hit_queue_size, 1)] = pixel_index;
+    else
+        accumulate_path_miss(render_data, path.ray_payload, path.ray, pixel_index);
+}
+
+/**
+ * Next event estimation at the hit of the path at index 'queue_index' in the hit queue
+ */
+#ifdef __KERNELCC__
+GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) WavefrontDirectLighting(HIPRTRenderData render_data, int hit_queue_size)
+#else
+GLOBAL_KERNEL_SIGNATURE(void) inline WavefrontDirectLighting(HIPRTRenderData render_data, int hit_queue_size, int queue_index)
+#endif
+{
+#ifdef __KERNELCC__
+    const int queue_index = blockIdx.x * blockDim.x + threadIdx.x;
+#endif
+    if (queue_index >= hit_queue_size)
+        return;
+
+    render_data.render_settings.nb_bounces = get_path_tracing_bounce_count(render_data);
+
+    int path_index = render_data.buffers.wavefront.hit_queue[queue_index];
+    WavefrontPathState& path = render_data.buffers.wavefront.paths[path_index];
+    int x = path.pixel_index % render_data.render_settings.render_resolution.x;
+    int y = path.pixel_index / render_data.render_settings.render_resolution.x;
+
+    prepare_path_hit(render_data, path.ray_payload, path.closest_hit_info, path.ray, path.pixel_index);
+
+    path.shadow_rays_offset = 0;
+    path.shadow_ray_count = 0;
+
+#ifndef __KERNELCC__
+    // The shadow rays of the light samples are collected here instead of being traced.
+    // 'render_data' is a copy so this only affects the light sampling of this path
+    WavefrontDeferredShadowRays deferred_shadow_rays;
+    if (render_data.buffers.wavefront.shadow_ray_queue != nullptr)
+        render_data.buffers.wavefront.deferred_shadow_rays = &deferred_shadow_rays;
+#endif
+
+    // Estimates direct lighting with next-even estimation. The direct lighting is only
+    // added to ray_payload.ray_color by the shading stage, once the shadow rays are traced
+    sample_direct_lighting(render_data, path.ray_payload, path.closest_hit_info, -path.ray.direction, x, y, path.mis_reuse, path.random_number_generator,
+        path.light_direct_contribution, path.envmap_direct_contribution);
+
+#ifndef __KERNELCC__
+    if (deferred_shadow_rays.count == 0)
+        return;
+
+    // Reserving the range of the shadow rays in the queue only if the whole range fits. The size of the queue
+    // is never advanced past its capacity so all the shadow rays before the size are written by their path
+    int shadow_ray_queue_capacity = render_data.buffers.wavefront.shadow_ray_queue_capacity;
+    int shadow_rays_offset = hippt::atomic_fetch_add(render_data.buffers.wavefront.shadow_ray_queue_size, 0);
+    while (shadow_rays_offset + deferred_shadow_rays.count <= shadow_ray_queue_capacity)
+    {
+        int current_size = hippt::atomic_compare_exchange(render_data.buffers.wavefront.shadow_ray_queue_size, shadow_rays_offset, shadow_rays_offset + deferred_shadow_rays.count);
+        if (current_size == shadow_rays_offset)
+            break;
+
+        shadow_rays_offset = current_size;
+    }
+
+    if (shadow_rays_offset + deferred_shadow_rays.count <= shadow_ray_queue_capacity)
+    {
+        for (int i = 0; i < deferred_shadow_rays.count; i++)
+        {
+            WavefrontShadowRay& shadow_ray = render_data.buffers.wavefront.shadow_ray_queue[shadow_rays_offset + i];
+
+            shadow_ray = deferred_shadow_rays.shadow_rays[i];
+            shadow_ray.path_index = path_index;
+        }
+
+        path.shadow_rays_offset = shadow_rays_offset;
+        path.shadow_ray_count = deferred_shadow_rays.count;
+    }
+    else
+    {
+        // The shadow ray queue is full, tracing the shadow rays of that path right away
+        for (int i = 0; i < deferred_shadow_rays.count; i++)
+        {
+            trace_wavefront_shadow_ray(render_data, deferred_shadow_rays.shadow_rays[i]);
+            add_wavefront_shadow_ray_contribution(path, deferred_shadow_rays.shadow_rays[i]);
+        }
+    }
+#endif
+}
+
+/**
+ * Traces the shadow ray at index 'queue_index' in the shadow ray queue
+ */
+#ifdef __KERNELCC__
+GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) WavefrontTraceShadowRays(HIPRTRenderData render_data, int shadow_ray_queue_size)
+#else
+GLOBAL_KERNEL_SIGNATURE(void) inline WavefrontTraceShadowRays(HIPRTRenderData render_data, int shadow_ray_queue_size, int queue_index)
+#endif
+{
+#ifdef __KERNELCC__
+    const int queue_index = blockIdx.x * blockDim.x + threadIdx.x;
+#endif
+    if (queue_index >= shadow_ray_queue_size)
+        return;
+
+    trace_wavefront_shadow_ray(render_data, render_data.buffers.wavefront.shadow_ray_queue[queue_index]);
+}
+
+#ifndef __KERNELCC__
+/**
+ * CPU only. Same as WavefrontTraceShadowRays() but for the 'shadow_ray_count' (at most BVHConstants::PACKET_MAX_RAY_COUNT)
+ * shadow rays at the indices 'shadow_ray_indices' of the shadow ray queue, traced with a single packet traversal of the BVH.
+ *
+ * The packet traversal only pays off if the shadow rays are coherent: the CPU renderer
+ * gathers the shadow rays of the same tile of pixels that go in the same direction octant
+ */
+inline void WavefrontTraceShadowRaysPacket(HIPRTRenderData render_data, const int* shadow_ray_indices, int shadow_ray_count)
+{
+    hiprtRay rays[BVHConstants::PACKET_MAX_RAY_COUNT];
+    float t_max[BVHConstants::PACKET_MAX_RAY_COUNT];
+    int last_hit_primitive_indices[BVHConstants::PACKET_MAX_RAY_COUNT];
+    int last_hit_instance_ids[BVHConstants::PACKET_MAX_RAY_COUNT];
+    int bounces[BVHConstants::PACKET_MAX_RAY_COUNT];
+    Xorshift32Generator random_number_generators[BVHConstants::PACKET_MAX_RAY_COUNT];
+    Xorshift32Generator* random_number_generators_pointers[BVHConstants::PACKET_MAX_RAY_COUNT];
+
+    for (int i = 0; i < shadow_ray_count; i++)
+    {
+        const WavefrontShadowRay& shadow_ray = render_data.buffers.wavefront.shadow_ray_queue[shadow_ray_indices[i]];
+
+        rays[i] = shadow_ray.ray;
+        t_max[i] = shadow_ray.t_max;
+        last_hit_primitive_indices[i] = shadow_ray.last_hit_primitive_index;
+        last_hit_instance_ids[i] = shadow_ray.last_hit_instance_id;
+        bounces[i] = shadow_ray.bounce;
+        random_number_generators[i] = Xorshift32Generator(shadow_ray.random_seed);
+        random_number_generators_pointers[i] = &random_number_generators[i];
+    }
+
+    bool in_shadow[BVHConstants::PACKET_MAX_RAY_COUNT];
+    evaluate_shadow_rays_packet(render_data, rays, t_max, last_hit_primitive_indices, last_hit_instance_ids, bounces, random_number_generators_pointers, shadow_ray_count, in_shadow);
+
+    for (int i = 0; i < shadow_ray_count; i++)
+    {
+        WavefrontShadowRay& shadow_ray = render_data.buffers.wavefront.shadow_ray_queue[shadow_ray_indices[i]];
+
+        shadow_ray.occluded = in_shadow[i];
+        accumulate_wavefront_shadow_ray_visibility(render_data, shadow_ray);
+    }
+}
+#endif
+
+/**
+ * Samples the next bounce of the path at index 'queue_index' in the hit queue.
+ * The path is pushed in the ray queue if it survives and has bounces left
+ */
+#ifdef __KERNELCC__
+GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) WavefrontShade(HIPRTRenderData render_data, int hit_queue_size)
+#else
+GLOBAL_KERNEL_SIGNATURE(void) inline WavefrontShade(HIPRTRenderData render_data, int hit_queue_size, int queue_index)
+#endif
+{
+#ifdef __KERNELCC__
+    const int queue_index = blockIdx.x * blockDim.x + threadIdx.x;
+#endif
+    if (queue_index >= hit_queue_size)
+        return;
+
+    render_data.render_settings.nb_bounces = get_path_tracing_bounce_count(render_data);
+
+    int path_index = render_data.buffers.wavefront.hit_queue[queue_index];
+    WavefrontPathState& path = render_data.buffers.wavefront.paths[path_index];
+
+    for (int i = 0; i < path.shadow_ray_count; i++)
+        add_wavefront_shadow_ray_contribution(path, render_data.buffers.wavefront.shadow_ray_queue[path.shadow_rays_offset + i]);
+    accumulate_direct_lighting(render_data, path.ray_payload, path.light_direct_contribution, path.envmap_direct_contribution);
+
+    if (!sample_path_next_bounce(render_data, path.ray_payload, path.closest_hit_info, path.ray, path.mis_reuse, path.random_number_generator))
+        return;
+
+    // + 1 to nb_bounces here because we want "0" bounces to still act as one
+    // hit and to return some color. Same as the loop of 'FullPathTracer'
+    if (path.ray_payload.bounce + 1 < render_data.render_settings.nb_bounces + 1)
+        render_data.buffers.wavefront.ray_queue[hippt::atomic_fetch_add(render_data.buffers.wavefront.ray_queue_size, 1)] = path_index;
+}
+
+/**
+ * Traces the next ray of the path at index 'queue_index' in the ray queue.
+ * The path is pushed in the hit queue if the ray hit the scene, the miss is handled right away otherwise
+ */
+#ifdef __KERNELCC__
+GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) WavefrontExtend(HIPRTRenderData render_data, int ray_queue_size)
+#else
+GLOBAL_KERNEL_SIGNATURE(void) inline WavefrontExtend(HIPRTRenderData render_data, int ray_queue_size, int queue_index)
+#endif
+{
+#ifdef __KERNELCC__
+    const int queue_index = blockIdx.x * blockDim.x + threadIdx.x;
+#endif
+    if (queue_index >= ray_queue_size)
+        return;
+
+    int path_index = render_data.buffers.wavefront.ray_queue[queue_index];
+    WavefrontPathState& path = render_data.buffers.wavefront.paths[path_index];
+
+    path.ray_payload.bounce++;
+
+    bool intersection_found;
+    if (path.mis_reuse.has_ray())
+        // Reusing a BSDF MIS ray if there is one available
+        intersection_found = reuse_mis_ray(render_data, path.closest_hit_info, path.ray_payload, -path.ray.direction, path.mis_reuse);
+    else
+        intersection_found = trace_ray(render_data, path.ray, path.ray_payload, path.closest_hit_info, path.closest_hit_info.primitive_index, path.closest_hit_info.instance_id, path.ray_payload.bounce, path.random_number_generator);
+
+    if (intersection_found)
+        render_data.buffers.wavefront.hit_queue[hippt::atomic_fetch_add(render_data.buffers.wavefront.hit_queue_size, 1)] = path_index;
+    else
+        accumulate_path_miss(render_data, path.ray_payload, path.ray, path.pixel_index);
+}
+
+/**
+ * Accumulates the radiance of the path of the pixel once all the paths are terminated
+ */
+#ifdef __KERNELCC__
+GLOBAL_KERNEL_SIGNATURE(void) __launch_bounds__(64) WavefrontAccumulate(HIPRTRenderData render_data)
+#else
+GLOBAL_KERNEL_SIGNATURE(void) inline WavefrontAccumulate(HIPRTRenderData render_data, int x, int y)
+#endif
+{
+#ifdef __KERNELCC__
+    const uint32_t x = blockIdx.x * blockDim.x + threadIdx.x;
+    const uint32_t y = blockIdx.y * blockDim.y + threadIdx.y;
+#endif
+    if (x >= render_data.render_settings.render_resolution.x || y >= render_data.render_settings.render_resolution.y)
+        return;
+
+    uint32_t pixel_index = x + y * render_data.render_settings.render_resolution.x;
+    if (!render_data.aux_buffers.pixel_active[pixel_index])
+        return;
+
+    WavefrontPathState& path = render_data.buffers.wavefront.paths[pixel_index];
+
+    // Checking for NaNs / negative value samples
+    if (!sanity_check(render_data, path.ray_payload, x, y))
+        return;
+
+    // If we got here, this means that we still have at least one ray active
+    render_data.aux_buffers.still_one_ray_active[0] = 1;
+
+    accumulate_color(render_data, path.ray_payload.ray_color, pixel_index, path.random_number_generator);
+}
+
+#endif
@@ -7,13 +7,22 @@
 #define HIPRT_SCENE_H
 
 #include "HIPRT-Orochi/HIPRTOrochiUtils.h"
+#include "HIPRT-Orochi/OrochiBuffer.h"
 #include "HIPRT-Orochi/OrochiTexture.h"
+#include "HostDeviceCommon/KernelOptions/KernelOptions.h"
+#include "HostDeviceCommon/Math.h"
+#include "HostDeviceCommon/Packing.h"
 #include "Renderer/GPUDataStructures/MaterialPackedSoAGPUData.h"
+#include "Renderer/LightBVH.h"
+#include "Scene/SceneInstance.h"
 #include "UI/ImGui/ImGuiLogger.h"
 
 #include "hiprt/hiprt.h"
 #include "Orochi/Orochi.h"
 
+#include <memory>
+#include <vector>
+
 extern ImGuiLogger g_imgui_logger;
 
 struct HIPRTGeometry
@@ -52,6 +61,26 @@ struct HIPRTGeometry
 		OROCHI_CHECK_ERROR(oroMemcpy(reinterpret_cast<oroDeviceptr>(m_mesh.vertices), vertices_positions.data(), m_mesh.vertexCount * sizeof(float3), oroMemcpyHostToDevice));
 	}
 
+	/**
+	 * Overwrites the positions of the vertices [first_vertex, first_vertex + vertex_count)
+	 * of the already uploaded vertices. The BVH isn't updated, see refit_bvh()
+	 */
+	void update_vertices(const float3* vertices_positions, int first_vertex, int vertex_count)
+	{
+		float3* destination = reinterpret_cast<float3*>(m_mesh.vertices) + first_vertex;
+		OROCHI_CHECK_ERROR(oroMemcpy(reinterpret_cast<oroDeviceptr>(destination), vertices_positions, vertex_count * sizeof(float3), oroMemcpyHostToDevice));
+	}
+
+	std::vector<float3> download_vertices(int first_vertex, int vertex_count)
+	{
+		std::vector<float3> vertices_positions(vertex_count);
+
+		float3* source = reinterpret_cast<float3*>(m_mesh.vertices) + first_vertex;
+		OROCHI_CHECK_ERROR(oroMemcpy(vertices_positions.data(), reinterpret_cast<oroDeviceptr>(source), vertex_count * sizeof(float3), oroMemcpyDeviceToHost));
+
+		return vertices_positions;
+	}
+
 	void log_bvh_building(hiprtBuildFlags build_flags)
 	{
 		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Compiling BVH building kernels & building scene BVH...");
@@ -83,7 +112,8 @@ struct HIPRTGeometry
 		// Geom type 0 here 
 		geometry_build_input.geomType = 0;
 
-		log_bvh_building(build_options.buildFlags);
+		if (m_log_build)
+			log_bvh_building(build_options.buildFlags);
 		// Getting the buffer sizes for the construction of the BVH
 		HIPRT_CHECK_ERROR(hiprtGetGeometryBuildTemporaryBufferSize(m_hiprt_ctx, geometry_build_input, build_options, geometry_temp_size));
 		OROCHI_CHECK_ERROR(oroMalloc(reinterpret_cast<oroDeviceptr*>(&geometry_temp), geometry_temp_size));
@@ -94,15 +124,277 @@ struct HIPRTGeometry
 
 		if (do_compaction)
 			HIPRT_CHECK_ERROR(hiprtCompactGeometry(m_hiprt_ctx, 0, m_geometry, m_geometry));
+		m_compacted = do_compaction;
+		m_build_flags = build_flags;
+
+		if (!m_log_build)
+			return;
 
 		auto stop = std::chrono::high_resolution_clock::now();
-		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "BVH built in %ldms", std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "BVH built in %lldms", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
+	}
+
+	/**
+	 * Updates the bounds of the BVH for the current positions of the vertices, keeping its topology.
+	 *
+	 * Compacted BVHs cannot be updated: they are rebuilt without compaction instead
+	 * so that the next deformations of the mesh can be refitted
+	 */
+	void refit_bvh(oroStream_t build_stream)
+	{
+		if (m_geometry == nullptr || m_compacted)
+		{
+			build_bvh(m_build_flags, false, build_stream);
+
+			return;
+		}
+
+		hiprtBuildOptions build_options;
+		hiprtGeometryBuildInput geometry_build_input;
+		size_t geometry_temp_size;
+		hiprtDevicePtr geometry_temp;
+
+		build_options.buildFlags = m_build_flags;
+		geometry_build_input.type = hiprtPrimitiveTypeTriangleMesh;
+		geometry_build_input.primitive.triangleMesh = m_mesh;
+		geometry_build_input.geomType = 0;
+
+		HIPRT_CHECK_ERROR(hiprtGetGeometryBuildTemporaryBufferSize(m_hiprt_ctx, geometry_build_input, build_options, geometry_temp_size));
+		OROCHI_CHECK_ERROR(oroMalloc(reinterpret_cast<oroDeviceptr*>(&geometry_temp), geometry_temp_size));
+		HIPRT_CHECK_ERROR(hiprtBuildGeometry(m_hiprt_ctx, hiprtBuildOperationUpdate, geometry_build_input, build_options, geometry_temp, build_stream, m_geometry));
+		OROCHI_CHECK_ERROR(oroFree(reinterpret_cast<oroDeviceptr>(geometry_temp)));
 	}
 
 	hiprtContext m_hiprt_ctx = nullptr;
 	hiprtTriangleMeshPrimitive m_mesh = { nullptr };
-	// One geometry for the whole scene for now
 	hiprtGeometry m_geometry = nullptr;
+
+	hiprtBuildFlags m_build_flags = hiprtBuildFlagBitPreferHighQualityBuild;
+	bool m_compacted = false;
+	// The BLASes of the meshes don't log their builds, the whole scene BVH does
+	bool m_log_build = true;
+};
+
+/**
+ * BVH of the scene on the GPU: one HIPRT geometry (BLAS) per mesh of the scene
+ * and a HIPRT scene (TLAS) over the instances of these geometries (see SceneInstance).
+ *
+ * The BLASes have their own copy of the vertices and indices of their mesh, in the object
+ * space of the mesh. Moving an instance only changes its transform and rebuilds the TLAS.
+ * Deforming a mesh refits its BLAS.
+ *
+ * The hits of the traversals are relative to the instance that was hit,
+ * see get_scene_hit() in the device code
+ */
+struct HIPRTSceneBVH
+{
+	~HIPRTSceneBVH()
+	{
+		if (m_scene)
+			HIPRT_CHECK_ERROR(hiprtDestroyScene(m_hiprt_ctx, m_scene));
+	}
+
+	/**
+	 * Uploads the geometry of each mesh of the scene to its BLAS, in the local vertex indexing of the mesh.
+	 * See SceneMetadata::mesh_triangle_offsets for the offsets
+	 */
+	void set_meshes(hiprtContext hiprt_ctx, const std::vector<int>& triangles_indices, const std::vector<float3>& vertices_positions, const std::vector<int>& mesh_triangle_offsets, const std::vector<int>& mesh_vertex_offsets, const std::vector<SceneInstance>& instances)
+	{
+		m_hiprt_ctx = hiprt_ctx;
+		m_mesh_triangle_offsets = mesh_triangle_offsets;
+		m_mesh_vertex_offsets = mesh_vertex_offsets;
+		m_instances = instances;
+
+		int mesh_count = hippt::max(0, static_cast<int>(mesh_triangle_offsets.size()) - 1);
+		m_blases.clear();
+		for (int mesh_index = 0; mesh_index < mesh_count; mesh_index++)
+		{
+			int first_vertex = mesh_vertex_offsets[mesh_index];
+			std::vector<int> mesh_triangles_indices(triangles_indices.begin() + mesh_triangle_offsets[mesh_index] * 3, triangles_indices.begin() + mesh_triangle_offsets[mesh_index + 1] * 3);
+			for (int& vertex_index : mesh_triangles_indices)
+				vertex_index -= first_vertex;
+
+			std::vector<float3> mesh_vertices(vertices_positions.begin() + first_vertex, vertices_positions.begin() + mesh_vertex_offsets[mesh_index + 1]);
+
+			std::unique_ptr<HIPRTGeometry> blas = std::make_unique<HIPRTGeometry>(hiprt_ctx);
+			blas->m_log_build = false;
+			if (!mesh_triangles_indices.empty())
+			{
+				blas->upload_indices(mesh_triangles_indices);
+				blas->upload_vertices(mesh_vertices);
+			}
+
+			m_blases.push_back(std::move(blas));
+		}
+	}
+
+	/**
+	 * Builds all the BLASes and the TLAS
+	 */
+	void build(hiprtBuildFlags build_flags, bool do_compaction, oroStream_t build_stream)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Compiling BVH building kernels & building scene BVH...");
+
+		m_build_flags = build_flags;
+		for (std::unique_ptr<HIPRTGeometry>& blas : m_blases)
+			blas->build_bvh(build_flags, do_compaction, build_stream);
+
+		build_tlas(build_stream);
+
+		auto stop = std::chrono::high_resolution_clock::now();
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "BVH built in %lldms (%zu BLASes, %zu instances)", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count(), m_blases.size(), m_instances.size());
+	}
+
+	/**
+	 * Changes the object to world transform of the instance. build_tlas() must be
+	 * called once all the transforms have been set for the change to be visible
+	 */
+	void set_instance_transform(int instance_index, const float4x4& object_to_world)
+	{
+		m_instances[instance_index].object_to_world = object_to_world;
+	}
+
+	/**
+	 * Uploads the new object space positions of the vertices of the mesh and refits its BLAS.
+	 * build_tlas() must then be called since the bounds of the mesh have changed
+	 */
+	void update_mesh_vertices(int mesh_index, const std::vector<float3>& object_space_vertices_positions, oroStream_t build_stream)
+	{
+		HIPRTGeometry& blas = *m_blases[mesh_index];
+		if (blas.m_mesh.triangleCount == 0)
+			return;
+
+		blas.update_vertices(object_space_vertices_positions.data(), 0, object_space_vertices_positions.size());
+		blas.refit_bvh(build_stream);
+	}
+
+	/**
+	 * Rebuilds the TLAS from the current transforms of the instances.
+	 * This is very cheap compared to a rebuild of the BLASes
+	 */
+	void build_tlas(oroStream_t build_stream)
+	{
+		if (m_scene != nullptr)
+		{
+			HIPRT_CHECK_ERROR(hiprtDestroyScene(m_hiprt_ctx, m_scene));
+
+			m_scene = nullptr;
+		}
+
+		std::vector<hiprtInstance> instances;
+		std::vector<hiprtFrameMatrix> frames;
+		std::vector<hiprtTransformHeader> transform_headers;
+		std::vector<int> instance_primitive_offsets;
+		std::vector<float4x4> instance_object_to_world;
+		std::vector<float4x4> instance_normal_to_world;
+		m_has_instance_transforms = false;
+		float4x4 identity = identity_affine_matrix();
+		for (const SceneInstance& scene_instance : m_instances)
+		{
+			int mesh_index = scene_instance.mesh_index;
+			if (m_blases[mesh_index]->m_geometry == nullptr)
+				// Empty mesh
+				continue;
+
+			hiprtInstance instance;
+			instance.type = hiprtInstanceTypeGeometry;
+			instance.geometry = m_blases[mesh_index]->m_geometry;
+
+			// Same row-major 3x4 layout as the first 3 rows of our affine matrices
+			hiprtFrameMatrix frame = {};
+			for (int row = 0; row < 3; row++)
+				for (int column = 0; column < 4; column++)
+					frame.matrix[row][column] = scene_instance.object_to_world.m[row][column];
+
+			for (int row = 0; row < 4; row++)
+				for (int column = 0; column < 4; column++)
+					m_has_instance_transforms |= scene_instance.object_to_world.m[row][column] != identity.m[row][column];
+
+			hiprtTransformHeader transform_header;
+			transform_header.frameIndex = frames.size();
+			transform_header.frameCount = 1;
+
+			instances.push_back(instance);
+			frames.push_back(frame);
+			transform_headers.push_back(transform_header);
+			instance_primitive_offsets.push_back(m_mesh_triangle_offsets[mesh_index]);
+			instance_object_to_world.push_back(scene_instance.object_to_world);
+			instance_normal_to_world.push_back(affine_normal_matrix(affine_matrix_inverse(scene_instance.object_to_world)));
+		}
+
+		if (instances.empty())
+			// No BVH to build
+			return;
+
+		m_hiprt_instances.resize(instances.size());
+		m_hiprt_instances.upload_data(instances);
+		m_instance_frames.resize(frames.size());
+		m_instance_frames.upload_data(frames);
+		m_instance_transform_headers.resize(transform_headers.size());
+		m_instance_transform_headers.upload_data(transform_headers);
+		m_instance_primitive_offsets.resize(instance_primitive_offsets.size());
+		m_instance_primitive_offsets.upload_data(instance_primitive_offsets);
+		m_instance_object_to_world.resize(instance_object_to_world.size());
+		m_instance_object_to_world.upload_data(instance_object_to_world);
+		m_instance_normal_to_world.resize(instance_normal_to_world.size());
+		m_instance_normal_to_world.upload_data(instance_normal_to_world);
+
+		hiprtBuildOptions build_options;
+		hiprtSceneBuildInput scene_build_input;
+		size_t scene_temp_size;
+		hiprtDevicePtr scene_temp;
+
+		build_options.buildFlags = m_build_flags;
+		scene_build_input.instances = m_hiprt_instances.get_device_pointer();
+		scene_build_input.instanceTransformHeaders = m_instance_transform_headers.get_device_pointer();
+		scene_build_input.instanceFrames = m_instance_frames.get_device_pointer();
+		scene_build_input.instanceMasks = nullptr;
+		scene_build_input.instanceCount = instances.size();
+		scene_build_input.frameCount = frames.size();
+		scene_build_input.frameType = hiprtFrameTypeMatrix;
+
+		HIPRT_CHECK_ERROR(hiprtGetSceneBuildTemporaryBufferSize(m_hiprt_ctx, scene_build_input, build_options, scene_temp_size));
+		OROCHI_CHECK_ERROR(oroMalloc(reinterpret_cast<oroDeviceptr*>(&scene_temp), scene_temp_size));
+
+		HIPRT_CHECK_ERROR(hiprtCreateScene(m_hiprt_ctx, scene_build_input, build_options, m_scene));
+		HIPRT_CHECK_ERROR(hiprtBuildScene(m_hiprt_ctx, hiprtBuildOperationBuild, scene_build_input, build_options, scene_temp, build_stream, m_scene));
+		OROCHI_CHECK_ERROR(oroFree(reinterpret_cast<oroDeviceptr>(scene_temp)));
+	}
+
+	int get_mesh_count() const
+	{
+		return m_blases.size();
+	}
+
+	int get_instance_count() const
+	{
+		return m_instances.size();
+	}
+
+	hiprtContext m_hiprt_ctx = nullptr;
+	hiprtBuildFlags m_build_flags = hiprtBuildFlagBitPreferHighQualityBuild;
+
+	std::vector<std::unique_ptr<HIPRTGeometry>> m_blases;
+	std::vector<SceneInstance> m_instances;
+	std::vector<int> m_mesh_triangle_offsets;
+	std::vector<int> m_mesh_vertex_offsets;
+
+	// Instances of the TLAS, the instances of empty meshes are skipped
+	OrochiBuffer<hiprtInstance> m_hiprt_instances;
+	OrochiBuffer<hiprtFrameMatrix> m_instance_frames;
+	OrochiBuffer<hiprtTransformHeader> m_instance_transform_headers;
+	// For each instance, index of the first triangle of its mesh in the triangle buffers of the scene.
+	// Indexed by the instance ID of the hits
+	OrochiBuffer<int> m_instance_primitive_offsets;
+	// Transforms of the instances of the TLAS for the shading, see RenderBuffers::instance_object_to_world
+	OrochiBuffer<float4x4> m_instance_object_to_world;
+	OrochiBuffer<float4x4> m_instance_normal_to_world;
+	// False if all the instances have an identity transform in which case
+	// the shading doesn't need the transforms of the instances
+	bool m_has_instance_transforms = false;
+
+	hiprtScene m_scene = nullptr;
 };
 
 struct HIPRTScene
@@ -112,15 +404,26 @@ struct HIPRTScene
 		stream << "Scene statistics: " << std::endl;
 		stream << "\t" << geometry.m_mesh.vertexCount << " vertices" << std::endl;
 		stream << "\t" << geometry.m_mesh.triangleCount << " triangles" << std::endl;
+		stream << "\t" << bvh.get_mesh_count() << " meshes" << std::endl;
+		stream << "\t" << bvh.get_instance_count() << " instances" << std::endl;
 		stream << "\t" << emissive_triangles_indices.get_element_count() << " emissive triangles" << std::endl;
 		stream << "\t" << materials_buffer.m_element_count << " materials" << std::endl;
 		stream << "\t" << orochi_materials_textures.size() << " textures" << std::endl;
 	}
 
+	// Vertices and indices of all the meshes of the scene, in the object space of the meshes, for
+	// the shading. No BVH is built on that geometry, the BVH is 'bvh'
 	HIPRTGeometry geometry;
+	HIPRTSceneBVH bvh;
 
+#if GeometryCompression == KERNEL_OPTION_TRUE
+	// Bitfield, see RenderBuffers::has_vertex_normals
+	OrochiBuffer<unsigned int> has_vertex_normals;
+	OrochiBuffer<Octahedral24BitNormal> vertex_normals;
+#else
 	OrochiBuffer<unsigned char> has_vertex_normals;
 	OrochiBuffer<float3> vertex_normals;
+#endif
 	OrochiBuffer<int> material_indices;
 	DevicePackedTexturedMaterialSoAGPUData materials_buffer;
 
@@ -135,11 +438,28 @@ struct HIPRTScene
 	int emissive_triangles_count = 0;
 	OrochiBuffer<int> emissive_triangles_indices;
 
+	// Light BVH and power alias table for sampling the emissive triangles. Built on the CPU
+	LightBVH light_bvh;
+	OrochiBuffer<LightBVHNode> light_bvh_nodes;
+	OrochiBuffer<int> light_bvh_triangle_leaf_indices;
+	OrochiBuffer<float> emissive_power_alias_table_probas;
+	OrochiBuffer<int> emissive_power_alias_table_alias;
+
 	// Vector to keep the textures data alive otherwise the OrochiTexture objects would
 	// be destroyed which means that the underlying textures would be destroyed
 	std::vector<OrochiTexture> orochi_materials_textures;
 	OrochiBuffer<oroTextureObject_t> gpu_materials_textures;
+	// See RenderBuffers::material_textures_two_channels
+	OrochiBuffer<unsigned char> material_textures_two_channels;
+#if GeometryCompression == KERNEL_OPTION_TRUE
+	// See QuantizedTexcoordsBuffer
+	OrochiBuffer<Uint2xPacked> texcoords_buffer;
+	OrochiBuffer<float4> texcoords_block_bounds_buffer;
+	OrochiBuffer<int> texcoords_block_first_vertices_buffer;
+	OrochiBuffer<int> texcoords_window_first_blocks_buffer;
+#else
 	OrochiBuffer<float2> texcoords_buffer;
+#endif
 };
 
 #endif
@@ -75,6 +75,13 @@ void OrochiTexture::create_texture_from_array(hipTextureFilterMode filtering_mod
 
 void OrochiTexture::init_from_image(const Image8Bit& image, hipTextureFilterMode filtering_mode, hipTextureAddressMode address_mode)
 {
+	if (image.get_compression_format() != TEXTURE_COMPRESSION_NONE)
+	{
+		init_from_compressed_image(image, filtering_mode, address_mode);
+
+		return;
+	}
+
 	int channels = image.channels;
 	if (channels == 3 || channels > 4)
 	{
@@ -101,6 +108,51 @@ void OrochiTexture::init_from_image(const Image8Bit& image, hipTextureFilterMode
 	create_texture_from_array(filtering_mode, address_mode, true);
 }
 
+void OrochiTexture::init_from_compressed_image(const Image8Bit& image, hipTextureFilterMode filtering_mode, hipTextureAddressMode address_mode)
+{
+	width = image.width;
+	height = image.height;
+
+#ifndef OROCHI_ENABLE_CUEW
+	// Block compressed channel formats aren't exposed by Orochi, using native HIP
+	hipChannelFormatDesc channel_descriptor;
+	switch (image.get_compression_format())
+	{
+	case TEXTURE_COMPRESSION_BC1:
+		channel_descriptor = hipCreateChannelDesc(8, 8, 8, 8, hipChannelFormatKindUnsignedBlockCompressed1);
+		break;
+
+	case TEXTURE_COMPRESSION_BC4:
+		channel_descriptor = hipCreateChannelDesc(8, 0, 0, 0, hipChannelFormatKindUnsignedBlockCompressed4);
+		break;
+
+	case TEXTURE_COMPRESSION_BC5:
+		channel_descriptor = hipCreateChannelDesc(8, 8, 0, 0, hipChannelFormatKindUnsignedBlockCompressed5);
+		break;
+
+	case TEXTURE_COMPRESSION_BC7:
+	default:
+		channel_descriptor = hipCreateChannelDesc(8, 8, 8, 8, hipChannelFormatKindUnsignedBlockCompressed7);
+		break;
+	}
+
+	// The array is sized in texels but the copy is done in rows of blocks
+	int block_row_byte_size = (image.width / TextureCompression::BLOCK_SIZE) * TextureCompression::get_block_byte_size(image.get_compression_format());
+	OROCHI_CHECK_ERROR(hipMallocArray(&m_texture_array, &channel_descriptor, image.width, image.height, hipArrayDefault));
+	OROCHI_CHECK_ERROR(hipMemcpy2DToArray(m_texture_array, 0, 0, image.data().data(),
+		block_row_byte_size,
+		block_row_byte_size,
+		image.height / TextureCompression::BLOCK_SIZE, hipMemcpyHostToDevice));
+
+	create_texture_from_array(filtering_mode, address_mode, true);
+#else
+	// No block compressed textures through CUEW, uploading the decompressed texels
+	Image8Bit decompressed_image(TextureCompression::decompress(image.data().data(), image.width, image.height, image.channels, image.get_compression_format()), image.width, image.height, image.channels);
+
+	init_from_image(decompressed_image, filtering_mode, address_mode);
+#endif
+}
+
 void OrochiTexture::init_from_image(const Image32Bit& image, hipTextureFilterMode filtering_mode, hipTextureAddressMode address_mode)
 {
 	int channels = image.channels;
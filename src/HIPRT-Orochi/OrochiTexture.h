@@ -30,6 +30,10 @@ public:
 	unsigned int width = 0, height = 0;
 
 private:
+	/**
+	 * Uploads the blocks of a block compressed image to a texture of the matching GPU format
+	 */
+	void init_from_compressed_image(const Image8Bit& image, hipTextureFilterMode filtering_mode, hipTextureAddressMode address_mode);
 
 	void create_texture_from_array(hipTextureFilterMode filtering_mode, hipTextureAddressMode address_mode, bool read_mode_float_normalized);
 
@@ -6,6 +6,8 @@
 #ifndef HOST_DEVICE_COMMON_BSDFS_DATA_H
 #define HOST_DEVICE_COMMON_BSDFS_DATA_H
 
+#include "HostDeviceCommon/KernelOptions/PrincipledBSDFKernelOptions.h"
+
  /**
   * What masking-shadowing term to use with the GGX NDF.
   *
@@ -68,6 +70,11 @@ struct BRDFsData
 	int metal_energy_compensation_max_bounce = 0;
 	int clearcoat_energy_compensation_max_bounce = 0;
 	int glossy_base_energy_compensation_max_bounce = 0;
+
+	// Only used by the CPU: lobe masks of the specializations of the principled BSDF, chosen
+	// from the scene by the CPURenderer. See PrincipledBSDFSpecializedLobeMaskX for the GPU
+	unsigned int principled_bsdf_specialized_lobe_masks[PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_COUNT] = { PRINCIPLED_LOBE_NONE };
+	int principled_bsdf_specialized_lobe_mask_count = 0;
 };
 
 #endif
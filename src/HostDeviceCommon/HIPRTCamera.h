@@ -25,7 +25,7 @@ struct HIPRTCamera
     /**
      * Returns a camera ray for pixel (x, y) and the given render solution
      */
-    HIPRT_HOST_DEVICE hiprtRay get_camera_ray(float x, float y, int2 res)
+    HIPRT_HOST_DEVICE hiprtRay get_camera_ray(float x, float y, int2 res) const
     {
         float x_ndc_space = x / res.x * 2 - 1;
         float y_ndc_space = y / res.y * 2 - 1;
@@ -47,6 +47,19 @@ struct HIPRTCamera
 
         return ray;
     }
+
+    /**
+     * Returns the angle (in radians) covered by one pixel at the center of the image.
+     * This is the spread angle of the ray cones of the camera rays
+     */
+    HIPRT_HOST_DEVICE float get_pixel_spread_angle(int2 res) const
+    {
+        float3 center_direction = get_camera_ray(res.x * 0.5f, res.y * 0.5f, res).direction;
+        float3 next_pixel_direction = get_camera_ray(res.x * 0.5f, res.y * 0.5f + 1.0f, res).direction;
+
+        // Chord between the two normalized directions, equal to the angle for small angles
+        return hippt::length(next_pixel_direction - center_direction);
+    }
 };
 
 #endif
@@ -28,6 +28,8 @@ struct HitInfo
     float t = -1.0f;
 
     int primitive_index = -1;
+    // Instance of the mesh of the primitive, see FilterFunctionPayload::last_hit_instance_id
+    int instance_id = -1;
 };
 
 /**
@@ -40,6 +42,7 @@ struct HitInfo
 struct ShadowLightRayHitInfo
 {
     int hit_prim_index;
+    int hit_instance_id;
     int hit_material_index;
     float hit_distance;
 
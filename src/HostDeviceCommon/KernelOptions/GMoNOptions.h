@@ -6,6 +6,8 @@
 #ifndef HOST_DEVICE_COMMON_KERNEL_OPTIONS_GMON_OPTIONS_H
 #define HOST_DEVICE_COMMON_KERNEL_OPTIONS_GMON_OPTIONS_H
 
+#include "HostDeviceCommon/KernelOptions/Common.h"
+
 /**
  * Kernel options for the implementation of GMoN
  * 
@@ -47,4 +49,23 @@
  */
 #define GMoNSortRadixSize 2
 
+/**
+ * If KERNEL_OPTION_TRUE, the GMoN sets store the mean of their samples in half precision
+ * and their number of samples (see GMoNPackedSet) instead of the sum of their samples in full precision.
+ * 
+ * This is 8 bytes per set and per pixel instead of 12. The precision of the means is about 0.05%
+ * which is way below the noise of the sets. The means are rounded stochastically so they stay
+ * unbiased but keep a bit of rounding noise after a few thousands samples per set.
+ */
+#define GMoNUsePackedSets KERNEL_OPTION_FALSE
+
+/**
+ * Up to that many GMoN sets, the means are sorted in registers with a sorting
+ * network instead of the radix sort in shared memory
+ *
+ * Cannot be more than 16 because the index of the sets are stored in 4 bits
+ * when sorting with the sorting network
+ */
+#define GMoNMaxSetsCountForSortingNetwork 16
+
 #endif // #ifndef HOST_DEVICE_COMMON_KERNEL_OPTIONS_GMON_OPTIONS_H
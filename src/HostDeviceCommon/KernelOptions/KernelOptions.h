@@ -52,9 +52,18 @@
 #define LSS_RIS_BSDF_AND_LIGHT 4
 #define LSS_RESTIR_DI 5
 
+#define LSS_BASE_UNIFORM 0
+#define LSS_BASE_POWER 1
+#define LSS_BASE_LIGHT_BVH 2
+
 #define ESS_NO_SAMPLING 0
 #define ESS_BINARY_SEARCH 1
 #define ESS_ALIAS_TABLE 2
+#define ESS_GUIDED_CDF 3
+
+#define PST_WHITE_NOISE 0
+#define PST_SOBOL_OWEN 1
+#define PST_BLUE_NOISE_DITHERED 2
 
 #define RESTIR_DI_BIAS_CORRECTION_1_OVER_M 0
 #define RESTIR_DI_BIAS_CORRECTION_1_OVER_Z 1
@@ -101,6 +110,22 @@
   */
 #define SharedStackBVHTraversalSize 16
 
+/**
+ * If true, the per-vertex data used for shading is stored compressed in the render buffers:
+ *	- Vertex normals are packed in 24 bits with an octahedral mapping (Octahedral24BitNormal)
+ *	- Texture coordinates are quantized on 16 bits per component (QuantizedTexcoordsBuffer)
+ *	- Whether a vertex has a normal or not is one bit of a bitfield instead of one byte per vertex
+ *
+ * This cuts the vertex data fetched at each hit from 21 bytes to about 7 bytes per vertex.
+ *
+ * The compression is lossy (normals and texcoords lose some precision) so it is
+ * opt-in: it is only worth it on scenes whose vertex data doesn't fit in the caches.
+ *
+ * This option changes the layout of the buffers that the renderers fill when the scene is loaded
+ * so it isn't defined in the #ifndef __KERNELCC__ block below: it cannot be changed at runtime
+ */
+#define GeometryCompression KERNEL_OPTION_FALSE
+
 /**
  * If true, the BSDF ray shot for BSDF MIS during the evaluation of NEE will be reused
  * for the next bounce. 
@@ -116,6 +141,26 @@
  */
 #define DoFirstBounceWarpDirectionReuse KERNEL_OPTION_FALSE
 
+/**
+ * What random numbers the path tracer uses for its random decisions
+ * (camera ray jittering, BSDF sampling, light sampling, envmap sampling, russian roulette)
+ *
+ * Possible values (the prefix PST stands for "Path Sampler Type"):
+ *
+ *	- PST_WHITE_NOISE
+ *		Independent random numbers from the Xorshift generator
+ *
+ *	- PST_SOBOL_OWEN
+ *		Owen-scrambled Sobol sequence, scrambled per pixel. Each random decision of the
+ *		path uses its own dimensions of the sequence (see SamplerDimension)
+ *
+ *	- PST_BLUE_NOISE_DITHERED
+ *		Same sequence as PST_SOBOL_OWEN but shared by all the pixels and shifted per pixel
+ *		by a blue noise value: the error is distributed as blue noise in screen space
+ *		which is visually more pleasing at low sample counts
+ */
+#define PathSamplerType PST_SOBOL_OWEN
+
 /**
  * Allows the overriding of the BRDF/BSDF used by the path tracer. When an override is used,
  * the material retains its properties (color, roughness, ...) but only the parameters relevant
@@ -168,6 +213,27 @@
  */
 #define DirectLightSamplingStrategy LSS_RIS_BSDF_AND_LIGHT
 
+/**
+ * How the emissive triangles are picked by the light sampling strategies
+ * (uniform one light, MIS, RIS and the light candidates of ReSTIR DI).
+ * 
+ * Possible values:
+ * 
+ *	- LSS_BASE_UNIFORM
+ *		All the emissive triangles have the same probability of being picked
+ * 
+ *	- LSS_BASE_POWER
+ *		Emissive triangles are picked proportionally to their power (emission luminance * area)
+ *		with an alias table
+ * 
+ *	- LSS_BASE_LIGHT_BVH
+ *		Emissive triangles are picked by traversing a light BVH stochastically, based on the
+ *		power, distance and orientation of the lights with regards to the shaded point.
+ *		The lights presampling of ReSTIR DI isn't done at a given point so it
+ *		uses LSS_BASE_POWER instead
+ */
+#define DirectLightSamplingBaseStrategy LSS_BASE_UNIFORM
+
 /**
  * Whether or not to use NEE++ features at all
  */
@@ -216,6 +282,14 @@
  *	- ESS_BINARY_SEARCH
  *		Importance samples the environment map using a binary search on the CDF
  *		distributions of the envmap
+ *
+ *	- ESS_ALIAS_TABLE
+ *		Importance samples the environment map in O(1) using an alias table
+ *
+ *	- ESS_GUIDED_CDF
+ *		Importance samples the environment map with a marginal CDF over the rows
+ *		and a 16-bit quantized conditional CDF per row, both inverted in O(1) on average with
+ *		guide tables. Uses less than half the memory of the alias table
  */
 #define EnvmapSamplingStrategy ESS_ALIAS_TABLE
 
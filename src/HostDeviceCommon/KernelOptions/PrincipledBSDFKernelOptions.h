@@ -41,6 +41,25 @@
 #define GGX_VNDF_SPHERICAL_CAPS 1
 #define GGX_VNDF_BOUNDED 2
 
+/**
+ * Lobes of the principled BSDF. A combination of these bits is a "lobe mask"
+ * that gives the lobes that a material may use.
+ * 
+ * The two metallic lobes (two roughnesses) are both PRINCIPLED_LOBE_METAL
+ */
+#define PRINCIPLED_LOBE_NONE 0
+#define PRINCIPLED_LOBE_COAT 1
+#define PRINCIPLED_LOBE_SHEEN 2
+#define PRINCIPLED_LOBE_METAL 4
+#define PRINCIPLED_LOBE_SPECULAR 8
+#define PRINCIPLED_LOBE_DIFFUSE 16
+#define PRINCIPLED_LOBE_GLASS 32
+#define PRINCIPLED_LOBE_DIFFUSE_TRANSMISSION 64
+#define PRINCIPLED_LOBE_ALL 127
+
+// Number of PrincipledBSDFSpecializedLobeMaskX options
+#define PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_COUNT 4
+
 /**
  * Options are defined in a #ifndef __KERNELCC__ block because:
  *	- If they were not, the would be defined on the GPU side. However, the -D <macro>=<value> compiler option
@@ -144,6 +163,58 @@
  */
 #define PrincipledBSDFDeltaDistributionEvaluationOptimization KERNEL_OPTION_TRUE
 
+/**
+ * Lobe masks (combinations of PRINCIPLED_LOBE_XXX) for which a specialized version of
+ * the principled BSDF is compiled. The lobes that are not in the mask are removed from
+ * that version at compile time so they cost no instructions and no registers.
+ * 
+ * At each evaluation / sampling, the BSDF uses the first of these versions whose lobe
+ * mask contains all the lobes that the material needs at the hit point, the generic
+ * version with all the lobes is used if there is none.
+ * This means that the masks should be given from the one with the fewest lobes to the one with the most lobes.
+ * 
+ * Each specialization is another copy of the BSDF in the kernels so more specializations
+ * means longer compile times and larger kernels. PRINCIPLED_LOBE_NONE disables the specialization.
+ * 
+ * All the specializations are inlined in the same kernels and the register allocation of a kernel
+ * is the maximum over all its code paths. As long as the generic version is compiled in the kernels,
+ * the specializations thus do not lower the register count (and occupancy) of the kernels, they only
+ * save the instructions executed for the lobes that the material doesn't use.
+ * See PrincipledBSDFSpecializationsCoverScene for removing the generic version from the kernels.
+ * The register counts are given in the "Kernels compilation statistics" of the "Shaders/Kernels" settings,
+ * setting all the masks to PRINCIPLED_LOBE_NONE gives the counts without the specializations.
+ * 
+ * On the GPU, these options are set by the GPURenderer when it is created, before the kernels
+ * are compiled, from the lobe combinations used by the materials of the scene.
+ * The CPU doesn't use these options: the CPURenderer chooses the specializations from the scene
+ * at runtime, see BRDFsData::principled_bsdf_specialized_lobe_masks.
+ * The default values below are the combinations commonly found in scenes:
+ *	- pure metals
+ *	- dielectrics: specular + diffuse
+ *	- glass: specular + glass
+ *	- metallic textures: metal + specular + diffuse
+ */
+#define PrincipledBSDFSpecializedLobeMask0 PRINCIPLED_LOBE_METAL
+#define PrincipledBSDFSpecializedLobeMask1 (PRINCIPLED_LOBE_SPECULAR | PRINCIPLED_LOBE_DIFFUSE)
+#define PrincipledBSDFSpecializedLobeMask2 (PRINCIPLED_LOBE_SPECULAR | PRINCIPLED_LOBE_GLASS)
+#define PrincipledBSDFSpecializedLobeMask3 (PRINCIPLED_LOBE_METAL | PRINCIPLED_LOBE_SPECULAR | PRINCIPLED_LOBE_DIFFUSE)
+
+/**
+ * Whether or not every material of the scene is covered by one of the PrincipledBSDFSpecializedLobeMaskX
+ * specializations i.e. the generic version of the BSDF with all the lobes is never needed.
+ * 
+ * If KERNEL_OPTION_TRUE, the generic version isn't compiled in the kernels anymore and the last
+ * specialization is used in its place so the register count of the kernels is the one of the largest
+ * specialization instead of the one of the full BSDF.
+ * This must only be set if all the materials are covered, the lobes of a material that is not covered
+ * would be ignored.
+ * 
+ * Set by the GPURenderer, along with the specializations, when they cover all the materials of the scene.
+ * 
+ * Possible options are KERNEL_OPTION_TRUE and KERNEL_OPTION_FALSE. Self explanatory.
+ */
+#define PrincipledBSDFSpecializationsCoverScene KERNEL_OPTION_FALSE
+
 #endif // #ifndef __KERNELCC__
 
 #endif
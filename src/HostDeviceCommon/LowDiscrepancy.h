@@ -0,0 +1,191 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef HOST_DEVICE_COMMON_LOW_DISCREPANCY_H
+#define HOST_DEVICE_COMMON_LOW_DISCREPANCY_H
+
+#include "HostDeviceCommon/Math.h"
+
+/**
+ * Low discrepancy sequences used by the path tracer when PathSamplerType isn't PST_WHITE_NOISE.
+ *
+ * The sequence is a 4D Sobol sequence, Owen-scrambled with the hash-based nested uniform
+ * scrambling of [1]. Dimensions above 4 are obtained by padding: each group of 4 dimensions
+ * uses the same 4D Sobol sequence but with its own shuffling of the sample indices and its own
+ * scrambling so that the groups are decorrelated from each other [1].
+ *
+ * References:
+ * [1] [Practical Hash-based Owen Scrambling, Burley, 2020]
+ * [2] [Blue-noise Dithered Sampling, Georgiev, Fajardo, 2016]
+ * [3] [Next Generation Post Processing in Call of Duty: Advanced Warfare, Jimenez, 2014]
+ */
+
+/**
+ * Dimensions of the low discrepancy sequence used by each random decision of a path.
+ *
+ * A path first uses the camera dimensions and then SamplerDimension::PER_BOUNCE dimensions per bounce.
+ * Each decision starts on a multiple of 4 so that the dimensions of a decision are always
+ * in the same 4D Sobol group
+ */
+struct SamplerDimension
+{
+    // Jittering of the camera ray in the pixel. 2 dimensions
+    static constexpr unsigned int PIXEL = 0;
+    // Point on the lens of the camera. 2 dimensions. Reserved for depth of field
+    static constexpr unsigned int LENS = 2;
+
+    static constexpr unsigned int FIRST_BOUNCE = 4;
+    static constexpr unsigned int PER_BOUNCE = 16;
+
+    // Offsets of the decisions of a bounce, relative to the first dimension of the bounce
+    //
+    // Lobe selection + direction sampling of the BSDF
+    static constexpr unsigned int BSDF = 0;
+    static constexpr unsigned int BSDF_COUNT = 4;
+    // Light selection + point on the light
+    static constexpr unsigned int LIGHT = 4;
+    static constexpr unsigned int LIGHT_COUNT = 3;
+    // Texel selection + point in the texel of the envmap
+    static constexpr unsigned int ENVMAP = 8;
+    static constexpr unsigned int ENVMAP_COUNT = 4;
+    // Russian roulette
+    static constexpr unsigned int RUSSIAN_ROULETTE = 12;
+    static constexpr unsigned int RUSSIAN_ROULETTE_COUNT = 1;
+
+    HIPRT_HOST_DEVICE HIPRT_INLINE static unsigned int bounce_dimension(int bounce, unsigned int decision_offset)
+    {
+        return FIRST_BOUNCE + bounce * PER_BOUNCE + decision_offset;
+    }
+};
+
+struct LowDiscrepancySamplerState
+{
+    // Index of the sample in the sequence
+    unsigned int sample_index = 0;
+    // Seed of the Owen scrambling. Per pixel with PST_SOBOL_OWEN,
+    // the same for all pixels with PST_BLUE_NOISE_DITHERED
+    unsigned int scramble_seed = 0;
+
+    // Only used by PST_BLUE_NOISE_DITHERED
+    unsigned int pixel_x = 0;
+    unsigned int pixel_y = 0;
+
+    // Next dimension returned and end (excluded) of the dimensions that can be returned.
+    // White noise is returned once 'dimension' reaches 'dimension_end'
+    unsigned int dimension = 0;
+    unsigned int dimension_end = 0;
+};
+
+HIPRT_HOST_DEVICE HIPRT_INLINE unsigned int reverse_bits(unsigned int x)
+{
+    x = (x << 16u) | (x >> 16u);
+    x = ((x & 0x55555555u) << 1u) | ((x & 0xAAAAAAAAu) >> 1u);
+    x = ((x & 0x33333333u) << 2u) | ((x & 0xCCCCCCCCu) >> 2u);
+    x = ((x & 0x0F0F0F0Fu) << 4u) | ((x & 0xF0F0F0F0u) >> 4u);
+    x = ((x & 0x00FF00FFu) << 8u) | ((x & 0xFF00FF00u) >> 8u);
+
+    return x;
+}
+
+HIPRT_HOST_DEVICE HIPRT_INLINE unsigned int hash_combine(unsigned int seed, unsigned int value)
+{
+    return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+/**
+ * Permutation of the bits of 'x' where each bit only depends on the bits below it.
+ * Improved constants from [1]
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE unsigned int laine_karras_permutation(unsigned int x, unsigned int seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+
+    return x;
+}
+
+/**
+ * Owen scrambling of 'x' (in base 2)
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE unsigned int nested_uniform_scramble(unsigned int x, unsigned int seed)
+{
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+/**
+ * Component 'dimension' (in [0, 3]) of the 'index'-th point of the 4D Sobol sequence
+ *
+ * The direction numbers are computed on the fly from the primitive polynomials
+ * and initial direction numbers of [Joe, Kuo, 2008]:
+ *  - dimension 1: x + 1, m = { 1 }
+ *  - dimension 2: x^2 + x + 1, m = { 1, 3 }
+ *  - dimension 3: x^3 + x + 1, m = { 1, 3, 1 }
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE unsigned int sobol_4d_component(unsigned int index, unsigned int dimension)
+{
+    if (dimension == 0)
+        // Van der Corput sequence
+        return reverse_bits(index);
+
+    // Last three direction numbers v(k - 1), v(k - 2) and v(k - 3)
+    unsigned int v1 = 0, v2 = 0, v3 = 0;
+    unsigned int result = 0;
+    for (unsigned int k = 0; index != 0; k++, index >>= 1)
+    {
+        unsigned int v;
+        if (dimension == 1)
+            v = k == 0 ? 0x80000000u : v1 ^ (v1 >> 1);
+        else if (dimension == 2)
+            v = k == 0 ? 0x80000000u : (k == 1 ? 0xC0000000u : v1 ^ v2 ^ (v2 >> 2));
+        else
+            v = k == 0 ? 0x80000000u : (k == 1 ? 0xC0000000u : (k == 2 ? 0x20000000u : v2 ^ v3 ^ (v3 >> 3)));
+
+        if (index & 1u)
+            result ^= v;
+
+        v3 = v2;
+        v2 = v1;
+        v1 = v;
+    }
+
+    return result;
+}
+
+/**
+ * Interleaved gradient noise [3]: cheap screen space noise whose values
+ * are well distributed over the neighboring pixels
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float interleaved_gradient_noise(float x, float y)
+{
+    return hippt::fract(52.9829189f * hippt::fract(0.06711056f * x + 0.00583715f * y));
+}
+
+/**
+ * Returns the given dimension of the current sample of the sampler in [0, 1[
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float low_discrepancy_sample(const LowDiscrepancySamplerState& state, unsigned int dimension, bool blue_noise_dithered)
+{
+    unsigned int group_seed = hash_combine(state.scramble_seed, dimension / 4);
+
+    // Shuffling the sample indices per group of dimensions for padding
+    unsigned int shuffled_index = nested_uniform_scramble(state.sample_index, group_seed);
+    unsigned int component = dimension % 4;
+    unsigned int sobol = nested_uniform_scramble(sobol_4d_component(shuffled_index, component), hash_combine(group_seed, component));
+
+    // 24 bits of mantissa
+    float sample = (sobol >> 8) * (1.0f / 16777216.0f);
+    if (blue_noise_dithered)
+        // Toroidal shift of the sample by a blue noise value [2]. All the pixels use the
+        // same sequence and the shift distributes the error as blue noise in screen space.
+        // The shift is offset per dimension to decorrelate the dimensions
+        sample = hippt::fract(sample + interleaved_gradient_noise(state.pixel_x + 5.588238f * dimension, state.pixel_y + 5.588238f * dimension));
+
+    return sample;
+}
+
+#endif
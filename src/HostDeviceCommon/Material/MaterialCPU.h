@@ -165,6 +165,29 @@ struct CPUMaterial
             || emissive_texture_used;
     }
 
+    /**
+     * Lobes of the principled BSDF (combination of PRINCIPLED_LOBE_XXX) that this material
+     * may use anywhere on its surface, seen from outside or from inside of the object.
+     *
+     * The parameters read from a texture can take any value so their lobes are considered used
+     */
+    unsigned int get_principled_lobe_mask() const
+    {
+        bool metallic_textured = metallic_texture_index != MaterialUtils::NO_TEXTURE || roughness_metallic_texture_index != MaterialUtils::NO_TEXTURE;
+        bool specular_textured = specular_texture_index != MaterialUtils::NO_TEXTURE;
+        bool coat_textured = coat_texture_index != MaterialUtils::NO_TEXTURE;
+        bool sheen_textured = sheen_texture_index != MaterialUtils::NO_TEXTURE;
+        bool specular_transmission_textured = specular_transmission_texture_index != MaterialUtils::NO_TEXTURE;
+
+        unsigned int outside_lobe_mask = MaterialUtils::get_principled_lobe_mask(coat_textured ? 1.0f : coat, sheen_textured ? 1.0f : sheen,
+                                                                                 metallic_textured ? 0.0f : metallic, metallic_textured ? 1.0f : metallic,
+                                                                                 specular_textured ? 1.0f : specular,
+                                                                                 specular_transmission_textured ? 0.0f : specular_transmission, specular_transmission_textured ? 1.0f : specular_transmission,
+                                                                                 diffuse_transmission, diffuse_transmission);
+
+        return MaterialUtils::add_principled_inside_lobes(outside_lobe_mask, diffuse_transmission, diffuse_transmission);
+    }
+
     /*
      * Clamps some of the parameters of the material to avoid edge cases like NaNs
      * during rendering (i.e. numerical instabilities)
@@ -97,6 +97,67 @@ struct MaterialUtils
         return true;
     }
 
+    /**
+     * Returns the lobes of the principled BSDF (combination of PRINCIPLED_LOBE_XXX) that may have a non-zero
+     * weight when the BSDF is evaluated from outside of the object, for a material whose parameters
+     * are in the given [min, max] ranges.
+     *
+     * The min and max are the same value when the parameters of the material at the hit point
+     * are known. The host gives the full [0, 1] range for the parameters that are read from a texture.
+     *
+     * The conditions follow the lobes weights of principled_bsdf_get_lobes_weights() but the
+     * specular lobe is also included as long as 'specular' isn't 0 because the specular layer
+     * attenuates the layers below it (glass, diffuse transmission) even when it has no weight
+     */
+    HIPRT_HOST_DEVICE static unsigned int get_principled_lobe_mask(float coat_max, float sheen_max,
+                                                                   float metallic_min, float metallic_max, float specular_max,
+                                                                   float specular_transmission_min, float specular_transmission_max,
+                                                                   float diffuse_transmission_min, float diffuse_transmission_max)
+    {
+        unsigned int lobe_mask = PRINCIPLED_LOBE_NONE;
+
+        bool not_fully_metallic = metallic_min < 1.0f;
+
+        if (coat_max > 0.0f)
+            lobe_mask |= PRINCIPLED_LOBE_COAT;
+        if (sheen_max > 0.0f)
+            lobe_mask |= PRINCIPLED_LOBE_SHEEN;
+        if (metallic_max > 0.0f)
+            lobe_mask |= PRINCIPLED_LOBE_METAL;
+        if (specular_max > 0.0f && not_fully_metallic)
+            lobe_mask |= PRINCIPLED_LOBE_SPECULAR;
+        if (not_fully_metallic && specular_transmission_min < 1.0f && diffuse_transmission_min < 1.0f)
+            lobe_mask |= PRINCIPLED_LOBE_DIFFUSE;
+        if (not_fully_metallic && specular_transmission_max > 0.0f && diffuse_transmission_min < 1.0f)
+            lobe_mask |= PRINCIPLED_LOBE_GLASS;
+        if (not_fully_metallic && diffuse_transmission_max > 0.0f)
+            lobe_mask |= PRINCIPLED_LOBE_DIFFUSE_TRANSMISSION;
+
+        return lobe_mask;
+    }
+
+    /**
+     * Adds to 'outside_lobe_mask' (see get_principled_lobe_mask()) the lobes of the principled BSDF
+     * that may have a non-zero weight when the BSDF is evaluated from inside of the object.
+     *
+     * Only the materials with a glass or diffuse transmission lobe are evaluated from inside of the object.
+     * The shading normal of the others is flipped towards the view direction and they are evaluated from
+     * outside, see principled_bsdf_get_lobes_weights_fringe_fix()
+     */
+    HIPRT_HOST_DEVICE static unsigned int add_principled_inside_lobes(unsigned int outside_lobe_mask, float diffuse_transmission_min, float diffuse_transmission_max)
+    {
+        if (!(outside_lobe_mask & (PRINCIPLED_LOBE_GLASS | PRINCIPLED_LOBE_DIFFUSE_TRANSMISSION)))
+            return outside_lobe_mask;
+
+        unsigned int lobe_mask = outside_lobe_mask;
+        if (diffuse_transmission_min < 1.0f)
+            lobe_mask |= PRINCIPLED_LOBE_GLASS;
+        if (diffuse_transmission_max > 0.0f)
+            lobe_mask |= PRINCIPLED_LOBE_DIFFUSE_TRANSMISSION;
+
+        return lobe_mask;
+    }
+
     enum SpecularDeltaReflectionSampled : int
     {
         NOT_SPECULAR = -1,
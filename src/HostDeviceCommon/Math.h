@@ -158,6 +158,9 @@ namespace hippt
 	template <typename T>
 	__device__ T atomic_compare_exchange(T* address, T expected, T new_value) { return atomicCAS(address, expected, new_value); }
 
+	template <typename T>
+	__device__ T atomic_exchange(T* address, T new_value) { return atomicExch(address, new_value); }
+
 	/**
 	 * For t=0, returns a
 	 */
@@ -302,8 +305,17 @@ namespace hippt
 	template <typename T>
 	T atomic_fetch_add(std::atomic<T>* atomic_address, T increment) { return atomic_address->fetch_add(increment); }
 
+	/**
+	 * Returns the value that was stored at the address before the exchange, same as atomicCAS() on the GPU
+	 */
 	template <typename T>
-	T atomic_compare_exchange(std::atomic<T>* atomic_address, T expected, T new_value) { return atomic_address->compare_exchange_strong(expected, new_value); }
+	T atomic_compare_exchange(std::atomic<T>* atomic_address, T expected, T new_value) { atomic_address->compare_exchange_strong(expected, new_value); return expected; }
+
+	/**
+	 * Returns the value that was stored at the address before the exchange, same as atomicExch() on the GPU
+	 */
+	template <typename T>
+	T atomic_exchange(std::atomic<T>* atomic_address, T new_value) { return atomic_address->exchange(new_value); }
 
 	/**
 	 * For t=0, returns a
@@ -430,6 +442,77 @@ HIPRT_HOST_DEVICE HIPRT_INLINE float3 matrix_X_vec(const float4x4& m, const floa
 	return make_float3(xt * inv_w, yt * inv_w, zt * inv_w);
 }
 
+/**
+ * Affine transforms (the object to world transforms of the meshes for example)
+ * are stored row-major, m[row][column], with the translation in the last column
+ * and (0, 0, 0, 1) as the last row. matrix_X_point() applies them to points
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float4x4 identity_affine_matrix()
+{
+	float4x4 identity;
+	identity.m[0][0] = 1.0f;
+	identity.m[1][1] = 1.0f;
+	identity.m[2][2] = 1.0f;
+	identity.m[3][3] = 1.0f;
+
+	return identity;
+}
+
+/**
+ * Applies the linear part of the affine transform 'm' to the vector 'u'
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float3 affine_matrix_X_vec(const float4x4& m, const float3& u)
+{
+	return make_float3(m.m[0][0] * u.x + m.m[0][1] * u.y + m.m[0][2] * u.z,
+					   m.m[1][0] * u.x + m.m[1][1] * u.y + m.m[1][2] * u.z,
+					   m.m[2][0] * u.x + m.m[2][1] * u.y + m.m[2][2] * u.z);
+}
+
+HIPRT_HOST_DEVICE HIPRT_INLINE float4x4 affine_matrix_inverse(const float4x4& m)
+{
+	// Inverse of the 3x3 linear part with the cofactors
+	float c00 = m.m[1][1] * m.m[2][2] - m.m[1][2] * m.m[2][1];
+	float c01 = m.m[1][2] * m.m[2][0] - m.m[1][0] * m.m[2][2];
+	float c02 = m.m[1][0] * m.m[2][1] - m.m[1][1] * m.m[2][0];
+	float determinant = m.m[0][0] * c00 + m.m[0][1] * c01 + m.m[0][2] * c02;
+	float inverse_determinant = 1.0f / determinant;
+
+	float4x4 inverse;
+	inverse.m[0][0] = c00 * inverse_determinant;
+	inverse.m[1][0] = c01 * inverse_determinant;
+	inverse.m[2][0] = c02 * inverse_determinant;
+	inverse.m[0][1] = (m.m[0][2] * m.m[2][1] - m.m[0][1] * m.m[2][2]) * inverse_determinant;
+	inverse.m[1][1] = (m.m[0][0] * m.m[2][2] - m.m[0][2] * m.m[2][0]) * inverse_determinant;
+	inverse.m[2][1] = (m.m[0][1] * m.m[2][0] - m.m[0][0] * m.m[2][1]) * inverse_determinant;
+	inverse.m[0][2] = (m.m[0][1] * m.m[1][2] - m.m[0][2] * m.m[1][1]) * inverse_determinant;
+	inverse.m[1][2] = (m.m[0][2] * m.m[1][0] - m.m[0][0] * m.m[1][2]) * inverse_determinant;
+	inverse.m[2][2] = (m.m[0][0] * m.m[1][1] - m.m[0][1] * m.m[1][0]) * inverse_determinant;
+
+	// The inverse translation is the opposite of the translation brought back by the inverse linear part
+	float3 inverse_translation = affine_matrix_X_vec(inverse, make_float3(m.m[0][3], m.m[1][3], m.m[2][3]));
+	inverse.m[0][3] = -inverse_translation.x;
+	inverse.m[1][3] = -inverse_translation.y;
+	inverse.m[2][3] = -inverse_translation.z;
+	inverse.m[3][3] = 1.0f;
+
+	return inverse;
+}
+
+/**
+ * Returns the matrix that transforms the normals of a surface transformed
+ * by the affine transform whose inverse is 'inverse_m' (the inverse transpose)
+ */
+HIPRT_HOST_DEVICE HIPRT_INLINE float4x4 affine_normal_matrix(const float4x4& inverse_m)
+{
+	float4x4 normal_matrix;
+	for (int row = 0; row < 3; row++)
+		for (int column = 0; column < 3; column++)
+			normal_matrix.m[row][column] = inverse_m.m[column][row];
+	normal_matrix.m[3][3] = 1.0f;
+
+	return normal_matrix;
+}
+
 #ifndef __KERNELCC__
 
 #include <iostream>
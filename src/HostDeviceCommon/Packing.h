@@ -220,16 +220,173 @@ struct Uint2xPacked
 		m_packed &= ~(0xFFFFu << (index * 16));
 
 		// Set
-		m_packed |= value << (index * 16);
+		m_packed |= static_cast<unsigned int>(value) << (index * 16);
 	}
 
 private:
 	unsigned int m_packed = 0;
 };
 
+/**
+ * Packs a float2 as two IEEE 754 half floats (1 sign bit, 5 exponent bits, 10 mantissa bits)
+ * into a 32 bit unsigned int. x is in the 16 LSB.
+ *
+ * The relative precision is 2^-11 which is about 0.0005 for values in [0.5, 1].
+ * Values too large for a half are packed as infinity and values too small are flushed to 0.
+ */
+struct Half2xPacked
+{
+	HIPRT_HOST_DEVICE float2 unpack() const
+	{
+		return make_float2(half_to_float(m_packed & 0xFFFFu), half_to_float(m_packed >> 16));
+	}
+
+	HIPRT_HOST_DEVICE void pack(float2 value)
+	{
+		m_packed = float_to_half(value.x) | (float_to_half(value.y) << 16);
+	}
+
+	/**
+	 * Same as pack() but with stochastic rounding, see float_to_half_stochastic()
+	 */
+	HIPRT_HOST_DEVICE void pack_stochastic(float2 value, float random)
+	{
+		m_packed = float_to_half_stochastic(value.x, random) | (float_to_half_stochastic(value.y, random) << 16);
+	}
+
+	/**
+	 * Returns the 16 bits of the half float closest to 'value'
+	 */
+	HIPRT_HOST_DEVICE static unsigned int float_to_half(float value)
+	{
+		unsigned int bits = hippt::asuint(value);
+		unsigned int sign = (bits >> 16) & 0x8000u;
+		int exponent = static_cast<int>((bits >> 23) & 0xFFu) - 127 + 15;
+		unsigned int mantissa = bits & 0x7FFFFFu;
+
+		if (exponent <= 0)
+			// Too small for a normalized half, flushing to 0
+			return sign;
+		else if (exponent >= 31)
+			// Too large (or NaN / infinity), packing as infinity
+			return sign | 0x7C00u;
+
+		// Round to nearest even on the 13 mantissa bits that are dropped
+		unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+		unsigned int dropped = mantissa & 0x1FFFu;
+		if (dropped > 0x1000u || (dropped == 0x1000u && (half & 1u)))
+			// The carry may overflow into the exponent, which is the correct rounding
+			half++;
+
+		return half;
+	}
+
+	/**
+	 * Returns the 16 bits of one of the two half floats around 'value', picked randomly
+	 * with 'random' in [0, 1[ such that the expected value of the half is 'value'.
+	 *
+	 * Round to nearest is biased when small increments are repeatedly added to a half:
+	 * the increments below half an ULP are always lost. They are kept on average here
+	 */
+	HIPRT_HOST_DEVICE static unsigned int float_to_half_stochastic(float value, float random)
+	{
+		unsigned int bits = hippt::asuint(value);
+		unsigned int sign = (bits >> 16) & 0x8000u;
+		int exponent = static_cast<int>((bits >> 23) & 0xFFu) - 127 + 15;
+		unsigned int mantissa = bits & 0x7FFFFFu;
+
+		if (exponent <= 0)
+		{
+			// Too small for a normalized half, rounding between 0 and the smallest normalized half
+			// because the packing doesn't produce denormals
+			const float min_normal_half = 6.103515625e-05f;
+
+			return (random * min_normal_half < hippt::abs(value)) ? (sign | (1u << 10)) : sign;
+		}
+		else if (exponent >= 31)
+			// Too large (or NaN / infinity), packing as infinity
+			return sign | 0x7C00u;
+
+		unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+		unsigned int dropped = mantissa & 0x1FFFu;
+		if (random * 8192.0f < static_cast<float>(dropped))
+			// Rounding up with a probability proportional to the dropped bits.
+			// The carry may overflow into the exponent, which is the correct rounding
+			half++;
+
+		return half;
+	}
+
+	/**
+	 * Returns the float value of the half float stored in the 16 LSB of 'half'
+	 */
+	HIPRT_HOST_DEVICE static float half_to_float(unsigned int half)
+	{
+		unsigned int sign = (half & 0x8000u) << 16;
+		unsigned int exponent = (half >> 10) & 0x1Fu;
+		unsigned int mantissa = half & 0x3FFu;
+
+		if (exponent == 0)
+			// Zero, the packing never produces denormals
+			return hippt::asfloat(sign);
+		else if (exponent == 31)
+			return hippt::asfloat(sign | 0x7F800000u | (mantissa << 13));
+
+		return hippt::asfloat(sign | ((exponent - 15 + 127) << 23) | (mantissa << 13));
+	}
+
+private:
+	unsigned int m_packed = 0;
+};
+
+/**
+ * Texture coordinates of the vertices of the scene quantized on 16 bits per component.
+ *
+ * The vertices are grouped in blocks of BLOCK_SIZE consecutive vertices and the texcoords
+ * of a vertex are quantized in the bounds of the texcoords of its block. The precision thus
+ * depends on the extent of the texcoords of the block but not on their magnitude: tiled texcoords
+ * around u = 100 are as precise as texcoords in [0, 1], which isn't the case with half floats.
+ *
+ * The vertices of a mesh are contiguous so a block is almost always in a single mesh
+ */
+struct QuantizedTexcoordsBuffer
+{
+	// Maximum number of vertices in a block
+	static constexpr int BLOCK_SIZE = 64;
+
+	HIPRT_HOST_DEVICE float2 unpack(int vertex_index) const
+	{
+		int block_index = window_first_blocks[vertex_index / BLOCK_SIZE];
+		// Meshes that start in the window of the vertex start a new block
+		while (block_first_vertices[block_index + 1] <= vertex_index)
+			block_index++;
+
+		float4 bounds = block_bounds[block_index];
+		Uint2xPacked quantized = quantized_texcoords[vertex_index];
+
+		return make_float2(bounds.x + quantized.get_value<0>() * bounds.z, bounds.y + quantized.get_value<1>() * bounds.w);
+	}
+
+	// Texcoords of each vertex, quantized in the bounds of its block
+	Uint2xPacked* quantized_texcoords = nullptr;
+	// For each block of vertices, the minimum U and V of the block in xy
+	// and the size of one quantization step in U and V in zw
+	float4* block_bounds = nullptr;
+
+	// The blocks never span two meshes: the texcoords of different meshes usually are in unrelated
+	// ranges and a shared block would quantize them coarsely. The blocks of a mesh start at its
+	// first vertex and are BLOCK_SIZE vertices long, except the last one.
+	//
+	// Index of the first vertex of each block. One more element than there are blocks
+	int* block_first_vertices = nullptr;
+	// For each window of BLOCK_SIZE vertices of the scene (vertices [i * BLOCK_SIZE, (i + 1) * BLOCK_SIZE)),
+	// the index of the block of the first vertex of the window
+	int* window_first_blocks = nullptr;
+};
+
 /**
  * Reference:
- * 
+ *
  * [1] [Survey of Efficient Representations for Independent Unit Vectors, Cigolle et al., 2014]
  */
 struct Octahedral24BitNormal
@@ -240,7 +397,7 @@ public:
 		float2_to_Snorm12_2x_as_3UChar(octahedral_encode(normal), packed_x, packed_y, packed_z);
 	}
 
-	HIPRT_HOST_DEVICE float3 unpack()
+	HIPRT_HOST_DEVICE float3 unpack() const
 	{
 		float2 v = Snorm12_2x_as_UChar_to_float2(packed_x, packed_y, packed_z);
 		return final_decode(v.x, v.y);
@@ -274,7 +431,7 @@ private:
 
 	HIPRT_HOST_DEVICE float2 octahedral_encode(float3 v)
 	{
-		float l1norm_inv = 1.0f / (abs(v.x) + abs(v.y) + abs(v.z));
+		float l1norm_inv = 1.0f / (hippt::abs(v.x) + hippt::abs(v.y) + hippt::abs(v.z));
 		float2 result = make_float2(v.x * l1norm_inv, v.y * l1norm_inv);
 		if (v.z < 0.0f)
 			result = (make_float2(1.0f) - make_float2(hippt::abs(result.y), hippt::abs(result.x))) * sign_not_zero(make_float2(result.x, result.y));
@@ -282,19 +439,19 @@ private:
 		return result;
 	}
 
-	HIPRT_HOST_DEVICE float sign_not_zero(float k)
+	HIPRT_HOST_DEVICE float sign_not_zero(float k) const
 	{
 		return k >= 0.0f ? 1.0f : -1.0f;
 	}
 
-	HIPRT_HOST_DEVICE float2 sign_not_zero(float2 v)
+	HIPRT_HOST_DEVICE float2 sign_not_zero(float2 v) const
 	{
 		return make_float2(sign_not_zero(v.x), sign_not_zero(v.y));
 	}
 
-	HIPRT_HOST_DEVICE float3 final_decode(float x, float y) 
+	HIPRT_HOST_DEVICE float3 final_decode(float x, float y) const
 	{
-		float3 v = make_float3(x, y, 1.0f - abs(x) - abs(y));
+		float3 v = make_float3(x, y, 1.0f - hippt::abs(x) - hippt::abs(y));
 		if (v.z < 0.0f) 
 		{
 			float2 temp = make_float2(v.x, v.y);
@@ -304,7 +461,7 @@ private:
 		return hippt::normalize(v);
 	}
 
-	HIPRT_HOST_DEVICE float2 Snorm12_2x_as_Uchar_to_packed_float2(unsigned char x, unsigned char y, unsigned char z)
+	HIPRT_HOST_DEVICE float2 Snorm12_2x_as_Uchar_to_packed_float2(unsigned char x, unsigned char y, unsigned char z) const
 	{
 		float2 s;
 
@@ -315,12 +472,12 @@ private:
 		return s;
 	}
 
-	HIPRT_HOST_DEVICE float unpack_Snorm12(float f)
+	HIPRT_HOST_DEVICE float unpack_Snorm12(float f) const
 	{
 		return hippt::clamp(-1.0f, 1.0f, (f / 2047.0f) - 1.0f);
 	}
 
-	HIPRT_HOST_DEVICE float2 Snorm12_2x_as_UChar_to_float2(unsigned char x, unsigned char y, unsigned char z)
+	HIPRT_HOST_DEVICE float2 Snorm12_2x_as_UChar_to_float2(unsigned char x, unsigned char y, unsigned char z) const
 	{
 		float2 s = Snorm12_2x_as_Uchar_to_packed_float2(x, y, z);
 		return make_float2(unpack_Snorm12(s.x), unpack_Snorm12(s.y));
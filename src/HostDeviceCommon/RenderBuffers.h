@@ -7,7 +7,11 @@
 #define HOST_DEVICE_COMMON_RENDER_BUFFERS_H
 
 #include "Device/includes/GMoN/GMoNDevice.h"
+#include "Device/includes/LightBVH/LightBVHDevice.h"
+#include "Device/includes/Wavefront/WavefrontQueues.h"
+#include "HostDeviceCommon/KernelOptions/KernelOptions.h"
 #include "HostDeviceCommon/Material/MaterialPackedSoA.h"
+#include "HostDeviceCommon/Packing.h"
 
 struct RenderBuffers
 {
@@ -19,12 +23,36 @@ struct RenderBuffers
 	// Data for the GMoN estimator
 	GMoNDevice gmon_estimator;
 
+	// Path states and queues of the wavefront path tracer.
+	// Only allocated by the CPU renderer when wavefront path tracing is used
+	WavefrontQueues wavefront;
+
 	// A device pointer to the buffer of triangles vertex indices
 	// triangles_indices[0], triangles_indices[1] and triangles_indices[2]
 	// represent the indices of the vertices of the first triangle for example
 	int* triangles_indices = nullptr;
+	// GPU only. For each instance of the TLAS of the GPU, index of the first
+	// triangle of its mesh in the triangle buffers. See get_scene_primitive_index()
+	int* instance_primitive_offsets = nullptr;
+	// Object to world transform of each instance of the scene and the matrix that brings
+	// the normals of the instance to world space, indexed by the 'instanceID' of the hits.
+	// nullptr if all the geometry of the scene is already in world space (scene without instancing
+	// or single-level BVH on the CPU). See instance_to_world_point()
+	float4x4* instance_object_to_world = nullptr;
+	float4x4* instance_normal_to_world = nullptr;
 	// A device pointer to the buffer of triangle vertices positions
 	float3* vertices_positions = nullptr;
+#if GeometryCompression == KERNEL_OPTION_TRUE
+	// A device pointer to a bitfield that indicates whether or not
+	// a vertex normal is available for the given vertex index.
+	// Bit 'vertex_index % 32' of has_vertex_normals[vertex_index / 32]
+	unsigned int* has_vertex_normals = nullptr;
+	// The smooth normal at each vertex of the scene, octahedral-packed.
+	// Needs to be indexed by a vertex index
+	Octahedral24BitNormal* vertex_normals = nullptr;
+	// Texture coordinates at each vertices, quantized on 16 bits
+	QuantizedTexcoordsBuffer texcoords;
+#else
 	// A device pointer to a buffer filled with 0s and 1s that
 	// indicates whether or not a vertex normal is available for
 	// the given vertex index
@@ -34,6 +62,7 @@ struct RenderBuffers
 	float3* vertex_normals = nullptr;
 	// Texture coordinates at each vertices
 	float2* texcoords = nullptr;
+#endif
 
 	// Index of the material used by each triangle of the scene
 	int* material_indices = nullptr;
@@ -52,10 +81,24 @@ struct RenderBuffers
 	int emissive_triangles_count = 0;
 	int* emissive_triangles_indices = nullptr;
 
+	// Alias table for picking emissive triangles proportionally to their power.
+	// Indexed like 'emissive_triangles_indices'
+	float* emissive_power_alias_table_probas = nullptr;
+	int* emissive_power_alias_table_alias = nullptr;
+
+	// Light BVH over the emissive triangles for
+	// DirectLightSamplingBaseStrategy == LSS_BASE_LIGHT_BVH.
+	// Also used for the power of the triangles by LSS_BASE_POWER
+	LightBVHDevice light_bvh;
+
 	// A pointer either to an array of Image8Bit or to an array of
 	// oroTextureObject_t whether if CPU or GPU rendering respectively
 	// This pointer can be cast for the textures to be be retrieved.
 	void* material_textures = nullptr;
+	// For each texture of 'material_textures', 1 if the texture only stores its red and green channels.
+	// These are the BC5 compressed normal maps (see TextureCompression), the Z of their
+	// normals is reconstructed from X and Y
+	unsigned char* material_textures_two_channels = nullptr;
 };
 
 #endif
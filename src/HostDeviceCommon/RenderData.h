@@ -97,8 +97,8 @@ struct HIPRTRenderData
 	// random seed on the GPU for the random number generator to get started
 	unsigned int random_seed = 42;
 
-	// HIPRT BVH
-	hiprtGeometry GPU_BVH = nullptr;
+	// HIPRT BVH: TLAS over one BLAS per mesh
+	hiprtScene GPU_BVH = nullptr;
 	// GPU Intersection functions (for alpha testing for example)
 	hiprtFuncTable hiprt_function_table = nullptr;
 
@@ -6,6 +6,7 @@
 #ifndef HOST_DEVICE_COMMON_WORLD_SETTINGS_H
 #define HOST_DEVICE_COMMON_WORLD_SETTINGS_H
 
+#include "Device/includes/EnvmapGuidedCDF/EnvmapGuidedCDFDevice.h"
 #include "HostDeviceCommon/Color.h"
 #include "HostDeviceCommon/Packing.h"
 
@@ -46,6 +47,9 @@ struct WorldSettings
 	int* alias_table_alias = nullptr;
 	float* alias_table_probas = nullptr;
 
+	// Marginal / conditional CDFs with guide tables for sampling the envmap with the guided CDF strategy
+	EnvmapGuidedCDFDevice envmap_guided_cdf;
+
 	// Rotation matrix for rotating the envmap around in the current frame
 	float3x3 envmap_to_world_matrix = float3x3{ { {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f} } };
 	float3x3 world_to_envmap_matrix = float3x3{ { {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f} } };
@@ -8,6 +8,8 @@
 
 #include <hiprt/hiprt_device.h>
 
+#include "HostDeviceCommon/KernelOptions/KernelOptions.h"
+#include "HostDeviceCommon/LowDiscrepancy.h"
 #include "HostDeviceCommon/Math.h"
 
 struct Xorshift32State {
@@ -34,7 +36,7 @@ struct Xorshift32Generator
      */
     HIPRT_HOST_DEVICE int random_index(int array_size)
     {
-        int random_num = xorshift32() / static_cast<float>(XORSHIFT_MAX) * array_size;
+        int random_num = (*this)() * array_size;
         return hippt::min(random_num, array_size - 1);
     }
 
@@ -43,11 +45,49 @@ struct Xorshift32Generator
      */
     HIPRT_HOST_DEVICE float operator()()
     {
+#if PathSamplerType != PST_WHITE_NOISE
+        if (m_low_discrepancy_state.dimension < m_low_discrepancy_state.dimension_end)
+            return hippt::min(low_discrepancy_sample(m_low_discrepancy_state, m_low_discrepancy_state.dimension++, PathSamplerType == PST_BLUE_NOISE_DITHERED), 1.0f - 1.0e-7f);
+#endif
+
         //Float in [0, 1[
         float a = xorshift32() / static_cast<float>(XORSHIFT_MAX);
         return hippt::min(a, 1.0f - 1.0e-7f);
     }
 
+    /**
+     * Sets up the low discrepancy sequence used by this generator when PathSamplerType
+     * isn't PST_WHITE_NOISE. Has no effect until begin_dimensions() is called
+     */
+    HIPRT_HOST_DEVICE void init_low_discrepancy(unsigned int pixel_x, unsigned int pixel_y, unsigned int sample_index, unsigned int scramble_seed)
+    {
+        m_low_discrepancy_state.pixel_x = pixel_x;
+        m_low_discrepancy_state.pixel_y = pixel_y;
+        m_low_discrepancy_state.sample_index = sample_index;
+        m_low_discrepancy_state.scramble_seed = scramble_seed;
+    }
+
+    /**
+     * The next 'count' numbers returned by operator() are the dimensions 'start_dimension',
+     * 'start_dimension' + 1, ... of the low discrepancy sequence (see SamplerDimension).
+     * The numbers returned after that are white noise until the next call.
+     *
+     * Has no effect if PathSamplerType is PST_WHITE_NOISE
+     */
+    HIPRT_HOST_DEVICE void begin_dimensions(unsigned int start_dimension, unsigned int count)
+    {
+        m_low_discrepancy_state.dimension = start_dimension;
+        m_low_discrepancy_state.dimension_end = start_dimension + count;
+    }
+
+    /**
+     * The numbers returned by operator() are white noise until the next call to begin_dimensions()
+     */
+    HIPRT_HOST_DEVICE void end_dimensions()
+    {
+        m_low_discrepancy_state.dimension_end = m_low_discrepancy_state.dimension;
+    }
+
     /**
      * Returns a random uint
      */
@@ -62,6 +102,7 @@ struct Xorshift32Generator
     }
 
     Xorshift32State m_state;
+    LowDiscrepancySamplerState m_low_discrepancy_state;
 };
 
 #endif
@@ -18,7 +18,6 @@ extern ImGuiLogger g_imgui_logger;
 
 #include "tinyexr.cc"
 
-#include <deque>
 
 Image8Bit::Image8Bit(int width, int height, int channels) : Image8Bit(std::vector<unsigned char>(width * height * channels, 0), width, height, channels) {}
 
@@ -60,6 +59,25 @@ Image8Bit Image8Bit::read_image(const std::string& filepath, int output_channels
     return output_image;
 }
 
+Image8Bit Image8Bit::read_image_from_memory(const unsigned char* file_data, size_t file_size, const std::string& filepath, int output_channels, bool flipY)
+{
+    stbi_set_flip_vertically_on_load_thread(flipY);
+
+    int width, height, read_channels;
+    unsigned char* pixels = stbi_load_from_memory(file_data, static_cast<int>(file_size), &width, &height, &read_channels, output_channels);
+
+    if (!pixels)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Error reading image %s: %s", filepath.c_str(), stbi_failure_reason());
+        return Image8Bit();
+    }
+
+    Image8Bit output_image(pixels, width, height, output_channels);
+
+    stbi_image_free(pixels);
+    return output_image;
+}
+
 Image8Bit Image8Bit::read_image_hdr(const std::string& filepath, int output_channels, bool flipY)
 {
     stbi_set_flip_vertically_on_load(flipY);
@@ -187,16 +205,226 @@ ColorRGBA32F Image8Bit::sample_rgba32f(float2 uv) const
     int x = (u * (width - 1));
     int y = (v * (height - 1));
 
+    unsigned char texel[4];
+    fetch_texel(0, x, y, texel);
+
     ColorRGBA32F out_color;
     for (int i = 0; i < channels; i++)
-        out_color[i] = m_pixel_data[(x + y * width) * channels + i] / 255.0f;
+        out_color[i] = texel[i] / 255.0f;
 
     return out_color;
 }
 
+ColorRGBA32F Image8Bit::sample_rgba32f(float2 uv, float texcoords_footprint) const
+{
+    // Repeat wrapping is done in sample_bilinear()
+    float u = uv.x;
+    // Sampling with [0, 0] bottom-left convention
+    float v = 1.0f - uv.y;
+
+    // Footprint in texels of the full resolution level. log2(0) is -inf which selects the finest level
+    float lod = std::log2(texcoords_footprint * std::sqrt(static_cast<float>(width) * height));
+    lod = hippt::clamp(0.0f, static_cast<float>(get_mip_level_count() - 1), lod);
+
+    int mip_level = static_cast<int>(lod);
+    float mip_level_interpolation = lod - mip_level;
+
+    ColorRGBA32F color = sample_bilinear(mip_level, u, v);
+    if (mip_level_interpolation > 0.0f)
+        color = hippt::lerp(color, sample_bilinear(mip_level + 1, u, v), mip_level_interpolation);
+
+    return color;
+}
+
+ColorRGBA32F Image8Bit::sample_bilinear(int mip_level, float u, float v) const
+{
+    int level_width = std::max(1, width >> mip_level);
+    int level_height = std::max(1, height >> mip_level);
+
+    // Texel centers are at half integer coordinates
+    float x = u * level_width - 0.5f;
+    float y = v * level_height - 0.5f;
+    float x_floor = std::floor(x);
+    float y_floor = std::floor(y);
+    float weight_x = x - x_floor;
+    float weight_y = y - y_floor;
+
+    // Repeat wrapping, also for negative coordinates
+    int x0 = static_cast<int>(x_floor) % level_width;
+    int y0 = static_cast<int>(y_floor) % level_height;
+    x0 = x0 < 0 ? x0 + level_width : x0;
+    y0 = y0 < 0 ? y0 + level_height : y0;
+    int x1 = x0 + 1 == level_width ? 0 : x0 + 1;
+    int y1 = y0 + 1 == level_height ? 0 : y0 + 1;
+
+    unsigned char texel_00[4], texel_10[4], texel_01[4], texel_11[4];
+    fetch_texel(mip_level, x0, y0, texel_00);
+    fetch_texel(mip_level, x1, y0, texel_10);
+    fetch_texel(mip_level, x0, y1, texel_01);
+    fetch_texel(mip_level, x1, y1, texel_11);
+
+    ColorRGBA32F out_color;
+    for (int i = 0; i < channels; i++)
+    {
+        float top = hippt::lerp(static_cast<float>(texel_00[i]), static_cast<float>(texel_10[i]), weight_x);
+        float bottom = hippt::lerp(static_cast<float>(texel_01[i]), static_cast<float>(texel_11[i]), weight_x);
+
+        out_color[i] = hippt::lerp(top, bottom, weight_y) / 255.0f;
+    }
+
+    return out_color;
+}
+
+void Image8Bit::fetch_texel(int mip_level, int x, int y, unsigned char* out_texel) const
+{
+    int level_width = std::max(1, width >> mip_level);
+    const unsigned char* level_data = mip_level == 0 ? m_pixel_data.data() : m_mip_levels[mip_level - 1].data();
+
+    if (m_compression_format == TEXTURE_COMPRESSION_NONE)
+    {
+        for (int i = 0; i < channels; i++)
+            out_texel[i] = level_data[(x + y * level_width) * channels + i];
+
+        return;
+    }
+
+    int block_count_x = (level_width + TextureCompression::BLOCK_SIZE - 1) / TextureCompression::BLOCK_SIZE;
+    int block_index = x / TextureCompression::BLOCK_SIZE + (y / TextureCompression::BLOCK_SIZE) * block_count_x;
+    int texel_index = x % TextureCompression::BLOCK_SIZE + (y % TextureCompression::BLOCK_SIZE) * TextureCompression::BLOCK_SIZE;
+
+    unsigned char rgba[4];
+    TextureCompression::decode_texel(m_compression_format, level_data + block_index * TextureCompression::get_block_byte_size(m_compression_format), texel_index, rgba);
+    for (int i = 0; i < channels; i++)
+        out_texel[i] = rgba[i];
+}
+
+void Image8Bit::generate_mipmaps()
+{
+    m_mip_levels.clear();
+    if (width == 0 || height == 0)
+        return;
+
+    // The mip levels are generated from uncompressed texels. If the image is already
+    // compressed, the finest level is decompressed in a temporary buffer and only
+    // the mip levels are compressed afterwards: the finest level is never re-encoded.
+    //
+    // This adds the compression error of the finest level to the mip levels so
+    // generate_mipmaps() should be called before compress() when possible
+    std::vector<unsigned char> decompressed_data;
+    const unsigned char* source_data = m_pixel_data.data();
+    if (m_compression_format != TEXTURE_COMPRESSION_NONE)
+    {
+        decompressed_data = TextureCompression::decompress(m_pixel_data.data(), width, height, channels, m_compression_format);
+        source_data = decompressed_data.data();
+    }
+
+    int source_width = width;
+    int source_height = height;
+    while (source_width > 1 || source_height > 1)
+    {
+        int level_width = std::max(1, source_width / 2);
+        int level_height = std::max(1, source_height / 2);
+
+        std::vector<unsigned char> level_data(static_cast<size_t>(level_width) * level_height * channels);
+        for (int y = 0; y < level_height; y++)
+        {
+            // Clamping for the odd sizes and the levels that are only 1 texel wide / high
+            int source_y0 = std::min(y * 2, source_height - 1);
+            int source_y1 = std::min(y * 2 + 1, source_height - 1);
+
+            for (int x = 0; x < level_width; x++)
+            {
+                int source_x0 = std::min(x * 2, source_width - 1);
+                int source_x1 = std::min(x * 2 + 1, source_width - 1);
+
+                for (int i = 0; i < channels; i++)
+                {
+                    int sum = source_data[(source_x0 + source_y0 * source_width) * channels + i]
+                        + source_data[(source_x1 + source_y0 * source_width) * channels + i]
+                        + source_data[(source_x0 + source_y1 * source_width) * channels + i]
+                        + source_data[(source_x1 + source_y1 * source_width) * channels + i];
+
+                    // Rounded average
+                    level_data[(x + y * level_width) * channels + i] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+
+        m_mip_levels.push_back(std::move(level_data));
+
+        source_width = level_width;
+        source_height = level_height;
+        source_data = m_mip_levels.back().data();
+    }
+
+    if (m_compression_format != TEXTURE_COMPRESSION_NONE)
+        compress_mip_levels(m_compression_format);
+}
+
+void Image8Bit::compress(TextureCompressionFormat format)
+{
+    if (format == TEXTURE_COMPRESSION_NONE || m_compression_format != TEXTURE_COMPRESSION_NONE)
+        return;
+
+    m_pixel_data = TextureCompression::compress(m_pixel_data.data(), width, height, channels, format);
+    compress_mip_levels(format);
+
+    m_compression_format = format;
+}
+
+void Image8Bit::compress_mip_levels(TextureCompressionFormat format)
+{
+    for (int level = 1; level <= static_cast<int>(m_mip_levels.size()); level++)
+    {
+        std::vector<unsigned char>& level_data = m_mip_levels[level - 1];
+        level_data = TextureCompression::compress(level_data.data(), std::max(1, width >> level), std::max(1, height >> level), channels, format);
+    }
+}
+
+TextureCompressionFormat Image8Bit::get_compression_format() const
+{
+    return m_compression_format;
+}
+
+int Image8Bit::get_mip_level_count() const
+{
+    return 1 + static_cast<int>(m_mip_levels.size());
+}
+
+const std::vector<unsigned char>& Image8Bit::get_level_data(int mip_level) const
+{
+    return mip_level == 0 ? m_pixel_data : m_mip_levels[mip_level - 1];
+}
+
+void Image8Bit::set_levels(std::vector<std::vector<unsigned char>>&& levels, TextureCompressionFormat format)
+{
+    m_mip_levels.clear();
+    m_pixel_data.clear();
+    m_compression_format = format;
+    if (levels.empty())
+        return;
+
+    m_pixel_data = std::move(levels[0]);
+    for (int level = 1; level < static_cast<int>(levels.size()); level++)
+        m_mip_levels.push_back(std::move(levels[level]));
+}
+
+size_t Image8Bit::get_level_byte_size(int width, int height, int channels, TextureCompressionFormat format, int mip_level)
+{
+    int level_width = std::max(1, width >> mip_level);
+    int level_height = std::max(1, height >> mip_level);
+
+    if (format == TEXTURE_COMPRESSION_NONE)
+        return static_cast<size_t>(level_width) * level_height * channels;
+    else
+        return static_cast<size_t>(TextureCompression::get_block_count(level_width, level_height)) * TextureCompression::get_block_byte_size(format);
+}
+
 void Image8Bit::set_data(const std::vector<unsigned char>& data)
 {
     m_pixel_data = data;
+    m_mip_levels.clear();
+    m_compression_format = TEXTURE_COMPRESSION_NONE;
 }
 
 const std::vector<unsigned char>& Image8Bit::data() const
@@ -298,6 +526,8 @@ bool Image8Bit::is_fully_opaque() const
 void Image8Bit::free()
 {
     m_pixel_data.clear();
+    m_mip_levels.clear();
+    m_compression_format = TEXTURE_COMPRESSION_NONE;
     width = 0;
     height = 0;
     channels = 0;
@@ -605,16 +835,12 @@ std::vector<float> Image32Bit::compute_cdf() const
     return out_cdf;
 }
 
-/**
- * Reference: Vose's Alias Method [https://www.keithschwarz.com/darts-dice-coins/]
- */
 void Image32Bit::compute_alias_table(std::vector<float>& out_probas, std::vector<int>& out_alias, float* out_luminance_total_sum) const
 {
     // TODO try using floats here to reduce memory usage during the construction and see if precision is an issue or not
 
     // A vector of the luminance of all the pixels of the envmap
-    // normalized such that the average of the elements of this vector is 'width*height'
-    std::vector<double> normalized_luminance_of_pixels(width * height);
+    std::vector<double> luminance_of_pixels(width * height);
     double max_luminance = 0.0f;
     double luminance_sum = 0.0f;
     for (int y = 0; y < height; y++)
@@ -624,7 +850,7 @@ void Image32Bit::compute_alias_table(std::vector<float>& out_probas, std::vector
             int index = y * width + x;
 
             double luminance = static_cast<double>(luminance_of_pixel(x, y));
-            normalized_luminance_of_pixels[index] = luminance;
+            luminance_of_pixels[index] = luminance;
             luminance_sum += luminance;
             max_luminance = std::max(max_luminance, luminance);
         }
@@ -637,63 +863,7 @@ void Image32Bit::compute_alias_table(std::vector<float>& out_probas, std::vector
     if (out_luminance_total_sum != nullptr)
         *out_luminance_total_sum = luminance_sum;
 
-    for (double& luminance_value : normalized_luminance_of_pixels)
-    {
-        // Normalize so that the sum of the elements is 1
-        luminance_value /= luminance_sum;
-
-        // Scale for alias table construction such that the average of
-        // the elements is 1
-        luminance_value *= (width * height);
-    }
-
-    out_probas.resize(width * height);
-    out_alias.resize(width * height);
-
-    std::deque<int> small;
-    std::deque<int> large;
-
-    for (int i = 0; i < normalized_luminance_of_pixels.size(); i++)
-    {
-        if (normalized_luminance_of_pixels[i] < 1.0f)
-            small.push_back(i);
-        else
-            large.push_back(i);
-    }
-
-    while (!small.empty() && !large.empty())
-    {
-        int small_index = small.front();
-        int large_index = large.front();
-
-        small.pop_front();
-        large.pop_front();
-
-        out_probas[small_index] = normalized_luminance_of_pixels[small_index];
-        out_alias[small_index] = large_index;
-
-        normalized_luminance_of_pixels[large_index] = (normalized_luminance_of_pixels[large_index] + normalized_luminance_of_pixels[small_index]) - 1.0f;
-        if (normalized_luminance_of_pixels[large_index] > 1.0f)
-            large.push_back(large_index);
-        else
-            small.push_back(large_index);
-    }
-
-    while (!large.empty())
-    {
-        int index = large.front();
-        large.pop_front();
-
-        out_probas[index] = 1.0f;
-    }
-
-    while (!small.empty())
-    {
-        int index = small.front();
-        small.pop_front();
-
-        out_probas[index] = 1.0f;
-    }
+    Utils::compute_alias_table(luminance_of_pixels, luminance_sum, out_probas, out_alias);
 }
 
 size_t Image32Bit::byte_size() const
@@ -7,6 +7,7 @@
 #define IMAGE_H
 
 #include "HostDeviceCommon/Color.h"
+#include "Image/TextureCompression.h"
 
 #include "stb_image.h"
 #include "stb_image_write.h"
@@ -29,6 +30,11 @@ public:
     Image8Bit(const std::vector<unsigned char>& data, int width, int height, int channels);
 
     static Image8Bit read_image(const std::string& filepath, int output_channels, bool flipY);
+    /**
+     * Decodes an image file that has already been read in memory.
+     * 'filepath' is only used for the error messages
+     */
+    static Image8Bit read_image_from_memory(const unsigned char* file_data, size_t file_size, const std::string& filepath, int output_channels, bool flipY);
     static Image8Bit read_image_hdr(const std::string& filepath, int output_channels, bool flipY);
 
     bool write_image_png(const char* filename, const bool flipY = true) const;
@@ -39,6 +45,49 @@ public:
     float luminance_of_area(const ImageBin& area) const;
 
     ColorRGBA32F sample_rgba32f(float2 uv) const;
+    /**
+     * Trilinearly filtered sampling. 'texcoords_footprint' is the width in UV space
+     * of the area to filter and selects the mip level to sample. Only the finest level
+     * is used if generate_mipmaps() hasn't been called (the sampling is then bilinear)
+     */
+    ColorRGBA32F sample_rgba32f(float2 uv, float texcoords_footprint) const;
+
+    /**
+     * Generates the mip levels of the image with a box filter, down to 1x1.
+     * The mip levels are invalidated by set_data()
+     *
+     * Should be called before compress(): the mip levels of an image that is already
+     * compressed are built from its decompressed texels and carry their compression error
+     */
+    void generate_mipmaps();
+    /**
+     * Number of mip levels of the image, including the full resolution level
+     */
+    int get_mip_level_count() const;
+
+    /**
+     * Replaces the texels of the image and of its mip levels by blocks of the given format.
+     * The sampling functions keep working on the compressed image but all the other functions
+     * (luminance, is_constant_color, ...) expect an uncompressed image.
+     *
+     * data() returns the compressed blocks afterwards
+     */
+    void compress(TextureCompressionFormat format);
+    TextureCompressionFormat get_compression_format() const;
+
+    /**
+     * Texels (or blocks if the image is compressed) of the given mip level, 0 being the full resolution level
+     */
+    const std::vector<unsigned char>& get_level_data(int mip_level) const;
+    /**
+     * Replaces the texels of the image and of its mip levels by 'levels', full resolution level first.
+     * The levels are in the given format and must have the sizes given by get_level_byte_size()
+     */
+    void set_levels(std::vector<std::vector<unsigned char>>&& levels, TextureCompressionFormat format);
+    /**
+     * Size in bytes of the mip level 'mip_level' of an image of the given size and format
+     */
+    static size_t get_level_byte_size(int width, int height, int channels, TextureCompressionFormat format, int mip_level);
 
     void set_data(const std::vector<unsigned char>& data);
     const std::vector<unsigned char>& data() const;
@@ -77,7 +126,21 @@ public:
     int width, height, channels;
 
 protected:
+    ColorRGBA32F sample_bilinear(int mip_level, float u, float v) const;
+    /**
+     * Reads the texel (x, y) of the given mip level in 'out_texel' ('channels' values)
+     */
+    void fetch_texel(int mip_level, int x, int y, unsigned char* out_texel) const;
+    /**
+     * Compresses the mip levels 1 and above, the finest level is left untouched
+     */
+    void compress_mip_levels(TextureCompressionFormat format);
+
     std::vector<unsigned char> m_pixel_data;
+    TextureCompressionFormat m_compression_format = TEXTURE_COMPRESSION_NONE;
+    // Mip levels 1 and above, the full resolution level 0 is 'm_pixel_data'.
+    // Level i is max(1, width >> i) * max(1, height >> i) pixels
+    std::vector<std::vector<unsigned char>> m_mip_levels;
 };
 
 class Image32Bit
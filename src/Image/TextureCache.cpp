@@ -0,0 +1,198 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Image/TextureCache.h"
+#include "UI/ImGui/ImGuiLogger.h"
+#include "Utils/MappedFile.h"
+#include "Utils/Utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+extern ImGuiLogger g_imgui_logger;
+
+const std::string TextureCache::CACHE_DIRECTORY = "texture_cache";
+
+static constexpr char TEXTURE_CACHE_MAGIC[8] = { 'H', 'I', 'P', 'R', 'T', 'T', 'E', 'X' };
+
+struct TextureCacheHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int padding;
+    unsigned long long int cache_key;
+
+    int width;
+    int height;
+    int channels;
+
+    unsigned char is_constant_color;
+    unsigned char is_fully_opaque;
+    unsigned char padding2[2];
+
+    // TextureCompressionFormat of the levels that follow the header
+    unsigned int compression_format;
+    int mip_level_count;
+};
+
+unsigned long long int TextureCache::compute_cache_key(const std::string& texture_filepath, int channel_count, TextureCompressionFormat compression_format, bool mip_levels)
+{
+    std::error_code error;
+    std::filesystem::path absolute_path = std::filesystem::absolute(texture_filepath, error);
+    if (error)
+        return 0;
+
+    unsigned long long int file_size = std::filesystem::file_size(absolute_path, error);
+    if (error)
+        return 0;
+
+    long long int last_write_time = std::filesystem::last_write_time(absolute_path, error).time_since_epoch().count();
+    if (error)
+        return 0;
+
+    std::string path_string = absolute_path.string();
+    unsigned int version = CACHE_VERSION;
+    unsigned int compression_format_uint = compression_format;
+    unsigned char mip_levels_uchar = mip_levels;
+
+    unsigned long long int key = Utils::hash_fnv1a(path_string.data(), path_string.size());
+    key = Utils::hash_fnv1a(&file_size, sizeof(file_size), key);
+    key = Utils::hash_fnv1a(&last_write_time, sizeof(last_write_time), key);
+    key = Utils::hash_fnv1a(&channel_count, sizeof(channel_count), key);
+    key = Utils::hash_fnv1a(&compression_format_uint, sizeof(compression_format_uint), key);
+    key = Utils::hash_fnv1a(&mip_levels_uchar, sizeof(mip_levels_uchar), key);
+    key = Utils::hash_fnv1a(&version, sizeof(version), key);
+
+    // 0 is reserved for errors
+    return key == 0 ? 1 : key;
+}
+
+std::string TextureCache::get_cache_filepath(unsigned long long int cache_key)
+{
+    char filename[64];
+    std::snprintf(filename, sizeof(filename), "%016llx.texcache", cache_key);
+
+    return CACHE_DIRECTORY + "/" + filename;
+}
+
+TextureAnalysis TextureCache::analyze_texture(const Image8Bit& texture)
+{
+    TextureAnalysis analysis;
+    analysis.is_constant_color = texture.is_constant_color(CONSTANT_COLOR_THRESHOLD);
+    analysis.is_fully_opaque = texture.is_fully_opaque();
+
+    return analysis;
+}
+
+bool TextureCache::read_texture(unsigned long long int cache_key, Image8Bit& out_texture, TextureAnalysis& out_analysis)
+{
+    std::string cache_filepath = get_cache_filepath(cache_key);
+
+    MappedFile file;
+    if (!file.open(cache_filepath))
+        return false;
+
+    if (file.get_size() < sizeof(TextureCacheHeader))
+        return false;
+
+    TextureCacheHeader header;
+    std::memcpy(&header, file.get_data(), sizeof(TextureCacheHeader));
+    if (std::memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC)) != 0
+        || header.version != CACHE_VERSION
+        || header.cache_key != cache_key
+        || header.width <= 0 || header.height <= 0 || header.channels <= 0
+        || header.compression_format > TEXTURE_COMPRESSION_BC7 || header.mip_level_count <= 0)
+        return false;
+
+    TextureCompressionFormat compression_format = static_cast<TextureCompressionFormat>(header.compression_format);
+
+    size_t levels_size = 0;
+    for (int level = 0; level < header.mip_level_count; level++)
+        levels_size += Image8Bit::get_level_byte_size(header.width, header.height, header.channels, compression_format, level);
+    if (file.get_size() - sizeof(TextureCacheHeader) < levels_size)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Texture cache file \"%s\" is truncated. Ignoring it.", cache_filepath.c_str());
+
+        return false;
+    }
+
+    std::vector<std::vector<unsigned char>> levels(header.mip_level_count);
+    const unsigned char* level_data = file.get_data() + sizeof(TextureCacheHeader);
+    for (int level = 0; level < header.mip_level_count; level++)
+    {
+        size_t level_size = Image8Bit::get_level_byte_size(header.width, header.height, header.channels, compression_format, level);
+        levels[level].assign(level_data, level_data + level_size);
+
+        level_data += level_size;
+    }
+
+    out_texture = Image8Bit();
+    out_texture.width = header.width;
+    out_texture.height = header.height;
+    out_texture.channels = header.channels;
+    out_texture.set_levels(std::move(levels), compression_format);
+    out_analysis.is_constant_color = header.is_constant_color;
+    out_analysis.is_fully_opaque = header.is_fully_opaque;
+
+    return true;
+}
+
+bool TextureCache::write_texture(unsigned long long int cache_key, const Image8Bit& texture, const TextureAnalysis& analysis)
+{
+    if (texture.width == 0 || texture.height == 0)
+        return false;
+
+    std::error_code error;
+    std::filesystem::create_directories(CACHE_DIRECTORY, error);
+
+    std::string cache_filepath = get_cache_filepath(cache_key);
+    // The file is written under a temporary name and then renamed so that
+    // a partially written cache file is never read. The name is unique per thread
+    // because the same texture may be loaded by multiple threads at the same time
+    std::string temporary_filepath = cache_filepath + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+    TextureCacheHeader header;
+    std::memset(&header, 0, sizeof(TextureCacheHeader));
+    std::memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.cache_key = cache_key;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.channels = texture.channels;
+    header.is_constant_color = analysis.is_constant_color;
+    header.is_fully_opaque = analysis.is_fully_opaque;
+    header.compression_format = texture.get_compression_format();
+    header.mip_level_count = texture.get_mip_level_count();
+
+    std::ofstream file(temporary_filepath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(TextureCacheHeader));
+    for (int level = 0; level < texture.get_mip_level_count(); level++)
+        file.write(reinterpret_cast<const char*>(texture.get_level_data(level).data()), texture.get_level_data(level).size());
+    file.close();
+
+    if (file.fail())
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Could not write texture cache file \"%s\".", temporary_filepath.c_str());
+        std::filesystem::remove(temporary_filepath, error);
+
+        return false;
+    }
+
+    std::filesystem::rename(temporary_filepath, cache_filepath, error);
+    if (error)
+    {
+        std::filesystem::remove(temporary_filepath, error);
+
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "Image/Image.h"
+
+#include <string>
+
+/**
+ * Results of the scans of the texels of a texture done when loading the
+ * textures of a scene. These are stored in the texture cache alongside the texels
+ */
+struct TextureAnalysis
+{
+    // Computed with TextureCache::CONSTANT_COLOR_THRESHOLD
+    bool is_constant_color = false;
+    bool is_fully_opaque = false;
+};
+
+/**
+ * On-disk cache of the decoded textures of the scenes.
+ *
+ * Each texture is stored in its own file, as it is after the loading (raw 8-bit texels or
+ * compressed blocks, with its mip levels if they were generated), with the result of its
+ * analysis such that a texture that is in the cache can be loaded without decoding
+ * the PNG/JPG/..., without scanning its texels and without compressing it again.
+ *
+ * The key of a texture is a hash of the path of the texture file, its size, its last
+ * write time, the number of channels it is read with and how it is processed after
+ * the decoding (compression format and mip levels). Modifying a texture file
+ * thus leads to a new key. Old cache files are never removed and can be deleted
+ * manually from TextureCache::CACHE_DIRECTORY.
+ */
+class TextureCache
+{
+public:
+    // Needs to be incremented every time the layout of the cache files changes
+    static constexpr unsigned int CACHE_VERSION = 2;
+
+    // Maximum difference between the channels of the texels and the
+    // first texel for a texture to be considered of constant color
+    static constexpr int CONSTANT_COLOR_THRESHOLD = 5;
+
+    // Directory, relative to the working directory, where the cache files are stored
+    static const std::string CACHE_DIRECTORY;
+
+    /**
+     * Returns the key of the texture at 'texture_filepath' read with 'channel_count' channels,
+     * compressed with 'compression_format' (TEXTURE_COMPRESSION_NONE if the texture isn't compressed)
+     * and with or without its mip levels.
+     * 0 is returned if the texture file doesn't exist
+     */
+    static unsigned long long int compute_cache_key(const std::string& texture_filepath, int channel_count, TextureCompressionFormat compression_format, bool mip_levels);
+    static std::string get_cache_filepath(unsigned long long int cache_key);
+
+    static TextureAnalysis analyze_texture(const Image8Bit& texture);
+
+    /**
+     * Returns false if there is no valid cache file for that key
+     */
+    static bool read_texture(unsigned long long int cache_key, Image8Bit& out_texture, TextureAnalysis& out_analysis);
+    static bool write_texture(unsigned long long int cache_key, const Image8Bit& texture, const TextureAnalysis& analysis);
+};
+
+#endif
@@ -0,0 +1,529 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Image/TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Finds the two endpoints of the segment, along the principal axis of the colors of
+ * the block, that contains all the colors of the block (projected on the segment).
+ *
+ * Only the first 'channel_count' channels are considered
+ */
+static void find_principal_axis_endpoints(const unsigned char block_rgba[16][4], int channel_count, float out_endpoint_0[4], float out_endpoint_1[4])
+{
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channel_count; c++)
+            mean[c] += block_rgba[i][c] / 16.0f;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int c0 = 0; c0 < channel_count; c0++)
+            for (int c1 = 0; c1 < channel_count; c1++)
+                covariance[c0][c1] += (block_rgba[i][c0] - mean[c0]) * (block_rgba[i][c1] - mean[c1]);
+
+    // Power iteration for the eigenvector of the largest eigenvalue of the covariance matrix
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float new_axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float length = 0.0f;
+        for (int c0 = 0; c0 < channel_count; c0++)
+        {
+            for (int c1 = 0; c1 < channel_count; c1++)
+                new_axis[c0] += covariance[c0][c1] * axis[c1];
+
+            length = std::max(length, std::abs(new_axis[c0]));
+        }
+
+        if (length == 0.0f)
+            // All the colors of the block are the same
+            break;
+
+        for (int c = 0; c < channel_count; c++)
+            axis[c] = new_axis[c] / length;
+    }
+
+    float axis_length_squared = 0.0f;
+    for (int c = 0; c < channel_count; c++)
+        axis_length_squared += axis[c] * axis[c];
+
+    float min_projection = 0.0f;
+    float max_projection = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float projection = 0.0f;
+        for (int c = 0; c < channel_count; c++)
+            projection += (block_rgba[i][c] - mean[c]) * axis[c];
+        projection /= axis_length_squared;
+
+        min_projection = std::min(min_projection, projection);
+        max_projection = std::max(max_projection, projection);
+    }
+
+    for (int c = 0; c < 4; c++)
+    {
+        out_endpoint_0[c] = c < channel_count ? std::clamp(mean[c] + axis[c] * max_projection, 0.0f, 255.0f) : 255.0f;
+        out_endpoint_1[c] = c < channel_count ? std::clamp(mean[c] + axis[c] * min_projection, 0.0f, 255.0f) : 255.0f;
+    }
+}
+
+/**
+ * Writes 'bit_count' bits of 'value' at 'bit_offset' in the block, least significant bits first
+ */
+static void write_bits(unsigned char* block, int& bit_offset, unsigned int value, int bit_count)
+{
+    for (int i = 0; i < bit_count; i++, bit_offset++)
+        if (value & (1u << i))
+            block[bit_offset / 8] |= 1u << (bit_offset % 8);
+}
+
+static unsigned int read_bits(const unsigned char* block, int bit_offset, int bit_count)
+{
+    unsigned int value = 0;
+    for (int i = 0; i < bit_count; i++, bit_offset++)
+        value |= ((block[bit_offset / 8] >> (bit_offset % 8)) & 1u) << i;
+
+    return value;
+}
+
+static unsigned short pack_565(const float rgb[3])
+{
+    unsigned int r = static_cast<unsigned int>(std::lround(rgb[0] * 31.0f / 255.0f));
+    unsigned int g = static_cast<unsigned int>(std::lround(rgb[1] * 63.0f / 255.0f));
+    unsigned int b = static_cast<unsigned int>(std::lround(rgb[2] * 31.0f / 255.0f));
+
+    return static_cast<unsigned short>((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(unsigned short color, int out_rgb[3])
+{
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+
+    out_rgb[0] = (r << 3) | (r >> 2);
+    out_rgb[1] = (g << 2) | (g >> 4);
+    out_rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void compute_bc1_palette(unsigned short color_0, unsigned short color_1, int out_palette[4][3])
+{
+    unpack_565(color_0, out_palette[0]);
+    unpack_565(color_1, out_palette[1]);
+
+    for (int c = 0; c < 3; c++)
+    {
+        if (color_0 > color_1)
+        {
+            out_palette[2][c] = (2 * out_palette[0][c] + out_palette[1][c]) / 3;
+            out_palette[3][c] = (out_palette[0][c] + 2 * out_palette[1][c]) / 3;
+        }
+        else
+        {
+            // 3 colors + transparent black mode. Never produced by the encoder
+            out_palette[2][c] = (out_palette[0][c] + out_palette[1][c]) / 2;
+            out_palette[3][c] = 0;
+        }
+    }
+}
+
+static void compute_bc4_palette(unsigned char endpoint_0, unsigned char endpoint_1, int out_palette[8])
+{
+    out_palette[0] = endpoint_0;
+    out_palette[1] = endpoint_1;
+
+    if (endpoint_0 > endpoint_1)
+    {
+        for (int i = 1; i < 7; i++)
+            out_palette[i + 1] = ((7 - i) * endpoint_0 + i * endpoint_1) / 7;
+    }
+    else
+    {
+        for (int i = 1; i < 5; i++)
+            out_palette[i + 1] = ((5 - i) * endpoint_0 + i * endpoint_1) / 5;
+        out_palette[6] = 0;
+        out_palette[7] = 255;
+    }
+}
+
+// Interpolation weights of the 4 bits indices of BC7
+static constexpr int BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static int bc7_interpolate(int endpoint_0, int endpoint_1, int index)
+{
+    return ((64 - BC7_WEIGHTS_4[index]) * endpoint_0 + BC7_WEIGHTS_4[index] * endpoint_1 + 32) >> 6;
+}
+
+int TextureCompression::get_block_byte_size(TextureCompressionFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_COMPRESSION_BC1:
+    case TEXTURE_COMPRESSION_BC4:
+        return 8;
+
+    case TEXTURE_COMPRESSION_BC5:
+    case TEXTURE_COMPRESSION_BC7:
+        return 16;
+
+    case TEXTURE_COMPRESSION_NONE:
+    default:
+        return 0;
+    }
+}
+
+int TextureCompression::get_block_count(int width, int height)
+{
+    return ((width + BLOCK_SIZE - 1) / BLOCK_SIZE) * ((height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+std::vector<unsigned char> TextureCompression::compress(const unsigned char* pixels, int width, int height, int channels, TextureCompressionFormat format)
+{
+    int block_count_x = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int block_count_y = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int block_byte_size = get_block_byte_size(format);
+
+    std::vector<unsigned char> blocks(static_cast<size_t>(block_count_x) * block_count_y * block_byte_size, 0);
+
+#pragma omp parallel for
+    for (int block_y = 0; block_y < block_count_y; block_y++)
+    {
+        for (int block_x = 0; block_x < block_count_x; block_x++)
+        {
+            unsigned char block_rgba[16][4];
+            for (int i = 0; i < 16; i++)
+            {
+                int x = std::min(block_x * BLOCK_SIZE + i % BLOCK_SIZE, width - 1);
+                int y = std::min(block_y * BLOCK_SIZE + i / BLOCK_SIZE, height - 1);
+                const unsigned char* pixel = pixels + (static_cast<size_t>(x) + static_cast<size_t>(y) * width) * channels;
+
+                for (int c = 0; c < 4; c++)
+                    block_rgba[i][c] = c < channels ? pixel[c] : (c == 3 ? 255 : 0);
+            }
+
+            unsigned char* out_block = blocks.data() + (static_cast<size_t>(block_x) + static_cast<size_t>(block_y) * block_count_x) * block_byte_size;
+            switch (format)
+            {
+            case TEXTURE_COMPRESSION_BC1:
+                compress_block_bc1(block_rgba, out_block);
+                break;
+
+            case TEXTURE_COMPRESSION_BC4:
+            case TEXTURE_COMPRESSION_BC5:
+            {
+                // BC5 is a BC4 block for the red channel followed by a BC4 block for the green channel
+                int channel_count = format == TEXTURE_COMPRESSION_BC4 ? 1 : 2;
+                for (int c = 0; c < channel_count; c++)
+                {
+                    unsigned char block_values[16];
+                    for (int i = 0; i < 16; i++)
+                        block_values[i] = block_rgba[i][c];
+
+                    compress_block_bc4(block_values, out_block + c * 8);
+                }
+                break;
+            }
+
+            case TEXTURE_COMPRESSION_BC7:
+                compress_block_bc7(block_rgba, out_block);
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    return blocks;
+}
+
+void TextureCompression::decode_texel(TextureCompressionFormat format, const unsigned char* block, int texel_index, unsigned char out_rgba[4])
+{
+    switch (format)
+    {
+    case TEXTURE_COMPRESSION_BC1:
+        decode_texel_bc1(block, texel_index, out_rgba);
+        break;
+
+    case TEXTURE_COMPRESSION_BC4:
+        out_rgba[0] = decode_texel_bc4(block, texel_index);
+        out_rgba[1] = 0;
+        out_rgba[2] = 0;
+        out_rgba[3] = 255;
+        break;
+
+    case TEXTURE_COMPRESSION_BC5:
+        out_rgba[0] = decode_texel_bc4(block, texel_index);
+        out_rgba[1] = decode_texel_bc4(block + 8, texel_index);
+        out_rgba[2] = 0;
+        out_rgba[3] = 255;
+        break;
+
+    case TEXTURE_COMPRESSION_BC7:
+        decode_texel_bc7(block, texel_index, out_rgba);
+        break;
+
+    default:
+        std::memset(out_rgba, 0, 4);
+        break;
+    }
+}
+
+std::vector<unsigned char> TextureCompression::decompress(const unsigned char* blocks, int width, int height, int channels, TextureCompressionFormat format)
+{
+    int block_count_x = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int block_byte_size = get_block_byte_size(format);
+
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+
+#pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char* block = blocks + (static_cast<size_t>(x / BLOCK_SIZE) + static_cast<size_t>(y / BLOCK_SIZE) * block_count_x) * block_byte_size;
+
+            unsigned char rgba[4];
+            decode_texel(format, block, (x % BLOCK_SIZE) + (y % BLOCK_SIZE) * BLOCK_SIZE, rgba);
+
+            for (int c = 0; c < channels; c++)
+                pixels[(static_cast<size_t>(x) + static_cast<size_t>(y) * width) * channels + c] = rgba[c];
+        }
+    }
+
+    return pixels;
+}
+
+void TextureCompression::compress_block_bc1(const unsigned char block_rgba[16][4], unsigned char* out_block)
+{
+    float endpoint_0[4], endpoint_1[4];
+    find_principal_axis_endpoints(block_rgba, 3, endpoint_0, endpoint_1);
+
+    unsigned short color_0 = pack_565(endpoint_0);
+    unsigned short color_1 = pack_565(endpoint_1);
+    // color_0 > color_1 selects the 4 colors mode
+    if (color_0 < color_1)
+        std::swap(color_0, color_1);
+
+    unsigned int indices = 0;
+    if (color_0 != color_1)
+    {
+        int palette[4][3];
+        compute_bc1_palette(color_0, color_1, palette);
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best_index = 0;
+            int best_error = INT32_MAX;
+            for (int index = 0; index < 4; index++)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; c++)
+                    error += (block_rgba[i][c] - palette[index][c]) * (block_rgba[i][c] - palette[index][c]);
+
+                if (error < best_error)
+                {
+                    best_error = error;
+                    best_index = index;
+                }
+            }
+
+            indices |= best_index << (i * 2);
+        }
+    }
+    // else all the indices are 0 (color_0)
+
+    std::memcpy(out_block + 0, &color_0, sizeof(unsigned short));
+    std::memcpy(out_block + 2, &color_1, sizeof(unsigned short));
+    std::memcpy(out_block + 4, &indices, sizeof(unsigned int));
+}
+
+void TextureCompression::compress_block_bc4(const unsigned char block_values[16], unsigned char* out_block)
+{
+    unsigned char endpoint_0 = *std::max_element(block_values, block_values + 16);
+    unsigned char endpoint_1 = *std::min_element(block_values, block_values + 16);
+
+    // endpoint_0 > endpoint_1 selects the 8 values mode
+    int palette[8];
+    compute_bc4_palette(endpoint_0, endpoint_1, palette);
+
+    unsigned long long int indices = 0;
+    if (endpoint_0 != endpoint_1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best_index = 0;
+            int best_error = INT32_MAX;
+            for (int index = 0; index < 8; index++)
+            {
+                int error = std::abs(block_values[i] - palette[index]);
+                if (error < best_error)
+                {
+                    best_error = error;
+                    best_index = index;
+                }
+            }
+
+            indices |= static_cast<unsigned long long int>(best_index) << (i * 3);
+        }
+    }
+
+    out_block[0] = endpoint_0;
+    out_block[1] = endpoint_1;
+    for (int i = 0; i < 6; i++)
+        out_block[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+}
+
+void TextureCompression::compress_block_bc7(const unsigned char block_rgba[16][4], unsigned char* out_block)
+{
+    float endpoints_float[2][4];
+    find_principal_axis_endpoints(block_rgba, 4, endpoints_float[0], endpoints_float[1]);
+
+    // Mode 6: 7 bits per channel + 1 p-bit shared by the channels of an endpoint.
+    // The p-bit that gives the closest 8 bits endpoint is kept
+    int quantized[2][4];
+    int p_bits[2];
+    int endpoints[2][4];
+    for (int e = 0; e < 2; e++)
+    {
+        float best_error = 1.0e30f;
+        for (int p = 0; p < 2; p++)
+        {
+            float error = 0.0f;
+            int candidate[4];
+            for (int c = 0; c < 4; c++)
+            {
+                candidate[c] = std::clamp(static_cast<int>(std::lround((endpoints_float[e][c] - p) / 2.0f)), 0, 127);
+
+                float difference = ((candidate[c] << 1) | p) - endpoints_float[e][c];
+                error += difference * difference;
+            }
+
+            if (error < best_error)
+            {
+                best_error = error;
+                p_bits[e] = p;
+                for (int c = 0; c < 4; c++)
+                {
+                    quantized[e][c] = candidate[c];
+                    endpoints[e][c] = (candidate[c] << 1) | p;
+                }
+            }
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        int best_error = INT32_MAX;
+        for (int index = 0; index < 16; index++)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                int difference = block_rgba[i][c] - bc7_interpolate(endpoints[0][c], endpoints[1][c], index);
+                error += difference * difference;
+            }
+
+            if (error < best_error)
+            {
+                best_error = error;
+                indices[i] = index;
+            }
+        }
+    }
+
+    // The most significant bit of the index of the first texel (the anchor) is implicitly 0
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; c++)
+            std::swap(quantized[0][c], quantized[1][c]);
+        std::swap(p_bits[0], p_bits[1]);
+
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    std::memset(out_block, 0, 16);
+    int bit_offset = 0;
+    // Mode 6 is a 1 at bit 6
+    write_bits(out_block, bit_offset, 1u << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        write_bits(out_block, bit_offset, quantized[0][c], 7);
+        write_bits(out_block, bit_offset, quantized[1][c], 7);
+    }
+    write_bits(out_block, bit_offset, p_bits[0], 1);
+    write_bits(out_block, bit_offset, p_bits[1], 1);
+    for (int i = 0; i < 16; i++)
+        write_bits(out_block, bit_offset, indices[i], i == 0 ? 3 : 4);
+}
+
+void TextureCompression::decode_texel_bc1(const unsigned char* block, int texel_index, unsigned char out_rgba[4])
+{
+    unsigned short color_0, color_1;
+    unsigned int indices;
+    std::memcpy(&color_0, block + 0, sizeof(unsigned short));
+    std::memcpy(&color_1, block + 2, sizeof(unsigned short));
+    std::memcpy(&indices, block + 4, sizeof(unsigned int));
+
+    int palette[4][3];
+    compute_bc1_palette(color_0, color_1, palette);
+
+    int index = (indices >> (texel_index * 2)) & 3;
+    for (int c = 0; c < 3; c++)
+        out_rgba[c] = static_cast<unsigned char>(palette[index][c]);
+    out_rgba[3] = (color_0 <= color_1 && index == 3) ? 0 : 255;
+}
+
+unsigned char TextureCompression::decode_texel_bc4(const unsigned char* block, int texel_index)
+{
+    int palette[8];
+    compute_bc4_palette(block[0], block[1], palette);
+
+    return static_cast<unsigned char>(palette[read_bits(block + 2, texel_index * 3, 3)]);
+}
+
+void TextureCompression::decode_texel_bc7(const unsigned char* block, int texel_index, unsigned char out_rgba[4])
+{
+    if ((block[0] & 0x7F) != 0x40)
+    {
+        // Only mode 6 is produced by the encoder
+        std::memset(out_rgba, 0, 4);
+
+        return;
+    }
+
+    int bit_offset = 7;
+    int endpoints[2][4];
+    for (int c = 0; c < 4; c++)
+    {
+        endpoints[0][c] = read_bits(block, bit_offset, 7) << 1;
+        endpoints[1][c] = read_bits(block, bit_offset + 7, 7) << 1;
+        bit_offset += 14;
+    }
+
+    int p_bit_0 = read_bits(block, bit_offset, 1);
+    int p_bit_1 = read_bits(block, bit_offset + 1, 1);
+    bit_offset += 2;
+    for (int c = 0; c < 4; c++)
+    {
+        endpoints[0][c] |= p_bit_0;
+        endpoints[1][c] |= p_bit_1;
+    }
+
+    // The first index is 3 bits, the others are 4 bits
+    int index_bit_offset = texel_index == 0 ? bit_offset : bit_offset + 3 + (texel_index - 1) * 4;
+    int index = read_bits(block, index_bit_offset, texel_index == 0 ? 3 : 4);
+
+    for (int c = 0; c < 4; c++)
+        out_rgba[c] = static_cast<unsigned char>(bc7_interpolate(endpoints[0][c], endpoints[1][c], index));
+}
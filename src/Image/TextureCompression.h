@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <vector>
+
+enum TextureCompressionFormat
+{
+    TEXTURE_COMPRESSION_NONE,
+    // 4x4 blocks of 8 bytes. RGB, 565 endpoints + 2 bits indices. Alpha is always 1
+    TEXTURE_COMPRESSION_BC1,
+    // 4x4 blocks of 8 bytes. Single channel (R), 8 bits endpoints + 3 bits indices
+    TEXTURE_COMPRESSION_BC4,
+    // 4x4 blocks of 16 bytes. Two channels (RG), two BC4 blocks
+    TEXTURE_COMPRESSION_BC5,
+    // 4x4 blocks of 16 bytes. RGBA
+    TEXTURE_COMPRESSION_BC7
+};
+
+/**
+ * Block compression of 8-bit textures in the BCn formats that the GPUs can sample natively.
+ *
+ * The texels are decoded exactly as the hardware decodes them such that the CPU
+ * and GPU renderers see the same texels.
+ *
+ * The BC7 encoder only uses mode 6 (single subset, RGBA endpoints with p-bits and 4 bits indices)
+ * which is the most versatile mode for smooth color textures. The endpoints of BC1 and BC7 blocks
+ * are found along the principal axis of the colors of the block.
+ *
+ * Row 'y' of the blocks contains the texels of the rows 4 * y to 4 * y + 3 of the image,
+ * in the order they're stored in the image.
+ */
+class TextureCompression
+{
+public:
+    static constexpr int BLOCK_SIZE = 4;
+
+    /**
+     * Size in bytes of a 4x4 block of the given format. 0 for TEXTURE_COMPRESSION_NONE
+     */
+    static int get_block_byte_size(TextureCompressionFormat format);
+    static int get_block_count(int width, int height);
+
+    /**
+     * Compresses the 'width' x 'height' texels of 'pixels' that have 'channels' channels.
+     * Images whose size isn't a multiple of 4 are padded by clamping to the border
+     */
+    static std::vector<unsigned char> compress(const unsigned char* pixels, int width, int height, int channels, TextureCompressionFormat format);
+
+    /**
+     * Decodes the texel 'texel_index' (x + y * 4 in the block) of the given block in RGBA.
+     * The channels that aren't stored by the format are decoded to 0, alpha to 255
+     */
+    static void decode_texel(TextureCompressionFormat format, const unsigned char* block, int texel_index, unsigned char out_rgba[4]);
+
+    /**
+     * Decompresses a whole image back to 'channels' channels
+     */
+    static std::vector<unsigned char> decompress(const unsigned char* blocks, int width, int height, int channels, TextureCompressionFormat format);
+
+private:
+    static void compress_block_bc1(const unsigned char block_rgba[16][4], unsigned char* out_block);
+    static void compress_block_bc4(const unsigned char block_values[16], unsigned char* out_block);
+    static void compress_block_bc7(const unsigned char block_rgba[16][4], unsigned char* out_block);
+
+    static void decode_texel_bc1(const unsigned char* block, int texel_index, unsigned char out_rgba[4]);
+    static unsigned char decode_texel_bc4(const unsigned char* block, int texel_index);
+    static void decode_texel_bc7(const unsigned char* block, int texel_index, unsigned char out_rgba[4]);
+};
+
+#endif
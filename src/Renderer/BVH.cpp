@@ -8,6 +8,9 @@
 #include <vector>
 
 #include "Renderer/BVH.h"
+#include "UI/ImGui/ImGuiLogger.h"
+
+extern ImGuiLogger g_imgui_logger;
 
 const float3 BoundingVolume::PLANE_NORMALS[BVHConstants::PLANES_COUNT] = {
 	make_float3(1, 0, 0),
@@ -20,8 +23,15 @@ const float3 BoundingVolume::PLANE_NORMALS[BVHConstants::PLANES_COUNT] = {
 };
 
 BVH::BVH() : m_root(nullptr), m_triangles(nullptr) {}
-BVH::BVH(std::vector<Triangle>* triangles, int max_depth, int leaf_max_obj_count) : m_triangles(triangles)
+BVH::BVH(std::vector<Triangle>* triangles, CPUBVHType bvh_type, int max_depth, int leaf_max_obj_count) : m_bvh_type(bvh_type), m_root(nullptr), m_triangles(triangles)
 {
+	if (m_bvh_type == CPUBVHType::BINARY_SAH)
+	{
+		m_flattened_bvh.build(*triangles);
+
+		return;
+	}
+
 	BoundingVolume volume;
 	float3 minimum = make_float3(INFINITY, INFINITY, INFINITY);
 	float3 maximum = make_float3(-INFINITY, -INFINITY, -INFINITY);
@@ -41,6 +51,11 @@ BVH::BVH(std::vector<Triangle>* triangles, int max_depth, int leaf_max_obj_count
 	build_bvh(max_depth, leaf_max_obj_count, minimum, maximum, volume);
 }
 
+BVH::BVH(std::vector<Triangle>* triangles, const std::vector<int>& mesh_triangle_offsets, const std::vector<SceneInstance>& instances) : m_bvh_type(CPUBVHType::TWO_LEVEL), m_root(nullptr), m_triangles(triangles)
+{
+    m_two_level_bvh.build(*triangles, mesh_triangle_offsets, instances);
+}
+
 BVH::~BVH()
 {
 	delete m_root;
@@ -48,8 +63,11 @@ BVH::~BVH()
 
 void BVH::operator=(BVH&& bvh)
 {
+	m_bvh_type = bvh.m_bvh_type;
 	m_triangles = bvh.m_triangles;
 	m_root = bvh.m_root;
+	m_flattened_bvh = std::move(bvh.m_flattened_bvh);
+	m_two_level_bvh = std::move(bvh.m_two_level_bvh);
 
 	bvh.m_root = nullptr;
 }
@@ -66,5 +84,69 @@ void BVH::build_bvh(int max_depth, int leaf_max_obj_count, float3 min, float3 ma
 
 bool BVH::intersect(const hiprtRay& ray, hiprtHit& hit_info, void* filter_function_payload) const
 {
-    return m_root->intersect(*m_triangles, ray, hit_info, filter_function_payload);
+    if (m_bvh_type == CPUBVHType::BINARY_SAH)
+        return m_flattened_bvh.intersect(ray, hit_info, filter_function_payload);
+    else if (m_bvh_type == CPUBVHType::TWO_LEVEL)
+        return m_two_level_bvh.intersect(ray, hit_info, filter_function_payload);
+    else
+        return m_root->intersect(*m_triangles, ray, hit_info, filter_function_payload);
+}
+
+void BVH::intersect_packet(const hiprtRay* rays, hiprtHit* hits, bool* out_hit_found, int ray_count, void** filter_function_payloads, bool any_hit) const
+{
+    if (m_bvh_type == CPUBVHType::BINARY_SAH)
+        m_flattened_bvh.intersect_packet(rays, hits, out_hit_found, ray_count, filter_function_payloads, any_hit);
+    else if (m_bvh_type == CPUBVHType::TWO_LEVEL)
+        m_two_level_bvh.intersect_packet(rays, hits, out_hit_found, ray_count, filter_function_payloads, any_hit);
+    else
+    {
+        for (int i = 0; i < ray_count; i++)
+            out_hit_found[i] = m_root->intersect(*m_triangles, rays[i], hits[i], filter_function_payloads[i]);
+    }
+}
+
+void BVH::refit()
+{
+    if (m_bvh_type == CPUBVHType::BINARY_SAH)
+        m_flattened_bvh.refit(*m_triangles);
+    else if (m_bvh_type == CPUBVHType::TWO_LEVEL)
+    {
+        for (int mesh_index = 0; mesh_index < m_two_level_bvh.get_mesh_count(); mesh_index++)
+            m_two_level_bvh.refit_mesh(mesh_index, *m_triangles);
+        m_two_level_bvh.rebuild_tlas();
+    }
+    else
+    {
+        // The octree cannot be refitted, rebuilding it
+        delete m_root;
+        m_root = nullptr;
+
+        *this = BVH(m_triangles, CPUBVHType::OCTREE);
+    }
+}
+
+void BVH::refit_mesh(int mesh_index)
+{
+    if (m_bvh_type != CPUBVHType::TWO_LEVEL)
+    {
+        refit();
+
+        return;
+    }
+
+    m_two_level_bvh.refit_mesh(mesh_index, *m_triangles);
+    m_two_level_bvh.rebuild_tlas();
+}
+
+void BVH::set_instance_transform(int instance_index, const float4x4& object_to_world)
+{
+    if (m_bvh_type != CPUBVHType::TWO_LEVEL)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Only the two-level CPU BVH supports instance transforms");
+
+        return;
+    }
+
+    m_two_level_bvh.set_instance_transform(instance_index, object_to_world);
+    m_two_level_bvh.rebuild_tlas();
 }
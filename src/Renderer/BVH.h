@@ -10,7 +10,9 @@
 
 #include "Renderer/BoundingVolume.h"
 #include "Renderer/BVHConstants.h"
+#include "Renderer/FlattenedBVH.h"
 #include "Renderer/Triangle.h"
+#include "Renderer/TwoLevelBVH.h"
 
 #include <array>
 #include <atomic>
@@ -162,6 +164,7 @@ public:
                     if (triangle.intersect(ray, localHit))
                     {
                         localHit.primID = triangle_id;
+                        localHit.instanceID = 0;
 
                         if (filter_function(ray, nullptr, filter_function_payload, localHit))
                             // Hit is filtered
@@ -241,18 +244,57 @@ public:
 
 public:
     BVH();
-    BVH(std::vector<Triangle>* triangles, int max_depth = 32, int leaf_max_obj_count = 8);
+    /**
+     * 'max_depth' and 'leaf_max_obj_count' are only used by the octree.
+     * The flattened BVH uses the constants of BVHConstants
+     */
+    BVH(std::vector<Triangle>* triangles, CPUBVHType bvh_type = CPUBVHType::BINARY_SAH, int max_depth = 32, int leaf_max_obj_count = 8);
+    /**
+     * Builds a TWO_LEVEL BVH with one BLAS per mesh and the given instances of these meshes.
+     * See SceneMetadata::mesh_triangle_offsets
+     */
+    BVH(std::vector<Triangle>* triangles, const std::vector<int>& mesh_triangle_offsets, const std::vector<SceneInstance>& instances);
     ~BVH();
 
     void operator=(BVH&& bvh);
      
     bool intersect(const hiprtRay& ray, hiprtHit& hit_info, void* filter_function_payload) const;
 
+    /**
+     * Intersects a packet of rays with a shared traversal (see FlattenedBVH::intersect_packet()).
+     * The octree has no packet traversal and intersects the rays one by one
+     */
+    void intersect_packet(const hiprtRay* rays, hiprtHit* hits, bool* out_hit_found, int ray_count, void** filter_function_payloads, bool any_hit = false) const;
+
+    /**
+     * Updates the BVH after the triangles have been modified in place without changing
+     * the topology of the tree. The octree doesn't support refitting and is rebuilt
+     */
+    void refit();
+
+    /**
+     * Refits the BVH after the triangles of the mesh have been modified in place.
+     * Only the BLAS of the mesh is refitted with the TWO_LEVEL BVH, the other BVHs are refitted entirely
+     */
+    void refit_mesh(int mesh_index);
+
+    /**
+     * TWO_LEVEL only. Moves an instance rigidly, only the TLAS is rebuilt
+     */
+    void set_instance_transform(int instance_index, const float4x4& object_to_world);
+
 private:
     void build_bvh(int max_depth, int leaf_max_obj_count, float3 min, float3 max, const BoundingVolume& volume);
 
 public:
+    CPUBVHType m_bvh_type = CPUBVHType::BINARY_SAH;
+
+    // Root of the octree if the octree is used
     OctreeNode* m_root;
+    // Used if the BVH type is BINARY_SAH
+    FlattenedBVH m_flattened_bvh;
+    // Used if the BVH type is TWO_LEVEL
+    TwoLevelBVH m_two_level_bvh;
 
     std::vector<Triangle>* m_triangles;
 };
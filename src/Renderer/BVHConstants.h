@@ -6,12 +6,80 @@
 #ifndef BVH_CONSTANTS_H
 #define BVH_CONSTANTS_H
 
+/**
+ * What kind of acceleration structure is built by the CPU BVH
+ *
+ *	- OCTREE
+ *		The original octree of 7-planes bounding volumes. Kept for comparisons
+ *
+ *	- BINARY_SAH
+ *		Flattened binary BVH built with binned SAH and traversed with a stack
+ *
+ *	- TWO_LEVEL
+ *		One BINARY_SAH BVH per mesh (BLAS) and a BINARY_SAH BVH over the instances of
+ *		these meshes (TLAS). Meshes can be moved and refitted without a full rebuild
+ */
+enum CPUBVHType
+{
+    OCTREE,
+    BINARY_SAH,
+    TWO_LEVEL
+};
+
+/**
+ * Instruction set used by the traversal of the flattened BVH on the CPU.
+ * The best level supported by the CPU is detected at runtime when the BVH is built
+ *
+ *	- CPU_SIMD_SCALAR
+ *		One triangle / one box at a time. This is the reference implementation
+ *
+ *	- CPU_SIMD_SSE4
+ *		4 triangles per instruction, one child box per instruction
+ *
+ *	- CPU_SIMD_AVX2
+ *		8 triangles per instruction, both child boxes per instruction
+ */
+enum CPUSIMDLevel
+{
+    CPU_SIMD_SCALAR,
+    CPU_SIMD_SSE4,
+    CPU_SIMD_AVX2
+};
+
 struct BVHConstants
 {
-    static constexpr int FLATTENED_BVH_MAX_STACK_SIZE = 100000;
+    // Size of the traversal stack of the flattened BVH. The builder
+    // guarantees that the depth of the tree never exceeds that
+    static constexpr int FLATTENED_BVH_MAX_STACK_SIZE = 64;
+    // Past this depth, the flattened BVH builder stops using the SAH and splits
+    // at the object median instead so that the depth of the tree stays bounded
+    static constexpr int FLATTENED_BVH_MAX_SAH_DEPTH = 32;
+
+    // How many bins to use for evaluating the SAH cost of the split candidates
+    static constexpr int SAH_BIN_COUNT = 16;
+    // Cost of traversing a node relative to the cost of intersecting a triangle
+    static constexpr float SAH_TRAVERSAL_COST = 0.125f;
+    static constexpr float SAH_TRIANGLE_INTERSECTION_COST = 1.0f;
+
+    // Nodes with fewer triangles than that are built by a single thread.
+    // Nodes with more triangles compute their bounds and SAH bins with all the threads
+    static constexpr int PARALLEL_BUILD_MIN_TRIANGLES = 4096;
+    // The top of the tree is split in parallel until there are at least
+    // that many subtrees per thread. These subtrees are then built concurrently
+    static constexpr int PARALLEL_BUILD_SUBTREES_PER_THREAD = 8;
 
     static constexpr int PLANES_COUNT = 7;
     static constexpr int MAX_TRIANGLES_PER_LEAF = 8;
+    // Number of triangles in the SoA packets of the SIMD traversal.
+    // Each leaf of the flattened BVH is stored in exactly one packet
+    static constexpr int SIMD_TRIANGLE_PACKET_SIZE = 8;
+
+    // Maximum number of rays in a packet of the packet traversal. One 8x8 tile of pixels
+    static constexpr int PACKET_MAX_RAY_COUNT = 64;
+    // When fewer rays than that are still active in a subtree, the packet traversal
+    // finishes that subtree with single rays: the rays aren't coherent enough anymore
+    // for the shared traversal to pay off
+    static constexpr int PACKET_MIN_ACTIVE_RAYS = 4;
 };
 
 #endif
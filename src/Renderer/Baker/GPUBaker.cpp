@@ -5,30 +5,28 @@
 
 #include "Renderer/GPURenderer.h"
 #include "Renderer/Baker/GPUBaker.h"
-#include "Threads/ThreadManager.h"
 
 extern ImGuiLogger g_imgui_logger;
 
 GPUBaker::GPUBaker(std::shared_ptr<GPURenderer> renderer) : m_renderer(renderer) 
 {
 	OROCHI_CHECK_ERROR(oroStreamCreate(&m_bake_stream));
-	m_compiler_priority_mutex = std::make_shared<std::mutex>();
 
-	m_ggx_conductor_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream, m_compiler_priority_mutex,
+	m_ggx_conductor_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream,
 		DEVICE_KERNELS_DIRECTORY "/Baking/GGXConductorDirectionalAlbedo.h", "GGXConductorDirectionalAlbedoBake", "GGX conductor directional albedo");
 
-	m_ggx_fresnel_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream, m_compiler_priority_mutex,
+	m_ggx_fresnel_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream,
 		DEVICE_KERNELS_DIRECTORY "/Baking/GGXFresnelDirectionalAlbedo.h", "GGXFresnelDirectionalAlbedoBake", "GGX fresnel directional albedo");
 
-	m_glossy_dielectric_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream, m_compiler_priority_mutex,
+	m_glossy_dielectric_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream,
 		DEVICE_KERNELS_DIRECTORY "/Baking/GlossyDielectricDirectionalAlbedo.h", "GlossyDielectricDirectionalAlbedoBake", "dielectric directional albedo");
 
-	m_ggx_glass_entering_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream, m_compiler_priority_mutex,
+	m_ggx_glass_entering_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream,
 		DEVICE_KERNELS_DIRECTORY "/Baking/GGXGlassDirectionalAlbedo.h", "GGXGlassDirectionalAlbedoBakeEntering", "GGX glass directional albedo 1/2");
-	m_ggx_glass_exiting_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream, m_compiler_priority_mutex,
+	m_ggx_glass_exiting_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream,
 		DEVICE_KERNELS_DIRECTORY "/Baking/GGXGlassDirectionalAlbedo.h", "GGXGlassDirectionalAlbedoBakeExiting", "GGX glass directional albedo 2/2");
 
-	m_ggx_thin_glass_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream, m_compiler_priority_mutex,
+	m_ggx_thin_glass_directional_albedo_bake_kernel = GPUBakerKernel(m_renderer, m_bake_stream,
 		DEVICE_KERNELS_DIRECTORY "/Baking/GGXThinGlassDirectionalAlbedo.h", "GGXThinGlassDirectionalAlbedoBake", "GGX thin glass directional albedo");
 }
 
@@ -43,10 +43,6 @@ private:
 	std::shared_ptr<GPURenderer> m_renderer = nullptr;
 
 	oroStream_t m_bake_stream;
-	// Mutex so that if we're baking multiple textures at the same time,
-	// we don't run into issue with the compilers wanting to take the priority
-	// (over background compiling kerneks) at the same time
-	std::shared_ptr<std::mutex> m_compiler_priority_mutex;
 
 	GPUBakerKernel m_ggx_conductor_directional_albedo_bake_kernel;
 	GPUBakerKernel m_ggx_fresnel_directional_albedo_bake_kernel;
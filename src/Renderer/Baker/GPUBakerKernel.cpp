@@ -5,14 +5,13 @@
 
 #include "Renderer/Baker/GPUBakerKernel.h"
 #include "Renderer/Baker/GPUBakerConstants.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
 
-GPUBakerKernel::GPUBakerKernel(std::shared_ptr<GPURenderer> renderer, oroStream_t bake_stream, std::shared_ptr<std::mutex> compiler_priority_mutex,
+GPUBakerKernel::GPUBakerKernel(std::shared_ptr<GPURenderer> renderer, oroStream_t bake_stream,
 	const std::string& kernel_filepath, const std::string& kernel_function, const std::string& kernel_title)
 {
 	m_renderer = renderer;
 	m_bake_stream = bake_stream;
-	m_compiler_priority_mutex = compiler_priority_mutex;
 
 	m_kernel_filepath = kernel_filepath;
 	m_kernel_function = kernel_function;
@@ -37,9 +36,9 @@ void GPUBakerKernel::bake_internal(int3 bake_resolution, const void* bake_settin
 	thread_data->bake_settings_pointer = bake_settings_pointer;
 	thread_data->output_filename = output_filename;
 
-	// Starting everything on a thread to avoid blocking to UI (during the compilation
-	// of the kernel mainly)
-	ThreadManager::start_thread("kernel_bake_" + m_kernel_title, [this, thread_data, nb_kernel_iterations] {
+	// Starting everything in a background task to avoid blocking to UI (during the compilation
+	// of the kernel mainly). Nothing waits on the bake, is_complete() is polled instead
+	g_task_scheduler.submit([this, thread_data, nb_kernel_iterations] {
 		OROCHI_CHECK_ERROR(oroCtxSetCurrent(m_renderer->get_hiprt_orochi_ctx()->orochi_ctx));
 
 		int3& bake_resolution = thread_data->bake_resolution;
@@ -50,18 +49,10 @@ void GPUBakerKernel::bake_internal(int3 bake_resolution, const void* bake_settin
 		{
 			g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "%s", ("Compiling " + m_kernel_title + " kernel...").c_str());
 
-			// Taking the priority for the compilation as otherwise, the kernels
-			// precompiling in the background are going to have the hand and we'll
-			// never be able to compile our bake kernel and we'll never start baking
-			// (until all kernels are precompiled in background of course but that's
-			// going to take a long time)
-			std::lock_guard<std::mutex> lock(*m_compiler_priority_mutex);
-			m_renderer->take_kernel_compilation_priority();
-
+			// This is an interactive compilation for the GPUKernelCompiler so it goes
+			// before the kernels precompiling in the background
 			m_bake_kernel = GPUKernel(m_kernel_filepath, m_kernel_function);
 			m_bake_kernel.compile(m_renderer->get_hiprt_orochi_ctx());
-
-			m_renderer->release_kernel_compilation_priority();
 		}
 
 		m_bake_buffer.resize(bake_resolution.x * bake_resolution.y * bake_resolution.z);
@@ -136,9 +127,7 @@ void GPUBakerKernel::bake_internal(int3 bake_resolution, const void* bake_settin
 
 		m_bake_buffer.free();
 		m_bake_complete = true;
-	});
-
-	ThreadManager::detach_threads("kernel_bake_" + m_kernel_title);
+	}, {}, TASK_PRIORITY_BACKGROUND);
 }
 
 bool GPUBakerKernel::is_complete() const
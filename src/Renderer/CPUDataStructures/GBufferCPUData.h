@@ -22,6 +22,7 @@ struct GBufferCPUData
 		shading_normals.resize(new_element_count);
 		primary_hit_position.resize(new_element_count);
 		first_hit_prim_index.resize(new_element_count);
+		first_hit_instance_id.resize(new_element_count);
 		cameray_ray_hit.resize(new_element_count);
 		ray_volume_states.resize(new_element_count);
 	}
@@ -31,6 +32,7 @@ struct GBufferCPUData
 	std::vector<Octahedral24BitNormal> shading_normals;
 	std::vector<float3> primary_hit_position;
 	std::vector<int> first_hit_prim_index;
+	std::vector<int> first_hit_instance_id;
 
 	std::vector<unsigned char> cameray_ray_hit;
 
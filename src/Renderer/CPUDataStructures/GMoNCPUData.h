@@ -6,6 +6,7 @@
 #ifndef RENDERER_GMON_CPU_DATA_H
 #define RENDERER_GMON_CPU_DATA_H
 
+#include "Device/includes/GMoN/GMoNDevice.h"
 #include "Renderer/CPUGPUCommonDataStructures/GMoNCPUGPUCommonData.h"
 
 /**
@@ -19,21 +20,43 @@ struct GMoNCPUData : public GMoNCPUGPUCommonData
 	void resize(unsigned int render_width, unsigned int render_height)
 	{
 		sets.resize(render_width * render_height * number_of_sets);
+		tile_sample_counts.assign(GMoNDevice::get_tile_count(make_int2(render_width, render_height)), 0);
 
 		result_framebuffer = Image32Bit(render_width, render_height, /* channels */ 3);
+
+		current_resolution = make_int2(render_width, render_height);
+		current_number_of_sets = number_of_sets;
+		last_recomputed_sample_count = 0;
+	}
+
+	size_t get_memory_usage_bytes() const
+	{
+		size_t nb_pixels = current_resolution.x * current_resolution.y;
+
+		size_t bytes_result_framebuffer = nb_pixels * sizeof(ColorRGB32F);
+		size_t bytes_sets = nb_pixels * sizeof(GMoNSet) * current_number_of_sets;
+		size_t bytes_tiles = tile_sample_counts.size() * sizeof(unsigned int);
+
+		return bytes_result_framebuffer + bytes_sets + bytes_tiles;
 	}
 
 	// This is one very big buffer that contains all the sets we accumulate into for GMoN
 	//
 	// For example, if GMoNMSets == 5 and a render resolution of 1280x720,
 	// this is going to be a buffer that is 1280*720*5 elements long
-	std::vector<ColorRGB32F> sets;
+	std::vector<GMoNSet> sets;
+
+	// See GMoNDevice::tile_sample_counts
+	std::vector<unsigned int> tile_sample_counts;
 
 	// This is the buffer that contains the G-median of means result of each pixel and this is going
 	// to be displayed in the viewport instead of the regular framebuffer if GMoN is being used
 	Image32Bit result_framebuffer;
 
 	unsigned int number_of_sets = GMoNMSetsCount;
+
+	// Sample count of the render when the median of means was last computed
+	unsigned int last_recomputed_sample_count = 0;
 };
 
 #endif
@@ -17,6 +17,11 @@ struct NEEPlusPlusCPUData : public NEEPlusPlusCPUGPUCommonData
 	int frame_timer_before_visibility_map_update = 32;
 
 	std::vector<AtomicType<unsigned int>> packed_buffer;
+	std::vector<AtomicType<unsigned long long int>> hash_keys;
+	std::vector<AtomicType<unsigned int>> entry_epochs;
+	std::vector<AtomicType<unsigned int>> touched_entries;
+	std::vector<AtomicType<unsigned int>> touched_entry_counts;
+
 	AtomicType<unsigned int> total_shadow_ray_queries;
 	AtomicType<unsigned int> shadow_rays_actually_traced;
 };
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef RENDERER_WAVEFRONT_CPU_DATA_H
+#define RENDERER_WAVEFRONT_CPU_DATA_H
+
+#include "Device/includes/Wavefront/WavefrontPathState.h"
+#include "Device/includes/Wavefront/WavefrontQueues.h"
+
+#include <vector>
+
+/**
+ * CPU-side buffers of the wavefront path tracer
+ */
+struct WavefrontCPUData
+{
+	void resize(unsigned int render_width, unsigned int render_height)
+	{
+		unsigned int pixel_count = render_width * render_height;
+
+		paths.resize(pixel_count);
+		ray_queue.resize(pixel_count);
+		hit_queue.resize(pixel_count);
+		sorted_hit_queue.resize(pixel_count);
+		shadow_ray_queue.resize(pixel_count * SHADOW_RAYS_PER_PIXEL);
+		sorted_shadow_ray_indices.resize(pixel_count * SHADOW_RAYS_PER_PIXEL);
+	}
+
+	void free()
+	{
+		paths = std::vector<WavefrontPathState>();
+		ray_queue = std::vector<int>();
+		hit_queue = std::vector<int>();
+		sorted_hit_queue = std::vector<int>();
+		material_histogram = std::vector<int>();
+		shadow_ray_queue = std::vector<WavefrontShadowRay>();
+		sorted_shadow_ray_indices = std::vector<int>();
+		shadow_ray_bin_offsets = std::vector<int>();
+	}
+
+	void get_device_queues(WavefrontQueues& out_queues)
+	{
+		out_queues.paths = paths.data();
+		out_queues.ray_queue = ray_queue.data();
+		out_queues.ray_queue_size = &ray_queue_size;
+		out_queues.hit_queue = hit_queue.data();
+		out_queues.hit_queue_size = &hit_queue_size;
+		out_queues.shadow_ray_queue = shadow_ray_queue.data();
+		out_queues.shadow_ray_queue_size = &shadow_ray_queue_size;
+		out_queues.shadow_ray_queue_capacity = static_cast<int>(shadow_ray_queue.size());
+	}
+
+	// Average number of shadow rays per path that the shadow ray queue can hold at each bounce.
+	// RIS and envmap MIS only need 3 shadow rays per path with one light sample
+	static constexpr unsigned int SHADOW_RAYS_PER_PIXEL = 4;
+
+	std::vector<WavefrontPathState> paths;
+
+	std::vector<int> ray_queue;
+	AtomicType<int> ray_queue_size;
+
+	std::vector<int> hit_queue;
+	AtomicType<int> hit_queue_size;
+
+	// Scratch buffers for sorting the hit queue by material
+	std::vector<int> sorted_hit_queue;
+	std::vector<int> material_histogram;
+
+	std::vector<WavefrontShadowRay> shadow_ray_queue;
+	AtomicType<int> shadow_ray_queue_size;
+
+	// Scratch buffers for gathering the shadow rays in packets
+	std::vector<int> sorted_shadow_ray_indices;
+	std::vector<int> shadow_ray_bin_offsets;
+};
+
+#endif
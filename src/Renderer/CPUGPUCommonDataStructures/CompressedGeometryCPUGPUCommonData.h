@@ -0,0 +1,125 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef RENDERER_COMPRESSED_GEOMETRY_CPU_GPU_COMMON_DATA_H
+#define RENDERER_COMPRESSED_GEOMETRY_CPU_GPU_COMMON_DATA_H
+
+#include "HostDeviceCommon/Packing.h"
+
+#include <vector>
+
+/**
+ * Packing of the per-vertex data of the scene for GeometryCompression.
+ * Used by both the CPU and the GPU renderer when setting the scene
+ */
+struct CompressedGeometryCPUGPUCommonData
+{
+    static std::vector<Octahedral24BitNormal> pack_vertex_normals(const std::vector<float3>& vertex_normals)
+    {
+        std::vector<Octahedral24BitNormal> packed(vertex_normals.size());
+
+#pragma omp parallel for
+        for (int i = 0; i < vertex_normals.size(); i++)
+        {
+            float3 normal = vertex_normals[i];
+            if (hippt::length(normal) == 0.0f)
+                // Vertices of meshes without normals have a zero normal that
+                // the octahedral mapping cannot encode. That normal is never read anyways
+                normal = make_float3(0.0f, 0.0f, 1.0f);
+
+            packed[i].pack(hippt::normalize(normal));
+        }
+
+        return packed;
+    }
+
+    struct PackedTexcoords
+    {
+        // See QuantizedTexcoordsBuffer
+        std::vector<Uint2xPacked> quantized_texcoords;
+        std::vector<float4> block_bounds;
+        std::vector<int> block_first_vertices;
+        std::vector<int> window_first_blocks;
+    };
+
+    /**
+     * Quantizes the texcoords on 16 bits in the bounds of their block of vertices, see QuantizedTexcoordsBuffer.
+     * The blocks are cut in the vertices of each mesh, given by 'mesh_vertex_offsets' (see SceneMetadata::mesh_vertex_offsets)
+     */
+    static PackedTexcoords pack_texcoords(const std::vector<float2>& texcoords, const std::vector<int>& mesh_vertex_offsets)
+    {
+        PackedTexcoords packed;
+
+        int vertex_count = texcoords.size();
+        int mesh_count = hippt::max(0, static_cast<int>(mesh_vertex_offsets.size()) - 1);
+        for (int mesh_index = 0; mesh_index < mesh_count; mesh_index++)
+            for (int first_vertex = mesh_vertex_offsets[mesh_index]; first_vertex < mesh_vertex_offsets[mesh_index + 1]; first_vertex += QuantizedTexcoordsBuffer::BLOCK_SIZE)
+                packed.block_first_vertices.push_back(first_vertex);
+        // Vertices that aren't part of any mesh, if any, still need a block
+        for (int first_vertex = mesh_count > 0 ? mesh_vertex_offsets.back() : 0; first_vertex < vertex_count; first_vertex += QuantizedTexcoordsBuffer::BLOCK_SIZE)
+            packed.block_first_vertices.push_back(first_vertex);
+        int block_count = packed.block_first_vertices.size();
+        packed.block_first_vertices.push_back(vertex_count);
+
+        int window_count = (vertex_count + QuantizedTexcoordsBuffer::BLOCK_SIZE - 1) / QuantizedTexcoordsBuffer::BLOCK_SIZE;
+        packed.window_first_blocks.resize(window_count);
+        for (int window_index = 0, block_index = 0; window_index < window_count; window_index++)
+        {
+            while (packed.block_first_vertices[block_index + 1] <= window_index * QuantizedTexcoordsBuffer::BLOCK_SIZE)
+                block_index++;
+
+            packed.window_first_blocks[window_index] = block_index;
+        }
+
+        packed.quantized_texcoords.resize(vertex_count);
+        packed.block_bounds.resize(block_count);
+
+#pragma omp parallel for
+        for (int block_index = 0; block_index < block_count; block_index++)
+        {
+            int first_vertex = packed.block_first_vertices[block_index];
+            int last_vertex = packed.block_first_vertices[block_index + 1];
+
+            float2 min_texcoords = texcoords[first_vertex];
+            float2 max_texcoords = texcoords[first_vertex];
+            for (int i = first_vertex + 1; i < last_vertex; i++)
+            {
+                min_texcoords = make_float2(hippt::min(min_texcoords.x, texcoords[i].x), hippt::min(min_texcoords.y, texcoords[i].y));
+                max_texcoords = make_float2(hippt::max(max_texcoords.x, texcoords[i].x), hippt::max(max_texcoords.y, texcoords[i].y));
+            }
+
+            float2 step = (max_texcoords - min_texcoords) / 65535.0f;
+            packed.block_bounds[block_index] = make_float4(min_texcoords.x, min_texcoords.y, step.x, step.y);
+
+            for (int i = first_vertex; i < last_vertex; i++)
+            {
+                // A step of 0 means that all the texcoords of the block are the same on that axis
+                float quantized_u = step.x == 0.0f ? 0.0f : hippt::clamp(0.0f, 65535.0f, roundf((texcoords[i].x - min_texcoords.x) / step.x));
+                float quantized_v = step.y == 0.0f ? 0.0f : hippt::clamp(0.0f, 65535.0f, roundf((texcoords[i].y - min_texcoords.y) / step.y));
+
+                packed.quantized_texcoords[i].set_value<0>(static_cast<unsigned short>(quantized_u));
+                packed.quantized_texcoords[i].set_value<1>(static_cast<unsigned short>(quantized_v));
+            }
+        }
+
+        return packed;
+    }
+
+    /**
+     * Packs the 0/1 per-vertex flags into a bitfield of 32 vertices per unsigned int
+     */
+    static std::vector<unsigned int> pack_has_vertex_normals(const std::vector<unsigned char>& has_vertex_normals)
+    {
+        std::vector<unsigned int> bitfield((has_vertex_normals.size() + 31) / 32, 0u);
+
+        for (int i = 0; i < has_vertex_normals.size(); i++)
+            if (has_vertex_normals[i])
+                bitfield[i / 32] |= 1u << (i % 32);
+
+        return bitfield;
+    }
+};
+
+#endif
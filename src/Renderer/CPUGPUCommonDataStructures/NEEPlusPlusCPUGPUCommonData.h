@@ -13,18 +13,15 @@ struct NEEPlusPlusCPUGPUCommonData
 {
 	unsigned int get_vram_usage_bytes() const
 	{
-		// Number of elements per matrix * sizeof(unsigned int) bytes
-		return get_visibility_matrix_element_count(grid_dimensions_no_envmap + make_int3(2, 2, 2)) * sizeof(unsigned int);
+		// Per entry of the hash table: packed buffers, key, epoch and the two touched entries lists
+		unsigned int bytes_per_entry = sizeof(unsigned int) + sizeof(unsigned long long int) + sizeof(unsigned int) + 2 * sizeof(unsigned int);
+
+		return get_hash_table_entry_count() * bytes_per_entry + 2 * sizeof(unsigned int);
 	}
 
-	unsigned int get_visibility_matrix_element_count(int3 dimensions) const
+	unsigned int get_hash_table_entry_count() const
 	{
-		unsigned int grid_elements_count = dimensions.x * dimensions.y * dimensions.z;
-
-		// Dividing by 2 because the visibility map is symmetrical so we only need half of the matrix
-		unsigned half_matrix_size = grid_elements_count * (grid_elements_count + 1) / 2;
-
-		return half_matrix_size;
+		return hash_table_bucket_count * NEEPlusPlusDevice::HASH_TABLE_BUCKET_SIZE;
 	}
 
 	void get_grid_extents(int3 base_grid_dimensions, float3& out_min_grid_point, float3& out_max_grid_point)
@@ -48,6 +45,10 @@ struct NEEPlusPlusCPUGPUCommonData
 
 	float3 base_grid_min_point, base_grid_max_point;
 
+	// Number of buckets of the visibility hash table, must be a power of 2.
+	// This bounds the memory used by NEE++ whatever the resolution of the grid
+	unsigned int hash_table_bucket_count = NEEPlusPlusDevice::NEE_PLUS_PLUS_DEFAULT_HASH_TABLE_BUCKET_COUNT;
+
 	// After how many samples to stop updating the visibility map
 	// (because it's probably converged enough)
 	int stop_update_samples = 64;
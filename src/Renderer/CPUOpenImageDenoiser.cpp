@@ -0,0 +1,208 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Renderer/CPUOpenImageDenoiser.h"
+#include "UI/ImGui/ImGuiLogger.h"
+
+extern ImGuiLogger g_imgui_logger;
+
+void CPUOpenImageDenoiser::set_use_albedo(bool use_albedo)
+{
+    m_filters_outdated |= m_use_albedo != use_albedo;
+    m_use_albedo = use_albedo;
+}
+
+void CPUOpenImageDenoiser::set_denoise_albedo(bool denoise_albedo_or_not)
+{
+    m_filters_outdated |= m_denoise_albedo != denoise_albedo_or_not;
+    m_denoise_albedo = denoise_albedo_or_not;
+}
+
+void CPUOpenImageDenoiser::set_use_normals(bool use_normals)
+{
+    m_filters_outdated |= m_use_normals != use_normals;
+    m_use_normals = use_normals;
+}
+
+void CPUOpenImageDenoiser::set_denoise_normals(bool denoise_normals_or_not)
+{
+    m_filters_outdated |= m_denoise_normals != denoise_normals_or_not;
+    m_denoise_normals = denoise_normals_or_not;
+}
+
+void CPUOpenImageDenoiser::set_max_memory_mb(int max_memory_mb)
+{
+    m_filters_outdated |= m_max_memory_mb != max_memory_mb;
+    m_max_memory_mb = max_memory_mb;
+}
+
+void CPUOpenImageDenoiser::initialize()
+{
+    if (m_device)
+        return;
+
+    m_device = oidn::newDevice(oidn::DeviceType::CPU);
+
+    const char* error_message;
+    if (m_device.getError(error_message) != oidn::Error::None)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "There was an error getting a CPU device for denoising with OIDN. Perhaps some missing libraries for your hardware? %s", error_message);
+
+        m_device = nullptr;
+        return;
+    }
+
+    m_device.commit();
+}
+
+void CPUOpenImageDenoiser::set_buffers(const ColorRGB32F* color, const ColorRGB32F* albedo_aov, const float3* normals_aov, int width, int height)
+{
+    m_filters_outdated |= m_color != color || m_albedo_aov != albedo_aov || m_normals_aov != normals_aov || m_width != width || m_height != height;
+
+    m_color = color;
+    m_albedo_aov = albedo_aov;
+    m_normals_aov = normals_aov;
+    m_width = width;
+    m_height = height;
+}
+
+void CPUOpenImageDenoiser::finalize()
+{
+    if (!check_device())
+        return;
+
+    // OIDN doesn't support the normals without the albedo
+    bool use_albedo = m_use_albedo && m_albedo_aov != nullptr;
+    bool use_normals = m_use_normals && m_normals_aov != nullptr && use_albedo;
+    if (m_use_normals && !use_normals)
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "The normals AOV can only be used for denoising along with the albedo AOV. Denoising without the normals.");
+
+    size_t pixel_count = static_cast<size_t>(m_width) * m_height;
+    m_denoised.resize(pixel_count);
+
+    // The OIDN filters take non-const pointers even for their inputs, they don't write to them though
+    m_beauty_filter = m_device.newFilter("RT");
+    m_beauty_filter.setImage("color", const_cast<ColorRGB32F*>(m_color), oidn::Format::Float3, m_width, m_height);
+    m_beauty_filter.setImage("output", m_denoised.data(), oidn::Format::Float3, m_width, m_height);
+    m_beauty_filter.set("hdr", true);
+    m_beauty_filter.set("cleanAux", (!use_albedo || m_denoise_albedo) && (!use_normals || m_denoise_normals));
+    if (m_max_memory_mb > 0)
+        m_beauty_filter.set("maxMemoryMB", m_max_memory_mb);
+
+    m_albedo_filter = nullptr;
+    m_prefiltered_albedo.clear();
+    m_prefiltered_albedo.shrink_to_fit();
+    if (use_albedo)
+    {
+        ColorRGB32F* albedo = const_cast<ColorRGB32F*>(m_albedo_aov);
+        if (m_denoise_albedo)
+        {
+            m_prefiltered_albedo.resize(pixel_count);
+
+            m_albedo_filter = m_device.newFilter("RT");
+            m_albedo_filter.setImage("albedo", albedo, oidn::Format::Float3, m_width, m_height);
+            m_albedo_filter.setImage("output", m_prefiltered_albedo.data(), oidn::Format::Float3, m_width, m_height);
+            if (m_max_memory_mb > 0)
+                m_albedo_filter.set("maxMemoryMB", m_max_memory_mb);
+            m_albedo_filter.commit();
+
+            albedo = m_prefiltered_albedo.data();
+        }
+
+        m_beauty_filter.setImage("albedo", albedo, oidn::Format::Float3, m_width, m_height);
+    }
+
+    m_normals_filter = nullptr;
+    m_prefiltered_normals.clear();
+    m_prefiltered_normals.shrink_to_fit();
+    if (use_normals)
+    {
+        float3* normals = const_cast<float3*>(m_normals_aov);
+        if (m_denoise_normals)
+        {
+            m_prefiltered_normals.resize(pixel_count);
+
+            m_normals_filter = m_device.newFilter("RT");
+            m_normals_filter.setImage("normal", normals, oidn::Format::Float3, m_width, m_height);
+            m_normals_filter.setImage("output", m_prefiltered_normals.data(), oidn::Format::Float3, m_width, m_height);
+            if (m_max_memory_mb > 0)
+                m_normals_filter.set("maxMemoryMB", m_max_memory_mb);
+            m_normals_filter.commit();
+
+            normals = m_prefiltered_normals.data();
+        }
+
+        m_beauty_filter.setImage("normal", normals, oidn::Format::Float3, m_width, m_height);
+    }
+
+    m_beauty_filter.commit();
+    m_filters_outdated = false;
+}
+
+bool CPUOpenImageDenoiser::denoise(float input_scale)
+{
+    if (m_color == nullptr)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "No buffers were given to the CPU denoiser. Did you forget to call set_buffers()?");
+
+        return false;
+    }
+
+    if (m_filters_outdated)
+        finalize();
+    if (m_filters_outdated)
+        // The filters couldn't be created
+        return false;
+
+    if (m_albedo_filter)
+        m_albedo_filter.execute();
+    if (m_normals_filter)
+        m_normals_filter.execute();
+
+    // Only the parameter changes, this doesn't recreate the filter
+    m_beauty_filter.set("inputScale", input_scale);
+    m_beauty_filter.commit();
+    m_beauty_filter.execute();
+
+    const char* error_message;
+    if (m_device.getError(error_message) != oidn::Error::None)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Error while denoising: %s", error_message);
+
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<Image32Bit> CPUOpenImageDenoiser::get_blended_images(const std::vector<float>& blend_factors) const
+{
+    std::vector<Image32Bit> blended_images;
+    for (float blend_factor : blend_factors)
+    {
+        Image32Bit blended_image(m_width, m_height, 3);
+        ColorRGB32F* blended_pixels = blended_image.get_data_as_ColorRGB32F();
+
+#pragma omp parallel for
+        for (int index = 0; index < m_width * m_height; index++)
+            blended_pixels[index] = blend_factor * m_denoised[index] + (1.0f - blend_factor) * m_color[index];
+
+        blended_images.push_back(std::move(blended_image));
+    }
+
+    return blended_images;
+}
+
+bool CPUOpenImageDenoiser::check_device()
+{
+    if (!m_device)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "The CPU denoiser has no OIDN device. Did you forget to call initialize()?");
+
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef CPU_OPEN_IMAGE_DENOISER_H
+#define CPU_OPEN_IMAGE_DENOISER_H
+
+#include "HostDeviceCommon/Color.h"
+#include "Image/Image.h"
+
+#include <OpenImageDenoise/oidn.hpp>
+#include <vector>
+
+/**
+ * OIDN denoiser of the CPU renderer, the CPU counterpart of OpenImageDenoiser.
+ *
+ * The device and the filters are created once and reused by all the subsequent denoise() calls.
+ * The filters read the framebuffer and the AOVs of the renderer directly in its memory (no copy)
+ * so these buffers must stay alive and at the same address between set_buffers() and denoise()
+ */
+class CPUOpenImageDenoiser
+{
+public:
+    void set_use_albedo(bool use_albedo);
+    void set_denoise_albedo(bool denoise_albedo_or_not);
+    void set_use_normals(bool use_normals);
+    void set_denoise_normals(bool denoise_normals_or_not);
+    /**
+     * Maximum amount of memory that OIDN can use for its filters. Images that
+     * would need more memory are denoised tile by tile by OIDN.
+     *
+     * 0 for the default of OIDN
+     */
+    void set_max_memory_mb(int max_memory_mb);
+
+    /**
+     * Creates the CPU device. Does nothing if the device was already created
+     */
+    void initialize();
+
+    /**
+     * Sets the buffers that are going to be read by the filters. 'albedo_aov' and 'normals_aov'
+     * are only used if set_use_albedo() / set_use_normals() have been called with true.
+     *
+     * The filters are only recreated (on the next call to denoise()) if the buffers or
+     * the resolution changed since the last call
+     */
+    void set_buffers(const ColorRGB32F* color, const ColorRGB32F* albedo_aov, const float3* normals_aov, int width, int height);
+
+    /**
+     * Creates the filters for the buffers given to set_buffers().
+     * Called automatically by denoise() if the filters are outdated
+     */
+    void finalize();
+
+    /**
+     * Denoises the color buffer. The color is multiplied by 'input_scale' before being denoised
+     * and the denoised result is brought back to the scale of the input so that an accumulation
+     * buffer can be denoised as is with 'input_scale' being 1.0f / sample_count
+     *
+     * Returns false if the denoising failed
+     */
+    bool denoise(float input_scale = 1.0f);
+
+    /**
+     * Blends the result of the last denoise() with the noisy color buffer, once per blend factor:
+     *
+     *      blend_factor * denoised + (1.0f - blend_factor) * noisy
+     *
+     * The images are in the scale of the color buffer given to set_buffers()
+     */
+    std::vector<Image32Bit> get_blended_images(const std::vector<float>& blend_factors) const;
+
+private:
+    bool check_device();
+
+    bool m_use_albedo = false;
+    bool m_denoise_albedo = true;
+    bool m_use_normals = false;
+    bool m_denoise_normals = true;
+    int m_max_memory_mb = 0;
+
+    const ColorRGB32F* m_color = nullptr;
+    const ColorRGB32F* m_albedo_aov = nullptr;
+    const float3* m_normals_aov = nullptr;
+    int m_width = 0, m_height = 0;
+
+    // If true, the filters need to be recreated before the next denoising
+    bool m_filters_outdated = true;
+
+    oidn::DeviceRef m_device;
+
+    oidn::FilterRef m_beauty_filter;
+    oidn::FilterRef m_albedo_filter;
+    oidn::FilterRef m_normals_filter;
+
+    // The AOVs of the renderer are only read. They are
+    // prefiltered into these buffers, not in place
+    std::vector<ColorRGB32F> m_prefiltered_albedo;
+    std::vector<float3> m_prefiltered_normals;
+    std::vector<ColorRGB32F> m_denoised;
+};
+
+#endif
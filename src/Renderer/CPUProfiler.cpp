@@ -0,0 +1,275 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Renderer/CPUProfiler.h"
+#include "Renderer/GPURenderer.h"
+#include "UI/PerformanceMetricsComputer.h"
+
+#include <fstream>
+#include <iomanip>
+
+CPUProfiler g_cpu_profiler;
+
+const std::string CPUProfiler::HOT_FUNCTION_KEYS[CPU_PROFILER_HOT_FUNCTION_COUNT] =
+{
+    "BVH Traversal",
+    "BSDF Evaluation",
+    "Light Sampling"
+};
+
+std::mutex CPUProfiler::s_threads_data_mutex;
+std::vector<std::unique_ptr<CPUProfilerThreadData>> CPUProfiler::s_threads_data;
+
+CPUProfilerThreadData& CPUProfiler::get_thread_data()
+{
+    static thread_local CPUProfilerThreadData* thread_data = nullptr;
+
+    if (thread_data == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(s_threads_data_mutex);
+
+        s_threads_data.push_back(std::make_unique<CPUProfilerThreadData>());
+        thread_data = s_threads_data.back().get();
+    }
+
+    return *thread_data;
+}
+
+CPUProfiler::CPUProfiler()
+{
+    m_origin = std::chrono::high_resolution_clock::now();
+}
+
+void CPUProfiler::set_record_trace(bool record_trace)
+{
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    m_record_trace = record_trace;
+}
+
+void CPUProfiler::begin_frame()
+{
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    m_frame_pass_times.clear();
+    m_frame_start_us = get_microseconds_since_origin(std::chrono::high_resolution_clock::now());
+}
+
+void CPUProfiler::end_frame()
+{
+    double frame_end_us = get_microseconds_since_origin(std::chrono::high_resolution_clock::now());
+    CPUProfilerThreadData totals = sum_threads_data();
+
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    m_frame_pass_times[GPURenderer::ALL_RENDER_PASSES_TIME_KEY] = (frame_end_us - m_frame_start_us) / 1000.0;
+    m_previous_frame_totals = m_frame_index > 0 ? m_last_frame_totals : m_counters_baseline;
+    m_last_frame_totals = totals;
+    if (m_record_trace)
+        m_frame_counters.push_back({ frame_end_us, totals });
+    m_frame_index++;
+}
+
+void CPUProfiler::record_pass(const std::string& key, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point stop)
+{
+    double start_us = get_microseconds_since_origin(start);
+    double duration_us = std::chrono::duration<double, std::micro>(stop - start).count();
+
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    if (m_record_trace)
+        m_pass_events.push_back({ key, start_us, duration_us, m_frame_index });
+    m_frame_pass_times[key] += duration_us / 1000.0;
+    m_total_pass_times[key] += duration_us / 1000.0;
+}
+
+void CPUProfiler::update_perf_metrics(std::shared_ptr<PerformanceMetricsComputer> perf_metrics) const
+{
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    for (const auto& [key, time_ms] : m_frame_pass_times)
+        perf_metrics->add_value(key, time_ms);
+
+    if (m_frame_index == 0)
+        return;
+
+    // Hot functions times of the last frame, summed over all the threads
+    CPUProfilerThreadData last_frame = subtract(m_last_frame_totals, m_previous_frame_totals);
+    for (int i = 0; i < CPU_PROFILER_HOT_FUNCTION_COUNT; i++)
+        if (last_frame.hot_function_calls[i] > 0)
+            perf_metrics->add_value(CPUProfiler::HOT_FUNCTION_KEYS[i], last_frame.hot_function_time_ns[i] / 1.0e6);
+}
+
+/**
+ * Escapes the characters of 'string' that cannot appear as is in a JSON string
+ */
+static std::string json_escape(const std::string& string)
+{
+    std::string escaped;
+    for (char character : string)
+    {
+        if (character == '"' || character == '\\')
+            escaped += '\\';
+        escaped += character;
+    }
+
+    return escaped;
+}
+
+bool CPUProfiler::export_chrome_trace(const std::string& file_path) const
+{
+    std::ofstream file(file_path);
+    if (!file.is_open())
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPURenderer\"}}";
+
+    for (const PassEvent& event : m_pass_events)
+        file << "," << std::endl << "{\"name\":\"" << json_escape(event.key) << "\",\"cat\":\"pass\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+             << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us
+             << ",\"args\":{\"frame\":" << event.frame_index << "}}";
+
+    // The counters are written as per frame deltas
+    CPUProfilerThreadData previous = m_counters_baseline;
+    for (const FrameCounters& frame : m_frame_counters)
+    {
+        CPUProfilerThreadData frame_counters = subtract(frame.totals, previous);
+
+        file << "," << std::endl << "{\"name\":\"BVH\",\"ph\":\"C\",\"pid\":0,\"ts\":" << frame.end_us
+             << ",\"args\":{\"rays traced\":" << frame_counters.rays_traced
+             << ",\"nodes visited\":" << frame_counters.bvh_nodes_visited
+             << ",\"triangles tested\":" << frame_counters.triangles_tested << "}}";
+        file << "," << std::endl << "{\"name\":\"Rays\",\"ph\":\"C\",\"pid\":0,\"ts\":" << frame.end_us
+             << ",\"args\":{\"primary\":" << frame_counters.rays_traced_per_type[CPU_PROFILER_PRIMARY_RAY]
+             << ",\"secondary\":" << frame_counters.rays_traced_per_type[CPU_PROFILER_SECONDARY_RAY]
+             << ",\"shadow\":" << frame_counters.rays_traced_per_type[CPU_PROFILER_SHADOW_RAY] << "}}";
+
+#if CPU_PROFILER_HOT_FUNCTIONS
+        file << "," << std::endl << "{\"name\":\"Hot functions (ms, all threads)\",\"ph\":\"C\",\"pid\":0,\"ts\":" << frame.end_us << ",\"args\":{";
+        for (int i = 0; i < CPU_PROFILER_HOT_FUNCTION_COUNT; i++)
+            file << (i > 0 ? "," : "") << "\"" << json_escape(CPUProfiler::HOT_FUNCTION_KEYS[i]) << "\":" << frame_counters.hot_function_time_ns[i] / 1.0e6;
+        file << "}}";
+#endif
+
+        previous = frame.totals;
+    }
+
+    file << std::endl << "]}" << std::endl;
+
+    return true;
+}
+
+void CPUProfiler::print_summary(std::ostream& stream) const
+{
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    if (m_frame_index == 0)
+        return;
+
+    // Sorted by key for a stable output
+    stream << "Render passes (average over " << m_frame_index << " frames):" << std::endl;
+    for (const auto& [key, total_ms] : m_total_pass_times)
+        stream << "\t" << key << ": " << total_ms / m_frame_index << "ms" << std::endl;
+
+    CPUProfilerThreadData totals = subtract(m_last_frame_totals, m_counters_baseline);
+    stream << "\t" << totals.rays_traced << " rays traced, " << totals.bvh_nodes_visited << " BVH nodes visited, " << totals.triangles_tested << " triangles tested";
+    if (totals.rays_traced > 0)
+        stream << " (" << totals.bvh_nodes_visited / static_cast<double>(totals.rays_traced) << " nodes, " << totals.triangles_tested / static_cast<double>(totals.rays_traced) << " triangles per ray)";
+    stream << std::endl;
+    stream << "\t" << totals.rays_traced_per_type[CPU_PROFILER_PRIMARY_RAY] << " primary, " << totals.rays_traced_per_type[CPU_PROFILER_SECONDARY_RAY] << " secondary, " << totals.rays_traced_per_type[CPU_PROFILER_SHADOW_RAY] << " shadow rays" << std::endl;
+
+    for (int i = 0; i < CPU_PROFILER_HOT_FUNCTION_COUNT; i++)
+        if (totals.hot_function_calls[i] > 0)
+            stream << "\t" << CPUProfiler::HOT_FUNCTION_KEYS[i] << ": " << totals.hot_function_calls[i] << " calls, " << totals.hot_function_time_ns[i] / static_cast<double>(totals.hot_function_calls[i]) << "ns per call (all threads)" << std::endl;
+}
+
+CPUProfilerThreadData CPUProfiler::get_counters() const
+{
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    if (m_frame_index == 0)
+        return CPUProfilerThreadData();
+
+    return subtract(m_last_frame_totals, m_counters_baseline);
+}
+
+std::map<std::string, double> CPUProfiler::get_total_pass_times() const
+{
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    return m_total_pass_times;
+}
+
+int CPUProfiler::get_frame_count() const
+{
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    return m_frame_index;
+}
+
+void CPUProfiler::clear()
+{
+    CPUProfilerThreadData baseline = sum_threads_data();
+
+    std::lock_guard<std::mutex> lock(m_events_mutex);
+
+    m_counters_baseline = baseline;
+
+    m_pass_events.clear();
+    m_frame_counters.clear();
+    m_frame_pass_times.clear();
+    m_total_pass_times.clear();
+    m_frame_index = 0;
+}
+
+CPUProfilerThreadData CPUProfiler::sum_threads_data() const
+{
+    std::lock_guard<std::mutex> lock(s_threads_data_mutex);
+
+    CPUProfilerThreadData totals;
+    for (const std::unique_ptr<CPUProfilerThreadData>& thread_data : s_threads_data)
+    {
+        totals.rays_traced += thread_data->rays_traced;
+        totals.bvh_nodes_visited += thread_data->bvh_nodes_visited;
+        totals.triangles_tested += thread_data->triangles_tested;
+        for (int i = 0; i < CPU_PROFILER_RAY_TYPE_COUNT; i++)
+            totals.rays_traced_per_type[i] += thread_data->rays_traced_per_type[i];
+
+        for (int i = 0; i < CPU_PROFILER_HOT_FUNCTION_COUNT; i++)
+        {
+            totals.hot_function_time_ns[i] += thread_data->hot_function_time_ns[i];
+            totals.hot_function_calls[i] += thread_data->hot_function_calls[i];
+        }
+    }
+
+    return totals;
+}
+
+CPUProfilerThreadData CPUProfiler::subtract(const CPUProfilerThreadData& a, const CPUProfilerThreadData& b)
+{
+    CPUProfilerThreadData difference;
+    difference.rays_traced = a.rays_traced - b.rays_traced;
+    difference.bvh_nodes_visited = a.bvh_nodes_visited - b.bvh_nodes_visited;
+    difference.triangles_tested = a.triangles_tested - b.triangles_tested;
+    for (int i = 0; i < CPU_PROFILER_RAY_TYPE_COUNT; i++)
+        difference.rays_traced_per_type[i] = a.rays_traced_per_type[i] - b.rays_traced_per_type[i];
+
+    for (int i = 0; i < CPU_PROFILER_HOT_FUNCTION_COUNT; i++)
+    {
+        difference.hot_function_time_ns[i] = a.hot_function_time_ns[i] - b.hot_function_time_ns[i];
+        difference.hot_function_calls[i] = a.hot_function_calls[i] - b.hot_function_calls[i];
+    }
+
+    return difference;
+}
+
+double CPUProfiler::get_microseconds_since_origin(std::chrono::high_resolution_clock::time_point time) const
+{
+    return std::chrono::duration<double, std::micro>(time - m_origin).count();
+}
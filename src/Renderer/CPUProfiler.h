@@ -0,0 +1,274 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef RENDERER_CPU_PROFILER_H
+#define RENDERER_CPU_PROFILER_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PerformanceMetricsComputer;
+
+/**
+ * If 1, the BVH traversals of the CPU renderer count the rays traced, the nodes visited and the
+ * triangles tested. The counts are accumulated in registers during a traversal and added
+ * to the counters of the thread once at the end of the traversal so this is very cheap
+ */
+#define CPU_PROFILER_COUNTERS 1
+
+/**
+ * If 1, the hot device functions (BVH traversal, BSDF evaluation, light sampling) are timed
+ * on the CPU. This costs two clock reads per call which is not negligible compared to
+ * a BSDF evaluation so this is disabled by default.
+ *
+ * The times are inclusive: the time of the shadow rays traced during light sampling for
+ * example is counted both in the light sampling time and in the BVH traversal time
+ */
+#define CPU_PROFILER_HOT_FUNCTIONS 0
+
+enum CPUProfilerHotFunction
+{
+    CPU_PROFILER_BVH_TRAVERSAL = 0,
+    CPU_PROFILER_BSDF_EVAL,
+    CPU_PROFILER_LIGHT_SAMPLING,
+
+    CPU_PROFILER_HOT_FUNCTION_COUNT
+};
+
+enum CPUProfilerRayType
+{
+    // Closest hit rays of bounce 0
+    CPU_PROFILER_PRIMARY_RAY = 0,
+    // Closest hit rays of the other bounces
+    CPU_PROFILER_SECONDARY_RAY,
+    // Any hit visibility rays (NEE, ReSTIR DI visibility, NEE++ caching, ...)
+    CPU_PROFILER_SHADOW_RAY,
+
+    CPU_PROFILER_RAY_TYPE_COUNT
+};
+
+/**
+ * Counters of one thread. Only ever written by the thread that owns them.
+ * Aligned on a cache line so that threads don't share lines
+ */
+struct alignas(64) CPUProfilerThreadData
+{
+    unsigned long long int rays_traced = 0;
+    unsigned long long int bvh_nodes_visited = 0;
+    unsigned long long int triangles_tested = 0;
+    // Rays traced by the path tracer, by type. A shadow ray that continues through an
+    // alpha-tested transparent surface is counted once per BVH traversal
+    unsigned long long int rays_traced_per_type[CPU_PROFILER_RAY_TYPE_COUNT] = {};
+
+    long long int hot_function_time_ns[CPU_PROFILER_HOT_FUNCTION_COUNT] = {};
+    unsigned long long int hot_function_calls[CPU_PROFILER_HOT_FUNCTION_COUNT] = {};
+};
+
+/**
+ * Lightweight instrumentation of the passes of the CPU renderer.
+ *
+ * The time of each pass is recorded with a CPUProfilerScope. The passes use the same keys as
+ * the kernels of the GPURenderer such that the PerformanceMetricsComputer shows the
+ * same metrics for both renderers.
+ *
+ * If enabled with set_record_trace(), every pass of every frame is also kept as an event that
+ * can be exported as a Chrome trace (chrome://tracing or https://ui.perfetto.dev) along with
+ * the per-frame counters of CPUProfilerThreadData. The events are not kept otherwise so that
+ * the memory used by the profiler doesn't grow with the number of frames rendered
+ */
+class CPUProfiler
+{
+public:
+    // The passes are keyed by the kernel ids of the GPURenderer and of
+    // its render passes (GPURenderer::CAMERA_RAYS_KERNEL_ID, ...)
+    static const std::string HOT_FUNCTION_KEYS[CPU_PROFILER_HOT_FUNCTION_COUNT];
+
+    /**
+     * Returns the counters of the calling thread. They are created on the first call
+     * and owned by the profiler such that they survive the thread
+     */
+    static CPUProfilerThreadData& get_thread_data();
+
+    CPUProfiler();
+
+    /**
+     * Whether or not the passes and counters of each frame are kept for export_chrome_trace().
+     * Disabled by default
+     */
+    void set_record_trace(bool record_trace);
+
+    void begin_frame();
+    /**
+     * Snapshots the counters of all the threads for the frame that just ended.
+     * Must be called when no thread is rendering
+     */
+    void end_frame();
+
+    /**
+     * Adds the time between 'start' and 'stop' to the pass 'key' of the current frame.
+     * Passes that run several times per frame (ReSTIR DI spatial reuse passes for example)
+     * are summed.
+     *
+     * Thread safe
+     */
+    void record_pass(const std::string& key, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point stop);
+
+    /**
+     * Adds the times of the passes of the last frame to 'perf_metrics'
+     */
+    void update_perf_metrics(std::shared_ptr<PerformanceMetricsComputer> perf_metrics) const;
+
+    /**
+     * Writes the events and counters recorded so far in the Chrome trace event JSON format.
+     * The trace is empty if set_record_trace() wasn't enabled. Returns false if the file couldn't be opened
+     */
+    bool export_chrome_trace(const std::string& file_path) const;
+
+    /**
+     * Prints the average time of each pass and the counters over all the frames recorded
+     */
+    void print_summary(std::ostream& stream) const;
+
+    /**
+     * Returns the counters summed over all the threads since the last clear(),
+     * as of the last end_frame()
+     */
+    CPUProfilerThreadData get_counters() const;
+    /**
+     * Returns the total time in milliseconds of each pass over all the frames
+     * recorded since the last clear()
+     */
+    std::map<std::string, double> get_total_pass_times() const;
+    int get_frame_count() const;
+
+    void clear();
+
+private:
+    struct PassEvent
+    {
+        std::string key;
+        // Microseconds since the creation of the profiler
+        double start_us;
+        double duration_us;
+        int frame_index;
+    };
+
+    struct FrameCounters
+    {
+        double end_us;
+        CPUProfilerThreadData totals;
+    };
+
+    CPUProfilerThreadData sum_threads_data() const;
+    static CPUProfilerThreadData subtract(const CPUProfilerThreadData& a, const CPUProfilerThreadData& b);
+    double get_microseconds_since_origin(std::chrono::high_resolution_clock::time_point time) const;
+
+    std::chrono::high_resolution_clock::time_point m_origin;
+
+    mutable std::mutex m_events_mutex;
+    int m_frame_index = 0;
+    // Times in milliseconds of the passes of the frame being recorded / last frame recorded
+    std::unordered_map<std::string, double> m_frame_pass_times;
+    // Times in milliseconds of the passes summed over all the frames since the last clear()
+    std::map<std::string, double> m_total_pass_times;
+    double m_frame_start_us = 0.0;
+
+    // Counters of all the threads summed at the end of the last two frames
+    CPUProfilerThreadData m_last_frame_totals;
+    CPUProfilerThreadData m_previous_frame_totals;
+
+    // Only filled if 'm_record_trace' is true, see set_record_trace()
+    bool m_record_trace = false;
+    std::vector<PassEvent> m_pass_events;
+    // Counters of all the threads summed at the end of each frame (not per frame deltas)
+    std::vector<FrameCounters> m_frame_counters;
+    // Sum of the counters of all the threads at the last clear()
+    CPUProfilerThreadData m_counters_baseline;
+
+    static std::mutex s_threads_data_mutex;
+    static std::vector<std::unique_ptr<CPUProfilerThreadData>> s_threads_data;
+};
+
+extern CPUProfiler g_cpu_profiler;
+
+/**
+ * Records the time of the enclosing scope as the pass 'key' in g_cpu_profiler
+ */
+class CPUProfilerScope
+{
+public:
+    CPUProfilerScope(const std::string& key) : m_key(key), m_start(std::chrono::high_resolution_clock::now()) {}
+    ~CPUProfilerScope() { g_cpu_profiler.record_pass(m_key, m_start, std::chrono::high_resolution_clock::now()); }
+
+private:
+    const std::string& m_key;
+    std::chrono::high_resolution_clock::time_point m_start;
+};
+
+/**
+ * Adds the time of the enclosing scope to the hot function counter of the calling thread
+ */
+class CPUProfilerHotFunctionScope
+{
+public:
+    CPUProfilerHotFunctionScope(CPUProfilerHotFunction hot_function) : m_hot_function(hot_function), m_start(std::chrono::steady_clock::now()) {}
+    ~CPUProfilerHotFunctionScope()
+    {
+        CPUProfilerThreadData& thread_data = CPUProfiler::get_thread_data();
+
+        thread_data.hot_function_time_ns[m_hot_function] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+        thread_data.hot_function_calls[m_hot_function]++;
+    }
+
+private:
+    CPUProfilerHotFunction m_hot_function;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * Counters of a single BVH traversal, added to the counters of the thread when destroyed.
+ * Compiles to nothing if CPU_PROFILER_COUNTERS is 0
+ */
+struct CPUProfilerTraversalCounters
+{
+    ~CPUProfilerTraversalCounters()
+    {
+#if CPU_PROFILER_COUNTERS
+        CPUProfilerThreadData& thread_data = CPUProfiler::get_thread_data();
+
+        thread_data.rays_traced += rays_traced;
+        thread_data.bvh_nodes_visited += nodes_visited;
+        thread_data.triangles_tested += triangles_tested;
+#endif
+    }
+
+    void trace_rays(int count) { rays_traced += count; }
+    void visit_node() { nodes_visited++; }
+    void test_triangles(int count) { triangles_tested += count; }
+
+    unsigned int rays_traced = 0;
+    unsigned int nodes_visited = 0;
+    unsigned int triangles_tested = 0;
+};
+
+#if CPU_PROFILER_COUNTERS
+#define CPU_PROFILER_COUNT_RAYS(ray_type, count) CPUProfiler::get_thread_data().rays_traced_per_type[ray_type] += (count)
+#else
+#define CPU_PROFILER_COUNT_RAYS(ray_type, count)
+#endif
+
+#if CPU_PROFILER_HOT_FUNCTIONS
+#define CPU_PROFILER_HOT_FUNCTION_SCOPE(hot_function) CPUProfilerHotFunctionScope cpu_profiler_hot_function_scope(hot_function)
+#else
+#define CPU_PROFILER_HOT_FUNCTION_SCOPE(hot_function)
+#endif
+
+#endif
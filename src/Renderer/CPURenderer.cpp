@@ -13,15 +13,19 @@
 #include "Device/kernels/ReSTIR/DI/TemporalReuse.h"
 #include "Device/kernels/ReSTIR/DI/SpatialReuse.h"
 #include "Device/kernels/ReSTIR/DI/FusedSpatiotemporalReuse.h"
+#include "Device/kernels/Wavefront/WavefrontPathTracer.h"
 
 #include "Renderer/Baker/GPUBaker.h"
 #include "Renderer/Baker/GPUBakerConstants.h"
 #include "Renderer/CPURenderer.h"
-#include "Threads/ThreadManager.h"
+#include "Renderer/GPURenderer.h"
+#include "Threads/TaskScheduler.h"
 #include "UI/ApplicationSettings.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <filesystem>
 #include <omp.h>
 
  // If 1, only the pixel at DEBUG_PIXEL_X and DEBUG_PIXEL_Y will be rendered,
@@ -68,6 +72,33 @@
 // DEBUG_PIXEL_Y coordinates
 #define DEBUG_NEIGHBORHOOD_SIZE 40
 
+// If 1, the camera rays are traced by tiles of CAMERA_RAYS_PACKET_TILE_SIZE^2 pixels
+// whose rays share a single packet traversal of the BVH.
+// If 0, one single ray traversal per pixel.
+// 
+// Only used when DEBUG_PIXEL is 0
+#define PACKET_CAMERA_RAYS 1
+
+// If 1, the shadow rays of the wavefront path tracer are gathered by tiles of
+// CAMERA_RAYS_PACKET_TILE_SIZE^2 pixels and by direction octant and traced in packets.
+// If 0, one single ray traversal per shadow ray.
+// 
+// Only used when the wavefront path tracer is enabled
+#define PACKET_SHADOW_RAYS 1
+
+// If 1, the hit queue of the wavefront path tracer is sorted by material
+// before the shading stages. Only used when the wavefront path tracer is
+// enabled, see CPURenderer::set_wavefront_path_tracing()
+#define WAVEFRONT_SORT_BY_MATERIAL 1
+
+const std::string CPURenderer::WAVEFRONT_GENERATE_PASS_ID = "Wavefront Generate";
+const std::string CPURenderer::WAVEFRONT_SORT_PASS_ID = "Wavefront Sort By Material";
+const std::string CPURenderer::WAVEFRONT_DIRECT_LIGHTING_PASS_ID = "Wavefront Direct Lighting";
+const std::string CPURenderer::WAVEFRONT_SHADOW_RAYS_PASS_ID = "Wavefront Shadow Rays";
+const std::string CPURenderer::WAVEFRONT_SHADE_PASS_ID = "Wavefront Shade";
+const std::string CPURenderer::WAVEFRONT_EXTEND_PASS_ID = "Wavefront Extend";
+const std::string CPURenderer::WAVEFRONT_ACCUMULATE_PASS_ID = "Wavefront Accumulate";
+
 CPURenderer::CPURenderer(int width, int height) : m_resolution(make_int2(width, height))
 {
     m_framebuffer = Image32Bit(width, height, 3);
@@ -93,6 +124,7 @@ CPURenderer::CPURenderer(int width, int height) : m_resolution(make_int2(width,
     setup_brdfs_data();
     setup_nee_plus_plus();
     setup_gmon();
+    setup_wavefront();
 
     m_rng = Xorshift32Generator(42);
 }
@@ -146,11 +178,22 @@ void CPURenderer::setup_nee_plus_plus()
     // + (2, 2, 2) for envmap NEE++
     m_render_data.nee_plus_plus.grid_dimensions = m_nee_plus_plus.grid_dimensions_no_envmap + make_int3(2, 2, 2);
 
-    // Dividing by 2 because the visibility map is symmetrical so we only need half of the matrix
-    int half_matrix_size = m_nee_plus_plus.get_visibility_matrix_element_count(m_render_data.nee_plus_plus.grid_dimensions);
-    m_nee_plus_plus.packed_buffer = std::vector<AtomicType<unsigned int>>(half_matrix_size);
+    m_render_data.nee_plus_plus.hash_table_bucket_count = m_nee_plus_plus.hash_table_bucket_count;
+    m_render_data.nee_plus_plus.current_epoch = 1;
+
+    unsigned int entry_count = m_nee_plus_plus.get_hash_table_entry_count();
+    m_nee_plus_plus.packed_buffer = std::vector<AtomicType<unsigned int>>(entry_count);
+    m_nee_plus_plus.hash_keys = std::vector<AtomicType<unsigned long long int>>(entry_count);
+    m_nee_plus_plus.entry_epochs = std::vector<AtomicType<unsigned int>>(entry_count);
+    // Two lists, see the NEE++ device structure
+    m_nee_plus_plus.touched_entries = std::vector<AtomicType<unsigned int>>(entry_count * 2);
+    m_nee_plus_plus.touched_entry_counts = std::vector<AtomicType<unsigned int>>(2);
 
     m_render_data.nee_plus_plus.packed_buffers = m_nee_plus_plus.packed_buffer.data();
+    m_render_data.nee_plus_plus.hash_keys = m_nee_plus_plus.hash_keys.data();
+    m_render_data.nee_plus_plus.entry_epochs = m_nee_plus_plus.entry_epochs.data();
+    m_render_data.nee_plus_plus.touched_entries = m_nee_plus_plus.touched_entries.data();
+    m_render_data.nee_plus_plus.touched_entry_counts = m_nee_plus_plus.touched_entry_counts.data();
     m_render_data.nee_plus_plus.total_shadow_ray_queries = &m_nee_plus_plus.total_shadow_ray_queries;
     m_render_data.nee_plus_plus.shadow_rays_actually_traced = &m_nee_plus_plus.shadow_rays_actually_traced;
 #endif
@@ -165,10 +208,50 @@ void CPURenderer::setup_gmon()
     {
         m_gmon.resize(m_resolution.x, m_resolution.y);
         m_render_data.buffers.gmon_estimator.sets = m_gmon.sets.data();
+        m_render_data.buffers.gmon_estimator.tile_sample_counts = m_gmon.tile_sample_counts.data();
         m_render_data.buffers.gmon_estimator.result_framebuffer = m_gmon.result_framebuffer.get_data_as_ColorRGB32F();
     }
 }
 
+void CPURenderer::set_gmon(bool enabled)
+{
+    m_gmon.use_gmon = enabled;
+    setup_gmon();
+
+    if (!m_gmon.use_gmon)
+    {
+        m_render_data.buffers.gmon_estimator.sets = nullptr;
+        m_render_data.buffers.gmon_estimator.result_framebuffer = nullptr;
+        m_render_data.buffers.gmon_estimator.tile_sample_counts = nullptr;
+    }
+}
+
+const GMoNCPUData& CPURenderer::get_gmon_data() const
+{
+    return m_gmon;
+}
+
+void CPURenderer::setup_wavefront()
+{
+    if (m_wavefront_path_tracing)
+    {
+        m_wavefront.resize(m_resolution.x, m_resolution.y);
+        m_wavefront.get_device_queues(m_render_data.buffers.wavefront);
+    }
+}
+
+void CPURenderer::set_wavefront_path_tracing(bool enabled)
+{
+    m_wavefront_path_tracing = enabled;
+    setup_wavefront();
+
+    if (!m_wavefront_path_tracing)
+    {
+        m_wavefront.free();
+        m_render_data.buffers.wavefront = WavefrontQueues();
+    }
+}
+
 void CPURenderer::nee_plus_plus_memcpy_accumulation(int frame_number)
 {
 #if DirectLightUseNEEPlusPlus == KERNEL_OPTION_TRUE
@@ -177,11 +260,16 @@ void CPURenderer::nee_plus_plus_memcpy_accumulation(int frame_number)
     if (!enough_frames_passed || not_updating_vis_map_anymore)
         return;
 
+    CPUProfilerScope profiler_scope(GPURenderer::NEE_PLUS_PLUS_FINALIZE_ACCUMULATION_ID);
+
     // Only doing if using NEE++
-    unsigned int matrix_element_count = m_nee_plus_plus.get_visibility_matrix_element_count(m_nee_plus_plus.get_grid_dimensions_with_envmap());
+    unsigned int touched_entry_count = m_render_data.nee_plus_plus.touched_entry_counts[m_render_data.nee_plus_plus.get_current_touched_entries_list()];
 
-    for (int x = 0; x < matrix_element_count; x++)
+    // At least one call so that the touched entries list of the next epoch is cleared
+    for (unsigned int x = 0; x < hippt::max(1u, touched_entry_count); x++)
         NEEPlusPlusFinalizeAccumulation(m_render_data.nee_plus_plus, x);
+
+    m_render_data.nee_plus_plus.current_epoch++;
 #else
     // Otherwise, it's a no-op
 #endif
@@ -207,6 +295,47 @@ void CPURenderer::set_scene(Scene& parsed_scene)
 {
     m_render_data.GPU_BVH = nullptr;
 
+    // The vertices of the instanced meshes are in object space, only the two-level BVH can trace them
+    bool has_instance_transforms = false;
+    float4x4 identity = identity_affine_matrix();
+    m_instance_object_to_world.clear();
+    m_instance_normal_to_world.clear();
+    for (const SceneInstance& instance : parsed_scene.metadata.instances)
+    {
+        for (int row = 0; row < 4; row++)
+            for (int column = 0; column < 4; column++)
+                has_instance_transforms |= instance.object_to_world.m[row][column] != identity.m[row][column];
+
+        m_instance_object_to_world.push_back(instance.object_to_world);
+        m_instance_normal_to_world.push_back(affine_normal_matrix(affine_matrix_inverse(instance.object_to_world)));
+    }
+
+    CPUBVHType bvh_type = m_bvh_type;
+    if (has_instance_transforms && bvh_type != CPUBVHType::TWO_LEVEL)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "The scene has instanced meshes, using the two-level CPU BVH");
+
+        bvh_type = CPUBVHType::TWO_LEVEL;
+    }
+
+    // The instanceID of the hits of the single-level BVHs isn't an instance index
+    m_render_data.buffers.instance_object_to_world = has_instance_transforms ? m_instance_object_to_world.data() : nullptr;
+    m_render_data.buffers.instance_normal_to_world = has_instance_transforms ? m_instance_normal_to_world.data() : nullptr;
+
+    std::cout << "Building scene BVH..." << std::endl;
+    m_triangle_buffer = parsed_scene.get_triangles();
+    // The BVH of the scene is built on the worker pool while the rest of the scene is being set up
+    m_bvh_build_task = g_task_scheduler.submit([this, bvh_type, mesh_triangle_offsets = parsed_scene.metadata.mesh_triangle_offsets, instances = parsed_scene.metadata.instances]() {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        if (bvh_type == CPUBVHType::TWO_LEVEL)
+            m_bvh = std::make_shared<BVH>(&m_triangle_buffer, mesh_triangle_offsets, instances);
+        else
+            m_bvh = std::make_shared<BVH>(&m_triangle_buffer, bvh_type);
+
+        m_bvh_build_time_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    });
+
     std::vector<DevicePackedTexturedMaterial> gpu_packed_materials;
     gpu_packed_materials.resize(parsed_scene.materials.size());
     for (int i = 0; i < parsed_scene.materials.size(); i++)
@@ -216,18 +345,39 @@ void CPURenderer::set_scene(Scene& parsed_scene)
     m_render_data.buffers.materials_buffer = m_gpu_packed_materials.get_device_SoA_struct();
     m_render_data.buffers.material_indices = parsed_scene.material_indices.data();
 
+    // The CPU has all the versions of the principled BSDF compiled, the specializations
+    // used for the lobes of the scene are picked at runtime, see principled_bsdf_eval()
+    std::vector<unsigned int> specialized_lobe_masks = parsed_scene.get_principled_bsdf_specialized_lobe_masks(PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_COUNT);
+    for (int i = 0; i < specialized_lobe_masks.size(); i++)
+        m_render_data.bsdfs_data.principled_bsdf_specialized_lobe_masks[i] = specialized_lobe_masks[i];
+    m_render_data.bsdfs_data.principled_bsdf_specialized_lobe_mask_count = specialized_lobe_masks.size();
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Specialized principled BSDFs cover %.1f%% of the triangles of the scene", parsed_scene.get_principled_lobe_masks_coverage(specialized_lobe_masks) * 100.0f);
+
     // Computing the opaqueness of materials i.e. whether or not they are FULLY opaque
     m_material_opaque.resize(parsed_scene.materials.size());
     for (int i = 0; i < parsed_scene.materials.size(); i++)
         m_material_opaque[i] = parsed_scene.material_has_opaque_base_color_texture[i] && parsed_scene.materials[i].alpha_opacity == 1.0f;
 
     m_render_data.buffers.material_opaque = m_material_opaque.data();
-    m_render_data.buffers.has_vertex_normals = parsed_scene.has_vertex_normals.data();
     m_render_data.buffers.accumulated_ray_colors = m_framebuffer.get_data_as_ColorRGB32F();
     m_render_data.buffers.triangles_indices = parsed_scene.triangle_indices.data();
     m_render_data.buffers.vertices_positions = parsed_scene.vertices_positions.data();
+#if GeometryCompression == KERNEL_OPTION_TRUE
+    m_has_vertex_normals_bitfield = CompressedGeometryCPUGPUCommonData::pack_has_vertex_normals(parsed_scene.has_vertex_normals);
+    m_packed_vertex_normals = CompressedGeometryCPUGPUCommonData::pack_vertex_normals(parsed_scene.vertex_normals);
+    m_packed_texcoords = CompressedGeometryCPUGPUCommonData::pack_texcoords(parsed_scene.texcoords, parsed_scene.metadata.mesh_vertex_offsets);
+
+    m_render_data.buffers.has_vertex_normals = m_has_vertex_normals_bitfield.data();
+    m_render_data.buffers.vertex_normals = m_packed_vertex_normals.data();
+    m_render_data.buffers.texcoords.quantized_texcoords = m_packed_texcoords.quantized_texcoords.data();
+    m_render_data.buffers.texcoords.block_bounds = m_packed_texcoords.block_bounds.data();
+    m_render_data.buffers.texcoords.block_first_vertices = m_packed_texcoords.block_first_vertices.data();
+    m_render_data.buffers.texcoords.window_first_blocks = m_packed_texcoords.window_first_blocks.data();
+#else
+    m_render_data.buffers.has_vertex_normals = parsed_scene.has_vertex_normals.data();
     m_render_data.buffers.vertex_normals = parsed_scene.vertex_normals.data();
     m_render_data.buffers.texcoords = parsed_scene.texcoords.data();
+#endif
 
     m_render_data.bsdfs_data.sheen_ltc_parameters_texture = &m_sheen_ltc_params;
     m_render_data.bsdfs_data.GGX_conductor_Ess = &m_GGX_conductor_Ess;
@@ -236,9 +386,20 @@ void CPURenderer::set_scene(Scene& parsed_scene)
     m_render_data.bsdfs_data.GGX_Ess_glass_inverse = &m_GGX_Ess_glass_inverse;
     m_render_data.bsdfs_data.GGX_Ess_thin_glass = &m_GGX_Ess_thin_glass;
 
-    ThreadManager::join_threads(ThreadManager::SCENE_TEXTURES_LOADING_THREAD_KEY);
+    g_task_scheduler.wait(parsed_scene.textures_loading_tasks);
+    // Mip levels for the ray cones LOD filtering of the texture fetches
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < parsed_scene.textures.size(); i++)
+        // The mip levels are usually already generated by the texture loading, see SceneParserOptions::generate_texture_mipmaps
+        if (parsed_scene.textures[i].get_mip_level_count() == 1)
+            parsed_scene.textures[i].generate_mipmaps();
     m_render_data.buffers.material_textures = parsed_scene.textures.data();
 
+    m_material_textures_two_channels.resize(parsed_scene.textures.size());
+    for (int i = 0; i < parsed_scene.textures.size(); i++)
+        m_material_textures_two_channels[i] = parsed_scene.textures[i].get_compression_format() == TEXTURE_COMPRESSION_BC5;
+    m_render_data.buffers.material_textures_two_channels = m_material_textures_two_channels.data();
+
     m_render_data.aux_buffers.pixel_active = m_pixel_active_buffer.data();
     m_render_data.aux_buffers.denoiser_albedo = m_denoiser_albedo.data();
     m_render_data.aux_buffers.denoiser_normals = m_denoiser_normals.data();
@@ -253,16 +414,14 @@ void CPURenderer::set_scene(Scene& parsed_scene)
     m_render_data.g_buffer.shading_normals = m_g_buffer.shading_normals.data();
     m_render_data.g_buffer.primary_hit_position = m_g_buffer.primary_hit_position.data();
     m_render_data.g_buffer.first_hit_prim_index = m_g_buffer.first_hit_prim_index.data();
-
-
-
-
+    m_render_data.g_buffer.first_hit_instance_id = m_g_buffer.first_hit_instance_id.data();
 
     m_render_data.g_buffer_prev_frame.materials = m_g_buffer_prev_frame.materials.data();
     m_render_data.g_buffer_prev_frame.geometric_normals = m_g_buffer_prev_frame.geometric_normals.data();
     m_render_data.g_buffer_prev_frame.shading_normals = m_g_buffer_prev_frame.shading_normals.data();
     m_render_data.g_buffer_prev_frame.primary_hit_position = m_g_buffer_prev_frame.primary_hit_position.data();
     m_render_data.g_buffer_prev_frame.first_hit_prim_index = m_g_buffer_prev_frame.first_hit_prim_index.data();
+    m_render_data.g_buffer_prev_frame.first_hit_instance_id = m_g_buffer_prev_frame.first_hit_instance_id.data();
 
     m_render_data.render_settings.restir_di_settings.light_presampling.light_samples = m_restir_di_state.presampled_lights_buffer.data();
     m_render_data.render_settings.restir_di_settings.initial_candidates.output_reservoirs = m_restir_di_state.initial_candidates_reservoirs.data();
@@ -278,56 +437,180 @@ void CPURenderer::set_scene(Scene& parsed_scene)
     m_render_data.nee_plus_plus.grid_min_point = grid_min_point_with_envmap;
     m_render_data.nee_plus_plus.grid_max_point = grid_max_point_with_envmap;
 
-    ThreadManager::join_threads(ThreadManager::SCENE_LOADING_PARSE_EMISSIVE_TRIANGLES);
+    g_task_scheduler.wait(parsed_scene.emissive_triangles_task);
     m_render_data.buffers.emissive_triangles_count = parsed_scene.emissive_triangle_indices.size();
     m_render_data.buffers.emissive_triangles_indices = parsed_scene.emissive_triangle_indices.data();
 
-    std::cout << "Building scene BVH..." << std::endl;
-    m_triangle_buffer = parsed_scene.get_triangles();
-    m_bvh = std::make_shared<BVH>(&m_triangle_buffer);
+    m_parsed_scene_metadata = parsed_scene.metadata;
+    const std::vector<int>& mesh_triangle_offsets = parsed_scene.metadata.mesh_triangle_offsets;
+    m_mesh_has_emissive_triangles = std::vector<bool>(hippt::max(0, static_cast<int>(mesh_triangle_offsets.size()) - 1), false);
+    for (int emissive_triangle_index : parsed_scene.emissive_triangle_indices)
+    {
+        // The triangles of the meshes are contiguous, finding the mesh of the triangle in the offsets
+        int mesh_index = std::upper_bound(mesh_triangle_offsets.begin(), mesh_triangle_offsets.end(), emissive_triangle_index) - mesh_triangle_offsets.begin() - 1;
+        m_mesh_has_emissive_triangles[mesh_index] = true;
+    }
+
+    m_light_bvh.build(parsed_scene);
+    m_render_data.buffers.light_bvh = m_light_bvh.get_host_device_data();
+    m_render_data.buffers.emissive_power_alias_table_probas = m_light_bvh.get_power_alias_table_probas().data();
+    m_render_data.buffers.emissive_power_alias_table_alias = m_light_bvh.get_power_alias_table_alias().data();
+
+    g_task_scheduler.wait(m_bvh_build_task);
     m_render_data.cpu_only.bvh = m_bvh.get();
 }
 
-void CPURenderer::set_envmap(Image32Bit& envmap_image)
+void CPURenderer::set_instance_transform(int instance_index, const float4x4& object_to_world)
 {
-    ThreadManager::join_threads(ThreadManager::ENVMAP_LOAD_FROM_DISK_THREAD);
+    if (instance_index < 0 || instance_index >= m_parsed_scene_metadata.instances.size())
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot set the transform of instance %d, the scene only has %zu instances", instance_index, m_parsed_scene_metadata.instances.size());
 
-    if (envmap_image.width == 0 || envmap_image.height == 0)
+        return;
+    }
+
+    if (m_bvh->m_bvh_type != CPUBVHType::TWO_LEVEL)
     {
-        m_render_data.world_settings.ambient_light_type = AmbientLightType::UNIFORM;
-        m_render_data.world_settings.uniform_light_color = ColorRGB32F(0.5f, 0.5f, 0.5f);
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot move instance %d, the BVH of the scene isn't the two-level BVH", instance_index);
 
-        std::cout << "Empty envmap set on the CPURenderer... Defaulting to uniform ambient light type" << std::endl;
+        return;
+    }
+
+    int mesh_index = m_parsed_scene_metadata.instances[instance_index].mesh_index;
+    if (is_mesh_emissive(mesh_index))
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot move instance %d, its mesh \"%s\" is emissive", instance_index, m_parsed_scene_metadata.mesh_names[mesh_index].c_str());
+
+        return;
+    }
+
+    m_parsed_scene_metadata.instances[instance_index].object_to_world = object_to_world;
+    m_bvh->set_instance_transform(instance_index, object_to_world);
+
+    m_instance_object_to_world[instance_index] = object_to_world;
+    m_instance_normal_to_world[instance_index] = affine_normal_matrix(affine_matrix_inverse(object_to_world));
+    // The hits of the two-level BVH always carry their instance index so the transforms
+    // can be used for the shading even if the scene didn't have any transform until now
+    m_render_data.buffers.instance_object_to_world = m_instance_object_to_world.data();
+    m_render_data.buffers.instance_normal_to_world = m_instance_normal_to_world.data();
+
+    reset();
+}
+
+void CPURenderer::update_mesh_vertices(int mesh_index, const std::vector<float3>& object_space_vertices_positions)
+{
+    int mesh_count = m_mesh_has_emissive_triangles.size();
+    if (mesh_index < 0 || mesh_index >= mesh_count)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot update the vertices of mesh %d, the scene only has %d meshes", mesh_index, mesh_count);
 
         return;
     }
 
-    if (EnvmapSamplingStrategy == ESS_BINARY_SEARCH)
+    if (is_mesh_emissive(mesh_index))
     {
-        m_envmap_cdf = envmap_image.compute_cdf();
-        m_render_data.world_settings.envmap_total_sum = m_envmap_cdf.back();
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot deform mesh \"%s\", it is emissive", m_parsed_scene_metadata.mesh_names[mesh_index].c_str());
+
+        return;
     }
-    else if (EnvmapSamplingStrategy == ESS_ALIAS_TABLE)
+
+    int first_vertex = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index];
+    int vertex_count = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index + 1] - first_vertex;
+    if (object_space_vertices_positions.size() != vertex_count)
     {
-        float total_sum;
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Mesh %d has %d vertices but %zu vertices were given", mesh_index, vertex_count, object_space_vertices_positions.size());
 
-        envmap_image.compute_alias_table(m_alias_table_probas, m_alias_table_alias, &total_sum);
-        m_render_data.world_settings.envmap_total_sum = total_sum;
+        return;
     }
 
-    m_packed_envmap.pack_from(envmap_image);
-    m_render_data.world_settings.envmap = m_packed_envmap.get_data_pointer();
-    m_render_data.world_settings.envmap_width = envmap_image.width;
-    m_render_data.world_settings.envmap_height = envmap_image.height;
-    m_render_data.world_settings.ambient_light_type = AmbientLightType::ENVMAP;
+    // The shading reads the vertices of the scene
+    std::copy(object_space_vertices_positions.begin(), object_space_vertices_positions.end(), m_render_data.buffers.vertices_positions + first_vertex);
+
+    const int* triangles_indices = m_render_data.buffers.triangles_indices;
+    const float3* vertices_positions = m_render_data.buffers.vertices_positions;
+    for (int triangle_index = m_parsed_scene_metadata.mesh_triangle_offsets[mesh_index]; triangle_index < m_parsed_scene_metadata.mesh_triangle_offsets[mesh_index + 1]; triangle_index++)
+        m_triangle_buffer[triangle_index] = Triangle(vertices_positions[triangles_indices[triangle_index * 3 + 0]],
+                                                     vertices_positions[triangles_indices[triangle_index * 3 + 1]],
+                                                     vertices_positions[triangles_indices[triangle_index * 3 + 2]]);
 
-    if (EnvmapSamplingStrategy == ESS_BINARY_SEARCH)
-        m_render_data.world_settings.envmap_cdf = m_envmap_cdf.data();
-    else if (EnvmapSamplingStrategy == ESS_ALIAS_TABLE)
+    m_bvh->refit_mesh(mesh_index);
+
+    reset();
+}
+
+std::vector<float3> CPURenderer::get_mesh_vertices(int mesh_index) const
+{
+    int first_vertex = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index];
+    int last_vertex = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index + 1];
+
+    return std::vector<float3>(m_render_data.buffers.vertices_positions + first_vertex, m_render_data.buffers.vertices_positions + last_vertex);
+}
+
+bool CPURenderer::is_mesh_emissive(int mesh_index) const
+{
+    return m_mesh_has_emissive_triangles[mesh_index];
+}
+
+void CPURenderer::set_envmap(Image32Bit& envmap_image, const TaskHandle& envmap_loading_task)
+{
+    g_task_scheduler.wait(envmap_loading_task);
+
+    if (envmap_image.width == 0 || envmap_image.height == 0)
     {
-        m_render_data.world_settings.alias_table_probas = m_alias_table_probas.data();
-        m_render_data.world_settings.alias_table_alias = m_alias_table_alias.data();
+        m_render_data.world_settings.ambient_light_type = AmbientLightType::UNIFORM;
+        m_render_data.world_settings.uniform_light_color = ColorRGB32F(0.5f, 0.5f, 0.5f);
+
+        std::cout << "Empty envmap set on the CPURenderer... Defaulting to uniform ambient light type" << std::endl;
+
+        return;
     }
+
+    // The sampling structures of the envmap are computed on the worker pool
+    // while the scene is being set up. 'envmap_image' must stay alive until rendering
+    m_envmap_task = g_task_scheduler.submit([this, &envmap_image]() {
+        if (EnvmapSamplingStrategy == ESS_BINARY_SEARCH)
+        {
+            m_envmap_cdf = envmap_image.compute_cdf();
+            m_render_data.world_settings.envmap_total_sum = m_envmap_cdf.back();
+        }
+        else if (EnvmapSamplingStrategy == ESS_ALIAS_TABLE)
+        {
+            float total_sum;
+
+            envmap_image.compute_alias_table(m_alias_table_probas, m_alias_table_alias, &total_sum);
+            m_render_data.world_settings.envmap_total_sum = total_sum;
+        }
+        else if (EnvmapSamplingStrategy == ESS_GUIDED_CDF)
+        {
+            if (!m_envmap_guided_cdf.build(envmap_image))
+            {
+                m_render_data.world_settings.ambient_light_type = AmbientLightType::UNIFORM;
+                m_render_data.world_settings.uniform_light_color = ColorRGB32F(0.5f, 0.5f, 0.5f);
+
+                std::cout << "The envmap couldn't be importance sampled on the CPURenderer... Defaulting to uniform ambient light type" << std::endl;
+
+                return;
+            }
+
+            m_render_data.world_settings.envmap_total_sum = m_envmap_guided_cdf.get_luminance_total_sum();
+        }
+
+        m_packed_envmap.pack_from(envmap_image);
+        m_render_data.world_settings.envmap = m_packed_envmap.get_data_pointer();
+        m_render_data.world_settings.envmap_width = envmap_image.width;
+        m_render_data.world_settings.envmap_height = envmap_image.height;
+        m_render_data.world_settings.ambient_light_type = AmbientLightType::ENVMAP;
+
+        if (EnvmapSamplingStrategy == ESS_BINARY_SEARCH)
+            m_render_data.world_settings.envmap_cdf = m_envmap_cdf.data();
+        else if (EnvmapSamplingStrategy == ESS_ALIAS_TABLE)
+        {
+            m_render_data.world_settings.alias_table_probas = m_alias_table_probas.data();
+            m_render_data.world_settings.alias_table_alias = m_alias_table_alias.data();
+        }
+        else if (EnvmapSamplingStrategy == ESS_GUIDED_CDF)
+            m_render_data.world_settings.envmap_guided_cdf = m_envmap_guided_cdf.get_host_device_data();
+    });
 }
 
 void CPURenderer::set_camera(Camera& camera)
@@ -346,6 +629,16 @@ HIPRTRenderSettings& CPURenderer::get_render_settings()
     return m_render_data.render_settings;
 }
 
+void CPURenderer::set_bvh_type(CPUBVHType bvh_type)
+{
+    m_bvh_type = bvh_type;
+}
+
+float CPURenderer::get_bvh_build_time_ms() const
+{
+    return m_bvh_build_time_ms;
+}
+
 Image32Bit& CPURenderer::get_framebuffer()
 {
     if (m_gmon.use_gmon)
@@ -354,15 +647,81 @@ Image32Bit& CPURenderer::get_framebuffer()
         return m_framebuffer;
 }
 
+void CPURenderer::set_tiled_rendering(bool enabled, int tile_size, TileOrder tile_order)
+{
+    m_tiled_rendering = enabled;
+    if (enabled)
+        m_tile_scheduler.setup(m_resolution, tile_size, tile_order);
+}
+
+void CPURenderer::set_time_budget(float seconds)
+{
+    m_time_budget_seconds = seconds;
+}
+
+void CPURenderer::set_checkpointing(const std::string& output_path, float interval_seconds)
+{
+    m_checkpoint_path = output_path;
+    m_checkpoint_interval_seconds = interval_seconds;
+}
+
+void CPURenderer::set_profiler_trace_output(const std::string& trace_path)
+{
+    m_profiler_trace_path = trace_path;
+}
+
+void CPURenderer::update_perf_metrics(std::shared_ptr<PerformanceMetricsComputer> perf_metrics)
+{
+    g_cpu_profiler.update_perf_metrics(perf_metrics);
+}
+
+std::shared_ptr<PerformanceMetricsComputer> CPURenderer::get_perf_metrics()
+{
+    return m_perf_metrics;
+}
+
+void CPURenderer::write_checkpoint(const std::string& output_path)
+{
+    // Tonemapping a copy so that we can keep accumulating in the framebuffer
+    Image32Bit checkpoint = get_framebuffer();
+    tonemap(checkpoint, 2.2f, 1.0f);
+
+    // Writing to a temporary file first so that a render node killed while
+    // writing the checkpoint never leaves a truncated image behind
+    std::string temporary_path = output_path + ".tmp";
+    if (!checkpoint.write_image_png(temporary_path.c_str()))
+    {
+        std::cerr << "Could not write the checkpoint " << temporary_path << std::endl;
+
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, output_path, error);
+    if (error)
+        std::cerr << "Could not write the checkpoint " << output_path << ": " << error.message() << std::endl;
+}
+
 void CPURenderer::render()  
 {
     std::cout << "CPU rendering..." << std::endl;
 
+    g_task_scheduler.wait(m_envmap_task);
+
+    if (m_perf_metrics == nullptr)
+        m_perf_metrics = std::make_shared<PerformanceMetricsComputer>();
+    // The events of each pass are only kept if the trace is exported at the end of the render
+    g_cpu_profiler.set_record_trace(!m_profiler_trace_path.empty());
+    g_cpu_profiler.clear();
+
     auto start = std::chrono::high_resolution_clock::now();
+    auto last_checkpoint = start;
 
     // Using 'samples_per_frame' as the number of samples to render on the CPU
     for (int frame_number = 1; frame_number <= m_render_data.render_settings.samples_per_frame; frame_number++)
     {
+        g_cpu_profiler.begin_frame();
+
         m_render_data.render_settings.do_update_status_buffers = true;
 
         pre_render_update(frame_number);
@@ -373,10 +732,14 @@ void CPURenderer::render()
         // Only doing ReSTIR DI is ReSTIR DI is enabled 
         ReSTIR_DI_pass();
 #endif
-        tracing_pass();
+        if (m_wavefront_path_tracing)
+            wavefront_tracing_pass();
+        else
+            tracing_pass();
 
         if (m_render_data.render_settings.accumulate)
             m_render_data.render_settings.sample_number++;
+        m_render_data.render_settings.denoiser_AOV_accumulation_counter++;
         m_render_data.random_seed = m_rng.xorshift32();
         m_render_data.render_settings.need_to_reset = false;
         // We want the G Buffer of the frame that we just rendered to go in the "g_buffer_prev_frame"
@@ -385,11 +748,39 @@ void CPURenderer::render()
         nee_plus_plus_memcpy_accumulation(frame_number);
         gmon_check_for_sets_accumulation();
 
+        g_cpu_profiler.end_frame();
+        update_perf_metrics(m_perf_metrics);
+
         std::cout << "Frame " << frame_number << ": " << frame_number/ static_cast<float>(m_render_data.render_settings.samples_per_frame) * 100.0f << "%" << std::endl;
+
+        auto now = std::chrono::high_resolution_clock::now();
+        if (!m_checkpoint_path.empty() && std::chrono::duration<float>(now - last_checkpoint).count() >= m_checkpoint_interval_seconds)
+        {
+            write_checkpoint(m_checkpoint_path);
+
+            last_checkpoint = now;
+        }
+
+        if (m_time_budget_seconds > 0.0f && std::chrono::duration<float>(now - start).count() >= m_time_budget_seconds)
+        {
+            std::cout << "Time budget of " << m_time_budget_seconds << "s reached after " << frame_number << " samples" << std::endl;
+
+            break;
+        }
     }
 
     auto stop = std::chrono::high_resolution_clock::now();
     std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() << "ms" << std::endl;
+
+    g_cpu_profiler.print_summary(std::cout);
+    if (!m_profiler_trace_path.empty())
+    {
+        if (g_cpu_profiler.export_chrome_trace(m_profiler_trace_path))
+            std::cout << "Profiler trace written to " << m_profiler_trace_path << std::endl;
+        else
+            g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Could not write the profiler trace to %s", m_profiler_trace_path.c_str());
+    }
+
 }
 
 void CPURenderer::pre_render_update(int frame_number)
@@ -414,10 +805,18 @@ void CPURenderer::reset()
 {
     m_render_data.render_settings.need_to_reset = true;
     m_render_data.render_settings.sample_number = 0;
+    m_render_data.render_settings.denoiser_AOV_accumulation_counter = 0;
 }
 
 void CPURenderer::debug_render_pass(std::function<void(int, int)> render_pass_function)
 {
+    if (m_tiled_rendering)
+    {
+        m_tile_scheduler.for_each_pixel(render_pass_function);
+
+        return;
+    }
+
     // Center pixel when rendering a neighborhood
     int center_x = 0;
     int center_y = 0;
@@ -504,9 +903,25 @@ void CPURenderer::nee_plus_plus_cache_visibility_pass()
 
 void CPURenderer::camera_rays_pass()
 {
+    CPUProfilerScope profiler_scope(GPURenderer::CAMERA_RAYS_KERNEL_ID);
+
+#if !DEBUG_PIXEL && PACKET_CAMERA_RAYS
+    int tile_count_x = (m_resolution.x + CAMERA_RAYS_PACKET_TILE_SIZE - 1) / CAMERA_RAYS_PACKET_TILE_SIZE;
+    int tile_count_y = (m_resolution.y + CAMERA_RAYS_PACKET_TILE_SIZE - 1) / CAMERA_RAYS_PACKET_TILE_SIZE;
+
+#pragma omp parallel for schedule(dynamic)
+    for (int tile_index = 0; tile_index < tile_count_x * tile_count_y; tile_index++)
+    {
+        int tile_x = (tile_index % tile_count_x) * CAMERA_RAYS_PACKET_TILE_SIZE;
+        int tile_y = (tile_index / tile_count_x) * CAMERA_RAYS_PACKET_TILE_SIZE;
+
+        CameraRaysPacket(m_render_data, m_resolution, tile_x, tile_y);
+    }
+#else
     debug_render_pass([this](int x, int y) {
         CameraRays(m_render_data, m_resolution, x, y);
     });
+#endif
 }
 
 void CPURenderer::ReSTIR_DI_pass()
@@ -566,6 +981,9 @@ LightPresamplingParameters CPURenderer::configure_ReSTIR_DI_light_presampling_pa
      */
     parameters.emissive_triangles_count = m_render_data.buffers.emissive_triangles_count;
     parameters.emissive_triangles_indices = m_render_data.buffers.emissive_triangles_indices;
+    parameters.emissive_power_alias_table_probas = m_render_data.buffers.emissive_power_alias_table_probas;
+    parameters.emissive_power_alias_table_alias = m_render_data.buffers.emissive_power_alias_table_alias;
+    parameters.light_bvh = m_render_data.buffers.light_bvh;
     parameters.triangles_indices = m_render_data.buffers.triangles_indices;
     parameters.vertices_positions = m_render_data.buffers.vertices_positions;
     parameters.material_indices = m_render_data.buffers.material_indices;
@@ -588,6 +1006,8 @@ void CPURenderer::launch_ReSTIR_DI_presampling_lights_pass()
 {
     if (ReSTIR_DI_DoLightsPresampling == KERNEL_OPTION_TRUE)
     {
+        CPUProfilerScope profiler_scope(ReSTIRDIRenderPass::RESTIR_DI_LIGHTS_PRESAMPLING_KERNEL_ID);
+
         LightPresamplingParameters launch_parameters = configure_ReSTIR_DI_light_presampling_pass();
 
         for (int index = 0; index < launch_parameters.number_of_subsets * launch_parameters.subset_size; index++)
@@ -606,6 +1026,7 @@ void CPURenderer::launch_ReSTIR_DI_initial_candidates_pass()
 {
     configure_ReSTIR_DI_initial_pass();
 
+    CPUProfilerScope profiler_scope(ReSTIRDIRenderPass::RESTIR_DI_INITIAL_CANDIDATES_KERNEL_ID);
     debug_render_pass([this](int x, int y) {
         ReSTIR_DI_InitialCandidates(m_render_data, m_resolution, x, y);
     });
@@ -745,6 +1166,8 @@ void CPURenderer::configure_ReSTIR_DI_output_buffer()
 
 void CPURenderer::ReSTIR_DI_temporal_reuse_pass()
 {
+    CPUProfilerScope profiler_scope(ReSTIRDIRenderPass::RESTIR_DI_TEMPORAL_REUSE_KERNEL_ID);
+
     debug_render_pass([this](int x, int y) {
         ReSTIR_DI_TemporalReuse(m_render_data, m_resolution, x, y);
     });
@@ -752,6 +1175,8 @@ void CPURenderer::ReSTIR_DI_temporal_reuse_pass()
 
 void CPURenderer::ReSTIR_DI_spatial_reuse_pass()
 {
+    CPUProfilerScope profiler_scope(ReSTIRDIRenderPass::RESTIR_DI_SPATIAL_REUSE_KERNEL_ID);
+
     debug_render_pass([this](int x, int y) {
         ReSTIR_DI_SpatialReuse(m_render_data, m_resolution, x, y);
     });
@@ -759,6 +1184,8 @@ void CPURenderer::ReSTIR_DI_spatial_reuse_pass()
 
 void CPURenderer::ReSTIR_DI_spatiotemporal_reuse_pass()
 {
+    CPUProfilerScope profiler_scope(ReSTIRDIRenderPass::RESTIR_DI_SPATIOTEMPORAL_REUSE_KERNEL_ID);
+
     debug_render_pass([this](int x, int y) {
         ReSTIR_DI_SpatiotemporalReuse(m_render_data, m_resolution, x, y);
     });
@@ -766,21 +1193,223 @@ void CPURenderer::ReSTIR_DI_spatiotemporal_reuse_pass()
 
 void CPURenderer::tracing_pass()
 {
+    CPUProfilerScope profiler_scope(GPURenderer::PATH_TRACING_KERNEL_ID);
+
     debug_render_pass([this](int x, int y) {
         FullPathTracer(m_render_data, x, y);
     });
 }
 
+void CPURenderer::wavefront_tracing_pass()
+{
+    CPUProfilerScope profiler_scope(GPURenderer::PATH_TRACING_KERNEL_ID);
+
+    m_wavefront.hit_queue_size.store(0);
+    {
+        CPUProfilerScope stage_profiler_scope(CPURenderer::WAVEFRONT_GENERATE_PASS_ID);
+
+        debug_render_pass([this](int x, int y) {
+            WavefrontGenerate(m_render_data, x, y);
+        });
+    }
+
+    int hit_queue_size = m_wavefront.hit_queue_size.load();
+    while (hit_queue_size > 0)
+    {
+#if WAVEFRONT_SORT_BY_MATERIAL
+        {
+            CPUProfilerScope stage_profiler_scope(CPURenderer::WAVEFRONT_SORT_PASS_ID);
+
+            wavefront_sort_hit_queue_by_material();
+        }
+#endif
+
+        m_wavefront.shadow_ray_queue_size.store(0);
+        {
+            CPUProfilerScope stage_profiler_scope(CPURenderer::WAVEFRONT_DIRECT_LIGHTING_PASS_ID);
+
+            wavefront_queue_pass(hit_queue_size, [this, hit_queue_size](int queue_index) {
+                WavefrontDirectLighting(m_render_data, hit_queue_size, queue_index);
+            });
+        }
+
+        // The direct lighting stage only reserves the ranges of shadow rays that fit in
+        // the queue, the shadow rays that didn't fit have already been traced
+        int shadow_ray_queue_size = m_wavefront.shadow_ray_queue_size.load();
+        {
+            CPUProfilerScope stage_profiler_scope(CPURenderer::WAVEFRONT_SHADOW_RAYS_PASS_ID);
+
+#if PACKET_SHADOW_RAYS
+            wavefront_trace_shadow_rays_packets(shadow_ray_queue_size);
+#else
+            wavefront_queue_pass(shadow_ray_queue_size, [this, shadow_ray_queue_size](int queue_index) {
+                WavefrontTraceShadowRays(m_render_data, shadow_ray_queue_size, queue_index);
+            });
+#endif
+        }
+
+        m_wavefront.ray_queue_size.store(0);
+        {
+            CPUProfilerScope stage_profiler_scope(CPURenderer::WAVEFRONT_SHADE_PASS_ID);
+
+            wavefront_queue_pass(hit_queue_size, [this, hit_queue_size](int queue_index) {
+                WavefrontShade(m_render_data, hit_queue_size, queue_index);
+            });
+        }
+
+        int ray_queue_size = m_wavefront.ray_queue_size.load();
+        m_wavefront.hit_queue_size.store(0);
+        {
+            CPUProfilerScope stage_profiler_scope(CPURenderer::WAVEFRONT_EXTEND_PASS_ID);
+
+            wavefront_queue_pass(ray_queue_size, [this, ray_queue_size](int queue_index) {
+                WavefrontExtend(m_render_data, ray_queue_size, queue_index);
+            });
+        }
+
+        hit_queue_size = m_wavefront.hit_queue_size.load();
+    }
+
+    {
+        CPUProfilerScope stage_profiler_scope(CPURenderer::WAVEFRONT_ACCUMULATE_PASS_ID);
+
+        debug_render_pass([this](int x, int y) {
+            WavefrontAccumulate(m_render_data, x, y);
+        });
+    }
+}
+
+void CPURenderer::wavefront_queue_pass(int queue_size, std::function<void(int)> stage_function)
+{
+#if DEBUG_PIXEL == 0
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (int queue_index = 0; queue_index < queue_size; queue_index++)
+        stage_function(queue_index);
+}
+
+void CPURenderer::wavefront_sort_hit_queue_by_material()
+{
+    // Counting sort of the paths on the material index of their hit
+    int hit_queue_size = m_wavefront.hit_queue_size.load();
+    int material_count = static_cast<int>(m_material_opaque.size());
+
+    m_wavefront.material_histogram.assign(material_count + 1, 0);
+    for (int i = 0; i < hit_queue_size; i++)
+    {
+        const WavefrontPathState& path = m_wavefront.paths[m_wavefront.hit_queue[i]];
+
+        m_wavefront.material_histogram[m_render_data.buffers.material_indices[path.closest_hit_info.primitive_index] + 1]++;
+    }
+
+    // Prefix sum for the first index of each material in the sorted queue
+    for (int material_index = 0; material_index < material_count; material_index++)
+        m_wavefront.material_histogram[material_index + 1] += m_wavefront.material_histogram[material_index];
+
+    for (int i = 0; i < hit_queue_size; i++)
+    {
+        int path_index = m_wavefront.hit_queue[i];
+        const WavefrontPathState& path = m_wavefront.paths[path_index];
+
+        int material_index = m_render_data.buffers.material_indices[path.closest_hit_info.primitive_index];
+        m_wavefront.sorted_hit_queue[m_wavefront.material_histogram[material_index]++] = path_index;
+    }
+
+    std::swap(m_wavefront.hit_queue, m_wavefront.sorted_hit_queue);
+    m_render_data.buffers.wavefront.hit_queue = m_wavefront.hit_queue.data();
+}
+
+void CPURenderer::wavefront_trace_shadow_rays_packets(int shadow_ray_queue_size)
+{
+    int tile_count_x = (m_resolution.x + CAMERA_RAYS_PACKET_TILE_SIZE - 1) / CAMERA_RAYS_PACKET_TILE_SIZE;
+    int tile_count_y = (m_resolution.y + CAMERA_RAYS_PACKET_TILE_SIZE - 1) / CAMERA_RAYS_PACKET_TILE_SIZE;
+    // One bin per direction octant of each tile
+    int bin_count = tile_count_x * tile_count_y * 8;
+
+    auto get_shadow_ray_bin = [this, tile_count_x](const WavefrontShadowRay& shadow_ray) {
+        // The paths are indexed by their pixel
+        int tile_x = (shadow_ray.path_index % m_resolution.x) / CAMERA_RAYS_PACKET_TILE_SIZE;
+        int tile_y = (shadow_ray.path_index / m_resolution.x) / CAMERA_RAYS_PACKET_TILE_SIZE;
+        int octant = (shadow_ray.ray.direction.x < 0.0f ? 1 : 0) | (shadow_ray.ray.direction.y < 0.0f ? 2 : 0) | (shadow_ray.ray.direction.z < 0.0f ? 4 : 0);
+
+        return (tile_x + tile_y * tile_count_x) * 8 + octant;
+    };
+
+    // Counting sort of the shadow rays on their bin, same as wavefront_sort_hit_queue_by_material()
+    std::vector<int>& bin_offsets = m_wavefront.shadow_ray_bin_offsets;
+    bin_offsets.assign(bin_count + 1, 0);
+    for (int i = 0; i < shadow_ray_queue_size; i++)
+        bin_offsets[get_shadow_ray_bin(m_wavefront.shadow_ray_queue[i]) + 1]++;
+
+    for (int bin_index = 0; bin_index < bin_count; bin_index++)
+        bin_offsets[bin_index + 1] += bin_offsets[bin_index];
+
+    // After this loop, 'bin_offsets[bin]' is the end of 'bin' in the sorted indices
+    for (int i = 0; i < shadow_ray_queue_size; i++)
+        m_wavefront.sorted_shadow_ray_indices[bin_offsets[get_shadow_ray_bin(m_wavefront.shadow_ray_queue[i])]++] = i;
+
+#if DEBUG_PIXEL == 0
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int bin_index = 0; bin_index < bin_count; bin_index++)
+    {
+        int bin_end = bin_offsets[bin_index];
+        for (int packet_start = bin_index == 0 ? 0 : bin_offsets[bin_index - 1]; packet_start < bin_end; packet_start += BVHConstants::PACKET_MAX_RAY_COUNT)
+        {
+            int packet_size = hippt::min(BVHConstants::PACKET_MAX_RAY_COUNT, bin_end - packet_start);
+
+            WavefrontTraceShadowRaysPacket(m_render_data, &m_wavefront.sorted_shadow_ray_indices[packet_start], packet_size);
+        }
+    }
+}
+
 void CPURenderer::gmon_compute_median_of_means()
 {
+    CPUProfilerScope profiler_scope(GMoNRenderPass::COMPUTE_GMON_KERNEL);
+
+    // The median of means is computed after the sample count was incremented
+    m_render_data.buffers.gmon_estimator.last_recomputation_sample_count = m_gmon.last_recomputed_sample_count;
+    m_render_data.buffers.gmon_estimator.recomputation_sample_count = m_render_data.render_settings.sample_number;
+
     debug_render_pass([this](int x, int y) {
         GMoNComputeMedianOfMeans(m_render_data, x, y);
     });
+
+    m_gmon.last_recomputed_sample_count = m_render_data.render_settings.sample_number;
+}
+
+std::vector<Image32Bit> CPURenderer::denoise(const std::vector<float>& blend_factors)
+{
+    m_denoiser.initialize();
+    m_denoiser.set_use_albedo(true);
+    m_denoiser.set_use_normals(true);
+    // The framebuffer is shared with the denoiser, it is not copied
+    m_denoiser.set_buffers(get_framebuffer().get_data_as_ColorRGB32F(), m_denoiser_albedo.data(), m_denoiser_normals.data(), m_resolution.x, m_resolution.y);
+
+    // The framebuffer holds the sum of the samples when accumulating
+    float input_scale = 1.0f;
+    if (m_render_data.render_settings.accumulate && m_render_data.render_settings.sample_number > 0)
+        input_scale = 1.0f / m_render_data.render_settings.sample_number;
+
+    if (!m_denoiser.denoise(input_scale))
+        return std::vector<Image32Bit>();
+
+    return m_denoiser.get_blended_images(blend_factors);
+}
+
+void CPURenderer::set_denoiser_max_memory_mb(int max_memory_mb)
+{
+    m_denoiser.set_max_memory_mb(max_memory_mb);
 }
 
 void CPURenderer::tonemap(float gamma, float exposure)
 {
-    ColorRGB32F* framebuffer_data = get_framebuffer().get_data_as_ColorRGB32F();
+    tonemap(get_framebuffer(), gamma, exposure);
+}
+
+void CPURenderer::tonemap(Image32Bit& image, float gamma, float exposure)
+{
+    ColorRGB32F* framebuffer_data = image.get_data_as_ColorRGB32F();
 
 #if DEBUG_PIXEL == 0
 #pragma omp parallel for schedule(dynamic)
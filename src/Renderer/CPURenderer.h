@@ -11,11 +11,20 @@
 #include "Image/Image.h"
 #include "Image/EnvmapRGBE9995.h"
 #include "Renderer/BVH.h"
+#include "Renderer/EnvmapGuidedCDF.h"
 #include "Renderer/CPUDataStructures/GBufferCPUData.h"
 #include "Renderer/CPUDataStructures/GMoNCPUData.h"
 #include "Renderer/CPUDataStructures/NEEPlusPlusCPUData.h"
 #include "Renderer/CPUDataStructures/MaterialPackedSoACPUData.h"
+#include "Renderer/CPUDataStructures/WavefrontCPUData.h"
+#include "Renderer/CPUGPUCommonDataStructures/CompressedGeometryCPUGPUCommonData.h"
+#include "Renderer/CPUOpenImageDenoiser.h"
+#include "Renderer/CPUProfiler.h"
+#include "Renderer/CPUTileScheduler.h"
+#include "Renderer/LightBVH.h"
 #include "Scene/SceneParser.h"
+#include "Threads/TaskScheduler.h"
+#include "UI/PerformanceMetricsComputer.h"
 #include "Utils/CommandlineArguments.h"
 
 #include <functional>
@@ -25,21 +34,115 @@
 class CPURenderer
 {
 public:
+    // Keys of the stages of the wavefront path tracer in the CPUProfiler.
+    // They are recorded inside the GPURenderer::PATH_TRACING_KERNEL_ID pass
+    static const std::string WAVEFRONT_GENERATE_PASS_ID;
+    static const std::string WAVEFRONT_SORT_PASS_ID;
+    static const std::string WAVEFRONT_DIRECT_LIGHTING_PASS_ID;
+    static const std::string WAVEFRONT_SHADOW_RAYS_PASS_ID;
+    static const std::string WAVEFRONT_SHADE_PASS_ID;
+    static const std::string WAVEFRONT_EXTEND_PASS_ID;
+    static const std::string WAVEFRONT_ACCUMULATE_PASS_ID;
+
     CPURenderer(int width, int height);
 
     void setup_brdfs_data();
     void setup_nee_plus_plus();
     void setup_gmon();
+    void setup_wavefront();
     void nee_plus_plus_memcpy_accumulation(int frame_number);
     void gmon_check_for_sets_accumulation();
 
     void set_scene(Scene& parsed_scene);
-    void set_envmap(Image32Bit& envmap_image);
+    /**
+     * 'envmap_loading_task' is the task reading 'envmap_image' from the disk, if any.
+     * It is waited on before using the envmap
+     */
+    void set_envmap(Image32Bit& envmap_image, const TaskHandle& envmap_loading_task = nullptr);
     void set_camera(Camera& camera);
 
     HIPRTRenderData& get_render_data();
     HIPRTRenderSettings& get_render_settings();
     Image32Bit& get_framebuffer();
+    /**
+     * Type of the BVH built by the next call to set_scene(). BINARY_SAH by default.
+     *
+     * Scenes with instanced meshes (see SceneMetadata::instances) always use the TWO_LEVEL BVH
+     */
+    void set_bvh_type(CPUBVHType bvh_type);
+    /**
+     * Time it took to build the BVH of the last scene given to set_scene()
+     */
+    float get_bvh_build_time_ms() const;
+
+    /**
+     * Moves the instance with an affine object to world transform (see SceneMetadata::instances).
+     * Only the TLAS of the BVH is rebuilt so the BVH of the scene must be the TWO_LEVEL one.
+     *
+     * Instances of emissive meshes cannot be moved, see is_mesh_emissive()
+     */
+    void set_instance_transform(int instance_index, const float4x4& object_to_world);
+    /**
+     * Deforms the mesh, and all its instances: 'object_space_vertices_positions' are the new positions
+     * of all the vertices of the mesh. The BVH is refitted, not rebuilt, so the deformation
+     * should keep the triangles of the mesh roughly where they were.
+     *
+     * The vertices are written in the scene given to set_scene().
+     * Emissive meshes cannot be deformed, see is_mesh_emissive()
+     */
+    void update_mesh_vertices(int mesh_index, const std::vector<float3>& object_space_vertices_positions);
+    std::vector<float3> get_mesh_vertices(int mesh_index) const;
+    /**
+     * Returns true if the mesh has triangles sampled by the direct lighting strategies.
+     * The light BVH and the power alias table are built once, when the scene is set,
+     * so these meshes must stay where they are
+     */
+    bool is_mesh_emissive(int mesh_index) const;
+
+    /**
+     * Enables or disables GMoN for the next render(). GMoN stays disabled if
+     * 'samples_per_frame' is less than the number of GMoN sets
+     */
+    void set_gmon(bool enabled);
+    const GMoNCPUData& get_gmon_data() const;
+
+    /**
+     * If enabled, render() traces the paths with the stages of the wavefront path tracer
+     * (see "Device/kernels/Wavefront/WavefrontPathTracer.h") instead of the 'FullPathTracer'
+     * megakernel. Disabled by default
+     */
+    void set_wavefront_path_tracing(bool enabled);
+
+    /**
+     * If enabled, the render passes render the full frame (whatever DEBUG_PIXEL is)
+     * tile by tile on the task scheduler instead of row by row with OpenMP
+     */
+    void set_tiled_rendering(bool enabled, int tile_size = CPUTileScheduler::DEFAULT_TILE_SIZE, TileOrder tile_order = TILE_ORDER_HILBERT);
+
+    /**
+     * render() stops after 'samples_per_frame' samples or after 'seconds' seconds,
+     * whichever comes first. 0 for no time budget
+     */
+    void set_time_budget(float seconds);
+
+    /**
+     * If 'output_path' isn't empty, render() writes the tonemapped framebuffer
+     * to 'output_path' every 'interval_seconds' seconds
+     */
+    void set_checkpointing(const std::string& output_path, float interval_seconds);
+    void write_checkpoint(const std::string& output_path);
+
+    /**
+     * If 'trace_path' isn't empty, render() exports the passes and counters recorded
+     * by the CPUProfiler as a Chrome trace to 'trace_path' at the end of the render
+     */
+    void set_profiler_trace_output(const std::string& trace_path);
+    /**
+     * Adds the times of the render passes of the last frame to 'perf_metrics'.
+     * The keys are the same as the ones of the GPURenderer
+     */
+    void update_perf_metrics(std::shared_ptr<PerformanceMetricsComputer> perf_metrics);
+    std::shared_ptr<PerformanceMetricsComputer> get_perf_metrics();
 
     void render();
     void pre_render_update(int frame_number);
@@ -73,17 +176,61 @@ public:
 
     void tracing_pass();
 
+    /**
+     * Same as 'tracing_pass()' but the paths are traced with the stages
+     * of the wavefront path tracer instead of one full path per pixel
+     */
+    void wavefront_tracing_pass();
+    void wavefront_queue_pass(int queue_size, std::function<void(int)> stage_function);
+    /**
+     * Reorders the hit queue such that the paths that hit the
+     * same material are next to each other in the queue
+     */
+    void wavefront_sort_hit_queue_by_material();
+    /**
+     * Traces the first 'shadow_ray_queue_size' shadow rays of the shadow ray queue in packets
+     * of the shadow rays of the same tile of pixels going in the same direction octant
+     */
+    void wavefront_trace_shadow_rays_packets(int shadow_ray_queue_size);
+
     void gmon_compute_median_of_means();
 
+    /**
+     * Denoises the framebuffer with the albedo and normals AOVs and returns one
+     * image per blend factor, see CPUOpenImageDenoiser::get_blended_images().
+     *
+     * The denoiser is created on the first call and reused afterwards. The returned images
+     * are in the scale of the framebuffer, they can be tonemapped with tonemap(image, ...)
+     */
+    std::vector<Image32Bit> denoise(const std::vector<float>& blend_factors);
+    /**
+     * Memory limit of the filters of the denoiser, see CPUOpenImageDenoiser::set_max_memory_mb()
+     */
+    void set_denoiser_max_memory_mb(int max_memory_mb);
+
     void tonemap(float gamma, float exposure);
+    void tonemap(Image32Bit& image, float gamma, float exposure);
 
 private:
     int2 m_resolution;
 
+    bool m_tiled_rendering = false;
+    CPUTileScheduler m_tile_scheduler;
+
+    // 0 for no time budget
+    float m_time_budget_seconds = 0.0f;
+    // Empty for no checkpoints
+    std::string m_checkpoint_path;
+    float m_checkpoint_interval_seconds = 0.0f;
+    // Empty for no trace export
+    std::string m_profiler_trace_path;
+    std::shared_ptr<PerformanceMetricsComputer> m_perf_metrics;
+
     Image32Bit m_framebuffer;
     std::vector<unsigned char> m_pixel_active_buffer;
     std::vector<ColorRGB32F> m_denoiser_albedo;
     std::vector<float3> m_denoiser_normals;
+    CPUOpenImageDenoiser m_denoiser;
 
     std::vector<int> m_pixel_sample_count;
     std::vector<int> m_pixel_converged_sample_count;
@@ -95,14 +242,29 @@ private:
     std::vector<float> m_envmap_cdf;
     std::vector<float> m_alias_table_probas;
     std::vector<int> m_alias_table_alias;
+    EnvmapGuidedCDF m_envmap_guided_cdf;
+    // Task that computes the sampling structures of the envmap. Waited on before rendering
+    TaskHandle m_envmap_task = nullptr;
 
     NEEPlusPlusCPUData m_nee_plus_plus;
 
     GMoNCPUData m_gmon;
 
+    bool m_wavefront_path_tracing = false;
+    WavefrontCPUData m_wavefront;
+
     DevicePackedTexturedMaterialSoACPUData m_gpu_packed_materials;
     // Keeps track of which material is fully opaque or not
     std::vector<unsigned char> m_material_opaque;
+    // See RenderBuffers::material_textures_two_channels
+    std::vector<unsigned char> m_material_textures_two_channels;
+
+#if GeometryCompression == KERNEL_OPTION_TRUE
+    // Packed per-vertex data of the scene
+    std::vector<unsigned int> m_has_vertex_normals_bitfield;
+    std::vector<Octahedral24BitNormal> m_packed_vertex_normals;
+    CompressedGeometryCPUGPUCommonData::PackedTexcoords m_packed_texcoords;
+#endif
 
     GBufferCPUData m_g_buffer;
     GBufferCPUData m_g_buffer_prev_frame;
@@ -131,7 +293,21 @@ private:
     Image32Bit3D m_GGX_Ess_thin_glass;
 
     std::vector<Triangle> m_triangle_buffer;
+    // Transforms of the instances of the scene for the shading,
+    // see RenderBuffers::instance_object_to_world
+    std::vector<float4x4> m_instance_object_to_world;
+    std::vector<float4x4> m_instance_normal_to_world;
     std::shared_ptr<BVH> m_bvh;
+    // Task building 'm_bvh', started by set_scene()
+    TaskHandle m_bvh_build_task = nullptr;
+    CPUBVHType m_bvh_type = CPUBVHType::BINARY_SAH;
+    float m_bvh_build_time_ms = 0.0f;
+
+    SceneMetadata m_parsed_scene_metadata;
+    std::vector<bool> m_mesh_has_emissive_triangles;
+
+    // Light BVH and power alias table for sampling the emissive triangles
+    LightBVH m_light_bvh;
 
     Camera m_camera;
     HIPRTRenderData m_render_data;
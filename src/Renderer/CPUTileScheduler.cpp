@@ -0,0 +1,156 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Renderer/CPUTileScheduler.h"
+#include "Threads/TaskScheduler.h"
+
+#include <algorithm>
+
+void CPUTileScheduler::setup(int2 resolution, int tile_size, TileOrder tile_order)
+{
+    m_resolution = resolution;
+    m_tile_size = std::max(1, tile_size);
+
+    int tile_count_x = (resolution.x + m_tile_size - 1) / m_tile_size;
+    int tile_count_y = (resolution.y + m_tile_size - 1) / m_tile_size;
+
+    switch (tile_order)
+    {
+    case TILE_ORDER_SCANLINE:
+        m_tiles = compute_scanline_order(tile_count_x, tile_count_y);
+        break;
+
+    case TILE_ORDER_MORTON:
+        m_tiles = compute_morton_order(tile_count_x, tile_count_y);
+        break;
+
+    case TILE_ORDER_HILBERT:
+    default:
+        m_tiles = compute_hilbert_order(tile_count_x, tile_count_y);
+        break;
+    }
+
+    // Tile coordinates to pixel coordinates
+    for (int2& tile : m_tiles)
+        tile = make_int2(tile.x * m_tile_size, tile.y * m_tile_size);
+}
+
+void CPUTileScheduler::for_each_pixel(const std::function<void(int, int)>& pixel_function) const
+{
+    std::vector<TaskHandle> tile_tasks;
+    tile_tasks.reserve(m_tiles.size());
+
+    for (const int2& tile : m_tiles)
+    {
+        tile_tasks.push_back(g_task_scheduler.submit([this, tile, &pixel_function]() {
+            int stop_x = std::min(tile.x + m_tile_size, m_resolution.x);
+            int stop_y = std::min(tile.y + m_tile_size, m_resolution.y);
+
+            for (int y = tile.y; y < stop_y; y++)
+                for (int x = tile.x; x < stop_x; x++)
+                    pixel_function(x, y);
+        }));
+    }
+
+    g_task_scheduler.wait(tile_tasks);
+}
+
+const std::vector<int2>& CPUTileScheduler::get_tiles() const
+{
+    return m_tiles;
+}
+
+int CPUTileScheduler::get_tile_size() const
+{
+    return m_tile_size;
+}
+
+TileOrder CPUTileScheduler::tile_order_from_string(const std::string& name)
+{
+    if (name == "scanline")
+        return TILE_ORDER_SCANLINE;
+    else if (name == "morton")
+        return TILE_ORDER_MORTON;
+    else
+        return TILE_ORDER_HILBERT;
+}
+
+std::vector<int2> CPUTileScheduler::compute_scanline_order(int tile_count_x, int tile_count_y)
+{
+    std::vector<int2> tiles;
+    tiles.reserve(tile_count_x * tile_count_y);
+
+    for (int y = 0; y < tile_count_y; y++)
+        for (int x = 0; x < tile_count_x; x++)
+            tiles.push_back(make_int2(x, y));
+
+    return tiles;
+}
+
+std::vector<int2> CPUTileScheduler::compute_morton_order(int tile_count_x, int tile_count_y)
+{
+    auto spread_bits = [](unsigned int value) {
+        value = (value | (value << 8)) & 0x00FF00FF;
+        value = (value | (value << 4)) & 0x0F0F0F0F;
+        value = (value | (value << 2)) & 0x33333333;
+        value = (value | (value << 1)) & 0x55555555;
+
+        return value;
+    };
+
+    std::vector<int2> tiles = compute_scanline_order(tile_count_x, tile_count_y);
+    std::sort(tiles.begin(), tiles.end(), [&spread_bits](const int2& a, const int2& b) {
+        return (spread_bits(a.x) | (spread_bits(a.y) << 1)) < (spread_bits(b.x) | (spread_bits(b.y) << 1));
+    });
+
+    return tiles;
+}
+
+std::vector<int2> CPUTileScheduler::compute_hilbert_order(int tile_count_x, int tile_count_y)
+{
+    // The Hilbert curve is defined on a power of 2 square grid. Walking the curve
+    // of the smallest square grid that covers all the tiles and skipping the
+    // positions that are outside of the image
+    int grid_size = 1;
+    while (grid_size < tile_count_x || grid_size < tile_count_y)
+        grid_size *= 2;
+
+    std::vector<int2> tiles;
+    tiles.reserve(tile_count_x * tile_count_y);
+
+    for (int curve_index = 0; curve_index < grid_size * grid_size; curve_index++)
+    {
+        // Curve index to 2D coordinates on the Hilbert curve
+        int x = 0;
+        int y = 0;
+        int remaining = curve_index;
+        for (int quadrant_size = 1; quadrant_size < grid_size; quadrant_size *= 2)
+        {
+            int quadrant_x = 1 & (remaining / 2);
+            int quadrant_y = 1 & (remaining ^ quadrant_x);
+
+            // Rotating the quadrant
+            if (quadrant_y == 0)
+            {
+                if (quadrant_x == 1)
+                {
+                    x = quadrant_size - 1 - x;
+                    y = quadrant_size - 1 - y;
+                }
+
+                std::swap(x, y);
+            }
+
+            x += quadrant_size * quadrant_x;
+            y += quadrant_size * quadrant_y;
+            remaining /= 4;
+        }
+
+        if (x < tile_count_x && y < tile_count_y)
+            tiles.push_back(make_int2(x, y));
+    }
+
+    return tiles;
+}
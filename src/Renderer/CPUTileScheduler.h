@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef CPU_TILE_SCHEDULER_H
+#define CPU_TILE_SCHEDULER_H
+
+#include "HostDeviceCommon/Math.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+enum TileOrder
+{
+    // Rows of tiles from top to bottom
+    TILE_ORDER_SCANLINE,
+    // Tiles sorted along a Z-order curve
+    TILE_ORDER_MORTON,
+    // Tiles sorted along a Hilbert curve. Consecutive tiles are adjacent when the grid of tiles
+    // is a power of 2 square. Otherwise, the curve jumps where it leaves the image
+    TILE_ORDER_HILBERT
+};
+
+/**
+ * Splits the image in square tiles and executes the render passes of the
+ * CPU renderer tile by tile on the worker threads of the task scheduler.
+ *
+ * One task is submitted per tile in the order of the space filling curve given by
+ * the TileOrder. The workers pick the tiles in that order and steal from each other
+ * when they run out of tiles such that all the cores are busy until the end of the pass
+ * while the tiles being rendered at the same time stay close to each other
+ * on the image (and thus in the BVH and textures)
+ */
+class CPUTileScheduler
+{
+public:
+    // 32x32 pixels: enough work per task for the scheduling overhead to be negligible while
+    // leaving enough tiles for the workers to balance the load at the end of a pass.
+    // A tile isn't rendered by the same worker from one pass to the next so the
+    // tiles don't keep their per pixel data in the cache of a core between passes
+    static constexpr int DEFAULT_TILE_SIZE = 32;
+
+    void setup(int2 resolution, int tile_size, TileOrder tile_order);
+
+    /**
+     * Calls 'pixel_function' for all the pixels of the image, tile by tile.
+     * Returns once all the tiles have been rendered
+     */
+    void for_each_pixel(const std::function<void(int, int)>& pixel_function) const;
+
+    /**
+     * Origin (bottom left pixel) of the tiles in the order they're going to be scheduled
+     */
+    const std::vector<int2>& get_tiles() const;
+    int get_tile_size() const;
+
+    /**
+     * Returns the TileOrder that corresponds to the given name ("scanline", "morton", "hilbert").
+     * Returns TILE_ORDER_HILBERT if the name isn't recognized
+     */
+    static TileOrder tile_order_from_string(const std::string& name);
+
+private:
+    static std::vector<int2> compute_scanline_order(int tile_count_x, int tile_count_y);
+    static std::vector<int2> compute_morton_order(int tile_count_x, int tile_count_y);
+    static std::vector<int2> compute_hilbert_order(int tile_count_x, int tile_count_y);
+
+    int2 m_resolution = make_int2(0, 0);
+    int m_tile_size = DEFAULT_TILE_SIZE;
+
+    std::vector<int2> m_tiles;
+};
+
+#endif
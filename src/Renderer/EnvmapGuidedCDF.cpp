@@ -0,0 +1,156 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Image/Image.h"
+#include "Renderer/EnvmapGuidedCDF.h"
+#include "UI/ImGui/ImGuiLogger.h"
+
+#include <algorithm>
+#include <cmath>
+
+extern ImGuiLogger g_imgui_logger;
+
+bool EnvmapGuidedCDF::build(const Image32Bit& envmap)
+{
+    int width = envmap.width;
+    int height = envmap.height;
+
+    if (width > MAX_ENVMAP_WIDTH)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Envmap is too wide (%d) for the guided CDF sampling strategy. Maximum width is %d.", width, MAX_ENVMAP_WIDTH);
+
+        return false;
+    }
+
+    m_conditional_guide_size = std::max(1u, (width + EnvmapGuidedCDFDevice::CONDITIONAL_GUIDE_RATIO - 1) / EnvmapGuidedCDFDevice::CONDITIONAL_GUIDE_RATIO);
+
+    m_marginal_cdf.resize(height);
+    m_marginal_guide.resize(height);
+    m_conditional_cdfs.resize(static_cast<size_t>(width) * height);
+    m_conditional_guides.resize(static_cast<size_t>(m_conditional_guide_size) * height);
+
+    std::vector<double> row_weights(height);
+    double luminance_total_sum = 0.0;
+
+#pragma omp parallel for reduction(+:luminance_total_sum)
+    for (int y = 0; y < height; y++)
+    {
+        // Polar angle at the center of the row
+        double sin_theta = std::sin((y + 0.5) / height * M_PI);
+
+        std::vector<double> texel_weights(width);
+        double row_weight = 0.0;
+        unsigned int non_zero_texels = 0;
+        for (int x = 0; x < width; x++)
+        {
+            double luminance = envmap.luminance_of_pixel(x, y);
+
+            texel_weights[x] = luminance * sin_theta;
+            row_weight += texel_weights[x];
+            non_zero_texels += texel_weights[x] > 0.0;
+            luminance_total_sum += luminance;
+        }
+        row_weights[y] = row_weight;
+
+        unsigned short* conditional_cdf = m_conditional_cdfs.data() + static_cast<size_t>(y) * width;
+        if (row_weight == 0.0)
+        {
+            // The row will never be sampled, uniform CDF just to have a valid one
+            for (int x = 0; x < width; x++)
+                conditional_cdf[x] = static_cast<unsigned short>((static_cast<unsigned long long int>(x + 1) * EnvmapGuidedCDFDevice::CONDITIONAL_CDF_MAX) / width);
+        }
+        else
+        {
+            // Every texel with a non-zero weight gets at least one quantization step so that
+            // it can still be sampled. The remaining steps are distributed proportionally to the weights
+            unsigned int proportional_steps = EnvmapGuidedCDFDevice::CONDITIONAL_CDF_MAX - non_zero_texels;
+
+            double prefix_weight = 0.0;
+            unsigned int prefix_non_zero_texels = 0;
+            for (int x = 0; x < width; x++)
+            {
+                prefix_weight += texel_weights[x];
+                prefix_non_zero_texels += texel_weights[x] > 0.0;
+
+                unsigned int steps = static_cast<unsigned int>(std::llround(prefix_weight / row_weight * proportional_steps));
+                conditional_cdf[x] = static_cast<unsigned short>(prefix_non_zero_texels + std::min(steps, proportional_steps));
+            }
+        }
+        conditional_cdf[width - 1] = EnvmapGuidedCDFDevice::CONDITIONAL_CDF_MAX;
+
+        // Guide table of the row: first texel whose CDF value is above the
+        // lowest random number that falls in each entry of the guide table.
+        // Lowered by one step to be robust to the rounding in the sampling function
+        unsigned int* conditional_guide = m_conditional_guides.data() + static_cast<size_t>(y) * m_conditional_guide_size;
+        int x = 0;
+        for (unsigned int guide_index = 0; guide_index < m_conditional_guide_size; guide_index++)
+        {
+            double threshold = static_cast<double>(guide_index) / m_conditional_guide_size * EnvmapGuidedCDFDevice::CONDITIONAL_CDF_MAX - 1.0;
+            while (x < width - 1 && conditional_cdf[x] <= threshold)
+                x++;
+
+            conditional_guide[guide_index] = x;
+        }
+    }
+
+    double total_weight = 0.0;
+    for (int y = 0; y < height; y++)
+        total_weight += row_weights[y];
+
+    double prefix_weight = 0.0;
+    for (int y = 0; y < height; y++)
+    {
+        float previous_cdf = y == 0 ? 0.0f : m_marginal_cdf[y - 1];
+
+        if (total_weight == 0.0)
+        {
+            // Black envmap, uniform rows
+            m_marginal_cdf[y] = static_cast<float>(y + 1) / height;
+
+            continue;
+        }
+
+        prefix_weight += row_weights[y];
+        m_marginal_cdf[y] = std::min(1.0f, static_cast<float>(prefix_weight / total_weight));
+        if (row_weights[y] > 0.0 && m_marginal_cdf[y] <= previous_cdf)
+            // Making sure that rows with a non-zero weight keep a non-zero probability
+            // even if their weight is lost in the float precision of the CDF
+            m_marginal_cdf[y] = std::min(1.0f, std::nextafter(previous_cdf, 2.0f));
+    }
+    m_marginal_cdf[height - 1] = 1.0f;
+
+    int y = 0;
+    for (int guide_index = 0; guide_index < height; guide_index++)
+    {
+        double threshold = static_cast<double>(guide_index) / height - 1.0e-6;
+        while (y < height - 1 && m_marginal_cdf[y] <= threshold)
+            y++;
+
+        m_marginal_guide[guide_index] = y;
+    }
+
+    m_luminance_total_sum = static_cast<float>(luminance_total_sum);
+
+    return true;
+}
+
+EnvmapGuidedCDFDevice EnvmapGuidedCDF::get_host_device_data()
+{
+    EnvmapGuidedCDFDevice guided_cdf;
+    guided_cdf.marginal_cdf = m_marginal_cdf.data();
+    guided_cdf.marginal_guide = m_marginal_guide.data();
+    guided_cdf.conditional_cdfs = m_conditional_cdfs.data();
+    guided_cdf.conditional_guides = m_conditional_guides.data();
+    guided_cdf.conditional_guide_size = m_conditional_guide_size;
+
+    return guided_cdf;
+}
+
+const std::vector<float>& EnvmapGuidedCDF::get_marginal_cdf() const { return m_marginal_cdf; }
+const std::vector<unsigned int>& EnvmapGuidedCDF::get_marginal_guide() const { return m_marginal_guide; }
+const std::vector<unsigned short>& EnvmapGuidedCDF::get_conditional_cdfs() const { return m_conditional_cdfs; }
+const std::vector<unsigned int>& EnvmapGuidedCDF::get_conditional_guides() const { return m_conditional_guides; }
+unsigned int EnvmapGuidedCDF::get_conditional_guide_size() const { return m_conditional_guide_size; }
+float EnvmapGuidedCDF::get_luminance_total_sum() const { return m_luminance_total_sum; }
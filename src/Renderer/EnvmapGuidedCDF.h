@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef ENVMAP_GUIDED_CDF_H
+#define ENVMAP_GUIDED_CDF_H
+
+#include "Device/includes/EnvmapGuidedCDF/EnvmapGuidedCDFDevice.h"
+
+#include <vector>
+
+class Image32Bit;
+
+/**
+ * Host side construction of the marginal / conditional CDFs and guide tables
+ * used by EnvmapSamplingStrategy == ESS_GUIDED_CDF. See EnvmapGuidedCDFDevice.
+ *
+ * The texels are weighted by their luminance times the sine of their polar angle
+ * so that the sampling density is proportional to the luminance in solid angle
+ * (the texels close to the poles cover a smaller solid angle).
+ *
+ * The rows are built in parallel.
+ */
+class EnvmapGuidedCDF
+{
+public:
+    // The conditional CDFs are quantized to 16 bits: every texel with a non-zero luminance
+    // is guaranteed a non-zero probability only if a row has less texels than that
+    static constexpr unsigned int MAX_ENVMAP_WIDTH = 32768;
+
+    /**
+     * Returns false if the envmap is too wide for the quantized conditional CDFs
+     */
+    bool build(const Image32Bit& envmap);
+
+    /**
+     * Returns the guided CDF with pointers to the host buffers of this instance.
+     * Only usable by the CPU renderer
+     */
+    EnvmapGuidedCDFDevice get_host_device_data();
+
+    const std::vector<float>& get_marginal_cdf() const;
+    const std::vector<unsigned int>& get_marginal_guide() const;
+    const std::vector<unsigned short>& get_conditional_cdfs() const;
+    const std::vector<unsigned int>& get_conditional_guides() const;
+    unsigned int get_conditional_guide_size() const;
+
+    /**
+     * Sum of the luminance of all the texels of the envmap
+     */
+    float get_luminance_total_sum() const;
+
+private:
+    std::vector<float> m_marginal_cdf;
+    std::vector<unsigned int> m_marginal_guide;
+    std::vector<unsigned short> m_conditional_cdfs;
+    std::vector<unsigned int> m_conditional_guides;
+    unsigned int m_conditional_guide_size = 0;
+
+    float m_luminance_total_sum = 0.0f;
+};
+
+#endif
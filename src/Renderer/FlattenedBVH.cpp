@@ -0,0 +1,897 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Device/functions/FilterFunction.h"
+#include "Renderer/CPUProfiler.h"
+#include "Renderer/FlattenedBVH.h"
+#include "UI/ImGui/ImGuiLogger.h"
+#include "Utils/Utils.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <omp.h>
+
+extern ImGuiLogger g_imgui_logger;
+
+/**
+ * Returns the component 'axis' of the given vector.
+ *
+ * X = 0, Y = 1, Z = 2
+ */
+static inline float get_axis(const float3& vector, int axis)
+{
+    return *(&vector.x + axis);
+}
+
+static inline int get_centroid_bin(const float3& centroid, int axis, const BoundingBox& centroid_bounds)
+{
+    float axis_min = get_axis(centroid_bounds.mini, axis);
+    float axis_extent = centroid_bounds.get_extent(axis);
+
+    int bin = static_cast<int>(BVHConstants::SAH_BIN_COUNT * (get_axis(centroid, axis) - axis_min) / axis_extent);
+
+    return hippt::clamp(0, BVHConstants::SAH_BIN_COUNT - 1, bin);
+}
+
+void FlattenedBVH::build(const std::vector<Triangle>& triangles, CPUSIMDLevel max_simd_level, int primitive_index_offset, bool log_statistics)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    m_nodes.clear();
+    m_ordered_triangles.clear();
+    m_triangle_indices.clear();
+    m_triangle_packets.clear();
+
+    // The SIMD level must be known before building because it changes the SAH costs
+    m_simd_level = CPUSIMDLevel::CPU_SIMD_SCALAR;
+#if FLATTENED_BVH_X86_SIMD
+    if (max_simd_level >= CPUSIMDLevel::CPU_SIMD_AVX2 && Utils::cpu_supports_avx2())
+        m_simd_level = CPUSIMDLevel::CPU_SIMD_AVX2;
+    else if (max_simd_level >= CPUSIMDLevel::CPU_SIMD_SSE4 && Utils::cpu_supports_sse4_1())
+        m_simd_level = CPUSIMDLevel::CPU_SIMD_SSE4;
+#endif
+
+    if (triangles.empty())
+        return;
+
+    int triangle_count = triangles.size();
+    std::vector<BoundingBox> triangles_bboxes(triangle_count);
+    std::vector<float3> triangles_centroids(triangle_count);
+    m_triangle_indices.resize(triangle_count);
+#pragma omp parallel for
+    for (int i = 0; i < triangle_count; i++)
+    {
+        const Triangle& triangle = triangles[i];
+
+        triangles_bboxes[i].extend(triangle.m_a);
+        triangles_bboxes[i].extend(triangle.m_b);
+        triangles_bboxes[i].extend(triangle.m_c);
+        triangles_centroids[i] = triangles_bboxes[i].get_center();
+
+        m_triangle_indices[i] = i;
+    }
+
+    int leaf_count;
+    int max_depth;
+    build_nodes(triangles_bboxes, triangles_centroids, leaf_count, max_depth);
+
+    if (m_simd_level == CPUSIMDLevel::CPU_SIMD_SCALAR)
+    {
+        // Reordering the triangles so that the triangles of a leaf are next to each other in memory
+        m_ordered_triangles.resize(triangle_count);
+#pragma omp parallel for
+        for (int i = 0; i < triangle_count; i++)
+        {
+            m_ordered_triangles[i] = triangles[m_triangle_indices[i]];
+            m_triangle_indices[i] += primitive_index_offset;
+        }
+    }
+    else
+    {
+        build_triangle_packets(triangles, primitive_index_offset);
+
+        // The packets store the triangle indices themselves
+        m_triangle_indices.clear();
+        m_triangle_indices.shrink_to_fit();
+    }
+
+    if (!log_statistics)
+        return;
+
+    const char* simd_level_names[] = { "scalar", "SSE4", "AVX2" };
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "CPU BVH built in %lldms with %d threads. Traversal: %s", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count(), omp_get_max_threads(), simd_level_names[m_simd_level]);
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "CPU BVH statistics: %zu nodes, %d leaves, %.2f triangles per leaf, max depth %d", m_nodes.size(), leaf_count, triangle_count / static_cast<float>(leaf_count), max_depth);
+}
+
+void FlattenedBVH::build_from_bounding_boxes(const std::vector<BoundingBox>& bounding_boxes)
+{
+    m_nodes.clear();
+    m_ordered_triangles.clear();
+    m_triangle_indices.clear();
+    m_triangle_packets.clear();
+
+    // The leaves of the TLAS contain instances, not triangles
+    m_simd_level = CPUSIMDLevel::CPU_SIMD_SCALAR;
+
+    if (bounding_boxes.empty())
+        return;
+
+    int primitive_count = bounding_boxes.size();
+    std::vector<float3> centroids(primitive_count);
+    m_triangle_indices.resize(primitive_count);
+    for (int i = 0; i < primitive_count; i++)
+    {
+        centroids[i] = bounding_boxes[i].get_center();
+        m_triangle_indices[i] = i;
+    }
+
+    int leaf_count;
+    int max_depth;
+    build_nodes(bounding_boxes, centroids, leaf_count, max_depth);
+}
+
+void FlattenedBVH::build_nodes(const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, int& out_leaf_count, int& out_max_depth)
+{
+    int triangle_count = triangles_bboxes.size();
+
+    // A binary tree with N leaves has at most 2N - 1 nodes
+    m_nodes.resize(triangle_count * 2 - 1);
+
+    // Splitting the top of the tree with all the threads working on the same node
+    // until we have enough subtrees to keep all the threads busy
+    int thread_count = omp_get_max_threads();
+    int subtree_max_triangles = hippt::max(BVHConstants::PARALLEL_BUILD_MIN_TRIANGLES, triangle_count / (thread_count * BVHConstants::PARALLEL_BUILD_SUBTREES_PER_THREAD));
+
+    std::vector<BuildJob> top_jobs = { { 0, 0, triangle_count, 0 } };
+    std::vector<BuildJob> subtree_jobs;
+    while (!top_jobs.empty())
+    {
+        BuildJob job = top_jobs.back();
+        top_jobs.pop_back();
+
+        if (job.end - job.start <= subtree_max_triangles)
+        {
+            subtree_jobs.push_back(job);
+
+            continue;
+        }
+
+        int middle = split_node(job, triangles_bboxes, triangles_centroids, /* parallel */ true);
+        if (middle == -1)
+            // The node was made a leaf
+            continue;
+
+        // The first child immediately follows its parent and the second child
+        // is placed right after the nodes reserved for the first child
+        top_jobs.push_back({ job.node_index + 1, job.start, middle, job.depth + 1 });
+        top_jobs.push_back({ job.node_index + 2 * (middle - job.start), middle, job.end, job.depth + 1 });
+    }
+
+    // Building the subtrees concurrently, each subtree with a single thread.
+    // Biggest subtrees first for a better load balancing
+    std::sort(subtree_jobs.begin(), subtree_jobs.end(), [](const BuildJob& a, const BuildJob& b) { return a.end - a.start > b.end - b.start; });
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < subtree_jobs.size(); i++)
+        build_recursive(subtree_jobs[i], triangles_bboxes, triangles_centroids);
+
+    compact_nodes(out_leaf_count, out_max_depth);
+}
+
+void FlattenedBVH::refit(const std::vector<Triangle>& triangles)
+{
+    // Leaves first, from the new positions of their triangles
+#pragma omp parallel for
+    for (int node_index = 0; node_index < m_nodes.size(); node_index++)
+    {
+        FlattenedBVHNode& node = m_nodes[node_index];
+        if (!node.is_leaf())
+            continue;
+
+        BoundingBox leaf_bounds;
+        if (m_simd_level == CPUSIMDLevel::CPU_SIMD_SCALAR)
+        {
+            for (int i = node.primitives_offset_or_second_child; i < node.primitives_offset_or_second_child + node.primitive_count; i++)
+            {
+                const Triangle& triangle = triangles[m_triangle_indices[i]];
+
+                m_ordered_triangles[i] = triangle;
+                leaf_bounds.extend(triangle.m_a);
+                leaf_bounds.extend(triangle.m_b);
+                leaf_bounds.extend(triangle.m_c);
+            }
+        }
+        else
+        {
+            FlattenedBVHTrianglePacket& packet = m_triangle_packets[node.primitives_offset_or_second_child];
+            for (int lane = 0; lane < node.primitive_count; lane++)
+            {
+                int triangle_index = packet.triangle_indices[lane];
+                const Triangle& triangle = triangles[triangle_index];
+
+                set_triangle_packet_lane(packet, lane, triangle, triangle_index);
+                leaf_bounds.extend(triangle.m_a);
+                leaf_bounds.extend(triangle.m_b);
+                leaf_bounds.extend(triangle.m_c);
+            }
+        }
+
+        node.aabb_min = leaf_bounds.mini;
+        node.aabb_max = leaf_bounds.maxi;
+    }
+
+    // The children of a node are always after their parent in
+    // the array so going backwards refits the children before their parent
+    for (int node_index = static_cast<int>(m_nodes.size()) - 1; node_index >= 0; node_index--)
+    {
+        FlattenedBVHNode& node = m_nodes[node_index];
+        if (node.is_leaf())
+            continue;
+
+        const FlattenedBVHNode& first_child = m_nodes[node_index + 1];
+        const FlattenedBVHNode& second_child = m_nodes[node.primitives_offset_or_second_child];
+
+        node.aabb_min = hippt::min(first_child.aabb_min, second_child.aabb_min);
+        node.aabb_max = hippt::max(first_child.aabb_max, second_child.aabb_max);
+    }
+}
+
+void FlattenedBVH::build_recursive(const BuildJob& job, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids)
+{
+    int middle = split_node(job, triangles_bboxes, triangles_centroids, /* parallel */ false);
+    if (middle == -1)
+        return;
+
+    build_recursive({ job.node_index + 1, job.start, middle, job.depth + 1 }, triangles_bboxes, triangles_centroids);
+    build_recursive({ job.node_index + 2 * (middle - job.start), middle, job.end, job.depth + 1 }, triangles_bboxes, triangles_centroids);
+}
+
+int FlattenedBVH::split_node(const BuildJob& job, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, bool parallel)
+{
+    int start = job.start;
+    int end = job.end;
+
+    BoundingBox node_bounds;
+    BoundingBox centroid_bounds;
+    compute_bounds(start, end, triangles_bboxes, triangles_centroids, parallel, node_bounds, centroid_bounds);
+
+    int triangle_count = end - start;
+    if (triangle_count == 1)
+    {
+        make_leaf(job.node_index, start, end, node_bounds);
+
+        return -1;
+    }
+
+    // Splitting along the axis of largest extent of the centroids
+    int split_axis = 0;
+    if (centroid_bounds.get_extent(1) > centroid_bounds.get_extent(split_axis))
+        split_axis = 1;
+    if (centroid_bounds.get_extent(2) > centroid_bounds.get_extent(split_axis))
+        split_axis = 2;
+
+    int middle;
+    if (centroid_bounds.get_extent(split_axis) <= 0.0f)
+    {
+        // All the centroids are at the same position, we cannot split spatially
+        if (triangle_count <= BVHConstants::MAX_TRIANGLES_PER_LEAF)
+        {
+            make_leaf(job.node_index, start, end, node_bounds);
+
+            return -1;
+        }
+
+        // Too many triangles for a single leaf, splitting arbitrarily in the middle
+        middle = (start + end) / 2;
+    }
+    else if (job.depth >= BVHConstants::FLATTENED_BVH_MAX_SAH_DEPTH)
+    {
+        if (triangle_count <= BVHConstants::MAX_TRIANGLES_PER_LEAF)
+        {
+            make_leaf(job.node_index, start, end, node_bounds);
+
+            return -1;
+        }
+
+        // Too deep in the tree, splitting at the object median
+        // to guarantee that the depth of the tree stays bounded
+        middle = (start + end) / 2;
+        std::nth_element(m_triangle_indices.begin() + start, m_triangle_indices.begin() + middle, m_triangle_indices.begin() + end,
+            [&triangles_centroids, split_axis](int a, int b) {
+                return get_axis(triangles_centroids[a], split_axis) < get_axis(triangles_centroids[b], split_axis);
+            });
+    }
+    else
+    {
+        int split_bin = 0;
+        bool do_split = find_SAH_split(start, end, split_axis, node_bounds, centroid_bounds, triangles_bboxes, triangles_centroids, parallel, split_bin);
+        if (!do_split && triangle_count <= BVHConstants::MAX_TRIANGLES_PER_LEAF)
+        {
+            make_leaf(job.node_index, start, end, node_bounds);
+
+            return -1;
+        }
+
+        auto middle_iterator = std::partition(m_triangle_indices.begin() + start, m_triangle_indices.begin() + end,
+            [&triangles_centroids, &centroid_bounds, split_axis, split_bin](int triangle_index) {
+                return get_centroid_bin(triangles_centroids[triangle_index], split_axis, centroid_bounds) <= split_bin;
+            });
+        middle = middle_iterator - m_triangle_indices.begin();
+
+        if (middle == start || middle == end)
+            // The partition failed to separate the triangles (may happen if the
+            // SAH chose not to split but we have too many triangles for a leaf)
+            middle = (start + end) / 2;
+    }
+
+    FlattenedBVHNode& node = m_nodes[job.node_index];
+    node.aabb_min = node_bounds.mini;
+    node.aabb_max = node_bounds.maxi;
+    node.primitives_offset_or_second_child = job.node_index + 2 * (middle - start);
+    node.primitive_count = 0;
+    node.split_axis = split_axis;
+
+    return middle;
+}
+
+void FlattenedBVH::compute_bounds(int start, int end, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, bool parallel, BoundingBox& out_node_bounds, BoundingBox& out_centroid_bounds) const
+{
+    out_node_bounds = BoundingBox();
+    out_centroid_bounds = BoundingBox();
+
+    if (!parallel || end - start < BVHConstants::PARALLEL_BUILD_MIN_TRIANGLES)
+    {
+        // Not worth the overhead of a parallel region for small nodes
+        for (int i = start; i < end; i++)
+        {
+            int triangle_index = m_triangle_indices[i];
+
+            out_node_bounds.extend(triangles_bboxes[triangle_index]);
+            out_centroid_bounds.extend(triangles_centroids[triangle_index]);
+        }
+
+        return;
+    }
+
+#pragma omp parallel
+    {
+        BoundingBox thread_node_bounds;
+        BoundingBox thread_centroid_bounds;
+
+#pragma omp for nowait
+        for (int i = start; i < end; i++)
+        {
+            int triangle_index = m_triangle_indices[i];
+
+            thread_node_bounds.extend(triangles_bboxes[triangle_index]);
+            thread_centroid_bounds.extend(triangles_centroids[triangle_index]);
+        }
+
+#pragma omp critical
+        {
+            out_node_bounds.extend(thread_node_bounds);
+            out_centroid_bounds.extend(thread_centroid_bounds);
+        }
+    }
+}
+
+bool FlattenedBVH::find_SAH_split(int start, int end, int axis, const BoundingBox& node_bounds, const BoundingBox& centroid_bounds, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, bool parallel, int& out_split_bin) const
+{
+    struct SAHBin
+    {
+        BoundingBox bounds;
+        int triangle_count = 0;
+    };
+
+    std::array<SAHBin, BVHConstants::SAH_BIN_COUNT> bins;
+    auto bin_triangles = [&](int bin_start, int bin_end, std::array<SAHBin, BVHConstants::SAH_BIN_COUNT>& out_bins)
+    {
+        for (int i = bin_start; i < bin_end; i++)
+        {
+            int triangle_index = m_triangle_indices[i];
+            int bin = get_centroid_bin(triangles_centroids[triangle_index], axis, centroid_bounds);
+
+            out_bins[bin].triangle_count++;
+            out_bins[bin].bounds.extend(triangles_bboxes[triangle_index]);
+        }
+    };
+
+    if (!parallel || end - start < BVHConstants::PARALLEL_BUILD_MIN_TRIANGLES)
+        bin_triangles(start, end, bins);
+    else
+    {
+#pragma omp parallel
+        {
+            // Each thread bins a contiguous chunk of the triangles
+            int thread_count = omp_get_num_threads();
+            int thread_index = omp_get_thread_num();
+            int chunk_size = (end - start + thread_count - 1) / thread_count;
+            int chunk_start = hippt::min(end, start + chunk_size * thread_index);
+            int chunk_end = hippt::min(end, chunk_start + chunk_size);
+
+            std::array<SAHBin, BVHConstants::SAH_BIN_COUNT> thread_bins;
+            bin_triangles(chunk_start, chunk_end, thread_bins);
+
+#pragma omp critical
+            {
+                for (int i = 0; i < BVHConstants::SAH_BIN_COUNT; i++)
+                {
+                    bins[i].triangle_count += thread_bins[i].triangle_count;
+                    bins[i].bounds.extend(thread_bins[i].bounds);
+                }
+            }
+        }
+    }
+
+    // Sweeping from the right to get the area and the triangle count
+    // of the right side of each split candidate. Split candidate 'i'
+    // puts the bins [0, i] on the left and [i + 1, BIN_COUNT - 1] on the right
+    std::array<float, BVHConstants::SAH_BIN_COUNT - 1> right_areas;
+    std::array<int, BVHConstants::SAH_BIN_COUNT - 1> right_counts;
+    BoundingBox right_bounds;
+    int right_count = 0;
+    for (int i = BVHConstants::SAH_BIN_COUNT - 1; i > 0; i--)
+    {
+        right_bounds.extend(bins[i].bounds);
+        right_count += bins[i].triangle_count;
+
+        right_areas[i - 1] = right_bounds.get_surface_area();
+        right_counts[i - 1] = right_count;
+    }
+
+    float best_cost = std::numeric_limits<float>::max();
+    BoundingBox left_bounds;
+    int left_count = 0;
+    for (int i = 0; i < BVHConstants::SAH_BIN_COUNT - 1; i++)
+    {
+        left_bounds.extend(bins[i].bounds);
+        left_count += bins[i].triangle_count;
+
+        if (left_count == 0 || right_counts[i] == 0)
+            continue;
+
+        float cost = get_SAH_triangles_cost(left_count) * left_bounds.get_surface_area() + get_SAH_triangles_cost(right_counts[i]) * right_areas[i];
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            out_split_bin = i;
+        }
+    }
+
+    if (best_cost == std::numeric_limits<float>::max())
+        // No valid split found
+        return false;
+
+    float node_area = node_bounds.get_surface_area();
+    float split_cost = BVHConstants::SAH_TRAVERSAL_COST + best_cost / node_area;
+    float leaf_cost = get_SAH_triangles_cost(end - start);
+
+    return split_cost < leaf_cost;
+}
+
+float FlattenedBVH::get_SAH_triangles_cost(int triangle_count) const
+{
+    int lane_count;
+    switch (m_simd_level)
+    {
+    case CPUSIMDLevel::CPU_SIMD_SSE4:
+        lane_count = 4;
+        break;
+
+    case CPUSIMDLevel::CPU_SIMD_AVX2:
+        lane_count = 8;
+        break;
+
+    case CPUSIMDLevel::CPU_SIMD_SCALAR:
+    default:
+        lane_count = 1;
+        break;
+    }
+
+    int packet_count = (triangle_count + lane_count - 1) / lane_count;
+
+    return BVHConstants::SAH_TRIANGLE_INTERSECTION_COST * packet_count;
+}
+
+void FlattenedBVH::make_leaf(int node_index, int start, int end, const BoundingBox& node_bounds)
+{
+    FlattenedBVHNode& node = m_nodes[node_index];
+    node.aabb_min = node_bounds.mini;
+    node.aabb_max = node_bounds.maxi;
+    node.primitives_offset_or_second_child = start;
+    node.primitive_count = end - start;
+    node.split_axis = 0;
+}
+
+void FlattenedBVH::compact_nodes(int& out_leaf_count, int& out_max_depth)
+{
+    struct CompactionEntry
+    {
+        int node_index;
+        int depth;
+        // Index in the compacted nodes of the parent whose second
+        // child is this node. -1 if this node is a first child
+        int parent_to_patch;
+    };
+
+    std::vector<FlattenedBVHNode> compacted_nodes;
+    compacted_nodes.reserve(m_nodes.size());
+
+    out_leaf_count = 0;
+    out_max_depth = 0;
+
+    // Depth-first traversal that visits the first child of a node
+    // right after the node itself to preserve the layout of the tree
+    std::vector<CompactionEntry> stack = { { 0, 0, -1 } };
+    while (!stack.empty())
+    {
+        CompactionEntry entry = stack.back();
+        stack.pop_back();
+
+        int new_index = compacted_nodes.size();
+        if (entry.parent_to_patch != -1)
+            compacted_nodes[entry.parent_to_patch].primitives_offset_or_second_child = new_index;
+
+        const FlattenedBVHNode& node = m_nodes[entry.node_index];
+        compacted_nodes.push_back(node);
+
+        out_max_depth = hippt::max(out_max_depth, entry.depth);
+        if (node.is_leaf())
+            out_leaf_count++;
+        else
+        {
+            stack.push_back({ node.primitives_offset_or_second_child, entry.depth + 1, new_index });
+            stack.push_back({ entry.node_index + 1, entry.depth + 1, -1 });
+        }
+    }
+
+    m_nodes = std::move(compacted_nodes);
+}
+
+void FlattenedBVH::set_triangle_packet_lane(FlattenedBVHTrianglePacket& packet, int lane, const Triangle& triangle, int triangle_index)
+{
+    float3 edge1 = triangle.m_b - triangle.m_a;
+    float3 edge2 = triangle.m_c - triangle.m_a;
+
+    packet.vertex_a_x[lane] = triangle.m_a.x;
+    packet.vertex_a_y[lane] = triangle.m_a.y;
+    packet.vertex_a_z[lane] = triangle.m_a.z;
+    packet.edge1_x[lane] = edge1.x;
+    packet.edge1_y[lane] = edge1.y;
+    packet.edge1_z[lane] = edge1.z;
+    packet.edge2_x[lane] = edge2.x;
+    packet.edge2_y[lane] = edge2.y;
+    packet.edge2_z[lane] = edge2.z;
+    packet.triangle_indices[lane] = triangle_index;
+}
+
+void FlattenedBVH::build_triangle_packets(const std::vector<Triangle>& triangles, int primitive_index_offset)
+{
+    std::vector<int> leaves_indices;
+    for (int i = 0; i < m_nodes.size(); i++)
+        if (m_nodes[i].is_leaf())
+            leaves_indices.push_back(i);
+
+    m_triangle_packets.resize(leaves_indices.size());
+
+#pragma omp parallel for
+    for (int packet_index = 0; packet_index < leaves_indices.size(); packet_index++)
+    {
+        FlattenedBVHNode& leaf = m_nodes[leaves_indices[packet_index]];
+        FlattenedBVHTrianglePacket& packet = m_triangle_packets[packet_index];
+
+        for (int lane = 0; lane < BVHConstants::SIMD_TRIANGLE_PACKET_SIZE; lane++)
+        {
+            Triangle triangle;
+            int triangle_index = -1;
+            if (lane < leaf.primitive_count)
+            {
+                triangle = triangles[m_triangle_indices[leaf.primitives_offset_or_second_child + lane]];
+                triangle_index = m_triangle_indices[leaf.primitives_offset_or_second_child + lane] + primitive_index_offset;
+            }
+            // else, the unused lanes get a degenerate triangle at the origin
+            // whose null edges always fail the intersection test
+
+            set_triangle_packet_lane(packet, lane, triangle, triangle_index);
+        }
+
+        leaf.primitives_offset_or_second_child = packet_index;
+    }
+}
+
+bool FlattenedBVH::intersect(const hiprtRay& ray, hiprtHit& hit_info, void* filter_function_payload) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    CPUProfilerTraversalCounters profiler_counters;
+    profiler_counters.trace_rays(1);
+
+    float closest_t = ray.maxT;
+
+    return traverse(0, ray, hit_info, closest_t, filter_function_payload);
+}
+
+bool FlattenedBVH::intersect(const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    return traverse(0, ray, hit_info, closest_t, filter_function_payload);
+}
+
+/**
+ * Index in [0, 7] of the octant of the direction. Two rays in the
+ * same octant visit the children of a node in the same order
+ */
+static inline int get_direction_octant(const float3& direction)
+{
+    return (direction.x < 0.0f ? 1 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 4 : 0);
+}
+
+void FlattenedBVH::intersect_packet(const hiprtRay* rays, hiprtHit* hits, bool* out_hit_found, int ray_count, void** filter_function_payloads, bool any_hit) const
+{
+    for (int i = 0; i < ray_count; i++)
+        out_hit_found[i] = false;
+
+    if (m_nodes.empty() || ray_count == 0)
+        return;
+
+    CPUProfilerTraversalCounters profiler_counters;
+    profiler_counters.trace_rays(ray_count);
+
+    float closest_t[BVHConstants::PACKET_MAX_RAY_COUNT];
+    for (int i = 0; i < ray_count; i++)
+        closest_t[i] = rays[i].maxT;
+
+    // The packet traversal only pays off if the rays all visit the children in
+    // the same order, i.e. if they all go in the same octant
+    int packet_octant = get_direction_octant(rays[0].direction);
+    bool coherent = ray_count >= BVHConstants::PACKET_MIN_ACTIVE_RAYS;
+    for (int i = 1; i < ray_count && coherent; i++)
+        coherent = get_direction_octant(rays[i].direction) == packet_octant;
+
+    if (!coherent)
+    {
+        for (int i = 0; i < ray_count; i++)
+            out_hit_found[i] = traverse(0, rays[i], hits[i], closest_t[i], filter_function_payloads[i]);
+
+        return;
+    }
+
+    float3 inverse_directions[BVHConstants::PACKET_MAX_RAY_COUNT];
+    for (int i = 0; i < ray_count; i++)
+        inverse_directions[i] = make_float3(1.0f / rays[i].direction.x, 1.0f / rays[i].direction.y, 1.0f / rays[i].direction.z);
+    bool direction_is_negative[3] = { (packet_octant & 1) != 0, (packet_octant & 2) != 0, (packet_octant & 4) != 0 };
+
+    struct PacketStackEntry
+    {
+        int node_index;
+        // Rays that hit the parent of the node. Only these rays need to be tested against the node
+        unsigned long long int ray_mask;
+    };
+
+    PacketStackEntry stack[BVHConstants::FLATTENED_BVH_MAX_STACK_SIZE];
+    int stack_size = 0;
+    int current_node_index = 0;
+    unsigned long long int current_ray_mask = ray_count == 64 ? ~0ull : (1ull << ray_count) - 1;
+    // Only used with 'any_hit': rays that already found a hit and don't need to traverse the BVH anymore
+    unsigned long long int finished_ray_mask = 0;
+    while (true)
+    {
+        unsigned long long int node_ray_mask = 0;
+        current_ray_mask &= ~finished_ray_mask;
+        if (current_ray_mask != 0)
+        {
+            const FlattenedBVHNode& node = m_nodes[current_node_index];
+            profiler_counters.visit_node();
+
+            for (unsigned long long int mask = current_ray_mask; mask != 0; mask &= mask - 1)
+            {
+                int ray_index = std::countr_zero(mask);
+                if (node.intersect_bounds(rays[ray_index].origin, inverse_directions[ray_index], closest_t[ray_index]))
+                    node_ray_mask |= 1ull << ray_index;
+            }
+        }
+
+        if (node_ray_mask != 0)
+        {
+            const FlattenedBVHNode& node = m_nodes[current_node_index];
+
+            if (std::popcount(node_ray_mask) < BVHConstants::PACKET_MIN_ACTIVE_RAYS)
+            {
+                // Not enough rays left in this subtree, finishing it with single rays
+                for (unsigned long long int mask = node_ray_mask; mask != 0; mask &= mask - 1)
+                {
+                    int ray_index = std::countr_zero(mask);
+                    out_hit_found[ray_index] |= traverse(current_node_index, rays[ray_index], hits[ray_index], closest_t[ray_index], filter_function_payloads[ray_index]);
+                }
+            }
+            else if (node.is_leaf())
+            {
+                for (unsigned long long int mask = node_ray_mask; mask != 0; mask &= mask - 1)
+                {
+                    int ray_index = std::countr_zero(mask);
+                    out_hit_found[ray_index] |= intersect_leaf(node, rays[ray_index], hits[ray_index], closest_t[ray_index], filter_function_payloads[ray_index]);
+                }
+
+                profiler_counters.test_triangles(node.primitive_count * std::popcount(node_ray_mask));
+            }
+            else
+            {
+                // Visiting the closest child first and pushing the other one on the stack
+                if (direction_is_negative[node.split_axis])
+                {
+                    stack[stack_size++] = { current_node_index + 1, node_ray_mask };
+                    current_node_index = node.primitives_offset_or_second_child;
+                }
+                else
+                {
+                    stack[stack_size++] = { node.primitives_offset_or_second_child, node_ray_mask };
+                    current_node_index = current_node_index + 1;
+                }
+                current_ray_mask = node_ray_mask;
+
+                continue;
+            }
+
+            if (any_hit)
+            {
+                for (unsigned long long int mask = node_ray_mask; mask != 0; mask &= mask - 1)
+                {
+                    int ray_index = std::countr_zero(mask);
+                    if (out_hit_found[ray_index])
+                        finished_ray_mask |= 1ull << ray_index;
+                }
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+
+        stack_size--;
+        current_node_index = stack[stack_size].node_index;
+        current_ray_mask = stack[stack_size].ray_mask;
+    }
+}
+
+bool FlattenedBVH::traverse(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    switch (m_simd_level)
+    {
+#if FLATTENED_BVH_X86_SIMD
+    case CPUSIMDLevel::CPU_SIMD_AVX2:
+        return traverse_avx2(start_node_index, ray, hit_info, closest_t, filter_function_payload);
+
+    case CPUSIMDLevel::CPU_SIMD_SSE4:
+        return traverse_sse4(start_node_index, ray, hit_info, closest_t, filter_function_payload);
+#endif
+
+    case CPUSIMDLevel::CPU_SIMD_SCALAR:
+    default:
+        return traverse_scalar(start_node_index, ray, hit_info, closest_t, filter_function_payload);
+    }
+}
+
+bool FlattenedBVH::intersect_leaf(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    switch (m_simd_level)
+    {
+#if FLATTENED_BVH_X86_SIMD
+    case CPUSIMDLevel::CPU_SIMD_AVX2:
+        return intersect_leaf_avx2(node, ray, hit_info, closest_t, filter_function_payload);
+
+    case CPUSIMDLevel::CPU_SIMD_SSE4:
+        return intersect_leaf_sse4(node, ray, hit_info, closest_t, filter_function_payload);
+#endif
+
+    case CPUSIMDLevel::CPU_SIMD_SCALAR:
+    default:
+        return intersect_leaf_scalar(node, ray, hit_info, closest_t, filter_function_payload);
+    }
+}
+
+bool FlattenedBVH::intersect_leaf_scalar(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    bool hit_found = false;
+    for (int i = node.primitives_offset_or_second_child; i < node.primitives_offset_or_second_child + node.primitive_count; i++)
+    {
+        hiprtHit local_hit;
+        if (!m_ordered_triangles[i].intersect(ray, local_hit) || local_hit.t >= closest_t)
+            continue;
+
+        local_hit.primID = m_triangle_indices[i];
+        // Single instance when used as a single-level BVH, the two-level BVH
+        // overrides the instance of the hits of its BLASes
+        local_hit.instanceID = 0;
+        if (filter_function(ray, nullptr, filter_function_payload, local_hit))
+            // Hit is filtered
+            continue;
+
+        hit_info = local_hit;
+        closest_t = local_hit.t;
+        hit_found = true;
+    }
+
+    return hit_found;
+}
+
+bool FlattenedBVH::traverse_scalar(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    float3 inverse_direction = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    bool direction_is_negative[3] = { inverse_direction.x < 0.0f, inverse_direction.y < 0.0f, inverse_direction.z < 0.0f };
+
+    bool hit_found = false;
+
+    CPUProfilerTraversalCounters profiler_counters;
+
+    int stack[BVHConstants::FLATTENED_BVH_MAX_STACK_SIZE];
+    int stack_size = 0;
+    int current_node_index = start_node_index;
+    while (true)
+    {
+        const FlattenedBVHNode& node = m_nodes[current_node_index];
+        profiler_counters.visit_node();
+
+        if (node.intersect_bounds(ray.origin, inverse_direction, closest_t))
+        {
+            if (node.is_leaf())
+            {
+                hit_found |= intersect_leaf_scalar(node, ray, hit_info, closest_t, filter_function_payload);
+                profiler_counters.test_triangles(node.primitive_count);
+
+                if (stack_size == 0)
+                    break;
+                current_node_index = stack[--stack_size];
+            }
+            else
+            {
+                // Visiting the closest child first and pushing the other one on the stack
+                if (direction_is_negative[node.split_axis])
+                {
+                    stack[stack_size++] = current_node_index + 1;
+                    current_node_index = node.primitives_offset_or_second_child;
+                }
+                else
+                {
+                    stack[stack_size++] = node.primitives_offset_or_second_child;
+                    current_node_index = current_node_index + 1;
+                }
+            }
+        }
+        else
+        {
+            if (stack_size == 0)
+                break;
+            current_node_index = stack[--stack_size];
+        }
+    }
+
+    return hit_found;
+}
+
+size_t FlattenedBVH::get_node_count() const
+{
+    return m_nodes.size();
+}
+
+CPUSIMDLevel FlattenedBVH::get_simd_level() const
+{
+    return m_simd_level;
+}
+
+const std::vector<FlattenedBVHNode>& FlattenedBVH::get_nodes() const
+{
+    return m_nodes;
+}
+
+const std::vector<int>& FlattenedBVH::get_primitive_indices() const
+{
+    return m_triangle_indices;
+}
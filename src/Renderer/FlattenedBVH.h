@@ -0,0 +1,304 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef FLATTENED_BVH_H
+#define FLATTENED_BVH_H
+
+#include "Renderer/BVHConstants.h"
+#include "Renderer/Triangle.h"
+#include "Scene/BoundingBox.h"
+
+#include <vector>
+
+#include <hiprt/hiprt_types.h> // for hiprtRay
+
+/**
+ * Node of the flattened BVH.
+ *
+ * Nodes are stored in depth-first order in a linear array: the first child
+ * of an interior node always immediately follows its parent in the array
+ * so only the index of the second child needs to be stored.
+ */
+struct FlattenedBVHNode
+{
+    float3 aabb_min;
+    // For a leaf, index of the first triangle of the leaf in the ordered triangles buffer
+    // with the scalar traversal or index of the triangle packet of the leaf with the SIMD traversals.
+    // For an interior node, index of the second child of the node
+    int primitives_offset_or_second_child;
+
+    float3 aabb_max;
+    // Number of triangles in the leaf. 0 for interior nodes
+    unsigned short int primitive_count;
+    // Axis along which the node was split. Used to visit the children
+    // in front-to-back order during the traversal
+    unsigned char split_axis;
+    unsigned char padding;
+
+    bool is_leaf() const { return primitive_count > 0; }
+
+    /**
+     * Slab test of the ray against the bounds of the node.
+     *
+     * Returns true if the ray enters the box before 't_max'
+     */
+    bool intersect_bounds(const float3& ray_origin, const float3& inverse_direction, float t_max) const
+    {
+        float t0_x = (aabb_min.x - ray_origin.x) * inverse_direction.x;
+        float t1_x = (aabb_max.x - ray_origin.x) * inverse_direction.x;
+        float t0_y = (aabb_min.y - ray_origin.y) * inverse_direction.y;
+        float t1_y = (aabb_max.y - ray_origin.y) * inverse_direction.y;
+        float t0_z = (aabb_min.z - ray_origin.z) * inverse_direction.z;
+        float t1_z = (aabb_max.z - ray_origin.z) * inverse_direction.z;
+
+        float t_enter = hippt::max(hippt::max(hippt::min(t0_x, t1_x), hippt::min(t0_y, t1_y)), hippt::max(hippt::min(t0_z, t1_z), 0.0f));
+        float t_exit = hippt::min(hippt::min(hippt::max(t0_x, t1_x), hippt::max(t0_y, t1_y)), hippt::min(hippt::max(t0_z, t1_z), t_max));
+
+        return t_enter <= t_exit;
+    }
+};
+
+static_assert(sizeof(FlattenedBVHNode) == 32, "FlattenedBVHNode is expected to be 32 bytes");
+
+/**
+ * The triangles of a leaf in SoA layout for the SIMD traversal.
+ *
+ * The edges are precomputed so that the Moller-Trumbore test can start
+ * right away. Unused lanes have null edges and are never hit
+ */
+struct alignas(32) FlattenedBVHTrianglePacket
+{
+    float vertex_a_x[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    float vertex_a_y[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    float vertex_a_z[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+
+    float edge1_x[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    float edge1_y[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    float edge1_z[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+
+    float edge2_x[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    float edge2_y[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    float edge2_z[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+
+    // Index of the triangles in the triangle buffer of the scene
+    int triangle_indices[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+};
+
+static_assert(BVHConstants::MAX_TRIANGLES_PER_LEAF <= BVHConstants::SIMD_TRIANGLE_PACKET_SIZE, "The triangles of a leaf must fit in a single SIMD packet");
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FLATTENED_BVH_X86_SIMD 1
+
+// GCC and Clang need the target instruction set on the functions that
+// use the intrinsics. MSVC accepts the intrinsics anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define FLATTENED_BVH_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define FLATTENED_BVH_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FLATTENED_BVH_TARGET_SSE4
+#define FLATTENED_BVH_TARGET_AVX2
+#endif
+#else
+#define FLATTENED_BVH_X86_SIMD 0
+#endif
+
+/**
+ * Binary BVH built with binned SAH and flattened in a linear array
+ * of 32-byte nodes.
+ *
+ * The traversal uses a fixed-size stack and visits the closest child first
+ * so no allocation is performed during the traversal
+ */
+class FlattenedBVH
+{
+public:
+    /**
+     * Builds the BVH using all the threads of the OpenMP runtime.
+     *
+     * The top of the tree is split with all the threads computing the bounds
+     * and SAH bins of each node together. Once enough independent subtrees
+     * are available, these subtrees are built concurrently by one thread each.
+     *
+     * The traversal uses the best SIMD level supported by the CPU, up to 'max_simd_level'.
+     * CPU_SIMD_SCALAR can be passed to use the reference scalar implementation.
+     *
+     * 'primitive_index_offset' is added to the index of the triangles in the hits and
+     * in the filter function calls. This is used by the BLASes of the two-level BVH whose
+     * triangles are a range of the triangles of the scene starting at 'primitive_index_offset'
+     */
+    void build(const std::vector<Triangle>& triangles, CPUSIMDLevel max_simd_level = CPUSIMDLevel::CPU_SIMD_AVX2, int primitive_index_offset = 0, bool log_statistics = true);
+
+    /**
+     * Builds a BVH over bounding boxes instead of triangles. Used for the TLAS of the two-level BVH.
+     *
+     * Such a BVH cannot be intersected with intersect(): the leaves index into 'get_primitive_indices()'
+     * which gives the index of the bounding boxes in 'bounding_boxes'
+     */
+    void build_from_bounding_boxes(const std::vector<BoundingBox>& bounding_boxes);
+
+    /**
+     * Updates the bounds of the nodes for the new positions of the triangles without changing the
+     * topology of the tree. This is much faster than a rebuild but the quality of the tree degrades
+     * if the triangles move too much relative to each other.
+     *
+     * 'triangles' is indexed with the primitive indices of the hits (i.e. with the
+     * 'primitive_index_offset' given to build() already added). Only for BVHs built over triangles
+     */
+    void refit(const std::vector<Triangle>& triangles);
+
+    bool intersect(const hiprtRay& ray, hiprtHit& hit_info, void* filter_function_payload) const;
+
+    /**
+     * Same as intersect() but only hits closer than 'closest_t' are considered and 'closest_t'
+     * is updated when a hit is found. The ray isn't counted in the traversal statistics of the profiler:
+     * the two-level BVH that traverses multiple BLASes per ray counts its rays itself
+     */
+    bool intersect(const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+
+    /**
+     * Closest hit traversal of a packet of up to BVHConstants::PACKET_MAX_RAY_COUNT rays.
+     *
+     * The rays traverse the BVH together: each node is fetched once for the whole packet
+     * and a mask of the rays that are still active is kept per node. If the rays don't
+     * all go in the same octant or if too few rays remain active in a subtree, the
+     * traversal falls back to single rays.
+     *
+     * Each ray has its own filter function payload. 'out_hit_found[i]' is true if ray 'i' hit something.
+     *
+     * If 'any_hit' is true, a ray stops traversing the BVH as soon as it finds a hit, which
+     * is then not necessarily the closest one. For occlusion rays whose maxT is the occlusion distance
+     */
+    void intersect_packet(const hiprtRay* rays, hiprtHit* hits, bool* out_hit_found, int ray_count, void** filter_function_payloads, bool any_hit = false) const;
+
+    size_t get_node_count() const;
+    CPUSIMDLevel get_simd_level() const;
+
+    const std::vector<FlattenedBVHNode>& get_nodes() const;
+    /**
+     * Only for BVHs built with the scalar traversal or with build_from_bounding_boxes(): the
+     * leaves of the SIMD traversals store the primitive indices in their triangle packets
+     */
+    const std::vector<int>& get_primitive_indices() const;
+
+private:
+    /**
+     * Single ray traversal of the subtree starting at node 'start_node_index'.
+     * Only hits closer than 'closest_t' are considered and 'closest_t' is updated when a hit is found.
+     *
+     * Dispatches to the traversal of the SIMD level of the BVH
+     */
+    bool traverse(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+    bool traverse_scalar(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+
+    /**
+     * Intersects the triangles of the leaf 'node' with the ray.
+     * Dispatches to the leaf test of the SIMD level of the BVH
+     */
+    bool intersect_leaf(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+    bool intersect_leaf_scalar(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+
+#if FLATTENED_BVH_X86_SIMD
+    // Implemented in FlattenedBVHSIMD.cpp
+    FLATTENED_BVH_TARGET_SSE4 bool traverse_sse4(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+    FLATTENED_BVH_TARGET_AVX2 bool traverse_avx2(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+
+    FLATTENED_BVH_TARGET_SSE4 bool intersect_leaf_sse4(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+    FLATTENED_BVH_TARGET_AVX2 bool intersect_leaf_avx2(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+#endif
+
+    /**
+     * A subtree waiting to be built.
+     *
+     * A subtree of N triangles is given the 2N - 1 nodes starting at 'node_index'
+     * in the node array, which is the maximum number of nodes it can use. This lets
+     * subtrees be built concurrently without synchronization. The holes left by subtrees
+     * that used fewer nodes are removed by 'compact_nodes()' at the end of the build.
+     */
+    struct BuildJob
+    {
+        int node_index;
+        int start;
+        int end;
+        int depth;
+    };
+
+    /**
+     * Builds the nodes of the tree over the given primitives bounds. 'm_triangle_indices' must have
+     * been initialized with the indices of the primitives and is reordered such that the primitives
+     * of a leaf are contiguous.
+     *
+     * The number of leaves and the maximum depth of the tree are returned for the statistics of the build
+     */
+    void build_nodes(const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, int& out_leaf_count, int& out_max_depth);
+
+    /**
+     * Builds the whole subtree of the given job with the calling thread
+     */
+    void build_recursive(const BuildJob& job, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids);
+
+    /**
+     * Computes the bounds of the node of the given job and either makes it a leaf or
+     * partitions its triangles in two.
+     *
+     * Returns the index in 'm_triangle_indices' of the first triangle of the
+     * second child or -1 if the node was made a leaf.
+     *
+     * If 'parallel' is true, the bounds and SAH bins are computed with all the threads
+     */
+    int split_node(const BuildJob& job, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, bool parallel);
+
+    void compute_bounds(int start, int end, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, bool parallel, BoundingBox& out_node_bounds, BoundingBox& out_centroid_bounds) const;
+
+    /**
+     * Finds the best split of the triangles in [start, end) using binned SAH.
+     *
+     * Returns false if making a leaf is cheaper than splitting, true otherwise.
+     * If true is returned, 'out_split_bin' contains the last bin (inclusive) that
+     * goes in the left child.
+     */
+    bool find_SAH_split(int start, int end, int axis, const BoundingBox& node_bounds, const BoundingBox& centroid_bounds, const std::vector<BoundingBox>& triangles_bboxes, const std::vector<float3>& triangles_centroids, bool parallel, int& out_split_bin) const;
+
+    /**
+     * SAH cost of intersecting 'triangle_count' triangles. With a SIMD traversal,
+     * the triangles are intersected by packets so the cost only increases
+     * every 4 or 8 triangles
+     */
+    float get_SAH_triangles_cost(int triangle_count) const;
+
+    void make_leaf(int node_index, int start, int end, const BoundingBox& node_bounds);
+
+    /**
+     * Removes the unused nodes between the subtrees and renumbers
+     * the nodes so that they are contiguous in depth-first order again.
+     *
+     * The number of leaves and the maximum depth of the tree are returned
+     * for the statistics of the build
+     */
+    void compact_nodes(int& out_leaf_count, int& out_max_depth);
+
+    /**
+     * Packs the triangles of each leaf in a SoA packet and makes
+     * the leaves point to their packet instead of the ordered triangles
+     */
+    void build_triangle_packets(const std::vector<Triangle>& triangles, int primitive_index_offset);
+    static void set_triangle_packet_lane(FlattenedBVHTrianglePacket& packet, int lane, const Triangle& triangle, int triangle_index);
+
+    CPUSIMDLevel m_simd_level = CPUSIMDLevel::CPU_SIMD_SCALAR;
+
+    std::vector<FlattenedBVHNode> m_nodes;
+
+    // Only used by the scalar traversal.
+    // Triangles reordered such that the triangles of a leaf are contiguous in memory
+    std::vector<Triangle> m_ordered_triangles;
+    // For each triangle of 'm_ordered_triangles', its index in the triangle
+    // buffer of the scene. This is the primitive index returned in the hits
+    std::vector<int> m_triangle_indices;
+
+    // Only used by the SIMD traversals. One packet per leaf, the leaves
+    // store the index of their packet instead of an offset in 'm_ordered_triangles'
+    std::vector<FlattenedBVHTrianglePacket> m_triangle_packets;
+};
+
+#endif
@@ -0,0 +1,450 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Device/functions/FilterFunction.h"
+#include "Renderer/CPUProfiler.h"
+#include "Renderer/FlattenedBVH.h"
+
+#if FLATTENED_BVH_X86_SIMD
+
+#include <immintrin.h>
+
+// Same epsilon as the scalar Triangle::intersect()
+static constexpr float TRIANGLE_INTERSECTION_EPSILON = 0.0000001f;
+
+/**
+ * Node of the traversal stack of the SIMD traversals.
+ *
+ * The entry distance of the node is kept so that nodes that are
+ * further than the closest hit found so far can be skipped when popped
+ */
+struct SIMDTraversalStackEntry
+{
+    int node_index;
+    float t_enter;
+};
+
+/**
+ * Goes through the lanes of 'packet' that were hit (bits of 'hit_mask'), closest first,
+ * and keeps the first hit that isn't rejected by the filter function.
+ *
+ * Returns true if a hit was kept. 'hit_info' and 'closest_t' are then updated
+ */
+static bool resolve_packet_hits(const FlattenedBVHTrianglePacket& packet, int hit_mask, const float* lanes_t, const float* lanes_u, const float* lanes_v,
+    const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload)
+{
+    while (hit_mask != 0)
+    {
+        int closest_lane = -1;
+        for (int lane = 0; lane < BVHConstants::SIMD_TRIANGLE_PACKET_SIZE; lane++)
+            if ((hit_mask & (1 << lane)) && (closest_lane == -1 || lanes_t[lane] < lanes_t[closest_lane]))
+                closest_lane = lane;
+
+        float3 edge1 = make_float3(packet.edge1_x[closest_lane], packet.edge1_y[closest_lane], packet.edge1_z[closest_lane]);
+        float3 edge2 = make_float3(packet.edge2_x[closest_lane], packet.edge2_y[closest_lane], packet.edge2_z[closest_lane]);
+
+        hiprtHit local_hit;
+        local_hit.t = lanes_t[closest_lane];
+        local_hit.normal = hippt::normalize(hippt::cross(edge1, edge2));
+        local_hit.uv = make_float2(lanes_u[closest_lane], lanes_v[closest_lane]);
+        local_hit.primID = packet.triangle_indices[closest_lane];
+        local_hit.instanceID = 0;
+
+        if (!filter_function(ray, nullptr, filter_function_payload, local_hit))
+        {
+            // The other lanes are all further away, no need to look at them
+            hit_info = local_hit;
+            closest_t = local_hit.t;
+
+            return true;
+        }
+
+        // Hit is filtered, trying the next closest lane
+        hit_mask &= ~(1 << closest_lane);
+    }
+
+    return false;
+}
+
+/**
+ * Horizontal max / min of the 4 lanes of 'value', broadcast to all the lanes
+ */
+FLATTENED_BVH_TARGET_SSE4 static inline __m128 horizontal_max_sse4(__m128 value)
+{
+    value = _mm_max_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_max_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+FLATTENED_BVH_TARGET_SSE4 static inline __m128 horizontal_min_sse4(__m128 value)
+{
+    value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+/**
+ * Slab test of the three axes of the box of 'node' at once.
+ *
+ * The fourth lane of the loads is not part of the box (it's the integer that follows
+ * the min / max corners in the node) and is replaced by [0, t_max] to clamp the interval
+ */
+FLATTENED_BVH_TARGET_SSE4 static inline bool intersect_node_bounds_sse4(const FlattenedBVHNode& node, __m128 ray_origin, __m128 inverse_direction, float t_max, float& out_t_enter)
+{
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.aabb_min.x), ray_origin), inverse_direction);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.aabb_max.x), ray_origin), inverse_direction);
+
+    __m128 t_enter = _mm_blend_ps(_mm_min_ps(t0, t1), _mm_setzero_ps(), 0b1000);
+    __m128 t_exit = _mm_blend_ps(_mm_max_ps(t0, t1), _mm_set1_ps(t_max), 0b1000);
+
+    t_enter = horizontal_max_sse4(t_enter);
+    t_exit = horizontal_min_sse4(t_exit);
+
+    out_t_enter = _mm_cvtss_f32(t_enter);
+
+    return _mm_comile_ss(t_enter, t_exit);
+}
+
+/**
+ * Moller-Trumbore test of 4 triangles of the packet, starting at lane 'first_lane'.
+ *
+ * Returns the mask of the lanes hit closer than 't_max'
+ */
+FLATTENED_BVH_TARGET_SSE4 static inline int intersect_triangles_sse4(const FlattenedBVHTrianglePacket& packet, int first_lane, const hiprtRay& ray, float t_max,
+    float* out_t, float* out_u, float* out_v)
+{
+    __m128 direction_x = _mm_set1_ps(ray.direction.x);
+    __m128 direction_y = _mm_set1_ps(ray.direction.y);
+    __m128 direction_z = _mm_set1_ps(ray.direction.z);
+
+    __m128 edge1_x = _mm_load_ps(packet.edge1_x + first_lane);
+    __m128 edge1_y = _mm_load_ps(packet.edge1_y + first_lane);
+    __m128 edge1_z = _mm_load_ps(packet.edge1_z + first_lane);
+    __m128 edge2_x = _mm_load_ps(packet.edge2_x + first_lane);
+    __m128 edge2_y = _mm_load_ps(packet.edge2_y + first_lane);
+    __m128 edge2_z = _mm_load_ps(packet.edge2_z + first_lane);
+
+    // h = cross(direction, edge2)
+    __m128 h_x = _mm_sub_ps(_mm_mul_ps(direction_y, edge2_z), _mm_mul_ps(direction_z, edge2_y));
+    __m128 h_y = _mm_sub_ps(_mm_mul_ps(direction_z, edge2_x), _mm_mul_ps(direction_x, edge2_z));
+    __m128 h_z = _mm_sub_ps(_mm_mul_ps(direction_x, edge2_y), _mm_mul_ps(direction_y, edge2_x));
+
+    __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1_x, h_x), _mm_mul_ps(edge1_y, h_y)), _mm_mul_ps(edge1_z, h_z));
+    __m128 f = _mm_div_ps(_mm_set1_ps(1.0f), a);
+
+    // s = origin - vertex_a
+    __m128 s_x = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(packet.vertex_a_x + first_lane));
+    __m128 s_y = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(packet.vertex_a_y + first_lane));
+    __m128 s_z = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(packet.vertex_a_z + first_lane));
+
+    __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(s_x, h_x), _mm_mul_ps(s_y, h_y)), _mm_mul_ps(s_z, h_z)));
+
+    // q = cross(s, edge1)
+    __m128 q_x = _mm_sub_ps(_mm_mul_ps(s_y, edge1_z), _mm_mul_ps(s_z, edge1_y));
+    __m128 q_y = _mm_sub_ps(_mm_mul_ps(s_z, edge1_x), _mm_mul_ps(s_x, edge1_z));
+    __m128 q_z = _mm_sub_ps(_mm_mul_ps(s_x, edge1_y), _mm_mul_ps(s_y, edge1_x));
+
+    __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(direction_x, q_x), _mm_mul_ps(direction_y, q_y)), _mm_mul_ps(direction_z, q_z)));
+    __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2_x, q_x), _mm_mul_ps(edge2_y, q_y)), _mm_mul_ps(edge2_z, q_z)));
+
+    __m128 epsilon = _mm_set1_ps(TRIANGLE_INTERSECTION_EPSILON);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+
+    // Not parallel to the triangle
+    __m128 mask = _mm_or_ps(_mm_cmpge_ps(a, epsilon), _mm_cmple_ps(a, _mm_sub_ps(zero, epsilon)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(u, one));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, epsilon));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(t_max)));
+
+    _mm_storeu_ps(out_t + first_lane, t);
+    _mm_storeu_ps(out_u + first_lane, u);
+    _mm_storeu_ps(out_v + first_lane, v);
+
+    return _mm_movemask_ps(mask) << first_lane;
+}
+
+bool FlattenedBVH::intersect_leaf_sse4(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    const FlattenedBVHTrianglePacket& packet = m_triangle_packets[node.primitives_offset_or_second_child];
+
+    alignas(16) float lanes_t[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    alignas(16) float lanes_u[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    alignas(16) float lanes_v[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+
+    int hit_mask = intersect_triangles_sse4(packet, 0, ray, closest_t, lanes_t, lanes_u, lanes_v);
+    if (node.primitive_count > 4)
+        hit_mask |= intersect_triangles_sse4(packet, 4, ray, closest_t, lanes_t, lanes_u, lanes_v);
+
+    return resolve_packet_hits(packet, hit_mask, lanes_t, lanes_u, lanes_v, ray, hit_info, closest_t, filter_function_payload);
+}
+
+bool FlattenedBVH::traverse_sse4(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    // The fourth lane is unused by the box tests
+    __m128 ray_origin = _mm_setr_ps(ray.origin.x, ray.origin.y, ray.origin.z, 0.0f);
+    __m128 inverse_direction = _mm_setr_ps(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z, 0.0f);
+
+    bool hit_found = false;
+
+    // The children are tested from their parent so the
+    // first node has to be tested on its own
+    float start_t_enter;
+    if (!intersect_node_bounds_sse4(m_nodes[start_node_index], ray_origin, inverse_direction, closest_t, start_t_enter))
+        return false;
+
+    CPUProfilerTraversalCounters profiler_counters;
+
+    SIMDTraversalStackEntry stack[BVHConstants::FLATTENED_BVH_MAX_STACK_SIZE];
+    int stack_size = 0;
+    int current_node_index = start_node_index;
+    while (true)
+    {
+        const FlattenedBVHNode& node = m_nodes[current_node_index];
+        profiler_counters.visit_node();
+
+        bool go_to_child = false;
+        if (node.is_leaf())
+        {
+            hit_found |= intersect_leaf_sse4(node, ray, hit_info, closest_t, filter_function_payload);
+            profiler_counters.test_triangles(node.primitive_count);
+        }
+        else
+        {
+            int first_child_index = current_node_index + 1;
+            int second_child_index = node.primitives_offset_or_second_child;
+
+            float first_t_enter, second_t_enter;
+            bool first_hit = intersect_node_bounds_sse4(m_nodes[first_child_index], ray_origin, inverse_direction, closest_t, first_t_enter);
+            bool second_hit = intersect_node_bounds_sse4(m_nodes[second_child_index], ray_origin, inverse_direction, closest_t, second_t_enter);
+
+            if (first_hit && second_hit)
+            {
+                // Visiting the closest child first and pushing the other one on the stack
+                if (second_t_enter < first_t_enter)
+                {
+                    stack[stack_size++] = { first_child_index, first_t_enter };
+                    current_node_index = second_child_index;
+                }
+                else
+                {
+                    stack[stack_size++] = { second_child_index, second_t_enter };
+                    current_node_index = first_child_index;
+                }
+
+                go_to_child = true;
+            }
+            else if (first_hit || second_hit)
+            {
+                current_node_index = first_hit ? first_child_index : second_child_index;
+
+                go_to_child = true;
+            }
+        }
+
+        if (go_to_child)
+            continue;
+
+        // Popping the next node that may still contain a closer hit
+        while (stack_size > 0 && stack[stack_size - 1].t_enter > closest_t)
+            stack_size--;
+
+        if (stack_size == 0)
+            break;
+        current_node_index = stack[--stack_size].node_index;
+    }
+
+    return hit_found;
+}
+
+/**
+ * Slab test of the boxes of the two children at once: the first child
+ * is in the low 128 bits and the second child in the high 128 bits.
+ *
+ * Returns a mask with bit 0 set if the first child is hit and bit 1 set
+ * if the second child is hit
+ */
+FLATTENED_BVH_TARGET_AVX2 static inline int intersect_children_bounds_avx2(const FlattenedBVHNode& first_child, const FlattenedBVHNode& second_child,
+    __m256 ray_origin, __m256 inverse_direction, float t_max, float& out_first_t_enter, float& out_second_t_enter)
+{
+    __m256 aabb_min = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&first_child.aabb_min.x)), _mm_loadu_ps(&second_child.aabb_min.x), 1);
+    __m256 aabb_max = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&first_child.aabb_max.x)), _mm_loadu_ps(&second_child.aabb_max.x), 1);
+
+    __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(aabb_min, ray_origin), inverse_direction);
+    __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(aabb_max, ray_origin), inverse_direction);
+
+    // The fourth lane of each box isn't part of the box and is replaced by [0, t_max]
+    __m256 t_enter = _mm256_blend_ps(_mm256_min_ps(t0, t1), _mm256_setzero_ps(), 0b10001000);
+    __m256 t_exit = _mm256_blend_ps(_mm256_max_ps(t0, t1), _mm256_set1_ps(t_max), 0b10001000);
+
+    // Horizontal max / min within each 128-bit half
+    t_enter = _mm256_max_ps(t_enter, _mm256_permute_ps(t_enter, _MM_SHUFFLE(2, 3, 0, 1)));
+    t_enter = _mm256_max_ps(t_enter, _mm256_permute_ps(t_enter, _MM_SHUFFLE(1, 0, 3, 2)));
+    t_exit = _mm256_min_ps(t_exit, _mm256_permute_ps(t_exit, _MM_SHUFFLE(2, 3, 0, 1)));
+    t_exit = _mm256_min_ps(t_exit, _mm256_permute_ps(t_exit, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    out_first_t_enter = _mm256_cvtss_f32(t_enter);
+    out_second_t_enter = _mm_cvtss_f32(_mm256_extractf128_ps(t_enter, 1));
+
+    int hit_mask = _mm256_movemask_ps(_mm256_cmp_ps(t_enter, t_exit, _CMP_LE_OQ));
+
+    return (hit_mask & 0x1) | ((hit_mask >> 3) & 0x2);
+}
+
+/**
+ * Moller-Trumbore test of the 8 triangles of the packet.
+ *
+ * Returns the mask of the lanes hit closer than 't_max'
+ */
+FLATTENED_BVH_TARGET_AVX2 static inline int intersect_triangles_avx2(const FlattenedBVHTrianglePacket& packet, const hiprtRay& ray, float t_max,
+    float* out_t, float* out_u, float* out_v)
+{
+    __m256 direction_x = _mm256_set1_ps(ray.direction.x);
+    __m256 direction_y = _mm256_set1_ps(ray.direction.y);
+    __m256 direction_z = _mm256_set1_ps(ray.direction.z);
+
+    __m256 edge1_x = _mm256_load_ps(packet.edge1_x);
+    __m256 edge1_y = _mm256_load_ps(packet.edge1_y);
+    __m256 edge1_z = _mm256_load_ps(packet.edge1_z);
+    __m256 edge2_x = _mm256_load_ps(packet.edge2_x);
+    __m256 edge2_y = _mm256_load_ps(packet.edge2_y);
+    __m256 edge2_z = _mm256_load_ps(packet.edge2_z);
+
+    // h = cross(direction, edge2)
+    __m256 h_x = _mm256_sub_ps(_mm256_mul_ps(direction_y, edge2_z), _mm256_mul_ps(direction_z, edge2_y));
+    __m256 h_y = _mm256_sub_ps(_mm256_mul_ps(direction_z, edge2_x), _mm256_mul_ps(direction_x, edge2_z));
+    __m256 h_z = _mm256_sub_ps(_mm256_mul_ps(direction_x, edge2_y), _mm256_mul_ps(direction_y, edge2_x));
+
+    __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1_x, h_x), _mm256_mul_ps(edge1_y, h_y)), _mm256_mul_ps(edge1_z, h_z));
+    __m256 f = _mm256_div_ps(_mm256_set1_ps(1.0f), a);
+
+    // s = origin - vertex_a
+    __m256 s_x = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(packet.vertex_a_x));
+    __m256 s_y = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(packet.vertex_a_y));
+    __m256 s_z = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(packet.vertex_a_z));
+
+    __m256 u = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s_x, h_x), _mm256_mul_ps(s_y, h_y)), _mm256_mul_ps(s_z, h_z)));
+
+    // q = cross(s, edge1)
+    __m256 q_x = _mm256_sub_ps(_mm256_mul_ps(s_y, edge1_z), _mm256_mul_ps(s_z, edge1_y));
+    __m256 q_y = _mm256_sub_ps(_mm256_mul_ps(s_z, edge1_x), _mm256_mul_ps(s_x, edge1_z));
+    __m256 q_z = _mm256_sub_ps(_mm256_mul_ps(s_x, edge1_y), _mm256_mul_ps(s_y, edge1_x));
+
+    __m256 v = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(direction_x, q_x), _mm256_mul_ps(direction_y, q_y)), _mm256_mul_ps(direction_z, q_z)));
+    __m256 t = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge2_x, q_x), _mm256_mul_ps(edge2_y, q_y)), _mm256_mul_ps(edge2_z, q_z)));
+
+    __m256 epsilon = _mm256_set1_ps(TRIANGLE_INTERSECTION_EPSILON);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    // Not parallel to the triangle
+    __m256 mask = _mm256_or_ps(_mm256_cmp_ps(a, epsilon, _CMP_GE_OQ), _mm256_cmp_ps(a, _mm256_sub_ps(zero, epsilon), _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, epsilon, _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(t_max), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(out_t, t);
+    _mm256_storeu_ps(out_u, u);
+    _mm256_storeu_ps(out_v, v);
+
+    return _mm256_movemask_ps(mask);
+}
+
+bool FlattenedBVH::intersect_leaf_avx2(const FlattenedBVHNode& node, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    const FlattenedBVHTrianglePacket& packet = m_triangle_packets[node.primitives_offset_or_second_child];
+
+    alignas(32) float lanes_t[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    alignas(32) float lanes_u[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+    alignas(32) float lanes_v[BVHConstants::SIMD_TRIANGLE_PACKET_SIZE];
+
+    int hit_mask = intersect_triangles_avx2(packet, ray, closest_t, lanes_t, lanes_u, lanes_v);
+
+    return resolve_packet_hits(packet, hit_mask, lanes_t, lanes_u, lanes_v, ray, hit_info, closest_t, filter_function_payload);
+}
+
+bool FlattenedBVH::traverse_avx2(int start_node_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    __m128 ray_origin_sse = _mm_setr_ps(ray.origin.x, ray.origin.y, ray.origin.z, 0.0f);
+    __m128 inverse_direction_sse = _mm_setr_ps(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z, 0.0f);
+    __m256 ray_origin = _mm256_set_m128(ray_origin_sse, ray_origin_sse);
+    __m256 inverse_direction = _mm256_set_m128(inverse_direction_sse, inverse_direction_sse);
+
+    bool hit_found = false;
+
+    // The children are tested from their parent so the
+    // first node has to be tested on its own
+    float start_t_enter;
+    if (!intersect_node_bounds_sse4(m_nodes[start_node_index], ray_origin_sse, inverse_direction_sse, closest_t, start_t_enter))
+        return false;
+
+    CPUProfilerTraversalCounters profiler_counters;
+
+    SIMDTraversalStackEntry stack[BVHConstants::FLATTENED_BVH_MAX_STACK_SIZE];
+    int stack_size = 0;
+    int current_node_index = start_node_index;
+    while (true)
+    {
+        const FlattenedBVHNode& node = m_nodes[current_node_index];
+        profiler_counters.visit_node();
+
+        bool go_to_child = false;
+        if (node.is_leaf())
+        {
+            hit_found |= intersect_leaf_avx2(node, ray, hit_info, closest_t, filter_function_payload);
+            profiler_counters.test_triangles(node.primitive_count);
+        }
+        else
+        {
+            int first_child_index = current_node_index + 1;
+            int second_child_index = node.primitives_offset_or_second_child;
+
+            float first_t_enter, second_t_enter;
+            int children_hit_mask = intersect_children_bounds_avx2(m_nodes[first_child_index], m_nodes[second_child_index], ray_origin, inverse_direction, closest_t, first_t_enter, second_t_enter);
+
+            if (children_hit_mask == 0x3)
+            {
+                // Visiting the closest child first and pushing the other one on the stack
+                if (second_t_enter < first_t_enter)
+                {
+                    stack[stack_size++] = { first_child_index, first_t_enter };
+                    current_node_index = second_child_index;
+                }
+                else
+                {
+                    stack[stack_size++] = { second_child_index, second_t_enter };
+                    current_node_index = first_child_index;
+                }
+
+                go_to_child = true;
+            }
+            else if (children_hit_mask != 0)
+            {
+                current_node_index = children_hit_mask == 0x1 ? first_child_index : second_child_index;
+
+                go_to_child = true;
+            }
+        }
+
+        if (go_to_child)
+            continue;
+
+        // Popping the next node that may still contain a closer hit
+        while (stack_size > 0 && stack[stack_size - 1].t_enter > closest_t)
+            stack_size--;
+
+        if (stack_size == 0)
+            break;
+        current_node_index = stack[--stack_size].node_index;
+    }
+
+    return hit_found;
+}
+
+#endif
@@ -22,6 +22,7 @@ struct GBufferGPURenderer
 		shading_normals.resize(new_element_count);
 		primary_hit_position.resize(new_element_count);
 		first_hit_prim_index.resize(new_element_count);
+		first_hit_instance_id.resize(new_element_count);
 
 		// We need to be careful here because the ray volume states contain the nested dielectric stack and the stack size can be changed at runtime through ImGui. However, on the CPU, the stack size is determined at compile time. Changing the stack size through ImGui only resizes the GPU shaders which then adapts to the new stack size thanks to the recompilation. However, on the CPU, we're not recompiling anything. This means that the stack size on the CPU doesn't match the stack size on the GPU anymore and the buffer will not be properly resized --> this is huge undefined behavior.
 		// To avoid that, we're manually giving the size here for resizing
@@ -35,6 +36,7 @@ struct GBufferGPURenderer
 		shading_normals.free();
 		primary_hit_position.free();
 		first_hit_prim_index.free();
+		first_hit_instance_id.free();
 		ray_volume_states.free();
 	}
 
@@ -47,6 +49,7 @@ struct GBufferGPURenderer
 		out.shading_normals = shading_normals.get_device_pointer();
 		out.primary_hit_position = primary_hit_position.get_device_pointer();
 		out.first_hit_prim_index = first_hit_prim_index.get_device_pointer();
+		out.first_hit_instance_id = first_hit_instance_id.get_device_pointer();
 
 		return out;
 	}
@@ -57,6 +60,7 @@ struct GBufferGPURenderer
 	OrochiBuffer<Octahedral24BitNormal> geometric_normals;
 	OrochiBuffer<float3> primary_hit_position;
 	OrochiBuffer<int> first_hit_prim_index;
+	OrochiBuffer<int> first_hit_instance_id;
 
 	OrochiBuffer<RayVolumeState> ray_volume_states;
 };
@@ -6,6 +6,7 @@
 #ifndef RENDERER_GMON_GPU_DATA_H
 #define RENDERER_GMON_GPU_DATA_H
 
+#include "Device/includes/GMoN/GMoNDevice.h"
 #include "HIPRT-Orochi/OrochiBuffer.h"
 #include "HostDeviceCommon/Color.h"
 #include "OpenGL/OpenGLInteropBuffer.h"
@@ -31,9 +32,13 @@ struct GMoNGPUData : public GMoNCPUGPUCommonData
 	{
 		sets.resize(render_width * render_height * number_of_sets);
 		sets.memset_whole_buffer(0);
+		tile_sample_counts.resize(GMoNDevice::get_tile_count(make_int2(render_width, render_height)));
+		tile_sample_counts.memset_whole_buffer(0);
 
 		current_resolution = make_int2(render_width, render_height);
 		current_number_of_sets = number_of_sets;
+		// The sets are empty, nothing to reuse from the last recomputation
+		last_recomputed_sample_count = 0;
 	}
 
 	void resize_interop(unsigned int new_width, unsigned int new_height)
@@ -44,6 +49,7 @@ struct GMoNGPUData : public GMoNCPUGPUCommonData
 	void free()
 	{
 		sets.free();
+		tile_sample_counts.free();
 		result_framebuffer->free();
 
 		current_resolution = make_int2(0, 0);
@@ -67,16 +73,20 @@ struct GMoNGPUData : public GMoNCPUGPUCommonData
 		unsigned int nb_pixels = current_resolution.x * current_resolution.y;
 
 		unsigned int bytes_result_framebuffer = nb_pixels * sizeof(ColorRGB32F);
-		unsigned int bytes_sets = nb_pixels * sizeof(ColorRGB32F) * current_number_of_sets;
+		unsigned int bytes_sets = nb_pixels * sizeof(GMoNSet) * current_number_of_sets;
+		unsigned int bytes_tiles = tile_sample_counts.get_element_count() * sizeof(unsigned int);
 
-		return bytes_result_framebuffer + bytes_sets;
+		return bytes_result_framebuffer + bytes_sets + bytes_tiles;
 	}
 
 	// This is one very big buffer that contains all the sets we accumulate into for GMoN
 	//
 	// For example, if GMoNMSets == 5 and a render resolution of 1280x720,
 	// this is going to be a buffer that is 1280*720*5 elements long
-	OrochiBuffer<ColorRGB32F> sets;
+	OrochiBuffer<GMoNSet> sets;
+
+	// See GMoNDevice::tile_sample_counts
+	OrochiBuffer<unsigned int> tile_sample_counts;
 
 	// This is the buffer that contains the G-median of means result of each pixel and this is going
 	// to be displayed in the viewport instead of the regular framebuffer if GMoN is being used
@@ -5,7 +5,7 @@
 
 #include "Renderer/GPUDataStructures/NEEPlusPlusGPUData.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
 
 NEEPlusPlusGPUData::NEEPlusPlusGPUData()
 {
@@ -13,9 +13,11 @@ NEEPlusPlusGPUData::NEEPlusPlusGPUData()
 	finalize_accumulation_kernel.set_kernel_function_name("NEEPlusPlusFinalizeAccumulation");
 }
 
-void NEEPlusPlusGPUData::compile_finalize_accumulation_kernel(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx)
+TaskHandle NEEPlusPlusGPUData::compile_finalize_accumulation_kernel(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx)
 {
-	ThreadManager::start_thread(ThreadManager::COMPILE_NEE_PLUS_PLUS_FINALIZE_ACCUMULATION_KERNEL_KEY, ThreadFunctions::compile_kernel_no_func_sets, std::ref(finalize_accumulation_kernel), hiprt_orochi_ctx);
+	return g_task_scheduler.submit([this, hiprt_orochi_ctx]() {
+		ThreadFunctions::compile_kernel_no_func_sets(finalize_accumulation_kernel, hiprt_orochi_ctx);
+	});
 }
 
 void NEEPlusPlusGPUData::recompile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx)
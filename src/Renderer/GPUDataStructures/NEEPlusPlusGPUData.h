@@ -10,12 +10,13 @@
 #include "HIPRT-Orochi/OrochiBuffer.h"
 #include "HIPRT-Orochi/HIPRTOrochiCtx.h"
 #include "Renderer/CPUGPUCommonDataStructures/NEEPlusPlusCPUGPUCommonData.h"
+#include "Threads/TaskScheduler.h"
 
 struct NEEPlusPlusGPUData : public NEEPlusPlusCPUGPUCommonData
 {
 	NEEPlusPlusGPUData();
 
-	void compile_finalize_accumulation_kernel(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx);
+	TaskHandle compile_finalize_accumulation_kernel(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx);
 	void recompile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx);
 
 	// This is the timer value 
@@ -35,7 +36,12 @@ struct NEEPlusPlusGPUData : public NEEPlusPlusCPUGPUCommonData
 	// are copied and this variable (which is essentially a timer) is reset back to its default counter value
 	float milliseconds_before_finalizing_accumulation = FINALIZE_ACCUMULATION_START_TIMER;
 
+	// See the NEE++ device structure for the details of these buffers
 	OrochiBuffer<unsigned int> packed_buffer;
+	OrochiBuffer<unsigned long long int> hash_keys;
+	OrochiBuffer<unsigned int> entry_epochs;
+	OrochiBuffer<unsigned int> touched_entries;
+	OrochiBuffer<unsigned int> touched_entry_counts;
 	
 	// Counters on the GPU for tracking 
 	OrochiBuffer<unsigned long long int> total_shadow_ray_queries;
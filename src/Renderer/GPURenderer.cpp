@@ -3,21 +3,27 @@
  * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
  */
 
+#include "Compiler/GPUKernelCompiler.h"
 #include "Compiler/GPUKernelCompilerOptions.h"
 #include "Device/includes/BSDFs/SheenLTCFittedParameters.h"
 #include "HIPRT-Orochi/HIPRTOrochiCtx.h"
 #include "Renderer/Baker/GPUBaker.h"
 #include "Renderer/Baker/GPUBakerConstants.h"
+#include "Renderer/CPUGPUCommonDataStructures/CompressedGeometryCPUGPUCommonData.h"
 #include "Renderer/GPURenderer.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
 #include "Threads/ThreadFunctions.h"
 
 #include <Orochi/OrochiUtils.h>
 
+#include <algorithm>
 #include <condition_variable>
 
+extern GPUKernelCompiler g_gpu_kernel_compiler;
+
 const std::string GPURenderer::NEE_PLUS_PLUS_CACHING_PREPASS_ID = "NEE++ Caching Prepass";
+const std::string GPURenderer::NEE_PLUS_PLUS_FINALIZE_ACCUMULATION_ID = "NEE++ Finalize Accumulation";
 const std::string GPURenderer::CAMERA_RAYS_KERNEL_ID = "Camera Rays";
 const std::string GPURenderer::PATH_TRACING_KERNEL_ID = "Path Tracing";
 const std::string GPURenderer::RAY_VOLUME_STATE_SIZE_KERNEL_ID = "Ray Volume State Size";
@@ -48,7 +54,8 @@ const std::string GPURenderer::ALL_RENDER_PASSES_TIME_KEY = "FullFrameTime";
 const std::string GPURenderer::FULL_FRAME_TIME_WITH_CPU_KEY = "FullFrameTimeWithCPU";
 const std::string GPURenderer::DEBUG_KERNEL_TIME_KEY = "DebugKernelTime";
 
-GPURenderer::GPURenderer(std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx, std::shared_ptr<ApplicationSettings> application_settings)
+GPURenderer::GPURenderer(std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx, std::shared_ptr<ApplicationSettings> application_settings, 
+	const std::vector<unsigned int>& principled_bsdf_specialized_lobe_masks, bool principled_bsdf_specializations_cover_scene)
 {
 	m_rng.m_state.seed = 42;
 
@@ -68,7 +75,7 @@ GPURenderer::GPURenderer(std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx, std::sha
 
 	setup_brdfs_data();
 	setup_filter_functions();
-	setup_kernels();
+	setup_kernels(principled_bsdf_specialized_lobe_masks, principled_bsdf_specializations_cover_scene);
 
 	m_render_pass_times[GPURenderer::ALL_RENDER_PASSES_TIME_KEY] = 0.0f;
 	for (auto& id_to_pass : GPURenderer::KERNEL_FUNCTION_NAMES)
@@ -180,6 +187,39 @@ void GPURenderer::setup_nee_plus_plus_from_scene(const Scene& scene)
 	m_nee_plus_plus.base_grid_max_point = scene.metadata.scene_bounding_box.maxi;
 }
 
+static const std::string PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_OPTIONS[PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_COUNT] = {
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_0,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_1,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_2,
+	GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_3,
+};
+
+void GPURenderer::setup_principled_bsdf_specializations(const std::vector<unsigned int>& specialized_lobe_masks, bool specializations_cover_scene)
+{
+	if (specialized_lobe_masks.empty())
+		// Keeping the default specializations, they are not known to cover the scene
+		return;
+
+	for (int i = 0; i < PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_COUNT; i++)
+		m_global_compiler_options->set_macro_value(PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_OPTIONS[i], i < specialized_lobe_masks.size() ? specialized_lobe_masks[i] : PRINCIPLED_LOBE_NONE);
+
+	// Without the generic BSDF in the kernels, the registers are bounded by the largest specialization
+	m_global_compiler_options->set_macro_value(GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE, specializations_cover_scene ? KERNEL_OPTION_TRUE : KERNEL_OPTION_FALSE);
+}
+
+std::vector<unsigned int> GPURenderer::get_principled_bsdf_specializations() const
+{
+	std::vector<unsigned int> specialized_lobe_masks;
+	for (int i = 0; i < PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_COUNT; i++)
+	{
+		int lobe_mask = m_global_compiler_options->get_macro_value(PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_OPTIONS[i]);
+		if (lobe_mask != PRINCIPLED_LOBE_NONE)
+			specialized_lobe_masks.push_back(lobe_mask);
+	}
+
+	return specialized_lobe_masks;
+}
+
 void GPURenderer::reset_nee_plus_plus()
 {
 	m_render_data.nee_plus_plus.reset_visibility_map = true;
@@ -231,11 +271,14 @@ void GPURenderer::setup_filter_functions()
 	m_render_data.hiprt_function_table = func_table;
 }
 
-void GPURenderer::setup_kernels()
+void GPURenderer::setup_kernels(const std::vector<unsigned int>& principled_bsdf_specialized_lobe_masks, bool principled_bsdf_specializations_cover_scene)
 {
 	m_global_compiler_options = std::make_shared<GPUKernelCompilerOptions>();
 	// Adding hardware acceleration by default if supported
 	m_global_compiler_options->set_macro_value("__USE_HWI__", device_supports_hardware_acceleration() == HardwareAccelerationSupport::SUPPORTED);
+	// The specializations of the BSDF must be known before the kernels start compiling
+	// below, changing them afterwards would recompile all the kernels
+	setup_principled_bsdf_specializations(principled_bsdf_specialized_lobe_masks, principled_bsdf_specializations_cover_scene);
 
 	// Some default values are set for USE_SHARED_STACK_BVH_TRAVERSAL and SHARED_STACK_BVH_TRAVERSAL_SIZE
 	// which I found work approximately well in terms of performance on various scenes (not perfect though and, on top of not 
@@ -257,15 +300,18 @@ void GPURenderer::setup_kernels()
 
 	m_restir_di_render_pass = ReSTIRDIRenderPass(this);
 	if (m_global_compiler_options->get_macro_value(GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_STRATEGY) == LSS_RESTIR_DI)
+	{
 		// We only need to compile the ReSTIR DI render pass if ReSTIR DI is actually being used
-		m_restir_di_render_pass.compile(m_hiprt_orochi_ctx, m_func_name_sets);
+		std::vector<TaskHandle> restir_di_compilation_tasks = m_restir_di_render_pass.compile(m_hiprt_orochi_ctx, m_func_name_sets);
+		m_kernels_compilation_tasks.insert(m_kernels_compilation_tasks.end(), restir_di_compilation_tasks.begin(), restir_di_compilation_tasks.end());
+	}
 
 	m_gmon_render_pass = GMoNRenderPass(this);
 	if (is_using_gmon())
-		m_gmon_render_pass.compile(m_hiprt_orochi_ctx);
+		m_kernels_compilation_tasks.push_back(m_gmon_render_pass.compile(m_hiprt_orochi_ctx));
 
 	if (m_global_compiler_options->get_macro_value(GPUKernelCompilerOptions::DIRECT_LIGHT_USE_NEE_PLUS_PLUS) == KERNEL_OPTION_TRUE)
-		m_nee_plus_plus.compile_finalize_accumulation_kernel(m_hiprt_orochi_ctx);
+		m_kernels_compilation_tasks.push_back(m_nee_plus_plus.compile_finalize_accumulation_kernel(m_hiprt_orochi_ctx));
 
 	// Configuring the kernel that will be used to retrieve the size of the RayVolumeState structure.
 	// This size will be needed to resize the 'ray_volume_states' buffer in the GBuffer if the nested dielectrics
@@ -276,11 +322,19 @@ void GPURenderer::setup_kernels()
 	m_ray_volume_state_byte_size_kernel.set_kernel_file_path(GPURenderer::KERNEL_FILES.at(GPURenderer::RAY_VOLUME_STATE_SIZE_KERNEL_ID));
 	m_ray_volume_state_byte_size_kernel.set_kernel_function_name(GPURenderer::KERNEL_FUNCTION_NAMES.at(GPURenderer::RAY_VOLUME_STATE_SIZE_KERNEL_ID));
 	m_ray_volume_state_byte_size_kernel.synchronize_options_with(*m_global_compiler_options, GPURenderer::KERNEL_OPTIONS_NOT_SYNCHRONIZED);
-	ThreadManager::start_thread(ThreadManager::COMPILE_RAY_VOLUME_STATE_SIZE_KERNEL_KEY, ThreadFunctions::compile_kernel_silent, std::ref(m_ray_volume_state_byte_size_kernel), m_hiprt_orochi_ctx, std::ref(m_func_name_sets));
+	m_ray_volume_state_byte_size_kernel_compilation_task = g_task_scheduler.submit([this]() {
+		ThreadFunctions::compile_kernel_silent(m_ray_volume_state_byte_size_kernel, m_hiprt_orochi_ctx, m_func_name_sets);
+	});
 
 	// Compiling kernels
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel, std::ref(m_kernels[GPURenderer::CAMERA_RAYS_KERNEL_ID]), m_hiprt_orochi_ctx, std::ref(m_func_name_sets));
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel, std::ref(m_kernels[GPURenderer::PATH_TRACING_KERNEL_ID]), m_hiprt_orochi_ctx, std::ref(m_func_name_sets));
+	for (const std::string& kernel_id : { GPURenderer::CAMERA_RAYS_KERNEL_ID, GPURenderer::PATH_TRACING_KERNEL_ID })
+	{
+		GPUKernel& kernel = m_kernels[kernel_id];
+
+		m_kernels_compilation_tasks.push_back(g_task_scheduler.submit([this, &kernel]() {
+			ThreadFunctions::compile_kernel(kernel, m_hiprt_orochi_ctx, m_func_name_sets);
+		}));
+	}
 }
 
 void GPURenderer::pre_render_update(float delta_time)
@@ -335,6 +389,7 @@ void GPURenderer::step_animations(float delta_time)
 {
 	m_envmap.update(this, delta_time);
 	m_camera_animation.animation_step(this, delta_time);
+	m_instance_animation.animation_step(this, delta_time);
 }
 
 void GPURenderer::download_status_buffers()
@@ -435,6 +490,10 @@ void GPURenderer::internal_pre_render_update_nee_plus_plus(float delta_time)
 		if (m_nee_plus_plus.packed_buffer.get_element_count() != 0)
 		{
 			m_nee_plus_plus.packed_buffer.free();
+			m_nee_plus_plus.hash_keys.free();
+			m_nee_plus_plus.entry_epochs.free();
+			m_nee_plus_plus.touched_entries.free();
+			m_nee_plus_plus.touched_entry_counts.free();
 			m_nee_plus_plus.total_shadow_ray_queries.free();
 			m_nee_plus_plus.shadow_rays_actually_traced.free();
 
@@ -452,24 +511,39 @@ void GPURenderer::internal_pre_render_update_nee_plus_plus(float delta_time)
 	m_render_data.nee_plus_plus.grid_min_point = min_grid_extent_with_envmap;
 	m_render_data.nee_plus_plus.grid_max_point = max_grid_extent_with_envmap;
 
+	m_render_data.nee_plus_plus.hash_table_bucket_count = m_nee_plus_plus.hash_table_bucket_count;
+
 	// Allocating / deallocating buffers
-	unsigned int matrix_element_count = m_nee_plus_plus.get_visibility_matrix_element_count(m_render_data.nee_plus_plus.grid_dimensions);
-	if (m_nee_plus_plus.packed_buffer.get_element_count() != matrix_element_count)
+	unsigned int entry_count = m_nee_plus_plus.get_hash_table_entry_count();
+	bool buffers_resized = false;
+	if (m_nee_plus_plus.packed_buffer.get_element_count() != entry_count)
 	{
-		m_nee_plus_plus.packed_buffer.resize(matrix_element_count);
+		m_nee_plus_plus.packed_buffer.resize(entry_count);
+		m_nee_plus_plus.hash_keys.resize(entry_count);
+		m_nee_plus_plus.entry_epochs.resize(entry_count);
+		// Two lists, see the NEE++ device structure
+		m_nee_plus_plus.touched_entries.resize(entry_count * 2);
+		m_nee_plus_plus.touched_entry_counts.resize(2);
 		m_nee_plus_plus.shadow_rays_actually_traced.resize(1);
 		m_nee_plus_plus.total_shadow_ray_queries.resize(1);
 
 		m_render_data_buffers_invalidated = true;
+		buffers_resized = true;
 	}
 
 	// Clearing the visibility map if this has been asked by the user
-	if (m_render_data.nee_plus_plus.reset_visibility_map)
+	if (m_render_data.nee_plus_plus.reset_visibility_map || buffers_resized)
 	{
-		// Clearing the visibility map by memseting everything to 0
+		// Clearing the visibility map by memseting everything to 0.
+		// The touched entries lists don't need to be cleared, only their counts
 		m_nee_plus_plus.packed_buffer.memset_whole_buffer(0);
+		m_nee_plus_plus.hash_keys.memset_whole_buffer(0);
+		m_nee_plus_plus.entry_epochs.memset_whole_buffer(0);
+		m_nee_plus_plus.touched_entry_counts.memset_whole_buffer(0);
 		m_nee_plus_plus.total_shadow_ray_queries.memset_whole_buffer(1);
 		m_nee_plus_plus.shadow_rays_actually_traced.memset_whole_buffer(1);
+
+		m_render_data.nee_plus_plus.current_epoch = 1;
 	}
 
 	if (m_render_data.render_settings.sample_number > m_nee_plus_plus.stop_update_samples)
@@ -485,8 +559,14 @@ void GPURenderer::internal_pre_render_update_nee_plus_plus(float delta_time)
 
 		// Because the visibility map data is packed, we can't just use a memcpy() to copy from the accumulation
 		// buffers to the visibilit map, we have to use a kernel that the does unpacking-copy
+		//
+		// The number of entries touched during the epoch is only known on the GPU so the kernel is launched
+		// for the whole hash table and the threads past the touched entries return immediately
 		void* launch_args[] = { &m_render_data.nee_plus_plus };
-		m_nee_plus_plus.finalize_accumulation_kernel.launch_asynchronous(256, 1, matrix_element_count, 1, launch_args, m_main_stream);
+		m_nee_plus_plus.finalize_accumulation_kernel.launch_asynchronous(256, 1, entry_count, 1, launch_args, m_main_stream);
+
+		// The arguments of the kernel were copied at launch so the next frames can start the next epoch
+		m_render_data.nee_plus_plus.current_epoch++;
 	}
 	
 	m_nee_plus_plus.statistics_refresh_timer -= delta_time;
@@ -582,7 +662,8 @@ void GPURenderer::render()
 	m_updated = false;
 
 	// Making sure kernels are compiled
-	ThreadManager::join_threads(ThreadManager::COMPILE_KERNELS_THREAD_KEY);
+	g_task_scheduler.wait(m_kernels_compilation_tasks);
+	m_kernels_compilation_tasks.clear();
 
 	map_buffers_for_render();
 	
@@ -898,21 +979,14 @@ std::shared_ptr<GPUKernelCompilerOptions> GPURenderer::get_global_compiler_optio
 	return m_global_compiler_options;
 }
 
-// Variables used to give the priority to the main thread when compiling shaders
-extern bool g_main_thread_compiling;
-extern std::condition_variable g_condition_for_compilation;
-
 void GPURenderer::recompile_kernels(bool use_cache)
 {
 	synchronize_kernel();
 
 	g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Recompiling kernels...");
 
-	// Notifying all threads that may be compiling that the main thread wants to
-	// compile. This will block threads other than the main thread from compiling
-	// and thus give the priority to the main thread
-	take_kernel_compilation_priority();
-
+	// These are interactive compilations for the GPUKernelCompiler: they
+	// go before the kernels precompiling in the background
 	for (auto& name_to_kenel : m_kernels)
 		name_to_kenel.second.compile_silent(m_hiprt_orochi_ctx, m_func_name_sets, use_cache);
 
@@ -925,68 +999,24 @@ void GPURenderer::recompile_kernels(bool use_cache)
 		m_nee_plus_plus.recompile(m_hiprt_orochi_ctx);
 
 	m_ray_volume_state_byte_size_kernel.compile_silent(m_hiprt_orochi_ctx, m_func_name_sets, use_cache);
-
-	// The main thread is done with the compilation, we can release the other threads
-	// so that they can continue compiling (background compilation of shaders most likely)
-	release_kernel_compilation_priority();
-}
-
-// Variables used to give the priority to the main thread when compiling shaders
-extern std::thread::id g_priority_thread_id;
-extern bool g_main_thread_compiling;
-extern std::condition_variable g_condition_for_compilation;
-void GPURenderer::take_kernel_compilation_priority()
-{
-	// Notifying all threads that may be compiling that the main thread wants to
-	// compile. This will block threads other than the main thread from compiling
-	// and thus give the priority to the main thread
-	g_main_thread_compiling = true;
-	g_condition_for_compilation.notify_all();
-	g_priority_thread_id = std::this_thread::get_id();
-}
-
-void GPURenderer::release_kernel_compilation_priority()
-{
-	// The main thread is done with the compilation, we can release the other threads
-	// so that they can continue compiling (background compilation of shaders most likely)
-	g_main_thread_compiling = false;
-	g_condition_for_compilation.notify_all();
 }
 
 void GPURenderer::precompile_kernels()
 {
-	return;
+	g_gpu_kernel_compiler.begin_precompilations();
 
 	g_imgui_logger.add_line_with_name(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, ImGuiLogger::BACKGROUND_KERNEL_PARSING_LINE_NAME, "Parsing kernel permutations in the background... [%d / %d]", 0, 1);
 	g_imgui_logger.add_line_with_name(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, ImGuiLogger::BACKGROUND_KERNEL_COMPILATION_LINE_NAME, "Compiling kernel permutations in the background... [%d / %d]", 0, 1);
 
-	// Launching all the threads actually takes some time
-	// so we're launching threads from a thread :D
-	// 
-	// We're not going to join the thread started right below
-	// so we can use a const char* for the key, we don't a constant
-	// defined in ThreadManager. Quick and dirty.
-	ThreadManager::start_thread(ThreadManager::GPU_RENDERER_PRECOMPILE_KERNELS_THREAD_KEY, [this]() {
-		OROCHI_CHECK_ERROR(oroCtxSetCurrent(m_hiprt_orochi_ctx->orochi_ctx));
-
-		precompile_direct_light_sampling_kernels();
-		precompile_ReSTIR_DI_kernels();
-	});
-
-	ThreadManager::detach_threads(ThreadManager::GPU_RENDERER_PRECOMPILE_KERNELS_THREAD_KEY);
-}
-
-extern bool g_background_shader_compilation_enabled;
-void GPURenderer::stop_background_shader_compilation()
-{
-	g_background_shader_compilation_enabled = false;
-	g_condition_for_compilation.notify_all();
+	// This only queues the permutations, the compile workers
+	// of the GPUKernelCompiler do the compilations in the background
+	precompile_direct_light_sampling_kernels();
+	precompile_ReSTIR_DI_kernels();
 }
 
-void GPURenderer::resume_background_shader_compilation()
+void GPURenderer::cancel_kernels_precompilation()
 {
-	g_background_shader_compilation_enabled = true;
-	g_condition_for_compilation.notify_all();
+	g_gpu_kernel_compiler.cancel_precompilations();
 }
 
 void GPURenderer::precompile_direct_light_sampling_kernels()
@@ -1077,12 +1107,7 @@ void GPURenderer::precompile_kernel(const std::string& id, GPUKernelCompilerOpti
 	GPUKernelCompilerOptions options = m_kernels[id].get_kernel_options().deep_copy();
 	partial_options.apply_onto(options);
 
-	ThreadManager::start_thread(ThreadManager::RENDERER_PRECOMPILE_KERNELS, ThreadFunctions::precompile_kernel,
-		GPURenderer::KERNEL_FUNCTION_NAMES.at(id),
-		GPURenderer::KERNEL_FILES.at(id),
-		options, m_hiprt_orochi_ctx, std::ref(m_func_name_sets));
-
-	ThreadManager::detach_threads(ThreadManager::RENDERER_PRECOMPILE_KERNELS);
+	g_gpu_kernel_compiler.precompile_kernel(GPURenderer::KERNEL_FUNCTION_NAMES.at(id), GPURenderer::KERNEL_FILES.at(id), options, m_hiprt_orochi_ctx, m_func_name_sets);
 }
 
 std::map<std::string, GPUKernel*> GPURenderer::get_kernels()
@@ -1235,17 +1260,32 @@ void GPURenderer::update_render_data()
 
 	if (m_render_data_buffers_invalidated)
 	{
-		m_render_data.GPU_BVH = m_hiprt_scene.geometry.m_geometry;
+		m_render_data.GPU_BVH = m_hiprt_scene.bvh.m_scene;
+		m_render_data.buffers.instance_primitive_offsets = m_hiprt_scene.bvh.m_instance_primitive_offsets.get_device_pointer();
+		if (m_hiprt_scene.bvh.m_has_instance_transforms)
+		{
+			m_render_data.buffers.instance_object_to_world = m_hiprt_scene.bvh.m_instance_object_to_world.get_device_pointer();
+			m_render_data.buffers.instance_normal_to_world = m_hiprt_scene.bvh.m_instance_normal_to_world.get_device_pointer();
+		}
+		else
+		{
+			m_render_data.buffers.instance_object_to_world = nullptr;
+			m_render_data.buffers.instance_normal_to_world = nullptr;
+		}
 
 		m_render_data.buffers.triangles_indices = reinterpret_cast<int*>(m_hiprt_scene.geometry.m_mesh.triangleIndices);
 		m_render_data.buffers.vertices_positions = reinterpret_cast<float3*>(m_hiprt_scene.geometry.m_mesh.vertices);
-		m_render_data.buffers.has_vertex_normals = reinterpret_cast<unsigned char*>(m_hiprt_scene.has_vertex_normals.get_device_pointer());
-		m_render_data.buffers.vertex_normals = reinterpret_cast<float3*>(m_hiprt_scene.vertex_normals.get_device_pointer());
+		m_render_data.buffers.has_vertex_normals = m_hiprt_scene.has_vertex_normals.get_device_pointer();
+		m_render_data.buffers.vertex_normals = m_hiprt_scene.vertex_normals.get_device_pointer();
 		m_render_data.buffers.material_indices = reinterpret_cast<int*>(m_hiprt_scene.material_indices.get_device_pointer());
 		m_render_data.buffers.materials_buffer = m_hiprt_scene.materials_buffer.get_device_SoA_struct();
 		m_render_data.buffers.material_opaque = m_hiprt_scene.material_opaque.get_device_pointer();
 		m_render_data.buffers.emissive_triangles_count = m_hiprt_scene.emissive_triangles_count;
 		m_render_data.buffers.emissive_triangles_indices = reinterpret_cast<int*>(m_hiprt_scene.emissive_triangles_indices.get_device_pointer());
+		m_render_data.buffers.emissive_power_alias_table_probas = m_hiprt_scene.emissive_power_alias_table_probas.get_device_pointer();
+		m_render_data.buffers.emissive_power_alias_table_alias = m_hiprt_scene.emissive_power_alias_table_alias.get_device_pointer();
+		m_render_data.buffers.light_bvh.nodes = m_hiprt_scene.light_bvh_nodes.get_device_pointer();
+		m_render_data.buffers.light_bvh.triangle_leaf_indices = m_hiprt_scene.light_bvh_triangle_leaf_indices.get_device_pointer();
 
 		m_render_data.bsdfs_data.sheen_ltc_parameters_texture = m_sheen_ltc_params.get_device_texture();
 		m_render_data.bsdfs_data.GGX_conductor_Ess = m_GGX_conductor_Ess.get_device_texture();
@@ -1255,7 +1295,15 @@ void GPURenderer::update_render_data()
 		m_render_data.bsdfs_data.GGX_Ess_thin_glass = m_GGX_Ess_thin_glass.get_device_texture();
 
 		m_render_data.buffers.material_textures = reinterpret_cast<oroTextureObject_t*>(m_hiprt_scene.gpu_materials_textures.get_device_pointer());
-		m_render_data.buffers.texcoords = reinterpret_cast<float2*>(m_hiprt_scene.texcoords_buffer.get_device_pointer());
+		m_render_data.buffers.material_textures_two_channels = m_hiprt_scene.material_textures_two_channels.get_device_pointer();
+#if GeometryCompression == KERNEL_OPTION_TRUE
+		m_render_data.buffers.texcoords.quantized_texcoords = m_hiprt_scene.texcoords_buffer.get_device_pointer();
+		m_render_data.buffers.texcoords.block_bounds = m_hiprt_scene.texcoords_block_bounds_buffer.get_device_pointer();
+		m_render_data.buffers.texcoords.block_first_vertices = m_hiprt_scene.texcoords_block_first_vertices_buffer.get_device_pointer();
+		m_render_data.buffers.texcoords.window_first_blocks = m_hiprt_scene.texcoords_window_first_blocks_buffer.get_device_pointer();
+#else
+		m_render_data.buffers.texcoords = m_hiprt_scene.texcoords_buffer.get_device_pointer();
+#endif
 
 		m_render_data.g_buffer = m_g_buffer.get_device_g_buffer();
 
@@ -1283,10 +1331,15 @@ void GPURenderer::update_render_data()
 		m_restir_di_render_pass.update_render_data();
 
 		m_render_data.nee_plus_plus.packed_buffers = reinterpret_cast<AtomicType<unsigned int>*>(m_nee_plus_plus.packed_buffer.get_device_pointer());
+		m_render_data.nee_plus_plus.hash_keys = reinterpret_cast<AtomicType<unsigned long long int>*>(m_nee_plus_plus.hash_keys.get_device_pointer());
+		m_render_data.nee_plus_plus.entry_epochs = reinterpret_cast<AtomicType<unsigned int>*>(m_nee_plus_plus.entry_epochs.get_device_pointer());
+		m_render_data.nee_plus_plus.touched_entries = reinterpret_cast<AtomicType<unsigned int>*>(m_nee_plus_plus.touched_entries.get_device_pointer());
+		m_render_data.nee_plus_plus.touched_entry_counts = reinterpret_cast<AtomicType<unsigned int>*>(m_nee_plus_plus.touched_entry_counts.get_device_pointer());
 		m_render_data.nee_plus_plus.shadow_rays_actually_traced = reinterpret_cast<AtomicType<unsigned int>*>(m_nee_plus_plus.shadow_rays_actually_traced.get_device_pointer());
 		m_render_data.nee_plus_plus.total_shadow_ray_queries = reinterpret_cast<AtomicType<unsigned int>*>(m_nee_plus_plus.total_shadow_ray_queries.get_device_pointer());
 
 		m_render_data.buffers.gmon_estimator.sets = m_gmon_render_pass.get_sets_buffers_device_pointer();
+		m_render_data.buffers.gmon_estimator.tile_sample_counts = m_gmon_render_pass.get_tile_sample_counts_device_pointer();
 
 		m_render_data_buffers_invalidated = false;
 	}
@@ -1301,13 +1354,24 @@ void GPURenderer::set_hiprt_scene_from_scene(const Scene& scene)
 	m_hiprt_scene.geometry.upload_indices(scene.triangle_indices);
 	m_hiprt_scene.geometry.upload_vertices(scene.vertices_positions);
 	m_hiprt_scene.geometry.m_hiprt_ctx = m_hiprt_orochi_ctx->hiprt_ctx;
+	m_hiprt_scene.bvh.set_meshes(m_hiprt_orochi_ctx->hiprt_ctx, scene.triangle_indices, scene.vertices_positions, scene.metadata.mesh_triangle_offsets, scene.metadata.mesh_vertex_offsets, scene.metadata.instances);
 	rebuild_renderer_bvh(hiprtBuildFlagBitPreferHighQualityBuild, true);
 
+#if GeometryCompression == KERNEL_OPTION_TRUE
+	std::vector<unsigned int> has_vertex_normals_bitfield = CompressedGeometryCPUGPUCommonData::pack_has_vertex_normals(scene.has_vertex_normals);
+	m_hiprt_scene.has_vertex_normals.resize(has_vertex_normals_bitfield.size());
+	m_hiprt_scene.has_vertex_normals.upload_data(has_vertex_normals_bitfield.data());
+
+	std::vector<Octahedral24BitNormal> packed_vertex_normals = CompressedGeometryCPUGPUCommonData::pack_vertex_normals(scene.vertex_normals);
+	m_hiprt_scene.vertex_normals.resize(packed_vertex_normals.size());
+	m_hiprt_scene.vertex_normals.upload_data(packed_vertex_normals.data());
+#else
 	m_hiprt_scene.has_vertex_normals.resize(scene.has_vertex_normals.size());
 	m_hiprt_scene.has_vertex_normals.upload_data(scene.has_vertex_normals.data());
 
 	m_hiprt_scene.vertex_normals.resize(scene.vertex_normals.size());
 	m_hiprt_scene.vertex_normals.upload_data(scene.vertex_normals.data());
+#endif
 
 	m_hiprt_scene.material_indices.resize(scene.material_indices.size());
 	m_hiprt_scene.material_indices.upload_data(scene.material_indices.data());
@@ -1316,8 +1380,7 @@ void GPURenderer::set_hiprt_scene_from_scene(const Scene& scene)
 	// parsing can modify the materials (emission of constant textures are stored in the
 	// material directly for example) so we need to wait for the end of texture parsing
 	// to upload the materials
-	ThreadManager::add_dependency(ThreadManager::RENDERER_UPLOAD_MATERIALS, ThreadManager::SCENE_TEXTURES_LOADING_THREAD_KEY);
-	ThreadManager::start_thread(ThreadManager::RENDERER_UPLOAD_MATERIALS, [this, &scene]() 
+	g_task_scheduler.submit([this, &scene]() 
 	{
 		OROCHI_CHECK_ERROR(oroCtxSetCurrent(m_hiprt_orochi_ctx->orochi_ctx));
 
@@ -1336,17 +1399,29 @@ void GPURenderer::set_hiprt_scene_from_scene(const Scene& scene)
 		m_hiprt_scene.material_opaque.upload_data(material_opaque);
 		m_hiprt_scene.material_has_opaque_base_color_texture = scene.material_has_opaque_base_color_texture;
 
+#if GeometryCompression == KERNEL_OPTION_TRUE
+		CompressedGeometryCPUGPUCommonData::PackedTexcoords packed_texcoords = CompressedGeometryCPUGPUCommonData::pack_texcoords(scene.texcoords, scene.metadata.mesh_vertex_offsets);
+		m_hiprt_scene.texcoords_buffer.resize(packed_texcoords.quantized_texcoords.size());
+		m_hiprt_scene.texcoords_buffer.upload_data(packed_texcoords.quantized_texcoords.data());
+		m_hiprt_scene.texcoords_block_bounds_buffer.resize(packed_texcoords.block_bounds.size());
+		m_hiprt_scene.texcoords_block_bounds_buffer.upload_data(packed_texcoords.block_bounds.data());
+		m_hiprt_scene.texcoords_block_first_vertices_buffer.resize(packed_texcoords.block_first_vertices.size());
+		m_hiprt_scene.texcoords_block_first_vertices_buffer.upload_data(packed_texcoords.block_first_vertices.data());
+		m_hiprt_scene.texcoords_window_first_blocks_buffer.resize(packed_texcoords.window_first_blocks.size());
+		m_hiprt_scene.texcoords_window_first_blocks_buffer.upload_data(packed_texcoords.window_first_blocks.data());
+#else
 		m_hiprt_scene.texcoords_buffer.resize(scene.texcoords.size());
 		m_hiprt_scene.texcoords_buffer.upload_data(scene.texcoords.data());
-	});
+#endif
+	}, scene.textures_loading_tasks);
 
-	ThreadManager::add_dependency(ThreadManager::RENDERER_UPLOAD_TEXTURES, ThreadManager::SCENE_TEXTURES_LOADING_THREAD_KEY);
-	ThreadManager::start_thread(ThreadManager::RENDERER_UPLOAD_TEXTURES, [this, &scene]() {
+	g_task_scheduler.submit([this, &scene]() {
 		OROCHI_CHECK_ERROR(oroCtxSetCurrent(m_hiprt_orochi_ctx->orochi_ctx));
 
 		if (scene.textures.size() > 0)
 		{
 			std::vector<oroTextureObject_t> oro_textures(scene.textures.size());
+			std::vector<unsigned char> textures_two_channels(scene.textures.size(), 0);
 			m_hiprt_scene.orochi_materials_textures.reserve(scene.textures.size());
 			for (int i = 0; i < scene.textures.size(); i++)
 			{
@@ -1368,15 +1443,17 @@ void GPURenderer::set_hiprt_scene_from_scene(const Scene& scene)
 				m_hiprt_scene.orochi_materials_textures.push_back(OrochiTexture(scene.textures[i]));
 
 				oro_textures[i] = m_hiprt_scene.orochi_materials_textures.back().get_device_texture();
+				textures_two_channels[i] = scene.textures[i].get_compression_format() == TEXTURE_COMPRESSION_BC5;
 			}
 
 			m_hiprt_scene.gpu_materials_textures.resize(oro_textures.size());
 			m_hiprt_scene.gpu_materials_textures.upload_data(oro_textures.data());
+			m_hiprt_scene.material_textures_two_channels.resize(textures_two_channels.size());
+			m_hiprt_scene.material_textures_two_channels.upload_data(textures_two_channels.data());
 		}
-	});
+	}, scene.textures_loading_tasks);
 
-	ThreadManager::add_dependency(ThreadManager::RENDERER_UPLOAD_EMISSIVE_TRIANGLES, ThreadManager::SCENE_LOADING_PARSE_EMISSIVE_TRIANGLES);
-	ThreadManager::start_thread(ThreadManager::RENDERER_UPLOAD_EMISSIVE_TRIANGLES, [this, &scene]() {
+	g_task_scheduler.submit([this, &scene]() {
 		m_hiprt_scene.emissive_triangles_count = scene.emissive_triangle_indices.size();
 		if (m_hiprt_scene.emissive_triangles_count > 0)
 		{
@@ -1384,29 +1461,142 @@ void GPURenderer::set_hiprt_scene_from_scene(const Scene& scene)
 
 			m_hiprt_scene.emissive_triangles_indices.resize(scene.emissive_triangle_indices.size());
 			m_hiprt_scene.emissive_triangles_indices.upload_data(scene.emissive_triangle_indices.data());
+
+			m_hiprt_scene.light_bvh.build(scene);
+
+			m_hiprt_scene.light_bvh_nodes.resize(m_hiprt_scene.light_bvh.get_nodes().size());
+			m_hiprt_scene.light_bvh_nodes.upload_data(m_hiprt_scene.light_bvh.get_nodes().data());
+			m_hiprt_scene.light_bvh_triangle_leaf_indices.resize(m_hiprt_scene.light_bvh.get_triangle_leaf_indices().size());
+			m_hiprt_scene.light_bvh_triangle_leaf_indices.upload_data(m_hiprt_scene.light_bvh.get_triangle_leaf_indices().data());
+			m_hiprt_scene.emissive_power_alias_table_probas.resize(m_hiprt_scene.light_bvh.get_power_alias_table_probas().size());
+			m_hiprt_scene.emissive_power_alias_table_probas.upload_data(m_hiprt_scene.light_bvh.get_power_alias_table_probas().data());
+			m_hiprt_scene.emissive_power_alias_table_alias.resize(m_hiprt_scene.light_bvh.get_power_alias_table_alias().size());
+			m_hiprt_scene.emissive_power_alias_table_alias.upload_data(m_hiprt_scene.light_bvh.get_power_alias_table_alias().data());
 		}
-	});
+	}, { scene.emissive_triangles_task });
 }
 
 void GPURenderer::rebuild_renderer_bvh(hiprtBuildFlags build_flags, bool do_compaction)
 {
-	m_hiprt_scene.geometry.build_bvh(build_flags, do_compaction, m_main_stream);
+	m_hiprt_scene.bvh.build(build_flags, do_compaction, m_main_stream);
+
+	// The HIPRT scene has been recreated
+	m_render_data_buffers_invalidated = true;
+}
+
+void GPURenderer::set_instance_transform(int instance_index, const float4x4& object_to_world)
+{
+	if (instance_index < 0 || instance_index >= m_hiprt_scene.bvh.get_instance_count())
+	{
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot set the transform of instance %d, the scene only has %d instances", instance_index, m_hiprt_scene.bvh.get_instance_count());
+
+		return;
+	}
+
+	int mesh_index = m_parsed_scene_metadata.instances[instance_index].mesh_index;
+	if (is_mesh_emissive(mesh_index))
+	{
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot move instance %d, its mesh \"%s\" is emissive", instance_index, m_parsed_scene_metadata.mesh_names[mesh_index].c_str());
+
+		return;
+	}
+
+	m_hiprt_scene.bvh.set_instance_transform(instance_index, object_to_world);
+	m_hiprt_scene.bvh.build_tlas(m_main_stream);
+
+	m_render_data_buffers_invalidated = true;
+	m_render_data.render_settings.need_to_reset = true;
+}
+
+void GPURenderer::update_mesh_vertices(int mesh_index, const std::vector<float3>& object_space_vertices_positions)
+{
+	if (mesh_index < 0 || mesh_index >= m_hiprt_scene.bvh.get_mesh_count())
+	{
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot update the vertices of mesh %d, the scene only has %d meshes", mesh_index, m_hiprt_scene.bvh.get_mesh_count());
+
+		return;
+	}
+
+	if (is_mesh_emissive(mesh_index))
+	{
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot deform mesh \"%s\", it is emissive", m_parsed_scene_metadata.mesh_names[mesh_index].c_str());
+
+		return;
+	}
+
+	int first_vertex = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index];
+	int vertex_count = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index + 1] - first_vertex;
+	if (object_space_vertices_positions.size() != vertex_count)
+	{
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Mesh %d has %d vertices but %zu vertices were given", mesh_index, vertex_count, object_space_vertices_positions.size());
+
+		return;
+	}
+
+	m_hiprt_scene.bvh.update_mesh_vertices(mesh_index, object_space_vertices_positions, m_main_stream);
+	// The bounds of the instances of the mesh have changed
+	m_hiprt_scene.bvh.build_tlas(m_main_stream);
+
+	// The shading buffers are in the object space of the meshes too
+	m_hiprt_scene.geometry.update_vertices(object_space_vertices_positions.data(), first_vertex, vertex_count);
+
+	m_render_data_buffers_invalidated = true;
+	m_render_data.render_settings.need_to_reset = true;
+}
+
+std::vector<float3> GPURenderer::get_mesh_vertices(int mesh_index)
+{
+	int first_vertex = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index];
+	int vertex_count = m_parsed_scene_metadata.mesh_vertex_offsets[mesh_index + 1] - first_vertex;
+
+	return m_hiprt_scene.geometry.download_vertices(first_vertex, vertex_count);
+}
+
+bool GPURenderer::is_mesh_emissive(int mesh_index)
+{
+	return m_mesh_has_emissive_triangles[mesh_index];
 }
 
 void GPURenderer::set_scene(const Scene& scene)
 {
 	set_hiprt_scene_from_scene(scene);
 	setup_nee_plus_plus_from_scene(scene);
+	// The specializations of the BSDF were chosen from this scene when the renderer was created
+	g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Specialized principled BSDFs cover %.1f%% of the triangles of the scene", scene.get_principled_lobe_masks_coverage(get_principled_bsdf_specializations()) * 100.0f);
+	if (m_global_compiler_options->get_macro_value(GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE) == KERNEL_OPTION_TRUE)
+	{
+		if (scene.principled_lobe_masks_cover_scene(get_principled_bsdf_specializations()))
+			g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "The kernels are compiled without the generic principled BSDF");
+		else
+		{
+			g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "The specialized principled BSDFs do not cover all the materials of the scene, recompiling the kernels with the generic principled BSDF");
+			m_global_compiler_options->set_macro_value(GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE, KERNEL_OPTION_FALSE);
+			recompile_kernels();
+		}
+	}
 
 	m_original_materials = scene.materials;
 	m_current_materials = scene.materials;
 	m_parsed_scene_metadata = scene.metadata;
+
+	// The emissive triangles of the scene may still be being parsed
+	g_task_scheduler.wait(scene.emissive_triangles_task);
+
+	const std::vector<int>& mesh_triangle_offsets = scene.metadata.mesh_triangle_offsets;
+	m_mesh_has_emissive_triangles = std::vector<bool>(mesh_triangle_offsets.size() - 1, false);
+	for (int emissive_triangle_index : scene.emissive_triangle_indices)
+	{
+		// The triangles of the meshes are contiguous, finding the mesh of the triangle in the offsets
+		int mesh_index = std::upper_bound(mesh_triangle_offsets.begin(), mesh_triangle_offsets.end(), emissive_triangle_index) - mesh_triangle_offsets.begin() - 1;
+		m_mesh_has_emissive_triangles[mesh_index] = true;
+	}
+
+	m_instance_animation.set_instances(scene.metadata.instances);
 }
 
-void GPURenderer::set_envmap(const Image32Bit& envmap_image, const std::string& envmap_filepath)
+void GPURenderer::set_envmap(const Image32Bit& envmap_image, const std::string& envmap_filepath, const TaskHandle& envmap_loading_task)
 {
-	ThreadManager::add_dependency(ThreadManager::RENDERER_SET_ENVMAP, ThreadManager::ENVMAP_LOAD_FROM_DISK_THREAD);
-	ThreadManager::start_thread(ThreadManager::RENDERER_SET_ENVMAP, [this, &envmap_image, &envmap_filepath]() {
+	g_task_scheduler.submit([this, &envmap_image, &envmap_filepath]() {
 		OROCHI_CHECK_ERROR(oroCtxSetCurrent(m_hiprt_orochi_ctx->orochi_ctx));
 
 		if (envmap_image.width == 0 || envmap_image.height == 0)
@@ -1439,8 +1629,15 @@ void GPURenderer::set_envmap(const Image32Bit& envmap_image, const std::string&
 		m_render_data.world_settings.envmap_cdf = nullptr;
 
 		m_envmap.get_alias_table_device_pointers(m_render_data.world_settings.alias_table_probas, m_render_data.world_settings.alias_table_alias);
+#elif EnvmapSamplingStrategy == ESS_GUIDED_CDF
+		m_render_data.world_settings.envmap_cdf = nullptr;
+
+		m_render_data.world_settings.alias_table_probas = nullptr;
+		m_render_data.world_settings.alias_table_alias = nullptr;
+
+		m_render_data.world_settings.envmap_guided_cdf = m_envmap.get_guided_cdf_device_data();
 #endif
-	});
+	}, { envmap_loading_task });
 }
 
 bool GPURenderer::has_envmap()
@@ -1466,6 +1663,8 @@ const std::vector<std::string>& GPURenderer::get_material_names()
 void GPURenderer::update_all_materials(std::vector<CPUMaterial>& materials)
 {
 	m_current_materials = materials;
+	for (const CPUMaterial& material : materials)
+		check_principled_bsdf_specializations_cover_material(material);
 
 	std::vector<unsigned char> new_opacity(materials.size());
 	std::vector<DevicePackedTexturedMaterial> packed_gpu_materials(materials.size());
@@ -1486,6 +1685,7 @@ void GPURenderer::update_all_materials(std::vector<CPUMaterial>& materials)
 void GPURenderer::update_one_material(CPUMaterial& material, int material_index)
 {
 	m_current_materials[material_index] = material;
+	check_principled_bsdf_specializations_cover_material(material);
 
 	DevicePackedTexturedMaterial packed_gpu_material = material.pack_to_GPU();
 	// The material is fully opaque if its base color texture is fully opaque
@@ -1497,6 +1697,21 @@ void GPURenderer::update_one_material(CPUMaterial& material, int material_index)
 	m_hiprt_scene.materials_buffer.upload_data_partial(material_index, &packed_gpu_material, 1);
 }
 
+void GPURenderer::check_principled_bsdf_specializations_cover_material(const CPUMaterial& material)
+{
+	if (m_global_compiler_options->get_macro_value(GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE) == KERNEL_OPTION_FALSE)
+		return;
+
+	unsigned int lobe_mask = material.get_principled_lobe_mask();
+	for (unsigned int specialized_lobe_mask : get_principled_bsdf_specializations())
+		if ((lobe_mask & ~specialized_lobe_mask) == 0)
+			return;
+
+	g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "The edited material isn't covered by the specialized principled BSDFs anymore, recompiling the kernels with the generic principled BSDF");
+	m_global_compiler_options->set_macro_value(GPUKernelCompilerOptions::PRINCIPLED_BSDF_SPECIALIZATIONS_COVER_SCENE, KERNEL_OPTION_FALSE);
+	recompile_kernels();
+}
+
 
 const std::vector<BoundingBox>& GPURenderer::get_mesh_bounding_boxes()
 {
@@ -1518,7 +1733,7 @@ size_t GPURenderer::get_ray_volume_state_byte_size()
 	OrochiBuffer<size_t> out_size_buffer(1);
 	size_t* out_size_buffer_pointer = out_size_buffer.get_device_pointer();
 
-	ThreadManager::join_threads(ThreadManager::COMPILE_RAY_VOLUME_STATE_SIZE_KERNEL_KEY);
+	g_task_scheduler.wait(m_ray_volume_state_byte_size_kernel_compilation_task);
 
 	void* launch_args[] = { &out_size_buffer_pointer };
 	m_ray_volume_state_byte_size_kernel.launch_synchronous(1, 1, 1, 1, launch_args, 0);
@@ -1548,6 +1763,11 @@ CameraAnimation& GPURenderer::get_camera_animation()
 	return m_camera_animation;
 }
 
+InstanceAnimation& GPURenderer::get_instance_animation()
+{
+	return m_instance_animation;
+}
+
 RendererEnvmap& GPURenderer::get_envmap()
 {
 	return m_envmap;
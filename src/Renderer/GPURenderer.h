@@ -27,7 +27,9 @@
 #include "Renderer/RenderPasses/ReSTIRDIRenderPass.h"
 #include "Scene/Camera.h"
 #include "Scene/CameraAnimation.h"
+#include "Scene/InstanceAnimation.h"
 #include "Scene/SceneParser.h"
+#include "Threads/TaskScheduler.h"
 #include "UI/ApplicationSettings.h"
 #include "UI/PerformanceMetricsComputer.h"
 
@@ -80,8 +82,17 @@ public:
 	/**
 	 * Constructs a renderer that will be using the given HIPRT/Orochi
 	 * context for handling GPU acceleration structures, buffers, textures, etc...
+	 *
+	 * 'principled_bsdf_specialized_lobe_masks' are the lobe masks for which the kernels
+	 * compile a specialized principled BSDF, see Scene::get_principled_bsdf_specialized_lobe_masks().
+	 * Empty to keep the default PrincipledBSDFSpecializedLobeMaskX options.
+	 * 
+	 * 'principled_bsdf_specializations_cover_scene' must only be true if these masks cover all
+	 * the materials of the scene (see Scene::principled_lobe_masks_cover_scene()), the kernels
+	 * are then compiled without the generic principled BSDF, see PrincipledBSDFSpecializationsCoverScene
 	 */
-	GPURenderer(std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx, std::shared_ptr<ApplicationSettings> application_settings);
+	GPURenderer(std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx, std::shared_ptr<ApplicationSettings> application_settings, 
+		const std::vector<unsigned int>& principled_bsdf_specialized_lobe_masks = {}, bool principled_bsdf_specializations_cover_scene = false);
 	void setup_brdfs_data();
 
 	/**
@@ -111,6 +122,13 @@ public:
 	 */
 	void setup_nee_plus_plus_from_scene(const Scene& scene);
 
+	/**
+	 * Sets the PrincipledBSDFSpecializedLobeMaskX and PrincipledBSDFSpecializationsCoverScene kernel options.
+	 * Doesn't recompile anything, this is called before the first compilation of the kernels
+	 */
+	void setup_principled_bsdf_specializations(const std::vector<unsigned int>& specialized_lobe_masks, bool specializations_cover_scene);
+	std::vector<unsigned int> get_principled_bsdf_specializations() const;
+
 	/**
 	 * Clears the visibility map of NEE++ so that it is recomputed next frame
 	 */
@@ -143,7 +161,7 @@ public:
 	/**
 	 * Initializes and compiles the kernels
 	 */
-	void setup_kernels();
+	void setup_kernels(const std::vector<unsigned int>& principled_bsdf_specialized_lobe_masks, bool principled_bsdf_specializations_cover_scene);
 
 	/**
 	 * This function is in charge of updating various "dynamic attributes/properties/buffers" of the renderer before rendering a frame.
@@ -268,12 +286,42 @@ public:
 
 	Camera& get_camera();
 	CameraAnimation& get_camera_animation();
+	InstanceAnimation& get_instance_animation();
 	RendererEnvmap& get_envmap();
 
 	void set_scene(const Scene& scene);
 	void rebuild_renderer_bvh(hiprtBuildFlags build_flags, bool do_compaction);
+	/**
+	 * Moves the instance with an affine object to world transform (see SceneMetadata::instances).
+	 * Only the TLAS of the scene is rebuilt, the BLAS of the mesh of the instance is untouched.
+	 *
+	 * Instances of emissive meshes cannot be moved, see is_mesh_emissive()
+	 */
+	void set_instance_transform(int instance_index, const float4x4& object_to_world);
+	/**
+	 * Deforms the mesh, and all its instances: 'object_space_vertices_positions' are the new positions
+	 * of all the vertices of the mesh. The BLAS of the mesh is refitted, not rebuilt, so the
+	 * deformation should keep the triangles of the mesh roughly where they were.
+	 *
+	 * Emissive meshes cannot be deformed, see is_mesh_emissive()
+	 */
+	void update_mesh_vertices(int mesh_index, const std::vector<float3>& object_space_vertices_positions);
+	/**
+	 * Reads back the current object space positions of the vertices of the mesh from the GPU
+	 */
+	std::vector<float3> get_mesh_vertices(int mesh_index);
+	/**
+	 * Returns true if the mesh has triangles sampled by the direct lighting strategies.
+	 * The light sampling data (emissive triangles, light BVH, power alias table) is built
+	 * once, when the scene is set, so these meshes must stay where they are
+	 */
+	bool is_mesh_emissive(int mesh_index);
 	void set_camera(const Camera& camera);
-	void set_envmap(const Image32Bit& envmap, const std::string& envmap_filepath);
+	/**
+	 * The envmap is set up asynchronously, once 'envmap_loading_task' (the task
+	 * that reads 'envmap' from the disk, if any) is finished
+	 */
+	void set_envmap(const Image32Bit& envmap, const std::string& envmap_filepath, const TaskHandle& envmap_loading_task = nullptr);
 	bool has_envmap();
 
 	const std::vector<CPUMaterial>& get_original_materials();
@@ -288,6 +336,11 @@ public:
 	 * Updates only the material with index 'material_index' and uploads it to the GPU 
 	 */
 	void update_one_material(CPUMaterial& material, int material_index);
+	/**
+	 * If the kernels were compiled without the generic principled BSDF (PrincipledBSDFSpecializationsCoverScene)
+	 * and 'material' has lobes that none of the specializations has, recompiles the kernels with the generic BSDF
+	 */
+	void check_principled_bsdf_specializations_cover_material(const CPUMaterial& material);
 
 	const std::vector<BoundingBox>& get_mesh_bounding_boxes();
 	const std::vector<std::string>& get_mesh_names();
@@ -335,15 +388,15 @@ public:
 	std::shared_ptr<GPUKernelCompilerOptions> get_global_compiler_options();
 
 	void recompile_kernels(bool use_cache = true);
-	void take_kernel_compilation_priority();
-	void release_kernel_compilation_priority();
 	/**
-	 * Precompiles a variety of kernel option combinations to avoid
+	 * Precompiles a variety of kernel option combinations in the background to avoid
 	 * having to compile too many kernels at runtime
 	 */
 	void precompile_kernels();
-	void stop_background_shader_compilation();
-	void resume_background_shader_compilation();
+	/**
+	 * Drops the kernel precompilations that haven't started yet
+	 */
+	void cancel_kernels_precompilation();
 
 	std::map<std::string, GPUKernel*> get_kernels();
 	std::vector<std::string> get_all_kernel_ids();
@@ -377,6 +430,8 @@ public:
 	Camera m_previous_frame_camera;
 	// Animator of the camera of the current frame ('m_camera')
 	CameraAnimation m_camera_animation;
+	// Motion of the instances and deformation of the meshes of the scene
+	InstanceAnimation m_instance_animation;
 
 private:
 	void set_hiprt_scene_from_scene(const Scene& scene);
@@ -552,6 +607,8 @@ private:
 
 	// Some additional info about the parsed scene such as materials names, mesh names, ...
 	SceneMetadata m_parsed_scene_metadata;
+	// For each mesh, whether or not it has triangles in the emissive triangles of the scene
+	std::vector<bool> m_mesh_has_emissive_triangles;
 	// The original materials of the scene. Those are the materials that have directly been read from the hard drive scene file.
 	// Used in case the user wants to revert every changes that have been done
 	std::vector<CPUMaterial> m_original_materials;
@@ -578,8 +635,12 @@ private:
 	// of this map is a "name"
 	std::map<std::string, GPUKernel> m_kernels;
 
+	// Compilations of the kernels started by setup_kernels(). The kernels can only be launched once these are finished
+	std::vector<TaskHandle> m_kernels_compilation_tasks;
+
 	// Kernel used for retrieving the size of the RayVolumeState structure on the GPU
 	GPUKernel m_ray_volume_state_byte_size_kernel;
+	TaskHandle m_ray_volume_state_byte_size_kernel_compilation_task = nullptr;
 	// If this kernel isn't empty, then it will be used instead of all the regular path tracing
 	// kernels.
 	// 
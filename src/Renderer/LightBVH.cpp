@@ -0,0 +1,372 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Renderer/LightBVH.h"
+#include "Scene/SceneParser.h"
+#include "UI/ImGui/ImGuiLogger.h"
+#include "Utils/Utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+extern ImGuiLogger g_imgui_logger;
+
+/**
+ * Returns the component 'axis' of the given vector.
+ *
+ * X = 0, Y = 1, Z = 2
+ */
+static inline float get_axis(const float3& vector, int axis)
+{
+    return *(&vector.x + axis);
+}
+
+static inline int get_centroid_bin(const float3& centroid, int axis, const BoundingBox& centroid_bounds)
+{
+    float axis_min = get_axis(centroid_bounds.mini, axis);
+    float axis_extent = centroid_bounds.get_extent(axis);
+
+    int bin = static_cast<int>(LightBVH::SAOH_BIN_COUNT * (get_axis(centroid, axis) - axis_min) / axis_extent);
+
+    return hippt::clamp(0, LightBVH::SAOH_BIN_COUNT - 1, bin);
+}
+
+/**
+ * Rotates 'vector' by 'angle' radians around the normalized 'axis' (Rodrigues' formula)
+ */
+static float3 rotate_around_axis(const float3& vector, const float3& axis, float angle)
+{
+    float cos_angle = cosf(angle);
+    float sin_angle = sinf(angle);
+
+    return vector * cos_angle + hippt::cross(axis, vector) * sin_angle + axis * hippt::dot(axis, vector) * (1.0f - cos_angle);
+}
+
+LightBVH::DirectionCone LightBVH::DirectionCone::entire_sphere()
+{
+    DirectionCone cone;
+    cone.axis = make_float3(0.0f, 0.0f, 1.0f);
+    cone.cos_theta = -1.0f;
+    cone.empty = false;
+
+    return cone;
+}
+
+bool LightBVH::DirectionCone::is_empty() const
+{
+    return empty;
+}
+
+LightBVH::DirectionCone LightBVH::DirectionCone::merge(const DirectionCone& a, const DirectionCone& b)
+{
+    // [Physically Based Rendering 4th Edition, Pharr, Jakob, Humphreys, 2023] Chapter 3.8.4
+    if (a.is_empty())
+        return b;
+    else if (b.is_empty())
+        return a;
+
+    float theta_a = acosf(hippt::clamp(-1.0f, 1.0f, a.cos_theta));
+    float theta_b = acosf(hippt::clamp(-1.0f, 1.0f, b.cos_theta));
+    float theta_d = acosf(hippt::clamp(-1.0f, 1.0f, hippt::dot(a.axis, b.axis)));
+
+    // One of the cones already contains the other one
+    if (hippt::min(theta_d + theta_b, M_PI) <= theta_a)
+        return a;
+    if (hippt::min(theta_d + theta_a, M_PI) <= theta_b)
+        return b;
+
+    float theta_o = (theta_a + theta_d + theta_b) * 0.5f;
+    if (theta_o >= M_PI)
+        return DirectionCone::entire_sphere();
+
+    float3 rotation_axis = hippt::cross(a.axis, b.axis);
+    if (hippt::length2(rotation_axis) == 0.0f)
+        return DirectionCone::entire_sphere();
+
+    DirectionCone merged;
+    merged.axis = hippt::normalize(rotate_around_axis(a.axis, hippt::normalize(rotation_axis), theta_o - theta_a));
+    merged.cos_theta = cosf(theta_o);
+    merged.empty = false;
+
+    return merged;
+}
+
+float LightBVH::get_SAOH_cost(const BoundingBox& bounds, const DirectionCone& normal_cone, float power, const BoundingBox& parent_bounds, int split_axis)
+{
+    if (normal_cone.is_empty())
+        // Nothing in there
+        return 0.0f;
+
+    // Orientation term of the cost with an emission angle of pi / 2
+    float theta_o = acosf(hippt::clamp(-1.0f, 1.0f, normal_cone.cos_theta));
+    float theta_w = hippt::min(theta_o + M_PI * 0.5f, M_PI);
+    float sin_theta_o = sqrtf(hippt::max(0.0f, 1.0f - normal_cone.cos_theta * normal_cone.cos_theta));
+    float M_omega = M_TWO_PI * (1.0f - normal_cone.cos_theta)
+        + M_PI * 0.5f * (2.0f * theta_w * sin_theta_o - cosf(theta_o - 2.0f * theta_w) - 2.0f * theta_o * sin_theta_o + normal_cone.cos_theta);
+
+    // Penalizing thin boxes along the split axis
+    float split_axis_extent = parent_bounds.get_extent(split_axis);
+    float Kr = split_axis_extent > 0.0f ? parent_bounds.get_max_extent() / split_axis_extent : 1.0f;
+
+    return power * M_omega * Kr * bounds.get_surface_area();
+}
+
+void LightBVH::build(const Scene& scene)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    m_nodes.clear();
+    m_triangle_leaf_indices.assign(scene.triangle_indices.size() / 3, -1);
+    m_power_alias_table_probas.clear();
+    m_power_alias_table_alias.clear();
+
+    int emissive_triangle_count = scene.emissive_triangle_indices.size();
+    if (emissive_triangle_count == 0)
+        return;
+
+    std::vector<BuildPrimitive> primitives(emissive_triangle_count);
+    std::vector<double> powers(emissive_triangle_count);
+    double power_sum = 0.0;
+    for (int i = 0; i < emissive_triangle_count; i++)
+    {
+        int triangle_index = scene.emissive_triangle_indices[i];
+
+        float3 vertex_a = scene.vertices_positions[scene.triangle_indices[triangle_index * 3 + 0]];
+        float3 vertex_b = scene.vertices_positions[scene.triangle_indices[triangle_index * 3 + 1]];
+        float3 vertex_c = scene.vertices_positions[scene.triangle_indices[triangle_index * 3 + 2]];
+
+        float3 normal = hippt::cross(vertex_b - vertex_a, vertex_c - vertex_a);
+        float normal_length = hippt::length(normal);
+        float area = normal_length * 0.5f;
+
+        const CPUMaterial& material = scene.materials[scene.material_indices[triangle_index]];
+        float emission_luminance = (material.emission * material.emission_strength * material.global_emissive_factor).luminance();
+        if (emission_luminance <= 0.0f)
+            // Emissive textures aren't known here, assuming a unit emission
+            // so that the triangle can still be sampled
+            emission_luminance = 1.0f;
+
+        BuildPrimitive& primitive = primitives[i];
+        primitive.bounds.extend(vertex_a);
+        primitive.bounds.extend(vertex_b);
+        primitive.bounds.extend(vertex_c);
+        primitive.centroid = primitive.bounds.get_center();
+        primitive.power = emission_luminance * area;
+        primitive.triangle_index = triangle_index;
+        if (normal_length > 0.0f)
+        {
+            primitive.normal_cone.axis = normal / normal_length;
+            primitive.normal_cone.cos_theta = 1.0f;
+            primitive.normal_cone.empty = false;
+        }
+        else
+            primitive.normal_cone = DirectionCone::entire_sphere();
+
+        powers[i] = primitive.power;
+        power_sum += primitive.power;
+    }
+
+    if (power_sum <= 0.0)
+    {
+        // Only degenerate triangles, falling back to uniform sampling
+        for (int i = 0; i < emissive_triangle_count; i++)
+        {
+            primitives[i].power = 1.0f;
+            powers[i] = 1.0;
+        }
+        power_sum = emissive_triangle_count;
+    }
+
+    Utils::compute_alias_table(powers, power_sum, m_power_alias_table_probas, m_power_alias_table_alias);
+
+    // Top-down build in depth-first order. The second child of a node is pushed
+    // on the stack before its first child so that the first child is built right
+    // after its parent and ends up at the next index in the nodes array
+    m_nodes.reserve(emissive_triangle_count * 2 - 1);
+    std::vector<BuildJob> build_stack;
+    build_stack.push_back({ 0, emissive_triangle_count, -1, false });
+    while (!build_stack.empty())
+    {
+        BuildJob job = build_stack.back();
+        build_stack.pop_back();
+
+        BoundingBox node_bounds;
+        DirectionCone node_cone;
+        float node_power = 0.0f;
+        for (int i = job.start; i < job.end; i++)
+        {
+            node_bounds.extend(primitives[i].bounds);
+            node_cone = DirectionCone::merge(node_cone, primitives[i].normal_cone);
+            node_power += primitives[i].power;
+        }
+
+        int node_index = m_nodes.size();
+        if (job.is_second_child)
+            m_nodes[job.parent_index].second_child_or_triangle_index = node_index;
+
+        LightBVHNode node = {};
+        node.bounds_min = node_bounds.mini;
+        node.bounds_max = node_bounds.maxi;
+        node.power = node_power;
+        node.normals_cone_axis = node_cone.axis;
+        node.cos_theta_o = node_cone.cos_theta;
+        node.parent_index = job.parent_index;
+
+        if (job.end - job.start == 1)
+        {
+            node.is_leaf = 1;
+            node.second_child_or_triangle_index = primitives[job.start].triangle_index;
+
+            m_triangle_leaf_indices[primitives[job.start].triangle_index] = node_index;
+            m_nodes.push_back(node);
+
+            continue;
+        }
+
+        node.is_leaf = 0;
+        m_nodes.push_back(node);
+
+        int split_index = split_primitives(primitives, job.start, job.end, node_bounds);
+
+        build_stack.push_back({ split_index, job.end, node_index, true });
+        build_stack.push_back({ job.start, split_index, node_index, false });
+    }
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Light BVH built in %lldms over %d emissive triangles (%zu nodes)", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count(), emissive_triangle_count, m_nodes.size());
+}
+
+int LightBVH::split_primitives(std::vector<BuildPrimitive>& primitives, int start, int end, const BoundingBox& node_bounds)
+{
+    BoundingBox centroid_bounds;
+    for (int i = start; i < end; i++)
+        centroid_bounds.extend(primitives[i].centroid);
+
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_bin = -1;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (centroid_bounds.get_extent(axis) <= 0.0f)
+            continue;
+
+        BoundingBox bins_bounds[SAOH_BIN_COUNT];
+        DirectionCone bins_cones[SAOH_BIN_COUNT];
+        float bins_powers[SAOH_BIN_COUNT] = { 0.0f };
+        int bins_counts[SAOH_BIN_COUNT] = { 0 };
+
+        for (int i = start; i < end; i++)
+        {
+            int bin = get_centroid_bin(primitives[i].centroid, axis, centroid_bounds);
+
+            bins_bounds[bin].extend(primitives[i].bounds);
+            bins_cones[bin] = DirectionCone::merge(bins_cones[bin], primitives[i].normal_cone);
+            bins_powers[bin] += primitives[i].power;
+            bins_counts[bin]++;
+        }
+
+        // Sweeping from the right to get the cost of the right side of each split
+        float right_costs[SAOH_BIN_COUNT - 1];
+        int right_counts[SAOH_BIN_COUNT - 1];
+        BoundingBox right_bounds;
+        DirectionCone right_cone;
+        float right_power = 0.0f;
+        int right_count = 0;
+        for (int bin = SAOH_BIN_COUNT - 1; bin > 0; bin--)
+        {
+            right_bounds.extend(bins_bounds[bin]);
+            right_cone = DirectionCone::merge(right_cone, bins_cones[bin]);
+            right_power += bins_powers[bin];
+            right_count += bins_counts[bin];
+
+            right_counts[bin - 1] = right_count;
+
+            right_costs[bin - 1] = get_SAOH_cost(right_bounds, right_cone, right_power, node_bounds, axis);
+        }
+
+        BoundingBox left_bounds;
+        DirectionCone left_cone;
+        float left_power = 0.0f;
+        int left_count = 0;
+        for (int bin = 0; bin < SAOH_BIN_COUNT - 1; bin++)
+        {
+            left_bounds.extend(bins_bounds[bin]);
+            left_cone = DirectionCone::merge(left_cone, bins_cones[bin]);
+            left_power += bins_powers[bin];
+            left_count += bins_counts[bin];
+
+            if (left_count == 0 || right_counts[bin] == 0)
+                // One of the sides would be empty
+                continue;
+
+            float cost = get_SAOH_cost(left_bounds, left_cone, left_power, node_bounds, axis) + right_costs[bin];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = bin;
+            }
+        }
+    }
+
+    int split_index = -1;
+    if (best_axis != -1)
+    {
+        auto first_right = std::partition(primitives.begin() + start, primitives.begin() + end, [best_axis, best_bin, &centroid_bounds](const BuildPrimitive& primitive)
+        {
+            return get_centroid_bin(primitive.centroid, best_axis, centroid_bounds) <= best_bin;
+        });
+
+        split_index = static_cast<int>(first_right - primitives.begin());
+    }
+
+    if (split_index <= start || split_index >= end)
+    {
+        // No usable split found (all the centroids at the same position for example),
+        // splitting in the middle of the longest axis
+        int longest_axis = 0;
+        for (int axis = 1; axis < 3; axis++)
+            if (node_bounds.get_extent(axis) > node_bounds.get_extent(longest_axis))
+                longest_axis = axis;
+
+        split_index = (start + end) / 2;
+        std::nth_element(primitives.begin() + start, primitives.begin() + split_index, primitives.begin() + end, [longest_axis](const BuildPrimitive& a, const BuildPrimitive& b)
+        {
+            return get_axis(a.centroid, longest_axis) < get_axis(b.centroid, longest_axis);
+        });
+    }
+
+    return split_index;
+}
+
+LightBVHDevice LightBVH::get_host_device_data()
+{
+    LightBVHDevice light_bvh;
+    light_bvh.nodes = m_nodes.data();
+    light_bvh.triangle_leaf_indices = m_triangle_leaf_indices.data();
+
+    return light_bvh;
+}
+
+const std::vector<LightBVHNode>& LightBVH::get_nodes() const
+{
+    return m_nodes;
+}
+
+const std::vector<int>& LightBVH::get_triangle_leaf_indices() const
+{
+    return m_triangle_leaf_indices;
+}
+
+std::vector<float>& LightBVH::get_power_alias_table_probas()
+{
+    return m_power_alias_table_probas;
+}
+
+std::vector<int>& LightBVH::get_power_alias_table_alias()
+{
+    return m_power_alias_table_alias;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include "Device/includes/LightBVH/LightBVHDevice.h"
+#include "Scene/BoundingBox.h"
+
+#include <vector>
+
+struct Scene;
+
+/**
+ * Host side construction of the data structures used for
+ * importance sampling the emissive triangles of the scene:
+ * 
+ *	- the light BVH used by DirectLightSamplingBaseStrategy == LSS_BASE_LIGHT_BVH
+ *	- the alias table for picking the triangles proportionally to their power (LSS_BASE_POWER)
+ * 
+ * The light BVH is built top-down with the binned SAOH (surface area orientation heuristic) of
+ * [Importance Sampling of Many Lights with Adaptive Tree Splitting, Conty Estevez, Kulla, 2018].
+ * There is one emissive triangle per leaf.
+ */
+class LightBVH
+{
+public:
+    static constexpr int SAOH_BIN_COUNT = 12;
+
+    void build(const Scene& scene);
+
+    /**
+     * Returns the light BVH with pointers to the host buffers of this instance.
+     * Only usable by the CPU renderer
+     */
+    LightBVHDevice get_host_device_data();
+
+    const std::vector<LightBVHNode>& get_nodes() const;
+    const std::vector<int>& get_triangle_leaf_indices() const;
+    std::vector<float>& get_power_alias_table_probas();
+    std::vector<int>& get_power_alias_table_alias();
+
+private:
+    /**
+     * Cone of directions used to bound the normals of the emissive triangles
+     */
+    struct DirectionCone
+    {
+        static DirectionCone entire_sphere();
+        static DirectionCone merge(const DirectionCone& a, const DirectionCone& b);
+
+        bool is_empty() const;
+
+        float3 axis = { 0.0f, 0.0f, 0.0f };
+        float cos_theta = 1.0f;
+        bool empty = true;
+    };
+
+    struct BuildPrimitive
+    {
+        BoundingBox bounds;
+        float3 centroid;
+        DirectionCone normal_cone;
+        float power;
+        int triangle_index;
+    };
+
+    struct BuildJob
+    {
+        int start;
+        int end;
+        int parent_index;
+        bool is_second_child;
+    };
+
+    /**
+     * Cost of a node with the given bounds, normals and power as defined
+     * by the SAOH. 'split_axis' is the axis along which the parent is split
+     */
+    static float get_SAOH_cost(const BoundingBox& bounds, const DirectionCone& normal_cone, float power, const BoundingBox& parent_bounds, int split_axis);
+
+    /**
+     * Partitions the primitives in [start, end) and returns the index of
+     * the first primitive of the second child
+     */
+    int split_primitives(std::vector<BuildPrimitive>& primitives, int start, int end, const BoundingBox& node_bounds);
+
+    std::vector<LightBVHNode> m_nodes;
+    std::vector<int> m_triangle_leaf_indices;
+
+    std::vector<float> m_power_alias_table_probas;
+    std::vector<int> m_power_alias_table_alias;
+};
+
+#endif
@@ -5,7 +5,7 @@
 
 #include "GMoNRenderPass.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
 
 const std::string GMoNRenderPass::COMPUTE_GMON_KERNEL = "GMoN Compute Kernel";
 
@@ -22,12 +22,16 @@ GMoNRenderPass::GMoNRenderPass(GPURenderer* renderer) : GMoNRenderPass()
 	m_kernels[GMoNRenderPass::COMPUTE_GMON_KERNEL].synchronize_options_with(*renderer->get_global_compiler_options(), {});
 }
 
-void GMoNRenderPass::compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx)
+TaskHandle GMoNRenderPass::compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx)
 {
 	if (!use_gmon())
-		return;
+		return nullptr;
+
+	GPUKernel& gmon_kernel = m_kernels[GMoNRenderPass::COMPUTE_GMON_KERNEL];
 
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel_no_func_sets, std::ref(m_kernels[GMoNRenderPass::COMPUTE_GMON_KERNEL]), hiprt_orochi_ctx);
+	return g_task_scheduler.submit([&gmon_kernel, hiprt_orochi_ctx]() {
+		ThreadFunctions::compile_kernel_no_func_sets(gmon_kernel, hiprt_orochi_ctx);
+	});
 }
 
 void GMoNRenderPass::recompile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, bool silent, bool use_cache)
@@ -63,6 +67,12 @@ void GMoNRenderPass::launch(std::shared_ptr<ApplicationSettings> application_set
 		// If we have rendered enough samples that one more sample has been accumulated in each of the
 		// GMoN sets
 		int2 render_resolution = m_renderer->m_render_resolution;
+
+		// For only rescaling the median of means of the tiles that didn't receive samples since the last recomputation
+		GMoNDevice& gmon_estimator = m_renderer->get_render_data().buffers.gmon_estimator;
+		gmon_estimator.last_recomputation_sample_count = sample_0 ? 0 : m_gmon.last_recomputed_sample_count;
+		gmon_estimator.recomputation_sample_count = m_renderer->get_render_settings().sample_number + 1;
+
 		void* launch_args[] = { &m_renderer->get_render_data() };
 
 		m_kernels[GMoNRenderPass::COMPUTE_GMON_KERNEL].launch_asynchronous(
@@ -174,7 +184,10 @@ void GMoNRenderPass::reset()
 		m_renderer->get_render_data().buffers.gmon_estimator.next_set_to_accumulate = 0;
 
 		if (buffers_allocated())
+		{
 			m_gmon.sets.memset_whole_buffer(0);
+			m_gmon.tile_sample_counts.memset_whole_buffer(0);
+		}
 
 		// Requesting a computation on reset just so that we copy the very
 		// first sample to the framebuffer to avoid having a black viewport
@@ -188,11 +201,16 @@ std::shared_ptr<OpenGLInteropBuffer<ColorRGB32F>> GMoNRenderPass::get_result_fra
 	return m_gmon.result_framebuffer;
 }
 
-ColorRGB32F* GMoNRenderPass::get_sets_buffers_device_pointer()
+GMoNSet* GMoNRenderPass::get_sets_buffers_device_pointer()
 {
 	return m_gmon.sets.get_device_pointer();
 }
 
+unsigned int* GMoNRenderPass::get_tile_sample_counts_device_pointer()
+{
+	return m_gmon.tile_sample_counts.get_device_pointer();
+}
+
 unsigned int GMoNRenderPass::get_number_of_sets_used()
 {
 	return m_kernels[GMoNRenderPass::COMPUTE_GMON_KERNEL].get_kernel_options().get_macro_value(GPUKernelCompilerOptions::GMON_M_SETS_COUNT);
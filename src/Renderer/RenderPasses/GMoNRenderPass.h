@@ -10,6 +10,7 @@
 #include "HIPRT-Orochi/HIPRTOrochiCtx.h"
 #include "HostDeviceCommon/RenderData.h"
 #include "Renderer/GPUDataStructures/GMoNGPUData.h"
+#include "Threads/TaskScheduler.h"
 #include "UI/ApplicationSettings.h"
 
 class GMoNRenderPass
@@ -20,7 +21,11 @@ public:
 	GMoNRenderPass();
 	GMoNRenderPass(GPURenderer* renderer);
 
-	void compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx);
+	/**
+	 * Starts the compilation of the kernel of the render pass.
+	 * Returns nullptr if GMoN isn't used
+	 */
+	TaskHandle compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx);
 	void recompile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, bool silent, bool use_cache);
 
 	void launch(std::shared_ptr<ApplicationSettings> application_settings);
@@ -47,7 +52,8 @@ public:
 	void reset();
 
 	std::shared_ptr<OpenGLInteropBuffer<ColorRGB32F>> get_result_framebuffer();
-	ColorRGB32F* get_sets_buffers_device_pointer();
+	GMoNSet* get_sets_buffers_device_pointer();
+	unsigned int* get_tile_sample_counts_device_pointer();
 	unsigned int get_number_of_sets_used();
 
 	void resize_interop_buffers(unsigned int new_width, unsigned int new_height);
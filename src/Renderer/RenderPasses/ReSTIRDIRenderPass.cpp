@@ -3,10 +3,13 @@
  * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
  */
 
+#include "Compiler/GPUKernelCompiler.h"
 #include "Renderer/GPURenderer.h"
 #include "Renderer/RenderPasses/ReSTIRDIRenderPass.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
+
+extern GPUKernelCompiler g_gpu_kernel_compiler;
 
 const std::string ReSTIRDIRenderPass::RESTIR_DI_INITIAL_CANDIDATES_KERNEL_ID = "ReSTIR DI Initial Candidates";
 const std::string ReSTIRDIRenderPass::RESTIR_DI_TEMPORAL_REUSE_KERNEL_ID = "ReSTIR DI Temporal Reuse";
@@ -70,13 +73,19 @@ ReSTIRDIRenderPass::ReSTIRDIRenderPass(GPURenderer* renderer) : m_renderer(rende
 	m_kernels[ReSTIRDIRenderPass::RESTIR_DI_LIGHTS_PRESAMPLING_KERNEL_ID].get_kernel_options().set_macro_value(GPUKernelCompilerOptions::SHARED_STACK_BVH_TRAVERSAL_SIZE, 0);
 }
 
-void ReSTIRDIRenderPass::compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, std::vector<hiprtFuncNameSet>& func_name_sets)
+std::vector<TaskHandle> ReSTIRDIRenderPass::compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, std::vector<hiprtFuncNameSet>& func_name_sets)
 {
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel, std::ref(m_kernels[ReSTIRDIRenderPass::RESTIR_DI_INITIAL_CANDIDATES_KERNEL_ID]), hiprt_orochi_ctx, std::ref(func_name_sets));
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel, std::ref(m_kernels[ReSTIRDIRenderPass::RESTIR_DI_TEMPORAL_REUSE_KERNEL_ID]), hiprt_orochi_ctx, std::ref(func_name_sets));
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel, std::ref(m_kernels[ReSTIRDIRenderPass::RESTIR_DI_SPATIAL_REUSE_KERNEL_ID]), hiprt_orochi_ctx, std::ref(func_name_sets));
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel, std::ref(m_kernels[ReSTIRDIRenderPass::RESTIR_DI_SPATIOTEMPORAL_REUSE_KERNEL_ID]), hiprt_orochi_ctx, std::ref(func_name_sets));
-	ThreadManager::start_thread(ThreadManager::COMPILE_KERNELS_THREAD_KEY, ThreadFunctions::compile_kernel, std::ref(m_kernels[ReSTIRDIRenderPass::RESTIR_DI_LIGHTS_PRESAMPLING_KERNEL_ID]), hiprt_orochi_ctx, std::ref(func_name_sets));
+	std::vector<TaskHandle> compilation_tasks;
+	for (auto& name_to_kernel : m_kernels)
+	{
+		GPUKernel& kernel = name_to_kernel.second;
+
+		compilation_tasks.push_back(g_task_scheduler.submit([&kernel, hiprt_orochi_ctx, &func_name_sets]() {
+			ThreadFunctions::compile_kernel(kernel, hiprt_orochi_ctx, func_name_sets);
+		}));
+	}
+
+	return compilation_tasks;
 }
 
 void ReSTIRDIRenderPass::recompile(std::shared_ptr<HIPRTOrochiCtx>& hiprt_orochi_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets, bool silent, bool use_cache)
@@ -92,44 +101,17 @@ void ReSTIRDIRenderPass::recompile(std::shared_ptr<HIPRTOrochiCtx>& hiprt_orochi
 
 void ReSTIRDIRenderPass::precompile_kernels(GPUKernelCompilerOptions partial_options, std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets)
 {
-	GPUKernelCompilerOptions options;
-
-	options = m_kernels[ReSTIRDIRenderPass::RESTIR_DI_LIGHTS_PRESAMPLING_KERNEL_ID].get_kernel_options().deep_copy();
-	partial_options.apply_onto(options);
-	ThreadManager::start_thread(ThreadManager::RESTIR_DI_PRECOMPILE_KERNELS, ThreadFunctions::precompile_kernel,
-		ReSTIRDIRenderPass::KERNEL_FUNCTION_NAMES.at(ReSTIRDIRenderPass::RESTIR_DI_LIGHTS_PRESAMPLING_KERNEL_ID),
-		ReSTIRDIRenderPass::KERNEL_FILES.at(ReSTIRDIRenderPass::RESTIR_DI_LIGHTS_PRESAMPLING_KERNEL_ID),
-		options, hiprt_orochi_ctx, std::ref(func_name_sets));
-
-	options = m_kernels[ReSTIRDIRenderPass::RESTIR_DI_INITIAL_CANDIDATES_KERNEL_ID].get_kernel_options().deep_copy();
-	partial_options.apply_onto(options);
-	ThreadManager::start_thread(ThreadManager::RESTIR_DI_PRECOMPILE_KERNELS, ThreadFunctions::precompile_kernel,
-		ReSTIRDIRenderPass::KERNEL_FUNCTION_NAMES.at(ReSTIRDIRenderPass::RESTIR_DI_INITIAL_CANDIDATES_KERNEL_ID),
-		ReSTIRDIRenderPass::KERNEL_FILES.at(ReSTIRDIRenderPass::RESTIR_DI_INITIAL_CANDIDATES_KERNEL_ID),
-		options, hiprt_orochi_ctx, std::ref(func_name_sets));
-
-	options = m_kernels[ReSTIRDIRenderPass::RESTIR_DI_SPATIAL_REUSE_KERNEL_ID].get_kernel_options().deep_copy();
-	partial_options.apply_onto(options);
-	ThreadManager::start_thread(ThreadManager::RESTIR_DI_PRECOMPILE_KERNELS, ThreadFunctions::precompile_kernel,
-		ReSTIRDIRenderPass::KERNEL_FUNCTION_NAMES.at(ReSTIRDIRenderPass::RESTIR_DI_SPATIAL_REUSE_KERNEL_ID),
-		ReSTIRDIRenderPass::KERNEL_FILES.at(ReSTIRDIRenderPass::RESTIR_DI_SPATIAL_REUSE_KERNEL_ID),
-		options, hiprt_orochi_ctx, std::ref(func_name_sets));
-
-	options = m_kernels[ReSTIRDIRenderPass::RESTIR_DI_TEMPORAL_REUSE_KERNEL_ID].get_kernel_options().deep_copy();
-	partial_options.apply_onto(options);
-	ThreadManager::start_thread(ThreadManager::RESTIR_DI_PRECOMPILE_KERNELS, ThreadFunctions::precompile_kernel,
-		ReSTIRDIRenderPass::KERNEL_FUNCTION_NAMES.at(ReSTIRDIRenderPass::RESTIR_DI_TEMPORAL_REUSE_KERNEL_ID),
-		ReSTIRDIRenderPass::KERNEL_FILES.at(ReSTIRDIRenderPass::RESTIR_DI_TEMPORAL_REUSE_KERNEL_ID),
-		options, hiprt_orochi_ctx, std::ref(func_name_sets));
-
-	options = m_kernels[ReSTIRDIRenderPass::RESTIR_DI_SPATIOTEMPORAL_REUSE_KERNEL_ID].get_kernel_options().deep_copy();
-	partial_options.apply_onto(options);
-	ThreadManager::start_thread(ThreadManager::RESTIR_DI_PRECOMPILE_KERNELS, ThreadFunctions::precompile_kernel,
-		ReSTIRDIRenderPass::KERNEL_FUNCTION_NAMES.at(ReSTIRDIRenderPass::RESTIR_DI_SPATIOTEMPORAL_REUSE_KERNEL_ID),
-		ReSTIRDIRenderPass::KERNEL_FILES.at(ReSTIRDIRenderPass::RESTIR_DI_SPATIOTEMPORAL_REUSE_KERNEL_ID),
-		options, hiprt_orochi_ctx, std::ref(func_name_sets));
-
-	ThreadManager::detach_threads(ThreadManager::RESTIR_DI_PRECOMPILE_KERNELS);
+	for (const std::string& kernel_id : { ReSTIRDIRenderPass::RESTIR_DI_LIGHTS_PRESAMPLING_KERNEL_ID,
+										   ReSTIRDIRenderPass::RESTIR_DI_INITIAL_CANDIDATES_KERNEL_ID,
+										   ReSTIRDIRenderPass::RESTIR_DI_SPATIAL_REUSE_KERNEL_ID,
+										   ReSTIRDIRenderPass::RESTIR_DI_TEMPORAL_REUSE_KERNEL_ID,
+										   ReSTIRDIRenderPass::RESTIR_DI_SPATIOTEMPORAL_REUSE_KERNEL_ID })
+	{
+		GPUKernelCompilerOptions options = m_kernels[kernel_id].get_kernel_options().deep_copy();
+		partial_options.apply_onto(options);
+
+		g_gpu_kernel_compiler.precompile_kernel(ReSTIRDIRenderPass::KERNEL_FUNCTION_NAMES.at(kernel_id), ReSTIRDIRenderPass::KERNEL_FILES.at(kernel_id), options, hiprt_orochi_ctx, func_name_sets);
+	}
 }
 
 void ReSTIRDIRenderPass::pre_render_update()
@@ -283,6 +265,9 @@ LightPresamplingParameters ReSTIRDIRenderPass::configure_light_presampling_pass(
 	 */
 	parameters.emissive_triangles_count = render_data->buffers.emissive_triangles_count;
 	parameters.emissive_triangles_indices = render_data->buffers.emissive_triangles_indices;
+	parameters.emissive_power_alias_table_probas = render_data->buffers.emissive_power_alias_table_probas;
+	parameters.emissive_power_alias_table_alias = render_data->buffers.emissive_power_alias_table_alias;
+	parameters.light_bvh = render_data->buffers.light_bvh;
 	parameters.triangles_indices = render_data->buffers.triangles_indices;
 	parameters.vertices_positions = render_data->buffers.vertices_positions;
 	parameters.material_indices = render_data->buffers.material_indices;
@@ -10,6 +10,7 @@
 #include "Device/includes/ReSTIR/DI/PresampledLight.h"
 #include "HIPRT-Orochi/OrochiBuffer.h"
 #include "HostDeviceCommon/RenderData.h"
+#include "Threads/TaskScheduler.h"
 #include "UI/PerformanceMetricsComputer.h"
 
 class GPURenderer;
@@ -47,7 +48,11 @@ public:
 	ReSTIRDIRenderPass() {}
 	ReSTIRDIRenderPass(GPURenderer* renderer);
 
-	void compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, std::vector<hiprtFuncNameSet>& func_name_sets);
+	/**
+	 * Starts the compilation of the kernels of the render pass.
+	 * Returns the compilation tasks, one per kernel
+	 */
+	std::vector<TaskHandle> compile(std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, std::vector<hiprtFuncNameSet>& func_name_sets);
 	void recompile(std::shared_ptr<HIPRTOrochiCtx>& hiprt_orochi_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets, bool silent = false, bool use_cache = true);
 	/**
 	 * Precompiles all kernels of this render pass to fill to shader cache in advance.
@@ -4,12 +4,16 @@
  */
 
 #include "Image/Image.h"
+#include "Renderer/EnvmapGuidedCDF.h"
 #include "Renderer/GPURenderer.h"
 #include "Renderer/RendererEnvmap.h"
+#include "UI/ImGui/ImGuiLogger.h"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include "glm/gtx/euler_angles.hpp"
 
+extern ImGuiLogger g_imgui_logger;
+
 void RendererEnvmap::init_from_image(const Image32Bit& image, const std::string& envmap_filepath)
 {
 	m_envmap_data.pack_from(image);
@@ -21,6 +25,10 @@ void RendererEnvmap::init_from_image(const Image32Bit& image, const std::string&
 
 void RendererEnvmap::update(GPURenderer* renderer, float delta_time)
 {
+	if (m_sampling_strategy_fell_back.exchange(false))
+		// The kernels were compiled for the guided CDF sampling strategy
+		renderer->recompile_kernels();
+
 	do_animation(renderer, delta_time);
 
 	// Updates the data/pointers in WorldSettings that the shaders will use
@@ -34,11 +42,13 @@ void RendererEnvmap::recompute_sampling_data_structure(GPURenderer* renderer, co
 		m_cdf.free();
 		m_alias_table_alias.free();
 		m_alias_table_probas.free();
+		free_guided_cdf();
 	}
 	else if (renderer->get_global_compiler_options()->get_macro_value(GPUKernelCompilerOptions::ENVMAP_SAMPLING_STRATEGY) == ESS_BINARY_SEARCH)
 	{
 		m_alias_table_alias.free();
 		m_alias_table_probas.free();
+		free_guided_cdf();
 
 		recompute_CDF(image);
 	}
@@ -46,9 +56,31 @@ void RendererEnvmap::recompute_sampling_data_structure(GPURenderer* renderer, co
 	{
 		if (m_cdf.get_element_count() > 0)
 			m_cdf.free();
+		free_guided_cdf();
 
 		recompute_alias_table(image);
 	}
+	else if (renderer->get_global_compiler_options()->get_macro_value(GPUKernelCompilerOptions::ENVMAP_SAMPLING_STRATEGY) == ESS_GUIDED_CDF)
+	{
+		if (m_cdf.get_element_count() > 0)
+			m_cdf.free();
+		if (m_alias_table_probas.get_element_count() > 0)
+		{
+			m_alias_table_alias.free();
+			m_alias_table_probas.free();
+		}
+
+		if (!recompute_guided_cdf(image))
+		{
+			// The kernels would sample empty guided CDF buffers so falling back to the alias table
+			g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Falling back to the alias table envmap sampling strategy.");
+
+			renderer->get_global_compiler_options()->set_macro_value(GPUKernelCompilerOptions::ENVMAP_SAMPLING_STRATEGY, ESS_ALIAS_TABLE);
+			recompute_alias_table(image);
+
+			m_sampling_strategy_fell_back = true;
+		}
+	}
 }
 
 void RendererEnvmap::recompute_CDF(const Image32Bit* image)
@@ -89,6 +121,51 @@ void RendererEnvmap::recompute_alias_table(const Image32Bit* image)
 	m_alias_table_alias.upload_data(alias);
 }
 
+bool RendererEnvmap::recompute_guided_cdf(const Image32Bit* image)
+{
+	EnvmapGuidedCDF guided_cdf;
+	bool built;
+	if (image != nullptr)
+		built = guided_cdf.build(*image);
+	else
+	{
+		if (m_envmap_filepath.ends_with(".exr"))
+			built = guided_cdf.build(Image32Bit::read_image_exr(m_envmap_filepath, true));
+		else
+			built = guided_cdf.build(Image32Bit::read_image_hdr(m_envmap_filepath, 4, true));
+	}
+
+	if (!built)
+		// The error has already been logged
+		return false;
+
+	m_guided_marginal_cdf.resize(guided_cdf.get_marginal_cdf().size());
+	m_guided_marginal_cdf.upload_data(guided_cdf.get_marginal_cdf());
+	m_guided_marginal_guide.resize(guided_cdf.get_marginal_guide().size());
+	m_guided_marginal_guide.upload_data(guided_cdf.get_marginal_guide());
+	m_guided_conditional_cdfs.resize(guided_cdf.get_conditional_cdfs().size());
+	m_guided_conditional_cdfs.upload_data(guided_cdf.get_conditional_cdfs());
+	m_guided_conditional_guides.resize(guided_cdf.get_conditional_guides().size());
+	m_guided_conditional_guides.upload_data(guided_cdf.get_conditional_guides());
+	m_guided_conditional_guide_size = guided_cdf.get_conditional_guide_size();
+
+	m_luminance_total_sum = guided_cdf.get_luminance_total_sum();
+
+	return true;
+}
+
+void RendererEnvmap::free_guided_cdf()
+{
+	if (m_guided_marginal_cdf.get_element_count() == 0)
+		return;
+
+	m_guided_marginal_cdf.free();
+	m_guided_marginal_guide.free();
+	m_guided_conditional_cdfs.free();
+	m_guided_conditional_guides.free();
+	m_guided_conditional_guide_size = 0;
+}
+
 RGBE9995Packed* RendererEnvmap::get_packed_data_pointer()
 {
 	return m_envmap_data.get_data_pointer();
@@ -105,6 +182,18 @@ float* RendererEnvmap::get_cdf_device_pointer()
 	return m_cdf.get_device_pointer();
 }
 
+EnvmapGuidedCDFDevice RendererEnvmap::get_guided_cdf_device_data()
+{
+	EnvmapGuidedCDFDevice guided_cdf;
+	guided_cdf.marginal_cdf = m_guided_marginal_cdf.get_device_pointer();
+	guided_cdf.marginal_guide = m_guided_marginal_guide.get_device_pointer();
+	guided_cdf.conditional_cdfs = m_guided_conditional_cdfs.get_device_pointer();
+	guided_cdf.conditional_guides = m_guided_conditional_guides.get_device_pointer();
+	guided_cdf.conditional_guide_size = m_guided_conditional_guide_size;
+
+	return guided_cdf;
+}
+
 unsigned int RendererEnvmap::get_width() { return m_width; }
 unsigned int RendererEnvmap::get_height() { return m_height; }
 
@@ -187,4 +276,15 @@ void RendererEnvmap::update_renderer(GPURenderer* renderer)
 		world_settings.alias_table_probas = m_alias_table_probas.get_device_pointer();
 		world_settings.alias_table_alias = m_alias_table_alias.get_device_pointer();
 	}
+	else if (renderer->get_global_compiler_options()->get_macro_value(GPUKernelCompilerOptions::ENVMAP_SAMPLING_STRATEGY) == ESS_GUIDED_CDF)
+	{
+		world_settings.envmap_cdf = nullptr;
+		world_settings.envmap_total_sum = m_luminance_total_sum;
+
+		world_settings.alias_table_probas = nullptr;
+		world_settings.alias_table_alias = nullptr;
+	}
+
+	// Null pointers if the guided CDF isn't used
+	world_settings.envmap_guided_cdf = get_guided_cdf_device_data();
 }
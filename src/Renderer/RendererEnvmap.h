@@ -6,8 +6,11 @@
 #ifndef RENDERER_ENVMAP_H
 #define RENDERER_ENVMAP_H
 
+#include "Device/includes/EnvmapGuidedCDF/EnvmapGuidedCDFDevice.h"
 #include "Image/EnvmapRGBE9995.h"
 
+#include <atomic>
+
 class GPURenderer;
 
 class RendererEnvmap
@@ -37,21 +40,26 @@ public:
 	/**
 	 * - Updates the animation of the envmap
 	 * - Recomputes the sampling data structure (CDF for binary search sampling, 
-	 *		alias table for alias table sampling) if necessary
+	 *		alias table for alias table sampling, guided CDF for guided CDF sampling) if necessary
 	 */
 	void update(GPURenderer* renderer, float delta_time);
 
 	/**
-	 * Computes the CDF or alias table of the envmap based of the envmap sampling strategy used
+	 * Computes the CDF, alias table or guided CDF of the envmap based of the envmap sampling strategy used
 	 * by the renderer.
 	 * 
 	 * The data structure that is unused will also be freed to free some VRAM.
+	 * 
+	 * If the guided CDF cannot be built for the envmap (too wide for example), the sampling
+	 * strategy of the renderer falls back to the alias table and the kernels are recompiled
+	 * on the next call to update()
 	 */
 	void recompute_sampling_data_structure(GPURenderer* renderer, const Image32Bit* = nullptr);
 
 	RGBE9995Packed* get_packed_data_pointer();
 	void get_alias_table_device_pointers(float*& out_probas_pointer, int*& out_alias_pointer);
 	float* get_cdf_device_pointer();
+	EnvmapGuidedCDFDevice get_guided_cdf_device_data();
 
 	unsigned int get_width();
 	unsigned int get_height();
@@ -59,6 +67,11 @@ public:
 private:
 	void recompute_CDF(const Image32Bit* image);
 	void recompute_alias_table(const Image32Bit* image);
+	/**
+	 * Returns false if the guided CDF couldn't be built for the envmap
+	 */
+	bool recompute_guided_cdf(const Image32Bit* image);
+	void free_guided_cdf();
 
 	/**
 	 * Recomputes the envmap matrices if necessary based on
@@ -96,7 +109,17 @@ private:
 	OrochiBuffer<float> m_cdf;
 	OrochiBuffer<float> m_alias_table_probas;
 	OrochiBuffer<int> m_alias_table_alias;
+	// Marginal / conditional CDFs and their guide tables for the guided CDF sampling strategy
+	OrochiBuffer<float> m_guided_marginal_cdf;
+	OrochiBuffer<unsigned int> m_guided_marginal_guide;
+	OrochiBuffer<unsigned short> m_guided_conditional_cdfs;
+	OrochiBuffer<unsigned int> m_guided_conditional_guides;
+	unsigned int m_guided_conditional_guide_size = 0;
 	float m_luminance_total_sum = 0.0f;
+
+	// Set when the guided CDF sampling strategy fell back to the alias table.
+	// recompute_sampling_data_structure() may run on another thread than update()
+	std::atomic<bool> m_sampling_strategy_fell_back = false;
 };
 
 #endif
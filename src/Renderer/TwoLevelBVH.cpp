@@ -0,0 +1,228 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Device/functions/FilterFunctionPayload.h"
+#include "Renderer/CPUProfiler.h"
+#include "Renderer/TwoLevelBVH.h"
+#include "UI/ImGui/ImGuiLogger.h"
+
+#include <chrono>
+
+extern ImGuiLogger g_imgui_logger;
+
+void TwoLevelBVH::build(const std::vector<Triangle>& triangles, const std::vector<int>& mesh_triangle_offsets, const std::vector<SceneInstance>& instances, CPUSIMDLevel max_simd_level)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int mesh_count = hippt::max(0, static_cast<int>(mesh_triangle_offsets.size()) - 1);
+
+    m_blases.clear();
+    m_blases.resize(mesh_count);
+
+    // One mesh after the other, each BLAS build uses all the threads
+    for (int mesh_index = 0; mesh_index < mesh_count; mesh_index++)
+    {
+        int first_triangle = mesh_triangle_offsets[mesh_index];
+        int last_triangle = mesh_triangle_offsets[mesh_index + 1];
+
+        std::vector<Triangle> mesh_triangles(triangles.begin() + first_triangle, triangles.begin() + last_triangle);
+        m_blases[mesh_index].build(mesh_triangles, max_simd_level, first_triangle, /* log_statistics */ false);
+    }
+
+    m_instances.clear();
+    m_instances.resize(instances.size());
+    for (int instance_index = 0; instance_index < instances.size(); instance_index++)
+    {
+        m_instances[instance_index].mesh_index = instances[instance_index].mesh_index;
+
+        set_instance_transform(instance_index, instances[instance_index].object_to_world);
+    }
+
+    rebuild_tlas();
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "CPU two-level BVH built in %lldms: %d BLASes, %zu instances, %zu nodes", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count(), mesh_count, m_instances.size(), get_node_count());
+}
+
+void TwoLevelBVH::set_instance_transform(int instance_index, const float4x4& object_to_world)
+{
+    TwoLevelBVHInstance& instance = m_instances[instance_index];
+
+    instance.object_to_world = object_to_world;
+    instance.world_to_object = affine_matrix_inverse(object_to_world);
+    instance.normal_to_world = affine_normal_matrix(instance.world_to_object);
+
+    instance.is_identity = true;
+    float4x4 identity = identity_affine_matrix();
+    for (int row = 0; row < 4; row++)
+        for (int column = 0; column < 4; column++)
+            instance.is_identity &= object_to_world.m[row][column] == identity.m[row][column];
+
+    update_instance_world_bounds(instance_index);
+}
+
+void TwoLevelBVH::refit_mesh(int mesh_index, const std::vector<Triangle>& triangles)
+{
+    m_blases[mesh_index].refit(triangles);
+
+    for (int instance_index = 0; instance_index < m_instances.size(); instance_index++)
+        if (m_instances[instance_index].mesh_index == mesh_index)
+            update_instance_world_bounds(instance_index);
+}
+
+void TwoLevelBVH::rebuild_tlas()
+{
+    std::vector<BoundingBox> instances_bounds;
+    m_tlas_instance_indices.clear();
+    for (int instance_index = 0; instance_index < m_instances.size(); instance_index++)
+    {
+        if (m_blases[m_instances[instance_index].mesh_index].get_nodes().empty())
+            continue;
+
+        instances_bounds.push_back(m_instances[instance_index].world_bounds);
+        m_tlas_instance_indices.push_back(instance_index);
+    }
+
+    m_tlas.build_from_bounding_boxes(instances_bounds);
+}
+
+void TwoLevelBVH::update_instance_world_bounds(int instance_index)
+{
+    TwoLevelBVHInstance& instance = m_instances[instance_index];
+    instance.world_bounds = BoundingBox();
+
+    const std::vector<FlattenedBVHNode>& blas_nodes = m_blases[instance.mesh_index].get_nodes();
+    if (blas_nodes.empty())
+        return;
+
+    // Bounds of the 8 transformed corners of the bounds of the BLAS
+    const FlattenedBVHNode& root = blas_nodes[0];
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float3 object_corner = make_float3(corner & 1 ? root.aabb_max.x : root.aabb_min.x,
+                                           corner & 2 ? root.aabb_max.y : root.aabb_min.y,
+                                           corner & 4 ? root.aabb_max.z : root.aabb_min.z);
+
+        instance.world_bounds.extend(matrix_X_point(instance.object_to_world, object_corner));
+    }
+}
+
+bool TwoLevelBVH::intersect_instance(int instance_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const
+{
+    const TwoLevelBVHInstance& instance = m_instances[instance_index];
+
+    hiprtRay object_ray = ray;
+    if (!instance.is_identity)
+    {
+        // The direction isn't normalized so that the distances
+        // along the ray are the same in object and world space
+        object_ray.origin = matrix_X_point(instance.world_to_object, ray.origin);
+        object_ray.direction = affine_matrix_X_vec(instance.world_to_object, ray.direction);
+    }
+
+    // The hits of the BLAS do not know their instance, the filter function
+    // reads it from the payload to discard the self intersections
+    reinterpret_cast<FilterFunctionPayload*>(filter_function_payload)->traversed_instance_id = instance_index;
+
+    hiprtHit instance_hit;
+    if (!m_blases[instance.mesh_index].intersect(object_ray, instance_hit, closest_t, filter_function_payload))
+        return false;
+
+    if (!instance.is_identity)
+        instance_hit.normal = affine_matrix_X_vec(instance.normal_to_world, instance_hit.normal);
+    instance_hit.instanceID = instance_index;
+
+    hit_info = instance_hit;
+
+    return true;
+}
+
+bool TwoLevelBVH::intersect(const hiprtRay& ray, hiprtHit& hit_info, void* filter_function_payload) const
+{
+    const std::vector<FlattenedBVHNode>& tlas_nodes = m_tlas.get_nodes();
+    if (tlas_nodes.empty())
+        return false;
+
+    CPUProfilerTraversalCounters profiler_counters;
+    profiler_counters.trace_rays(1);
+
+    const std::vector<int>& tlas_primitive_indices = m_tlas.get_primitive_indices();
+
+    float3 inverse_direction = make_float3(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    bool direction_is_negative[3] = { inverse_direction.x < 0.0f, inverse_direction.y < 0.0f, inverse_direction.z < 0.0f };
+
+    float closest_t = ray.maxT;
+    bool hit_found = false;
+
+    int stack[BVHConstants::FLATTENED_BVH_MAX_STACK_SIZE];
+    int stack_size = 0;
+    int current_node_index = 0;
+    while (true)
+    {
+        const FlattenedBVHNode& node = tlas_nodes[current_node_index];
+        profiler_counters.visit_node();
+
+        if (node.intersect_bounds(ray.origin, inverse_direction, closest_t))
+        {
+            if (node.is_leaf())
+            {
+                for (int i = node.primitives_offset_or_second_child; i < node.primitives_offset_or_second_child + node.primitive_count; i++)
+                    hit_found |= intersect_instance(m_tlas_instance_indices[tlas_primitive_indices[i]], ray, hit_info, closest_t, filter_function_payload);
+            }
+            else
+            {
+                // Visiting the closest child first and pushing the other one on the stack
+                if (direction_is_negative[node.split_axis])
+                {
+                    stack[stack_size++] = current_node_index + 1;
+                    current_node_index = node.primitives_offset_or_second_child;
+                }
+                else
+                {
+                    stack[stack_size++] = node.primitives_offset_or_second_child;
+                    current_node_index = current_node_index + 1;
+                }
+
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        current_node_index = stack[--stack_size];
+    }
+
+    return hit_found;
+}
+
+void TwoLevelBVH::intersect_packet(const hiprtRay* rays, hiprtHit* hits, bool* out_hit_found, int ray_count, void** filter_function_payloads, bool any_hit) const
+{
+    for (int i = 0; i < ray_count; i++)
+        out_hit_found[i] = intersect(rays[i], hits[i], filter_function_payloads[i]);
+}
+
+int TwoLevelBVH::get_mesh_count() const
+{
+    return m_blases.size();
+}
+
+int TwoLevelBVH::get_instance_count() const
+{
+    return m_instances.size();
+}
+
+const TwoLevelBVHInstance& TwoLevelBVH::get_instance(int instance_index) const
+{
+    return m_instances[instance_index];
+}
+
+size_t TwoLevelBVH::get_node_count() const
+{
+    size_t node_count = m_tlas.get_node_count();
+    for (const FlattenedBVH& blas : m_blases)
+        node_count += blas.get_node_count();
+
+    return node_count;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef TWO_LEVEL_BVH_H
+#define TWO_LEVEL_BVH_H
+
+#include "HostDeviceCommon/Math.h"
+#include "Renderer/FlattenedBVH.h"
+#include "Renderer/Triangle.h"
+#include "Scene/BoundingBox.h"
+#include "Scene/SceneInstance.h"
+
+#include <vector>
+
+#include <hiprt/hiprt_types.h> // for hiprtRay
+
+/**
+ * One instance of the two-level BVH: the BLAS of one mesh placed in the scene with a transform
+ */
+struct TwoLevelBVHInstance
+{
+    int mesh_index = 0;
+
+    // Affine transforms, see identity_affine_matrix()
+    float4x4 object_to_world = identity_affine_matrix();
+    float4x4 world_to_object = identity_affine_matrix();
+    // Brings the object space normals of the hits to world space
+    float4x4 normal_to_world = identity_affine_matrix();
+    // Identity instances skip the transformation of the rays and hits
+    bool is_identity = true;
+
+    BoundingBox world_bounds;
+};
+
+/**
+ * Two-level BVH: one BLAS (a FlattenedBVH) per mesh of the scene and a TLAS over the
+ * world space bounds of the instances of these BLASes. Several instances can share the same BLAS.
+ *
+ * Rigid motion of an instance only needs set_instance_transform() and a rebuild of the small
+ * TLAS. Deformations of a mesh refit its BLAS with refit_mesh() instead of rebuilding it.
+ *
+ * The hits are returned with the index of the triangle in the triangle buffer of
+ * the whole scene, with a world space normal and with the index of the instance hit in
+ * 'instanceID' such that they can be used like the hits of a single-level BVH
+ */
+class TwoLevelBVH
+{
+public:
+    /**
+     * Builds one BLAS per mesh and the TLAS over the given instances.
+     *
+     * The triangles of mesh 'i' are the triangles [mesh_triangle_offsets[i], mesh_triangle_offsets[i + 1])
+     * of 'triangles' (see SceneMetadata::mesh_triangle_offsets). The triangles are in the object space of their mesh
+     */
+    void build(const std::vector<Triangle>& triangles, const std::vector<int>& mesh_triangle_offsets, const std::vector<SceneInstance>& instances, CPUSIMDLevel max_simd_level = CPUSIMDLevel::CPU_SIMD_AVX2);
+
+    /**
+     * Changes the object to world transform of the instance. rebuild_tlas() must be
+     * called once all the transforms have been set for the change to be visible
+     */
+    void set_instance_transform(int instance_index, const float4x4& object_to_world);
+
+    /**
+     * Refits the BLAS of the mesh for the new positions of its triangles.
+     * 'triangles' is the triangle buffer of the whole scene.
+     *
+     * rebuild_tlas() must then be called since the bounds of the mesh have changed
+     */
+    void refit_mesh(int mesh_index, const std::vector<Triangle>& triangles);
+
+    /**
+     * Rebuilds the TLAS from the current transforms and bounds of the BLASes.
+     * There is one TLAS leaf per mesh so this is very cheap compared to a rebuild of the BLASes
+     */
+    void rebuild_tlas();
+
+    bool intersect(const hiprtRay& ray, hiprtHit& hit_info, void* filter_function_payload) const;
+
+    /**
+     * Same interface as FlattenedBVH::intersect_packet() but the rays
+     * of the packet are traced one by one through the TLAS. The closest hit
+     * is always returned, 'any_hit' only allows the traversal to stop earlier
+     */
+    void intersect_packet(const hiprtRay* rays, hiprtHit* hits, bool* out_hit_found, int ray_count, void** filter_function_payloads, bool any_hit = false) const;
+
+    int get_mesh_count() const;
+    int get_instance_count() const;
+    const TwoLevelBVHInstance& get_instance(int instance_index) const;
+    /**
+     * Number of nodes of the TLAS and of all the BLASes
+     */
+    size_t get_node_count() const;
+
+private:
+    /**
+     * Intersects the BLAS of the given instance with the ray brought to the object space of the instance
+     */
+    bool intersect_instance(int instance_index, const hiprtRay& ray, hiprtHit& hit_info, float& closest_t, void* filter_function_payload) const;
+
+    void update_instance_world_bounds(int instance_index);
+
+    std::vector<FlattenedBVH> m_blases;
+    std::vector<TwoLevelBVHInstance> m_instances;
+
+    FlattenedBVH m_tlas;
+    // Index of the instance of each primitive of the TLAS. The instances of meshes
+    // without triangles have an empty BLAS and are not in the TLAS
+    std::vector<int> m_tlas_instance_indices;
+};
+
+#endif
@@ -47,6 +47,17 @@ struct BoundingBox
 		return *(&maxi.x + coord) - *(&mini.x + coord);
 	}
 
+	float get_surface_area() const
+	{
+		if (maxi.x < mini.x)
+			// Empty bounding box
+			return 0.0f;
+
+		float3 extent = maxi - mini;
+
+		return 2.0f * (extent.x * extent.y + extent.x * extent.z + extent.y * extent.z);
+	}
+
 	float3 get_center() const
 	{
 		return (mini + maxi) * 0.5f;
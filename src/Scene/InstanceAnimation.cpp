@@ -0,0 +1,139 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Renderer/GPURenderer.h"
+#include "Scene/BoundingBox.h"
+#include "Scene/InstanceAnimation.h"
+
+#include <cmath>
+
+void InstanceAnimation::set_instances(const std::vector<SceneInstance>& instances)
+{
+    m_original_instances = instances;
+    m_instance_translations = std::vector<float3>(instances.size(), make_float3(0.0f, 0.0f, 0.0f));
+
+    m_animated_instance = 0;
+    m_oscillation_time = 0.0f;
+
+    m_original_mesh_vertices.clear();
+    m_mesh_scales.clear();
+}
+
+void InstanceAnimation::animation_step(GPURenderer* renderer, float delta_time)
+{
+    // We can step the animation either if we're not accumulating or
+    // if we're accumulating and we're allowed to step the animations
+    bool can_step_animation = false;
+    can_step_animation |= renderer->get_render_settings().accumulate && renderer->get_animation_state().can_step_animation;
+    can_step_animation |= !renderer->get_render_settings().accumulate;
+
+    if (animate && renderer->get_animation_state().do_animations && can_step_animation)
+    {
+        if (m_animated_instance >= get_instance_count() || renderer->is_mesh_emissive(get_instance_mesh_index(m_animated_instance)))
+            return;
+
+        m_oscillation_time += delta_time / 1000.0f;
+        m_oscillation_time = std::fmod(m_oscillation_time, m_oscillation_period);
+
+        renderer->set_instance_transform(m_animated_instance, get_instance_transform(m_animated_instance));
+    }
+}
+
+void InstanceAnimation::set_animated_instance(GPURenderer* renderer, int instance_index)
+{
+    if (instance_index == m_animated_instance || instance_index < 0 || instance_index >= get_instance_count())
+        return;
+
+    int previous_animated_instance = m_animated_instance;
+
+    m_animated_instance = instance_index;
+    m_oscillation_time = 0.0f;
+
+    if (!renderer->is_mesh_emissive(get_instance_mesh_index(previous_animated_instance)))
+        // Putting the previous instance back at its rest position
+        renderer->set_instance_transform(previous_animated_instance, get_instance_transform(previous_animated_instance));
+}
+
+int InstanceAnimation::get_animated_instance() const
+{
+    return m_animated_instance;
+}
+
+void InstanceAnimation::set_instance_translation(GPURenderer* renderer, int instance_index, float3 translation)
+{
+    if (instance_index < 0 || instance_index >= get_instance_count() || renderer->is_mesh_emissive(get_instance_mesh_index(instance_index)))
+        return;
+
+    m_instance_translations[instance_index] = translation;
+
+    renderer->set_instance_transform(instance_index, get_instance_transform(instance_index));
+}
+
+float3 InstanceAnimation::get_instance_translation(int instance_index) const
+{
+    return m_instance_translations[instance_index];
+}
+
+void InstanceAnimation::set_mesh_scale(GPURenderer* renderer, int mesh_index, float scale)
+{
+    if (renderer->is_mesh_emissive(mesh_index))
+        return;
+
+    auto original_vertices_find = m_original_mesh_vertices.find(mesh_index);
+    if (original_vertices_find == m_original_mesh_vertices.end())
+        original_vertices_find = m_original_mesh_vertices.emplace(mesh_index, renderer->get_mesh_vertices(mesh_index)).first;
+
+    const std::vector<float3>& original_vertices = original_vertices_find->second;
+    if (original_vertices.empty())
+        return;
+
+    BoundingBox object_space_bounds(original_vertices[0], original_vertices[0]);
+    for (const float3& vertex : original_vertices)
+        object_space_bounds.extend(vertex);
+    float3 center = object_space_bounds.get_center();
+
+    std::vector<float3> scaled_vertices(original_vertices.size());
+    for (int i = 0; i < original_vertices.size(); i++)
+        scaled_vertices[i] = center + (original_vertices[i] - center) * scale;
+
+    m_mesh_scales[mesh_index] = scale;
+
+    renderer->update_mesh_vertices(mesh_index, scaled_vertices);
+}
+
+float InstanceAnimation::get_mesh_scale(int mesh_index) const
+{
+    auto scale_find = m_mesh_scales.find(mesh_index);
+    if (scale_find == m_mesh_scales.end())
+        return 1.0f;
+
+    return scale_find->second;
+}
+
+int InstanceAnimation::get_instance_count() const
+{
+    return m_original_instances.size();
+}
+
+int InstanceAnimation::get_instance_mesh_index(int instance_index) const
+{
+    return m_original_instances[instance_index].mesh_index;
+}
+
+float4x4 InstanceAnimation::get_instance_transform(int instance_index) const
+{
+    float3 translation = m_instance_translations[instance_index];
+    if (instance_index == m_animated_instance)
+        translation = translation + m_oscillation_amplitude * sinf(2.0f * M_PI * m_oscillation_time / m_oscillation_period);
+
+    // The translation is in world space so it is simply added
+    // to the translation column of the affine transform
+    float4x4 object_to_world = m_original_instances[instance_index].object_to_world;
+    object_to_world.m[0][3] += translation.x;
+    object_to_world.m[1][3] += translation.y;
+    object_to_world.m[2][3] += translation.z;
+
+    return object_to_world;
+}
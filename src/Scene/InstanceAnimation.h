@@ -0,0 +1,89 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef INSTANCE_ANIMATION_H
+#define INSTANCE_ANIMATION_H
+
+#include "HostDeviceCommon/Math.h"
+#include "Scene/SceneInstance.h"
+
+#include <unordered_map>
+#include <vector>
+
+class GPURenderer;
+
+/**
+ * Moves the instances and deforms the meshes of the scene of the GPU renderer.
+ *
+ * Instances are translated on top of their transform from the scene file with
+ * GPURenderer::set_instance_transform(), which only rebuilds the TLAS.
+ * Meshes are scaled around their object space center with GPURenderer::update_mesh_vertices(),
+ * which refits the BLAS of the mesh.
+ *
+ * Emissive meshes can neither be moved nor deformed because the light sampling
+ * data (light BVH, power alias table) is built once when the scene is loaded
+ */
+class InstanceAnimation
+{
+public:
+    void set_instances(const std::vector<SceneInstance>& instances);
+
+    /**
+    * The 'delta_time' parameter should be how much time passed, in milliseconds, since the last
+    * call to animation_step()
+    */
+    void animation_step(GPURenderer* renderer, float delta_time);
+
+    /**
+     * Changes the instance that oscillates when 'animate' is true.
+     * The previously animated instance is put back at its rest position
+     */
+    void set_animated_instance(GPURenderer* renderer, int instance_index);
+    int get_animated_instance() const;
+
+    /**
+     * Translation of the instance, in world space, on top of its transform from the scene file
+     */
+    void set_instance_translation(GPURenderer* renderer, int instance_index, float3 translation);
+    float3 get_instance_translation(int instance_index) const;
+
+    /**
+     * Scales the vertices of the mesh around the center of its object space bounding box.
+     * All the instances of the mesh are affected
+     */
+    void set_mesh_scale(GPURenderer* renderer, int mesh_index, float scale);
+    float get_mesh_scale(int mesh_index) const;
+
+    int get_instance_count() const;
+    int get_instance_mesh_index(int instance_index) const;
+
+    // Public attributes here because we want them to be
+    // easily accessible, same as CameraAnimation
+    bool animate = false;
+
+    // The animated instance oscillates between -'m_oscillation_amplitude' and
+    // +'m_oscillation_amplitude' (world space offsets) around its rest position
+    float3 m_oscillation_amplitude = make_float3(0.0f, 0.5f, 0.0f);
+    // Duration of one back and forth of the animated instance in seconds
+    float m_oscillation_period = 4.0f;
+
+private:
+    float4x4 get_instance_transform(int instance_index) const;
+
+    // Instances as they were in the scene file
+    std::vector<SceneInstance> m_original_instances;
+    std::vector<float3> m_instance_translations;
+
+    int m_animated_instance = 0;
+    // Time in seconds since the beginning of the oscillation
+    float m_oscillation_time = 0.0f;
+
+    // Object space vertices of the meshes that have been scaled, before they were scaled.
+    // They are read back from the GPU the first time a mesh is scaled
+    std::unordered_map<int, std::vector<float3>> m_original_mesh_vertices;
+    std::unordered_map<int, float> m_mesh_scales;
+};
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Scene/SceneCache.h"
+#include "UI/ImGui/ImGuiLogger.h"
+#include "Utils/MappedFile.h"
+#include "Utils/Utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+extern ImGuiLogger g_imgui_logger;
+
+const std::string SceneCache::CACHE_DIRECTORY = "scene_cache";
+
+// The structures below are copied as raw bytes to and from the cache file
+static_assert(std::is_trivially_copyable<CPUMaterial>::value, "CPUMaterial must be trivially copyable to be stored in the scene cache");
+static_assert(std::is_trivially_copyable<Camera>::value, "Camera must be trivially copyable to be stored in the scene cache");
+static_assert(std::is_trivially_copyable<BoundingBox>::value, "BoundingBox must be trivially copyable to be stored in the scene cache");
+
+static constexpr char SCENE_CACHE_MAGIC[8] = { 'H', 'I', 'P', 'R', 'T', 'S', 'C', 'N' };
+// Alignment of the sections in the file
+static constexpr size_t SCENE_CACHE_SECTION_ALIGNMENT = 64;
+
+enum SceneCacheSectionIndex
+{
+    SECTION_TRIANGLE_INDICES = 0,
+    SECTION_VERTICES_POSITIONS,
+    SECTION_HAS_VERTEX_NORMALS,
+    SECTION_VERTEX_NORMALS,
+    SECTION_TEXCOORDS,
+    SECTION_MATERIAL_INDICES,
+    SECTION_MATERIALS,
+    SECTION_MATERIAL_HAS_OPAQUE_BASE_COLOR_TEXTURE,
+    SECTION_MESH_MATERIAL_INDICES,
+    SECTION_MESH_BOUNDING_BOXES,
+    SECTION_MESH_TRIANGLE_OFFSETS,
+    SECTION_MESH_VERTEX_OFFSETS,
+    SECTION_INSTANCES,
+    SECTION_MATERIAL_NAMES,
+    SECTION_MESH_NAMES,
+    SECTION_TEXTURE_PATHS,
+    SECTION_TEXTURE_TYPES,
+    SECTION_TEXTURE_MATERIAL_INDICES,
+
+    SECTION_COUNT
+};
+
+struct SceneCacheSection
+{
+    unsigned long long int offset;
+    unsigned long long int size;
+};
+
+struct SceneCacheHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int section_count;
+    unsigned long long int cache_key;
+
+    // Sizes of the structures copied as raw bytes, to detect changes to
+    // these structures that would have been made without updating the version
+    unsigned int material_size;
+    unsigned int camera_size;
+
+    unsigned int has_camera;
+    unsigned int padding;
+
+    Camera camera;
+    BoundingBox scene_bounding_box;
+
+    SceneCacheSection sections[SECTION_COUNT];
+};
+
+/**
+ * Hashes the whole content of the file at 'filepath'.
+ * Returns false if the file couldn't be read
+ */
+static bool hash_file_content(const std::filesystem::path& filepath, unsigned long long int& hash)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    std::vector<char> buffer(1 << 20);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        hash = Utils::hash_fnv1a(buffer.data(), file.gcount(), hash);
+    }
+
+    return true;
+}
+
+unsigned long long int SceneCache::compute_cache_key(const std::string& scene_filepath, const SceneParserOptions& options)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    unsigned long long int key = Utils::FNV1A_64_OFFSET_BASIS;
+
+    std::filesystem::path path = scene_filepath;
+    if (!hash_file_content(path, key))
+        return 0;
+
+    // Also hashing the files that have the same name as the scene file in the same
+    // directory. These are usually the buffers of the scene (.bin for a .gltf, .mtl for a .obj, ...)
+    std::error_code error;
+    std::vector<std::filesystem::path> companion_files;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(path.parent_path().empty() ? "." : path.parent_path(), error))
+        if (entry.is_regular_file(error) && entry.path().stem() == path.stem() && entry.path().filename() != path.filename())
+            companion_files.push_back(entry.path());
+    // The order of the directory iteration isn't specified, sorting
+    // for the key to be the same on every run
+    std::sort(companion_files.begin(), companion_files.end());
+    for (const std::filesystem::path& companion_file : companion_files)
+    {
+        std::string filename = companion_file.filename().string();
+        key = Utils::hash_fnv1a(filename.data(), filename.size(), key);
+
+        hash_file_content(companion_file, key);
+    }
+
+    // The options that change the content of the parsed scene
+    key = Utils::hash_fnv1a(&options.override_aspect_ratio, sizeof(options.override_aspect_ratio), key);
+
+    unsigned int version = SceneCache::CACHE_VERSION;
+    unsigned int material_size = sizeof(CPUMaterial);
+    key = Utils::hash_fnv1a(&version, sizeof(version), key);
+    key = Utils::hash_fnv1a(&material_size, sizeof(material_size), key);
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Scene cache key computed in %lldms", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
+
+    // 0 is reserved for errors
+    return key == 0 ? 1 : key;
+}
+
+std::string SceneCache::get_cache_filepath(unsigned long long int cache_key)
+{
+    char filename[64];
+    std::snprintf(filename, sizeof(filename), "%016llx.scenecache", cache_key);
+
+    return CACHE_DIRECTORY + "/" + filename;
+}
+
+/**
+ * Copies the section 'section_index' of the mapped cache file into 'out_vector'.
+ * Returns false if the section doesn't contain a whole number of elements
+ */
+template <typename T>
+static bool read_section(const MappedFile& file, const SceneCacheHeader& header, SceneCacheSectionIndex section_index, std::vector<T>& out_vector)
+{
+    const SceneCacheSection& section = header.sections[section_index];
+    if (section.size % sizeof(T) != 0)
+        return false;
+
+    out_vector.resize(section.size / sizeof(T));
+    if (section.size > 0)
+        std::memcpy(out_vector.data(), file.get_data() + section.offset, section.size);
+
+    return true;
+}
+
+/**
+ * Reads a list of strings stored as [string count][length 0][chars 0][length 1][chars 1]...
+ */
+static bool read_strings_section(const MappedFile& file, const SceneCacheHeader& header, SceneCacheSectionIndex section_index, std::vector<std::string>& out_strings)
+{
+    const SceneCacheSection& section = header.sections[section_index];
+    const unsigned char* data = file.get_data() + section.offset;
+    const unsigned char* data_end = data + section.size;
+
+    unsigned int string_count;
+    if (data + sizeof(unsigned int) > data_end)
+        return false;
+    std::memcpy(&string_count, data, sizeof(unsigned int));
+    data += sizeof(unsigned int);
+    if (string_count > section.size / sizeof(unsigned int))
+        // Each string needs at least its length
+        return false;
+
+    out_strings.resize(string_count);
+    for (std::string& string : out_strings)
+    {
+        unsigned int length;
+        if (data + sizeof(unsigned int) > data_end)
+            return false;
+        std::memcpy(&length, data, sizeof(unsigned int));
+        data += sizeof(unsigned int);
+
+        if (data + length > data_end)
+            return false;
+        string.assign(reinterpret_cast<const char*>(data), length);
+        data += length;
+    }
+
+    return true;
+}
+
+bool SceneCache::read_scene(unsigned long long int cache_key, Scene& parsed_scene, std::vector<std::pair<aiTextureType, std::string>>& out_texture_paths, std::vector<int>& out_texture_material_indices)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::string cache_filepath = get_cache_filepath(cache_key);
+
+    MappedFile file;
+    if (!file.open(cache_filepath))
+        // No cache file for this key
+        return false;
+
+    SceneCacheHeader header;
+    if (file.get_size() < sizeof(SceneCacheHeader))
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Scene cache file \"%s\" is truncated. Ignoring it.", cache_filepath.c_str());
+
+        return false;
+    }
+    std::memcpy(&header, file.get_data(), sizeof(SceneCacheHeader));
+
+    if (std::memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC)) != 0
+        || header.version != CACHE_VERSION
+        || header.section_count != SECTION_COUNT
+        || header.cache_key != cache_key
+        || header.material_size != sizeof(CPUMaterial)
+        || header.camera_size != sizeof(Camera))
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Scene cache file \"%s\" has an invalid header or was written by another version of the renderer. Ignoring it.", cache_filepath.c_str());
+
+        return false;
+    }
+
+    for (int i = 0; i < SECTION_COUNT; i++)
+    {
+        if (header.sections[i].offset > file.get_size() || header.sections[i].size > file.get_size() - header.sections[i].offset)
+        {
+            g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Scene cache file \"%s\" is truncated. Ignoring it.", cache_filepath.c_str());
+
+            return false;
+        }
+    }
+
+    std::vector<unsigned char> material_has_opaque_base_color_texture;
+    std::vector<std::string> texture_paths;
+    std::vector<int> texture_types;
+
+    bool valid = true;
+    valid &= read_section(file, header, SECTION_TRIANGLE_INDICES, parsed_scene.triangle_indices);
+    valid &= read_section(file, header, SECTION_VERTICES_POSITIONS, parsed_scene.vertices_positions);
+    valid &= read_section(file, header, SECTION_HAS_VERTEX_NORMALS, parsed_scene.has_vertex_normals);
+    valid &= read_section(file, header, SECTION_VERTEX_NORMALS, parsed_scene.vertex_normals);
+    valid &= read_section(file, header, SECTION_TEXCOORDS, parsed_scene.texcoords);
+    valid &= read_section(file, header, SECTION_MATERIAL_INDICES, parsed_scene.material_indices);
+    valid &= read_section(file, header, SECTION_MATERIALS, parsed_scene.materials);
+    valid &= read_section(file, header, SECTION_MATERIAL_HAS_OPAQUE_BASE_COLOR_TEXTURE, material_has_opaque_base_color_texture);
+    valid &= read_section(file, header, SECTION_MESH_MATERIAL_INDICES, parsed_scene.metadata.mesh_material_indices);
+    valid &= read_section(file, header, SECTION_MESH_BOUNDING_BOXES, parsed_scene.metadata.mesh_bounding_boxes);
+    valid &= read_section(file, header, SECTION_MESH_TRIANGLE_OFFSETS, parsed_scene.metadata.mesh_triangle_offsets);
+    valid &= read_section(file, header, SECTION_MESH_VERTEX_OFFSETS, parsed_scene.metadata.mesh_vertex_offsets);
+    valid &= read_section(file, header, SECTION_INSTANCES, parsed_scene.metadata.instances);
+    valid &= read_strings_section(file, header, SECTION_MATERIAL_NAMES, parsed_scene.metadata.material_names);
+    valid &= read_strings_section(file, header, SECTION_MESH_NAMES, parsed_scene.metadata.mesh_names);
+    valid &= read_strings_section(file, header, SECTION_TEXTURE_PATHS, texture_paths);
+    valid &= read_section(file, header, SECTION_TEXTURE_TYPES, texture_types);
+    valid &= read_section(file, header, SECTION_TEXTURE_MATERIAL_INDICES, out_texture_material_indices);
+    valid &= texture_paths.size() == texture_types.size() && texture_paths.size() == out_texture_material_indices.size();
+
+    if (!valid)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Scene cache file \"%s\" is corrupted. Ignoring it.", cache_filepath.c_str());
+
+        parsed_scene = Scene();
+        out_texture_paths.clear();
+        out_texture_material_indices.clear();
+
+        return false;
+    }
+
+    parsed_scene.material_has_opaque_base_color_texture.assign(material_has_opaque_base_color_texture.begin(), material_has_opaque_base_color_texture.end());
+    parsed_scene.metadata.scene_bounding_box = header.scene_bounding_box;
+    parsed_scene.camera = header.camera;
+    parsed_scene.has_camera = header.has_camera;
+
+    out_texture_paths.resize(texture_paths.size());
+    for (int i = 0; i < texture_paths.size(); i++)
+        out_texture_paths[i] = std::make_pair(static_cast<aiTextureType>(texture_types[i]), texture_paths[i]);
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Scene read from cache file \"%s\" in %lldms", cache_filepath.c_str(), (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
+
+    return true;
+}
+
+/**
+ * Writes 'size' bytes as the section 'section_index' of the cache file,
+ * after padding the file to the alignment of the sections
+ */
+static void write_section(std::ofstream& file, SceneCacheHeader& header, SceneCacheSectionIndex section_index, const void* data, size_t size)
+{
+    static const char padding[SCENE_CACHE_SECTION_ALIGNMENT] = { 0 };
+
+    size_t position = static_cast<size_t>(file.tellp());
+    size_t padding_size = (SCENE_CACHE_SECTION_ALIGNMENT - position % SCENE_CACHE_SECTION_ALIGNMENT) % SCENE_CACHE_SECTION_ALIGNMENT;
+    file.write(padding, padding_size);
+
+    header.sections[section_index].offset = position + padding_size;
+    header.sections[section_index].size = size;
+
+    if (size > 0)
+        file.write(static_cast<const char*>(data), size);
+}
+
+template <typename T>
+static void write_section(std::ofstream& file, SceneCacheHeader& header, SceneCacheSectionIndex section_index, const std::vector<T>& vector)
+{
+    write_section(file, header, section_index, vector.data(), vector.size() * sizeof(T));
+}
+
+static void write_strings_section(std::ofstream& file, SceneCacheHeader& header, SceneCacheSectionIndex section_index, const std::vector<std::string>& strings)
+{
+    std::vector<unsigned char> bytes;
+
+    auto append_uint = [&bytes](unsigned int value)
+    {
+        const unsigned char* value_bytes = reinterpret_cast<const unsigned char*>(&value);
+        bytes.insert(bytes.end(), value_bytes, value_bytes + sizeof(unsigned int));
+    };
+
+    append_uint(static_cast<unsigned int>(strings.size()));
+    for (const std::string& string : strings)
+    {
+        append_uint(static_cast<unsigned int>(string.size()));
+        bytes.insert(bytes.end(), string.begin(), string.end());
+    }
+
+    write_section(file, header, section_index, bytes);
+}
+
+bool SceneCache::write_scene(unsigned long long int cache_key, const Scene& parsed_scene, const std::vector<std::pair<aiTextureType, std::string>>& texture_paths, const std::vector<int>& texture_material_indices)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::error_code error;
+    std::filesystem::create_directories(CACHE_DIRECTORY, error);
+
+    std::string cache_filepath = get_cache_filepath(cache_key);
+    std::string temporary_filepath = cache_filepath + ".tmp";
+
+    std::ofstream file(temporary_filepath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Could not open scene cache file \"%s\" for writing.", temporary_filepath.c_str());
+
+        return false;
+    }
+
+    SceneCacheHeader header{};
+    std::memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.section_count = SECTION_COUNT;
+    header.cache_key = cache_key;
+    header.material_size = sizeof(CPUMaterial);
+    header.camera_size = sizeof(Camera);
+    header.has_camera = parsed_scene.has_camera;
+    header.camera = parsed_scene.camera;
+    header.scene_bounding_box = parsed_scene.metadata.scene_bounding_box;
+
+    // Placeholder for the header, rewritten once the offsets of the sections are known
+    file.write(reinterpret_cast<const char*>(&header), sizeof(SceneCacheHeader));
+
+    std::vector<unsigned char> material_has_opaque_base_color_texture(parsed_scene.material_has_opaque_base_color_texture.begin(), parsed_scene.material_has_opaque_base_color_texture.end());
+    std::vector<std::string> texture_paths_only(texture_paths.size());
+    std::vector<int> texture_types(texture_paths.size());
+    for (int i = 0; i < texture_paths.size(); i++)
+    {
+        texture_types[i] = static_cast<int>(texture_paths[i].first);
+        texture_paths_only[i] = texture_paths[i].second;
+    }
+
+    write_section(file, header, SECTION_TRIANGLE_INDICES, parsed_scene.triangle_indices);
+    write_section(file, header, SECTION_VERTICES_POSITIONS, parsed_scene.vertices_positions);
+    write_section(file, header, SECTION_HAS_VERTEX_NORMALS, parsed_scene.has_vertex_normals);
+    write_section(file, header, SECTION_VERTEX_NORMALS, parsed_scene.vertex_normals);
+    write_section(file, header, SECTION_TEXCOORDS, parsed_scene.texcoords);
+    write_section(file, header, SECTION_MATERIAL_INDICES, parsed_scene.material_indices);
+    write_section(file, header, SECTION_MATERIALS, parsed_scene.materials);
+    write_section(file, header, SECTION_MATERIAL_HAS_OPAQUE_BASE_COLOR_TEXTURE, material_has_opaque_base_color_texture);
+    write_section(file, header, SECTION_MESH_MATERIAL_INDICES, parsed_scene.metadata.mesh_material_indices);
+    write_section(file, header, SECTION_MESH_BOUNDING_BOXES, parsed_scene.metadata.mesh_bounding_boxes);
+    write_section(file, header, SECTION_MESH_TRIANGLE_OFFSETS, parsed_scene.metadata.mesh_triangle_offsets);
+    write_section(file, header, SECTION_MESH_VERTEX_OFFSETS, parsed_scene.metadata.mesh_vertex_offsets);
+    write_section(file, header, SECTION_INSTANCES, parsed_scene.metadata.instances);
+    write_strings_section(file, header, SECTION_MATERIAL_NAMES, parsed_scene.metadata.material_names);
+    write_strings_section(file, header, SECTION_MESH_NAMES, parsed_scene.metadata.mesh_names);
+    write_strings_section(file, header, SECTION_TEXTURE_PATHS, texture_paths_only);
+    write_section(file, header, SECTION_TEXTURE_TYPES, texture_types);
+    write_section(file, header, SECTION_TEXTURE_MATERIAL_INDICES, texture_material_indices);
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(SceneCacheHeader));
+    file.close();
+
+    if (file.fail())
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Could not write scene cache file \"%s\".", temporary_filepath.c_str());
+        std::filesystem::remove(temporary_filepath, error);
+
+        return false;
+    }
+
+    std::filesystem::rename(temporary_filepath, cache_filepath, error);
+    if (error)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Could not rename scene cache file \"%s\": %s", temporary_filepath.c_str(), error.message().c_str());
+        std::filesystem::remove(temporary_filepath, error);
+
+        return false;
+    }
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Scene cache file \"%s\" written in %lldms", cache_filepath.c_str(), (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
+
+    return true;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include "Scene/SceneParser.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Binary cache of the scenes parsed by ASSIMP so that loading the same scene
+ * again doesn't have to go through ASSIMP and the conversion to the 'Scene' structure.
+ *
+ * The cache file is made of a header followed by one section per array of the
+ * scene. The sections are aligned in the file so that the file can be memory mapped
+ * and each array of the scene is filled with a single copy from the mapped file.
+ *
+ * Cache files are named after a key that is a hash of:
+ *	- the content of the scene file and of the files next to it with the same name
+ *		(the .bin of a .gltf, the .mtl of a .obj, ...)
+ *	- the parser options that change the parsed scene
+ *	- the version of the cache format and the size of the cached structures
+ *
+ * Any modification of the scene file thus leads to a new key and a cache miss.
+ * Old cache files are never removed and can be deleted manually from SceneCache::CACHE_DIRECTORY.
+ *
+ * The textures aren't part of the cache, only their paths are: they are still read
+ * from disk on a cache hit.
+ */
+class SceneCache
+{
+public:
+    // Needs to be incremented every time the layout of the cache file changes
+    static constexpr unsigned int CACHE_VERSION = 3;
+
+    // Directory, relative to the working directory, where the cache files are stored
+    static const std::string CACHE_DIRECTORY;
+
+    /**
+     * Returns the cache key of the given scene file with the given options.
+     *
+     * 0 is returned if the scene file couldn't be read
+     */
+    static unsigned long long int compute_cache_key(const std::string& scene_filepath, const SceneParserOptions& options);
+    static std::string get_cache_filepath(unsigned long long int cache_key);
+
+    /**
+     * Reads the cache file of the given key in 'parsed_scene'.
+     *
+     * The paths of the textures of the scene and the index of the material that
+     * uses each texture are returned in 'out_texture_paths' and 'out_texture_material_indices'
+     * so that the textures can be loaded.
+     *
+     * Returns false (and leaves 'parsed_scene' empty) if there is no valid cache file for that key
+     */
+    static bool read_scene(unsigned long long int cache_key, Scene& parsed_scene, std::vector<std::pair<aiTextureType, std::string>>& out_texture_paths, std::vector<int>& out_texture_material_indices);
+
+    /**
+     * Writes 'parsed_scene' to the cache file of the given key.
+     *
+     * The scene is expected to be fully loaded, textures included, such that the
+     * materials are in their final state.
+     *
+     * The file is first written under a temporary name and then renamed so that
+     * another instance of the application never reads a partially written cache file
+     */
+    static bool write_scene(unsigned long long int cache_key, const Scene& parsed_scene, const std::vector<std::pair<aiTextureType, std::string>>& texture_paths, const std::vector<int>& texture_material_indices);
+};
+
+#endif
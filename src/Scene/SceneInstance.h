@@ -0,0 +1,26 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef SCENE_INSTANCE_H
+#define SCENE_INSTANCE_H
+
+#include "HostDeviceCommon/Math.h"
+
+/**
+ * One placement of a mesh of the scene in the world.
+ *
+ * A mesh that is used several times in the scene file (chairs, foliage, ...) is
+ * stored only once, in its object space, and each of its uses is an instance
+ */
+struct SceneInstance
+{
+    // Index of the mesh in the SceneMetadata::mesh_* vectors
+    int mesh_index = 0;
+
+    // Affine transform, see identity_affine_matrix()
+    float4x4 object_to_world = identity_affine_matrix();
+};
+
+#endif
@@ -4,9 +4,9 @@
  */
 
 #include "Image/Image.h"
+#include "Scene/SceneCache.h"
 #include "Scene/SceneParser.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
 #include "Threads/ThreadState.h"
 #include "UI/ImGui/ImGuiLogger.h"
 #include "Utils/CommandlineArguments.h"
@@ -21,14 +21,26 @@ extern ImGuiLogger g_imgui_logger;
 
 void SceneParser::parse_scene_file(const std::string& scene_filepath, Assimp::Importer& assimp_importer, Scene& parsed_scene, SceneParserOptions& options)
 {
+    // 0 if the scene cache isn't used
+    unsigned long long int cache_key = 0;
+    if (options.use_scene_cache)
+    {
+        cache_key = SceneCache::compute_cache_key(scene_filepath, options);
+        if (cache_key != 0 && parse_scene_cache(scene_filepath, cache_key, parsed_scene, options))
+            return;
+    }
+
     const aiScene* scene;
-    scene = assimp_importer.ReadFile(scene_filepath, aiPostProcessSteps::aiProcess_PreTransformVertices | aiPostProcessSteps::aiProcess_Triangulate | aiPostProcessSteps::aiProcess_GenBoundingBoxes);
+    scene = assimp_importer.ReadFile(scene_filepath, aiPostProcessSteps::aiProcess_Triangulate | aiPostProcessSteps::aiProcess_GenBoundingBoxes);
     if (scene == nullptr)
     {
         std::cerr << assimp_importer.GetErrorString() << std::endl;
         g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_WARNING, "Falling back to default scene...");
 
-        scene = assimp_importer.ReadFile(CommandlineArguments::DEFAULT_SCENE, aiPostProcessSteps::aiProcess_PreTransformVertices | aiPostProcessSteps::aiProcess_Triangulate);
+        // Not caching the default scene under the key of the scene that failed to load
+        cache_key = 0;
+
+        scene = assimp_importer.ReadFile(CommandlineArguments::DEFAULT_SCENE, aiPostProcessSteps::aiProcess_Triangulate | aiPostProcessSteps::aiProcess_GenBoundingBoxes);
         if (scene == nullptr)
         {
             // Couldn't even load the default scene either
@@ -75,11 +87,9 @@ void SceneParser::parse_scene_file(const std::string& scene_filepath, Assimp::Im
     // Default value of 1 so that materials that don't have a base color texture have their "texture" considered has opaque
     parsed_scene.material_has_opaque_base_color_texture.resize(num_materials, 1);
     parsed_scene.metadata.material_names.resize(num_materials);
-    parsed_scene.metadata.mesh_names.resize(scene->mNumMeshes);
-    parsed_scene.metadata.mesh_material_indices.resize(scene->mNumMeshes);
     parsed_scene.textures.resize(texture_count);
     assign_material_texture_indices(parsed_scene.materials, material_texture_indices, texture_indices_offsets);
-    dispatch_texture_loading(parsed_scene, scene_filepath, options.nb_texture_threads, texture_paths, material_indices);
+    dispatch_texture_loading(parsed_scene, scene_filepath, options, texture_paths, material_indices);
 
     parse_camera(scene, parsed_scene, options.override_aspect_ratio);
 
@@ -91,28 +101,26 @@ void SceneParser::parse_scene_file(const std::string& scene_filepath, Assimp::Im
     // to our materials buffer
     std::unordered_set<int> material_indices_already_seen;
 
-    // If the scene contains multiple meshes, each mesh will have
-    // its vertices indices starting at 0. We don't want that.
-    // We want indices to be continuously growing (because we don't want
-    // the second mesh (with indices starting at 0, i.e its own indices) to use
-    // the vertices of the first mesh that have been parsed (and that use indices 0!)
-    // The offset thus offsets the indices of the meshes that come after the first one
-    // to account for all the indices of the previously parsed meshes
-    int global_indices_offset = 0;
+    // The scene isn't pre-transformed by ASSIMP so that the meshes used by several
+    // nodes of the scene can be instanced instead of being duplicated
+    std::vector<std::vector<float4x4>> mesh_instance_transforms(scene->mNumMeshes);
+    collect_mesh_instances(scene->mRootNode, aiMatrix4x4(), mesh_instance_transforms);
+
+    int instanced_mesh_count = 0;
     for (int mesh_index = 0; mesh_index < scene->mNumMeshes; mesh_index++)
     {
         aiMesh* mesh = scene->mMeshes[mesh_index];
+        if (mesh_instance_transforms[mesh_index].empty())
+            // Mesh not used by any node of the scene
+            continue;
+
         int material_index = mesh->mMaterialIndex;
         aiMaterial* mesh_material = scene->mMaterials[material_index];
-        
 
         std::string material_name = std::string(mesh_material->GetName().C_Str());
-        std::string mesh_name = std::string(mesh->mName.C_Str());
         if (material_name == "")
             material_name = std::string("Material.") + std::to_string(material_index);
         parsed_scene.metadata.material_names[material_index] = material_name;
-        parsed_scene.metadata.mesh_names[mesh_index] = mesh_name;
-        parsed_scene.metadata.mesh_material_indices[mesh_index] = material_index;
 
         CPUMaterial& renderer_material = parsed_scene.materials[material_index];
         if (material_indices_already_seen.find(mesh->mMaterialIndex) == material_indices_already_seen.end())
@@ -123,63 +131,182 @@ void SceneParser::parse_scene_file(const std::string& scene_filepath, Assimp::Im
             material_indices_already_seen.insert(mesh->mMaterialIndex);
         }
 
-
-        // Inserting the normals if present
-        if (mesh->HasNormals())
-            parsed_scene.vertex_normals.insert(parsed_scene.vertex_normals.end(),
-                reinterpret_cast<float3*>(mesh->mNormals),
-                reinterpret_cast<float3*>(&mesh->mNormals[mesh->mNumVertices]));
-        else
-            parsed_scene.vertex_normals.insert(parsed_scene.vertex_normals.end(), mesh->mNumVertices, hiprtFloat3{0, 0, 0});
-
-        // Inserting texcoords if present, looking at set 0 because that's where "classical" texcoords are.
-        // Other sets are assumed not interesting here.
-        if (mesh->HasTextureCoords(0) && texture_per_mesh[material_index] > 0)
+        // Emissive meshes are always baked in world space (one copy of the mesh per use) because the
+        // light sampling reads the vertices of the emissive triangles without any transform.
+        // An emissive texture may turn out to be constant once loaded and the mesh would then be emissive
+        // so meshes with an emissive texture are baked too.
+        //
+        // Meshes used only once are baked as well: there's nothing to share and the
+        // traversal doesn't have to transform the rays for their (identity) instance
+        bool may_be_emissive = renderer_material.is_emissive() || renderer_material.emission_texture_index != MaterialUtils::NO_TEXTURE;
+        bool use_texcoords = mesh->HasTextureCoords(0) && texture_per_mesh[material_index] > 0;
+        if (mesh_instance_transforms[mesh_index].size() == 1 || may_be_emissive)
         {
-            for (int i = 0; i < mesh->mNumVertices; i++)
+            for (const float4x4& object_to_world : mesh_instance_transforms[mesh_index])
             {
-                parsed_scene.texcoords.push_back(make_float2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y));
+                SceneInstance instance;
+                instance.mesh_index = parsed_scene.metadata.mesh_names.size();
+
+                BoundingBox mesh_bounding_box = append_mesh(mesh, object_to_world, use_texcoords, parsed_scene);
+                parsed_scene.metadata.mesh_names.push_back(std::string(mesh->mName.C_Str()));
+                parsed_scene.metadata.mesh_material_indices.push_back(material_index);
+                parsed_scene.metadata.mesh_bounding_boxes.push_back(mesh_bounding_box);
+                parsed_scene.metadata.scene_bounding_box.extend(mesh_bounding_box);
+                parsed_scene.metadata.instances.push_back(instance);
             }
         }
         else
-            parsed_scene.texcoords.insert(parsed_scene.texcoords.end(), mesh->mNumVertices, float2{0.0f, 0.0f});
+        {
+            int shared_mesh_index = parsed_scene.metadata.mesh_names.size();
+            BoundingBox object_bounding_box = append_mesh(mesh, identity_affine_matrix(), use_texcoords, parsed_scene);
 
-        // Inserting 0 or 1 depending on whether the normals are present or not.
-        // These values will be used in the shader to determine whether we should do
-        // smooth shading or not
-        parsed_scene.has_vertex_normals.insert(parsed_scene.has_vertex_normals.end(), mesh->mNumVertices, mesh->HasNormals());
+            // The bounding box of an instanced mesh is the world space bounding box of all its instances
+            BoundingBox mesh_bounding_box;
+            for (const float4x4& object_to_world : mesh_instance_transforms[mesh_index])
+            {
+                SceneInstance instance;
+                instance.mesh_index = shared_mesh_index;
+                instance.object_to_world = object_to_world;
 
-        // Inserting all the vertices of the mesh
-        parsed_scene.vertices_positions.insert(parsed_scene.vertices_positions.end(), reinterpret_cast<hiprtFloat3*>(&mesh->mVertices[0]), reinterpret_cast<hiprtFloat3*>(&mesh->mVertices[mesh->mNumVertices]));
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    float3 object_corner = make_float3(corner & 1 ? object_bounding_box.maxi.x : object_bounding_box.mini.x,
+                                                       corner & 2 ? object_bounding_box.maxi.y : object_bounding_box.mini.y,
+                                                       corner & 4 ? object_bounding_box.maxi.z : object_bounding_box.mini.z);
 
-        int max_mesh_index_offset = 0;
-        for (int face_index = 0; face_index < mesh->mNumFaces; face_index++)
-        {
-            aiFace face = mesh->mFaces[face_index];
+                    mesh_bounding_box.extend(matrix_X_point(object_to_world, object_corner));
+                }
 
-            int index_1 = face.mIndices[0];
-            int index_2 = face.mIndices[1];
-            int index_3 = face.mIndices[2];
+                parsed_scene.metadata.instances.push_back(instance);
+            }
 
-            // Accumulating the maximum index of this mesh, this is to know
-            max_mesh_index_offset = std::max(max_mesh_index_offset, std::max(index_1, std::max(index_2, index_3)));
+            parsed_scene.metadata.mesh_names.push_back(std::string(mesh->mName.C_Str()));
+            parsed_scene.metadata.mesh_material_indices.push_back(material_index);
+            parsed_scene.metadata.mesh_bounding_boxes.push_back(mesh_bounding_box);
+            parsed_scene.metadata.scene_bounding_box.extend(mesh_bounding_box);
 
-            parsed_scene.triangle_indices.push_back(index_1 + global_indices_offset);
-            parsed_scene.triangle_indices.push_back(index_2 + global_indices_offset);
-            parsed_scene.triangle_indices.push_back(index_3 + global_indices_offset);
+            instanced_mesh_count++;
         }
+    }
+
+    // End of the last mesh
+    parsed_scene.metadata.mesh_triangle_offsets.push_back(parsed_scene.triangle_indices.size() / 3);
+    parsed_scene.metadata.mesh_vertex_offsets.push_back(parsed_scene.vertices_positions.size());
 
-        // We're pushing the same material index for all the faces of this mesh
-        // because all faces of a mesh have the same material (that's how ASSIMP assimp_importer's
-        // do things internally). An ASSIMP mesh is basically a set of faces that all have the
-        // same material.
-        // If you're importing the 3D model of a car, even though you probably think of it as only one "3D mesh",
-        // ASSIMP sees it as composed of as many meshes as there are different materials
-        parsed_scene.material_indices.insert(parsed_scene.material_indices.end(), mesh->mNumFaces, material_index);
+    if (instanced_mesh_count > 0)
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "%d meshes instanced, %zu instances in the scene", instanced_mesh_count, parsed_scene.metadata.instances.size());
+
+    // Adjusting the speed of the camera so that we can cross the scene in approximately Camera::SCENE_CROSS_TIME
+    parsed_scene.camera.auto_adjust_speed(parsed_scene.metadata.scene_bounding_box);
+
+    // We need to process the emissive triangles in a separate pass because:
+    //  - Some meshes may be using emissive textures
+    //  - Some of these textures may be constant textures (which that the whole texture is only one color)
+    //      These textures will actually not be loaded but rather the unique color of the texture
+    //      will be set as the emission of the material
+    //      Because this is all done on a separate thread asynchronously, we need to wait for that thread
+    //      to finish. That thread we're talking about is the thread that is loading the texture so we're adding
+    //      another thread which has a dependecy on the texture loading thread.
+    // This new thread will process the triangles of the scene and mark them as emissive and we can now use
+    // the information of the potential constant-emission textures
+    parsed_scene.emissive_triangles_task = g_task_scheduler.submit([&parsed_scene]() {
+        ThreadFunctions::load_scene_parse_emissive_triangles_from_material_indices(parsed_scene);
+    }, parsed_scene.textures_loading_tasks);
+
+    if (cache_key != 0)
+    {
+        // The cache is written once the textures are loaded because the texture loading
+        // threads modify the materials (constant emissive textures, opaque flags, ...).
+        // The emissive triangles task already waits for the textures
+        parsed_scene.write_cache_task = g_task_scheduler.submit([&parsed_scene, cache_key, texture_paths, material_indices]() {
+            ThreadFunctions::load_scene_write_cache(parsed_scene, cache_key, texture_paths, material_indices);
+        }, { parsed_scene.emissive_triangles_task });
+    }
+}
+
+bool SceneParser::parse_scene_cache(const std::string& scene_filepath, unsigned long long int cache_key, Scene& parsed_scene, SceneParserOptions& options)
+{
+    std::vector<std::pair<aiTextureType, std::string>> texture_paths;
+    // Index of the material associated with each texture
+    std::vector<int> texture_material_indices;
+    if (!SceneCache::read_scene(cache_key, parsed_scene, texture_paths, texture_material_indices))
+        return false;
+
+    if (parsed_scene.materials.size() > NestedDielectricsInteriorStack::MAX_MATERIAL_INDEX)
+    {
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "This scene contains too many materials for the renderer. Maximum number of material is: %d", NestedDielectricsInteriorStack::MAX_MATERIAL_INDEX);
+
+        int charac = std::getchar();
+
+        std::exit(1);
+    }
+
+    // The textures themselves aren't cached
+    parsed_scene.textures.resize(texture_paths.size());
+    dispatch_texture_loading(parsed_scene, scene_filepath, options, texture_paths, texture_material_indices);
+
+    // Same as with ASSIMP, the emissive triangles can only be found once the
+    // emissive textures are loaded
+    parsed_scene.emissive_triangles_task = g_task_scheduler.submit([&parsed_scene]() {
+        ThreadFunctions::load_scene_parse_emissive_triangles_from_material_indices(parsed_scene);
+    }, parsed_scene.textures_loading_tasks);
+
+    return true;
+}
+
+void SceneParser::collect_mesh_instances(const aiNode* node, const aiMatrix4x4& parent_to_world, std::vector<std::vector<float4x4>>& mesh_instance_transforms)
+{
+    aiMatrix4x4 node_to_world = parent_to_world * node->mTransformation;
+
+    if (node->mNumMeshes > 0)
+    {
+        // ASSIMP matrices are row-major with the translation in the last column, same as our affine matrices
+        float4x4 object_to_world;
+        for (int row = 0; row < 4; row++)
+            for (int column = 0; column < 4; column++)
+                object_to_world.m[row][column] = node_to_world[row][column];
+
+        for (int i = 0; i < node->mNumMeshes; i++)
+            mesh_instance_transforms[node->mMeshes[i]].push_back(object_to_world);
+    }
+
+    for (int child_index = 0; child_index < node->mNumChildren; child_index++)
+        collect_mesh_instances(node->mChildren[child_index], node_to_world, mesh_instance_transforms);
+}
+
+BoundingBox SceneParser::append_mesh(const aiMesh* mesh, const float4x4& transform, bool use_texcoords, Scene& parsed_scene)
+{
+    parsed_scene.metadata.mesh_triangle_offsets.push_back(parsed_scene.triangle_indices.size() / 3);
+    parsed_scene.metadata.mesh_vertex_offsets.push_back(parsed_scene.vertices_positions.size());
+
+    // If the scene contains multiple meshes, each mesh will have
+    // its vertices indices starting at 0. We don't want that.
+    // We want indices to be continuously growing (because we don't want
+    // the second mesh (with indices starting at 0, i.e its own indices) to use
+    // the vertices of the first mesh that have been parsed (and that use indices 0!)
+    // The offset thus offsets the indices of the mesh to account for all the vertices
+    // of the previously parsed meshes
+    int global_indices_offset = parsed_scene.vertices_positions.size();
+
+    float4x4 identity = identity_affine_matrix();
+    bool is_identity = true;
+    for (int row = 0; row < 4; row++)
+        for (int column = 0; column < 4; column++)
+            is_identity &= transform.m[row][column] == identity.m[row][column];
+
+    BoundingBox mesh_bounding_box;
+    if (is_identity)
+    {
+        // Inserting all the vertices of the mesh
+        parsed_scene.vertices_positions.insert(parsed_scene.vertices_positions.end(), reinterpret_cast<hiprtFloat3*>(&mesh->mVertices[0]), reinterpret_cast<hiprtFloat3*>(&mesh->mVertices[mesh->mNumVertices]));
+
+        // Inserting the normals if present
+        if (mesh->HasNormals())
+            parsed_scene.vertex_normals.insert(parsed_scene.vertex_normals.end(),
+                reinterpret_cast<float3*>(mesh->mNormals),
+                reinterpret_cast<float3*>(&mesh->mNormals[mesh->mNumVertices]));
 
-        // Adding the bounding box to the parsed scene
         aiAABB mesh_aabb = mesh->mAABB;
-        BoundingBox mesh_bounding_box;
         mesh_bounding_box.mini = make_float3(mesh_aabb.mMin.x, mesh_aabb.mMin.y, mesh_aabb.mMin.z);
         mesh_bounding_box.maxi = make_float3(mesh_aabb.mMax.x, mesh_aabb.mMax.y, mesh_aabb.mMax.z);
         if (mesh_bounding_box.get_max_extent() == 0.0f)
@@ -195,33 +322,61 @@ void SceneParser::parse_scene_file(const std::string& scene_filepath, Assimp::Im
             for (int vert_index = 0; vert_index < mesh->mNumVertices; vert_index++)
                 mesh_bounding_box.extend(*(float3*)(&mesh->mVertices[vert_index]));
         }
+    }
+    else
+    {
+        // Baking the transform in the vertices
+        float4x4 normal_to_world = affine_normal_matrix(affine_matrix_inverse(transform));
+        for (int vert_index = 0; vert_index < mesh->mNumVertices; vert_index++)
+        {
+            float3 world_position = matrix_X_point(transform, *reinterpret_cast<float3*>(&mesh->mVertices[vert_index]));
+
+            parsed_scene.vertices_positions.push_back(world_position);
+            mesh_bounding_box.extend(world_position);
+
+            if (mesh->HasNormals())
+                parsed_scene.vertex_normals.push_back(hippt::normalize(affine_matrix_X_vec(normal_to_world, *reinterpret_cast<float3*>(&mesh->mNormals[vert_index]))));
+        }
+    }
 
-        parsed_scene.metadata.mesh_bounding_boxes.push_back(mesh_bounding_box);
-        // Extending the bounding box of the scene with the bounding box of the mesh
-        parsed_scene.metadata.scene_bounding_box.extend(mesh_bounding_box);
+    if (!mesh->HasNormals())
+        parsed_scene.vertex_normals.insert(parsed_scene.vertex_normals.end(), mesh->mNumVertices, hiprtFloat3{0, 0, 0});
 
-        // If the max index of the mesh was 19, we want the next to start
-        // at 20, not 19, so we ++
-        max_mesh_index_offset++;
-        // Adding the maximum index of the mesh to our global indices offset 
-        global_indices_offset += max_mesh_index_offset;
+    // Inserting texcoords if present, looking at set 0 because that's where "classical" texcoords are.
+    // Other sets are assumed not interesting here.
+    if (use_texcoords)
+    {
+        for (int i = 0; i < mesh->mNumVertices; i++)
+        {
+            parsed_scene.texcoords.push_back(make_float2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y));
+        }
     }
+    else
+        parsed_scene.texcoords.insert(parsed_scene.texcoords.end(), mesh->mNumVertices, float2{0.0f, 0.0f});
 
-    // Adjusting the speed of the camera so that we can cross the scene in approximately Camera::SCENE_CROSS_TIME
-    parsed_scene.camera.auto_adjust_speed(parsed_scene.metadata.scene_bounding_box);
+    // Inserting 0 or 1 depending on whether the normals are present or not.
+    // These values will be used in the shader to determine whether we should do
+    // smooth shading or not
+    parsed_scene.has_vertex_normals.insert(parsed_scene.has_vertex_normals.end(), mesh->mNumVertices, mesh->HasNormals());
 
-    // We need to process the emissive triangles in a separate pass because:
-    //  - Some meshes may be using emissive textures
-    //  - Some of these textures may be constant textures (which that the whole texture is only one color)
-    //      These textures will actually not be loaded but rather the unique color of the texture
-    //      will be set as the emission of the material
-    //      Because this is all done on a separate thread asynchronously, we need to wait for that thread
-    //      to finish. That thread we're talking about is the thread that is loading the texture so we're adding
-    //      another thread which has a dependecy on the texture loading thread.
-    // This new thread will process the triangles of the scene and mark them as emissive and we can now use
-    // the information of the potential constant-emission textures
-    ThreadManager::add_dependency(ThreadManager::SCENE_LOADING_PARSE_EMISSIVE_TRIANGLES, ThreadManager::SCENE_TEXTURES_LOADING_THREAD_KEY);
-    ThreadManager::start_thread(ThreadManager::SCENE_LOADING_PARSE_EMISSIVE_TRIANGLES, ThreadFunctions::load_scene_parse_emissive_triangles, scene, std::ref(parsed_scene));
+    for (int face_index = 0; face_index < mesh->mNumFaces; face_index++)
+    {
+        aiFace face = mesh->mFaces[face_index];
+
+        parsed_scene.triangle_indices.push_back(face.mIndices[0] + global_indices_offset);
+        parsed_scene.triangle_indices.push_back(face.mIndices[1] + global_indices_offset);
+        parsed_scene.triangle_indices.push_back(face.mIndices[2] + global_indices_offset);
+    }
+
+    // We're pushing the same material index for all the faces of this mesh
+    // because all faces of a mesh have the same material (that's how ASSIMP assimp_importer's
+    // do things internally). An ASSIMP mesh is basically a set of faces that all have the
+    // same material.
+    // If you're importing the 3D model of a car, even though you probably think of it as only one "3D mesh",
+    // ASSIMP sees it as composed of as many meshes as there are different materials
+    parsed_scene.material_indices.insert(parsed_scene.material_indices.end(), mesh->mNumFaces, static_cast<int>(mesh->mMaterialIndex));
+
+    return mesh_bounding_box;
 }
 
 void SceneParser::parse_camera(const aiScene* scene, Scene& parsed_scene, float frame_aspect_override)
@@ -231,9 +386,19 @@ void SceneParser::parse_camera(const aiScene* scene, Scene& parsed_scene, float
     {
         aiCamera* camera = scene->mCameras[0];
 
-        glm::vec3 camera_position = *reinterpret_cast<glm::vec3*>(&camera->mPosition);
-        glm::vec3 camera_lookat = *reinterpret_cast<glm::vec3*>(&camera->mLookAt);
-        glm::vec3 camera_up = *reinterpret_cast<glm::vec3*>(&camera->mUp);
+        // The camera is relative to the node of the same name. The scene isn't pre-transformed
+        // by ASSIMP anymore so we have to bring the camera to world space ourselves
+        aiMatrix4x4 camera_to_world;
+        for (const aiNode* node = scene->mRootNode->FindNode(camera->mName); node != nullptr; node = node->mParent)
+            camera_to_world = node->mTransformation * camera_to_world;
+
+        aiVector3D world_position = camera_to_world * camera->mPosition;
+        aiVector3D world_lookat = aiMatrix3x3(camera_to_world) * camera->mLookAt;
+        aiVector3D world_up = aiMatrix3x3(camera_to_world) * camera->mUp;
+
+        glm::vec3 camera_position = *reinterpret_cast<glm::vec3*>(&world_position);
+        glm::vec3 camera_lookat = *reinterpret_cast<glm::vec3*>(&world_lookat);
+        glm::vec3 camera_up = *reinterpret_cast<glm::vec3*>(&world_up);
 
         // Inversing the lookat because glm::lookat creates a world->view matrix which means
         // that the position of the camera in world->view matrix is going to be '-true_position'
@@ -367,22 +532,34 @@ void SceneParser::assign_material_texture_indices(std::vector<CPUMaterial>& mate
     }
 }
 
-void SceneParser::dispatch_texture_loading(Scene& parsed_scene, const std::string& scene_path, int nb_threads, const std::vector<std::pair<aiTextureType, std::string>>& texture_paths, const std::vector<int>& material_indices)
+void SceneParser::dispatch_texture_loading(Scene& parsed_scene, const std::string& scene_path, const SceneParserOptions& options, const std::vector<std::pair<aiTextureType, std::string>>& texture_paths, const std::vector<int>& material_indices)
 {
-    if (nb_threads == -1)
-        // As many threads as there are textures if -1 was given
-        nb_threads = texture_paths.size();
+    int nb_reading_threads = std::max(1, options.nb_texture_reading_threads);
+    if (options.adaptive_texture_reading_threads)
+        // Starting all the threads that may be needed, only
+        // 'nb_texture_reading_threads' of them read at first
+        nb_reading_threads = std::max(nb_reading_threads, options.max_texture_reading_threads);
 
     // Creating a state to keep the data that the threads need alive
     std::shared_ptr<TextureLoadingThreadState> texture_threads_state = std::make_shared<TextureLoadingThreadState>();
     texture_threads_state->scene_filepath = scene_path;
     texture_threads_state->texture_paths = texture_paths;
     texture_threads_state->material_indices = material_indices;
-
-    ThreadManager::set_thread_data(ThreadManager::SCENE_TEXTURES_LOADING_THREAD_KEY, texture_threads_state);
-
-    for (int i = 0; i < nb_threads; i++)
-        ThreadManager::start_thread(ThreadManager::SCENE_TEXTURES_LOADING_THREAD_KEY, ThreadFunctions::load_scene_texture, std::ref(parsed_scene), texture_threads_state->scene_filepath, std::ref(texture_threads_state->texture_paths), std::ref(texture_threads_state->material_indices), i, nb_threads);
+    texture_threads_state->use_texture_cache = options.use_texture_cache;
+    texture_threads_state->compress_textures = options.compress_textures;
+    texture_threads_state->generate_mipmaps = options.generate_texture_mipmaps;
+    texture_threads_state->nb_reading_threads = nb_reading_threads;
+    texture_threads_state->reading_concurrency.setup(options.nb_texture_reading_threads, nb_reading_threads, options.adaptive_texture_reading_threads);
+
+    // The tasks keep the state alive.
+    //
+    // The readers that aren't active wait inside their task until they are needed. With the blocking
+    // priority, a reader is never started by a worker that waits in another reader (for the decoding
+    // to catch up for example) so the active readers can't end up stuck under an inactive one
+    for (int i = 0; i < nb_reading_threads; i++)
+        parsed_scene.textures_loading_tasks.push_back(g_task_scheduler.submit([&parsed_scene, texture_threads_state]() {
+            ThreadFunctions::load_scene_texture_read_files(parsed_scene, *texture_threads_state);
+        }, {}, TASK_PRIORITY_BLOCKING));
 }
 
 void SceneParser::read_material_properties(aiMaterial* mesh_material, CPUMaterial& renderer_material)
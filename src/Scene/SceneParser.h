@@ -15,10 +15,14 @@
 #include "Image/Image.h"
 #include "Scene/BoundingBox.h"
 #include "Scene/Camera.h"
+#include "Scene/SceneInstance.h"
 #include "Renderer/Sphere.h"
 #include "Renderer/Triangle.h"
+#include "Threads/TaskScheduler.h"
 #include "Utils/Utils.h"
 
+#include <algorithm>
+#include <bit>
 #include <filesystem>
 #include <thread>
 #include <vector>
@@ -51,7 +55,7 @@ struct SceneParserOptions
      * The scene filepath passed as argument is analyzed and it is 
      * determined whether that scene is on an SSD or an HDD
      * 
-     * If the file is on an SSD, the number of texture loading threads will be
+     * If the file is on an SSD, the number of texture reading threads will be
      * adjusted higher to keep the CPU busy (because on an SSD, we're probably CPU bound)
      * 
      * If we're on an HDD, the number of threads is adjusted lower not to overwhelm the HDD
@@ -66,28 +70,55 @@ struct SceneParserOptions
             true_filepath = std::filesystem::read_symlink(scene_filepath);
 
         if (Utils::is_file_on_ssd(true_filepath.string().c_str())) 
-            nb_texture_threads = 16;
+        {
+            nb_texture_reading_threads = 4;
+            max_texture_reading_threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) / 2, 4, 16);
+        }
         else
-            nb_texture_threads = 4;
+        {
+            // A single thread reads from the HDD to keep the reads sequential
+            nb_texture_reading_threads = 1;
+            max_texture_reading_threads = 2;
+        }
     }
 
     float override_aspect_ratio = 16.0f / 9.0f;
 
-    // How many CPU threads to use when loading the textures of the scene.
+    // How many threads read the texture files of the scene from disk.
+    // The textures read are then decoded by tasks of the worker pool (see TaskScheduler).
     // 
-    // Note that blindly defaulting to 1 thread per texture may not be the
-    // best idea, especially on HDDs. This is because with one thread per texture,
-    // all textures will be loading at the same time. Although this may utilize the
-    // CPU very well, this will cause A LOT of random read accesses on the drive
-    // can SIGNIFICANTLY degrade performance. This is mostly applicable to HDDs but
-    // to SSDs too to some extent. You may want to use a higher thread count for SSDs
-    // though to be sure to feed enough work to the CPU to keep up with the fast SSD.
-    // 
-    // -1 to use one thread per texture.
+    // Note that blindly using many reading threads may not be the best idea, especially
+    // on HDDs: all textures will be read at the same time which causes A LOT of random
+    // read accesses on the drive and can SIGNIFICANTLY degrade performance. This is mostly
+    // applicable to HDDs but to SSDs too to some extent.
+    int nb_texture_reading_threads = 1;
+    // If true, 'nb_texture_reading_threads' is only the number of reading threads at the
+    // beginning of the loading. The number of threads is then adjusted between 1 and
+    // 'max_texture_reading_threads' from the read throughput and the decoding time
+    // measured during the loading. See TextureReadingConcurrency
+    bool adaptive_texture_reading_threads = true;
+    int max_texture_reading_threads = 1;
+
+    // If true, the decoded textures are read from / written to the texture
+    // cache so that the textures don't have to be decoded again the next time
+    // the scene is loaded. See TextureCache
+    bool use_texture_cache = true;
+
+    // If true, the scene is read from the binary scene cache if it has already
+    // been parsed before and the scene cache file is written after parsing
+    // the scene with ASSIMP otherwise. See SceneCache
+    bool use_scene_cache = true;
+
+    // If true, the material textures are block compressed after being loaded:
+    // BC7 for the base color textures, BC5 for the normal maps, BC1 for the emissive
+    // textures and BC4 for the single channel textures. See TextureCompression
     //
-    // 16 seemed to be a good arbitrary number to avoid trashing the disks on my setup 
-    // (tested on the Amazon Lumberyard Bistro on both HDD and SSD)
-    int nb_texture_threads = 4;
+    // The compression is lossy so it is off by default
+    bool compress_textures = false;
+
+    // If true, the mip levels of the material textures are generated while the textures
+    // are loaded, before they are compressed. Only the CPU renderer samples the mip levels
+    bool generate_texture_mipmaps = false;
 };
 
 struct SceneMetadata
@@ -99,9 +130,20 @@ struct SceneMetadata
     // For a given mesh index, its material index
     std::vector<int> mesh_material_indices;
 
-    // AABBs of the meshes of the scene
+    // World space AABBs of the meshes of the scene (of all the instances of the mesh)
     std::vector<BoundingBox> mesh_bounding_boxes;
 
+    // The triangles of mesh 'i' are the triangles [mesh_triangle_offsets[i], mesh_triangle_offsets[i + 1])
+    // of the scene and its vertices are the vertices [mesh_vertex_offsets[i], mesh_vertex_offsets[i + 1]).
+    // Both vectors have one more element than there are meshes
+    std::vector<int> mesh_triangle_offsets;
+    std::vector<int> mesh_vertex_offsets;
+
+    // Placements of the meshes in the scene. The vertices of a mesh are in its object space,
+    // they are only in world space if all the instances of the mesh have an identity transform.
+    // Every mesh has at least one instance
+    std::vector<SceneInstance> instances;
+
     // AABB of the whole scene
     BoundingBox scene_bounding_box;
 };
@@ -126,6 +168,14 @@ struct Scene
     bool has_camera = false;
     Camera camera;
 
+    // Tasks of the part of the loading that SceneParser::parse_scene_file() leaves running in the background.
+    // The textures (and the materials, which the texture loading modifies) can only be used once
+    // 'textures_loading_tasks' are finished and 'emissive_triangle_indices' once 'emissive_triangles_task' is
+    std::vector<TaskHandle> textures_loading_tasks;
+    TaskHandle emissive_triangles_task = nullptr;
+    // Writing of the scene cache file, nullptr if the scene cache isn't written
+    TaskHandle write_cache_task = nullptr;
+
     Sphere add_sphere(const float3& center, float radius, const CPUMaterial& material, int primitive_index)
     {
         int material_index = materials.size();
@@ -138,6 +188,94 @@ struct Scene
         return sphere;
     }
 
+    /**
+     * Returns the lobe combinations of the principled BSDF (see CPUMaterial::get_principled_lobe_mask())
+     * used by the materials of the scene along with the number of triangles that use them.
+     *
+     * The most used combination comes first
+     */
+    std::vector<std::pair<unsigned int, int>> get_principled_lobe_masks_usage() const
+    {
+        std::vector<unsigned int> material_lobe_masks;
+        for (const CPUMaterial& material : materials)
+            material_lobe_masks.push_back(material.get_principled_lobe_mask());
+
+        std::vector<int> triangle_count_per_mask(PRINCIPLED_LOBE_ALL + 1, 0);
+        for (int material_index : material_indices)
+            triangle_count_per_mask[material_lobe_masks[material_index]]++;
+
+        std::vector<std::pair<unsigned int, int>> lobe_masks_usage;
+        for (unsigned int lobe_mask = 0; lobe_mask <= PRINCIPLED_LOBE_ALL; lobe_mask++)
+            if (triangle_count_per_mask[lobe_mask] > 0)
+                lobe_masks_usage.push_back(std::make_pair(lobe_mask, triangle_count_per_mask[lobe_mask]));
+
+        std::stable_sort(lobe_masks_usage.begin(), lobe_masks_usage.end(), [](const std::pair<unsigned int, int>& a, const std::pair<unsigned int, int>& b) { return a.second > b.second; });
+
+        return lobe_masks_usage;
+    }
+
+    /**
+     * Returns at most 'max_count' lobe masks for the specializations of the principled BSDF
+     * (see PrincipledBSDFSpecializedLobeMaskX): the lobe combinations most used by the scene.
+     *
+     * The BSDF uses the first specialization that has all the lobes of the material so
+     * the returned masks are sorted from the one with the fewest lobes to the one with the most
+     */
+    std::vector<unsigned int> get_principled_bsdf_specialized_lobe_masks(int max_count) const
+    {
+        std::vector<unsigned int> specialized_lobe_masks;
+        for (const auto& [lobe_mask, triangle_count] : get_principled_lobe_masks_usage())
+        {
+            if (specialized_lobe_masks.size() == max_count)
+                break;
+
+            // NONE would disable the specialization and ALL is the generic BSDF anyways
+            if (lobe_mask != PRINCIPLED_LOBE_NONE && lobe_mask != PRINCIPLED_LOBE_ALL)
+                specialized_lobe_masks.push_back(lobe_mask);
+        }
+
+        std::stable_sort(specialized_lobe_masks.begin(), specialized_lobe_masks.end(), [](unsigned int a, unsigned int b) { return std::popcount(a) < std::popcount(b); });
+
+        return specialized_lobe_masks;
+    }
+
+    /**
+     * Returns the proportion of the triangles of the scene whose material only uses
+     * lobes that are all in at least one of the given lobe masks
+     */
+    float get_principled_lobe_masks_coverage(const std::vector<unsigned int>& lobe_masks) const
+    {
+        if (material_indices.empty())
+            return 1.0f;
+
+        int covered_triangle_count = 0;
+        for (const auto& [lobe_mask, triangle_count] : get_principled_lobe_masks_usage())
+            for (unsigned int covering_mask : lobe_masks)
+                if ((lobe_mask & ~covering_mask) == 0)
+                {
+                    covered_triangle_count += triangle_count;
+
+                    break;
+                }
+
+        return covered_triangle_count / static_cast<float>(material_indices.size());
+    }
+
+    /**
+     * Returns true if the material of every triangle of the scene only uses lobes
+     * that are all in at least one of the given lobe masks.
+     * 
+     * The generic principled BSDF is then never needed, see PrincipledBSDFSpecializationsCoverScene
+     */
+    bool principled_lobe_masks_cover_scene(const std::vector<unsigned int>& lobe_masks) const
+    {
+        for (const auto& [lobe_mask, triangle_count] : get_principled_lobe_masks_usage())
+            if (std::none_of(lobe_masks.begin(), lobe_masks.end(), [lobe_mask](unsigned int covering_mask) { return (lobe_mask & ~covering_mask) == 0; }))
+                return false;
+
+        return true;
+    }
+
     std::vector<Triangle> get_triangles()
     {
         std::vector<Triangle> triangles;
@@ -169,6 +307,22 @@ public:
     static void parse_scene_file(const std::string& filepath, Assimp::Importer& assimp_importer, Scene& parsed_scene, SceneParserOptions& options);
 
 private:
+    /**
+     * Reads the scene from the scene cache file of the given key and starts
+     * loading its textures. Returns false if there is no valid cache file for that key
+     */
+    static bool parse_scene_cache(const std::string& filepath, unsigned long long int cache_key, Scene& parsed_scene, SceneParserOptions& options);
+
+    /**
+     * Walks the node hierarchy of the scene and appends the object to world transform
+     * of each use of a mesh to 'mesh_instance_transforms[mesh index]'
+     */
+    static void collect_mesh_instances(const aiNode* node, const aiMatrix4x4& parent_to_world, std::vector<std::vector<float4x4>>& mesh_instance_transforms);
+    /**
+     * Appends the geometry of the mesh, transformed by 'transform', to the buffers of the scene and
+     * starts a new mesh in the mesh offsets of the metadata. Returns the bounding box of the appended vertices
+     */
+    static BoundingBox append_mesh(const aiMesh* mesh, const float4x4& transform, bool use_texcoords, Scene& parsed_scene);
 
     static void parse_camera(const aiScene* scene, Scene& parsed_scene, float frame_aspect_override);
 
@@ -198,7 +352,7 @@ private:
      */
     static void prepare_textures(const aiScene* scene, std::vector<std::pair<aiTextureType, std::string>>& texture_paths, std::vector<ParsedMaterialTextureIndices>& material_texture_indices, std::vector<int>& material_indices, std::vector<int>& texture_per_mesh, std::vector<int>& texture_indices_offsets, int& texture_count);
     static void assign_material_texture_indices(std::vector<CPUMaterial>& materials, const std::vector<ParsedMaterialTextureIndices>& material_tex_indices, const std::vector<int>& material_textures_offsets);
-    static void dispatch_texture_loading(Scene& parsed_scene, const std::string& scene_path, int nb_threads, const std::vector<std::pair<aiTextureType, std::string>>& texture_paths, const std::vector<int>& material_indices);
+    static void dispatch_texture_loading(Scene& parsed_scene, const std::string& scene_path, const SceneParserOptions& options, const std::vector<std::pair<aiTextureType, std::string>>& texture_paths, const std::vector<int>& material_indices);
 
     static void read_material_properties(aiMaterial* mesh_material, CPUMaterial& renderer_material);
     /**
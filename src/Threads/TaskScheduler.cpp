@@ -0,0 +1,419 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Threads/TaskScheduler.h"
+#include "UI/ImGui/ImGuiLogger.h"
+#include "Utils/Utils.h"
+
+#include <algorithm>
+
+extern ImGuiLogger g_imgui_logger;
+
+TaskScheduler g_task_scheduler;
+
+// Scheduler state and index of the worker executing on this thread. nullptr / -1
+// if the calling thread isn't a worker
+static thread_local void* t_worker_state = nullptr;
+static thread_local int t_worker_index = -1;
+
+bool Task::is_finished() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_finished;
+}
+
+TaskScheduler::TaskScheduler()
+{
+	m_state = std::make_shared<SharedState>();
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_state->sleep_mutex);
+		m_state->stop = true;
+	}
+	m_state->sleep_condition.notify_all();
+
+	// Not joining: a worker may still be busy with a long background task (a kernel
+	// precompilation for example) and we don't want to wait for it when exiting the application.
+	// The workers keep the shared state alive and exit after their current task
+	for (std::thread& worker : m_workers)
+		worker.detach();
+}
+
+void TaskScheduler::start_workers()
+{
+	std::call_once(m_workers_started, [this]() {
+		int worker_count = std::max(2u, std::thread::hardware_concurrency());
+
+		m_state->max_running_background_tasks = std::max(1, worker_count / 4);
+		for (int i = 0; i < worker_count; i++)
+			m_state->worker_queues.push_back(std::make_unique<TaskQueue>());
+
+		// The queues must all exist before the first worker starts stealing
+		for (int i = 0; i < worker_count; i++)
+			m_workers.push_back(std::thread(TaskScheduler::worker_loop, m_state, i));
+	});
+}
+
+TaskHandle TaskScheduler::submit(std::function<void()> function, const std::vector<TaskHandle>& dependencies, TaskPriority priority)
+{
+	TaskHandle task = std::make_shared<Task>();
+	task->m_function = std::move(function);
+	task->m_priority = priority;
+
+	if (m_monothread)
+	{
+		for (const TaskHandle& dependency : dependencies)
+		{
+			if (dependency != nullptr && !dependency->is_finished())
+			{
+				g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "A task depends on an unfinished task in monothread mode. This should never happen since all tasks are executed serially.");
+
+				Utils::debugbreak();
+			}
+		}
+
+		run_task_function(task);
+		task->m_finished = true;
+
+		return task;
+	}
+
+	start_workers();
+
+	m_state->unfinished_tasks++;
+
+	for (const TaskHandle& dependency : dependencies)
+	{
+		if (dependency == nullptr)
+			continue;
+
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+		if (!dependency->m_finished)
+		{
+			task->m_remaining_dependencies++;
+			dependency->m_successors.push_back(task);
+		}
+	}
+
+	// Removing the 'submission' dependency. If all the dependencies were already
+	// finished (or finished during the submission), the task is ready
+	if (--task->m_remaining_dependencies == 0)
+		schedule(*m_state, task);
+
+	return task;
+}
+
+void TaskScheduler::wait(const TaskHandle& task)
+{
+	if (task == nullptr)
+		return;
+
+	if (!is_worker_thread())
+	{
+		std::unique_lock<std::mutex> lock(task->m_mutex);
+		task->m_finished_condition.wait(lock, [&task]() { return task->m_finished; });
+	}
+	else
+		// The worker helps the other workers while waiting
+		wait_until([&task]() { return task->is_finished(); });
+
+	rethrow_task_exception(task);
+}
+
+void TaskScheduler::wait(const std::vector<TaskHandle>& tasks)
+{
+	for (const TaskHandle& task : tasks)
+		wait(task);
+}
+
+void TaskScheduler::wait_until(const std::function<bool()>& predicate)
+{
+	bool worker_thread = is_worker_thread();
+
+	while (true)
+	{
+		// Reading the event count before evaluating the predicate: if a task finishes
+		// after the predicate was evaluated, the count has changed and the wait below returns right away
+		unsigned long long int task_event_count;
+		{
+			std::lock_guard<std::mutex> lock(m_state->task_event_mutex);
+			task_event_count = m_state->task_event_count;
+		}
+
+		if (predicate())
+			return;
+
+		if (worker_thread)
+		{
+			// Helping the other workers while waiting. Background tasks are never executed
+			// here because they may take very long and delay the return of this wait.
+			// Blocking tasks neither, see TASK_PRIORITY_BLOCKING
+			TaskHandle other_task = find_task(*m_state, t_worker_index, false);
+			if (other_task != nullptr)
+			{
+				execute(*m_state, other_task);
+
+				continue;
+			}
+		}
+
+		// Sleeping until a task finishes (which may make the predicate true) or until a task
+		// is scheduled (which a worker may have to execute for the predicate to become true)
+		std::unique_lock<std::mutex> lock(m_state->task_event_mutex);
+		m_state->task_event_condition.wait(lock, [this, task_event_count]() { return m_state->task_event_count != task_event_count; });
+	}
+}
+
+void TaskScheduler::wait_for_all_tasks()
+{
+	if (m_monothread)
+		// Everything was executed in submit()
+		return;
+
+	wait_until([this]() { return m_state->unfinished_tasks.load() == 0; });
+}
+
+void TaskScheduler::set_monothread(bool monothread)
+{
+	m_monothread = monothread;
+}
+
+bool TaskScheduler::is_monothread() const
+{
+	return m_monothread;
+}
+
+int TaskScheduler::get_worker_count() const
+{
+	return m_monothread ? 0 : std::max(2u, std::thread::hardware_concurrency());
+}
+
+bool TaskScheduler::is_worker_thread() const
+{
+	return t_worker_state == m_state.get();
+}
+
+void TaskScheduler::worker_loop(std::shared_ptr<SharedState> state, int worker_index)
+{
+	t_worker_state = state.get();
+	t_worker_index = worker_index;
+
+	while (true)
+	{
+		TaskHandle task = find_task(*state, worker_index, true);
+		if (task != nullptr)
+		{
+			execute(*state, task);
+
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(state->sleep_mutex);
+		state->sleep_condition.wait(lock, [&state]() {
+			return state->stop
+				|| state->pending_normal_tasks > 0
+				|| state->pending_blocking_tasks > 0
+				|| (state->pending_background_tasks > 0 && state->running_background_tasks < state->max_running_background_tasks);
+		});
+
+		if (state->stop)
+			break;
+	}
+}
+
+TaskHandle TaskScheduler::pop_task(TaskQueue& queue, bool from_back)
+{
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return nullptr;
+
+	TaskHandle task;
+	if (from_back)
+	{
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+	}
+	else
+	{
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+	}
+
+	return task;
+}
+
+TaskHandle TaskScheduler::find_task(SharedState& state, int worker_index, bool from_worker_loop)
+{
+	int worker_count = state.worker_queues.size();
+
+	// Most recent task of our own queue first: it is likely to use data that is still in the caches
+	TaskHandle task = pop_task(*state.worker_queues[worker_index], true);
+	if (task == nullptr)
+		task = pop_task(state.shared_queue, false);
+	// Stealing the oldest task of the other workers
+	for (int i = 1; i < worker_count && task == nullptr; i++)
+		task = pop_task(*state.worker_queues[(worker_index + i) % worker_count], false);
+
+	if (task != nullptr)
+	{
+		state.pending_normal_tasks--;
+
+		return task;
+	}
+
+	if (!from_worker_loop)
+		return nullptr;
+
+	if (state.pending_blocking_tasks > 0)
+	{
+		task = pop_task(state.blocking_queue, false);
+		if (task != nullptr)
+		{
+			state.pending_blocking_tasks--;
+
+			return task;
+		}
+	}
+
+	if (state.pending_background_tasks == 0)
+		return nullptr;
+
+	// Reserving a background slot before taking a background task
+	int running = state.running_background_tasks.load();
+	do
+	{
+		if (running >= state.max_running_background_tasks)
+			return nullptr;
+	} while (!state.running_background_tasks.compare_exchange_weak(running, running + 1));
+
+	task = pop_task(state.background_queue, false);
+	if (task == nullptr)
+		state.running_background_tasks--;
+	else
+		state.pending_background_tasks--;
+
+	return task;
+}
+
+void TaskScheduler::schedule(SharedState& state, const TaskHandle& task)
+{
+	if (task->m_priority == TASK_PRIORITY_BACKGROUND)
+	{
+		state.pending_background_tasks++;
+
+		std::lock_guard<std::mutex> lock(state.background_queue.mutex);
+		state.background_queue.tasks.push_back(task);
+	}
+	else if (task->m_priority == TASK_PRIORITY_BLOCKING)
+	{
+		state.pending_blocking_tasks++;
+
+		std::lock_guard<std::mutex> lock(state.blocking_queue.mutex);
+		state.blocking_queue.tasks.push_back(task);
+	}
+	else
+	{
+		state.pending_normal_tasks++;
+
+		// Tasks submitted by a worker go in the queue of that worker
+		TaskQueue& queue = (t_worker_state == &state) ? *state.worker_queues[t_worker_index] : state.shared_queue;
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+
+	wake_workers(state);
+	notify_task_event(state);
+}
+
+void TaskScheduler::execute(SharedState& state, const TaskHandle& task)
+{
+	run_task_function(task);
+
+	std::vector<TaskHandle> successors;
+	{
+		std::lock_guard<std::mutex> lock(task->m_mutex);
+
+		task->m_finished = true;
+		successors.swap(task->m_successors);
+	}
+	task->m_finished_condition.notify_all();
+
+	for (const TaskHandle& successor : successors)
+		if (--successor->m_remaining_dependencies == 0)
+			schedule(state, successor);
+
+	if (task->m_priority == TASK_PRIORITY_BACKGROUND)
+	{
+		state.running_background_tasks--;
+
+		// A background slot is available again
+		wake_workers(state);
+	}
+
+	state.unfinished_tasks--;
+	notify_task_event(state);
+}
+
+void TaskScheduler::run_task_function(const TaskHandle& task)
+{
+	try
+	{
+		task->m_function();
+	}
+	catch (const std::exception& e)
+	{
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "A task threw an exception: %s", e.what());
+
+		task->m_exception = std::current_exception();
+	}
+	catch (...)
+	{
+		g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "A task threw an unknown exception");
+
+		task->m_exception = std::current_exception();
+	}
+
+	// Releasing whatever the function captured as soon as possible
+	task->m_function = nullptr;
+}
+
+void TaskScheduler::wake_workers(SharedState& state)
+{
+	{
+		// Taking the lock so that a worker can't miss the notification
+		// between the check of its condition and going to sleep
+		std::lock_guard<std::mutex> lock(state.sleep_mutex);
+	}
+
+	state.sleep_condition.notify_one();
+}
+
+void TaskScheduler::notify_task_event(SharedState& state)
+{
+	{
+		std::lock_guard<std::mutex> lock(state.task_event_mutex);
+		state.task_event_count++;
+	}
+
+	state.task_event_condition.notify_all();
+}
+
+void TaskScheduler::rethrow_task_exception(const TaskHandle& task)
+{
+	// 'm_exception' is written before the task is marked as finished, under the mutex
+	std::exception_ptr exception;
+	{
+		std::lock_guard<std::mutex> lock(task->m_mutex);
+		exception = task->m_exception;
+	}
+
+	if (exception != nullptr)
+		std::rethrow_exception(exception);
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum TaskPriority
+{
+	// Regular tasks, executed by any worker as soon as their dependencies are done
+	TASK_PRIORITY_NORMAL,
+	// Long running tasks that may block for a long time (background kernel precompilation
+	// for example). Only a limited number of workers execute these tasks at the same time
+	// so that they can never take the whole pool
+	TASK_PRIORITY_BACKGROUND,
+	// Tasks that may wait (with wait_until()) for other tasks of the same kind to make progress.
+	// These tasks are never executed by a worker helping in wait() / wait_until(): they would
+	// end up blocked on top of the task that the worker was executing and that they wait for
+	TASK_PRIORITY_BLOCKING
+};
+
+class TaskScheduler;
+
+/**
+ * A node of the task graph.
+ *
+ * A task is executed by the scheduler once all the tasks it depends on are finished.
+ * Tasks are only manipulated through TaskHandle
+ */
+class Task
+{
+public:
+	bool is_finished() const;
+
+private:
+	friend class TaskScheduler;
+
+	std::function<void()> m_function;
+	TaskPriority m_priority = TASK_PRIORITY_NORMAL;
+
+	// Number of dependencies that are not finished yet + 1 while the task is being submitted
+	std::atomic<int> m_remaining_dependencies = 1;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_finished_condition;
+	bool m_finished = false;
+	// Exception thrown by 'm_function', rethrown to the threads that wait on the task
+	std::exception_ptr m_exception = nullptr;
+	// Tasks that depend on this one
+	std::vector<std::shared_ptr<Task>> m_successors;
+};
+
+using TaskHandle = std::shared_ptr<Task>;
+
+/**
+ * Handle on a task that returns a value of type T.
+ *
+ * Waiting on the result with get() goes through the scheduler such
+ * that a worker thread waiting on a result executes other tasks in the meantime.
+ * An exception thrown by the task is stored in the future and rethrown by get()
+ */
+template <typename T>
+class TaskFuture
+{
+public:
+	TaskFuture() {}
+	TaskFuture(TaskHandle handle, std::shared_future<T> future) : m_handle(handle), m_future(future) {}
+
+	const TaskHandle& get_handle() const { return m_handle; }
+	bool is_ready() const { return m_handle != nullptr && m_handle->is_finished(); }
+
+	/**
+	 * Waits for the task and returns its result.
+	 * Rethrows the exception thrown by the task if any
+	 */
+	decltype(auto) get() const;
+
+private:
+	TaskHandle m_handle = nullptr;
+	std::shared_future<T> m_future;
+};
+
+/**
+ * Task graph executor with a fixed pool of worker threads.
+ *
+ * Each worker has its own queue of tasks. Tasks submitted from a worker
+ * are pushed to the queue of that worker and tasks submitted from other threads
+ * go to a shared queue. A worker executes the tasks of its own queue first
+ * (most recent first) and steals from the shared queue and then from the other
+ * workers (oldest first) when its queue is empty.
+ *
+ * A worker that waits on a task (or on a future) executes other tasks while waiting
+ * so that tasks waiting on other tasks never deadlock the pool.
+ *
+ * An exception thrown by a task doesn't escape the worker: it is stored in the task
+ * and rethrown to the threads waiting on the task (wait() or TaskFuture::get())
+ */
+class TaskScheduler
+{
+public:
+	TaskScheduler();
+	~TaskScheduler();
+
+	/**
+	 * Submits a task that will be executed once all 'dependencies' are finished.
+	 * The returned handle can be used to wait for the task or as a dependency
+	 * of other tasks
+	 */
+	TaskHandle submit(std::function<void()> function, const std::vector<TaskHandle>& dependencies = {}, TaskPriority priority = TASK_PRIORITY_NORMAL);
+
+	/**
+	 * Same as submit() but the value returned by 'function' can be retrieved with the returned future
+	 */
+	template <typename Fn>
+	TaskFuture<std::invoke_result_t<Fn>> submit_with_future(Fn function, const std::vector<TaskHandle>& dependencies = {}, TaskPriority priority = TASK_PRIORITY_NORMAL)
+	{
+		using ReturnType = std::invoke_result_t<Fn>;
+
+		std::shared_ptr<std::packaged_task<ReturnType()>> packaged_task = std::make_shared<std::packaged_task<ReturnType()>>(std::move(function));
+		std::shared_future<ReturnType> future = packaged_task->get_future().share();
+
+		TaskHandle handle = submit([packaged_task]() { (*packaged_task)(); }, dependencies, priority);
+
+		return TaskFuture<ReturnType>(handle, future);
+	}
+
+	/**
+	 * Blocks until the given task is finished and rethrows the exception
+	 * that the task threw, if any.
+	 *
+	 * If called from a worker thread, the worker executes other tasks while waiting
+	 */
+	void wait(const TaskHandle& task);
+	void wait(const std::vector<TaskHandle>& tasks);
+
+	/**
+	 * Blocks until 'predicate' returns true.
+	 *
+	 * The predicate is evaluated again each time a task finishes or is scheduled so it must
+	 * only depend on state that the tasks modify. Same as wait(), a worker thread executes
+	 * other tasks while waiting
+	 */
+	void wait_until(const std::function<bool()>& predicate);
+
+	/**
+	 * Blocks until all the tasks submitted so far, and the tasks they submit, are finished.
+	 *
+	 * Must not be called from a task, it would wait for itself
+	 */
+	void wait_for_all_tasks();
+
+	/**
+	 * If true, tasks are executed directly in submit() on the calling thread. Useful for debugging.
+	 *
+	 * Tasks can only depend on finished tasks in that mode
+	 */
+	void set_monothread(bool monothread);
+	bool is_monothread() const;
+
+	int get_worker_count() const;
+
+	/**
+	 * Returns true if the calling thread is one of the worker threads of the scheduler
+	 */
+	bool is_worker_thread() const;
+
+private:
+	struct TaskQueue
+	{
+		std::mutex mutex;
+		std::deque<TaskHandle> tasks;
+	};
+
+	// State shared with the worker threads. Kept alive by the workers
+	// so that the scheduler can be destroyed at exit while a worker is still
+	// busy with a long task: the workers are detached and exit after their current task
+	struct SharedState
+	{
+		std::vector<std::unique_ptr<TaskQueue>> worker_queues;
+		TaskQueue shared_queue;
+		TaskQueue background_queue;
+		TaskQueue blocking_queue;
+
+		std::atomic<int> pending_normal_tasks = 0;
+		std::atomic<int> pending_blocking_tasks = 0;
+		std::atomic<int> pending_background_tasks = 0;
+		std::atomic<int> running_background_tasks = 0;
+		int max_running_background_tasks = 1;
+
+		// Tasks submitted and not finished yet, including the
+		// tasks still waiting for their dependencies
+		std::atomic<int> unfinished_tasks = 0;
+
+		std::mutex sleep_mutex;
+		std::condition_variable sleep_condition;
+		bool stop = false;
+
+		// Incremented and notified each time a task finishes or is scheduled, see wait_until()
+		std::mutex task_event_mutex;
+		std::condition_variable task_event_condition;
+		unsigned long long int task_event_count = 0;
+	};
+
+	void start_workers();
+
+	static void worker_loop(std::shared_ptr<SharedState> state, int worker_index);
+	/**
+	 * 'from_worker_loop' is false when the worker is looking for a task while waiting. Background
+	 * and blocking tasks are only executed directly from the loop of the workers
+	 */
+	static TaskHandle find_task(SharedState& state, int worker_index, bool from_worker_loop);
+	static TaskHandle pop_task(TaskQueue& queue, bool from_back);
+	static void schedule(SharedState& state, const TaskHandle& task);
+	static void execute(SharedState& state, const TaskHandle& task);
+	static void run_task_function(const TaskHandle& task);
+	static void wake_workers(SharedState& state);
+	static void notify_task_event(SharedState& state);
+	static void rethrow_task_exception(const TaskHandle& task);
+
+	std::shared_ptr<SharedState> m_state;
+	std::vector<std::thread> m_workers;
+	std::once_flag m_workers_started;
+
+	bool m_monothread = false;
+};
+
+extern TaskScheduler g_task_scheduler;
+
+template <typename T>
+decltype(auto) TaskFuture<T>::get() const
+{
+	g_task_scheduler.wait(m_handle);
+
+	return m_future.get();
+}
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Threads/TextureReadingConcurrency.h"
+
+#include <algorithm>
+
+void TextureReadingConcurrency::setup(int initial_readers, int max_readers, bool adaptive)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_max_readers = std::max(1, max_readers);
+    m_active_readers = std::clamp(initial_readers, 1, m_max_readers);
+    m_adaptive = adaptive;
+
+    m_last_change = 0;
+    m_previous_throughput = -1.0f;
+
+    m_start_time = std::chrono::steady_clock::now();
+    m_window_start_time = m_start_time;
+    m_window_bytes = 0;
+    m_window_read_time_ms = 0.0f;
+    m_window_decode_time_ms = 0.0f;
+    m_total_bytes = 0;
+}
+
+bool TextureReadingConcurrency::is_reader_active(int reader_index) const
+{
+    return reader_index < m_active_readers.load();
+}
+
+int TextureReadingConcurrency::get_active_readers() const
+{
+    return m_active_readers.load();
+}
+
+void TextureReadingConcurrency::record_read(size_t byte_count, float read_time_ms)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_window_bytes += byte_count;
+    m_window_read_time_ms += read_time_ms;
+    m_total_bytes += byte_count;
+
+    if (!m_adaptive)
+        return;
+
+    float window_duration_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_window_start_time).count();
+    if (window_duration_ms >= WINDOW_DURATION_MS)
+        end_window(window_duration_ms);
+}
+
+void TextureReadingConcurrency::record_decode(float decode_time_ms)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_window_decode_time_ms += decode_time_ms;
+}
+
+float TextureReadingConcurrency::get_average_throughput() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    float duration_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_start_time).count();
+    if (duration_ms <= 0.0f)
+        return 0.0f;
+
+    return m_total_bytes / 1000000.0f / (duration_ms / 1000.0f);
+}
+
+void TextureReadingConcurrency::end_window(float window_duration_ms)
+{
+    float throughput = m_window_bytes / 1000000.0f / (window_duration_ms / 1000.0f);
+    bool cpu_bound = m_window_decode_time_ms > m_window_read_time_ms;
+
+    int change;
+    if (m_previous_throughput < 0.0f)
+        // First window, trying with one more reader
+        change = 1;
+    else if (throughput > m_previous_throughput * (1.0f + THROUGHPUT_TOLERANCE))
+        // Better, continuing in the same direction
+        change = m_last_change != 0 ? m_last_change : 1;
+    else if (throughput < m_previous_throughput * (1.0f - THROUGHPUT_TOLERANCE))
+        // Worse, going back
+        change = m_last_change != 0 ? -m_last_change : -1;
+    else
+        change = cpu_bound ? 1 : -1;
+
+    int active_readers = std::clamp(m_active_readers.load() + change, 1, m_max_readers);
+    m_last_change = active_readers - m_active_readers.load();
+    m_active_readers = active_readers;
+
+    m_previous_throughput = throughput;
+    m_window_start_time = std::chrono::steady_clock::now();
+    m_window_bytes = 0;
+    m_window_read_time_ms = 0.0f;
+    m_window_decode_time_ms = 0.0f;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef TEXTURE_READING_CONCURRENCY_H
+#define TEXTURE_READING_CONCURRENCY_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+/**
+ * Number of threads reading the texture files of the scene at the same time,
+ * adjusted while the textures are loading.
+ *
+ * All the reading threads are started at the beginning of the loading but only
+ * the first 'get_active_readers()' of them read files, the others wait.
+ *
+ * The read throughput (MB/s) is measured over windows of a few hundred milliseconds
+ * and the number of readers is adjusted by one reader after each window:
+ *  - in the same direction as the last change if the throughput improved
+ *  - in the other direction if the throughput dropped (too many random reads on an HDD for example)
+ *  - if the throughput didn't change, a reader is added when the loading is CPU bound
+ *    (decoding the textures takes longer than reading them) because the readers also
+ *    decode while they wait. A reader is removed otherwise since it didn't help
+ */
+class TextureReadingConcurrency
+{
+public:
+    static constexpr float WINDOW_DURATION_MS = 250.0f;
+    // Relative change of the throughput between two windows
+    // under which the throughput is considered unchanged
+    static constexpr float THROUGHPUT_TOLERANCE = 0.05f;
+
+    /**
+     * If 'adaptive' is false, the number of readers stays 'initial_readers'
+     */
+    void setup(int initial_readers, int max_readers, bool adaptive);
+
+    /**
+     * Whether or not the reading thread 'reader_index' (in [0, max_readers - 1])
+     * is allowed to read files at the moment
+     */
+    bool is_reader_active(int reader_index) const;
+    int get_active_readers() const;
+
+    /**
+     * To be called by the readers after reading a texture (file or texture cache)
+     */
+    void record_read(size_t byte_count, float read_time_ms);
+    /**
+     * To be called after decoding a texture
+     */
+    void record_decode(float decode_time_ms);
+
+    /**
+     * Average read throughput since setup() in MB/s
+     */
+    float get_average_throughput() const;
+
+private:
+    /**
+     * Ends the current measurement window and adjusts the number of readers.
+     * Must be called with 'm_mutex' locked
+     */
+    void end_window(float window_duration_ms);
+
+    std::atomic<int> m_active_readers = 1;
+    int m_max_readers = 1;
+    bool m_adaptive = true;
+
+    mutable std::mutex m_mutex;
+    // 1 if the last change added a reader, -1 if it removed one, 0 if it didn't change anything
+    int m_last_change = 0;
+    // Throughput in MB/s of the previous window. Negative if there is no previous window
+    float m_previous_throughput = -1.0f;
+
+    std::chrono::steady_clock::time_point m_start_time;
+    std::chrono::steady_clock::time_point m_window_start_time;
+    size_t m_window_bytes = 0;
+    float m_window_read_time_ms = 0.0f;
+    float m_window_decode_time_ms = 0.0f;
+    size_t m_total_bytes = 0;
+};
+
+#endif
@@ -5,8 +5,17 @@
 
 #include "Image/Image.h"
 #include "Compiler/GPUKernel.h"
+#include "Scene/SceneCache.h"
+#include "Threads/TaskScheduler.h"
+#include "Threads/ThreadState.h"
+#include "UI/ImGui/ImGuiLogger.h"
+
+#include <chrono>
+#include <fstream>
 #include "Threads/ThreadFunctions.h"
 
+extern ImGuiLogger g_imgui_logger;
+
 void ThreadFunctions::compile_kernel(GPUKernel& kernel, std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets)
 {
     kernel.compile(hiprt_orochi_ctx, func_name_sets);
@@ -22,133 +31,253 @@ void ThreadFunctions::compile_kernel_silent(GPUKernel& kernel, std::shared_ptr<H
     kernel.compile_silent(hiprt_orochi_ctx, func_name_sets);
 }
 
-void ThreadFunctions::precompile_kernel(const std::string& kernel_function_name, const std::string& kernel_filepath, GPUKernelCompilerOptions options, std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets)
+/**
+ * Number of channels a texture of the given type is read with
+ */
+static int get_texture_channel_count(const Scene& parsed_scene, aiTextureType type, int material_index)
 {
-    OROCHI_CHECK_ERROR(oroCtxSetCurrent(hiprt_orochi_ctx->orochi_ctx));
+    switch (type)
+    {
+    case aiTextureType_BASE_COLOR:
+    case aiTextureType_DIFFUSE:
+        // 4 Channels because we may want the alpha for transparency handling
+        return 4;
 
-    GPUKernel kernel(kernel_filepath, kernel_function_name);
-    kernel.set_precompiled(true);
-    kernel.get_kernel_options() = options;
-    kernel.compile_silent(hiprt_orochi_ctx, func_name_sets);
+    case aiTextureType_NORMALS:
+    case aiTextureType_HEIGHT:
+        // Don't need the alpha
+        // TODO we only need 3 channels here but it's tricky to handle 3 channels texture with HIP/CUDA. Supported formats are only 1, 2, 4 channels, not three
+        return 4;
+
+    case aiTextureType_DIFFUSE_ROUGHNESS:
+        if (parsed_scene.materials[material_index].roughness_metallic_texture_index != MaterialUtils::NO_TEXTURE)
+            // This means we have a packed metallic/roughness texture
+            return 4;
+        else
+            // Otherwise, we don't have a packed metallic/roughness texture so only 1 channel just for the roughness
+            return 1;
+
+    case aiTextureType_EMISSIVE:
+        // TODO we only need 3 channels here but it's tricky to handle 3 channels texture with HIP/CUDA. Supported formats are only 1, 2, 4 channels, not three
+        return 4;
+
+    default:
+        return 1;
+    }
 }
 
-void ThreadFunctions::load_scene_texture(Scene& parsed_scene, std::string scene_path, const std::vector<std::pair<aiTextureType, std::string>>& tex_paths, const std::vector<int>& material_indices, int thread_index, int nb_threads)
+/**
+ * Block compression format used for a texture of the given type read with 'channel_count' channels
+ */
+static TextureCompressionFormat get_texture_compression_format(aiTextureType type, int channel_count)
 {
-    // Preparing the scene_filepath so that it's ready to be appended with the texture name
-    std::string corrected_filepath;
-    corrected_filepath = scene_path;
-    corrected_filepath = corrected_filepath.substr(0, corrected_filepath.rfind('/') + 1);
-
-    // While loop here so that a single thread can parse multiple textures
-    while (thread_index < parsed_scene.textures.size())
+    switch (type)
     {
-        std::string full_path = corrected_filepath + tex_paths[thread_index].second;
-        aiTextureType type = tex_paths[thread_index].first;
-        int nb_channels;
+    case aiTextureType_BASE_COLOR:
+    case aiTextureType_DIFFUSE:
+        // BC7 keeps the alpha for the alpha testing
+        return TEXTURE_COMPRESSION_BC7;
 
-        switch (type)
-        {
-        case aiTextureType_BASE_COLOR:
-        case aiTextureType_DIFFUSE:
-            // 4 Channels because we may want the alpha for transparency handling
-            nb_channels = 4;
-            break;
+    case aiTextureType_NORMALS:
+    case aiTextureType_HEIGHT:
+        // Only X and Y are stored, Z is reconstructed when sampling the normal map
+        return TEXTURE_COMPRESSION_BC5;
 
-        case aiTextureType_NORMALS:
-        case aiTextureType_HEIGHT:
-            // Don't need the alpha
-            // TODO we only need 3 channels here but it's tricky to handle 3 channels texture with HIP/CUDA. Supported formats are only 1, 2, 4 channels, not three
-            nb_channels = 4;
-            break;
+    case aiTextureType_EMISSIVE:
+        return TEXTURE_COMPRESSION_BC1;
 
-        case aiTextureType_DIFFUSE_ROUGHNESS:
-            if (parsed_scene.materials[material_indices[thread_index]].roughness_metallic_texture_index != MaterialUtils::NO_TEXTURE)
-            {
-                // This means we have a packed metallic/roughness texture
-                nb_channels = 4;
+    default:
+        // Packed metallic / roughness textures or single channel textures
+        return channel_count == 4 ? TEXTURE_COMPRESSION_BC7 : TEXTURE_COMPRESSION_BC4;
+    }
+}
 
-                break;
-            }
-            else
-            {
-                // Otherwise, we don't have a packed metallic/roughness texture so only 1 channel just for the roughness
-                nb_channels = 1;
+/**
+ * Returns the path of the texture 'texture_index' with the directory of the scene prepended
+ */
+static std::string get_texture_full_path(const TextureLoadingThreadState& state, int texture_index)
+{
+    std::string scene_directory = state.scene_filepath.substr(0, state.scene_filepath.rfind('/') + 1);
 
-                break;
-            }
+    return scene_directory + state.texture_paths[texture_index].second;
+}
 
-        case aiTextureType_EMISSIVE:
-            // TODO we only need 3 channels here but it's tricky to handle 3 channels texture with HIP/CUDA. Supported formats are only 1, 2, 4 channels, not three
-            nb_channels = 4;
-            break;
+void ThreadFunctions::load_scene_texture_read_files(Scene& parsed_scene, TextureLoadingThreadState& state)
+{
+    std::vector<TaskHandle> decoding_tasks;
+    int reader_index = state.next_reading_thread_index.fetch_add(1);
+    int texture_count = state.texture_paths.size();
+
+    while (true)
+    {
+        // Waiting while this reader isn't needed, see TextureReadingConcurrency
+        g_task_scheduler.wait_until([&state, reader_index, texture_count]() {
+            return state.reading_concurrency.is_reader_active(reader_index) || state.next_texture_to_read.load() >= texture_count;
+        });
 
-        default:
-            nb_channels = 1;
+        int texture_index = state.next_texture_to_read.fetch_add(1);
+        if (texture_index >= texture_count)
             break;
-        }
 
-        Image8Bit texture = Image8Bit::read_image(full_path, nb_channels, false);
+        std::string full_path = get_texture_full_path(state, texture_index);
+        int nb_channels = get_texture_channel_count(parsed_scene, state.texture_paths[texture_index].first, state.material_indices[texture_index]);
+
+        auto start_read = std::chrono::steady_clock::now();
 
-        int material_index = material_indices[thread_index];
-        if (type == aiTextureType_EMISSIVE)
+        TextureLoadingJob job;
+        job.texture_index = texture_index;
+        if (state.use_texture_cache)
         {
-            if (texture.is_constant_color(/* threshold */ 5))
-            {
-                // The emissive texture is constant color, we can then just not use that texture and use 
-                // the emission filed of the material to store the emission of the texture
-                parsed_scene.materials[material_index].emission_texture_index = MaterialUtils::CONSTANT_EMISSIVE_TEXTURE;
+            aiTextureType type = state.texture_paths[texture_index].first;
+            TextureCompressionFormat compression_format = state.compress_textures ? get_texture_compression_format(type, nb_channels) : TEXTURE_COMPRESSION_NONE;
 
-                ColorRGBA32F emission_rgba = texture.sample_rgba32f(make_float2(0, 0));
-                parsed_scene.materials[material_index].emission = ColorRGB32F(emission_rgba.r, emission_rgba.g, emission_rgba.b);
-            }
-            else
-                // If not emissive texture special case, we can actually read the texture
-                parsed_scene.textures[thread_index] = texture;
+            job.cache_key = TextureCache::compute_cache_key(full_path, nb_channels, compression_format, state.generate_mipmaps);
         }
+
+        if (job.cache_key != 0 && TextureCache::read_texture(job.cache_key, job.texture, job.analysis))
+            job.from_cache = true;
         else
         {
-            // If not emissive texture special case, we can actually read the texture
-
-            if (type == aiTextureType_DIFFUSE || type == aiTextureType_BASE_COLOR)
+            std::ifstream file(full_path, std::ios::binary | std::ios::ate);
+            if (file.is_open())
             {
-                // For base color textures, we're going to search for alpha transparency in the texture
-                unsigned char texture_fully_opaque = texture.is_fully_opaque() ? 1 : 0;
-                parsed_scene.material_has_opaque_base_color_texture[material_index] = texture_fully_opaque;
+                job.encoded_data.resize(file.tellg());
+                file.seekg(0);
+                file.read(reinterpret_cast<char*>(job.encoded_data.data()), job.encoded_data.size());
             }
-            parsed_scene.textures[thread_index] = texture;
+            // If the file couldn't be read, the texture is still decoded with
+            // no data and the decoding will log the error
         }
 
-        thread_index += nb_threads;
+        size_t job_size = job.byte_size();
+        state.reading_concurrency.record_read(job_size, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_read).count());
+
+        // Waiting for the decoding tasks to catch up if too much has been read already.
+        // The decoding tasks are executed by this thread in the meantime
+        g_task_scheduler.wait_until([&state, job_size]() {
+            size_t in_flight = state.bytes_in_flight.load();
+
+            return in_flight == 0 || in_flight + job_size <= state.max_bytes_in_flight;
+        });
+        state.bytes_in_flight += job_size;
+
+        std::shared_ptr<TextureLoadingJob> shared_job = std::make_shared<TextureLoadingJob>(std::move(job));
+        decoding_tasks.push_back(g_task_scheduler.submit([&parsed_scene, &state, shared_job, job_size]() {
+            auto start_decode = std::chrono::steady_clock::now();
+            ThreadFunctions::load_scene_texture_decode(parsed_scene, state, *shared_job);
+            state.reading_concurrency.record_decode(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_decode).count());
+
+            state.bytes_in_flight -= job_size;
+        }));
+    }
+
+    // Everything that needs the textures depends on the reading threads so
+    // the reading threads are only done once all their textures are decoded
+    g_task_scheduler.wait(decoding_tasks);
+
+    if (state.finished_reading_threads.fetch_add(1) + 1 != state.nb_reading_threads)
+        return;
+
+    // Last reading thread done, all the textures have been read and decoded
+    if (texture_count > 0)
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Textures read at %.1fMB/s, %d reading thread(s) at the end of the loading",
+            state.reading_concurrency.get_average_throughput(), state.reading_concurrency.get_active_readers());
+
+    if (state.compress_textures)
+    {
+        size_t uncompressed_size = state.uncompressed_textures_bytes.load();
+        size_t compressed_size = state.compressed_textures_bytes.load();
+
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Texture compression: %.1fMB --> %.1fMB (%.1fMB saved)",
+            uncompressed_size / 1000000.0f, compressed_size / 1000000.0f, (uncompressed_size - compressed_size) / 1000000.0f);
     }
 }
 
-void ThreadFunctions::load_scene_parse_emissive_triangles(const aiScene* scene, Scene& parsed_scene)
+void ThreadFunctions::load_scene_texture_decode(Scene& parsed_scene, TextureLoadingThreadState& state, TextureLoadingJob& job)
 {
-    // Looping over all the meshes
-    int current_triangle_index = 0;
-    for (int mesh_index = 0; mesh_index < scene->mNumMeshes; mesh_index++)
+    int texture_index = job.texture_index;
+    aiTextureType type = state.texture_paths[texture_index].first;
+    int material_index = state.material_indices[texture_index];
+
+    if (!job.from_cache)
     {
-        aiMesh* mesh = scene->mMeshes[mesh_index];
-        int material_index = mesh->mMaterialIndex;
+        std::string full_path = get_texture_full_path(state, texture_index);
+        int nb_channels = get_texture_channel_count(parsed_scene, type, material_index);
+
+        job.texture = Image8Bit::read_image_from_memory(job.encoded_data.data(), job.encoded_data.size(), full_path, nb_channels, false);
+        job.encoded_data.clear();
+        job.encoded_data.shrink_to_fit();
+
+        job.analysis = TextureCache::analyze_texture(job.texture);
+
+        Image8Bit& texture = job.texture;
+        if (state.generate_mipmaps)
+            // Before the compression so that the mip levels are built from the uncompressed texels
+            texture.generate_mipmaps();
 
-        CPUMaterial& renderer_material = parsed_scene.materials[material_index];
+        // The GPUs only support block compressed textures whose size is a multiple of the block size
+        bool compressible = texture.width % TextureCompression::BLOCK_SIZE == 0 && texture.height % TextureCompression::BLOCK_SIZE == 0;
+        if (state.compress_textures && compressible && !(type == aiTextureType_EMISSIVE && job.analysis.is_constant_color))
+            texture.compress(get_texture_compression_format(type, texture.channels));
 
-        // If the mesh is emissive, we're going to add the indices of its faces to the emissive triangles
-        // of the scene such that the triangles can be importance sampled (direct lighting estimation / next-event estimation)
-        //
-        // We are not importance sampling emissive texture so if the mesh has an emissive texture attached, we're
-        // not adding its triangles to the list of emissive triangles
-        bool is_mesh_emissive = renderer_material.is_emissive() && !renderer_material.emissive_texture_used;
+        // The texture is cached after the compression so that
+        // the next loadings don't have to compress it again
+        if (job.cache_key != 0)
+            TextureCache::write_texture(job.cache_key, texture, job.analysis);
+    }
+
+    Image8Bit& texture = job.texture;
+    if (texture.get_compression_format() != TEXTURE_COMPRESSION_NONE)
+    {
+        state.uncompressed_textures_bytes += Image8Bit::get_level_byte_size(texture.width, texture.height, texture.channels, TEXTURE_COMPRESSION_NONE, 0);
+        state.compressed_textures_bytes += texture.data().size();
+    }
 
-        if (is_mesh_emissive)
+    if (type == aiTextureType_EMISSIVE)
+    {
+        if (job.analysis.is_constant_color)
         {
-            for (int face_index = 0; face_index < mesh->mNumFaces; face_index++, current_triangle_index++)
-                // Pushing the index of the current triangle if we're looping on an emissive mesh
-                parsed_scene.emissive_triangle_indices.push_back(current_triangle_index);
+            // The emissive texture is constant color, we can then just not use that texture and use 
+            // the emission filed of the material to store the emission of the texture
+            parsed_scene.materials[material_index].emission_texture_index = MaterialUtils::CONSTANT_EMISSIVE_TEXTURE;
+
+            ColorRGBA32F emission_rgba = texture.sample_rgba32f(make_float2(0, 0));
+            parsed_scene.materials[material_index].emission = ColorRGB32F(emission_rgba.r, emission_rgba.g, emission_rgba.b);
         }
         else
-            current_triangle_index += mesh->mNumFaces;
+            // If not emissive texture special case, we can actually read the texture
+            parsed_scene.textures[texture_index] = std::move(texture);
     }
+    else
+    {
+        // If not emissive texture special case, we can actually read the texture
+
+        if (type == aiTextureType_DIFFUSE || type == aiTextureType_BASE_COLOR)
+        {
+            // For base color textures, we're going to search for alpha transparency in the texture
+            unsigned char texture_fully_opaque = job.analysis.is_fully_opaque ? 1 : 0;
+            parsed_scene.material_has_opaque_base_color_texture[material_index] = texture_fully_opaque;
+        }
+        parsed_scene.textures[texture_index] = std::move(texture);
+    }
+}
+
+void ThreadFunctions::load_scene_parse_emissive_triangles_from_material_indices(Scene& parsed_scene)
+{
+    for (int triangle_index = 0; triangle_index < parsed_scene.material_indices.size(); triangle_index++)
+    {
+        const CPUMaterial& renderer_material = parsed_scene.materials[parsed_scene.material_indices[triangle_index]];
+
+        // We are not importance sampling emissive textures so the triangles of
+        // materials with an emissive texture are not added to the emissive triangles
+        if (renderer_material.is_emissive() && !renderer_material.emissive_texture_used)
+            parsed_scene.emissive_triangle_indices.push_back(triangle_index);
+    }
+}
+
+void ThreadFunctions::load_scene_write_cache(Scene& parsed_scene, unsigned long long int cache_key, std::vector<std::pair<aiTextureType, std::string>> texture_paths, std::vector<int> texture_material_indices)
+{
+    SceneCache::write_scene(cache_key, parsed_scene, texture_paths, texture_material_indices);
 }
 
 //void ThreadFunctions::load_scene_parse_full_opaque_materials(const aiScene* scene, Scene& parsed_scene)
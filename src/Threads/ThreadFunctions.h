@@ -8,20 +8,33 @@
 
 #include "Renderer/GPURenderer.h"
 
+struct TextureLoadingJob;
+struct TextureLoadingThreadState;
+
 class ThreadFunctions
 {
 public:
 	static void compile_kernel(GPUKernel& kernel, std::shared_ptr<HIPRTOrochiCtx> hiprt_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets);
 	static void compile_kernel_no_func_sets(GPUKernel& kernel, std::shared_ptr<HIPRTOrochiCtx> hiprt_ctx);
 	static void compile_kernel_silent(GPUKernel& kernel, std::shared_ptr<HIPRTOrochiCtx> hiprt_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets);
-	static void precompile_kernel(const std::string& kernel_function_name, const std::string& kernel_filepath, GPUKernelCompilerOptions options, std::shared_ptr<HIPRTOrochiCtx> hiprt_ctx, const std::vector<hiprtFuncNameSet>& func_name_sets);
 
-	static void load_scene_texture(Scene& parsed_scene, std::string scene_path, const std::vector<std::pair<aiTextureType, std::string>>& tex_paths, const std::vector<int>& material_indices, int thread_index, int nb_threads);
+	/**
+	 * The reading threads read the texture files (or the decoded textures from the texture cache)
+	 * and start one decoding task per texture read such that reading from disk and
+	 * decoding overlap. A reading thread returns once all its textures are decoded.
+	 */
+	static void load_scene_texture_read_files(Scene& parsed_scene, TextureLoadingThreadState& state);
+	static void load_scene_texture_decode(Scene& parsed_scene, TextureLoadingThreadState& state, TextureLoadingJob& job);
 
 	/**
-	 * Frees the memory allocated by the aiScene needed when parsing the scene
+	 * Finds the emissive triangles of the scene from the per-triangle material indices.
+	 * Must run after the textures are loaded since constant emissive textures make their material emissive
+	 */
+	static void load_scene_parse_emissive_triangles_from_material_indices(Scene& parsed_scene);
+	/**
+	 * Writes the fully loaded scene to the scene cache file of the given key
 	 */
-	static void load_scene_parse_emissive_triangles(const aiScene* scene, Scene& parsed_scene);
+	static void load_scene_write_cache(Scene& parsed_scene, unsigned long long int cache_key, std::vector<std::pair<aiTextureType, std::string>> texture_paths, std::vector<int> texture_material_indices);
 	static void load_scene_parse_full_opaque_materials(const aiScene* scene, Scene& parsed_scene);
 
 	/**
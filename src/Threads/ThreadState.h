@@ -6,12 +6,74 @@
 #ifndef THREAD_STATE_H
 #define THREAD_STATE_H
 
+#include "Image/Image.h"
+#include "Image/TextureCache.h"
+#include "Threads/TextureReadingConcurrency.h"
+
+#include <atomic>
+
+/**
+ * A texture on its way from the threads that read the texture
+ * files to the tasks that decode the textures
+ */
+struct TextureLoadingJob
+{
+    int texture_index = -1;
+    // Key of the texture in the texture cache. 0 if the texture cache isn't used
+    unsigned long long int cache_key = 0;
+
+    // True if the texture was found in the texture cache. 'texture' and 'analysis'
+    // are then already filled and there's nothing to decode
+    bool from_cache = false;
+    Image8Bit texture;
+    TextureAnalysis analysis;
+
+    // Content of the texture file if the texture wasn't in the cache
+    std::vector<unsigned char> encoded_data;
+
+    size_t byte_size() const
+    {
+        return encoded_data.size() + texture.data().size();
+    }
+};
+
 struct TextureLoadingThreadState
 {
     std::vector<std::pair<aiTextureType, std::string>> texture_paths;
     std::vector<int> material_indices;
 
     std::string scene_filepath;
+
+    bool use_texture_cache = true;
+    // See SceneParserOptions::compress_textures
+    bool compress_textures = false;
+    // See SceneParserOptions::generate_texture_mipmaps
+    bool generate_mipmaps = false;
+
+    // Number of threads started for reading the texture files
+    // and how many of them have read all their textures
+    int nb_reading_threads = 1;
+    std::atomic<int> finished_reading_threads = 0;
+    // Each reading thread takes an index in [0, nb_reading_threads - 1] when it starts
+    std::atomic<int> next_reading_thread_index = 0;
+    // How many of the reading threads actually read at the same time
+    TextureReadingConcurrency reading_concurrency;
+
+    // Size of the textures before / after compression, for the memory report
+    std::atomic<size_t> uncompressed_textures_bytes = 0;
+    std::atomic<size_t> compressed_textures_bytes = 0;
+
+    // Index of the next texture to be read from disk by the reading threads
+    std::atomic<int> next_texture_to_read = 0;
+
+    // Size of the textures read by the reading threads and not decoded yet.
+    // 
+    // The reading threads wait while this is above 'max_bytes_in_flight' so that they
+    // don't read the whole scene in memory when the decoding can't keep up.
+    // A texture is always read if nothing is in flight so that a texture
+    // bigger than the budget can still go through
+    std::atomic<size_t> bytes_in_flight = 0;
+    size_t max_bytes_in_flight = 256 * 1024 * 1024;
 };
 
 #endif
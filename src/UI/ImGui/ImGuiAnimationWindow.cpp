@@ -27,6 +27,7 @@ void ImGuiAnimationWindow::draw()
 	draw_frame_sequence_rendering_panel();
 	draw_camera_panel();
 	draw_envmap_panel();
+	draw_objects_panel();
 
 	ImGui::PopItemWidth();
 
@@ -264,3 +265,102 @@ void ImGuiAnimationWindow::draw_envmap_panel()
 		ImGui::TreePop();
 	}
 }
+
+void ImGuiAnimationWindow::draw_objects_panel()
+{
+	if (ImGui::CollapsingHeader("Objects"))
+	{
+		ImGui::TreePush("Objects animation window tree");
+
+		InstanceAnimation& instance_animation = m_renderer->get_instance_animation();
+		const std::vector<std::string>& mesh_names = m_renderer->get_mesh_names();
+
+		static int selected_instance = 0;
+		if (selected_instance >= instance_animation.get_instance_count())
+			selected_instance = 0;
+
+		ImGui::Text("Objects");
+		if (ImGui::BeginListBox("##animated_objects", ImVec2(-FLT_MIN, 7 * ImGui::GetTextLineHeightWithSpacing())))
+		{
+			for (int n = 0; n < instance_animation.get_instance_count(); n++)
+			{
+				const bool is_selected = (selected_instance == n);
+
+				int mesh_index = instance_animation.get_instance_mesh_index(n);
+				std::string object_text = mesh_names[mesh_index] + " (instance " + std::to_string(n) + ")";
+				if (m_renderer->is_mesh_emissive(mesh_index))
+					object_text += " [emissive]";
+				if (ImGui::Selectable(object_text.c_str(), is_selected))
+					selected_instance = n;
+
+				// Set the initial focus when opening the combo (scrolling + keyboard navigation focus)
+				if (is_selected)
+					ImGui::SetItemDefaultFocus();
+			}
+			ImGui::EndListBox();
+		}
+
+		if (instance_animation.get_instance_count() == 0)
+		{
+			ImGui::TreePop();
+
+			return;
+		}
+
+		int mesh_index = instance_animation.get_instance_mesh_index(selected_instance);
+		bool is_emissive = m_renderer->is_mesh_emissive(mesh_index);
+
+		ImGui::Dummy(ImVec2(0.0f, 20.0f));
+		ImGui::BeginDisabled(is_emissive);
+		float3 translation = instance_animation.get_instance_translation(selected_instance);
+		if (ImGui::DragFloat3("Translation", &translation.x, 0.01f))
+		{
+			instance_animation.set_instance_translation(m_renderer.get(), selected_instance, translation);
+
+			m_render_window->set_render_dirty(true);
+		}
+		ImGuiRenderer::show_help_marker("World space translation of the object on top of its "
+										"transform in the scene file. Only the top level BVH of "
+										"the scene is rebuilt.");
+
+		float mesh_scale = instance_animation.get_mesh_scale(mesh_index);
+		if (ImGui::SliderFloat("Mesh scale", &mesh_scale, 0.5f, 1.5f))
+		{
+			instance_animation.set_mesh_scale(m_renderer.get(), mesh_index, mesh_scale);
+
+			m_render_window->set_render_dirty(true);
+		}
+		ImGuiRenderer::show_help_marker("Scales the vertices of the mesh of the object around its "
+										"center. All the instances of the mesh are scaled. The BVH "
+										"of the mesh is refitted, not rebuilt, so large scales degrade "
+										"the performance of the ray tracing.");
+
+		ImGui::Dummy(ImVec2(0.0f, 20.0f));
+		bool is_animated = instance_animation.animate && instance_animation.get_animated_instance() == selected_instance;
+		if (ImGui::Checkbox("Oscillate", &is_animated))
+		{
+			if (is_animated)
+			{
+				instance_animation.set_animated_instance(m_renderer.get(), selected_instance);
+				instance_animation.animate = true;
+			}
+			else
+				instance_animation.animate = false;
+		}
+		ImGuiRenderer::show_help_marker("Moves the object back and forth around its position "
+										"when the animations are enabled. Only one object "
+										"can oscillate at a time.");
+		if (is_animated)
+		{
+			ImGui::DragFloat3("Oscillation amplitude", &instance_animation.m_oscillation_amplitude.x, 0.01f);
+			if (ImGui::SliderFloat("Oscillation period (seconds)", &instance_animation.m_oscillation_period, 0.5f, 10.0f))
+				instance_animation.m_oscillation_period = std::max(0.001f, instance_animation.m_oscillation_period);
+		}
+		ImGui::EndDisabled();
+		if (is_emissive)
+			ImGuiRenderer::show_help_marker("Emissive objects cannot be moved because the light "
+											"sampling data structures are only built when the scene is loaded.");
+
+		ImGui::TreePop();
+	}
+}
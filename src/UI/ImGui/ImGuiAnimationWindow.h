@@ -21,6 +21,7 @@ public:
 	void draw_header();
 	void draw_camera_panel();
 	void draw_envmap_panel();
+	void draw_objects_panel();
 	void draw_frame_sequence_rendering_panel();
 
 private:
@@ -4,7 +4,6 @@
  */
 
 #include "Compiler/GPUKernelCompilerOptions.h"
-#include "Threads/ThreadManager.h"
 #include "UI/ImGui/ImGuiRenderer.h"
 #include "UI/RenderWindow.h"
 
@@ -7,7 +7,7 @@
 #include "HostDeviceCommon/RenderSettings.h"
 #include "Renderer/GPURenderer.h"
 #include "Scene/CameraAnimation.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
 #include "UI/ImGui/ImGuiRenderer.h"
 #include "UI/ImGui/ImGuiSettingsWindow.h"
 #include "UI/RenderWindow.h"
@@ -846,6 +846,19 @@ void ImGuiSettingsWindow::draw_sampling_panel()
 	{
 		ImGui::TreePush("Sampling tree");
 
+		const char* path_sampler_items[] = { "- White noise", "- Sobol (Owen scrambled)", "- Blue noise dithered Sobol" };
+		if (ImGui::Combo("Path sampler", global_kernel_options->get_raw_pointer_to_macro_value(GPUKernelCompilerOptions::PATH_SAMPLER_TYPE), path_sampler_items, IM_ARRAYSIZE(path_sampler_items)))
+		{
+			m_renderer->recompile_kernels();
+			m_render_window->set_render_dirty(true);
+		}
+		ImGuiRenderer::show_help_marker("Random numbers used for the random decisions of the paths.\n"
+										"\n"
+										"Sobol converges faster than white noise for the same number of samples.\n"
+										"Blue noise dithered Sobol distributes the remaining noise as blue noise on the "
+										"image which looks more pleasing at low sample counts.");
+		ImGui::Dummy(ImVec2(0.0f, 20.0f));
+
 		if (ImGui::CollapsingHeader("Adaptive sampling"))
 		{
 
@@ -913,6 +926,17 @@ void ImGuiSettingsWindow::draw_sampling_panel()
 				m_renderer->recompile_kernels();
 				m_render_window->set_render_dirty(true);
 			}
+
+			const char* base_strategy_items[] = { "- Uniform", "- Power", "- Light BVH" };
+			if (ImGui::Combo("Light picking", global_kernel_options->get_raw_pointer_to_macro_value(GPUKernelCompilerOptions::DIRECT_LIGHT_SAMPLING_BASE_STRATEGY), base_strategy_items, IM_ARRAYSIZE(base_strategy_items)))
+			{
+				m_renderer->recompile_kernels();
+				m_render_window->set_render_dirty(true);
+			}
+			ImGuiRenderer::show_help_marker("How the emissive triangles are picked by the light sampling strategies.\n"
+											"\n"
+											"Power picks the lights proportionally to their power.\n"
+											"Light BVH also takes the distance and orientation of the lights into account.");
 			ImGui::Dummy(ImVec2(0.0f, 20.0f));
 
 			// Display additional widgets to control the parameters of the direct light
@@ -1604,17 +1628,17 @@ void ImGuiSettingsWindow::draw_sampling_panel()
 		{
 			ImGui::TreePush("Envmap sampling tree");
 
-			const char* items[] = { "- No envmap importance sampling", "- Importance Sampling - Binary Search", "- Importance Sampling - Alias Table " };
+			const char* items[] = { "- No envmap importance sampling", "- Importance Sampling - Binary Search", "- Importance Sampling - Alias Table ", "- Importance Sampling - Guided CDF" };
 			if (ImGui::Combo("Sampling strategy", global_kernel_options->get_raw_pointer_to_macro_value(GPUKernelCompilerOptions::ENVMAP_SAMPLING_STRATEGY), items, IM_ARRAYSIZE(items)))
 			{
-				ThreadManager::start_thread("RecomputeEnvmapSamplingStructure", [this]() {
+				TaskHandle recompute_envmap_task = g_task_scheduler.submit([this]() {
 					m_renderer->get_envmap().recompute_sampling_data_structure(m_renderer.get());
 					});
 
 				m_renderer->recompile_kernels();
 				m_render_window->set_render_dirty(true);
 
-				ThreadManager::join_threads("RecomputeEnvmapSamplingStructure");
+				g_task_scheduler.wait(recompute_envmap_task);
 			}
 
 			if (global_kernel_options->get_macro_value(GPUKernelCompilerOptions::ENVMAP_SAMPLING_STRATEGY) != ESS_NO_SAMPLING)
@@ -1776,7 +1800,7 @@ void ImGuiSettingsWindow::draw_next_event_estimation_plus_plus_panel()
 				if (use_cube_grid)
 				{
 					static int grid_size = m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.x;
-					if (ImGui::SliderInt("Grid size (X, Y & Z)", &grid_size, 2, 30))
+					if (ImGui::SliderInt("Grid size (X, Y & Z)", &grid_size, 2, 64))
 					{
 						m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.x = grid_size;
 						m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.y = grid_size;
@@ -1788,11 +1812,11 @@ void ImGuiSettingsWindow::draw_next_event_estimation_plus_plus_panel()
 				else
 				{
 					ImGui::PushItemWidth(4 * ImGui::GetFontSize());
-					size_changed |= ImGui::SliderInt("##Grid_sizeX", &m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.x, 2, 30);
+					size_changed |= ImGui::SliderInt("##Grid_sizeX", &m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.x, 2, 64);
 					ImGui::SameLine();
-					size_changed |= ImGui::SliderInt("##Grid_sizeY", &m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.y, 2, 30);
+					size_changed |= ImGui::SliderInt("##Grid_sizeY", &m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.y, 2, 64);
 					ImGui::SameLine();
-					size_changed |= ImGui::SliderInt("Grid size (X/Y/Z)", &m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.z, 2, 30);
+					size_changed |= ImGui::SliderInt("Grid size (X/Y/Z)", &m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap.z, 2, 64);
 
 					// Back to default size
 					ImGui::PushItemWidth(16 * ImGui::GetFontSize());
@@ -1801,12 +1825,27 @@ void ImGuiSettingsWindow::draw_next_event_estimation_plus_plus_panel()
 				if (size_changed)
 				{
 					// Clamping
-					m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap = hippt::clamp(make_int3(2, 2, 2), make_int3(30, 30, 30), m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap);
+					m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap = hippt::clamp(make_int3(2, 2, 2), make_int3(64, 64, 64), m_renderer->get_nee_plus_plus_data().grid_dimensions_no_envmap);
 
 					m_renderer->reset_nee_plus_plus();
 					m_render_window->set_render_dirty(true);
 				}
 
+				static int hash_table_size_log2 = static_cast<int>(std::log2(m_renderer->get_nee_plus_plus_data().hash_table_bucket_count * NEEPlusPlusDevice::HASH_TABLE_BUCKET_SIZE));
+				if (ImGui::SliderInt("Visibility cache size (log2 entries)", &hash_table_size_log2, 12, 26))
+				{
+					hash_table_size_log2 = hippt::clamp(12, 26, hash_table_size_log2);
+					m_renderer->get_nee_plus_plus_data().hash_table_bucket_count = (1u << hash_table_size_log2) / NEEPlusPlusDevice::HASH_TABLE_BUCKET_SIZE;
+
+					m_renderer->reset_nee_plus_plus();
+					m_render_window->set_render_dirty(true);
+				}
+				ImGuiRenderer::show_help_marker("The visibility between voxels is cached in a hash table of that many entries. "
+					"Only the pairs of voxels that are queried use an entry so the size of the cache doesn't depend on "
+					"the grid resolution.\n\n"
+					""
+					"When the cache is full, the pairs of voxels that haven't been used for a while are evicted.");
+
 				if (ImGui::SliderFloat("Confidence threshold", &render_data.nee_plus_plus.confidence_threshold, 0.0f, 1.0f))
 					m_render_window->set_render_dirty(true);
 				ImGuiRenderer::show_help_marker("If a voxel-to-voxel unocclusion probability is higher than that, "
@@ -2860,26 +2899,24 @@ std::string ImGuiSettingsWindow::format_perf_metrics_tooltip_line(const std::str
 	return std::string(line_char);
 }
 
-extern bool g_background_shader_compilation_enabled;
 void ImGuiSettingsWindow::draw_shader_kernels_panel()
 {
 	if (ImGui::CollapsingHeader("Shaders/Kernels"))
 	{
 		ImGui::TreePush("Shaders kernels tree");
-		std::string background_shader_compilation_button_string;
-		if (g_background_shader_compilation_enabled)
-			background_shader_compilation_button_string = "Stop background shader compilation";
+		int pending_precompilations = g_gpu_kernel_compiler.get_pending_precompilation_count();
+		if (pending_precompilations > 0)
+		{
+			if (ImGui::Button("Cancel background shader compilation"))
+				m_renderer->cancel_kernels_precompilation();
+			ImGuiRenderer::show_help_marker(std::to_string(pending_precompilations) + " shader permutations left to precompile. Click to cancel the ones that haven't started yet.");
+		}
 		else
-			background_shader_compilation_button_string = "Resume background shader compilation";
-
-		if (ImGui::Button(background_shader_compilation_button_string.c_str()))
 		{
-			if (g_background_shader_compilation_enabled)
-				m_renderer->stop_background_shader_compilation();
-			else
-				m_renderer->resume_background_shader_compilation();
+			if (ImGui::Button("Start background shader compilation"))
+				m_renderer->precompile_kernels();
+			ImGuiRenderer::show_help_marker("Click to precompile the common shader permutations in the background such that changing options compiles faster.");
 		}
-		ImGuiRenderer::show_help_marker("Click to " + (g_background_shader_compilation_enabled ? std::string("stop") : std::string("resume")) + " background shaders precompilation");
 
 		if (ImGui::Button("Force shaders reload"))
 		{
@@ -6,7 +6,7 @@
 #include "Compiler/GPUKernelCompiler.h"
 #include "Scene/SceneParser.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
 #include "tracy/TracyOpenGL.hpp"
 #include "UI/RenderWindow.h"
 #include "UI/Interaction/LinuxRenderWindowMouseInteractor.h"
@@ -301,7 +301,7 @@ void APIENTRY RenderWindow::gl_debug_output_callback(GLenum source,
 
 const std::string RenderWindow::PERF_METRICS_CPU_OVERHEAD_TIME_KEY = "CPUDisplayTime";
 
-RenderWindow::RenderWindow(int renderer_width, int renderer_height, std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx) : m_viewport_width(renderer_width), m_viewport_height(renderer_height)
+RenderWindow::RenderWindow(int renderer_width, int renderer_height, std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx, const std::vector<unsigned int>& principled_bsdf_specialized_lobe_masks, bool principled_bsdf_specializations_cover_scene) : m_viewport_width(renderer_width), m_viewport_height(renderer_height)
 {
 	// Adding the size of the windows around the viewport such that these windows
 	// have their base size and the viewport has the size the the user has asked for
@@ -315,20 +315,20 @@ RenderWindow::RenderWindow(int renderer_width, int renderer_height, std::shared_
 
 	m_application_state = std::make_shared<ApplicationState>();
 	m_application_settings = std::make_shared<ApplicationSettings>();
-	m_renderer = std::make_shared<GPURenderer>(hiprt_oro_ctx, m_application_settings);
+	m_renderer = std::make_shared<GPURenderer>(hiprt_oro_ctx, m_application_settings, principled_bsdf_specialized_lobe_masks, principled_bsdf_specializations_cover_scene);
 	m_gpu_baker = std::make_shared<GPUBaker>(m_renderer);
 
 	// Disabling auto samples per frame is accumulation is OFF
 	m_application_settings->auto_sample_per_frame = m_renderer->get_render_settings().accumulate ? m_application_settings->auto_sample_per_frame : false;
 
-	ThreadManager::start_thread(ThreadManager::RENDER_WINDOW_RENDERER_INITIAL_RESIZE, [this, renderer_width, renderer_height]() {
+	g_task_scheduler.submit([this, renderer_width, renderer_height]() {
 		m_renderer->resize(renderer_width, renderer_height, /* resize interop buffers */ false);
 	});
 	// We need to resize OpenGL interop buffers on the main thread becaues they
 	// need the OpenGL context which is only available to the main thread
 	m_renderer->resize_interop_buffers(renderer_width, renderer_height);
 
-	ThreadManager::start_thread(ThreadManager::RENDER_WINDOW_CONSTRUCTOR, [this, renderer_width, renderer_height]() {
+	g_task_scheduler.submit([this, renderer_width, renderer_height]() {
 		m_denoiser = std::make_shared<OpenImageDenoiser>();
 		m_denoiser->initialize();
 		m_denoiser->resize(renderer_width, renderer_height);
@@ -367,8 +367,9 @@ RenderWindow::~RenderWindow()
 	// other part of the app is still using buffers or whatnot
 	glfwHideWindow(m_glfw_window);
 
-	// Waiting for all threads that are currently reading from the disk (for compiling kernels in the background)
-	// to finish the reading to avoid SEGFAULTING
+	// Not starting any other background compilation and waiting for the compilations that
+	// are currently reading from the disk to finish the reading to avoid SEGFAULTING
+	g_gpu_kernel_compiler.cancel_precompilations();
 	g_gpu_kernel_compiler.wait_compiler_file_operations();
 
 	// Waiting for the renderer to finish its frame otherwise
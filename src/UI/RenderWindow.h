@@ -30,7 +30,11 @@ class RenderWindow
 public:
 	static const std::string PERF_METRICS_CPU_OVERHEAD_TIME_KEY;
 
-	RenderWindow(int width, int height, std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx);
+	/**
+	 * 'principled_bsdf_specialized_lobe_masks' and 'principled_bsdf_specializations_cover_scene'
+	 * are given to the GPURenderer, see its constructor
+	 */
+	RenderWindow(int width, int height, std::shared_ptr<HIPRTOrochiCtx> hiprt_oro_ctx, const std::vector<unsigned int>& principled_bsdf_specialized_lobe_masks = {}, bool principled_bsdf_specializations_cover_scene = false);
 	~RenderWindow();
 
 	void init_glfw(int window_width, int window_height);
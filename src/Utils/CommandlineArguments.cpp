@@ -5,6 +5,8 @@
 
 #include "Utils/CommandlineArguments.h"
 
+#include <sstream>
+
 const std::string CommandlineArguments::DEFAULT_SCENE = DATA_DIRECTORY "/GLTFs/the-white-room-low.gltf";
 const std::string CommandlineArguments::DEFAULT_SKYSPHERE = DATA_DIRECTORY "/Skyspheres/evening_road_01_puresky_2k.hdr";
 
@@ -29,6 +31,50 @@ CommandlineArguments CommandlineArguments::process_command_line_args(int argc, c
             arguments.render_height = std::atoi(string_argv.substr(4).c_str());
         else if (string_argv.starts_with("--height="))
             arguments.render_height = std::atoi(string_argv.substr(9).c_str());
+        else if (string_argv == "--no-scene-cache")
+            arguments.use_scene_cache = false;
+        else if (string_argv == "--no-texture-cache")
+            arguments.use_texture_cache = false;
+        else if (string_argv == "--texture-compression")
+            arguments.compress_textures = true;
+        else if (string_argv == "--headless")
+            arguments.headless = true;
+        else if (string_argv.starts_with("--tile-size="))
+            arguments.tile_size = std::atoi(string_argv.substr(12).c_str());
+        else if (string_argv.starts_with("--tile-order="))
+            arguments.tile_order = string_argv.substr(13);
+        else if (string_argv == "--wavefront")
+            arguments.wavefront = true;
+        else if (string_argv.starts_with("--time-budget="))
+            arguments.time_budget_seconds = std::atof(string_argv.substr(14).c_str());
+        else if (string_argv.starts_with("--checkpoint-interval="))
+            arguments.checkpoint_interval_seconds = std::atof(string_argv.substr(22).c_str());
+        else if (string_argv.starts_with("--output="))
+            arguments.output_file_path = string_argv.substr(9);
+        else if (string_argv == "--denoise")
+            arguments.denoise = true;
+        else if (string_argv.starts_with("--denoise-blend="))
+        {
+            arguments.denoise = true;
+            arguments.denoise_blend_factors.clear();
+
+            std::stringstream blend_factors(string_argv.substr(16));
+            std::string blend_factor;
+            while (std::getline(blend_factors, blend_factor, ','))
+                if (!blend_factor.empty())
+                    arguments.denoise_blend_factors.push_back(std::atof(blend_factor.c_str()));
+
+            if (arguments.denoise_blend_factors.empty())
+            {
+                std::cerr << "No blend factor given to --denoise-blend, using the fully denoised image" << std::endl;
+
+                arguments.denoise_blend_factors = { 1.0f };
+            }
+        }
+        else if (string_argv.starts_with("--denoise-max-memory-mb="))
+            arguments.denoise_max_memory_mb = std::atoi(string_argv.substr(24).c_str());
+        else if (string_argv.starts_with("--profile-trace="))
+            arguments.profile_trace_path = string_argv.substr(16);
         else
             //Assuming scene file path
             arguments.scene_file_path = string_argv;
@@ -7,6 +7,8 @@
 #define COMMANDLINE_ARGUMENTS_H
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 struct CommandlineArguments
 {
@@ -24,6 +26,43 @@ struct CommandlineArguments
 
     int render_samples = 64;
     int bounces = 8;
+
+    // --no-scene-cache to always parse the scene with ASSIMP
+    bool use_scene_cache = true;
+    // --no-texture-cache to always decode the textures from their files
+    bool use_texture_cache = true;
+    // --texture-compression to block compress the material textures (lossy), see SceneParserOptions::compress_textures
+    bool compress_textures = false;
+
+    // --headless to render on the CPU without opening a window
+    bool headless = false;
+    // --tile-size=N, size in pixels of the square tiles of the headless CPU renderer
+    int tile_size = 32;
+    // --tile-order=scanline|morton|hilbert, order in which the tiles are scheduled
+    std::string tile_order = "hilbert";
+    // --wavefront to trace the paths of the headless CPU render with the wavefront path tracer
+    bool wavefront = false;
+    // --time-budget=S, maximum rendering time in seconds of the headless CPU render.
+    // The render stops after 'render_samples' samples or after that time, whichever comes first.
+    // 0 for no time budget
+    float time_budget_seconds = 0.0f;
+    // --checkpoint-interval=S, the current state of the headless CPU render is written to
+    // 'output_file_path' every S seconds. 0 to only write the final image
+    float checkpoint_interval_seconds = 0.0f;
+    // --output=<path>, PNG output of the headless CPU render
+    std::string output_file_path = "CPU_RT_output.png";
+    // --denoise to also write a denoised version of the headless CPU render
+    bool denoise = false;
+    // --denoise-blend=B0,B1,..., blend factors between the denoised and the noisy render.
+    // One denoised image is written per blend factor, all from the same denoising. Implies --denoise
+    // An empty list keeps the default
+    std::vector<float> denoise_blend_factors = { 1.0f };
+    // --denoise-max-memory-mb=N, maximum memory used by the denoiser. Larger images are denoised
+    // in tiles by OIDN. 0 for the default of OIDN
+    int denoise_max_memory_mb = 0;
+    // --profile-trace=<path>, Chrome trace JSON of the passes of the headless CPU render.
+    // Empty for no trace
+    std::string profile_trace_path = "";
 };
 
 #endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#include "Utils/MappedFile.h"
+
+#if defined(_WIN32) || defined(_WIN32_WCE) || defined(__WIN32__)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& filepath)
+{
+    close();
+
+#if defined(_WIN32) || defined(_WIN32_WCE) || defined(__WIN32__)
+    HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+
+        return false;
+    }
+
+    m_file_handle = file;
+    m_mapping_handle = mapping;
+    m_data = static_cast<const unsigned char*>(data);
+    m_size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int file_descriptor = ::open(filepath.c_str(), O_RDONLY);
+    if (file_descriptor == -1)
+        return false;
+
+    struct stat file_stats;
+    if (fstat(file_descriptor, &file_stats) == -1 || file_stats.st_size == 0)
+    {
+        ::close(file_descriptor);
+
+        return false;
+    }
+
+    void* data = mmap(nullptr, file_stats.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    // The mapping stays valid after the file descriptor is closed
+    ::close(file_descriptor);
+    if (data == MAP_FAILED)
+        return false;
+
+    // The whole file is going to be read front to back
+    madvise(data, file_stats.st_size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<const unsigned char*>(data);
+    m_size = static_cast<size_t>(file_stats.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data == nullptr)
+        return;
+
+#if defined(_WIN32) || defined(_WIN32_WCE) || defined(__WIN32__)
+    UnmapViewOfFile(m_data);
+    CloseHandle(static_cast<HANDLE>(m_mapping_handle));
+    CloseHandle(static_cast<HANDLE>(m_file_handle));
+
+    m_mapping_handle = nullptr;
+    m_file_handle = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool MappedFile::is_open() const
+{
+    return m_data != nullptr;
+}
+
+const unsigned char* MappedFile::get_data() const
+{
+    return m_data;
+}
+
+size_t MappedFile::get_size() const
+{
+    return m_size;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2024 Tom Clabault. GNU GPL3 license.
+ * GNU GPL3 license copy: https://www.gnu.org/licenses/gpl-3.0.txt
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only view of a whole file mapped in memory.
+ * 
+ * The file is unmapped when the object is destroyed
+ */
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    /**
+     * Maps the file at 'filepath'. Returns false if the file
+     * couldn't be opened or mapped
+     */
+    bool open(const std::string& filepath);
+    void close();
+
+    bool is_open() const;
+
+    const unsigned char* get_data() const;
+    size_t get_size() const;
+
+private:
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+
+    // Windows needs the handles of the file and of the mapping to close them
+    void* m_file_handle = nullptr;
+    void* m_mapping_handle = nullptr;
+};
+
+#endif
@@ -9,14 +9,23 @@
 #include "UI/ImGui/ImGuiLogger.h"
 #include "Utils/Utils.h"
 
+#include <deque>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <iomanip> // get_current_date_string()
-#include <OpenImageDenoise/oidn.hpp>
 #include <string>
 #include <sstream>
 
 #if defined(_WIN32) || defined(_WIN32_WCE) || defined(__WIN32__)
 #include <Windows.h> // for is_file_on_SSD()
+#elif defined(__linux__)
+#include <sys/stat.h> // for is_file_on_SSD()
+#include <sys/sysmacros.h> // for major() / minor()
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h> // for __cpuid()
 #endif
 
 extern ImGuiLogger g_imgui_logger;
@@ -105,8 +114,33 @@ void* Utils::get_volume_handle_for_file(const char* filePath)
 
 bool Utils::is_file_on_ssd(const char* file_path)
 {
-#if !defined(_WIN32) && !defined(_WIN32_WCE) && !defined(__WIN32__)
-    // Not on Windows, haven't written the code to determine that on Linux yet
+#if defined(__linux__)
+    struct stat file_stat;
+    if (stat(file_path, &file_stat) != 0)
+        return false;
+
+    // /sys/dev/block/<major>:<minor> links to the block device of the file in /sys/block/,
+    // or to one of the partitions of that device
+    std::string device_number = std::to_string(major(file_stat.st_dev)) + ":" + std::to_string(minor(file_stat.st_dev));
+    std::error_code error;
+    std::filesystem::path device_path = std::filesystem::canonical("/sys/dev/block/" + device_number, error);
+    if (error)
+        // Not on a block device (network share, tmpfs, ...)
+        return false;
+
+    // The partitions don't have a queue, the queue is the one of their device
+    std::filesystem::path rotational_path = device_path / "queue" / "rotational";
+    if (!std::filesystem::exists(rotational_path, error))
+        rotational_path = device_path.parent_path() / "queue" / "rotational";
+
+    std::ifstream rotational_file(rotational_path);
+    int rotational;
+    if (!(rotational_file >> rotational))
+        return false;
+
+    return rotational == 0;
+#elif !defined(_WIN32) && !defined(_WIN32_WCE) && !defined(__WIN32__)
+    // Haven't written the code to determine that on other platforms yet
     return false;
 #else
     bool is_ssd{ false };
@@ -132,96 +166,115 @@ bool Utils::is_file_on_ssd(const char* file_path)
 #endif
 }
 
-Image32Bit Utils::OIDN_denoise(const Image32Bit& image, int width, int height, float blend_factor)
+bool Utils::cpu_supports_sse4_1()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int cpu_info[4];
+    __cpuid(cpu_info, 1);
+
+    return cpu_info[2] & (1 << 19);
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("sse4.1");
+#else
+    return false;
+#endif
+}
+
+bool Utils::cpu_supports_avx2()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int cpu_info[4];
+    __cpuid(cpu_info, 0);
+    if (cpu_info[0] < 7)
+        // The extended features leaf isn't available
+        return false;
+
+    __cpuid(cpu_info, 1);
+    bool os_uses_xsave = cpu_info[2] & (1 << 27);
+    bool cpu_supports_avx = cpu_info[2] & (1 << 28);
+    if (!os_uses_xsave || !cpu_supports_avx)
+        return false;
+
+    // Checking that the OS saves the XMM and YMM registers on context switches
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(cpu_info, 7, 0);
+
+    return cpu_info[1] & (1 << 5);
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+unsigned long long int Utils::hash_fnv1a(const void* data, size_t size, unsigned long long int hash)
 {
-    // Create an Open Image Denoise device
-    static bool device_done = false;
-    static oidn::DeviceRef device;
-    if (!device_done)
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
     {
-        // We're going to create a CPU device as there seems to be some issues with the GPU (HIP at least)
-        // device on Linux
-        int num_devices = oidnGetNumPhysicalDevices();
-        for (int i = 0; i < num_devices; i++)
-        {
-            if (static_cast<oidn::DeviceType>(oidnGetPhysicalDeviceInt(i, "type")) == oidn::DeviceType::CPU)
-            {
-                device = oidn::newDevice(i);
-                if (device.getHandle() == nullptr)
-                {
-                    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "There was an error getting the device for denoising with OIDN. Perhaps some missing libraries for your hardware?");
-                    return Image32Bit();
-                }
-                device.commit();
-
-                device_done = true;
-            }
-        }
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
     }
 
-    if (!device_done)
+    return hash;
+}
+
+void Utils::compute_alias_table(const std::vector<double>& weights, double weights_sum, std::vector<float>& out_probas, std::vector<int>& out_alias)
+{
+    // Weights normalized such that the average of the elements is 1
+    std::vector<double> normalized_weights(weights.size());
+    for (int i = 0; i < weights.size(); i++)
+        normalized_weights[i] = weights[i] / weights_sum * weights.size();
+
+    out_probas.resize(weights.size());
+    out_alias.resize(weights.size());
+
+    std::deque<int> small;
+    std::deque<int> large;
+
+    for (int i = 0; i < normalized_weights.size(); i++)
     {
-        // If we couldn't make a CPU device, trying GPU
-        device = oidn::newDevice();
-        if (device.getHandle() == nullptr)
-        {
-            g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "There was an error getting the device for denoising with OIDN. Perhaps some missing libraries for your hardware?");
-            return Image32Bit();
-        }
-        device.commit();
-
-        device_done = true;
+        if (normalized_weights[i] < 1.0f)
+            small.push_back(i);
+        else
+            large.push_back(i);
     }
 
-    if (!device_done)
+    while (!small.empty() && !large.empty())
     {
-        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Cannot create any OIDN device, aborting denoising...");
-        return Image32Bit();
+        int small_index = small.front();
+        int large_index = large.front();
+
+        small.pop_front();
+        large.pop_front();
+
+        out_probas[small_index] = normalized_weights[small_index];
+        out_alias[small_index] = large_index;
+
+        normalized_weights[large_index] = (normalized_weights[large_index] + normalized_weights[small_index]) - 1.0f;
+        if (normalized_weights[large_index] > 1.0f)
+            large.push_back(large_index);
+        else
+            small.push_back(large_index);
     }
 
+    while (!large.empty())
+    {
+        int index = large.front();
+        large.pop_front();
+
+        out_probas[index] = 1.0f;
+    }
 
-    // Create buffers for input/output images accessible by both host (CPU) and device (CPU/GPU)
-    oidn::BufferRef colorBuf = device.newBuffer(width * height * 3 * sizeof(float));
-    // Create a filter for denoising a beauty (color) image using optional auxiliary images too
-    // This can be an expensive operation, so try no to create a new filter for every image!
-    static oidn::FilterRef filter = device.newFilter("RT"); // generic ray tracing filter
-    filter.setImage("color", colorBuf, oidn::Format::Float3, width, height); // beauty
-    filter.setImage("output", colorBuf, oidn::Format::Float3, width, height); // denoised beauty
-    filter.set("hdr", true); // beauty image is HDR
-    filter.commit();
-    // Fill the input image buffers
-    float* colorPtr = (float*)colorBuf.getData();
-    for (int y = 0; y < height; y++)
-        for (int x = 0; x < width; x++)
-        {
-            int index = y * width + x;
-
-            colorPtr[index * 3 + 0] = image[index * 3 + 0];
-            colorPtr[index * 3 + 1] = image[index * 3 + 1];
-            colorPtr[index * 3 + 2] = image[index * 3 + 2];
-        }
-    // Filter the beauty image
-
-    filter.execute();
-
-    float* denoised_ptr = (float*)colorBuf.getData();
-    Image32Bit output_image(width, height, 3);
-    ColorRGB32F* output_pixels = output_image.get_data_as_ColorRGB32F();
-    for (int y = 0; y < height; y++)
-        for (int x = 0; x < width; x++)
-        {
-            int index = y * width + x;
-
-            ColorRGB32F color = blend_factor * ColorRGB32F(denoised_ptr[index * 3 + 0], denoised_ptr[index * 3 + 1], denoised_ptr[index * 3 + 2]) + (1.0f - blend_factor) * image.get_pixel_ColorRGB32F(index);
-
-            output_pixels[index] = color;
-        }
-
-    const char* errorMessage;
-    if (device.getError(errorMessage) != oidn::Error::None)
-        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_ERROR, "Error: %s", errorMessage);
-
-    return output_image;
+    while (!small.empty())
+    {
+        int index = small.front();
+        small.pop_front();
+
+        out_probas[index] = 1.0f;
+    }
 }
 
 void Utils::debugbreak()
@@ -11,6 +11,7 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 class Utils
 {
@@ -27,10 +28,27 @@ public:
     static void* get_volume_handle_for_file(const char* filePath);
     static bool is_file_on_ssd(const char* file_path);
 
-    /*
-     * A blend factor of 1 gives only the noisy image. 0 only the denoised image
+    /**
+     * Runtime CPUID checks of the instruction sets supported by the CPU (and the OS
+     * for AVX registers). Always false when not compiling for x86
+     */
+    static bool cpu_supports_sse4_1();
+    static bool cpu_supports_avx2();
+
+    /**
+     * Builds the alias table for sampling the elements of 'weights' proportionally to their weight.
+     * 'weights_sum' is the sum of all the elements of 'weights', the weights don't need to be normalized.
+     *
+     * Reference: Vose's Alias Method [https://www.keithschwarz.com/darts-dice-coins/]
+     */
+    static void compute_alias_table(const std::vector<double>& weights, double weights_sum, std::vector<float>& out_probas, std::vector<int>& out_alias);
+
+    static constexpr unsigned long long int FNV1A_64_OFFSET_BASIS = 14695981039346656037ull;
+
+    /**
+     * 64-bit FNV-1a hash of 'size' bytes, continuing from 'hash'. Used for the keys of the on-disk caches
      */
-    static Image32Bit OIDN_denoise(const Image32Bit& image, int width, int height, float blend_factor);
+    static unsigned long long int hash_fnv1a(const void* data, size_t size, unsigned long long int hash = FNV1A_64_OFFSET_BASIS);
 
     /**
      * Breaks the debugger when calling this function as if a breakpoint was hit. 
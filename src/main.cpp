@@ -10,7 +10,7 @@
 #include "Scene/Camera.h"
 #include "Scene/SceneParser.h"
 #include "Threads/ThreadFunctions.h"
-#include "Threads/ThreadManager.h"
+#include "Threads/TaskScheduler.h"
 #include "UI/RenderWindow.h"
 #include "Utils/CommandlineArguments.h"
 #include "Utils/Utils.h"
@@ -19,12 +19,12 @@
 
 #include <chrono>
 #include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <sstream>
 
 extern ImGuiLogger g_imgui_logger;
 
-#define GPU_RENDER 1
-
 int main(int argc, char* argv[])
 {   
     CommandlineArguments cmd_arguments = CommandlineArguments::process_command_line_args(argc, argv);
@@ -40,69 +40,104 @@ int main(int argc, char* argv[])
     SceneParserOptions options(cmd_arguments.scene_file_path);
 
     options.override_aspect_ratio = (float)width / height;
+    options.use_scene_cache = cmd_arguments.use_scene_cache;
+    options.use_texture_cache = cmd_arguments.use_texture_cache;
+    options.compress_textures = cmd_arguments.compress_textures;
+    // The CPU renderer (headless) samples the textures with mipmaps
+    options.generate_texture_mipmaps = cmd_arguments.headless;
     start_scene = std::chrono::high_resolution_clock::now();
     start_full = std::chrono::high_resolution_clock::now();
     Assimp::Importer assimp_importer;
     SceneParser::parse_scene_file(cmd_arguments.scene_file_path, assimp_importer, parsed_scene, options);
     stop_scene = std::chrono::high_resolution_clock::now();
 
-    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Scene geometry parsed in %ldms", std::chrono::duration_cast<std::chrono::milliseconds>(stop_scene - start_scene).count());
+    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Scene geometry parsed in %lldms", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop_scene - start_scene).count());
     g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Reading envmap %s...", cmd_arguments.skysphere_file_path.c_str());
 
     // TODO we only need 3 channels for the envmap but the only supported formats are 1, 2, 4 channels in HIP/CUDA, not 3
     Image32Bit envmap_image;
-    ThreadManager::start_thread(ThreadManager::ENVMAP_LOAD_FROM_DISK_THREAD, ThreadFunctions::read_envmap, std::ref(envmap_image), cmd_arguments.skysphere_file_path, 4, true);
-#if GPU_RENDER
-    std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx = std::make_shared<HIPRTOrochiCtx>(0);
-
-    RenderWindow render_window(width, height, hiprt_orochi_ctx);
-
-    std::shared_ptr<GPURenderer> renderer = render_window.get_renderer();
-    renderer->set_envmap(envmap_image, cmd_arguments.skysphere_file_path);
-    renderer->set_camera(parsed_scene.camera);
-    renderer->set_scene(parsed_scene);
-    // Launching the background kernel precompilation
-    renderer->precompile_kernels();
-
-    // Joining everyone before starting the render except the precompilation threads
-    ThreadManager::join_all_threads({ ThreadManager::GPU_RENDERER_PRECOMPILE_KERNELS_THREAD_KEY, ThreadManager::RENDERER_PRECOMPILE_KERNELS, ThreadManager::RESTIR_DI_PRECOMPILE_KERNELS });
-
-    stop_full = std::chrono::high_resolution_clock::now();
-    g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Full scene parsed & built in %ldms", std::chrono::duration_cast<std::chrono::milliseconds>(stop_full - start_full).count());
-    renderer->get_hiprt_scene().print_statistics(std::cout);
-
-    // We don't need the scene anymore, we can free it now (freeing the ASSIMP scene data)
-    assimp_importer.FreeScene();
-    // Freeing the renderer's scene data (i.e. the data converted from ASSIMP)
-    parsed_scene = Scene();
-    envmap_image.free();
+    TaskHandle envmap_loading_task = g_task_scheduler.submit([&envmap_image, &cmd_arguments]() {
+        ThreadFunctions::read_envmap(envmap_image, cmd_arguments.skysphere_file_path, 4, true);
+    });
+
+    if (!cmd_arguments.headless)
+    {
+        std::shared_ptr<HIPRTOrochiCtx> hiprt_orochi_ctx = std::make_shared<HIPRTOrochiCtx>(0);
+
+        // The scene is parsed before the renderer is created such that the kernels
+        // are compiled once, directly with the BSDF specializations of the scene
+        std::vector<unsigned int> specialized_lobe_masks = parsed_scene.get_principled_bsdf_specialized_lobe_masks(PRINCIPLED_BSDF_SPECIALIZED_LOBE_MASK_COUNT);
+        bool specializations_cover_scene = parsed_scene.principled_lobe_masks_cover_scene(specialized_lobe_masks);
+        RenderWindow render_window(width, height, hiprt_orochi_ctx, specialized_lobe_masks, specializations_cover_scene);
+
+        std::shared_ptr<GPURenderer> renderer = render_window.get_renderer();
+        renderer->set_envmap(envmap_image, cmd_arguments.skysphere_file_path, envmap_loading_task);
+        renderer->set_camera(parsed_scene.camera);
+        renderer->set_scene(parsed_scene);
+        // Queuing the background kernel precompilation. The precompilations are
+        // executed by the workers of the kernel compiler, not by the task scheduler
+        renderer->precompile_kernels();
+
+        // Waiting for all the scene setup tasks before starting the render
+        g_task_scheduler.wait_for_all_tasks();
+
+        stop_full = std::chrono::high_resolution_clock::now();
+        g_imgui_logger.add_line(ImGuiLoggerSeverity::IMGUI_LOGGER_INFO, "Full scene parsed & built in %lldms", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop_full - start_full).count());
+        renderer->get_hiprt_scene().print_statistics(std::cout);
+
+        // We don't need the scene anymore, we can free it now (freeing the ASSIMP scene data)
+        assimp_importer.FreeScene();
+        // Freeing the renderer's scene data (i.e. the data converted from ASSIMP)
+        parsed_scene = Scene();
+        envmap_image.free();
         
-    render_window.run();
-#else
-
-    std::cout << "[" << width << "x" << height << "]: " << cmd_arguments.render_samples << " samples ; " << cmd_arguments.bounces << " bounces" << std::endl << std::endl;
-
-    CPURenderer cpu_renderer(width, height);
-    cpu_renderer.get_render_settings().nb_bounces = cmd_arguments.bounces;
-    cpu_renderer.get_render_settings().samples_per_frame = cmd_arguments.render_samples;
-    cpu_renderer.set_envmap(envmap_image);
-    cpu_renderer.set_camera(parsed_scene.camera);
-    cpu_renderer.set_scene(parsed_scene);
-
-    stop_full = std::chrono::high_resolution_clock::now();
-    std::cout << "Full scene & textures parsed in " << std::chrono::duration_cast<std::chrono::milliseconds>(stop_full - start_full).count() << "ms" << std::endl;
-    cpu_renderer.render();
-    cpu_renderer.tonemap(2.2f, 1.0f);
-
-    Image32Bit image_denoised_1 = Utils::OIDN_denoise(cpu_renderer.get_framebuffer(), width, height, 1.0f);
-    Image32Bit image_denoised_075 = Utils::OIDN_denoise(cpu_renderer.get_framebuffer(), width, height, 0.75f);
-    Image32Bit image_denoised_05 = Utils::OIDN_denoise(cpu_renderer.get_framebuffer(), width, height, 0.5f);
-
-    cpu_renderer.get_framebuffer().write_image_png("CPU_RT_output.png");
-    image_denoised_1.write_image_png("CPU_RT_output_denoised_1.png");
-    image_denoised_075.write_image_png("CPU_RT_output_denoised_075.png");
-    image_denoised_05.write_image_png("CPU_RT_output_denoised_05.png");
-#endif
+        render_window.run();
+    }
+    else
+    {
+        std::cout << "[" << width << "x" << height << "]: " << cmd_arguments.render_samples << " samples ; " << cmd_arguments.bounces << " bounces" << std::endl << std::endl;
+
+        CPURenderer cpu_renderer(width, height);
+        cpu_renderer.get_render_settings().nb_bounces = cmd_arguments.bounces;
+        cpu_renderer.get_render_settings().samples_per_frame = cmd_arguments.render_samples;
+        cpu_renderer.set_tiled_rendering(true, cmd_arguments.tile_size, CPUTileScheduler::tile_order_from_string(cmd_arguments.tile_order));
+        cpu_renderer.set_wavefront_path_tracing(cmd_arguments.wavefront);
+        cpu_renderer.set_time_budget(cmd_arguments.time_budget_seconds);
+        if (cmd_arguments.checkpoint_interval_seconds > 0.0f)
+            cpu_renderer.set_checkpointing(cmd_arguments.output_file_path, cmd_arguments.checkpoint_interval_seconds);
+        cpu_renderer.set_profiler_trace_output(cmd_arguments.profile_trace_path);
+        cpu_renderer.set_envmap(envmap_image, envmap_loading_task);
+        cpu_renderer.set_camera(parsed_scene.camera);
+        cpu_renderer.set_scene(parsed_scene);
+        // The scene cache may still be being written
+        g_task_scheduler.wait_for_all_tasks();
+
+        stop_full = std::chrono::high_resolution_clock::now();
+        std::cout << "Full scene & textures parsed in " << std::chrono::duration_cast<std::chrono::milliseconds>(stop_full - start_full).count() << "ms" << std::endl;
+        cpu_renderer.render();
+        cpu_renderer.write_checkpoint(cmd_arguments.output_file_path);
+
+        if (cmd_arguments.denoise)
+        {
+            // One denoising for all the blend factors
+            const std::vector<float>& blend_factors = cmd_arguments.denoise_blend_factors;
+            cpu_renderer.set_denoiser_max_memory_mb(cmd_arguments.denoise_max_memory_mb);
+            std::vector<Image32Bit> denoised_images = cpu_renderer.denoise(blend_factors);
+            for (int i = 0; i < denoised_images.size(); i++)
+            {
+                std::stringstream suffix;
+                suffix << "_denoised";
+                if (blend_factors.size() > 1)
+                    suffix << "_" << blend_factors[i];
+
+                std::filesystem::path denoised_path = cmd_arguments.output_file_path;
+                denoised_path.replace_filename(denoised_path.stem().string() + suffix.str() + denoised_path.extension().string());
+
+                cpu_renderer.tonemap(denoised_images[i], 2.2f, 1.0f);
+                denoised_images[i].write_image_png(denoised_path.string().c_str());
+            }
+        }
+    }
 
     return 0;
 }